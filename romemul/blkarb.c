@@ -0,0 +1,126 @@
+/**
+ * File: blkarb.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Block arbiter between GEMDRIVE and the USB mass storage. Both run in the same
+ * loop, so a lock never waits: a conflicting request is refused and the caller decides
+ */
+
+#include "include/blkarb.h"
+
+static BlockArbiter arbiter = {.fat_start = UINT32_MAX, .root_dir_start = UINT32_MAX, .data_start = UINT32_MAX};
+
+static BlkArbRegion region_of(uint32_t lba)
+{
+    if (lba < arbiter.fat_start)
+    {
+        return BLKARB_REGION_RESERVED;
+    }
+    if (lba < arbiter.root_dir_start)
+    {
+        return BLKARB_REGION_FAT;
+    }
+    if (lba < arbiter.data_start)
+    {
+        return BLKARB_REGION_ROOT_DIR;
+    }
+    return BLKARB_REGION_DATA;
+}
+
+void blkarb_set_layout(const FATFS *fs)
+{
+    arbiter.fat_start = (uint32_t)fs->fatbase;
+    arbiter.data_start = (uint32_t)fs->database;
+    // Only FAT12 and FAT16 have a fixed root directory. Otherwise dirbase is a cluster number
+    bool fixed_root = (fs->fs_type == FS_FAT12) || (fs->fs_type == FS_FAT16);
+    arbiter.root_dir_start = fixed_root ? (uint32_t)fs->dirbase : arbiter.data_start;
+    DPRINTF("Block arbiter layout. FAT: %lu, root dir: %lu, data: %lu\n", arbiter.fat_start, arbiter.root_dir_start, arbiter.data_start);
+}
+
+uint8_t blkarb_regions(uint32_t lba, uint32_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint8_t first = region_of(lba);
+    uint8_t last = region_of(lba + count - 1);
+    uint8_t regions = 0;
+    for (uint8_t region = first; region <= last; region++)
+    {
+        regions |= BLKARB_REGION_MASK(region);
+    }
+    return regions;
+}
+
+bool blkarb_lock(BlkArbOwner owner, uint8_t regions, bool write)
+{
+    BlkArbOwner other = (owner == BLKARB_OWNER_GEMDRIVE) ? BLKARB_OWNER_USB : BLKARB_OWNER_GEMDRIVE;
+    for (int region = 0; region < BLKARB_REGIONS; region++)
+    {
+        if ((regions & BLKARB_REGION_MASK(region)) == 0)
+        {
+            continue;
+        }
+        BlkArbLock *lock = &arbiter.locks[region];
+        if ((lock->writers[other] > 0) || (write && (lock->readers[other] > 0)))
+        {
+            arbiter.conflicts++;
+            return false;
+        }
+    }
+    for (int region = 0; region < BLKARB_REGIONS; region++)
+    {
+        if (regions & BLKARB_REGION_MASK(region))
+        {
+            if (write)
+            {
+                arbiter.locks[region].writers[owner]++;
+            }
+            else
+            {
+                arbiter.locks[region].readers[owner]++;
+            }
+        }
+    }
+    return true;
+}
+
+void blkarb_unlock(BlkArbOwner owner, uint8_t regions, bool write)
+{
+    for (int region = 0; region < BLKARB_REGIONS; region++)
+    {
+        if ((regions & BLKARB_REGION_MASK(region)) == 0)
+        {
+            continue;
+        }
+        uint16_t *count = write ? &arbiter.locks[region].writers[owner] : &arbiter.locks[region].readers[owner];
+        if (*count > 0)
+        {
+            (*count)--;
+        }
+    }
+    if (write)
+    {
+        for (BlkArbOwner other = 0; other < BLKARB_OWNERS; other++)
+        {
+            if (other != owner)
+            {
+                arbiter.changed[other] |= regions;
+            }
+        }
+    }
+}
+
+uint8_t blkarb_take_changes(BlkArbOwner owner)
+{
+    uint8_t changed = arbiter.changed[owner];
+    arbiter.changed[owner] = 0;
+    return changed;
+}
+
+const BlockArbiter *blkarb_get(void)
+{
+    return &arbiter;
+}
@@ -0,0 +1,49 @@
+/**
+ * File: bootprof.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Boot time profiler. Records a timestamp for each init phase
+ */
+
+#include "include/bootprof.h"
+
+static BootProfTable boot_profile = {0};
+
+void bootprof_mark(const char *name)
+{
+    if (boot_profile.count >= BOOTPROF_MAX_MARKS)
+    {
+        return;
+    }
+    BootProfMark *mark = &boot_profile.marks[boot_profile.count];
+    // 32 bits are enough: it wraps after 71 minutes
+    mark->timestamp_us = (uint32_t)time_us_64();
+    strncpy(mark->name, name, BOOTPROF_MAX_NAME_LENGTH - 1);
+    mark->name[BOOTPROF_MAX_NAME_LENGTH - 1] = '\0';
+    boot_profile.count++;
+}
+
+void bootprof_print(void)
+{
+    DPRINTF("Boot profile. %" PRIu32 " marks:\n", boot_profile.count);
+    uint32_t previous_us = 0;
+    for (uint32_t i = 0; i < boot_profile.count; i++)
+    {
+        BootProfMark *mark = &boot_profile.marks[i];
+        DPRINTFRAW("  %-12s %10" PRIu32 " us (+%" PRIu32 " us)\n", mark->name, mark->timestamp_us, mark->timestamp_us - previous_us);
+        previous_us = mark->timestamp_us;
+    }
+}
+
+void bootprof_copy_to_shared(uint8_t *dest)
+{
+    memcpy(dest, &boot_profile, sizeof(BootProfTable));
+    BootProfTable *shared_table = (BootProfTable *)dest;
+    shared_table->count = SWAP_LONGWORD(boot_profile.count);
+    for (uint32_t i = 0; i < boot_profile.count; i++)
+    {
+        shared_table->marks[i].timestamp_us = SWAP_LONGWORD(boot_profile.marks[i].timestamp_us);
+        CHANGE_ENDIANESS_BLOCK16(shared_table->marks[i].name, BOOTPROF_MAX_NAME_LENGTH);
+    }
+}
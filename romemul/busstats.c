@@ -0,0 +1,96 @@
+/**
+ * File: busstats.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Statistics of the accesses to the cartridge bus. The IRQ only increments
+ * counters, the rates and the PIO flags are handled here from the main loop
+ */
+
+#include "include/busstats.h"
+#include "include/romemul.h"
+
+BusStats bus_stats = {0};
+
+static BusStatsReport report = {0};
+static BusStats last_stats = {0};
+static absolute_time_t next_report = {0};
+
+static void sample_fdebug(void)
+{
+    if (read_rom_sm < 0)
+    {
+        return;
+    }
+    // The flags are sticky. Write 1 to clear them
+    uint32_t rx_stall = 1u << (PIO_FDEBUG_RXSTALL_LSB + read_rom_sm);
+    uint32_t fifo_error = (1u << (PIO_FDEBUG_RXUNDER_LSB + read_rom_sm)) | (1u << (PIO_FDEBUG_TXOVER_LSB + read_rom_sm));
+    uint32_t fdebug = default_pio->fdebug & (rx_stall | fifo_error);
+    if (fdebug == 0)
+    {
+        return;
+    }
+    default_pio->fdebug = fdebug;
+    if (fdebug & rx_stall)
+    {
+        bus_stats.rx_stalls++;
+    }
+    if (fdebug & fifo_error)
+    {
+        bus_stats.fifo_errors++;
+    }
+}
+
+void busstats_poll(uint8_t *dest)
+{
+    sample_fdebug();
+    if (absolute_time_diff_us(get_absolute_time(), next_report) > 0)
+    {
+        return;
+    }
+    bool first = is_nil_time(next_report);
+    next_report = make_timeout_time_ms(BUSSTATS_REPORT_MS);
+
+    // Take a copy: the IRQ can change the counters while the report is built
+    BusStats stats = bus_stats;
+    if (!first)
+    {
+        report.rom4_per_sec = (stats.accesses[0] - last_stats.accesses[0]) * 1000 / BUSSTATS_REPORT_MS;
+        report.rom3_per_sec = (stats.accesses[1] - last_stats.accesses[1]) * 1000 / BUSSTATS_REPORT_MS;
+        report.commands_per_sec = (stats.commands - last_stats.commands) * 1000 / BUSSTATS_REPORT_MS;
+    }
+    report.rom4_accesses = stats.accesses[0];
+    report.rom3_accesses = stats.accesses[1];
+    report.commands = stats.commands;
+    report.parse_timeouts = stats.parse_timeouts;
+    report.irq_overruns = stats.irq_overruns;
+    report.rx_stalls = stats.rx_stalls;
+    report.fifo_errors = stats.fifo_errors;
+    report.sys_clock_khz = clock_get_hz(clk_sys) / 1000;
+
+    // The oversized frames are not in the report: its layout is shared with the configurator
+    if ((stats.parse_timeouts != last_stats.parse_timeouts) || (stats.parse_oversized != last_stats.parse_oversized) ||
+        (stats.irq_overruns != last_stats.irq_overruns) || (stats.rx_stalls != last_stats.rx_stalls) ||
+        (stats.fifo_errors != last_stats.fifo_errors))
+    {
+        DPRINTF("Bus: ROM4 %lu/s, ROM3 %lu/s, commands %lu/s, timeouts %lu, oversized %lu, overruns %lu, RX stalls %lu, FIFO errors %lu\n",
+                report.rom4_per_sec, report.rom3_per_sec, report.commands_per_sec,
+                report.parse_timeouts, stats.parse_oversized, report.irq_overruns, report.rx_stalls, report.fifo_errors);
+    }
+    last_stats = stats;
+
+    if (dest != NULL)
+    {
+        uint32_t *src = (uint32_t *)&report;
+        uint32_t *shared = (uint32_t *)dest;
+        for (size_t i = 0; i < sizeof(BusStatsReport) / sizeof(uint32_t); i++)
+        {
+            shared[i] = SWAP_LONGWORD(src[i]);
+        }
+    }
+}
+
+const BusStatsReport *busstats_get_report(void)
+{
+    return &report;
+}
@@ -0,0 +1,112 @@
+/**
+ * File: capture.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Capture of the ROM3 protocol traffic. The IRQ appends each word to a ring in
+ * RAM and the main loop writes the ring to the SD card in blocks
+ */
+
+#include "include/capture.h"
+
+#if CAPTURE_ROM3 != 0
+CaptureRecord capture_ring[CAPTURE_RING_SIZE];
+volatile uint32_t capture_head = 0;
+volatile uint32_t capture_tail = 0;
+uint32_t capture_lost = 0;
+
+static FIL capture_file;
+static bool capture_open = false;
+static bool capture_failed = false; // Do not truncate the capture after an error
+static absolute_time_t next_open = {0};
+static absolute_time_t next_sync = {0};
+
+static bool open_capture_file(uint32_t app)
+{
+    if (absolute_time_diff_us(get_absolute_time(), next_open) > 0)
+    {
+        return false;
+    }
+    next_open = make_timeout_time_ms(CAPTURE_RETRY_MS);
+    FRESULT fr = f_open(&capture_file, CAPTURE_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK)
+    {
+        return false;
+    }
+    CaptureHeader header = {.magic = CAPTURE_MAGIC, .version = CAPTURE_VERSION, .app = app, .record_size = sizeof(CaptureRecord)};
+    UINT bw = 0;
+    fr = f_write(&capture_file, &header, sizeof(header), &bw);
+    if ((fr != FR_OK) || (bw != sizeof(header)))
+    {
+        DPRINTF("ERROR: Could not write the capture header (%d)\n", fr);
+        f_close(&capture_file);
+        return false;
+    }
+    DPRINTF("Capturing ROM3 to %s\n", CAPTURE_FILE);
+    next_sync = make_timeout_time_ms(CAPTURE_RETRY_MS);
+    return true;
+}
+
+void capture_poll(uint32_t app)
+{
+    if (capture_failed)
+    {
+        return;
+    }
+    if (!capture_open)
+    {
+        capture_open = open_capture_file(app);
+        if (!capture_open)
+        {
+            return;
+        }
+    }
+
+    uint32_t head = capture_head;
+    uint32_t pending = head - capture_tail;
+    if (pending == 0)
+    {
+        return;
+    }
+    if (pending < CAPTURE_BLOCK_RECORDS)
+    {
+        // An incomplete block only when the ST is not sending anything
+        uint32_t last_us = capture_ring[(head - 1) & (CAPTURE_RING_SIZE - 1)].time_us;
+        if (timer_hw->timerawl - last_us < CAPTURE_IDLE_US)
+        {
+            return;
+        }
+    }
+
+    // The blocks never cross the end of the ring, except the incomplete ones
+    uint32_t index = capture_tail & (CAPTURE_RING_SIZE - 1);
+    uint32_t count = pending < CAPTURE_BLOCK_RECORDS ? pending : CAPTURE_BLOCK_RECORDS;
+    if (index + count > CAPTURE_RING_SIZE)
+    {
+        count = CAPTURE_RING_SIZE - index;
+    }
+    UINT bw = 0;
+    FRESULT fr = f_write(&capture_file, &capture_ring[index], count * sizeof(CaptureRecord), &bw);
+    if ((fr != FR_OK) || (bw != count * sizeof(CaptureRecord)))
+    {
+        DPRINTF("ERROR: Could not write the capture (%d). Capture stopped\n", fr);
+        f_close(&capture_file);
+        capture_open = false;
+        capture_failed = true;
+        return;
+    }
+    __dmb();
+    capture_tail += count;
+
+    if (absolute_time_diff_us(get_absolute_time(), next_sync) <= 0)
+    {
+        f_sync(&capture_file);
+        next_sync = make_timeout_time_ms(CAPTURE_RETRY_MS);
+    }
+}
+#else
+void capture_poll(uint32_t app)
+{
+    (void)app;
+}
+#endif
@@ -0,0 +1,146 @@
+import argparse
+import os
+import re
+import struct
+import sys
+
+# Same values as capture.h and tprotocol.h
+CAPTURE_MAGIC = 0x33504143
+HEADER_FORMAT = "<IIII"
+RECORD_FORMAT = "<IHH"
+PROTOCOL_HEADER = 0xABCD
+PROTOCOL_READ_RESTART_MICROSECONDS = 10000
+
+APP_NAMES = {0: "CONFIGURATOR", 1: "ROMEMUL", 2: "FLOPPYEMUL", 3: "RTCEMUL", 4: "GEMDRVEMUL"}
+
+
+def read_command_names(commands_file):
+    # #define NAME (APP_X << 8 | 0xNN) and the plain numbers of the configurator
+    apps = {}
+    names = {}
+    with open(commands_file, "r") as f:
+        for line in f:
+            match = re.match(r"#define\s+(APP_\w+)\s+(0x[0-9A-Fa-f]+|\d+)", line)
+            if match:
+                apps[match.group(1)] = int(match.group(2), 0)
+                continue
+            match = re.match(r"#define\s+(\w+)\s+\((APP_\w+)\s*<<\s*8\s*\|\s*(0x[0-9A-Fa-f]+|\d+)\)", line)
+            if match and match.group(2) in apps:
+                names.setdefault((apps[match.group(2)] << 8) | int(match.group(3), 0), match.group(1))
+                continue
+            match = re.match(r"#define\s+(\w+)\s+(\d+)\s", line)
+            if match:
+                names.setdefault(int(match.group(2)), match.group(1))
+    return names
+
+
+def read_capture(input_file):
+    with open(input_file, "rb") as f:
+        data = f.read()
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_size:
+        raise ValueError("The file is too short for a capture header")
+    magic, version, app, record_size = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != CAPTURE_MAGIC:
+        raise ValueError(f"Not a ROM3 capture. Magic: 0x{magic:08X}")
+    if record_size != struct.calcsize(RECORD_FORMAT):
+        raise ValueError(f"Unknown record size: {record_size}")
+    # Unwrap the 32 bit microseconds timer
+    records = []
+    offset = 0
+    last = None
+    for time_us, word, lost in struct.iter_unpack(
+        RECORD_FORMAT, data[header_size : header_size + (len(data) - header_size) // record_size * record_size]
+    ):
+        if last is not None and time_us < last:
+            offset += 1 << 32
+        last = time_us
+        records.append((time_us + offset, word, lost))
+    return version, app, records
+
+
+def parse_frames(records):
+    # The state machine of parse_protocol in tprotocol.c
+    frames = []
+    timeouts = 0
+    step = "HEADER"
+    last_header = 0
+    frame = None
+    for time_us, word, lost in records:
+        if time_us - last_header > PROTOCOL_READ_RESTART_MICROSECONDS:
+            if step != "HEADER":
+                timeouts += 1
+            step = "HEADER"
+        if step == "HEADER":
+            last_header = time_us
+            if word == PROTOCOL_HEADER:
+                frame = {"start_us": time_us, "lost": lost, "payload": []}
+                step = "COMMAND"
+            continue
+        frame["lost"] += lost
+        if step == "COMMAND":
+            frame["command"] = word
+            step = "SIZE"
+        elif step == "SIZE":
+            frame["size"] = word
+            step = "PAYLOAD" if word > 0 else "DONE"
+        elif step == "PAYLOAD":
+            frame["payload"].append(word)
+            if len(frame["payload"]) * 2 >= frame["size"]:
+                step = "DONE"
+        if step == "DONE":
+            frame["end_us"] = time_us
+            frames.append(frame)
+            step = "HEADER"
+            last_header = 0
+    return frames, timeouts
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode a ROM3 capture (rom3cap.bin) into the commands of the protocol. "
+        "To run it through the parser of the firmware, use the capture_replay of the host tests"
+    )
+    parser.add_argument("input_file", help="The capture file copied from the SD card")
+    parser.add_argument(
+        "--commands",
+        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "include", "commands.h"),
+        help="commands.h with the names of the commands",
+    )
+    parser.add_argument("--summary", action="store_true", help="Only print the summary")
+    parser.add_argument("--payload", type=int, default=8, help="Payload words to print of each command")
+    args = parser.parse_args()
+
+    names = read_command_names(args.commands) if os.path.exists(args.commands) else {}
+    version, app, records = read_capture(args.input_file)
+    frames, timeouts = parse_frames(records)
+    if not records:
+        print("The capture is empty", file=sys.stderr)
+        return 1
+
+    start = records[0][0]
+    previous = start
+    counts = {}
+    for frame in frames:
+        name = names.get(frame["command"], f"0x{frame['command']:04X}")
+        counts[name] = counts.get(name, 0) + 1
+        if not args.summary:
+            payload = " ".join(f"{word:04X}" for word in frame["payload"][: args.payload])
+            print(
+                f"{(frame['start_us'] - start) / 1000:12.3f} ms  +{frame['start_us'] - previous:8d} us  "
+                f"{name:<32} size {frame['size']:5d}  {frame['end_us'] - frame['start_us']:6d} us  {payload}"
+                f"{'  LOST ' + str(frame['lost']) if frame['lost'] else ''}"
+            )
+        previous = frame["start_us"]
+
+    duration_s = max((records[-1][0] - start) / 1000000, 1e-6)
+    print(f"\nApp: {APP_NAMES.get(app, app)}. Capture version {version}")
+    print(f"{len(records)} words, {len(frames)} commands in {duration_s:.3f} s ({len(frames) / duration_s:.1f} commands/s)")
+    print(f"Parse timeouts: {timeouts}. Words lost: {sum(record[2] for record in records)}")
+    for name in sorted(counts, key=counts.get, reverse=True):
+        print(f"  {name:<32} {counts[name]:8d}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,118 @@
+/**
+ * File: cmdstats.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Latency statistics of the commands of the Atari ST. Always on: a lookup in a
+ * small table and a few additions for each command
+ */
+
+#include "include/cmdstats.h"
+
+static CmdStatsEntry stats[CMDSTATS_MAX_COMMANDS] = {0};
+static int stats_size = 0;
+static int last_index = 0; // The same command is usually repeated. Check it first
+static uint32_t dropped = 0;
+static bool changed = false;
+static absolute_time_t next_publish = {0};
+
+static CmdStatsEntry *find_entry_of(uint16_t command)
+{
+    if ((last_index < stats_size) && (stats[last_index].command == command))
+    {
+        return &stats[last_index];
+    }
+    for (int i = 0; i < stats_size; i++)
+    {
+        if (stats[i].command == command)
+        {
+            last_index = i;
+            return &stats[i];
+        }
+    }
+    if (stats_size == CMDSTATS_MAX_COMMANDS)
+    {
+        return NULL;
+    }
+    CmdStatsEntry *entry = &stats[stats_size];
+    entry->command = command;
+    entry->min_us = UINT32_MAX;
+    last_index = stats_size++;
+    return entry;
+}
+
+void cmdstats_record(uint16_t command, uint32_t start_us)
+{
+    // 32 bits are enough: a command never takes 71 minutes
+    uint32_t elapsed_us = timer_hw->timerawl - start_us;
+    CmdStatsEntry *entry = find_entry_of(command);
+    if (entry == NULL)
+    {
+        dropped++;
+        return;
+    }
+    entry->count++;
+    entry->total_us += elapsed_us;
+    if (elapsed_us < entry->min_us)
+    {
+        entry->min_us = elapsed_us;
+    }
+    if (elapsed_us > entry->max_us)
+    {
+        entry->max_us = elapsed_us;
+    }
+    int bucket = (elapsed_us < 8) ? 0 : (32 - __builtin_clz(elapsed_us)) - 3;
+    if (bucket >= CMDSTATS_BUCKETS)
+    {
+        bucket = CMDSTATS_BUCKETS - 1;
+    }
+    entry->buckets[bucket]++;
+    changed = true;
+}
+
+int cmdstats_size(void)
+{
+    return stats_size;
+}
+
+const CmdStatsEntry *cmdstats_get_entry(int index)
+{
+    if ((index < 0) || (index >= stats_size))
+    {
+        return NULL;
+    }
+    return &stats[index];
+}
+
+uint32_t cmdstats_bucket_floor_us(int bucket)
+{
+    return (bucket == 0) ? 0 : (4u << bucket);
+}
+
+void cmdstats_publish(uint8_t *dest)
+{
+    if (!changed || (absolute_time_diff_us(get_absolute_time(), next_publish) > 0))
+    {
+        return;
+    }
+    changed = false;
+    next_publish = make_timeout_time_ms(CMDSTATS_PUBLISH_MS);
+
+    CmdStatsSharedTable *shared_table = (CmdStatsSharedTable *)dest;
+    shared_table->size = SWAP_LONGWORD(stats_size);
+    shared_table->dropped = SWAP_LONGWORD(dropped);
+    for (int i = 0; i < stats_size; i++)
+    {
+        CmdStatsEntry *entry = &stats[i];
+        CmdStatsSharedEntry *shared_entry = &shared_table->entries[i];
+        shared_entry->command = SWAP_LONGWORD(entry->command);
+        shared_entry->count = SWAP_LONGWORD(entry->count);
+        shared_entry->min_us = SWAP_LONGWORD(entry->min_us);
+        shared_entry->avg_us = SWAP_LONGWORD((uint32_t)(entry->total_us / entry->count));
+        shared_entry->max_us = SWAP_LONGWORD(entry->max_us);
+        for (int j = 0; j < CMDSTATS_BUCKETS; j++)
+        {
+            shared_entry->buckets[j] = SWAP_LONGWORD(entry->buckets[j]);
+        }
+    }
+}
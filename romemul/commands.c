@@ -29,6 +29,9 @@ const CommandName commandStr[] = {
     {CLEAN_START, "CLEAN_START"},
     {BOOT_GEMDRIVE, "BOOT_GEMDRIVE"},
     {REBOOT, "REBOOT"},
+    {GET_BOOT_PROFILE, "GET_BOOT_PROFILE"},
+    {LIST_ROMS_PAGE, "LIST_ROMS_PAGE"},
+    {LIST_FLOPPIES_PAGE, "LIST_FLOPPIES_PAGE"},
     {FLOPPYEMUL_SAVE_VECTORS, "FLOPPYEMUL_SAVE_VECTORS"},
     {FLOPPYEMUL_READ_SECTORS, "FLOPPYEMUL_READ_SECTORS"},
     {FLOPPYEMUL_WRITE_SECTORS, "FLOPPYEMUL_WRITE_SECTORS"},
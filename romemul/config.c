@@ -3,55 +3,67 @@
 // We should define ALWAYS the default entries with valid values.
 // DONT FORGET TO CHANGE MAX_ENTRIES if the number of value changes!
 static ConfigEntry defaultEntries[MAX_ENTRIES] = {
-    {PARAM_BOOT_FEATURE, TYPE_STRING, "CONFIGURATOR"},
-    {PARAM_CONFIGURATOR_DARK, TYPE_BOOL, "false"},
-    {PARAM_DELAY_ROM_EMULATION, TYPE_BOOL, "false"},
-    {PARAM_DOWNLOAD_TIMEOUT_SEC, TYPE_INT, "60"},
-    {PARAM_FILE_COUNT_ENABLED, TYPE_BOOL, "false"},
-    {PARAM_FLOPPIES_FOLDER, TYPE_STRING, "/floppies"},
-    {PARAM_FLOPPY_BOOT_ENABLED, TYPE_BOOL, "true"},
-    {PARAM_FLOPPY_BUFFER_TYPE, TYPE_INT, "0"},
-    {PARAM_FLOPPY_DB_URL, TYPE_STRING, "http://ataristdb.sidecartridge.com"},
-    {PARAM_FLOPPY_IMAGE_A, TYPE_STRING, ""},
-    {PARAM_FLOPPY_IMAGE_B, TYPE_STRING, ""},
-    {PARAM_FLOPPY_NET_ENABLED, TYPE_BOOL, "false"},
-    {PARAM_FLOPPY_NET_TOUT_SEC, TYPE_INT, "45"},
-    {PARAM_FLOPPY_XBIOS_ENABLED, TYPE_BOOL, "true"},
-    {PARAM_GEMDRIVE_BUFF_TYPE, TYPE_INT, "0"},
-    {PARAM_GEMDRIVE_DRIVE, TYPE_STRING, "C"},
-    {PARAM_GEMDRIVE_FOLDERS, TYPE_STRING, "/hd"},
-    {PARAM_GEMDRIVE_RTC, TYPE_BOOL, "true"},
-    {PARAM_GEMDRIVE_TIMEOUT_SEC, TYPE_INT, "45"},
-    {PARAM_GEMDRIVE_FAKEFLOPPY, TYPE_BOOL, "true"},
-    {PARAM_HOSTNAME, TYPE_STRING, "sidecart"},
-    {PARAM_LASTEST_RELEASE_URL, TYPE_STRING, LATEST_RELEASE_URL},
-    {PARAM_MENU_REFRESH_SEC, TYPE_INT, "3"},
-    {PARAM_NETWORK_STATUS_SEC, TYPE_INT, NETWORK_POLL_INTERVAL_STR},
-    {PARAM_ROMS_CSV_URL, TYPE_STRING, "http://roms.sidecartridge.com/roms.csv"},
-    {PARAM_ROMS_FOLDER, TYPE_STRING, "/roms"},
-    {PARAM_ROMS_YAML_URL, TYPE_STRING, "http://roms.sidecartridge.com/roms.json"},
-    {PARAM_RTC_NTP_SERVER_HOST, TYPE_STRING, "pool.ntp.org"},
-    {PARAM_RTC_NTP_SERVER_PORT, TYPE_INT, "123"},
-    {PARAM_RTC_TYPE, TYPE_STRING, "SIDECART"},
-    {PARAM_RTC_UTC_OFFSET, TYPE_STRING, "+1"},
-    {PARAM_SAFE_CONFIG_REBOOT, TYPE_BOOL, "true"},
-    {PARAM_SD_MASS_STORAGE, TYPE_BOOL, "true"},
-    {PARAM_SD_BAUD_RATE_KB, TYPE_INT, "12500"},
-    {PARAM_WIFI_AUTH, TYPE_INT, ""},
-    {PARAM_WIFI_CONNECT_TIMEOUT, TYPE_INT, "30"},
-    {PARAM_WIFI_COUNTRY, TYPE_STRING, ""},
-    {PARAM_WIFI_DHCP, TYPE_BOOL, "true"},
-    {PARAM_WIFI_DNS, TYPE_STRING, "8.8.8.8"},
-    {PARAM_WIFI_GATEWAY, TYPE_STRING, ""},
-    {PARAM_WIFI_IP, TYPE_STRING, ""},
-    {PARAM_WIFI_NETMASK, TYPE_STRING, ""},
-    {PARAM_WIFI_PASSWORD, TYPE_STRING, ""},
-    {PARAM_WIFI_POWER, TYPE_INT, "0"},
-    {PARAM_WIFI_RSSI, TYPE_BOOL, "false"},
-    {PARAM_WIFI_SCAN_SECONDS, TYPE_INT, WIFI_SCAN_POLL_COUNTER_STR},
-    {PARAM_WIFI_SSID, TYPE_STRING, ""}};
+    [CONFIG_KEY_BOOT_FEATURE] = {PARAM_BOOT_FEATURE, TYPE_STRING, "CONFIGURATOR"},
+    [CONFIG_KEY_CONFIGURATOR_DARK] = {PARAM_CONFIGURATOR_DARK, TYPE_BOOL, "false"},
+    [CONFIG_KEY_DELAY_ROM_EMULATION] = {PARAM_DELAY_ROM_EMULATION, TYPE_BOOL, "false"},
+    [CONFIG_KEY_DOWNLOAD_TIMEOUT_SEC] = {PARAM_DOWNLOAD_TIMEOUT_SEC, TYPE_INT, "60"},
+    [CONFIG_KEY_FILE_COUNT_ENABLED] = {PARAM_FILE_COUNT_ENABLED, TYPE_BOOL, "false"},
+    [CONFIG_KEY_FLOPPIES_FOLDER] = {PARAM_FLOPPIES_FOLDER, TYPE_STRING, "/floppies"},
+    [CONFIG_KEY_FLOPPY_BOOT_ENABLED] = {PARAM_FLOPPY_BOOT_ENABLED, TYPE_BOOL, "true"},
+    [CONFIG_KEY_FLOPPY_BUFFER_TYPE] = {PARAM_FLOPPY_BUFFER_TYPE, TYPE_INT, "0"},
+    [CONFIG_KEY_FLOPPY_DB_URL] = {PARAM_FLOPPY_DB_URL, TYPE_STRING, "http://ataristdb.sidecartridge.com"},
+    [CONFIG_KEY_FLOPPY_IMAGE_A] = {PARAM_FLOPPY_IMAGE_A, TYPE_STRING, ""},
+    [CONFIG_KEY_FLOPPY_IMAGE_B] = {PARAM_FLOPPY_IMAGE_B, TYPE_STRING, ""},
+    [CONFIG_KEY_FLOPPY_NET_ENABLED] = {PARAM_FLOPPY_NET_ENABLED, TYPE_BOOL, "false"},
+    [CONFIG_KEY_FLOPPY_NET_TOUT_SEC] = {PARAM_FLOPPY_NET_TOUT_SEC, TYPE_INT, "45"},
+    [CONFIG_KEY_FLOPPY_XBIOS_ENABLED] = {PARAM_FLOPPY_XBIOS_ENABLED, TYPE_BOOL, "true"},
+    [CONFIG_KEY_GEMDRIVE_BUFF_TYPE] = {PARAM_GEMDRIVE_BUFF_TYPE, TYPE_INT, "0"},
+    [CONFIG_KEY_GEMDRIVE_DRIVE] = {PARAM_GEMDRIVE_DRIVE, TYPE_STRING, "C"},
+    [CONFIG_KEY_GEMDRIVE_FOLDERS] = {PARAM_GEMDRIVE_FOLDERS, TYPE_STRING, "/hd"},
+    [CONFIG_KEY_GEMDRIVE_RTC] = {PARAM_GEMDRIVE_RTC, TYPE_BOOL, "true"},
+    [CONFIG_KEY_GEMDRIVE_TIMEOUT_SEC] = {PARAM_GEMDRIVE_TIMEOUT_SEC, TYPE_INT, "45"},
+    [CONFIG_KEY_GEMDRIVE_FAKEFLOPPY] = {PARAM_GEMDRIVE_FAKEFLOPPY, TYPE_BOOL, "true"},
+    [CONFIG_KEY_HOSTNAME] = {PARAM_HOSTNAME, TYPE_STRING, "sidecart"},
+    [CONFIG_KEY_LASTEST_RELEASE_URL] = {PARAM_LASTEST_RELEASE_URL, TYPE_STRING, LATEST_RELEASE_URL},
+    [CONFIG_KEY_MENU_REFRESH_SEC] = {PARAM_MENU_REFRESH_SEC, TYPE_INT, "3"},
+    [CONFIG_KEY_NETWORK_STATUS_SEC] = {PARAM_NETWORK_STATUS_SEC, TYPE_INT, NETWORK_POLL_INTERVAL_STR},
+    [CONFIG_KEY_ROMS_CSV_URL] = {PARAM_ROMS_CSV_URL, TYPE_STRING, "http://roms.sidecartridge.com/roms.csv"},
+    [CONFIG_KEY_ROMS_FOLDER] = {PARAM_ROMS_FOLDER, TYPE_STRING, "/roms"},
+    [CONFIG_KEY_ROMS_YAML_URL] = {PARAM_ROMS_YAML_URL, TYPE_STRING, "http://roms.sidecartridge.com/roms.json"},
+    [CONFIG_KEY_RTC_NTP_SERVER_HOST] = {PARAM_RTC_NTP_SERVER_HOST, TYPE_STRING, "pool.ntp.org"},
+    [CONFIG_KEY_RTC_NTP_SERVER_PORT] = {PARAM_RTC_NTP_SERVER_PORT, TYPE_INT, "123"},
+    [CONFIG_KEY_RTC_TYPE] = {PARAM_RTC_TYPE, TYPE_STRING, "SIDECART"},
+    [CONFIG_KEY_RTC_UTC_OFFSET] = {PARAM_RTC_UTC_OFFSET, TYPE_STRING, "+1"},
+    [CONFIG_KEY_SAFE_CONFIG_REBOOT] = {PARAM_SAFE_CONFIG_REBOOT, TYPE_BOOL, "true"},
+    [CONFIG_KEY_SD_MASS_STORAGE] = {PARAM_SD_MASS_STORAGE, TYPE_BOOL, "true"},
+    [CONFIG_KEY_SD_BAUD_RATE_KB] = {PARAM_SD_BAUD_RATE_KB, TYPE_INT, "12500"},
+    [CONFIG_KEY_WIFI_AUTH] = {PARAM_WIFI_AUTH, TYPE_INT, ""},
+    [CONFIG_KEY_WIFI_CONNECT_TIMEOUT] = {PARAM_WIFI_CONNECT_TIMEOUT, TYPE_INT, "30"},
+    [CONFIG_KEY_WIFI_COUNTRY] = {PARAM_WIFI_COUNTRY, TYPE_STRING, ""},
+    [CONFIG_KEY_WIFI_DHCP] = {PARAM_WIFI_DHCP, TYPE_BOOL, "true"},
+    [CONFIG_KEY_WIFI_DNS] = {PARAM_WIFI_DNS, TYPE_STRING, "8.8.8.8"},
+    [CONFIG_KEY_WIFI_GATEWAY] = {PARAM_WIFI_GATEWAY, TYPE_STRING, ""},
+    [CONFIG_KEY_WIFI_IP] = {PARAM_WIFI_IP, TYPE_STRING, ""},
+    [CONFIG_KEY_WIFI_NETMASK] = {PARAM_WIFI_NETMASK, TYPE_STRING, ""},
+    [CONFIG_KEY_WIFI_PASSWORD] = {PARAM_WIFI_PASSWORD, TYPE_STRING, ""},
+    [CONFIG_KEY_WIFI_POWER] = {PARAM_WIFI_POWER, TYPE_INT, "0"},
+    [CONFIG_KEY_WIFI_RSSI] = {PARAM_WIFI_RSSI, TYPE_BOOL, "false"},
+    [CONFIG_KEY_WIFI_SCAN_SECONDS] = {PARAM_WIFI_SCAN_SECONDS, TYPE_INT, WIFI_SCAN_POLL_COUNTER_STR},
+    [CONFIG_KEY_WIFI_SSID] = {PARAM_WIFI_SSID, TYPE_STRING, ""}};
 
 ConfigData configData;
+ConfigSnapshot configSnapshot;
+
+_Static_assert(CONFIG_KEY_COUNT == MAX_ENTRIES, "ConfigKeyId and MAX_ENTRIES mismatch");
+_Static_assert(MAX_ENTRIES <= CONFIG_LOG_RECORDS_PER_SECTOR, "A config snapshot must fit in one sector of the log");
+_Static_assert(MAX_ENTRIES <= 64, "The dirty entries mask is 64 bits");
+_Static_assert(CONFIG_LOG_RECORDS_PER_PAGE * sizeof(ConfigLogRecord) + sizeof(ConfigLogHeader) <= FLASH_PAGE_SIZE, "The log header does not fit in the first page");
+
+// Config log state
+static int log_active_sector = -1; // -1 if there is no valid log in FLASH
+static uint32_t log_sequence = 0;
+static uint32_t log_next_slot = 0;
+static uint64_t dirty_entries = 0; // Entries modified since the last save
 
 static ConfigEntry read_entry(uint8_t **addressOffset)
 {
@@ -92,6 +104,8 @@ static void replace_bad_domain_entries()
 {
     for (size_t i = 0; i < MAX_ENTRIES; i++)
     {
+        char old_value[MAX_STRING_VALUE_LENGTH];
+        strncpy(old_value, configData.entries[i].value, MAX_STRING_VALUE_LENGTH);
 
         if (strcmp(configData.entries[i].value, "http://ataristdb.sidecart.xyz") == 0)
         {
@@ -109,16 +123,299 @@ static void replace_bad_domain_entries()
         {
             strcpy(configData.entries[i].value, "http://atarist.sidecartridge.com/version.txt");
         }
+        if (strncmp(old_value, configData.entries[i].value, MAX_STRING_VALUE_LENGTH) != 0)
+        {
+            dirty_entries |= (1ULL << i);
+        }
     }
 }
 
-void load_all_entries()
+static bool entry_to_bool(ConfigKeyId key_id)
+{
+    return configData.entries[key_id].value[0] == 't' || configData.entries[key_id].value[0] == 'T';
+}
+
+// Only the exact values "true", "TRUE" or "T". The parameters that were always compared as strings
+static bool entry_to_exact_bool(ConfigKeyId key_id)
+{
+    const char *value = configData.entries[key_id].value;
+    return (strcmp(value, "true") == 0) || (strcmp(value, "TRUE") == 0) || (strcmp(value, "T") == 0);
+}
+
+static int entry_to_int(ConfigKeyId key_id)
+{
+    return atoi(configData.entries[key_id].value);
+}
+
+static BootFeature entry_to_boot_feature(ConfigKeyId key_id)
+{
+    const char *value = configData.entries[key_id].value;
+    if (strcmp(value, "ROM_EMULATOR") == 0)
+    {
+        return BOOT_FEATURE_ROM_EMULATOR;
+    }
+    if (strcmp(value, "FLOPPY_EMULATOR") == 0)
+    {
+        return BOOT_FEATURE_FLOPPY_EMULATOR;
+    }
+    if (strcmp(value, "RTC_EMULATOR") == 0)
+    {
+        return BOOT_FEATURE_RTC_EMULATOR;
+    }
+    if (strcmp(value, "GEMDRIVE_EMULATOR") == 0)
+    {
+        return BOOT_FEATURE_GEMDRIVE_EMULATOR;
+    }
+    // Any other value launches the configurator
+    return BOOT_FEATURE_CONFIGURATOR;
+}
+
+// Parse the entries into the typed snapshot
+static void parse_config_snapshot()
+{
+    configSnapshot.boot_feature = entry_to_boot_feature(CONFIG_KEY_BOOT_FEATURE);
+    configSnapshot.delay_rom_emulation = entry_to_exact_bool(CONFIG_KEY_DELAY_ROM_EMULATION);
+    configSnapshot.safe_config_reboot = entry_to_bool(CONFIG_KEY_SAFE_CONFIG_REBOOT);
+    configSnapshot.file_count_enabled = entry_to_bool(CONFIG_KEY_FILE_COUNT_ENABLED);
+    configSnapshot.download_timeout_sec = entry_to_int(CONFIG_KEY_DOWNLOAD_TIMEOUT_SEC);
+    configSnapshot.sd_mass_storage = entry_to_bool(CONFIG_KEY_SD_MASS_STORAGE);
+    configSnapshot.sd_baud_rate_kb = entry_to_int(CONFIG_KEY_SD_BAUD_RATE_KB);
+
+    configSnapshot.floppy_boot_enabled = entry_to_bool(CONFIG_KEY_FLOPPY_BOOT_ENABLED);
+    configSnapshot.floppy_buffer_type = entry_to_int(CONFIG_KEY_FLOPPY_BUFFER_TYPE);
+    configSnapshot.floppy_net_enabled = entry_to_bool(CONFIG_KEY_FLOPPY_NET_ENABLED);
+    configSnapshot.floppy_net_tout_sec = entry_to_int(CONFIG_KEY_FLOPPY_NET_TOUT_SEC);
+    configSnapshot.floppy_xbios_enabled = entry_to_bool(CONFIG_KEY_FLOPPY_XBIOS_ENABLED);
+
+    configSnapshot.gemdrive_buff_type = entry_to_int(CONFIG_KEY_GEMDRIVE_BUFF_TYPE);
+    configSnapshot.gemdrive_drive = configData.entries[CONFIG_KEY_GEMDRIVE_DRIVE].value[0];
+    configSnapshot.gemdrive_rtc = entry_to_bool(CONFIG_KEY_GEMDRIVE_RTC);
+    configSnapshot.gemdrive_timeout_sec = entry_to_int(CONFIG_KEY_GEMDRIVE_TIMEOUT_SEC);
+    configSnapshot.gemdrive_fakefloppy = entry_to_bool(CONFIG_KEY_GEMDRIVE_FAKEFLOPPY);
+
+    configSnapshot.rtc_ntp_server_port = entry_to_int(CONFIG_KEY_RTC_NTP_SERVER_PORT);
+
+    configSnapshot.wifi_configured = configData.entries[CONFIG_KEY_WIFI_SSID].value[0] != '\0';
+    configSnapshot.wifi_auth = entry_to_int(CONFIG_KEY_WIFI_AUTH);
+    configSnapshot.wifi_connect_timeout_sec = entry_to_int(CONFIG_KEY_WIFI_CONNECT_TIMEOUT);
+    configSnapshot.wifi_dhcp = entry_to_bool(CONFIG_KEY_WIFI_DHCP);
+    configSnapshot.wifi_power = strtoul(configData.entries[CONFIG_KEY_WIFI_POWER].value, NULL, 16);
+    configSnapshot.wifi_rssi = entry_to_bool(CONFIG_KEY_WIFI_RSSI);
+    configSnapshot.wifi_scan_seconds = entry_to_int(CONFIG_KEY_WIFI_SCAN_SECONDS);
+    configSnapshot.network_status_sec = entry_to_int(CONFIG_KEY_NETWORK_STATUS_SEC);
+}
+
+static uint32_t config_log_checksum(const ConfigLogRecord *record)
+{
+    // FNV-1a of the record without the checksum field
+    const uint8_t *data = (const uint8_t *)record;
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < offsetof(ConfigLogRecord, checksum); i++)
+    {
+        hash ^= data[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+static uint32_t config_log_sector_offset(int sector)
+{
+    return CONFIG_LOG_FLASH_OFFSET + sector * FLASH_SECTOR_SIZE;
+}
+
+// Offset of the record slot inside the sector. Records never cross a page boundary
+static uint32_t config_log_slot_offset(uint32_t slot)
+{
+    return (slot / CONFIG_LOG_RECORDS_PER_PAGE) * FLASH_PAGE_SIZE + (slot % CONFIG_LOG_RECORDS_PER_PAGE) * sizeof(ConfigLogRecord);
+}
+
+static const ConfigLogHeader *config_log_header(int sector)
+{
+    return (const ConfigLogHeader *)(XIP_BASE + config_log_sector_offset(sector) + CONFIG_LOG_RECORDS_PER_PAGE * sizeof(ConfigLogRecord));
+}
+
+static bool config_log_is_dirty(size_t key_id)
+{
+    return (dirty_entries & (1ULL << key_id)) != 0;
+}
+
+static bool config_log_is_default(size_t key_id)
+{
+    return (configData.entries[key_id].dataType == defaultEntries[key_id].dataType) &&
+           (strncmp(configData.entries[key_id].value, defaultEntries[key_id].value, MAX_STRING_VALUE_LENGTH) == 0);
+}
+
+// Find the sector with a valid header and the highest sequence number
+static int config_log_find_active_sector(uint32_t *sequence)
+{
+    int active_sector = -1;
+    for (int sector = 0; sector < CONFIG_LOG_SECTORS; sector++)
+    {
+        const ConfigLogHeader *header = config_log_header(sector);
+        if ((header->magic != (CONFIG_LOG_MAGIC ^ CONFIG_VERSION)) || (header->sequence_check != ~header->sequence))
+        {
+            continue;
+        }
+        if ((active_sector < 0) || ((int32_t)(header->sequence - *sequence) > 0))
+        {
+            active_sector = sector;
+            *sequence = header->sequence;
+        }
+    }
+    return active_sector;
+}
+
+// Apply the records of the sector on top of the default entries
+static void config_log_replay(int sector)
+{
+    const uint8_t *sector_address = (const uint8_t *)(XIP_BASE + config_log_sector_offset(sector));
+    log_next_slot = 0;
+    for (uint32_t slot = 0; slot < CONFIG_LOG_RECORDS_PER_SECTOR; slot++)
+    {
+        const ConfigLogRecord *record = (const ConfigLogRecord *)(sector_address + config_log_slot_offset(slot));
+        if (record->key_id == CONFIG_LOG_KEY_ERASED)
+        {
+            // First free slot. End of the log
+            break;
+        }
+        log_next_slot = slot + 1;
+        if ((record->key_id >= MAX_ENTRIES) || (record->checksum != config_log_checksum(record)))
+        {
+            DPRINTF("WARNING: Invalid config log record in slot %d. Ignored.\n", slot);
+            continue;
+        }
+        ConfigEntry *entry = &configData.entries[record->key_id];
+        entry->dataType = record->dataType;
+        memcpy(entry->value, record->value, MAX_STRING_VALUE_LENGTH);
+        entry->value[MAX_STRING_VALUE_LENGTH - 1] = '\0';
+    }
+}
+
+// Program the pages of the given slots, one program per page touched. The bytes outside the new
+// records are 0xFF, so the records already in the page are not modified. A page shared with earlier
+// records is programmed again, and the first page twice when a snapshot does not fit in it: first
+// with its records and last with the header
+static void config_log_program_records(int sector, uint32_t first_slot, const uint16_t *key_ids, size_t num_records, const ConfigLogHeader *header)
+{
+    uint8_t page_buffer[FLASH_PAGE_SIZE];
+    uint32_t sector_offset = config_log_sector_offset(sector);
+    size_t i = 0;
+    do
+    {
+        uint32_t page = (num_records > 0) ? (first_slot + i) / CONFIG_LOG_RECORDS_PER_PAGE : 0;
+        memset(page_buffer, 0xFF, FLASH_PAGE_SIZE);
+        while ((i < num_records) && ((first_slot + i) / CONFIG_LOG_RECORDS_PER_PAGE == page))
+        {
+            ConfigEntry *entry = &configData.entries[key_ids[i]];
+            ConfigLogRecord *record = (ConfigLogRecord *)(page_buffer + config_log_slot_offset(first_slot + i) % FLASH_PAGE_SIZE);
+            record->key_id = key_ids[i];
+            record->dataType = entry->dataType;
+            memcpy(record->value, entry->value, MAX_STRING_VALUE_LENGTH);
+            record->checksum = config_log_checksum(record);
+            i++;
+        }
+        if ((header != NULL) && (page == 0) && (i >= num_records))
+        {
+            // Commit the header with the last page of the snapshot when it is the first one
+            memcpy(page_buffer + CONFIG_LOG_RECORDS_PER_PAGE * sizeof(ConfigLogRecord), header, sizeof(ConfigLogHeader));
+            header = NULL;
+        }
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(sector_offset + page * FLASH_PAGE_SIZE, page_buffer, FLASH_PAGE_SIZE);
+        restore_interrupts(ints);
+    } while (i < num_records);
+
+    if (header != NULL)
+    {
+        // Commit the header of the snapshot. Programmed last to survive a power loss
+        memset(page_buffer, 0xFF, FLASH_PAGE_SIZE);
+        memcpy(page_buffer + CONFIG_LOG_RECORDS_PER_PAGE * sizeof(ConfigLogRecord), header, sizeof(ConfigLogHeader));
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(sector_offset, page_buffer, FLASH_PAGE_SIZE);
+        restore_interrupts(ints);
+    }
+}
+
+// Write the entries that differ from the defaults in the next sector of the log
+static int config_log_compact()
+{
+    uint16_t key_ids[MAX_ENTRIES];
+    size_t num_records = 0;
+    for (size_t i = 0; i < configData.count && i < MAX_ENTRIES; i++)
+    {
+        if (!config_log_is_default(i))
+        {
+            key_ids[num_records++] = i;
+        }
+    }
+
+    int next_sector = (log_active_sector + 1) % CONFIG_LOG_SECTORS;
+    ConfigLogHeader header = {
+        .magic = CONFIG_LOG_MAGIC ^ CONFIG_VERSION,
+        .sequence = log_sequence + 1,
+        .sequence_check = ~(log_sequence + 1),
+        .reserved = 0xFFFFFFFF};
+
+    DPRINTF("Compacting %d config entries in log sector %d.\n", num_records, next_sector);
+
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(config_log_sector_offset(next_sector), FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+
+    config_log_program_records(next_sector, 0, key_ids, num_records, &header);
+
+    log_active_sector = next_sector;
+    log_sequence = header.sequence;
+    log_next_slot = num_records;
+    return 0;
+}
+
+// Append the modified entries to the active sector of the log
+static int config_log_append()
+{
+    uint16_t key_ids[MAX_ENTRIES];
+    size_t num_records = 0;
+    for (size_t i = 0; i < configData.count && i < MAX_ENTRIES; i++)
+    {
+        if (config_log_is_dirty(i))
+        {
+            key_ids[num_records++] = i;
+        }
+    }
+    if (num_records == 0)
+    {
+        DPRINTF("No config entries modified. Nothing to write.\n");
+        return 0;
+    }
+    if ((log_active_sector < 0) || (log_next_slot + num_records > CONFIG_LOG_RECORDS_PER_SECTOR))
+    {
+        return config_log_compact();
+    }
+    DPRINTF("Appending %d config entries to log sector %d, slot %d.\n", num_records, log_active_sector, log_next_slot);
+    config_log_program_records(log_active_sector, log_next_slot, key_ids, num_records, NULL);
+    log_next_slot += num_records;
+    return 0;
+}
+
+static void load_entries_from_flash()
 {
     uint8_t *currentAddress = (uint8_t *)(CONFIG_FLASH_OFFSET + XIP_BASE);
 
     // First, load default entries
     load_default_entries();
+    dirty_entries = 0;
+
+    // Then apply the config log if exists
+    log_active_sector = config_log_find_active_sector(&log_sequence);
+    if (log_active_sector >= 0)
+    {
+        config_log_replay(log_active_sector);
+        DPRINTF("Config log found in sector %d. Sequence: %u. Records: %d\n", log_active_sector, log_sequence, log_next_slot);
+        replace_bad_domain_entries();
+        return;
+    }
 
+    // No log. Try the legacy config. It will be migrated to the log in the next write
     uint8_t count = 0;
 
     const uint32_t magic = *(uint32_t *)currentAddress;
@@ -159,6 +456,17 @@ void load_all_entries()
     replace_bad_domain_entries();
 }
 
+void load_all_entries()
+{
+    load_entries_from_flash();
+    parse_config_snapshot();
+}
+
+ConfigEntry *find_entry_by_id(ConfigKeyId key_id)
+{
+    return &configData.entries[key_id];
+}
+
 ConfigEntry *find_entry(const char key[MAX_KEY_LENGTH])
 {
     for (size_t i = 0; i < configData.count; i++)
@@ -193,10 +501,15 @@ static int add_entry(const char key[MAX_KEY_LENGTH], DataType dataType, char val
         if (strncmp(configData.entries[i].key, key, MAX_KEY_LENGTH) == 0)
         {
             // Key already exists. Update its value and dataType
+            if ((configData.entries[i].dataType != dataType) || (strncmp(configData.entries[i].value, value, MAX_STRING_VALUE_LENGTH - 1) != 0))
+            {
+                dirty_entries |= (1ULL << i);
+            }
             configData.entries[i].dataType = dataType;
             strncpy(configData.entries[i].value, value, MAX_STRING_VALUE_LENGTH - 1);
             configData.entries[i].value[MAX_STRING_VALUE_LENGTH - 1] = '\0'; // Ensure null-termination
-            return 0;                                                        // Successfully updated existing entry
+            parse_config_snapshot();
+            return 0; // Successfully updated existing entry
         }
     }
 
@@ -210,6 +523,7 @@ static int add_entry(const char key[MAX_KEY_LENGTH], DataType dataType, char val
     strncpy(configData.entries[configData.count].value, value, MAX_STRING_VALUE_LENGTH - 1);
     configData.entries[configData.count].value[MAX_STRING_VALUE_LENGTH - 1] = '\0'; // Ensure null-termination
     configData.count++;
+    parse_config_snapshot();
 
     return 0; // Successfully added new entry
 }
@@ -271,32 +585,21 @@ int put_integer(const char key[MAX_KEY_LENGTH], int value)
 
 int write_all_entries()
 {
-
-    uint8_t *address = (uint8_t *)(CONFIG_FLASH_OFFSET + XIP_BASE);
-
     // Ensure we don't exceed the reserved space
-    if (configData.count * sizeof(ConfigEntry) > CONFIG_FLASH_SIZE)
+    if (configData.count > CONFIG_LOG_RECORDS_PER_SECTOR)
     {
         return -1; // Error: Config size exceeds reserved space
     }
     print_config_table();
     DPRINTF("Writing %d entries to FLASH.\n", configData.count);
-    DPRINTF("Size of ConfigData: %d\n", sizeof(ConfigData));
-    DPRINTF("Size of ConfigEntry: %d\n", sizeof(ConfigEntry));
-    DPRINTF("Size of entries: %d\n", configData.count * sizeof(ConfigEntry));
-
-    uint32_t ints = save_and_disable_interrupts();
-
-    // Erase the content before writing the configuration
-    // overwriting it's not enough
-    flash_range_erase(CONFIG_FLASH_OFFSET, CONFIG_FLASH_SIZE); // 4 Kbytes
-
-    // Transfer config to FLASH
-    flash_range_program(CONFIG_FLASH_OFFSET, (uint8_t *)&configData, sizeof(configData));
-
-    restore_interrupts(ints);
 
-    return 0; // Successful write
+    // Without a log (first boot or legacy config) a full snapshot is needed
+    int err = (log_active_sector < 0) ? config_log_compact() : config_log_append();
+    if (err == 0)
+    {
+        dirty_entries = 0;
+    }
+    return err;
 }
 
 int reset_config_default()
@@ -306,10 +609,15 @@ int reset_config_default()
     // Erase the content before writing the configuration
     // overwriting it's not enough
     flash_range_erase(CONFIG_FLASH_OFFSET, CONFIG_FLASH_SIZE); // 4 Kbytes
+    flash_range_erase(CONFIG_LOG_FLASH_OFFSET, CONFIG_LOG_FLASH_SIZE);
 
     restore_interrupts(ints);
 
+    log_active_sector = -1;
+    log_sequence = 0;
+    log_next_slot = 0;
     load_default_entries();
+    parse_config_snapshot();
 
     write_all_entries();
     return 0; // Successful write
@@ -432,6 +740,8 @@ void reboot()
     DPRINTF("Requesting AIRCR_Register reset...\n");
     AIRCR_Register = 0x5FA0004;
     DPRINTF("Now ASM code to reset...\n");
+    // The host tests build this file without the ARM code
+#if defined(__arm__)
     asm volatile(
         "mov r0, %[start]\n"
         "ldr r1, =%[vtable]\n"
@@ -442,6 +752,7 @@ void reboot()
         :
         : [start] "r"(XIP_BASE + 0x100), [vtable] "X"(PPB_BASE + M0PLUS_VTOR_OFFSET)
         :);
+#endif
     while (1)
     {
         DPRINTF("Reboot failed.\n");
@@ -33,6 +33,9 @@ const uint32_t CONFIG_FLASH_SIZE = 4096;
 const uint32_t CONFIG_FLASH_OFFSET = FLASH_ROM_LOAD_OFFSET - CONFIG_FLASH_SIZE; // Offset FLASH where the config is stored. Survives a reset or poweroff.
 const uint32_t CONFIG_VERSION = 0x00000001;                                     // Version of the config. Used to check if the config is compatible with the current code.
 const uint32_t CONFIG_MAGIC = 0x12340000;                                       // Magic number to check if the config exists in FLASH.
+const uint32_t CONFIG_LOG_FLASH_SIZE = 4096 * 4;                                // Size of the config log in FLASH. 4 sectors of 4Kbytes
+const uint32_t CONFIG_LOG_FLASH_OFFSET = CONFIG_FLASH_OFFSET - CONFIG_LOG_FLASH_SIZE; // Offset FLASH where the config log is stored. Below the legacy config.
+const uint32_t CONFIG_LOG_MAGIC = 0x434C4F47;                                   // Magic number of a valid config log sector ("CLOG")
 
 // Atari ST constants.
 const uint32_t ATARI_ROM4_START_ADDRESS = 0xFA0000; // Start address of the Atari ST ROM4
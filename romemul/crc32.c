@@ -0,0 +1,44 @@
+/**
+ * File: crc32.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Table driven CRC32, reflected polynomial 0xEDB88320
+ */
+
+#include "include/crc32.h"
+
+#include <stdbool.h>
+
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+static uint32_t crc32_table[256];
+static bool crc32_table_ready = false;
+
+static void crc32_build_table()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+        }
+        crc32_table[i] = crc;
+    }
+    crc32_table_ready = true;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    if (!crc32_table_ready)
+    {
+        crc32_build_table();
+    }
+    crc = ~crc;
+    while (length--)
+    {
+        crc = crc32_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
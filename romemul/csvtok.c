@@ -0,0 +1,145 @@
+/**
+ * File: csvtok.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Streaming CSV tokenizer. Parses the catalogs as the bytes arrive from the network
+ */
+
+#include "include/csvtok.h"
+
+static void append_char(CsvTokenizer *tokenizer, char c)
+{
+    // Silently truncate the fields that do not fit
+    if (tokenizer->field_length < CSV_TOKENIZER_MAX_FIELD_LENGTH - 1)
+    {
+        tokenizer->value[tokenizer->field_length++] = c;
+    }
+}
+
+static void end_field(CsvTokenizer *tokenizer)
+{
+    tokenizer->value[tokenizer->field_length] = '\0';
+    tokenizer->field_callback(tokenizer->arg, tokenizer->record, tokenizer->field, tokenizer->value);
+    tokenizer->field++;
+    tokenizer->field_length = 0;
+    tokenizer->state = CSV_FIELD_START;
+}
+
+static void end_record(CsvTokenizer *tokenizer)
+{
+    end_field(tokenizer);
+    if (tokenizer->record_callback != NULL)
+    {
+        tokenizer->record_callback(tokenizer->arg, tokenizer->record);
+    }
+    tokenizer->record++;
+    tokenizer->field = 0;
+}
+
+void csv_tokenizer_init(CsvTokenizer *tokenizer, char separator, csv_field_callback_t field_callback, csv_record_callback_t record_callback, void *arg)
+{
+    tokenizer->state = CSV_FIELD_START;
+    tokenizer->separator = separator;
+    tokenizer->record = 0;
+    tokenizer->field = 0;
+    tokenizer->field_length = 0;
+    tokenizer->field_callback = field_callback;
+    tokenizer->record_callback = record_callback;
+    tokenizer->arg = arg;
+}
+
+void csv_tokenizer_feed(CsvTokenizer *tokenizer, const char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = data[i];
+        switch (tokenizer->state)
+        {
+        case CSV_FIELD_START:
+            if (c == '"')
+            {
+                tokenizer->state = CSV_QUOTED;
+            }
+            else if (c == tokenizer->separator)
+            {
+                end_field(tokenizer);
+            }
+            else if (c == '\n')
+            {
+                // Skip the empty lines
+                if (tokenizer->field > 0)
+                {
+                    end_record(tokenizer);
+                }
+            }
+            else if ((c != ' ') && (c != '\t') && (c != '\r'))
+            {
+                append_char(tokenizer, c);
+                tokenizer->state = CSV_UNQUOTED;
+            }
+            break;
+        case CSV_UNQUOTED:
+            if (c == tokenizer->separator)
+            {
+                end_field(tokenizer);
+            }
+            else if (c == '\n')
+            {
+                end_record(tokenizer);
+            }
+            else if (c != '\r')
+            {
+                append_char(tokenizer, c);
+            }
+            break;
+        case CSV_QUOTED:
+            if (c == '"')
+            {
+                tokenizer->state = CSV_QUOTE_QUOTED;
+            }
+            else
+            {
+                append_char(tokenizer, c);
+            }
+            break;
+        case CSV_QUOTE_QUOTED:
+            if (c == '"')
+            {
+                // Escaped quote
+                append_char(tokenizer, c);
+                tokenizer->state = CSV_QUOTED;
+                break;
+            }
+            tokenizer->state = CSV_AFTER_QUOTED;
+            // Handle the character after the closing quote
+            __attribute__((fallthrough));
+        case CSV_AFTER_QUOTED:
+            if (c == tokenizer->separator)
+            {
+                end_field(tokenizer);
+            }
+            else if (c == '\n')
+            {
+                end_record(tokenizer);
+            }
+            break;
+        }
+    }
+}
+
+void csv_tokenizer_feed_pbuf(CsvTokenizer *tokenizer, const struct pbuf *p)
+{
+    for (const struct pbuf *q = p; q != NULL; q = q->next)
+    {
+        csv_tokenizer_feed(tokenizer, (const char *)q->payload, q->len);
+    }
+}
+
+void csv_tokenizer_finish(CsvTokenizer *tokenizer)
+{
+    if ((tokenizer->field > 0) || (tokenizer->state != CSV_FIELD_START))
+    {
+        end_record(tokenizer);
+    }
+}
@@ -0,0 +1,136 @@
+/**
+ * File: dallas.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The Dallas DS1216 clock of the RTC emulator. The ST writes the magic sequence as
+ * reads of two addresses, and then reads the 64 bits of the clock one by one
+ */
+
+#include "include/dallas.h"
+#include "include/tprotocol.h"
+
+// Function to convert a binary number to BCD format
+static inline uint8_t dallas_to_bcd(uint8_t val)
+{
+    return ((val / 10) << 4) | (val % 10);
+}
+
+// Function to populate the magic_sequence_dallas_rtc
+static void populate_magic_sequence(DallasClock *clock)
+{
+    // Loop through each bit of the 64-bit hex value. Leave the first two bits untouched
+    for (int i = 2; i < 66; i++)
+    {
+        // Check if the bit is 0 or 1 by shifting hex_value right i positions
+        // and checking the least significant bit
+        if ((clock->magic_sequence_hex >> (i - 2)) & 1)
+        {
+            clock->magic_sequence[i] = clock->write_address_bit_one; // If the bit is 1
+        }
+        else
+        {
+            clock->magic_sequence[i] = clock->write_address_bit_zero; // If the bit is 0
+        }
+    }
+}
+
+// Function to populate the clock_sequence_dallas_rtc
+static void populate_clock_sequence(uint8_t *sequence, uint8_t bcd_value)
+{
+    // Loop through each bit of the 8 bit BDC value
+    for (int i = 0; i < 8; i++)
+    {
+        // Check if the bit is 0 or 1 by shifting bcd_value right i positions
+        // and checking the least significant bit
+        if ((bcd_value >> i) & 1)
+        {
+            sequence[i] = 0xFF; // If the bit is 1
+        }
+        else
+        {
+            sequence[i] = 0x0; // If the bit is 0
+        }
+    }
+}
+
+void dallas_init(DallasClock *clock, uint32_t rom_address)
+{
+    memset(clock, 0, sizeof(DallasClock));
+    clock->magic_sequence_hex = DALLAS_MAGIC_SEQUENCE_HEX;
+    clock->read_address_bit = DALLAS_READ_ADDRESS_BIT;
+    clock->write_address_bit_zero = DALLAS_WRITE_ADDRESS_BIT_ZERO;
+    clock->write_address_bit_one = DALLAS_WRITE_ADDRESS_BIT_ONE;
+    clock->size_magic_sequence = sizeof(clock->magic_sequence);
+    clock->size_clock_sequence = sizeof(clock->clock_sequence[0]);
+    clock->prepared_second = -1;
+    clock->rom_address = rom_address;
+
+    // Populate the magic_sequence_dallas_rtc array
+    populate_magic_sequence(clock);
+}
+
+bool dallas_prepare(DallasClock *clock, const datetime_t *now)
+{
+    if (now->sec == clock->prepared_second)
+    {
+        return false;
+    }
+    uint8_t next = clock->ready_sequence ^ 1;
+    uint8_t *sequence = clock->clock_sequence[next];
+    memset(sequence, 0, clock->size_clock_sequence);
+
+    // Set the values in the clock_sequence_dallas_rtc. The hundredths of second are always zero
+    populate_clock_sequence(&sequence[8 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->sec));
+    populate_clock_sequence(&sequence[16 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->min));
+    populate_clock_sequence(&sequence[24 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->hour));
+    populate_clock_sequence(&sequence[32 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->dotw));
+    populate_clock_sequence(&sequence[40 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->day));
+    populate_clock_sequence(&sequence[48 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->month));
+    populate_clock_sequence(&sequence[56 - DALLAS_OFFSET_SYNC], dallas_to_bcd(now->year % 100));
+
+    clock->ready_sequence = next;
+    clock->prepared_second = now->sec;
+    return true;
+}
+
+bool __not_in_flash_func(dallas_access)(DallasClock *clock, uint8_t addr_lsb, uint64_t now_us, uint8_t *clock_bit)
+{
+    // Reset counter
+    if (now_us - clock->last_magic_found > PROTOCOL_READ_RESTART_MICROSECONDS)
+    {
+        clock->last_magic_found = now_us;
+        clock->retries = 0;
+    }
+
+    // Check the magic sequence of the Dallas RTC
+    if ((clock->retries < clock->size_magic_sequence) && (clock->magic_sequence[clock->retries] == addr_lsb))
+    {
+        clock->retries++;
+        if (clock->retries == clock->size_magic_sequence)
+        {
+            // We have the magic sequence. The time and date of the internal RTC mimicking the Dallas RTC clock
+            // is already prepared by the main loop: latch the buffer of the current second
+            if (clock->prepared_second >= 0)
+            {
+                clock->serving_sequence = clock->ready_sequence;
+                clock->retries = 0;
+            }
+        }
+        return false;
+    }
+
+    // Now we have to put the time and date of the internal RTC mimicking the Dallas RTC clock
+    if (clock->retries > (clock->size_magic_sequence + clock->size_clock_sequence))
+    {
+        return false;
+    }
+    *clock_bit = 0;
+    if ((clock->retries >= clock->size_magic_sequence) && (clock->retries - clock->size_magic_sequence < clock->size_clock_sequence))
+    {
+        *clock_bit = clock->clock_sequence[clock->serving_sequence][clock->retries - clock->size_magic_sequence];
+    }
+    // 32 bit the date and 32 bit the time
+    clock->retries++;
+    return true;
+}
@@ -0,0 +1,181 @@
+/**
+ * File: dircache.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Short-lived directory listing cache shared by the FTP server and the web catalog
+ */
+
+#include "include/dircache.h"
+
+static DirCache *slots[DIRCACHE_SLOTS] = {NULL};
+
+// The last directory found too big. It is not scanned again until it is old or invalidated
+static char too_big_path[DIRCACHE_MAX_PATH] = {0};
+static uint64_t too_big_us = 0;
+
+// Count the entries and the bytes of the names without allocating anything
+static FRESULT scan_directory(const char *path, uint32_t *count, uint32_t *names_size)
+{
+    DIR dir;
+    FILINFO fno;
+    FRESULT fr = f_opendir(&dir, path);
+    *count = 0;
+    *names_size = 0;
+    while (fr == FR_OK)
+    {
+        fr = f_readdir(&dir, &fno);
+        if ((fr != FR_OK) || (fno.fname[0] == 0))
+        {
+            break;
+        }
+        (*count)++;
+        *names_size += strlen(fno.fname) + 1;
+    }
+    f_closedir(&dir);
+    return fr;
+}
+
+static DirCache *load_directory(const char *path)
+{
+    uint32_t count;
+    uint32_t names_size;
+    if (scan_directory(path, &count, &names_size) != FR_OK)
+    {
+        DPRINTF("Cannot read directory %s\n", path);
+        return NULL;
+    }
+    uint32_t size = sizeof(DirCache) + count * sizeof(DirCacheEntry) + names_size;
+    if (size > DIRCACHE_MAX_SIZE)
+    {
+        DPRINTF("Directory %s too big to be cached: %d bytes\n", path, size);
+        strncpy(too_big_path, path, sizeof(too_big_path) - 1);
+        too_big_path[sizeof(too_big_path) - 1] = '\0';
+        too_big_us = time_us_64();
+        return NULL;
+    }
+    DirCache *cache = malloc(size);
+    if (cache == NULL)
+    {
+        DPRINTF("Not enough memory to cache directory %s\n", path);
+        return NULL;
+    }
+    strncpy(cache->path, path, sizeof(cache->path) - 1);
+    cache->path[sizeof(cache->path) - 1] = '\0';
+    cache->refs = 0;
+    cache->entries = (DirCacheEntry *)(cache + 1);
+    cache->names = (char *)(cache->entries + count);
+
+    DIR dir;
+    FILINFO fno;
+    uint32_t names_pos = 0;
+    uint32_t index = 0;
+    FRESULT fr = f_opendir(&dir, path);
+    while ((fr == FR_OK) && (index < count))
+    {
+        fr = f_readdir(&dir, &fno);
+        if ((fr != FR_OK) || (fno.fname[0] == 0))
+        {
+            break;
+        }
+        size_t name_length = strlen(fno.fname) + 1;
+        if (names_pos + name_length > names_size)
+        {
+            break;
+        }
+        DirCacheEntry *entry = &cache->entries[index++];
+        entry->size = (uint32_t)fno.fsize;
+        entry->name_offset = names_pos;
+        entry->fdate = fno.fdate;
+        entry->ftime = fno.ftime;
+        entry->attrib = fno.fattrib;
+        memcpy(cache->names + names_pos, fno.fname, name_length);
+        names_pos += name_length;
+    }
+    f_closedir(&dir);
+    if (fr != FR_OK)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->count = index;
+    cache->loaded_us = time_us_64();
+    DPRINTF("Directory %s cached: %d entries, %d bytes\n", path, cache->count, size);
+    return cache;
+}
+
+static void drop_slot(int slot)
+{
+    if (slots[slot] != NULL)
+    {
+        dircache_release(slots[slot]);
+        slots[slot] = NULL;
+    }
+}
+
+DirCache *dircache_get(const char *path)
+{
+    uint64_t now = time_us_64();
+    int victim = 0;
+    for (int i = 0; i < DIRCACHE_SLOTS; i++)
+    {
+        DirCache *cache = slots[i];
+        if (cache == NULL)
+        {
+            victim = i;
+            continue;
+        }
+        if (strcasecmp(cache->path, path) == 0)
+        {
+            if (now - cache->loaded_us < (uint64_t)DIRCACHE_TTL_MS * 1000)
+            {
+                cache->refs++;
+                return cache;
+            }
+            // Too old. Read it again in the same slot
+            victim = i;
+            break;
+        }
+        if ((slots[victim] != NULL) && (cache->loaded_us < slots[victim]->loaded_us))
+        {
+            victim = i;
+        }
+    }
+
+    if ((strcasecmp(too_big_path, path) == 0) && (now - too_big_us < (uint64_t)DIRCACHE_TTL_MS * 1000))
+    {
+        return NULL;
+    }
+    DirCache *cache = load_directory(path);
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    drop_slot(victim);
+    cache->refs = 2; // The slot and the caller
+    slots[victim] = cache;
+    return cache;
+}
+
+void dircache_release(DirCache *cache)
+{
+    if ((cache != NULL) && (--cache->refs == 0))
+    {
+        free(cache);
+    }
+}
+
+void dircache_invalidate(const char *path)
+{
+    if ((path == NULL) || (strcasecmp(too_big_path, path) == 0))
+    {
+        too_big_path[0] = '\0';
+    }
+    for (int i = 0; i < DIRCACHE_SLOTS; i++)
+    {
+        if ((slots[i] != NULL) && ((path == NULL) || (strcasecmp(slots[i]->path, path) == 0)))
+        {
+            drop_slot(i);
+        }
+    }
+}
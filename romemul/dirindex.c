@@ -0,0 +1,421 @@
+/**
+ * File: dirindex.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Sorted index of the ROM and floppy image folders stored in the SD card
+ */
+
+#include "include/dirindex.h"
+
+static uint32_t dirindex_hash(uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= DIRINDEX_FNV_PRIME;
+    }
+    return hash;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcasecmp(*(const char **)a, *(const char **)b);
+}
+
+// Only visible files with an allowed extension are indexed
+static bool is_indexed(const FILINFO *fno, const char **allowed_extensions, size_t num_extensions)
+{
+    return (fno->fname[0] != '.') && !(fno->fattrib & AM_DIR) && has_allowed_extension(fno->fname, allowed_extensions, num_extensions);
+}
+
+// FAT does not update the modification time of a folder when its content changes, so the
+// signature is calculated from the entries themselves. No memory is allocated here.
+static FRESULT scan_folder(const char *dir, const char **allowed_extensions, size_t num_extensions, uint32_t *signature, uint32_t *count)
+{
+    DIR dj;
+    FILINFO fno;
+    *signature = DIRINDEX_FNV_OFFSET_BASIS;
+    *count = 0;
+
+    FRESULT fr = f_findfirst(&dj, &fno, dir, "*");
+    while (fr == FR_OK && fno.fname[0])
+    {
+        if (is_indexed(&fno, allowed_extensions, num_extensions))
+        {
+            *signature = dirindex_hash(*signature, fno.fname, strlen(fno.fname));
+            *signature = dirindex_hash(*signature, &fno.fsize, sizeof(fno.fsize));
+            *signature = dirindex_hash(*signature, &fno.fdate, sizeof(fno.fdate));
+            *signature = dirindex_hash(*signature, &fno.ftime, sizeof(fno.ftime));
+            (*count)++;
+        }
+        fr = f_findnext(&dj, &fno);
+    }
+    f_closedir(&dj);
+    return fr;
+}
+
+static FRESULT open_index(const char *dir, const char *index_filename, FIL *file, DirIndexHeader *header)
+{
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s/%s", dir, index_filename);
+
+    FRESULT fr = f_open(file, index_path, FA_READ);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    unsigned int br = 0;
+    fr = f_read(file, header, sizeof(DirIndexHeader), &br);
+    if ((fr == FR_OK) && ((br != sizeof(DirIndexHeader)) || (header->magic != DIRINDEX_MAGIC) || (header->version != DIRINDEX_VERSION)))
+    {
+        fr = FR_NO_FILE;
+    }
+    if (fr != FR_OK)
+    {
+        f_close(file);
+    }
+    return fr;
+}
+
+// Read the offset of a name relative to the start of the names blob
+static FRESULT read_offset(FIL *file, uint32_t index, uint32_t *offset)
+{
+    unsigned int br = 0;
+    FRESULT fr = f_lseek(file, sizeof(DirIndexHeader) + index * sizeof(uint32_t));
+    if (fr == FR_OK)
+    {
+        fr = f_read(file, offset, sizeof(uint32_t), &br);
+    }
+    if ((fr == FR_OK) && (br != sizeof(uint32_t)))
+    {
+        fr = FR_INT_ERR;
+    }
+    return fr;
+}
+
+// The names of a sort pass. Each pass keeps the smallest names after the last one written.
+// When the buffer is full the biggest half is dropped, and those names wait for a later pass
+typedef struct
+{
+    char names[DIRINDEX_SORT_BUFFER_SIZE];
+    char *sorted[DIRINDEX_SORT_MAX_NAMES];
+    uint32_t offsets[DIRINDEX_SORT_MAX_NAMES];
+    char last[FF_LFN_BUF + 1];    // Last name written. Empty in the first pass
+    char ceiling[FF_LFN_BUF + 1]; // This name and the bigger ones wait for a later pass. Empty if none
+    uint32_t count;
+    uint32_t names_used;
+} DirIndexSort;
+
+static int compare_addresses(const void *a, const void *b)
+{
+    const char *name_a = *(const char **)a;
+    const char *name_b = *(const char **)b;
+    return (name_a > name_b) - (name_a < name_b);
+}
+
+// Keep the smallest half of the names and move them to the start of the buffer
+static void drop_biggest_names(DirIndexSort *sort)
+{
+    qsort(sort->sorted, sort->count, sizeof(char *), compare_names);
+    uint32_t keep = sort->count / 2;
+    strcpy(sort->ceiling, sort->sorted[keep]);
+    sort->count = keep;
+
+    // In the order of the buffer, so no name is overwritten before it is moved
+    qsort(sort->sorted, keep, sizeof(char *), compare_addresses);
+    sort->names_used = 0;
+    for (uint32_t i = 0; i < keep; i++)
+    {
+        size_t name_size = strlen(sort->sorted[i]) + 1;
+        sort->sorted[i] = memmove(&sort->names[sort->names_used], sort->sorted[i], name_size);
+        sort->names_used += name_size;
+    }
+}
+
+static void add_name(DirIndexSort *sort, const char *name)
+{
+    size_t name_size = strlen(name) + 1;
+    if ((sort->last[0] != '\0') && (strcasecmp(name, sort->last) <= 0))
+    {
+        return;
+    }
+    while ((sort->ceiling[0] == '\0') || (strcasecmp(name, sort->ceiling) < 0))
+    {
+        if ((sort->count < DIRINDEX_SORT_MAX_NAMES) && (sort->names_used + name_size <= sizeof(sort->names)))
+        {
+            sort->sorted[sort->count++] = memcpy(&sort->names[sort->names_used], name, name_size);
+            sort->names_used += name_size;
+            return;
+        }
+        drop_biggest_names(sort);
+    }
+}
+
+// Collect and sort the names of the next pass
+static FRESULT sort_pass(const char *dir, const char **allowed_extensions, size_t num_extensions, DirIndexSort *sort)
+{
+    DIR dj;
+    FILINFO fno;
+    sort->count = 0;
+    sort->names_used = 0;
+    sort->ceiling[0] = '\0';
+    FRESULT fr = f_findfirst(&dj, &fno, dir, "*");
+    while (fr == FR_OK && fno.fname[0])
+    {
+        if (is_indexed(&fno, allowed_extensions, num_extensions))
+        {
+            add_name(sort, fno.fname);
+        }
+        fr = f_findnext(&dj, &fno);
+    }
+    f_closedir(&dj);
+    qsort(sort->sorted, sort->count, sizeof(char *), compare_names);
+    return fr;
+}
+
+static FRESULT write_index(FIL *file, const char *dir, const char **allowed_extensions, size_t num_extensions, DirIndexSort *sort, uint32_t count, uint32_t signature)
+{
+    DirIndexHeader header = {0};
+    unsigned int bw = 0;
+
+    // Write an empty header first. The magic number is only written when the index is complete
+    FRESULT fr = f_write(file, &header, sizeof(header), &bw);
+    uint32_t names_offset = sizeof(header) + count * sizeof(uint32_t);
+    uint32_t names_size = 0;
+    uint32_t indexed = 0;
+    sort->last[0] = '\0';
+    bool done = false;
+    while ((fr == FR_OK) && !done)
+    {
+        fr = sort_pass(dir, allowed_extensions, num_extensions, sort);
+        // The folder could have changed since the scan
+        uint32_t batch = sort->count < count - indexed ? sort->count : count - indexed;
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            sort->offsets[i] = names_size;
+            names_size += strlen(sort->sorted[i]) + 1;
+        }
+        if (fr == FR_OK)
+        {
+            fr = f_lseek(file, sizeof(header) + indexed * sizeof(uint32_t));
+        }
+        if (fr == FR_OK)
+        {
+            fr = f_write(file, sort->offsets, batch * sizeof(uint32_t), &bw);
+        }
+        if (fr == FR_OK)
+        {
+            fr = f_lseek(file, names_offset + (batch > 0 ? sort->offsets[0] : 0));
+        }
+        for (uint32_t i = 0; (fr == FR_OK) && (i < batch); i++)
+        {
+            fr = f_write(file, sort->sorted[i], strlen(sort->sorted[i]) + 1, &bw);
+        }
+        indexed += batch;
+        if (batch > 0)
+        {
+            strcpy(sort->last, sort->sorted[batch - 1]);
+        }
+        done = (batch == 0) || (sort->ceiling[0] == '\0') || (indexed == count);
+    }
+    if (fr == FR_OK)
+    {
+        header.magic = DIRINDEX_MAGIC;
+        header.version = DIRINDEX_VERSION;
+        header.signature = signature;
+        header.count = indexed;
+        header.names_offset = names_offset;
+        header.names_size = names_size;
+        fr = f_lseek(file, 0);
+    }
+    if (fr == FR_OK)
+    {
+        fr = f_write(file, &header, sizeof(header), &bw);
+    }
+    return fr;
+}
+
+static FRESULT build_index(const char *dir, const char *index_filename, const char **allowed_extensions, size_t num_extensions, uint32_t signature, uint32_t count)
+{
+    // The same memory for any number of files. Big folders take more passes
+    DirIndexSort *sort = malloc(sizeof(DirIndexSort));
+    if (sort == NULL)
+    {
+        DPRINTF("Not enough memory to index %" PRIu32 " files\n", count);
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s/%s", dir, index_filename);
+    FIL file;
+    FRESULT fr = f_open(&file, index_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr == FR_OK)
+    {
+        fr = write_index(&file, dir, allowed_extensions, num_extensions, sort, count, signature);
+        f_close(&file);
+        if (fr != FR_OK)
+        {
+            // Never leave a partial index behind
+            f_unlink(index_path);
+        }
+    }
+
+    free(sort);
+    return fr;
+}
+
+// The index checked last. The pages of a listing do not scan the folder again
+static char checked_index_path[512] = {0};
+
+void dirindex_invalidate(void)
+{
+    checked_index_path[0] = '\0';
+}
+
+bool dirindex_refresh(const char *dir, const char *index_filename, const char **allowed_extensions, size_t num_extensions)
+{
+    char index_path[512];
+    snprintf(index_path, sizeof(index_path), "%s/%s", dir, index_filename);
+    if (strcmp(index_path, checked_index_path) == 0)
+    {
+        return true;
+    }
+    dirindex_invalidate();
+
+    uint32_t signature = 0;
+    uint32_t count = 0;
+    FRESULT fr = scan_folder(dir, allowed_extensions, num_extensions, &signature, &count);
+    if (fr != FR_OK)
+    {
+        DPRINTF("Error scanning folder %s: %s (%d)\n", dir, FRESULT_str(fr), fr);
+        return false;
+    }
+
+    FIL file;
+    DirIndexHeader header;
+    if (open_index(dir, index_filename, &file, &header) == FR_OK)
+    {
+        f_close(&file);
+        if ((header.signature == signature) && (header.count == count))
+        {
+            DPRINTF("Index %s is up to date. %" PRIu32 " files\n", index_path, count);
+            strcpy(checked_index_path, index_path);
+            return true;
+        }
+    }
+
+    DPRINTF("Building index %s. %" PRIu32 " files\n", index_path, count);
+    fr = build_index(dir, index_filename, allowed_extensions, num_extensions, signature, count);
+    if (fr != FR_OK)
+    {
+        DPRINTF("Error building index: %s (%d)\n", FRESULT_str(fr), fr);
+        return false;
+    }
+    strcpy(checked_index_path, index_path);
+    return true;
+}
+
+int dirindex_store_page(const char *dir, const char *index_filename, uint32_t first, uint8_t *memory_location, size_t memory_size)
+{
+    DirIndexPage *page = (DirIndexPage *)memory_location;
+    uint8_t *names_start = memory_location + sizeof(DirIndexPage);
+    uint8_t *dest_ptr = names_start;
+    int count = -1;
+
+    FIL file;
+    DirIndexHeader header;
+    FRESULT fr = open_index(dir, index_filename, &file, &header);
+    if (fr == FR_OK)
+    {
+        count = 0;
+        if (first < header.count)
+        {
+            uint32_t offset = 0;
+            fr = read_offset(&file, first, &offset);
+            if (fr == FR_OK)
+            {
+                fr = f_lseek(&file, header.names_offset + offset);
+            }
+            if (fr == FR_OK)
+            {
+                // Read as much of the names blob as fits and keep only the complete names
+                uint32_t room = memory_size - sizeof(DirIndexPage) - DIRINDEX_PAGE_TRAILER_SIZE;
+                uint32_t available = header.names_size - offset;
+                unsigned int br = 0;
+                fr = f_read(&file, names_start, available < room ? available : room, &br);
+                for (uint8_t *ptr = names_start; (fr == FR_OK) && (ptr < names_start + br); ptr++)
+                {
+                    if (*ptr == 0x00)
+                    {
+                        count++;
+                        dest_ptr = ptr + 1;
+                    }
+                }
+            }
+            if (fr != FR_OK)
+            {
+                DPRINTF("Error reading index: %s (%d)\n", FRESULT_str(fr), fr);
+                count = -1;
+                dest_ptr = names_start;
+            }
+        }
+        page->total = header.count > 0xFFFF ? 0xFFFF : (uint16_t)header.count;
+        f_close(&file);
+    }
+    else
+    {
+        page->total = 0;
+    }
+    page->first = (uint16_t)first;
+    page->count = count > 0 ? (uint16_t)count : 0;
+    page->reserved = 0;
+
+    // Ensure even address for the following data
+    if ((uintptr_t)dest_ptr & 1)
+    {
+        *dest_ptr++ = 0x00;
+    }
+    // Same end of list marker as store_file_list()
+    *dest_ptr++ = 0x00;
+    *dest_ptr++ = 0x00;
+    *dest_ptr++ = 0xFF;
+    *dest_ptr++ = 0xFF;
+
+    // Swap the names to motorola endian format. The header words are already native words
+    CHANGE_ENDIANESS_BLOCK16(names_start, dest_ptr - names_start);
+    return count;
+}
+
+bool dirindex_get_name(const char *dir, const char *index_filename, uint32_t index, char *name, size_t name_size)
+{
+    FIL file;
+    DirIndexHeader header;
+    FRESULT fr = open_index(dir, index_filename, &file, &header);
+    if (fr != FR_OK)
+    {
+        DPRINTF("Error opening index %s/%s: %s (%d)\n", dir, index_filename, FRESULT_str(fr), fr);
+        return false;
+    }
+    if (index >= header.count)
+    {
+        f_close(&file);
+        return false;
+    }
+
+    uint32_t offset = 0;
+    unsigned int br = 0;
+    fr = read_offset(&file, index, &offset);
+    if (fr == FR_OK)
+    {
+        fr = f_lseek(&file, header.names_offset + offset);
+    }
+    if (fr == FR_OK)
+    {
+        fr = f_read(&file, name, name_size - 1, &br);
+    }
+    f_close(&file);
+    name[(fr == FR_OK) ? br : 0] = '\0';
+    return (fr == FR_OK) && (br > 0);
+}
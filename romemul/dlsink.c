@@ -0,0 +1,111 @@
+/**
+ * File: dlsink.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Download sink. Stages the HTTP body in aligned blocks before persisting it
+ */
+
+#include "include/dlsink.h"
+
+static void persist_buffer(DownloadSink *sink, uint32_t size)
+{
+    if (!sink->failed)
+    {
+        if (sink->persist(sink->arg, sink->buffer, size))
+        {
+            sink->persisted += sink->buffer_pos;
+        }
+        else
+        {
+            DPRINTF("Download sink failed to persist %d bytes\n", size);
+            sink->failed = true;
+        }
+    }
+    sink->buffer_pos = 0;
+}
+
+void download_sink_init(DownloadSink *sink, uint8_t *buffer, uint32_t buffer_size, download_sink_persist_t persist, void *arg)
+{
+    sink->buffer = buffer;
+    sink->buffer_size = buffer_size;
+    sink->buffer_pos = 0;
+    sink->unacked = 0;
+    sink->skip = 0;
+    sink->persisted = 0;
+    sink->failed = false;
+    sink->persist = persist;
+    sink->arg = arg;
+}
+
+void download_sink_skip(DownloadSink *sink, uint32_t bytes)
+{
+    sink->skip += bytes;
+}
+
+uint32_t download_sink_stage_pbuf(DownloadSink *sink, struct pbuf *p)
+{
+    for (struct pbuf *q = p; q != NULL; q = q->next)
+    {
+        const uint8_t *payload = (const uint8_t *)q->payload;
+        uint16_t length = q->len;
+        if (sink->skip > 0)
+        {
+            uint16_t skipped = sink->skip < length ? sink->skip : length;
+            payload += skipped;
+            length -= skipped;
+            sink->skip -= skipped;
+        }
+        while (length > 0)
+        {
+            uint32_t room = sink->buffer_size - sink->buffer_pos;
+            uint16_t chunk = length < room ? length : room;
+            memcpy(sink->buffer + sink->buffer_pos, payload, chunk);
+            sink->buffer_pos += chunk;
+            payload += chunk;
+            length -= chunk;
+            if (sink->buffer_pos == sink->buffer_size)
+            {
+                persist_buffer(sink, sink->buffer_size);
+            }
+        }
+    }
+
+    // Only acknowledge what is already persisted. The rest waits in the staging buffer
+    uint32_t ack = 0;
+    sink->unacked += p->tot_len;
+    if ((sink->buffer_pos == 0) || sink->failed)
+    {
+        ack = sink->unacked;
+    }
+    else if (sink->unacked > sink->buffer_pos)
+    {
+        ack = sink->unacked - sink->buffer_pos;
+    }
+    sink->unacked -= ack;
+    return ack;
+}
+
+void download_sink_write_pbuf(DownloadSink *sink, struct altcp_pcb *conn, struct pbuf *p)
+{
+    uint32_t ack = download_sink_stage_pbuf(sink, p);
+    if (ack > 0)
+    {
+        tcp_recved(conn, ack);
+    }
+}
+
+bool download_sink_finish(DownloadSink *sink, uint32_t align, uint8_t pad)
+{
+    if (sink->buffer_pos > 0)
+    {
+        uint32_t size = sink->buffer_pos;
+        if ((align > 0) && (size % align != 0))
+        {
+            size += align - (size % align);
+            memset(sink->buffer + sink->buffer_pos, pad, size - sink->buffer_pos);
+        }
+        persist_buffer(sink, size);
+    }
+    return !sink->failed;
+}
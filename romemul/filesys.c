@@ -105,6 +105,13 @@ FRESULT checkDiskSpace(const char *folder, uint32_t nDiskSize)
     return FR_OK; // Enough space available
 }
 
+static bool msa_write_track(void *arg, const uint8_t *data, uint32_t size)
+{
+    UINT bw;
+    FRESULT fr = f_write((FIL *)arg, data, size, &bw);
+    return (fr == FR_OK) && (bw == size);
+}
+
 /**
  * @brief Converts an MSA disk image file to an ST disk image file.
  *
@@ -123,18 +130,12 @@ FRESULT checkDiskSpace(const char *folder, uint32_t nDiskSize)
  */
 FRESULT MSA_to_ST(const char *folder, char *msaFilename, char *stFilename, bool overwrite)
 {
-    MSAHEADERSTRUCT msaHeader;
-    uint32_t nBytesLeft = 0;
-    uint8_t *pMSAImageBuffer, *pImageBuffer;
-    uint8_t Byte, Data;
-    uint16_t Track, Side, DataLength, NumBytesUnCompressed, RunLength;
-    uint8_t *pBuffer = NULL;
     FRESULT fr;   // FatFS function common result code
     FIL src_file; // File objects
     FIL dest_file;
-    UINT br, bw; // File read/write count
+    UINT br; // File read count
+    MsaDecoder decoder;
     BYTE *buffer_in = NULL;
-    BYTE *buffer_out = NULL;
 
     // Check if the folder exists, if not, exit
     DPRINTF("Checking folder %s\n", folder);
@@ -167,213 +168,77 @@ FRESULT MSA_to_ST(const char *folder, char *msaFilename, char *stFilename, bool
         DPRINTF("MSA file not found!\n");
         return FR_NO_FILE;
     }
-    // Calculate the size of the MSA file
-    nBytesLeft = f_size(&src_file);
 
-    // Check if the ST destination file exists in the SD card with FatFS
-    if (f_open(&dest_file, dest_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    buffer_in = malloc(MSA_READ_BUFFER_SIZE);
+    if (buffer_in == NULL)
     {
-        DPRINTF("Error creating destination ST file!\n");
-        return FR_NO_FILE;
+        DPRINTF("Not enough memory to read the MSA file!\n");
+        f_close(&src_file);
+        return FR_NOT_ENOUGH_CORE;
     }
 
-    buffer_in = malloc(sizeof(MSAHEADERSTRUCT) * +sizeof(uint16_t));
-    // Read only the memory needed to read the header AND the first track info (a word)
-    fr = f_read(&src_file, buffer_in, sizeof(MSAHEADERSTRUCT) + sizeof(uint16_t), &br); // Read a chunk of source file
-    if (fr != FR_OK)
-    {
-        DPRINTF("Error reading source file!\n");
-        if (buffer_in != NULL)
-        {
-            free(buffer_in);
-        }
-        return FR_DISK_ERR;
-    }
-
-    memcpy(&msaHeader, buffer_in, sizeof(MSAHEADERSTRUCT));
-    /* First swap 'header' words around to PC format - easier later on */
-    msaHeader.ID = bswap_16(msaHeader.ID);
-    msaHeader.SectorsPerTrack = bswap_16(msaHeader.SectorsPerTrack);
-    msaHeader.Sides = bswap_16(msaHeader.Sides);
-    msaHeader.StartingTrack = bswap_16(msaHeader.StartingTrack);
-    msaHeader.EndingTrack = bswap_16(msaHeader.EndingTrack);
-    DPRINTF("MSA Header: ID: %x\n", msaHeader.ID);
-    DPRINTF("MSA Header: SectorsPerTrack: %d\n", msaHeader.SectorsPerTrack);
-    DPRINTF("MSA Header: Sides: %d\n", msaHeader.Sides);
-    DPRINTF("MSA Header: StartingTrack: %d\n", msaHeader.StartingTrack);
-    DPRINTF("MSA Header: EndingTrack: %d\n", msaHeader.EndingTrack);
-
-    if (msaHeader.ID != 0x0E0F || msaHeader.EndingTrack > 86 || msaHeader.StartingTrack > msaHeader.EndingTrack || msaHeader.SectorsPerTrack > 56 || msaHeader.Sides > 1 || nBytesLeft <= (long)sizeof(MSAHEADERSTRUCT))
+    // Read and validate the header before creating the destination file
+    msa_decoder_init(&decoder, msa_write_track, &dest_file);
+    fr = f_read(&src_file, buffer_in, MSA_HEADER_SIZE, &br);
+    if ((fr != FR_OK) || (br != MSA_HEADER_SIZE) || !msa_decoder_feed(&decoder, buffer_in, br))
     {
         DPRINTF("MSA image has a bad header!\n");
-        if (buffer_in != NULL)
-        {
-            free(buffer_in);
-        }
+        msa_decoder_finish(&decoder);
+        free(buffer_in);
+        f_close(&src_file);
         return FR_DISK_ERR;
     }
 
-    if (checkDiskSpace(folder, NUM_BYTES_PER_SECTOR * msaHeader.SectorsPerTrack * (msaHeader.Sides + 1) * (msaHeader.EndingTrack - msaHeader.StartingTrack)) != FR_OK)
+    if (checkDiskSpace(folder, msa_decoder_image_size(&decoder)) != FR_OK)
     {
         DPRINTF("Not enough space in the SD card!\n");
-        if (buffer_in != NULL)
-        {
-            free(buffer_in);
-        }
+        msa_decoder_finish(&decoder);
+        free(buffer_in);
+        f_close(&src_file);
         return FR_DENIED;
     }
 
-    nBytesLeft -= sizeof(MSAHEADERSTRUCT);
-    // The length of the first track to read
-    uint16_t currentTrackDataLength = bswap_16((uint16_t) * (uint16_t *)(buffer_in + sizeof(MSAHEADERSTRUCT)));
+    if (f_open(&dest_file, dest_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        DPRINTF("Error creating destination ST file!\n");
+        msa_decoder_finish(&decoder);
+        free(buffer_in);
+        f_close(&src_file);
+        return FR_NO_FILE;
+    }
 
-    /* Uncompress to memory as '.ST' disk image - NOTE: assumes NUM_BYTES_PER_SECTOR bytes
-     * per sector (use NUM_BYTES_PER_SECTOR define)!!! */
-    for (Track = msaHeader.StartingTrack; Track <= msaHeader.EndingTrack; Track++)
+    // Decode the tracks as the source file is read. The decoder writes whole cylinders
+    do
     {
-        for (Side = 0; Side < (msaHeader.Sides + 1); Side++)
+        fr = f_read(&src_file, buffer_in, MSA_READ_BUFFER_SIZE, &br);
+        if (fr != FR_OK)
         {
-            uint16_t nBytesPerTrack = NUM_BYTES_PER_SECTOR * msaHeader.SectorsPerTrack;
-            nBytesLeft -= sizeof(uint16_t);
-            DPRINTF("Track: %d\n", Track);
-            DPRINTF("Side: %d\n", Side);
-            DPRINTF("Current Track Size: %d\n", currentTrackDataLength);
-            DPRINTF("Bytes per track: %d\n", nBytesPerTrack);
-            DPRINTF("Bytes left: %d\n", nBytesLeft);
-
-            if (nBytesLeft < 0)
-                goto out;
-
-            // Reserve write buffer
-            if (buffer_out != NULL)
-            {
-                free(buffer_out);
-            }
-            buffer_out = malloc(nBytesPerTrack);
-
-            if (buffer_in != NULL)
-            {
-                free(buffer_in);
-            }
-            buffer_in = malloc(currentTrackDataLength + sizeof(uint16_t));
-
-            BYTE *buffer_in_tmp = buffer_in;
-            fr = f_read(&src_file, buffer_in_tmp, currentTrackDataLength + sizeof(uint16_t), &br); // Read a chunk of source file
-            if (fr != FR_OK)
-            {
-                DPRINTF("Error reading source file!\n");
-                if (buffer_in != NULL)
-                {
-                    free(buffer_in);
-                }
-                if (buffer_out != NULL)
-                {
-                    free(buffer_out);
-                }
-                return FR_DISK_ERR;
-            }
-
-            // Check if it is not a compressed track
-            if (currentTrackDataLength == nBytesPerTrack)
-            {
-                nBytesLeft -= currentTrackDataLength;
-                if (nBytesLeft < 0)
-                    goto out;
-
-                // No compression, read the full track and write it to the destination file
-                fr = f_write(&dest_file, buffer_in, nBytesPerTrack, &bw); // Write it to the destination file
-                if (fr != FR_OK)
-                {
-                    DPRINTF("Error writing destination file!\n");
-                    if (buffer_in != NULL)
-                    {
-                        free(buffer_in);
-                    }
-                    if (buffer_out != NULL)
-                    {
-                        free(buffer_out);
-                    }
-                    return FR_DISK_ERR;
-                }
-                buffer_in_tmp += currentTrackDataLength;
-            }
-            else
-            {
-                // Compressed track, uncompress it
-                NumBytesUnCompressed = 0;
-                BYTE *buffer_out_tmp = buffer_out;
-                while (NumBytesUnCompressed < nBytesPerTrack)
-                {
-                    if (--nBytesLeft < 0)
-                        goto out;
-                    Byte = *buffer_in_tmp++;
-                    if (Byte != 0xE5) /* Compressed header? */
-                    {
-                        *buffer_out_tmp++ = Byte; /* No, just copy byte */
-                        NumBytesUnCompressed++;
-                    }
-                    else
-                    {
-                        nBytesLeft -= 3;
-                        if (nBytesLeft < 0)
-                            goto out;
-                        Data = *buffer_in_tmp++; /* Byte to copy */
-                        RunLength = (uint16_t)(buffer_in_tmp[1] | buffer_in_tmp[0] << 8);
-                        /* Limit length to size of track, incorrect images may overflow */
-                        if (RunLength + NumBytesUnCompressed > nBytesPerTrack)
-                        {
-                            DPRINTF("MSA_UnCompress: Illegal run length -> corrupted disk image?\n");
-                            RunLength = nBytesPerTrack - NumBytesUnCompressed;
-                        }
-                        buffer_in_tmp += sizeof(uint16_t);
-                        for (uint16_t i = 0; i < RunLength; i++)
-                        {
-                            *buffer_out_tmp++ = Data; /* Copy byte */
-                        }
-                        NumBytesUnCompressed += RunLength;
-                    }
-                }
-                // No compression, read the full track and write it to the destination file
-                fr = f_write(&dest_file, buffer_out, nBytesPerTrack, &bw); // Write it to the destination file
-                if (fr != FR_OK)
-                {
-                    DPRINTF("Error writing destination file!\n");
-                    if (buffer_in != NULL)
-                    {
-                        free(buffer_in);
-                    }
-                    if (buffer_out != NULL)
-                    {
-                        free(buffer_out);
-                    }
-                    return FR_DISK_ERR;
-                }
-            }
-            if (nBytesLeft > 0)
-            {
-                currentTrackDataLength = (uint16_t)(buffer_in_tmp[1] | buffer_in_tmp[0] << 8);
-            }
+            DPRINTF("Error reading source file!\n");
+            break;
         }
-    }
-out:
-    if (nBytesLeft < 0)
-    {
-        DPRINTF("MSA error: Premature end of file!\n");
-    }
+        if (!msa_decoder_feed(&decoder, buffer_in, br))
+        {
+            DPRINTF("Error writing destination file!\n");
+            fr = FR_DISK_ERR;
+            break;
+        }
+    } while ((br == MSA_READ_BUFFER_SIZE) && (decoder.state != MSA_DECODER_DONE));
+
+    // The decoder must have written all the tracks of the header
+    bool complete = msa_decoder_finish(&decoder);
+    free(buffer_in);
 
     // Close files
     f_close(&src_file);
     f_close(&dest_file);
 
-    if (buffer_in != NULL)
-    {
-        free(buffer_in);
-    }
-    if (buffer_out != NULL)
+    if ((fr != FR_OK) || !complete)
     {
-        free(buffer_out);
+        // A truncated or broken image must not leave a partial ST image to be loaded later
+        DPRINTF("MSA error: Premature end of file!\n");
+        f_unlink(dest_path);
+        return FR_DISK_ERR;
     }
-
     return FR_OK;
 }
 
@@ -2012,20 +1877,16 @@ void change_spi_speed()
     size_t sd_num = sd_get_num();
     if (sd_num > 0)
     {
-        ConfigEntry *sd_baud_rate_kb = find_entry(PARAM_SD_BAUD_RATE_KB);
-        if (sd_baud_rate_kb != NULL)
+        int baud_rate = configSnapshot.sd_baud_rate_kb;
+        if (baud_rate > 0)
         {
-            int baud_rate = atoi(sd_baud_rate_kb->value);
-            if (baud_rate > 0)
-            {
-                DPRINTF("Changing SD card baud rate to %i\n", baud_rate);
-                sd_card_t *sd_card = sd_get_by_num(sd_num - 1);
-                sd_card->spi_if_p->spi->baud_rate = baud_rate * 1000;
-            }
-            else
-            {
-                DPRINTF("Invalid baud rate. Using default value\n");
-            }
+            DPRINTF("Changing SD card baud rate to %i\n", baud_rate);
+            sd_card_t *sd_card = sd_get_by_num(sd_num - 1);
+            sd_card->spi_if_p->spi->baud_rate = baud_rate * 1000;
+        }
+        else
+        {
+            DPRINTF("Invalid baud rate. Using default value\n");
         }
     }
     else
@@ -48,6 +48,7 @@ static uint32_t memory_shared_address = 0;
 static uint32_t memory_code_address = 0;
 static uint16_t *payloadPtr = NULL;
 static uint32_t random_token;
+static volatile uint32_t command_arrival_us = 0; // Timer when the last command was received. The ST waits for the answer
 static uint32_t vector_call;
 static ConnectionData connection_data = {};
 static uint32_t flags = 0;
@@ -81,6 +82,21 @@ static FloppyCatalog floppy_catalog = {
     .list = NULL,
     .size = 0};
 
+static FloppyStats floppy_stats = {0};
+
+// The version of the state of the drives changes every time a drive is mounted or ejected,
+// so the web page downloads the state only when it changes
+static uint32_t api_state_version = 1;
+static uint32_t api_state_since = 0; // Version the client already has. Set by the CGI handler
+static int api_catalog_page = 0;     // Page of the catalog requested. Set by the CGI handler
+// The JSON documents are sent in parts of the SSI insert buffer. A string too long for one part
+// continues in the next parts. The tag part of each connection keeps the member in progress and the
+// bytes of its string already sent, so two clients can read the documents at the same time. Part 0 is
+// the header. The strings are shorter than 256 bytes (MAX_STRING_VALUE_LENGTH and the catalog names)
+#define API_TAG_PART(member, offset) ((u16_t)((((member) + 1) << 8) | (offset)))
+#define API_TAG_MEMBER(part) (((part) >> 8) - 1)
+#define API_TAG_OFFSET(part) ((size_t)((part) & 0xFF))
+
 /**
  * @brief Creates the BIOS Parameter Block (BPB) from the first sector of the floppy image.
  *
@@ -221,7 +237,31 @@ static void floppyemul_filelist(const char *dir, FATFS *fs, FloppyCatalog *flopp
     const char *allowed_extensions[] = {"st", "rw", NULL};
     int num_files = 0;
     char **files = NULL;
-    bool success = get_dir_files(dir, allowed_extensions, &files, &num_files, fs);
+    bool success = false;
+    // The listing is shared with the FTP server. Directories too big for the cache are read as before
+    DirCache *dircache = dircache_get(dir);
+    if (dircache != NULL)
+    {
+        files = malloc((dircache->count + 1) * sizeof(char *));
+        success = (files != NULL);
+        for (uint32_t i = 0; success && (i < dircache->count); i++)
+        {
+            const char *name = dircache_name(dircache, i);
+            if ((name[0] != '.') && !(dircache->entries[i].attrib & AM_DIR) && has_allowed_extension(name, allowed_extensions, 2))
+            {
+                files[num_files++] = strdup(name);
+            }
+        }
+        dircache_release(dircache);
+        if (success)
+        {
+            qsort(files, num_files, sizeof(char *), compare_strings);
+        }
+    }
+    else
+    {
+        success = get_dir_files(dir, allowed_extensions, &files, &num_files, fs);
+    }
     if (!success)
     {
         DPRINTF("ERROR: Could not get files from the floppy folder\n");
@@ -252,6 +292,22 @@ static void floppyemul_filelist(const char *dir, FATFS *fs, FloppyCatalog *flopp
         floppy_catalog->size = num_files;
     }
 }
+/**
+ * @brief Frees the filenames of the floppy catalog.
+ *
+ * @param floppy_catalog The floppy catalog to empty.
+ */
+static void floppyemul_release_filelist(FloppyCatalog *floppy_catalog)
+{
+    for (int i = 0; i < floppy_catalog->size; i++)
+    {
+        free(floppy_catalog->list[i]);
+    }
+    free(floppy_catalog->list);
+    floppy_catalog->list = NULL;
+    floppy_catalog->size = 0;
+}
+
 /**
  * @brief Selects a floppy disk image for a specific drive.
  *
@@ -282,6 +338,7 @@ const char *cgi_floppy_select(int iIndex, int iNumParams, char *pcParam[], char
             put_string(param, floppy_name);
             SET_FLAG(drv == 'a' ? MOUNT_DRIVE_A_FLAG : MOUNT_DRIVE_B_FLAG);
             write_all_entries();
+            api_state_version++;
         }
     }
     return "/floppies_select.shtml";
@@ -318,6 +375,7 @@ const char *cgi_floppy_eject(int iIndex, int iNumParams, char *pcParam[], char *
     put_string(param, "");
     SET_FLAG(drv == 'a' ? UMOUNT_DRIVE_A_FLAG : UMOUNT_DRIVE_B_FLAG);
     write_all_entries();
+    api_state_version++;
     return "/floppies_eject.shtml";
 }
 
@@ -331,6 +389,60 @@ const char *cgi_floppy_eject_b(int iIndex, int iNumParams, char *pcParam[], char
     return cgi_floppy_eject(iIndex, iNumParams, pcParam, pcValue, 'b');
 }
 
+/**
+ * @brief Returns the state of the drives as JSON.
+ *
+ * This function is a CGI handler of the web API. The optional parameter "since" is the version of the
+ * state the client already has. If the state did not change, the JSON only contains the version.
+ *
+ * @param iIndex The index of the CGI handler.
+ * @param iNumParams The number of parameters passed to the CGI handler.
+ * @param pcParam An array of parameter names.
+ * @param pcValue An array of parameter values.
+ * @return The URL of the JSON document with the state. Its content is generated by the JSTATE SSI tag.
+ */
+const char *cgi_api_state(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    api_state_since = 0;
+    for (int i = 0; i < iNumParams; i++)
+    {
+        if (strcmp(pcParam[i], "since") == 0)
+        {
+            api_state_since = strtoul(pcValue[i], NULL, 10);
+        }
+    }
+    return "/api/state.json";
+}
+
+/**
+ * @brief Returns a page of the floppy catalog as JSON.
+ *
+ * This function is a CGI handler of the web API. The parameter "page" is the page requested, starting at 0.
+ * Each page has FLOPPYEMUL_API_PAGE_SIZE files. The id of each file is the one expected by floppy_select_X.cgi.
+ *
+ * @param iIndex The index of the CGI handler.
+ * @param iNumParams The number of parameters passed to the CGI handler.
+ * @param pcParam An array of parameter names.
+ * @param pcValue An array of parameter values.
+ * @return The URL of the JSON document with the page. Its content is generated by the JCATALOG SSI tag.
+ */
+const char *cgi_api_catalog(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    api_catalog_page = 0;
+    for (int i = 0; i < iNumParams; i++)
+    {
+        if (strcmp(pcParam[i], "page") == 0)
+        {
+            api_catalog_page = atoi(pcValue[i]);
+        }
+    }
+    if (api_catalog_page < 0)
+    {
+        api_catalog_page = 0;
+    }
+    return "/api/catalog.json";
+}
+
 /**
  * @brief Array of CGI handlers for floppy select and eject operations.
  *
@@ -341,7 +453,43 @@ static const tCGI cgi_handlers[] = {
     {"/floppy_select_a.cgi", cgi_floppy_select_a},
     {"/floppy_select_b.cgi", cgi_floppy_select_b},
     {"/floppy_eject_a.cgi", cgi_floppy_eject_a},
-    {"/floppy_eject_b.cgi", cgi_floppy_eject_b}};
+    {"/floppy_eject_b.cgi", cgi_floppy_eject_b},
+    {"/api/state.cgi", cgi_api_state},
+    {"/api/catalog.cgi", cgi_api_catalog}};
+
+/**
+ * @brief Writes a string member of a JSON document in the SSI insert buffer, escaped. If the string does not
+ * fit, it writes as much as fits and the next calls continue from the offset.
+ *
+ * @param pcInsert The SSI insert buffer.
+ * @param iInsertLen The size of the buffer.
+ * @param printed Set to the number of characters written.
+ * @param offset Bytes of the string already sent. Updated, and set to 0 when the member is complete.
+ * @param prefix Written before the string, in the first call only. Must leave room for JSONESC_MAX_SEQUENCE + 1 characters and the suffix.
+ * @param value The UTF-8 string.
+ * @param suffix Written after the string, in the last call only.
+ * @return true if the member is complete, false if the string continues in the next call.
+ */
+static bool json_string_part(char *pcInsert, int iInsertLen, size_t *printed, size_t *offset, const char *prefix, const char *value, const char *suffix)
+{
+    size_t pos = 0;
+    size_t written;
+    if (*offset == 0)
+    {
+        pos = snprintf(pcInsert, iInsertLen, "%s", prefix);
+    }
+    *offset += json_escape(pcInsert + pos, iInsertLen - pos - strlen(suffix), value + *offset, &written);
+    pos += written;
+    if (value[*offset] != '\0')
+    {
+        *printed = pos;
+        return false;
+    }
+    pos += snprintf(pcInsert + pos, iInsertLen - pos, "%s", suffix);
+    *offset = 0;
+    *printed = pos;
+    return true;
+}
 
 /**
  * @brief Array of SSI tags for the HTTP server.
@@ -355,8 +503,12 @@ const char *ssi_tags[] = {
     "AACTION",  // 2
     "BACTION",  // 3
     "FOLDER",   // 4
-    "ACATALOG", // 5
-    "BCATALOG", // 6
+    "FTPSTATS", // 5
+    "JSTATE",   // 6
+    "JCATALOG", // 7
+    "JCOUNTRS", // 8
+    "JLATENCY", // 9
+    "JBUSSTAT", // 10
 };
 
 /**
@@ -381,7 +533,6 @@ u16_t ssi_handler(int iIndex, char *pcInsert, int iInsertLen
 {
     DPRINTF("SSI handler called with index %d\n", iIndex);
     size_t printed;
-    char drv = 'b';
     switch (iIndex)
     {
     case 0: /* "DRIVE_A" */
@@ -449,28 +600,215 @@ u16_t ssi_handler(int iIndex, char *pcInsert, int iInsertLen
     case 4: /* "FOLDER" */
         printed = snprintf(pcInsert, iInsertLen, "%s", find_entry(PARAM_FLOPPIES_FOLDER)->value);
         break;
-    case 5: /* "ACATALOG" */
-        drv = 'a';
-    case 6: /* "BCATALOG" */
+    case 5: /* "FTPSTATS" */
     {
-        // Iterate over the floppy catalog an create a large string with the HTML code as follows
-        // <option value="floppy1.st">floppy1.st</option>
-        // <option value="floppy2.st">floppy2.st</option>
-        // ...
-        DPRINTF("Current tag part: %d\n", current_tag_part);
-        if (floppy_catalog.list != NULL)
+        // One row per slot of the FTP session pool
+        FtpSessionStats stats;
+        if (ftpd_get_max_sessions() == 0)
         {
-            printed = snprintf(pcInsert, iInsertLen, "<div class='font-mono ml-2 text-navy-700 hover:text-blue-500 hover:text-underline relative group'><a href='/floppy_select_%c.cgi?id=%d'>%s</a></div>\n", drv, current_tag_part, floppy_catalog.list[current_tag_part]);
-            DPRINTF("Printed: %d\n", printed);
-
-            if (current_tag_part < (floppy_catalog.size - 1))
+            printed = snprintf(pcInsert, iInsertLen, "FTP SERVER NOT RUNNING");
+            break;
+        }
+        if (ftpd_get_session_stats(current_tag_part, &stats))
+        {
+            const uint8_t *ip = (const uint8_t *)&stats.remote_ip;
+            printed = snprintf(pcInsert, iInsertLen, "<div class='font-mono'>%d.%d.%d.%d: %lus, %lu transfers in %lus, sent %lu, received %lu bytes%s</div>\n",
+                               ip[0], ip[1], ip[2], ip[3],
+                               (unsigned long)((time_us_64() - stats.connected_us) / 1000000),
+                               (unsigned long)stats.transfers,
+                               (unsigned long)(stats.transfer_us / 1000000),
+                               (unsigned long)stats.bytes_sent,
+                               (unsigned long)stats.bytes_received,
+                               stats.transferring ? " (transferring)" : "");
+        }
+        else
+        {
+            printed = snprintf(pcInsert, iInsertLen, "<div class='font-mono'>Session %d: free</div>\n", current_tag_part + 1);
+        }
+        if (current_tag_part < (ftpd_get_max_sessions() - 1))
+        {
+            *next_tag_part = current_tag_part + 1;
+        }
+        break;
+    }
+    case 6: /* "JSTATE" */
+    {
+        // Part 0 is the header, then the folder and the drives. Their strings continue in the next parts if they don't fit
+        int member = 0;
+        size_t offset = 0;
+        if (current_tag_part == 0)
+        {
+            bool changed = (api_state_since != api_state_version);
+            printed = snprintf(pcInsert, iInsertLen, "{\"version\":%lu,\"changed\":%s", (unsigned long)api_state_version, changed ? "true" : "false");
+            if (!changed)
+            {
+                printed += snprintf(pcInsert + printed, iInsertLen - printed, "}");
+                break;
+            }
+        }
+        else if ((member = API_TAG_MEMBER(current_tag_part)) == 0)
+        {
+            offset = API_TAG_OFFSET(current_tag_part);
+            if (json_string_part(pcInsert, iInsertLen, &printed, &offset, ",\"folder\":\"", find_entry(PARAM_FLOPPIES_FOLDER)->value, "\""))
+            {
+                member++;
+            }
+        }
+        else
+        {
+            offset = API_TAG_OFFSET(current_tag_part);
+            bool drive_a = (member == 1);
+            const char *image = find_entry(drive_a ? PARAM_FLOPPY_IMAGE_A : PARAM_FLOPPY_IMAGE_B)->value;
+            char prefix[32];
+            char suffix[48];
+            snprintf(prefix, sizeof(prefix), ",\"drive_%c\":{\"image\":\"", drive_a ? 'a' : 'b');
+            snprintf(suffix, sizeof(suffix), "\",\"mounted\":%s,\"rw\":%s}%s",
+                     IS_FLAG_SET(drive_a ? FILE_READY_A_FLAG : FILE_READY_B_FLAG) ? "true" : "false",
+                     is_floppy_rw(image) ? "true" : "false",
+                     drive_a ? "" : "}");
+            if (json_string_part(pcInsert, iInsertLen, &printed, &offset, prefix, image, suffix))
+            {
+                member++;
+            }
+        }
+        if (member < 3)
+        {
+            *next_tag_part = API_TAG_PART(member, offset);
+        }
+        break;
+    }
+    case 7: /* "JCATALOG" */
+    {
+        // Part 0 is the header, then the files of the page and the last part closes the document.
+        // A name that does not fit continues in the next parts
+        int first = api_catalog_page * FLOPPYEMUL_API_PAGE_SIZE;
+        int count = floppy_catalog.size - first;
+        if (count < 0)
+        {
+            count = 0;
+        }
+        if (count > FLOPPYEMUL_API_PAGE_SIZE)
+        {
+            count = FLOPPYEMUL_API_PAGE_SIZE;
+        }
+        int member = 0;
+        size_t offset = 0;
+        if (current_tag_part == 0)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "{\"page\":%d,\"pages\":%d,\"total\":%d,\"files\":[",
+                               api_catalog_page,
+                               (floppy_catalog.size + FLOPPYEMUL_API_PAGE_SIZE - 1) / FLOPPYEMUL_API_PAGE_SIZE,
+                               floppy_catalog.size);
+        }
+        else if ((member = API_TAG_MEMBER(current_tag_part)) < count)
+        {
+            int id = first + member;
+            char prefix[32];
+            offset = API_TAG_OFFSET(current_tag_part);
+            snprintf(prefix, sizeof(prefix), "%s{\"id\":%d,\"name\":\"", member > 0 ? "," : "", id);
+            if (json_string_part(pcInsert, iInsertLen, &printed, &offset, prefix, floppy_catalog.list[id], "\"}"))
             {
-                *next_tag_part = current_tag_part + 1;
+                member++;
             }
         }
         else
         {
-            printed = snprintf(pcInsert, iInsertLen, "NO DISKS FOUND");
+            printed = snprintf(pcInsert, iInsertLen, "]}");
+            break;
+        }
+        *next_tag_part = API_TAG_PART(member, offset);
+        break;
+    }
+    case 8: /* "JCOUNTRS" */
+    {
+        if (current_tag_part == 0)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "{\"uptime_s\":%lu,\"reads_a\":%lu,\"reads_b\":%lu,\"writes_a\":%lu,\"writes_b\":%lu",
+                               (unsigned long)(time_us_64() / 1000000),
+                               (unsigned long)floppy_stats.sectors_read[0],
+                               (unsigned long)floppy_stats.sectors_read[1],
+                               (unsigned long)floppy_stats.sectors_written[0],
+                               (unsigned long)floppy_stats.sectors_written[1]);
+            *next_tag_part = current_tag_part + 1;
+        }
+        else
+        {
+            printed = snprintf(pcInsert, iInsertLen, ",\"bytes_read\":%lu,\"bytes_written\":%lu,\"checksum_errors\":%lu}",
+                               (unsigned long)floppy_stats.bytes_read,
+                               (unsigned long)floppy_stats.bytes_written,
+                               (unsigned long)floppy_stats.checksum_errors);
+        }
+        break;
+    }
+    case 9: /* "JLATENCY" */
+    {
+        // Part 0 is the header, then three parts per command and the last part closes the document
+        int size = cmdstats_size();
+        int index = (current_tag_part - 1) / 3;
+        const CmdStatsEntry *entry = cmdstats_get_entry(index);
+        if (current_tag_part == 0)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "{\"uptime_s\":%lu,\"buckets_floor_us\":[", (unsigned long)(time_us_64() / 1000000));
+            for (int i = 0; i < CMDSTATS_BUCKETS; i++)
+            {
+                printed += snprintf(pcInsert + printed, iInsertLen - printed, "%s%lu", i > 0 ? "," : "", (unsigned long)cmdstats_bucket_floor_us(i));
+            }
+            printed += snprintf(pcInsert + printed, iInsertLen - printed, "],\"commands\":[");
+        }
+        else if (entry == NULL)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "]}");
+        }
+        else if ((current_tag_part - 1) % 3 == 0)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "%s{\"id\":%u,\"count\":%lu,\"min_us\":%lu,\"avg_us\":%lu,\"max_us\":%lu",
+                               index > 0 ? "," : "",
+                               entry->command,
+                               (unsigned long)entry->count,
+                               (unsigned long)entry->min_us,
+                               (unsigned long)(entry->total_us / entry->count),
+                               (unsigned long)entry->max_us);
+        }
+        else
+        {
+            // Half of the histogram in each part, so each part fits in the insert buffer
+            bool first_half = ((current_tag_part - 1) % 3 == 1);
+            int from = first_half ? 0 : CMDSTATS_BUCKETS / 2;
+            printed = snprintf(pcInsert, iInsertLen, "%s", first_half ? ",\"buckets\":[" : ",");
+            for (int i = from; i < from + CMDSTATS_BUCKETS / 2; i++)
+            {
+                printed += snprintf(pcInsert + printed, iInsertLen - printed, "%s%lu", i > from ? "," : "", (unsigned long)entry->buckets[i]);
+            }
+            printed += snprintf(pcInsert + printed, iInsertLen - printed, "%s", first_half ? "" : "]}");
+        }
+        if (current_tag_part <= size * 3)
+        {
+            *next_tag_part = current_tag_part + 1;
+        }
+        break;
+    }
+    case 10: /* "JBUSSTAT" */
+    {
+        const BusStatsReport *report = busstats_get_report();
+        if (current_tag_part == 0)
+        {
+            printed = snprintf(pcInsert, iInsertLen, "{\"sys_clock_khz\":%lu,\"rom4_per_sec\":%lu,\"rom3_per_sec\":%lu,\"commands_per_sec\":%lu,\"rom4_accesses\":%lu",
+                               (unsigned long)report->sys_clock_khz,
+                               (unsigned long)report->rom4_per_sec,
+                               (unsigned long)report->rom3_per_sec,
+                               (unsigned long)report->commands_per_sec,
+                               (unsigned long)report->rom4_accesses);
+            *next_tag_part = current_tag_part + 1;
+        }
+        else
+        {
+            printed = snprintf(pcInsert, iInsertLen, ",\"rom3_accesses\":%lu,\"commands\":%lu,\"parse_timeouts\":%lu,\"irq_overruns\":%lu,\"rx_stalls\":%lu,\"fifo_errors\":%lu}",
+                               (unsigned long)report->rom3_accesses,
+                               (unsigned long)report->commands,
+                               (unsigned long)report->parse_timeouts,
+                               (unsigned long)report->irq_overruns,
+                               (unsigned long)report->rx_stalls,
+                               (unsigned long)report->fifo_errors);
         }
         break;
     }
@@ -499,6 +837,7 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
     // available in the payload
     random_token = GET_RANDOM_TOKEN(protocol->payload);
     payloadPtr = ((uint16_t *)(protocol)->payload);
+    command_arrival_us = timer_hw->timerawl;
 
     // Handle the protocol
     switch (protocol->command_id)
@@ -524,18 +863,18 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
         break;
     case FLOPPYEMUL_READ_SECTORS:
         // Read sectors from the floppy emulator
-        DPRINTF("Command READ_SECTORS (%i) received: %d\n", protocol->command_id, protocol->payload_size);
         sector_size = GET_NEXT32_PAYLOAD_PARAM16(payloadPtr);    // d3.l register
         logical_sector = GET_NEXT16_PAYLOAD_PARAM16(payloadPtr); // d3.h register
         disk_number = GET_NEXT16_PAYLOAD_PARAM16(payloadPtr);    // d4.l register
+        TRACE(TRACE_FLOPPY_COMMAND, protocol->command_id, logical_sector, disk_number);
         SET_FLAG(SECTOR_READ_FLAG);
         break;
     case FLOPPYEMUL_WRITE_SECTORS:
         // Write sectors from the floppy emulator
-        DPRINTF("Command WRITE_SECTORS (%i) received: %d\n", protocol->command_id, protocol->payload_size);
         sector_size = GET_NEXT32_PAYLOAD_PARAM16(payloadPtr);    // d3.l register
         logical_sector = GET_NEXT16_PAYLOAD_PARAM16(payloadPtr); // d3.h register
         disk_number = GET_NEXT16_PAYLOAD_PARAM16(payloadPtr);    // d4.l register
+        TRACE(TRACE_FLOPPY_COMMAND, protocol->command_id, logical_sector, disk_number);
         NEXT32_PAYLOAD_PTR(payloadPtr);
         NEXT32_PAYLOAD_PTR(payloadPtr); // Increment four extra words (the previous d4.l with disk_number and d5.l not used)
         SET_FLAG(SECTOR_WRITE_FLAG);
@@ -573,8 +912,8 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
         CLEAR_FLAG(MOUNT_DRIVE_B_FLAG);
         break;
     case FLOPPYEMUL_SHOW_VECTOR_CALL:
-        DPRINTF("Command SHOW_VECTOR_CALL (%i) received: %d\n", protocol->command_id, protocol->payload_size);
         vector_call = GET_NEXT32_PAYLOAD_PARAM16(payloadPtr); // d3.l register
+        TRACE(TRACE_FLOPPY_COMMAND, protocol->command_id, vector_call, 0);
         SET_FLAG(SHOW_VECTOR_CALL_FLAG);
         break;
     default:
@@ -594,8 +933,12 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
  */
 void __not_in_flash_func(floppyemul_dma_irq_handler_lookup_callback)(void)
 {
+    // Clear the interrupt request for the channel. A new access during the handler sets it again
+    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+
     // Read the address to process
     uint32_t addr = (uint32_t)dma_hw->ch[lookup_data_rom_dma_channel].al3_read_addr_trig;
+    busstats_access(addr);
 
     // Avoid priting anything inside an IRQ handled function
     // DPRINTF("DMA LOOKUP: $%x\n", addr);
@@ -603,60 +946,45 @@ void __not_in_flash_func(floppyemul_dma_irq_handler_lookup_callback)(void)
     {
         parse_protocol((uint16_t)(addr & 0xFFFF), handle_protocol_command);
     }
-    // Clear the interrupt request for the channel
-    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+    busstats_irq_exit(lookup_data_rom_dma_channel);
 }
 
-/**
- * @brief Initializes the floppy emulator.
- *
- * This function initializes and launch the floppy emulator.
- *
- * @param safe_config_reboot A boolean value indicating whether to perform a safe configuration reboot.
- */
-void init_floppyemul(bool safe_config_reboot)
+// The state of the loop of the emulator. Prepared by floppyemul_setup() and used by floppyemul_poll()
+static char *fullpath_a = NULL;
+static char *fullpath_b = NULL;
+static bool floppy_rw_a = true;
+static bool floppy_rw_b = true;
+static bool write_config_only_once = true;
+static bool select_safe_config_reboot = false;
+static FATFS fs;              /* File system object */
+static FIL fsrc_a;            /* File objects for drive A*/
+static FIL fsrc_b;            /* File objects for drive B */
+static unsigned int br_a = 0; /* File read/write count */
+static unsigned int br_b = 0; /* File read/write count */
+static bool network_ready = false;
+static bool microsd_mounted = false;
+static bool error = false; // The emulator stops serving the commands
+static uint32_t upload_count = 0;
+
+void floppyemul_setup(bool safe_config_reboot)
 {
-
-    char *fullpath_a = NULL;
-    char *fullpath_b = NULL;
-    bool floppy_rw_a = true;
-    bool floppy_rw_b = true;
-    bool write_config_only_once = true;
-    FATFS fs;              /* File system object */
-    FRESULT fr;            /* FatFs function common result code */
-    FIL fsrc_a;            /* File objects for drive A*/
-    FIL fsrc_b;            /* File objects for drive B */
-    unsigned int br_a = 0; /* File read/write count */
-    unsigned int br_b = 0; /* File read/write count */
+    FRESULT fr; /* FatFs function common result code */
+    fullpath_a = NULL;
+    fullpath_b = NULL;
+    floppy_rw_a = true;
+    floppy_rw_b = true;
+    write_config_only_once = true;
+    select_safe_config_reboot = safe_config_reboot;
 
     DPRINTF("Waiting for commands...\n");
     memory_shared_address = ROM3_START_ADDRESS; // Start of the shared memory buffer
     memory_code_address = ROM4_START_ADDRESS;   // Start of the code memory
+    memset((void *)(memory_shared_address + FLOPPYEMUL_CMDSTATS), 0, sizeof(CmdStatsSharedTable) + sizeof(BusStatsReport));
 
-    ConfigEntry *xbios_enabled = find_entry(PARAM_FLOPPY_XBIOS_ENABLED);
-    bool floppy_xbios_enabled = true;
-    if (xbios_enabled != NULL)
-    {
-        floppy_xbios_enabled = (xbios_enabled->value[0] == 't' || xbios_enabled->value[0] == 'T');
-    }
-    ConfigEntry *boot_enabled = find_entry(PARAM_FLOPPY_BOOT_ENABLED);
-    bool floppy_boot_enabled = true;
-    if (boot_enabled != NULL)
-    {
-        floppy_boot_enabled = (boot_enabled->value[0] == 't' || boot_enabled->value[0] == 'T');
-    }
-    ConfigEntry *buffer_type = find_entry(PARAM_FLOPPY_BUFFER_TYPE);
-    uint32_t buffer_type_value = 0;
-    if (buffer_type != NULL)
-    {
-        buffer_type_value = atoi(buffer_type->value);
-    }
-    ConfigEntry *network_enabled = find_entry(PARAM_FLOPPY_NET_ENABLED);
-    bool floppy_network_enabled = true;
-    if (network_enabled != NULL)
-    {
-        floppy_network_enabled = (network_enabled->value[0] == 't' || network_enabled->value[0] == 'T');
-    }
+    bool floppy_xbios_enabled = configSnapshot.floppy_xbios_enabled;
+    bool floppy_boot_enabled = configSnapshot.floppy_boot_enabled;
+    uint32_t buffer_type_value = configSnapshot.floppy_buffer_type;
+    bool floppy_network_enabled = configSnapshot.floppy_net_enabled;
 
     SET_SHARED_VAR(SHARED_VARIABLE_BUFFER_TYPE, buffer_type_value, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // 0: _diskbuff, 1: heap
     SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_XBIOS_TRAP_ENABLED, floppy_xbios_enabled ? 0xFFFFFFFF : 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
@@ -669,18 +997,13 @@ void init_floppyemul(bool safe_config_reboot)
     //
     // Init network
     //
-    bool network_ready = false;
+    network_ready = false;
     memset((void *)(memory_shared_address + FLOPPYEMUL_IP_ADDRESS), 0, 128);
     memset((void *)(memory_shared_address + FLOPPYEMUL_HOSTNAME), 0, 128);
 
     // Local wifi password in the local file
     char *wifi_password_file_content = NULL;
-    ConfigEntry *floppy_network_timeout = find_entry(PARAM_FLOPPY_NET_TOUT_SEC);
-    uint32_t floppy_network_timeout_sec = 0;
-    if (floppy_network_timeout != NULL)
-    {
-        floppy_network_timeout_sec = atoi(floppy_network_timeout->value);
-    }
+    uint32_t floppy_network_timeout_sec = configSnapshot.floppy_net_tout_sec;
     // The ping timeout is the same as the network timeout
     SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_PING_TIMEOUT, floppy_network_timeout_sec, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
     floppy_network_timeout_sec = floppy_network_timeout_sec;
@@ -692,7 +1015,7 @@ void init_floppyemul(bool safe_config_reboot)
     bool show_blink = true;
     // Only try to get the datetime from the network if the wifi is configured
     // and the network configuration is enabled
-    if ((strlen(find_entry(PARAM_WIFI_SSID)->value) > 0) && (floppy_network_enabled))
+    if (configSnapshot.wifi_configured && (floppy_network_enabled))
     {
         // Initialize SD card
         if (!sd_init_driver())
@@ -714,47 +1037,21 @@ void init_floppyemul(bool safe_config_reboot)
 
         cyw43_arch_deinit();
 
-        network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-        absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(reconnect_t, 0);
         absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(second_t, 0);
-        bool wifi_init = true;
-        uint32_t time_to_connect_again = 1000; // 1 second
         network_ready = false;
-        // Wait until timeout
-        while ((!network_ready) && (floppy_network_timeout_sec > 0) && (strlen(find_entry(PARAM_WIFI_SSID)->value) > 0))
-        {
-#if PICO_CYW43_ARCH_POLL
-            cyw43_arch_poll();
-#endif
-            // Only display when changes status to avoid flooding the console
-            ConnectionStatus previous_status = get_previous_connection_status();
-            ConnectionStatus current_status = get_network_connection_status();
-            if (current_status != previous_status)
+        if (floppy_network_timeout_sec > 0)
+        {
+            wifi_manager_start(&wifi_password_file_content, floppy_network_timeout_sec * 1000, NULL, NULL);
+        }
+        // Wait until connected or timeout
+        while ((!network_ready) && (floppy_network_timeout_sec > 0))
+        {
+            WifiManagerState wifi_state = wifi_manager_poll();
+            if (wifi_state == WIFI_MANAGER_TIMEOUT)
             {
-                get_connection_data(&connection_data);
-#if defined(_DEBUG) && (_DEBUG != 0)
-                DPRINTF("Status: %d - Prev: %d - SSID: %s - IPv4: %s - GW:%s - Mask:%s - MAC:%s\n",
-                        current_status,
-                        previous_status,
-                        connection_data.ssid,
-                        connection_data.ipv4_address,
-                        print_ipv4(get_gateway()),
-                        print_ipv4(get_netmask()),
-                        print_mac(get_mac_address()));
-#endif
-                if ((current_status == GENERIC_ERROR) || (current_status == CONNECT_FAILED_ERROR) || (current_status == BADAUTH_ERROR))
-                {
-                    if (wifi_init)
-                    {
-                        reconnect_t = make_timeout_time_ms(0);
-                        time_to_connect_again = time_to_connect_again * 2;
-                        wifi_init = false;
-                        DPRINTF("Connection failed. Retrying in %d ms...\n", time_to_connect_again);
-                        cyw43_arch_deinit();
-                    }
-                }
+                break;
             }
-            network_ready = (current_status == CONNECTED_WIFI_IP);
+            network_ready = (wifi_state == WIFI_MANAGER_CONNECTED);
             if (time_passed(&second_t, 1000) == 1)
             {
                 DPRINTF("Timeout in seconds: %d\n", floppy_network_timeout_sec);
@@ -766,6 +1063,7 @@ void init_floppyemul(bool safe_config_reboot)
                 DPRINTF("Ping received, but forced not ready yet.\n");
                 CLEAR_FLAG(PING_RECEIVED_FLAG);
                 SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_PING_STATUS, 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Not ready yet
+                cmdstats_record(FLOPPYEMUL_PING, command_arrival_us);
                 SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
             }
 
@@ -776,20 +1074,17 @@ void init_floppyemul(bool safe_config_reboot)
                 // Write config only once to avoid hitting the flash too much
                 write_config_only_once = false;
             }
-
-            if ((!wifi_init) && (time_passed(&reconnect_t, time_to_connect_again) == 1))
-            {
-                network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-                reconnect_t = make_timeout_time_ms(0);
-                wifi_init = true;
-            }
         }
-        if (floppy_network_timeout_sec == 0)
+        if (network_ready)
+        {
+            get_connection_data(&connection_data);
+        }
+        else
         {
             DPRINTF("Timeout reached. No network.\n");
             // Just be sure to deinit the network stack
             blink_morse('F');
-            cyw43_arch_deinit();
+            wifi_manager_stop();
 
             // Null connection_data
             memset(&connection_data, 0, sizeof(ConnectionData));
@@ -834,7 +1129,7 @@ void init_floppyemul(bool safe_config_reboot)
         }
     }
 
-    bool error = false;
+    error = false;
     // Initialize SD card
     if (!sd_init_driver())
     {
@@ -844,7 +1139,7 @@ void init_floppyemul(bool safe_config_reboot)
 
     // Mount drive
     fr = f_mount(&fs, "0:", 1);
-    bool microsd_mounted = (fr == FR_OK);
+    microsd_mounted = (fr == FR_OK);
     if (!microsd_mounted)
     {
         DPRINTF("ERROR: Could not mount filesystem (%d)\r\n", fr);
@@ -860,449 +1155,505 @@ void init_floppyemul(bool safe_config_reboot)
 
     SET_FLAG(MOUNT_DRIVE_A_FLAG);
     SET_FLAG(MOUNT_DRIVE_B_FLAG);
+    upload_count = httpd_get_upload_count();
     srand(time(0)); // Seed the random number generator
-    while (!error)
+}
+
+bool floppyemul_poll(void)
+{
+    FRESULT fr; /* FatFs function common result code */
+    if (error)
     {
-        // *((volatile uint32_t *)(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
-        WRITE_LONGWORD(memory_shared_address, FLOPPYEMUL_RANDOM_TOKEN_SEED, rand() % 0xFFFFFFFF);
-        if (network_ready)
-        {
-#if PICO_CYW43_ARCH_POLL
-            cyw43_arch_poll();
-#endif
-        }
-        if (IS_FLAG_SET(SHOW_VECTOR_CALL_FLAG))
+        return false;
+    }
+    // *((volatile uint32_t *)(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
+    WRITE_LONGWORD(memory_shared_address, FLOPPYEMUL_RANDOM_TOKEN_SEED, rand() % 0xFFFFFFFF);
+    if (network_ready)
+    {
+        // Also joins the access point again if the link is lost
+        wifi_manager_poll();
+        // Release an upload whose connection was reset
+        cyw43_arch_lwip_begin();
+        httpd_upload_poll();
+        cyw43_arch_lwip_end();
+        // A file was uploaded from the web page. Read the floppy folder again
+        if (upload_count != httpd_get_upload_count())
         {
-            DPRINTF("VECTOR CALL: $%x\n", vector_call);
-            CLEAR_FLAG(SHOW_VECTOR_CALL_FLAG);
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+            upload_count = httpd_get_upload_count();
+            floppyemul_release_filelist(&floppy_catalog);
+            floppyemul_filelist(find_entry(PARAM_FLOPPIES_FOLDER)->value, &fs, &floppy_catalog);
+            api_state_version++;
         }
+    }
+    // Publish the statistics and format the trace only when no sector is waiting
+    if (!IS_FLAG_SET(SECTOR_READ_FLAG) && !IS_FLAG_SET(SECTOR_WRITE_FLAG))
+    {
+        cmdstats_publish((uint8_t *)(memory_shared_address + FLOPPYEMUL_CMDSTATS));
+        busstats_poll((uint8_t *)(memory_shared_address + FLOPPYEMUL_BUSSTATS));
+        capture_poll(APP_FLOPPYEMUL);
+        trace_drain();
+    }
+    if (IS_FLAG_SET(SHOW_VECTOR_CALL_FLAG))
+    {
+        CLEAR_FLAG(SHOW_VECTOR_CALL_FLAG);
+        cmdstats_record(FLOPPYEMUL_SHOW_VECTOR_CALL, command_arrival_us);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
 
-        if (IS_FLAG_SET(MOUNT_DRIVE_A_FLAG))
+    if (IS_FLAG_SET(MOUNT_DRIVE_A_FLAG))
+    {
+        CLEAR_FLAG(MOUNT_DRIVE_A_FLAG);
+        if (!IS_FLAG_SET(FILE_READY_A_FLAG))
         {
-            CLEAR_FLAG(MOUNT_DRIVE_A_FLAG);
-            if (!IS_FLAG_SET(FILE_READY_A_FLAG))
-            {
 
-                char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
-                char *filename_a = find_entry(PARAM_FLOPPY_IMAGE_A)->value;
+            char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+            char *filename_a = find_entry(PARAM_FLOPPY_IMAGE_A)->value;
 
-                if (!dir || strlen(dir) == 0)
-                {
-                    DPRINTF("Error: Missing directory drive A.\n");
-                    error = true;
-                }
-                else if (!filename_a || strlen(filename_a) == 0)
-                {
-                    DPRINTF("Error: Missing filename drive A.\n");
-                    // it's ok if there is no floppy image in drive A
-                }
-                else if (strcmp(filename_a, find_entry(PARAM_FLOPPY_IMAGE_B)->value) == 0)
+            if (!dir || strlen(dir) == 0)
+            {
+                DPRINTF("Error: Missing directory drive A.\n");
+                error = true;
+            }
+            else if (!filename_a || strlen(filename_a) == 0)
+            {
+                DPRINTF("Error: Missing filename drive A.\n");
+                // it's ok if there is no floppy image in drive A
+            }
+            else if (strcmp(filename_a, find_entry(PARAM_FLOPPY_IMAGE_B)->value) == 0)
+            {
+                DPRINTF("Error: Drive A image is the same as drive B.\n");
+                error = true;
+            }
+            else
+            {
+                size_t fullpath_a_len = strlen(dir) + strlen(filename_a) + 2;
+                fullpath_a = malloc(fullpath_a_len);
+
+                if (!fullpath_a)
                 {
-                    DPRINTF("Error: Drive A image is the same as drive B.\n");
+                    DPRINTF("Error: Unable to allocate memory.\n");
                     error = true;
                 }
                 else
                 {
-                    size_t fullpath_a_len = strlen(dir) + strlen(filename_a) + 2;
-                    fullpath_a = malloc(fullpath_a_len);
 
-                    if (!fullpath_a)
+                    snprintf(fullpath_a, fullpath_a_len, "%s/%s", dir, filename_a);
+
+                    DPRINTF("Emulating floppy image in drive A: %s\n", fullpath_a);
+
+                    floppy_rw_a = is_floppy_rw(fullpath_a);
+                    DPRINTF("Floppy image is %s\n", floppy_rw_a ? "read/write" : "read only");
+
+                    // Invoke the function
+                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+                    FRESULT err = floppyemul_open(fullpath_a, floppy_rw_a, &fsrc_a);
+                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+                    if (err != FR_OK)
                     {
-                        DPRINTF("Error: Unable to allocate memory.\n");
+                        DPRINTF("ERROR: Could not open floppy image %s (%d)\r\n", fullpath_a, err);
                         error = true;
                     }
                     else
                     {
-
-                        snprintf(fullpath_a, fullpath_a_len, "%s/%s", dir, filename_a);
-
-                        DPRINTF("Emulating floppy image in drive A: %s\n", fullpath_a);
-
-                        floppy_rw_a = is_floppy_rw(fullpath_a);
-                        DPRINTF("Floppy image is %s\n", floppy_rw_a ? "read/write" : "read only");
-
-                        // Invoke the function
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-                        FRESULT err = floppyemul_open(fullpath_a, floppy_rw_a, &fsrc_a);
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-                        if (err != FR_OK)
+                        DPRINTF("Floppy image %s opened successfully\n", fullpath_a);
+                        // Set the BPB of the floppy
+                        // Create BPB for disk A
+                        FRESULT bpb_found = floppyemul_create_BPB(&fsrc_a, &BpbData_A);
+                        if (bpb_found != FR_OK)
                         {
-                            DPRINTF("ERROR: Could not open floppy image %s (%d)\r\n", fullpath_a, err);
+                            DPRINTF("ERROR: Could not create BPB for image file  %s (%d)\r\n", fullpath_a, fr);
                             error = true;
                         }
                         else
                         {
-                            DPRINTF("Floppy image %s opened successfully\n", fullpath_a);
-                            // Set the BPB of the floppy
-                            // Create BPB for disk A
-                            FRESULT bpb_found = floppyemul_create_BPB(&fsrc_a, &BpbData_A);
-                            if (bpb_found != FR_OK)
-                            {
-                                DPRINTF("ERROR: Could not create BPB for image file  %s (%d)\r\n", fullpath_a, fr);
-                                error = true;
-                            }
-                            else
-                            {
-                                CLEAR_FLAG(SET_BPB_FLAG);
-                                BPBData *bpb_ptr = &BpbData_A;
-                                memcpy((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_A), bpb_ptr, sizeof(BpbData_A));
-                                SET_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 0 = 1: Floppy emulation A
-                                SET_FLAG(FILE_READY_A_FLAG);
-                            }
+                            CLEAR_FLAG(SET_BPB_FLAG);
+                            BPBData *bpb_ptr = &BpbData_A;
+                            memcpy((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_A), bpb_ptr, sizeof(BpbData_A));
+                            SET_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 0 = 1: Floppy emulation A
+                            SET_FLAG(FILE_READY_A_FLAG);
+                            api_state_version++;
                         }
                     }
                 }
             }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
         }
-        if (IS_FLAG_SET(MOUNT_DRIVE_B_FLAG))
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    if (IS_FLAG_SET(MOUNT_DRIVE_B_FLAG))
+    {
+        CLEAR_FLAG(MOUNT_DRIVE_B_FLAG);
+        if (!IS_FLAG_SET(FILE_READY_B_FLAG))
         {
-            CLEAR_FLAG(MOUNT_DRIVE_B_FLAG);
-            if (!IS_FLAG_SET(FILE_READY_B_FLAG))
+
+            char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+            char *filename_b = find_entry(PARAM_FLOPPY_IMAGE_B)->value;
+
+            if (!dir || strlen(dir) == 0)
+            {
+                DPRINTF("Error: Missing directory or filename drive B.\n");
+                error = true;
+            }
+            else if (!filename_b || strlen(filename_b) == 0)
+            {
+                DPRINTF("Error: Missing filename drive B.\n");
+                // it's ok if there is no floppy image in drive B
+            }
+            else if (strcmp(filename_b, find_entry(PARAM_FLOPPY_IMAGE_A)->value) == 0)
+            {
+                DPRINTF("Error: Drive B image is the same as drive A.\n");
+                error = true;
+            }
+            else
             {
 
-                char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
-                char *filename_b = find_entry(PARAM_FLOPPY_IMAGE_B)->value;
+                size_t fullpath_b_len = strlen(dir) + strlen(filename_b) + 2;
+                fullpath_b = malloc(fullpath_b_len);
 
-                if (!dir || strlen(dir) == 0)
-                {
-                    DPRINTF("Error: Missing directory or filename drive B.\n");
-                    error = true;
-                }
-                else if (!filename_b || strlen(filename_b) == 0)
+                if (!fullpath_b)
                 {
-                    DPRINTF("Error: Missing filename drive B.\n");
-                    // it's ok if there is no floppy image in drive B
-                }
-                else if (strcmp(filename_b, find_entry(PARAM_FLOPPY_IMAGE_A)->value) == 0)
-                {
-                    DPRINTF("Error: Drive B image is the same as drive A.\n");
+                    DPRINTF("Error: Unable to allocate memory.\n");
                     error = true;
                 }
                 else
                 {
 
-                    size_t fullpath_b_len = strlen(dir) + strlen(filename_b) + 2;
-                    fullpath_b = malloc(fullpath_b_len);
+                    snprintf(fullpath_b, fullpath_b_len, "%s/%s", dir, filename_b);
+
+                    DPRINTF("Emulating floppy image in drive B: %s\n", fullpath_b);
 
-                    if (!fullpath_b)
+                    floppy_rw_b = is_floppy_rw(fullpath_b);
+                    DPRINTF("Floppy image is %s\n", floppy_rw_b ? "read/write" : "read only");
+
+                    // Invoke the function
+                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+                    FRESULT err = floppyemul_open(fullpath_b, floppy_rw_b, &fsrc_b);
+                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+                    if (err != FR_OK)
                     {
-                        DPRINTF("Error: Unable to allocate memory.\n");
+                        DPRINTF("ERROR: Could not open floppy image %s (%d)\r\n", fullpath_b, err);
                         error = true;
                     }
                     else
                     {
-
-                        snprintf(fullpath_b, fullpath_b_len, "%s/%s", dir, filename_b);
-
-                        DPRINTF("Emulating floppy image in drive B: %s\n", fullpath_b);
-
-                        floppy_rw_b = is_floppy_rw(fullpath_b);
-                        DPRINTF("Floppy image is %s\n", floppy_rw_b ? "read/write" : "read only");
-
-                        // Invoke the function
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-                        FRESULT err = floppyemul_open(fullpath_b, floppy_rw_b, &fsrc_b);
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-                        if (err != FR_OK)
+                        DPRINTF("Floppy image %s opened successfully\n", fullpath_b);
+                        // Set the BPB of the floppy
+                        // Create BPB for disk B
+                        FRESULT bpb_found = floppyemul_create_BPB(&fsrc_b, &BpbData_B);
+                        if (bpb_found != FR_OK)
                         {
-                            DPRINTF("ERROR: Could not open floppy image %s (%d)\r\n", fullpath_b, err);
+                            DPRINTF("ERROR: Could not create BPB for image file  %s (%d)\r\n", fullpath_b, fr);
                             error = true;
                         }
                         else
                         {
-                            DPRINTF("Floppy image %s opened successfully\n", fullpath_b);
-                            // Set the BPB of the floppy
-                            // Create BPB for disk B
-                            FRESULT bpb_found = floppyemul_create_BPB(&fsrc_b, &BpbData_B);
-                            if (bpb_found != FR_OK)
-                            {
-                                DPRINTF("ERROR: Could not create BPB for image file  %s (%d)\r\n", fullpath_b, fr);
-                                error = true;
-                            }
-                            else
-                            {
-                                CLEAR_FLAG(SET_BPB_FLAG);
-                                BPBData *bpb_ptr = &BpbData_B;
-                                memcpy((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_B), bpb_ptr, sizeof(BpbData_B));
-                                SET_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 1, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 1 = 1: Floppy emulation B
-                                SET_FLAG(FILE_READY_B_FLAG);
-                            }
+                            CLEAR_FLAG(SET_BPB_FLAG);
+                            BPBData *bpb_ptr = &BpbData_B;
+                            memcpy((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_B), bpb_ptr, sizeof(BpbData_B));
+                            SET_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 1, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 1 = 1: Floppy emulation B
+                            SET_FLAG(FILE_READY_B_FLAG);
+                            api_state_version++;
                         }
                     }
                 }
             }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
         }
-        if (IS_FLAG_SET(UMOUNT_DRIVE_A_FLAG))
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    if (IS_FLAG_SET(UMOUNT_DRIVE_A_FLAG))
+    {
+        CLEAR_FLAG(UMOUNT_DRIVE_A_FLAG);
+        // Umount the A drive
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+        FRESULT fr = floppyemul_close(&fsrc_a);
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+        if (fr != FR_OK)
         {
-            CLEAR_FLAG(UMOUNT_DRIVE_A_FLAG);
-            // Umount the A drive
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-            FRESULT fr = floppyemul_close(&fsrc_a);
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-            if (fr != FR_OK)
-            {
-                DPRINTF("ERROR: Could not close floppy image %s (%d)\r\n", fullpath_a, fr);
-                error = true;
-            }
-            else
-            {
-                memset((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_A), 0, sizeof(BpbData_A));
-                SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_MEDIA_CHANGED_A, MED_CHANGED, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
-                CLEAR_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 0 = 0: No floppy emulation A
-                CLEAR_FLAG(FILE_READY_A_FLAG);
-            }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+            DPRINTF("ERROR: Could not close floppy image %s (%d)\r\n", fullpath_a, fr);
+            error = true;
         }
-        if (IS_FLAG_SET(UMOUNT_DRIVE_B_FLAG))
+        else
         {
-            CLEAR_FLAG(UMOUNT_DRIVE_B_FLAG);
-            // Umount the B drive
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-            FRESULT fr = floppyemul_close(&fsrc_b);
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-            if (fr != FR_OK)
-            {
-                DPRINTF("ERROR: Could not close floppy image %s (%d)\r\n", fullpath_b, fr);
-                error = true;
-            }
-            else
-            {
-                memset((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_B), 0, sizeof(BpbData_B));
-                SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_MEDIA_CHANGED_B, MED_CHANGED, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
-                CLEAR_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 1, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 1 = 0: No floppy emulation B
-                CLEAR_FLAG(FILE_READY_B_FLAG);
-            }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+            memset((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_A), 0, sizeof(BpbData_A));
+            SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_MEDIA_CHANGED_A, MED_CHANGED, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
+            CLEAR_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 0 = 0: No floppy emulation A
+            CLEAR_FLAG(FILE_READY_A_FLAG);
+            api_state_version++;
         }
-
-        if (IS_FLAG_SET(PING_RECEIVED_FLAG))
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    if (IS_FLAG_SET(UMOUNT_DRIVE_B_FLAG))
+    {
+        CLEAR_FLAG(UMOUNT_DRIVE_B_FLAG);
+        // Umount the B drive
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+        FRESULT fr = floppyemul_close(&fsrc_b);
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+        if (fr != FR_OK)
         {
-            DPRINTF("Ping received\n");
-            CLEAR_FLAG(PING_RECEIVED_FLAG);
-            // If we are here, means there is network configured. Fine.
-            // Also check if the SD card is mounted or not
-            bool ok_to_read = microsd_mounted && !error && (IS_FLAG_SET(FILE_READY_A_FLAG) || IS_FLAG_SET(FILE_READY_B_FLAG));
-            DPRINTF("Ok to read: %d\n", ok_to_read);
-            SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_PING_STATUS, ok_to_read ? 0xFFFFFFFF : 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+            DPRINTF("ERROR: Could not close floppy image %s (%d)\r\n", fullpath_b, fr);
+            error = true;
         }
-
-        if (IS_FLAG_SET(SAVE_VECTORS_FLAG))
+        else
         {
-            CLEAR_FLAG(SAVE_VECTORS_FLAG);
-            // Save the vectors needed for the floppy emulation
-            DPRINTF("Saving vectors\n");
-            // DPRINTF("random token: %x\n", random_token);
-            if (!disk_vectors.XBIOS_trap_payload_set)
-            {
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_XBIOS_TRAP, disk_vectors.XBIOS_trap_payload);
-                disk_vectors.XBIOS_trap_payload_set = true;
-            }
-            else
-            {
-                DPRINTF("XBIOS_trap_payload previously set.\n");
-            }
-            DPRINTF("XBIOS_trap_payload: %x\n", disk_vectors.XBIOS_trap_payload);
+            memset((void *)(memory_shared_address + FLOPPYEMUL_BPB_DATA_B), 0, sizeof(BpbData_B));
+            SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_MEDIA_CHANGED_B, MED_CHANGED, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
+            CLEAR_SHARED_PRIVATE_VAR_BIT(FLOPPYEMUL_SVAR_EMULATION_MODE, 1, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES); // Bit 1 = 0: No floppy emulation B
+            CLEAR_FLAG(FILE_READY_B_FLAG);
+            api_state_version++;
+        }
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
 
-            if (!disk_vectors.hdv_bpb_payload_set)
-            {
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_BPB, disk_vectors.hdv_bpb_payload);
-                disk_vectors.hdv_bpb_payload_set = true;
-            }
-            else
-            {
-                DPRINTF("hdv_bpb_payload previously set.\n");
-            }
-            DPRINTF("hdv_bpb_payload: %x\n", disk_vectors.hdv_bpb_payload);
+    if (IS_FLAG_SET(PING_RECEIVED_FLAG))
+    {
+        DPRINTF("Ping received\n");
+        CLEAR_FLAG(PING_RECEIVED_FLAG);
+        // If we are here, means there is network configured. Fine.
+        // Also check if the SD card is mounted or not
+        bool ok_to_read = microsd_mounted && !error && (IS_FLAG_SET(FILE_READY_A_FLAG) || IS_FLAG_SET(FILE_READY_B_FLAG));
+        DPRINTF("Ok to read: %d\n", ok_to_read);
+        SET_SHARED_PRIVATE_VAR(FLOPPYEMUL_SVAR_PING_STATUS, ok_to_read ? 0xFFFFFFFF : 0, memory_shared_address, FLOPPYEMUL_SHARED_VARIABLES);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
 
-            if (!disk_vectors.hdv_rw_payload_set)
-            {
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_RW, disk_vectors.hdv_rw_payload);
-                disk_vectors.hdv_rw_payload_set = true;
-            }
-            else
-            {
-                DPRINTF("hdv_rw_payload previously set.\n");
-            }
-            DPRINTF("hdv_rw_payload: %x\n", disk_vectors.hdv_rw_payload);
+    if (IS_FLAG_SET(SAVE_VECTORS_FLAG))
+    {
+        CLEAR_FLAG(SAVE_VECTORS_FLAG);
+        // Save the vectors needed for the floppy emulation
+        DPRINTF("Saving vectors\n");
+        // DPRINTF("random token: %x\n", random_token);
+        if (!disk_vectors.XBIOS_trap_payload_set)
+        {
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_XBIOS_TRAP, disk_vectors.XBIOS_trap_payload);
+            disk_vectors.XBIOS_trap_payload_set = true;
+        }
+        else
+        {
+            DPRINTF("XBIOS_trap_payload previously set.\n");
+        }
+        DPRINTF("XBIOS_trap_payload: %x\n", disk_vectors.XBIOS_trap_payload);
 
-            if (!disk_vectors.hdv_mediach_payload_set)
-            {
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_MEDIACH, disk_vectors.hdv_mediach_payload);
-                disk_vectors.hdv_mediach_payload_set = true;
-            }
-            else
-            {
-                DPRINTF("hdv_mediach_payload previously set.\n");
-            }
-            DPRINTF("hdv_mediach_payload: %x\n", disk_vectors.hdv_mediach_payload);
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+        if (!disk_vectors.hdv_bpb_payload_set)
+        {
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_BPB, disk_vectors.hdv_bpb_payload);
+            disk_vectors.hdv_bpb_payload_set = true;
         }
-        if (IS_FLAG_SET(SAVE_HARDWARE_FLAG))
+        else
         {
-            CLEAR_FLAG(SAVE_HARDWARE_FLAG);
-            DPRINTF("Setting hardware type: %x\n", hardware_type.machine);
-            DPRINTF("Setting hardware type start function: %x\n", hardware_type.start_function);
-            DPRINTF("Setting hardware type end function: %x\n", hardware_type.end_function);
+            DPRINTF("hdv_bpb_payload previously set.\n");
+        }
+        DPRINTF("hdv_bpb_payload: %x\n", disk_vectors.hdv_bpb_payload);
 
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_HARDWARE_TYPE, hardware_type.machine);
-            // Self-modifying code to change the speed of the cpu and cache or not. Not strictly needed, but can avoid bus errors
-            // Check if the hardware type is 0x00010010 (Atari MegaSTe)
-            if (hardware_type.machine != 0x00010010)
-            {
-                // write the 0x4E71 opcode (NOP) at the beginning of the function 8 times
-                MEMSET16BIT(memory_code_address, (hardware_type.start_function & 0xFFFF), 8, 0x4E71); // NOP
-                // write the 0x4E71 opcode (NOP) at the end of the function 2 times
-                MEMSET16BIT(memory_code_address, (hardware_type.end_function & 0xFFFF), 2, 0x4E71); // NOP
-            }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+        if (!disk_vectors.hdv_rw_payload_set)
+        {
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_RW, disk_vectors.hdv_rw_payload);
+            disk_vectors.hdv_rw_payload_set = true;
+        }
+        else
+        {
+            DPRINTF("hdv_rw_payload previously set.\n");
         }
+        DPRINTF("hdv_rw_payload: %x\n", disk_vectors.hdv_rw_payload);
 
-        if (IS_FLAG_SET(SECTOR_READ_FLAG))
+        if (!disk_vectors.hdv_mediach_payload_set)
         {
-            CLEAR_FLAG(SECTOR_READ_FLAG);
-            DPRINTF("DISK %s (%d) - LSECTOR: %i / SSIZE: %i\n", disk_number == 0 ? "A:" : "B:", disk_number, logical_sector, sector_size);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_OLD_HDV_MEDIACH, disk_vectors.hdv_mediach_payload);
+            disk_vectors.hdv_mediach_payload_set = true;
+        }
+        else
+        {
+            DPRINTF("hdv_mediach_payload previously set.\n");
+        }
+        DPRINTF("hdv_mediach_payload: %x\n", disk_vectors.hdv_mediach_payload);
+        cmdstats_record(FLOPPYEMUL_SAVE_VECTORS, command_arrival_us);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    if (IS_FLAG_SET(SAVE_HARDWARE_FLAG))
+    {
+        CLEAR_FLAG(SAVE_HARDWARE_FLAG);
+        DPRINTF("Setting hardware type: %x\n", hardware_type.machine);
+        DPRINTF("Setting hardware type start function: %x\n", hardware_type.start_function);
+        DPRINTF("Setting hardware type end function: %x\n", hardware_type.end_function);
+
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, FLOPPYEMUL_HARDWARE_TYPE, hardware_type.machine);
+        // Self-modifying code to change the speed of the cpu and cache or not. Not strictly needed, but can avoid bus errors
+        // Check if the hardware type is 0x00010010 (Atari MegaSTe)
+        if (hardware_type.machine != 0x00010010)
+        {
+            // write the 0x4E71 opcode (NOP) at the beginning of the function 8 times
+            MEMSET16BIT(memory_code_address, (hardware_type.start_function & 0xFFFF), 8, 0x4E71); // NOP
+            // write the 0x4E71 opcode (NOP) at the end of the function 2 times
+            MEMSET16BIT(memory_code_address, (hardware_type.end_function & 0xFFFF), 2, 0x4E71); // NOP
+        }
+        cmdstats_record(FLOPPYEMUL_SAVE_HARDWARE, command_arrival_us);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
 
-            FIL fsrc_tmp = {0};
-            char *fullpath_tmp = NULL;
-            unsigned int br_tmp = {0};
-            if (disk_number == 0)
-            {
-                fsrc_tmp = fsrc_a;
-                fullpath_tmp = fullpath_a;
-                br_tmp = br_a;
-            }
-            else
-            {
-                fsrc_tmp = fsrc_b;
-                fullpath_tmp = fullpath_b;
-                br_tmp = br_b;
-            }
+    if (IS_FLAG_SET(SECTOR_READ_FLAG))
+    {
+        CLEAR_FLAG(SECTOR_READ_FLAG);
+
+        FIL fsrc_tmp = {0};
+        char *fullpath_tmp = NULL;
+        unsigned int br_tmp = {0};
+        if (disk_number == 0)
+        {
+            fsrc_tmp = fsrc_a;
+            fullpath_tmp = fullpath_a;
+            br_tmp = br_a;
+        }
+        else
+        {
+            fsrc_tmp = fsrc_b;
+            fullpath_tmp = fullpath_b;
+            br_tmp = br_b;
+        }
 
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-            /* Set read/write pointer to logical sector position */
-            fr = f_lseek(&fsrc_tmp, logical_sector * sector_size);
-            if (fr)
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+        /* Set read/write pointer to logical sector position */
+        fr = f_lseek(&fsrc_tmp, logical_sector * sector_size);
+        if (fr)
+        {
+            DPRINTF("ERROR: Could not seek file %s (%d). Closing file.\n", fullpath_tmp, fr);
+            f_close(&fsrc_tmp);
+            error = true;
+        }
+        fr = f_read(&fsrc_tmp, (void *)(memory_shared_address + FLOPPYEMUL_IMAGE), sector_size, &br_tmp); /* Read a chunk of data from the source file */
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+        if (fr)
+        {
+            DPRINTF("ERROR: Could not read file %s (%d). Closing file.\n", fullpath_tmp, fr);
+            f_close(&fsrc_tmp);
+            error = true;
+        }
+        else
+        {
+            // After reading from the file, we need to calculate the checksum
+            // Checksum is calculated by adding all the words in the sector
+            uint16_t checksum = 0;
+            for (int i = 0; i < sector_size / 2; i++)
             {
-                DPRINTF("ERROR: Could not seek file %s (%d). Closing file.\n", fullpath_tmp, fr);
-                f_close(&fsrc_tmp);
-                error = true;
+                uint16_t tmp = READ_WORD(memory_shared_address, FLOPPYEMUL_IMAGE + i * 2);
+                checksum += SWAP_WORD(tmp);
             }
-            fr = f_read(&fsrc_tmp, (void *)(memory_shared_address + FLOPPYEMUL_IMAGE), sector_size, &br_tmp); /* Read a chunk of data from the source file */
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-            if (fr)
+            // Set the checksum in the shared memory
+            TRACE(TRACE_FLOPPY_READ, disk_number, logical_sector, checksum);
+            WRITE_WORD(memory_shared_address, FLOPPYEMUL_READ_CHECKSUM, checksum);
+            floppy_stats.sectors_read[disk_number == 0 ? 0 : 1]++;
+            floppy_stats.bytes_read += sector_size;
+        }
+        CHANGE_ENDIANESS_BLOCK16(memory_shared_address + FLOPPYEMUL_IMAGE, sector_size);
+        cmdstats_record(FLOPPYEMUL_READ_SECTORS, command_arrival_us);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    if (IS_FLAG_SET(SECTOR_WRITE_FLAG))
+    {
+        CLEAR_FLAG(SECTOR_WRITE_FLAG);
+        // Only write if the floppy image is read/write. It's important because the FatFS seems to ignore the FA_READ flag
+        if (disk_number == 0 ? floppy_rw_a : floppy_rw_b)
+        {
+            uint16_t chk = 0;
+            uint16_t remote_chk = 1;
+
+            // Copy shared memory to a local buffer
+            uint16_t buff_tmp[(sector_size + 2) / 2];
+            memset(buff_tmp, 0, sizeof(buff_tmp)); // Initialize all elements to zero
+            memcpy(buff_tmp, payloadPtr, sector_size + 2);
+
+            uint16_t *target_start = &buff_tmp[0];
+            // Calculate the checksum of the buffer
+            // Use a 16 bit checksum to minimize the number of loops
+            uint16_t words_to_write = (sector_size) / 2;
+            uint16_t *target16 = (uint16_t *)target_start;
+            // Read the checksum from the last word
+            remote_chk = target16[words_to_write];
+            chk = 0; // Reset the checksum
+            for (int i = 0; i < words_to_write; i++)
             {
-                DPRINTF("ERROR: Could not read file %s (%d). Closing file.\n", fullpath_tmp, fr);
-                f_close(&fsrc_tmp);
-                error = true;
+                // Sum the value
+                chk += target16[i];
             }
-            else
+            if (chk == remote_chk)
             {
-                // After reading from the file, we need to calculate the checksum
-                // Checksum is calculated by adding all the words in the sector
-                uint16_t checksum = 0;
-                for (int i = 0; i < sector_size / 2; i++)
+                // Change the endianness of the bytes read
+                CHANGE_ENDIANESS_BLOCK16(target16, ((sector_size + 1) * 2) / 2);
+                FIL fsrc_tmp = {0};
+                char *fullpath_tmp = NULL;
+                unsigned int br_tmp = {0};
+                if (disk_number == 0)
                 {
-                    uint16_t tmp = READ_WORD(memory_shared_address, FLOPPYEMUL_IMAGE + i * 2);
-                    checksum += SWAP_WORD(tmp);
+                    fsrc_tmp = fsrc_a;
+                    fullpath_tmp = fullpath_a;
+                    br_tmp = br_a;
                 }
-                // Set the checksum in the shared memory
-                DPRINTF("Checksum: %x\n", checksum);
-                WRITE_WORD(memory_shared_address, FLOPPYEMUL_READ_CHECKSUM, checksum);
-            }
-            CHANGE_ENDIANESS_BLOCK16(memory_shared_address + FLOPPYEMUL_IMAGE, sector_size);
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
-        }
-        if (IS_FLAG_SET(SECTOR_WRITE_FLAG))
-        {
-            CLEAR_FLAG(SECTOR_WRITE_FLAG);
-            // Only write if the floppy image is read/write. It's important because the FatFS seems to ignore the FA_READ flag
-            if (disk_number == 0 ? floppy_rw_a : floppy_rw_b)
-            {
-                DPRINTF("DISK %s (%d) - LSECTOR: %i / SSIZE: %i\n", disk_number == 0 ? "A:" : "B:", disk_number, logical_sector, sector_size);
-
-                uint16_t chk = 0;
-                uint16_t remote_chk = 1;
-
-                // Copy shared memory to a local buffer
-                uint16_t buff_tmp[(sector_size + 2) / 2];
-                memset(buff_tmp, 0, sizeof(buff_tmp)); // Initialize all elements to zero
-                memcpy(buff_tmp, payloadPtr, sector_size + 2);
-
-                uint16_t *target_start = &buff_tmp[0];
-                // Calculate the checksum of the buffer
-                // Use a 16 bit checksum to minimize the number of loops
-                uint16_t words_to_write = (sector_size) / 2;
-                uint16_t *target16 = (uint16_t *)target_start;
-                // Read the checksum from the last word
-                remote_chk = target16[words_to_write];
-                chk = 0; // Reset the checksum
-                for (int i = 0; i < words_to_write; i++)
+                else
                 {
-                    // Sum the value
-                    chk += target16[i];
+                    fsrc_tmp = fsrc_b;
+                    fullpath_tmp = fullpath_b;
+                    br_tmp = br_b;
                 }
-                if (chk == remote_chk)
-                {
-                    // Change the endianness of the bytes read
-                    CHANGE_ENDIANESS_BLOCK16(target16, ((sector_size + 1) * 2) / 2);
-                    FIL fsrc_tmp = {0};
-                    char *fullpath_tmp = NULL;
-                    unsigned int br_tmp = {0};
-                    if (disk_number == 0)
-                    {
-                        fsrc_tmp = fsrc_a;
-                        fullpath_tmp = fullpath_a;
-                        br_tmp = br_a;
-                    }
-                    else
-                    {
-                        fsrc_tmp = fsrc_b;
-                        fullpath_tmp = fullpath_b;
-                        br_tmp = br_b;
-                    }
 
-                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-                    /* Set read/write pointer to logical sector position */
-                    fr = f_lseek(&fsrc_tmp, logical_sector * sector_size);
-                    if (fr)
-                    {
-                        DPRINTF("ERROR: Could not seek file %s (%d). Closing file.\r\n", fullpath_tmp, fr);
-                        f_close(&fsrc_a);
-                        error = true;
-                    }
-                    fr = f_write(&fsrc_tmp, target_start, sector_size, &br_tmp); /* Write a chunk of data from the source file */
-                    if (fr)
-                    {
-                        DPRINTF("ERROR: Could not read file %s (%d). Closing file.\r\n", fullpath_tmp, fr);
-                        f_close(&fsrc_a);
-                        error = true;
-                    }
-                    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+                dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+                /* Set read/write pointer to logical sector position */
+                fr = f_lseek(&fsrc_tmp, logical_sector * sector_size);
+                if (fr)
+                {
+                    DPRINTF("ERROR: Could not seek file %s (%d). Closing file.\r\n", fullpath_tmp, fr);
+                    f_close(&fsrc_a);
+                    error = true;
+                }
+                fr = f_write(&fsrc_tmp, target_start, sector_size, &br_tmp); /* Write a chunk of data from the source file */
+                if (fr)
+                {
+                    DPRINTF("ERROR: Could not read file %s (%d). Closing file.\r\n", fullpath_tmp, fr);
+                    f_close(&fsrc_a);
+                    error = true;
                 }
                 else
                 {
-                    DPRINTF("Checksum: x%x. Remote checksum: x%x. Checksum error. Not writing to disk.\n", chk, remote_chk);
-                    // Force the error writing a random token different from the one received
-                    random_token = 0xFFFFFFFF;
+                    TRACE(TRACE_FLOPPY_WRITE, disk_number, logical_sector, chk);
+                    floppy_stats.sectors_written[disk_number == 0 ? 0 : 1]++;
+                    floppy_stats.bytes_written += sector_size;
                 }
+                dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
             }
             else
             {
-                DPRINTF("ERROR: Trying to write to a read-only floppy image.\r\n");
+                DPRINTF("Checksum: x%x. Remote checksum: x%x. Checksum error. Not writing to disk.\n", chk, remote_chk);
+                floppy_stats.checksum_errors++;
+                // Force the error writing a random token different from the one received
+                random_token = 0xFFFFFFFF;
             }
-            SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
         }
-        // If SELECT button is pressed, launch the configurator
-        if (gpio_get(SELECT_GPIO) != 0)
+        else
         {
-            select_button_action(safe_config_reboot, write_config_only_once);
-            // Write config only once to avoid hitting the flash too much
-            write_config_only_once = false;
+            DPRINTF("ERROR: Trying to write to a read-only floppy image.\r\n");
         }
+        cmdstats_record(FLOPPYEMUL_WRITE_SECTORS, command_arrival_us);
+        SET_RANDOM_TOKEN(memory_shared_address + FLOPPYEMUL_RANDOM_TOKEN, random_token);
+    }
+    // If SELECT button is pressed, launch the configurator
+    if (gpio_get(SELECT_GPIO) != 0)
+    {
+        select_button_action(select_safe_config_reboot, write_config_only_once);
+        // Write config only once to avoid hitting the flash too much
+        write_config_only_once = false;
+    }
+    return !error;
+}
+
+/**
+ * @brief Initializes the floppy emulator.
+ *
+ * This function initializes and launch the floppy emulator.
+ *
+ * @param safe_config_reboot A boolean value indicating whether to perform a safe configuration reboot.
+ */
+void init_floppyemul(bool safe_config_reboot)
+{
+    floppyemul_setup(safe_config_reboot);
+    while (floppyemul_poll())
+    {
     }
     // Init the CYW43 WiFi module. Needed to show the error message in the LED
     // cyw43_arch_init();
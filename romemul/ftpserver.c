@@ -22,6 +22,16 @@
 #include <time.h>
 
 #include "include/vfs.h"
+#include "include/dlsink.h"
+#include "include/dircache.h"
+
+/* Size of the FIFO of the data connections. RETR keeps the bytes in the FIFO until
+   they are acknowledged, so it must hold the whole TCP send buffer. */
+#define FTPD_DATA_FIFO_SIZE (16 * 1024)
+/* Reads and writes of the files are done in whole sectors */
+#define FTPD_SECTOR_SIZE 512
+/* Size of the FIFO of the replies of the control connections */
+#define FTPD_MSG_FIFO_SIZE 2048
 
 #define EINVAL 1
 #define ENOMEM 2
@@ -45,6 +55,7 @@
 #define msg200 "200 Command okay."
 #define msg202 "202 Command not implemented, superfluous at this site."
 #define msg211 "211 System status, or system help reply."
+#define msg211FEAT "211-Features:\r\n MLST type*;size*;modify*;\r\n211 End"
 #define msg212 "212 Directory status."
 #define msg213 "213 File status."
 #define msg214 "214 %s."
@@ -81,6 +92,7 @@
 */
 #define msg230 "230 User logged in, proceed."
 #define msg250 "250 Requested file action okay, completed."
+#define msg250MLST "250-Listing %s\r\n %s %s\r\n250 End"
 #define msg257PWD "257 \"%s\" is current directory."
 #define msg257 "257 \"%s\" created."
 /*
@@ -136,6 +148,7 @@ enum ftpd_state_e {
 	FTPD_IDLE,
 	FTPD_NLST,
 	FTPD_LIST,
+	FTPD_MLSD,
 	FTPD_RETR,
 	FTPD_RNFR,
 	FTPD_STOR,
@@ -218,45 +231,22 @@ typedef struct sfifo_t
 #define sfifo_space(x)	((x)->size - 1 - sfifo_used(x))
 
 /*
- * Alloc buffer, init FIFO etc...
+ * Init FIFO over a buffer of the session pool. The buffer is not
+ * allocated here, so the size must already be a power of 2. The
+ * FIFO can hold size - 1 bytes.
  */
-static int sfifo_init(sfifo_t *f, int size)
+static int sfifo_init(sfifo_t *f, char *buffer, int size)
 {
 	memset(f, 0, sizeof(sfifo_t));
 
-	if(size > SFIFO_MAX_BUFFER_SIZE)
+	if(size > SFIFO_MAX_BUFFER_SIZE || (size & (size - 1)) != 0)
 		return -EINVAL;
 
-	/*
-	 * Set sufficient power-of-2 size.
-	 *
-	 * No, there's no bug. If you need
-	 * room for N bytes, the buffer must
-	 * be at least N+1 bytes. (The fifo
-	 * can't tell 'empty' from 'full'
-	 * without unsafe index manipulations
-	 * otherwise.)
-	 */
-	f->size = 1;
-	for(; f->size <= size; f->size <<= 1)
-		;
-
-	/* Get buffer */
-	if( 0 == (f->buffer = (void *)malloc(f->size)) )
-		return -ENOMEM;
-
+	f->buffer = buffer;
+	f->size = size;
 	return 0;
 }
 
-/*
- * Dealloc buffer etc...
- */
-static void sfifo_close(sfifo_t *f)
-{
-	if(f->buffer)
-		free(f->buffer);
-}
-
 /*
  * Write bytes to a FIFO
  * Return number of bytes written, or an error code
@@ -287,19 +277,26 @@ static int sfifo_write(sfifo_t *f, const void *_buf, int len)
 		i = 0;
 	}
 	memcpy(f->buffer + i, buf, len);
-	f->writepos = i + len;
+	f->writepos = (i + len) & SFIFO_SIZEMASK(f);
 
 	return total;
 }
 
 struct ftpd_datastate {
 	int connected;
-	vfs_dir_t *vfs_dir;
-	vfs_dirent_t *vfs_dirent;
+	vfs_dir_t *vfs_dir;	/* Listing of a directory too big for the cache */
+	DirCache *dircache;	/* Cached listing of the directory */
+	uint32_t dirpos;	/* Next entry of the cached listing */
+	FILINFO fno;		/* Entry of the listing waiting for room in the FIFO */
+	int fno_pending;
 	vfs_file_t *vfs_file;
 	sfifo_t fifo;
+	int sentpos;		/* Bytes of the FIFO before this position are queued to TCP */
+	DownloadSink sink;	/* STOR: stages the received data in the FIFO buffer */
 	struct tcp_pcb *msgpcb;
 	struct ftpd_msgstate *msgfs;
+	int transfer;		/* A LIST, NLST, MLSD, RETR or STOR uses the connection */
+	u64_t opened_us;	/* When the transfer started */
 };
 
 struct ftpd_msgstate {
@@ -313,9 +310,85 @@ struct ftpd_msgstate {
 	struct ftpd_datastate *datafs;
 	int passive;
 	char *renamefrom;
+	struct ftpd_session *session;
 };
 
+/*
+ * A client session. The control and the data connection of a client use the
+ * same slot of the pool: a client has at most one data connection at a time.
+ */
+struct ftpd_session {
+	int in_use;
+	struct ftpd_msgstate msgstate;
+	struct ftpd_datastate datastate;
+	FtpSessionStats stats;
+	char msgbuffer[FTPD_MSG_FIFO_SIZE];
+	char databuffer[FTPD_DATA_FIFO_SIZE];
+};
+
+/* The pool is allocated once when the server starts and never freed, so
+   clients connecting and disconnecting do not fragment the heap. */
+static struct ftpd_session *sessions = NULL;
+static int max_sessions = 0;
+
+static struct ftpd_session *session_alloc(void)
+{
+	int i;
+
+	for (i = 0; i < max_sessions; i++) {
+		struct ftpd_session *session = &sessions[i];
+
+		if (session->in_use)
+			continue;
+		memset(session, 0, offsetof(struct ftpd_session, msgbuffer));
+		session->in_use = 1;
+		session->stats.connected_us = time_us_64();
+		session->msgstate.session = session;
+		sfifo_init(&session->msgstate.fifo, session->msgbuffer, FTPD_MSG_FIFO_SIZE);
+		return session;
+	}
+	return NULL;
+}
+
+static void session_free(struct ftpd_session *session)
+{
+	session->in_use = 0;
+}
+
+/* The data connection state of a session. Any previous one must be closed */
+static struct ftpd_datastate *datastate_alloc(struct tcp_pcb *msgpcb, struct ftpd_msgstate *fsm)
+{
+	struct ftpd_datastate *fsd = &fsm->session->datastate;
+
+	memset(fsd, 0, sizeof(struct ftpd_datastate));
+	sfifo_init(&fsd->fifo, fsm->session->databuffer, FTPD_DATA_FIFO_SIZE);
+	fsd->msgfs = fsm;
+	fsd->msgpcb = msgpcb;
+	return fsd;
+}
+
+/* A command starts a transfer on the data connection. Only these are counted */
+static void datastate_start(struct ftpd_datastate *fsd)
+{
+	fsd->transfer = 1;
+	fsd->opened_us = time_us_64();
+	fsd->msgfs->session->stats.transferring = true;
+}
+
+static void datastate_free(struct ftpd_datastate *fsd)
+{
+	FtpSessionStats *stats = &fsd->msgfs->session->stats;
+
+	if (!fsd->transfer)
+		return;
+	fsd->transfer = 0;
+	stats->transfers++;
+	stats->transfer_us += time_us_64() - fsd->opened_us;
+	stats->transferring = false;
+}
+
 static void send_msg(struct tcp_pcb *pcb, struct ftpd_msgstate *fsm, char *msg, ...);
+static void ftpd_dataclose(struct tcp_pcb *pcb, struct ftpd_datastate *fsd);
 
 static void ftpd_dataerr(void *arg, err_t err)
 {
@@ -324,16 +397,18 @@ static void ftpd_dataerr(void *arg, err_t err)
 	LWIP_DEBUGF(FTPD_DEBUG, ("ftpd_dataerr: %s (%i)\n", lwip_strerr(err), err));
 	if (fsd == NULL)
 		return;
-	fsd->msgfs->datafs = NULL;
 	fsd->msgfs->state = FTPD_IDLE;
-	free(fsd);
+	/* The pcb is already freed by lwIP. Release the rest of the state */
+	ftpd_dataclose(NULL, fsd);
 }
 
 static void ftpd_dataclose(struct tcp_pcb *pcb, struct ftpd_datastate *fsd)
 {
-	tcp_arg(pcb, NULL);
-	tcp_sent(pcb, NULL);
-	tcp_recv(pcb, NULL);
+	if (pcb) {
+		tcp_arg(pcb, NULL);
+		tcp_sent(pcb, NULL);
+		tcp_recv(pcb, NULL);
+	}
 
 	if (fsd->msgfs->datalistenpcb) {
 		tcp_arg(fsd->msgfs->datalistenpcb, NULL);
@@ -343,10 +418,32 @@ static void ftpd_dataclose(struct tcp_pcb *pcb, struct ftpd_datastate *fsd)
 	}
 
 	fsd->msgfs->datafs = NULL;
-	sfifo_close(&fsd->fifo);
-	free(fsd);
-	tcp_arg(pcb, NULL);
-	tcp_close(pcb);
+	fsd->msgfs->datapcb = NULL;
+	if (fsd->vfs_file)
+		vfs_close(fsd->vfs_file);
+	if (fsd->vfs_dir)
+		vfs_closedir(fsd->vfs_dir);
+	dircache_release(fsd->dircache);
+	datastate_free(fsd);
+	if (pcb == NULL)
+		return;
+	/* The queued segments point to the FIFO of the session. A closed pcb
+	   would retransmit them after the next transfer reuses the FIFO, so a
+	   transfer that is not acknowledged yet is reset. It only happens from
+	   the control connection: ABOR, a new PASV or PORT, QUIT or an error. */
+	if (sfifo_used(&fsd->fifo) > 0)
+		tcp_abort(pcb);
+	else
+		tcp_close(pcb);
+}
+
+/* Drop the data connection of a session that is not finished */
+static void abort_dataconnection(struct ftpd_msgstate *fsm)
+{
+	if (fsm->datafs == NULL)
+		return;
+	ftpd_dataclose(fsm->datapcb, fsm->datafs);
+	fsm->state = FTPD_IDLE;
 }
 
 static void close_with_message(struct ftpd_datastate *fsd, struct tcp_pcb *pcb, char* msg) {
@@ -363,41 +460,53 @@ static void close_with_message(struct ftpd_datastate *fsd, struct tcp_pcb *pcb,
 }
 
 
+/*
+ * Queue the data of the FIFO that is not sent yet. The data is not copied:
+ * it stays in the FIFO until it is acknowledged in ftpd_datasent().
+ */
 static void send_data(struct tcp_pcb *pcb, struct ftpd_datastate *fsd)
 {
-	err_t err;
-	u16_t len;
-
-	if (sfifo_used(&fsd->fifo) > 0) {
-		int i;
+	while (fsd->sentpos != fsd->fifo.writepos) {
+		err_t err;
+		int len;
 
-		/* We cannot send more data than space available in the send
-		   buffer. */
-		if (tcp_sndbuf(pcb) < sfifo_used(&fsd->fifo)) {
+		if (fsd->sentpos < fsd->fifo.writepos)
+			len = fsd->fifo.writepos - fsd->sentpos;
+		else
+			len = fsd->fifo.size - fsd->sentpos;
+		if (len > tcp_sndbuf(pcb))
 			len = tcp_sndbuf(pcb);
-		} else {
-			len = (u16_t) sfifo_used(&fsd->fifo);
-		}
-
-		i = fsd->fifo.readpos;
-		if ((i + len) > fsd->fifo.size) {
-			err = tcp_write(pcb, fsd->fifo.buffer + i, (u16_t)(fsd->fifo.size - i), 1);
-			if (err != ERR_OK) {
-				LWIP_DEBUGF(FTPD_DEBUG, ("send_data: error writing!\n"));
-				return;
-			}
-			len -= fsd->fifo.size - i;
-			fsd->fifo.readpos = 0;
-			i = 0;
-		}
+		if (len == 0)
+			break;
 
-		err = tcp_write(pcb, fsd->fifo.buffer + i, len, 1);
+		err = tcp_write(pcb, fsd->fifo.buffer + fsd->sentpos, (u16_t)len, 0);
 		if (err != ERR_OK) {
 			LWIP_DEBUGF(FTPD_DEBUG, ("send_data: error writing!\n"));
-			return;
+			break;
 		}
-		fsd->fifo.readpos += len;
+		fsd->sentpos = (fsd->sentpos + len) & SFIFO_SIZEMASK(&fsd->fifo);
 	}
+	tcp_output(pcb);
+}
+
+/*
+ * Read the file straight into the contiguous free region of the FIFO.
+ * Whole sectors are read so FatFs can transfer them without its own buffer.
+ */
+static int read_file_data(struct ftpd_datastate *fsd)
+{
+	int len;
+
+	len = fsd->fifo.size - fsd->fifo.writepos;
+	if (len > sfifo_space(&fsd->fifo))
+		len = sfifo_space(&fsd->fifo);
+	len &= ~(FTPD_SECTOR_SIZE - 1);
+	if (len == 0)
+		return 0;
+
+	len = vfs_read(fsd->fifo.buffer + fsd->fifo.writepos, 1, len, fsd->vfs_file);
+	fsd->fifo.writepos = (fsd->fifo.writepos + len) & SFIFO_SIZEMASK(&fsd->fifo);
+	return len;
 }
 
 static void send_file(struct ftpd_datastate *fsd, struct tcp_pcb *pcb)
@@ -406,104 +515,131 @@ static void send_file(struct ftpd_datastate *fsd, struct tcp_pcb *pcb)
 		return;
 
 	if (fsd->vfs_file) {
-		char buffer[2048];
-		int len;
+		/* Keep the FIFO and the TCP send buffer full */
+		while (1) {
+			int len;
 
-		len = sfifo_space(&fsd->fifo);
-		if (len == 0) {
+			len = read_file_data(fsd);
 			send_data(pcb, fsd);
-			return;
+			if (len == 0 || tcp_sndbuf(pcb) == 0)
+				break;
 		}
-		if (len > 2048)
-			len = 2048;
-		len = vfs_read(buffer, 1, len, fsd->vfs_file);
-		if (len == 0) {
-			if (vfs_eof(fsd->vfs_file) == 0)
-				return;
-			vfs_close(fsd->vfs_file);
-			fsd->vfs_file = NULL;
+		if (vfs_eof(fsd->vfs_file) == 0)
 			return;
-		}
-		sfifo_write(&fsd->fifo, buffer, len);
+		vfs_close(fsd->vfs_file);
+		fsd->vfs_file = NULL;
+	}
+
+	/* Close when all the data is acknowledged. Until then the FIFO is in use */
+	if (sfifo_used(&fsd->fifo) > 0) {
 		send_data(pcb, fsd);
-	} else {
-		if (sfifo_used(&fsd->fifo) > 0) {
-			send_data(pcb, fsd);
-			return;
-		}
-		close_with_message(fsd, pcb, msg226);
 		return;
 	}
+	close_with_message(fsd, pcb, msg226);
 }
 
-static void send_next_directory(struct ftpd_datastate *fsd, struct tcp_pcb *pcb, int shortlist)
+/* Read the next entry of the listing into fsd->fno */
+static int read_directory_entry(struct ftpd_datastate *fsd)
 {
-	char buffer[1024];
+	if (fsd->dircache) {
+		const DirCacheEntry *entry;
+
+		if (fsd->dirpos >= fsd->dircache->count)
+			return 0;
+		entry = &fsd->dircache->entries[fsd->dirpos];
+		strcpy(fsd->fno.fname, dircache_name(fsd->dircache, fsd->dirpos));
+		fsd->fno.fsize = entry->size;
+		fsd->fno.fdate = entry->fdate;
+		fsd->fno.ftime = entry->ftime;
+		fsd->fno.fattrib = entry->attrib;
+		fsd->dirpos++;
+		return 1;
+	}
+	if (f_readdir(fsd->vfs_dir, &fsd->fno) != FR_OK)
+		return 0;
+	return fsd->fno.fname[0] != 0;
+}
+
+/* MLSD/MLST facts of an entry. The FAT date and time are used as they are */
+static int format_facts(char *buffer, const FILINFO *fno)
+{
+	return sprintf(buffer, "type=%s;size=%lu;modify=%04i%02i%02i%02i%02i%02i;",
+		(fno->fattrib & AM_DIR) ? "dir" : "file", (unsigned long)fno->fsize,
+		1980 + (fno->fdate >> 9), (fno->fdate >> 5) & 0xf, fno->fdate & 0x1f,
+		fno->ftime >> 11, (fno->ftime >> 5) & 0x3f, (fno->ftime & 0x1f) * 2);
+}
+
+static int format_directory_entry(char *buffer, enum ftpd_state_e state, const FILINFO *fno)
+{
+	int month;
 	int len;
 
+	switch (state) {
+	case FTPD_NLST:
+		return sprintf(buffer, "%s\r\n", fno->fname);
+	case FTPD_MLSD:
+		len = format_facts(buffer, fno);
+		return len + sprintf(buffer + len, " %s\r\n", fno->fname);
+	default:
+		month = (fno->fdate >> 5) & 0xf;
+		if (month < 1 || month > 12)
+			month = 1;
+		len = sprintf(buffer, "-rw-rw-rw-   1 user     ftp  %11lu %s %02i %5i %s\r\n", (unsigned long)fno->fsize, month_table[month - 1], fno->fdate & 0x1f, 1980 + (fno->fdate >> 9), fno->fname);
+		if (fno->fattrib & AM_DIR)
+			buffer[0] = 'd';
+		return len;
+	}
+}
+
+static void send_next_directory(struct ftpd_datastate *fsd, struct tcp_pcb *pcb)
+{
+	char buffer[FF_LFN_BUF + 96];
+	int len;
+
+	/* Fill the FIFO with as many entries as fit. They go out in full segments */
 	while (1) {
-	if (fsd->vfs_dirent == NULL)
-		fsd->vfs_dirent = vfs_readdir(fsd->vfs_dir);
-
-	if (fsd->vfs_dirent) {
-		if (shortlist) {
-			len = sprintf(buffer, "%s\r\n", fsd->vfs_dirent->name);
-			if (sfifo_space(&fsd->fifo) < len) {
-				send_data(pcb, fsd);
-				return;
-			}
-			sfifo_write(&fsd->fifo, buffer, len);
-			fsd->vfs_dirent = NULL;
-		} else {
-			vfs_stat_t st;
-			time_t current_time;
-			int current_year;
-			struct tm *s_time;
-
-			time(&current_time);
-			s_time = gmtime(&current_time);
-			current_year = s_time->tm_year;
-
-			vfs_stat(fsd->msgfs->vfs, fsd->vfs_dirent->name, &st);
-			s_time = gmtime(&st.st_mtime);
-			if (s_time->tm_year == current_year)
-				len = sprintf(buffer, "-rw-rw-rw-   1 user     ftp  %11ld %s %02i %02i:%02i %s\r\n", st.st_size, month_table[s_time->tm_mon], s_time->tm_mday, s_time->tm_hour, s_time->tm_min, fsd->vfs_dirent->name);
-			else
-				len = sprintf(buffer, "-rw-rw-rw-   1 user     ftp  %11ld %s %02i %5i %s\r\n", st.st_size, month_table[s_time->tm_mon], s_time->tm_mday, s_time->tm_year + 1900, fsd->vfs_dirent->name);
-			if (VFS_ISDIR(st.st_mode))
-				buffer[0] = 'd';
-			if (sfifo_space(&fsd->fifo) < len) {
-				send_data(pcb, fsd);
-				return;
-			}
-			sfifo_write(&fsd->fifo, buffer, len);
-			fsd->vfs_dirent = NULL;
+		if (!fsd->fno_pending) {
+			if (!read_directory_entry(fsd))
+				break;
+			fsd->fno_pending = 1;
 		}
-	} else {
-		if (sfifo_used(&fsd->fifo) > 0) {
+		len = format_directory_entry(buffer, fsd->msgfs->state, &fsd->fno);
+		if (sfifo_space(&fsd->fifo) < len) {
 			send_data(pcb, fsd);
 			return;
 		}
+		sfifo_write(&fsd->fifo, buffer, len);
+		fsd->fno_pending = 0;
+	}
 
-		vfs_closedir(fsd->vfs_dir);
-		fsd->vfs_dir = NULL;
-		close_with_message(fsd, pcb, msg226);
+	if (sfifo_used(&fsd->fifo) > 0) {
+		send_data(pcb, fsd);
 		return;
 	}
+
+	if (fsd->vfs_dir) {
+		vfs_closedir(fsd->vfs_dir);
+		fsd->vfs_dir = NULL;
 	}
+	dircache_release(fsd->dircache);
+	fsd->dircache = NULL;
+	close_with_message(fsd, pcb, msg226);
 }
 
 static err_t ftpd_datasent(void *arg, struct tcp_pcb *pcb, u16_t len)
 {
 	struct ftpd_datastate *fsd = arg;
-	(void) len; /* suppress unused warning */
+
+	fsd->msgfs->session->stats.bytes_sent += len;
+
+	/* The acknowledged bytes of the FIFO can be reused */
+	fsd->fifo.readpos = (fsd->fifo.readpos + len) & SFIFO_SIZEMASK(&fsd->fifo);
 
 	switch (fsd->msgfs->state) {
 	case FTPD_LIST:
-		send_next_directory(fsd, pcb, 0);
-		break;
 	case FTPD_NLST:
-		send_next_directory(fsd, pcb, 1);
+	case FTPD_MLSD:
+		send_next_directory(fsd, pcb);
 		break;
 	case FTPD_RETR:
 		send_file(fsd, pcb);
@@ -515,36 +651,42 @@ static err_t ftpd_datasent(void *arg, struct tcp_pcb *pcb, u16_t len)
 	return ERR_OK;
 }
 
+static bool stor_persist(void *arg, uint8_t *data, uint32_t size)
+{
+	return vfs_write(data, 1, size, (vfs_file_t *)arg) == (int)size;
+}
+
 static err_t ftpd_datarecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
 {
 	struct ftpd_datastate *fsd = arg;
 
+	if (err == ERR_OK && p != NULL && (fsd->msgfs->state != FTPD_STOR || fsd->vfs_file == NULL)) {
+		/* No STOR in progress, discard the data */
+		tcp_recved(pcb, p->tot_len);
+		pbuf_free(p);
+		return ERR_OK;
+	}
 	if (err == ERR_OK && p != NULL) {
-		struct pbuf *q;
-		u16_t tot_len = 0;
-
-		for (q = p; q != NULL; q = q->next) {
-			int len;
-
-			len = vfs_write(q->payload, 1, q->len, fsd->vfs_file);
-			tot_len += len;
-			if (len != q->len) {
-				vfs_close(fsd->vfs_file);
-				fsd->vfs_file = NULL;
-				close_with_message(fsd, pcb, msg553);
-				break;
-			}
-		}
-
-		/* Inform TCP that we have taken the data. */
-		tcp_recved(pcb, tot_len);
+		fsd->msgfs->session->stats.bytes_received += p->tot_len;
 
+		/* The pbufs are coalesced into sector aligned writes. TCP is
+		   only informed that we have taken the data once it is written. */
+		download_sink_write_pbuf(&fsd->sink, pcb, p);
 		pbuf_free(p);
+		if (fsd->sink.failed) {
+			vfs_close(fsd->vfs_file);
+			fsd->vfs_file = NULL;
+			dircache_invalidate(NULL);
+			close_with_message(fsd, pcb, msg553);
+		}
 	}
 	if (err == ERR_OK && p == NULL) {
+		int written = download_sink_finish(&fsd->sink, 0, 0);
+
 		vfs_close(fsd->vfs_file);
 		fsd->vfs_file = NULL;
-		close_with_message(fsd, pcb, msg226);
+		dircache_invalidate(NULL);
+		close_with_message(fsd, pcb, written ? msg226 : msg553);
 	}
 
 	return ERR_OK;
@@ -570,10 +712,9 @@ static err_t ftpd_dataconnected(void *arg, struct tcp_pcb *pcb, err_t err)
 
 	switch (fsd->msgfs->state) {
 	case FTPD_LIST:
-		send_next_directory(fsd, pcb, 0);
-		break;
 	case FTPD_NLST:
-		send_next_directory(fsd, pcb, 1);
+	case FTPD_MLSD:
+		send_next_directory(fsd, pcb);
 		break;
 	case FTPD_RETR:
 		send_file(fsd, pcb);
@@ -606,10 +747,9 @@ static err_t ftpd_dataaccept(void *arg, struct tcp_pcb *pcb, err_t err)
 
 	switch (fsd->msgfs->state) {
 	case FTPD_LIST:
-		send_next_directory(fsd, pcb, 0);
-		break;
 	case FTPD_NLST:
-		send_next_directory(fsd, pcb, 1);
+	case FTPD_MLSD:
+		send_next_directory(fsd, pcb);
 		break;
 	case FTPD_RETR:
 		send_file(fsd, pcb);
@@ -623,33 +763,23 @@ static err_t ftpd_dataaccept(void *arg, struct tcp_pcb *pcb, err_t err)
 
 static int open_dataconnection(struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 {
-	if (fsm->passive)
+	if (fsm->passive) {
+		/* The data connection of a PASV is for one transfer */
+		if (fsm->datafs == NULL) {
+			send_msg(pcb, fsm, msg425);
+			return 1;
+		}
+		datastate_start(fsm->datafs);
 		return 0;
-
-	/* Allocate memory for the structure that holds the state of the
-	   connection. */
-	fsm->datafs = malloc(sizeof(struct ftpd_datastate));
-
-	if (fsm->datafs == NULL) {
-		LWIP_DEBUGF(FTPD_DEBUG, ("open_dataconnection: Out of memory\n"));
-		send_msg(pcb, fsm, msg451);
-		return 1;
 	}
-	memset(fsm->datafs, 0, sizeof(struct ftpd_datastate));
-	fsm->datafs->msgfs = fsm;
-	fsm->datafs->msgpcb = pcb;
 
-	if (sfifo_init(&fsm->datafs->fifo, 2000) != 0) {
-		free(fsm->datafs);
-		send_msg(pcb, fsm, msg451);
-		return 1;
-	}
+	abort_dataconnection(fsm);
+	fsm->datafs = datastate_alloc(pcb, fsm);
 
 	fsm->datapcb = tcp_new();
 
 	if (fsm->datapcb == NULL) {
-		sfifo_close(&fsm->datafs->fifo);
-		free(fsm->datafs);
+		ftpd_dataclose(NULL, fsm->datafs);
 		send_msg(pcb, fsm, msg451);
 		return 1;
 	}
@@ -661,6 +791,7 @@ static int open_dataconnection(struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 	IP_SET_TYPE_VAL(dataip, IPADDR_TYPE_V4);
 	ip4_addr_copy(*ip_2_ip4(&dataip), fsm->dataip);
 	tcp_connect(fsm->datapcb, &dataip, fsm->dataport, ftpd_dataconnected);
+	datastate_start(fsm->datafs);
 
 	return 0;
 }
@@ -700,6 +831,9 @@ static void cmd_port(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 	} else {
 		IP4_ADDR(&fsm->dataip, (u8_t) ip[0], (u8_t) ip[1], (u8_t) ip[2], (u8_t) ip[3]);
 		fsm->dataport = ((u16_t) pHi << 8) | (u16_t) pLo;
+		/* Back to active mode. The connection of a previous PASV is dropped */
+		abort_dataconnection(fsm);
+		fsm->passive = 0;
 		send_msg(pcb, fsm, msg200);
 	}
 }
@@ -742,9 +876,10 @@ static void cmd_pwd(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *
 	}
 }
 
-static void cmd_list_common(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm, int shortlist)
+static void cmd_list_common(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm, enum ftpd_state_e state)
 {
-	vfs_dir_t *vfs_dir;
+	vfs_dir_t *vfs_dir = NULL;
+	DirCache *dircache;
 	char *cwd;
 	(void) arg; /* suppress unused warning */
 
@@ -753,36 +888,126 @@ static void cmd_list_common(const char *arg, struct tcp_pcb *pcb, struct ftpd_ms
 		send_msg(pcb, fsm, msg451);
 		return;
 	}
-	vfs_dir = vfs_opendir(fsm->vfs, cwd);
+	/* The directories too big for the cache are read while listing */
+	dircache = dircache_get(cwd);
+	if (!dircache)
+		vfs_dir = vfs_opendir(fsm->vfs, cwd);
 	free(cwd);
-	if (!vfs_dir) {
+	if (!dircache && !vfs_dir) {
 		send_msg(pcb, fsm, msg451);
 		return;
 	}
 
 	if (open_dataconnection(pcb, fsm) != 0) {
-		vfs_closedir(vfs_dir);
+		if (vfs_dir)
+			vfs_closedir(vfs_dir);
+		dircache_release(dircache);
 		return;
 	}
 
 	fsm->datafs->vfs_dir = vfs_dir;
-	fsm->datafs->vfs_dirent = NULL;
-	if (shortlist != 0)
-		fsm->state = FTPD_NLST;
-	else
-		fsm->state = FTPD_LIST;
+	fsm->datafs->dircache = dircache;
+	fsm->datafs->dirpos = 0;
+	fsm->datafs->fno_pending = 0;
+	fsm->state = state;
 
 	send_msg(pcb, fsm, msg150);
 }
 
 static void cmd_nlst(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 {
-	cmd_list_common(arg, pcb, fsm, 1);
+	cmd_list_common(arg, pcb, fsm, FTPD_NLST);
 }
 
 static void cmd_list(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 {
-	cmd_list_common(arg, pcb, fsm, 0);
+	cmd_list_common(arg, pcb, fsm, FTPD_LIST);
+}
+
+static void cmd_mlsd(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
+{
+	cmd_list_common(arg, pcb, fsm, FTPD_MLSD);
+}
+
+/* Append the components of a path. "." is skipped and ".." removes the last component,
+   because f_stat does not accept them */
+static int append_path(char *path, size_t *len, size_t size, const char *src)
+{
+	size_t n;
+
+	while (*src) {
+		n = strcspn(src, "/");
+		if (n == 2 && src[0] == '.' && src[1] == '.') {
+			while (*len > 0 && path[--(*len)] != '/')
+				;
+		} else if (n > 0 && !(n == 1 && src[0] == '.')) {
+			if (*len + 1 + n >= size)
+				return -1;
+			path[(*len)++] = '/';
+			memcpy(path + *len, src, n);
+			*len += n;
+		}
+		src += n;
+		if (*src == '/')
+			src++;
+	}
+	path[*len] = '\0';
+	return 0;
+}
+
+/* Absolute path of an argument. Relative paths start at the working directory */
+static int resolve_path(struct ftpd_msgstate *fsm, const char *arg, char *path, size_t size)
+{
+	size_t len = 0;
+	char *cwd;
+	int r = 0;
+
+	if (*arg != '/') {
+		cwd = vfs_getcwd(fsm->vfs, NULL, 0);
+		if (!cwd)
+			return -1;
+		r = append_path(path, &len, size, cwd);
+		free(cwd);
+	}
+	if (r == 0)
+		r = append_path(path, &len, size, arg);
+	if (r == 0 && len == 0)
+		strcpy(path, "/");
+	return r;
+}
+
+static void cmd_mlst(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
+{
+	char path[512];
+	vfs_stat_t st;
+	FILINFO fno;
+	char facts[64];
+
+	if (resolve_path(fsm, arg, path, sizeof(path)) != 0) {
+		send_msg(pcb, fsm, msg550);
+		return;
+	}
+	if (strcmp(path, "/") == 0) {
+		/* The root directory cannot be passed to f_stat */
+		strcpy(facts, "type=dir;");
+	} else {
+		if (vfs_stat(fsm->vfs, path, &st) != 0) {
+			send_msg(pcb, fsm, msg550);
+			return;
+		}
+		fno.fsize = st.st_size;
+		fno.fattrib = st.st_mode;
+		fno.fdate = st.st_fdate;
+		fno.ftime = st.st_ftime;
+		format_facts(facts, &fno);
+	}
+	send_msg(pcb, fsm, msg250MLST, path, facts, path);
+}
+
+static void cmd_feat(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
+{
+	(void) arg; /* suppress unused warning */
+	send_msg(pcb, fsm, msg211FEAT);
 }
 
 static void cmd_retr(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
@@ -830,6 +1055,7 @@ static void cmd_stor(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 	}
 
 	fsm->datafs->vfs_file = vfs_file;
+	download_sink_init(&fsm->datafs->sink, (uint8_t *)fsm->datafs->fifo.buffer, DOWNLOAD_SINK_SD_BUFFER_SIZE, stor_persist, vfs_file);
 	fsm->state = FTPD_STOR;
 }
 
@@ -852,28 +1078,14 @@ static void cmd_pasv(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 	struct tcp_pcb *temppcb;
 	(void) arg; /* suppress unused warning */
 
-	/* Allocate memory for the structure that holds the state of the
-	   connection. */
-	fsm->datafs = malloc(sizeof(struct ftpd_datastate));
-
-	if (fsm->datafs == NULL) {
-		LWIP_DEBUGF(FTPD_DEBUG, ("cmd_pasv: Out of memory\n"));
-		send_msg(pcb, fsm, msg451);
-		return;
-	}
-	memset(fsm->datafs, 0, sizeof(struct ftpd_datastate));
-
-	if (sfifo_init(&fsm->datafs->fifo, 2000) != 0) {
-		free(fsm->datafs);
-		send_msg(pcb, fsm, msg451);
-		return;
-	}
+	/* A second PASV replaces the data connection of the first one */
+	abort_dataconnection(fsm);
+	fsm->datafs = datastate_alloc(pcb, fsm);
 
 	fsm->datalistenpcb = tcp_new();
 
 	if (fsm->datalistenpcb == NULL) {
-		free(fsm->datafs);
-		sfifo_close(&fsm->datafs->fifo);
+		ftpd_dataclose(NULL, fsm->datafs);
 		send_msg(pcb, fsm, msg451);
 		return;
 	}
@@ -895,9 +1107,8 @@ static void cmd_pasv(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 		if (err == ERR_USE) {
 			continue;
 		} else {
-			ftpd_dataclose(fsm->datalistenpcb, fsm->datafs);
-			fsm->datalistenpcb = NULL;
-			fsm->datafs = NULL;
+			ftpd_dataclose(NULL, fsm->datafs);
+			send_msg(pcb, fsm, msg451);
 			return;
 		}
 	}
@@ -905,17 +1116,14 @@ static void cmd_pasv(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 	temppcb = tcp_listen(fsm->datalistenpcb);
 	if (!temppcb) {
 		LWIP_DEBUGF(FTPD_DEBUG, ("cmd_pasv: tcp_listen failed\n"));
-		ftpd_dataclose(fsm->datalistenpcb, fsm->datafs);
-		fsm->datalistenpcb = NULL;
-		fsm->datafs = NULL;
+		ftpd_dataclose(NULL, fsm->datafs);
+		send_msg(pcb, fsm, msg451);
 		return;
 	}
 	fsm->datalistenpcb = temppcb;
 
 	fsm->passive = 1;
 	fsm->datafs->connected = 0;
-	fsm->datafs->msgfs = fsm;
-	fsm->datafs->msgpcb = pcb;
 
 	/* Tell TCP that this is the structure we wish to be passed for our
 	   callbacks. */
@@ -927,15 +1135,7 @@ static void cmd_pasv(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 static void cmd_abrt(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 {
 	(void) arg; /* suppress unused warning */
-	if (fsm->datafs != NULL) {
-		tcp_arg(fsm->datapcb, NULL);
-		tcp_sent(fsm->datapcb, NULL);
-		tcp_recv(fsm->datapcb, NULL);
-		tcp_abort(pcb);
-		sfifo_close(&fsm->datafs->fifo);
-		free(fsm->datafs);
-		fsm->datafs = NULL;
-	}
+	abort_dataconnection(fsm);
 	fsm->state = FTPD_IDLE;
 }
 
@@ -995,6 +1195,7 @@ static void cmd_rnto(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 		send_msg(pcb, fsm, msg501);
 		return;
 	}
+	dircache_invalidate(NULL);
 	if (vfs_rename(fsm->vfs, fsm->renamefrom, arg)) {
 		send_msg(pcb, fsm, msg450);
 	} else {
@@ -1012,6 +1213,7 @@ static void cmd_mkd(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *
 		send_msg(pcb, fsm, msg501);
 		return;
 	}
+	dircache_invalidate(NULL);
 	if (vfs_mkdir(fsm->vfs, arg, VFS_IRWXU | VFS_IRWXG | VFS_IRWXO) != 0) {
 		send_msg(pcb, fsm, msg550);
 	} else {
@@ -1039,6 +1241,7 @@ static void cmd_rmd(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate *
 		send_msg(pcb, fsm, msg550);
 		return;
 	}
+	dircache_invalidate(NULL);
 	if (vfs_rmdir(fsm->vfs, arg) != 0) {
 		send_msg(pcb, fsm, msg550);
 	} else {
@@ -1066,6 +1269,7 @@ static void cmd_dele(const char *arg, struct tcp_pcb *pcb, struct ftpd_msgstate
 		send_msg(pcb, fsm, msg550);
 		return;
 	}
+	dircache_invalidate(NULL);
 	if (vfs_remove(fsm->vfs, arg) != 0) {
 		send_msg(pcb, fsm, msg550);
 	} else {
@@ -1089,6 +1293,9 @@ static struct ftpd_command ftpd_commands[] = {
 	{"XPWD", cmd_pwd},
 	{"NLST", cmd_nlst},
 	{"LIST", cmd_list},
+	{"MLSD", cmd_mlsd},
+	{"MLST", cmd_mlst},
+	{"FEAT", cmd_feat},
 	{"RETR", cmd_retr},
 	{"STOR", cmd_stor},
 	{"NOOP", cmd_noop},
@@ -1171,13 +1378,12 @@ static void ftpd_msgerr(void *arg, err_t err)
 		return;
 	if (fsm->datafs)
 		ftpd_dataclose(fsm->datapcb, fsm->datafs);
-	sfifo_close(&fsm->fifo);
 	vfs_close(fsm->vfs);
 	fsm->vfs = NULL;
 	if (fsm->renamefrom)
 		free(fsm->renamefrom);
 	fsm->renamefrom = NULL;
-	free(fsm);
+	session_free(fsm->session);
 }
 
 static void ftpd_msgclose(struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
@@ -1187,13 +1393,12 @@ static void ftpd_msgclose(struct tcp_pcb *pcb, struct ftpd_msgstate *fsm)
 	tcp_recv(pcb, NULL);
 	if (fsm->datafs)
 		ftpd_dataclose(fsm->datapcb, fsm->datafs);
-	sfifo_close(&fsm->fifo);
 	vfs_close(fsm->vfs);
 	fsm->vfs = NULL;
 	if (fsm->renamefrom)
 		free(fsm->renamefrom);
 	fsm->renamefrom = NULL;
-	free(fsm);
+	session_free(fsm->session);
 	tcp_arg(pcb, NULL);
 	tcp_close(pcb);
 }
@@ -1283,10 +1488,9 @@ static err_t ftpd_msgpoll(void *arg, struct tcp_pcb *pcb)
 		if (fsm->datafs->connected) {
 			switch (fsm->state) {
 			case FTPD_LIST:
-				send_next_directory(fsm->datafs, fsm->datapcb, 0);
-				break;
 			case FTPD_NLST:
-				send_next_directory(fsm->datafs, fsm->datapcb, 1);
+			case FTPD_MLSD:
+				send_next_directory(fsm->datafs, fsm->datapcb);
 				break;
 			case FTPD_RETR:
 				send_file(fsm->datafs, fsm->datapcb);
@@ -1303,32 +1507,36 @@ static err_t ftpd_msgpoll(void *arg, struct tcp_pcb *pcb)
 static err_t ftpd_msgaccept(void *arg, struct tcp_pcb *pcb, err_t err)
 {
 	LWIP_PLATFORM_DIAG(("ftpd_msgaccept called"));
+	struct ftpd_session *session;
 	struct ftpd_msgstate *fsm;
 	(void) err; /* suppress unused warning */
 	(void) arg;
 
-	/* Allocate memory for the structure that holds the state of the
-	   connection. */
-	fsm = malloc(sizeof(struct ftpd_msgstate));
-
-	if (fsm == NULL) {
-		LWIP_DEBUGF(FTPD_DEBUG, ("ftpd_msgaccept: Out of memory\n"));
-		return ERR_MEM;
+	/* Take a free slot of the pool for the state of the session. */
+	session = session_alloc();
+
+	if (session == NULL) {
+		/* Too many clients. The reply is a literal, so it is not copied. */
+		LWIP_DEBUGF(FTPD_DEBUG, ("ftpd_msgaccept: No free session\n"));
+		tcp_arg(pcb, NULL);
+		if (tcp_write(pcb, msg421 "\r\n", sizeof(msg421 "\r\n") - 1, 0) == ERR_OK)
+			tcp_output(pcb);
+		if (tcp_close(pcb) != ERR_OK) {
+			tcp_abort(pcb);
+			return ERR_ABRT;
+		}
+		return ERR_OK;
 	}
-	memset(fsm, 0, sizeof(struct ftpd_msgstate));
+	fsm = &session->msgstate;
 
 	/* Initialize the structure. */
-	if (sfifo_init(&fsm->fifo, 2000) != 0) {
-		free(fsm);
-		return ERR_MEM;
-	}
 	fsm->state = FTPD_IDLE;
 	fsm->vfs = vfs_openfs();
 	if (fsm->vfs == NULL) {
-		sfifo_close(&fsm->fifo);
-		free(fsm);
+		session_free(session);
 		return ERR_CLSD;
 	}
+	session->stats.remote_ip = ip4_addr_get_u32(ip_2_ip4(&pcb->remote_ip));
 
 	/* Tell TCP that this is the structure we wish to be passed for our
 	   callbacks. */
@@ -1355,6 +1563,20 @@ void ftpd_init(void)
 {
 	struct tcp_pcb *pcb;
 
+	if (sessions != NULL)
+		return;
+
+	/* Fewer sessions if there is not enough memory for all of them */
+	max_sessions = FTPD_MAX_SESSIONS;
+	for (; max_sessions > 0; max_sessions--) {
+		sessions = calloc(max_sessions, sizeof(struct ftpd_session));
+		if (sessions != NULL)
+			break;
+	}
+	DPRINTF("ftpd_init: sessions: %d (%d bytes each)\n", max_sessions, (int) sizeof(struct ftpd_session));
+	if (sessions == NULL)
+		return;
+
 	vfs_load_plugin(vfs_default_fs);
 
 	pcb = tcp_new();
@@ -1366,6 +1588,21 @@ void ftpd_init(void)
 	tcp_accept(pcb, ftpd_msgaccept);
 }
 
+int ftpd_get_max_sessions(void)
+{
+	return max_sessions;
+}
+
+bool ftpd_get_session_stats(int index, FtpSessionStats *stats)
+{
+	if (index < 0 || index >= max_sessions || !sessions[index].in_use)
+		return false;
+	*stats = sessions[index].stats;
+	if (stats->transferring)
+		stats->transfer_us += time_us_64() - sessions[index].datastate.opened_us;
+	return true;
+}
+
 void test()
 {
   DPRINTF("Starting FTP Server...\n");
@@ -10,6 +10,7 @@
 
 // Let's substitute the flags
 static uint16_t active_command_id = 0xFFFF;
+static volatile uint32_t command_arrival_us = 0; // Timer when the active command was received
 
 static uint16_t *payloadPtr = NULL;
 static uint32_t random_token;
@@ -19,6 +20,13 @@ static char *hd_folder = NULL;
 static bool debug = false;
 static char drive_letter = 'C';
 
+// State of the main loop between the calls of gemdrvemul_poll()
+static FATFS fs;
+static bool hd_folder_ready = false;
+static bool usb_shared = false;
+static bool write_config_only_once = true;
+static bool select_safe_config_reboot = false;
+
 // Save Dgetdrv variables
 static uint16_t dgetdrive_value = 0xFFFF;
 
@@ -37,6 +45,12 @@ static FileDescriptors *fdescriptors = NULL; // Initialize the head of the list
 static PD *pexec_pd = NULL;
 static ExecHeader *pexec_exec_header = NULL;
 
+// Background network and NTP acquisition variables
+static NetworkAcquisitionState network_acquisition_state = NETWORK_ACQUISITION_IDLE;
+static char *wifi_password_file_content = NULL;
+static uint32_t wifi_timeout_ms = 0;
+static bool dns_query_done = false;
+
 static inline void __not_in_flash_func(generate_random_token_seed)(const TransmissionProtocol *protocol)
 {
     random_token = ((*((uint32_t *)protocol->payload) & 0xFFFF0000) >> 16) | ((*((uint32_t *)protocol->payload) & 0x0000FFFF) << 16);
@@ -118,6 +132,7 @@ static DTANode *__not_in_flash_func(lookupDTA)(uint32_t key)
     unsigned int index = hash(key);
     DTANode *current = dtaTbl[index];
     DTANode *new_current = NULL;
+    uint32_t visited = 0;
 
     while (current != NULL)
     {
@@ -126,17 +141,10 @@ static DTANode *__not_in_flash_func(lookupDTA)(uint32_t key)
             new_current = current;
             new_current->dj->pat = current->pat;
         }
-        DPRINTF("DTA key: %x, filinfo_fname: %s, dir_obj: %x, pattern: %s\n", current->key, current->fno->fname, (void *)current->dj, current->dj->pat);
+        visited++;
         current = current->next;
     }
-    if (new_current == NULL)
-    {
-        DPRINTF("DTA key: %x not found\n", key);
-    }
-    else
-    {
-        DPRINTF("Returning DTA key: %x\n", new_current->key);
-    }
+    TRACE(TRACE_DTA_LOOKUP, new_current != NULL, key, visited);
     return new_current;
 }
 
@@ -616,6 +624,104 @@ static int __not_in_flash_func(count_fdesc)(FileDescriptors *head)
     return count;
 }
 
+// Commands that can change the content of the SD card
+static bool command_writes(uint16_t command_id)
+{
+    switch (command_id)
+    {
+    case GEMDRVEMUL_DCREATE_CALL:
+    case GEMDRVEMUL_DDELETE_CALL:
+    case GEMDRVEMUL_FCREATE_CALL:
+    case GEMDRVEMUL_FDELETE_CALL:
+    case GEMDRVEMUL_FATTRIB_CALL:
+    case GEMDRVEMUL_FRENAME_CALL:
+    case GEMDRVEMUL_FDATETIME_CALL:
+    case GEMDRVEMUL_WRITE_BUFF_CALL:
+    case GEMDRVEMUL_FCLOSE_CALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The USB host wrote to the card. Forget what FatFs and GEMDRIVE read from it before
+static void usb_shared_invalidate(FATFS *fs, uint8_t changed)
+{
+    DPRINTF("USB host changed regions %x. Invalidating caches\n", changed);
+    // The iterators of Fsfirst/Fsnext could point to changed directories
+    cleanDTAHashTable();
+    if (changed & BLKARB_METADATA_REGIONS)
+    {
+        // The FAT or the boot sector changed. The open files could be gone
+        FRESULT fr = f_mount(fs, "0:", 1);
+        if (fr != FR_OK)
+        {
+            DPRINTF("ERROR: Could not mount filesystem again (%d)\r\n", fr);
+        }
+        else
+        {
+            blkarb_set_layout(fs);
+        }
+        delete_all_files(&fdescriptors);
+    }
+    else
+    {
+        // Only clusters changed. Read again the sectors cached by FatFs and the open files.
+        // usb_shared_end left the files and the window synced, so nothing is written back here
+        fs->winsect = (LBA_t)0 - 1;
+        for (FileDescriptors *file = fdescriptors; file != NULL; file = file->next)
+        {
+            FIL *fp = &file->fobject;
+            FRESULT fr = f_sync(fp);
+            if (fr == FR_OK)
+            {
+                // Seeking to the same position reloads the buffer only if the sector is different
+                fp->sect = 0;
+                fr = f_lseek(fp, f_tell(fp));
+            }
+            if (fr != FR_OK)
+            {
+                DPRINTF("ERROR: Could not reload file %s (%d)\n", file->fpath, fr);
+            }
+        }
+    }
+}
+
+// Lock the card for a command. The writes staged by the USB host are committed first.
+// Returns false if the USB host still holds the card
+static bool usb_shared_begin(FATFS *fs, bool mounted, bool write)
+{
+    if (!blkarb_lock(BLKARB_OWNER_GEMDRIVE, BLKARB_ALL_REGIONS, write))
+    {
+        usb_mass_flush();
+        if (!blkarb_lock(BLKARB_OWNER_GEMDRIVE, BLKARB_ALL_REGIONS, write))
+        {
+            DPRINTF("ERROR: The USB host holds the card after a flush\n");
+            return false;
+        }
+    }
+    uint8_t changed = blkarb_take_changes(BLKARB_OWNER_GEMDRIVE);
+    if (mounted && (changed != 0))
+    {
+        usb_shared_invalidate(fs, changed);
+    }
+    return true;
+}
+
+// Release the card after a command. The written files are synced so the USB host never
+// reads a half updated file
+static void usb_shared_end(bool write)
+{
+    if (write)
+    {
+        for (FileDescriptors *file = fdescriptors; file != NULL; file = file->next)
+        {
+            f_sync(&file->fobject);
+        }
+    }
+    blkarb_unlock(BLKARB_OWNER_GEMDRIVE, BLKARB_ALL_REGIONS, write);
+}
+
 static void print_variables(uint32_t memory_shared_address)
 {
     // DPRINTF("Printing shared variables\n");
@@ -728,7 +834,8 @@ static inline void __not_in_flash_func(handle_protocol_command)(const Transmissi
     if (active_command_id == 0xFFFF)
     {
         payloadPtr = (uint16_t *)protocol->payload + 2;
-        DPRINTF("Command %s(%i) received: %d\n", get_command_name(protocol->command_id), protocol->command_id, protocol->payload_size);
+        TRACE(TRACE_GEMDRIVE_COMMAND, protocol->command_id, protocol->payload_size, 0);
+        command_arrival_us = timer_hw->timerawl;
         generate_random_token_seed(protocol);
         active_command_id = protocol->command_id;
     }
@@ -737,8 +844,12 @@ static inline void __not_in_flash_func(handle_protocol_command)(const Transmissi
 // Interrupt handler callback for DMA completion
 void __not_in_flash_func(gemdrvemul_dma_irq_handler_lookup_callback)(void)
 {
+    // Clear the interrupt request for the channel. A new access during the handler sets it again
+    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+
     // Read the address to process
     uint32_t addr = (uint32_t)dma_hw->ch[lookup_data_rom_dma_channel].al3_read_addr_trig;
+    busstats_access(addr);
 
     // Avoid priting anything inside an IRQ handled function
     // DPRINTF("DMA LOOKUP: $%x\n", addr);
@@ -746,23 +857,176 @@ void __not_in_flash_func(gemdrvemul_dma_irq_handler_lookup_callback)(void)
     {
         parse_protocol((uint16_t)(addr & 0xFFFF), handle_protocol_command);
     }
+    busstats_irq_exit(lookup_data_rom_dma_channel);
+}
 
-    // Clear the interrupt request for the channel
-    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+// Write the RTC time in the shared memory for the Atari ST to read
+static void publish_rtc_time(uint32_t memory_shared_address)
+{
+    uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + GEMDRVEMUL_RTC_STATUS);
+    // Change order for the endianess
+    rtc_time_ptr[1] = 0x1b;
+    rtc_time_ptr[0] = add_bcd(to_bcd((get_rtc_time()->year % 100)), to_bcd((2000 - 1980) + (80 - 30))); // Fix Y2K issue
+    rtc_time_ptr[3] = to_bcd(get_rtc_time()->month);
+    rtc_time_ptr[2] = to_bcd(get_rtc_time()->day);
+    rtc_time_ptr[5] = to_bcd(get_rtc_time()->hour);
+    rtc_time_ptr[4] = to_bcd(get_rtc_time()->min);
+    rtc_time_ptr[7] = to_bcd(get_rtc_time()->sec);
+    rtc_time_ptr[6] = 0x0;
 }
 
-void init_gemdrvemul(bool safe_config_reboot)
+// Stop the background network acquisition and release the network stack
+static void network_acquisition_stop(NetworkAcquisitionState final_state)
+{
+    wifi_manager_stop();
+    network_acquisition_state = final_state;
+}
+
+// Advance the background Wi-Fi and NTP acquisition one step. Never blocks, so it can be called
+// from the commands loop while the Atari ST is already booting
+static void network_acquisition_poll(uint32_t memory_shared_address)
 {
-    FRESULT fr; /* FatFs function common result code */
-    FATFS fs;
-    bool hd_folder_ready = false;
+    switch (network_acquisition_state)
+    {
+    case NETWORK_ACQUISITION_WIFI_START:
+    {
+        // Initialize SD card
+        if (!sd_init_driver())
+        {
+            DPRINTF("ERROR: Could not initialize SD card\r\n");
+        }
+        else
+        {
+            FRESULT err = read_and_trim_file(WIFI_PASS_FILE_NAME, &wifi_password_file_content, MAX_WIFI_PASSWORD_LENGTH);
+            if (err == FR_OK)
+            {
+                DPRINTF("Wifi password file found. Content: %s\n", wifi_password_file_content);
+            }
+            else
+            {
+                DPRINTF("Wifi password file not found.\n");
+            }
+        }
+
+        cyw43_arch_deinit();
+
+        wifi_manager_start(&wifi_password_file_content, wifi_timeout_ms, NULL, NULL);
+        network_acquisition_state = NETWORK_ACQUISITION_WIFI_CONNECTING;
+        break;
+    }
+    case NETWORK_ACQUISITION_WIFI_CONNECTING:
+    {
+        WifiManagerState wifi_state = wifi_manager_poll();
+        if (wifi_state == WIFI_MANAGER_TIMEOUT)
+        {
+            network_acquisition_state = NETWORK_ACQUISITION_FAILED;
+        }
+        else if (wifi_state == WIFI_MANAGER_CONNECTED)
+        {
+            network_acquisition_state = NETWORK_ACQUISITION_NTP_START;
+        }
+        break;
+    }
+    case NETWORK_ACQUISITION_NTP_START:
+    {
+        // We have network connection!
+        // Start the internal RTC
+        rtc_init();
 
-    char *ntp_server_host = NULL;
-    int ntp_server_port = NTP_DEFAULT_PORT;
-    u_int16_t network_poll_counter = 0;
+        char *ntp_server_host = find_entry(PARAM_RTC_NTP_SERVER_HOST)->value;
+        int ntp_server_port = configSnapshot.rtc_ntp_server_port;
+
+        DPRINTF("NTP server host: %s\n", ntp_server_host);
+        DPRINTF("NTP server port: %d\n", ntp_server_port);
+
+        char *utc_offset_entry = find_entry(PARAM_RTC_UTC_OFFSET)->value;
+        if (strlen(utc_offset_entry) > 0)
+        {
+            // The offset can be in decimal format
+            set_utc_offset_seconds((long)(atoi(utc_offset_entry) * 60 * 60));
+        }
+        DPRINTF("UTC offset: %ld\n", get_utc_offset_seconds());
+
+        // Start the NTP client
+        ntp_init();
+        get_net_time()->ntp_server_found = false;
+        dns_query_done = false;
+        network_acquisition_state = NETWORK_ACQUISITION_NTP_WAITING;
+        break;
+    }
+    case NETWORK_ACQUISITION_NTP_WAITING:
+    {
+        wifi_manager_poll();
+        if ((get_net_time()->ntp_server_found) && dns_query_done)
+        {
+            DPRINTF("NTP server found. Connecting to NTP server...\n");
+            get_net_time()->ntp_server_found = false;
+            set_internal_rtc();
+        }
+        // Get the IP address from the DNS server if the wifi is connected and no IP address is found yet
+        if (!(dns_query_done))
+        {
+            // Let's connect to ntp server
+            DPRINTF("Querying the DNS...\n");
+            err_t dns_ret = dns_gethostbyname(find_entry_by_id(CONFIG_KEY_RTC_NTP_SERVER_HOST)->value, &get_net_time()->ntp_ipaddr, host_found_callback, get_net_time());
+            if (dns_ret == ERR_ARG)
+            {
+                DPRINTF("Invalid DNS argument\n");
+            }
+            DPRINTF("DNS query done\n");
+            dns_query_done = true;
+        }
+        if (get_net_time()->ntp_error)
+        {
+            DPRINTF("Error getting the NTP server IP address\n");
+            dns_query_done = false;
+            get_net_time()->ntp_error = false;
+            get_net_time()->ntp_server_found = false;
+        }
+        if (get_rtc_time()->year != 0)
+        {
+            DPRINTF("RTC set by NTP server\n");
+            // Set the RTC time for the Atari ST to read
+            rtc_get_datetime(get_rtc_time());
+
+            DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
+                    get_rtc_time()->day,
+                    get_rtc_time()->month,
+                    get_rtc_time()->year,
+                    get_rtc_time()->hour,
+                    get_rtc_time()->min,
+                    get_rtc_time()->sec);
+
+            publish_rtc_time(memory_shared_address);
+
+            // If connected to the wifi then set the network status to 1, otherwise set it to 0
+            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_NETWORK_STATUS)) = 0xFFFFFFFF;
+            network_acquisition_state = NETWORK_ACQUISITION_DONE;
+        }
+        break;
+    }
+    case NETWORK_ACQUISITION_DONE:
+    {
+        // Also joins the access point again if the link is lost
+        wifi_manager_poll();
+        // Keep the RTC disciplined by NTP while the machine is on. The time is updated in place
+        if (ntp_discipline_poll())
+        {
+            rtc_get_datetime(get_rtc_time());
+            publish_rtc_time(memory_shared_address);
+        }
+        break;
+    }
+    default:
+        // Idle or failed. Nothing to do
+        break;
+    }
+}
 
-    // Local wifi password in the local file
-    char *wifi_password_file_content = NULL;
+void gemdrvemul_setup(bool safe_config_reboot)
+{
+    hd_folder_ready = false;
+    select_safe_config_reboot = safe_config_reboot;
 
     srand(time(0));
     printf("Initializing GEMDRIVE...\n"); // Print alwayse
@@ -770,24 +1034,24 @@ void init_gemdrvemul(bool safe_config_reboot)
     dpath_string[0] = '\\'; // Set the root folder as default
     dpath_string[1] = '\0';
 
-    bool write_config_only_once = true;
+    write_config_only_once = true;
     active_command_id = 0xFFFF;
 
+    // The USB host can read and write the SD card while GEMDRIVE serves the Atari ST
+    usb_shared = usb_mass_is_shared();
+    DPRINTF("USB mass storage shared? %s\n", usb_shared ? "Yes" : "No");
+
     DPRINTF("Waiting for commands...\n");
     uint32_t memory_shared_address = ROM3_START_ADDRESS; // Start of the shared memory buffer
-    uint32_t memory_firmware_code = ROM4_START_ADDRESS;  // Start of the firmware code
 
     init_variables(memory_shared_address);
+    // The statistics are beyond the variables. Nothing measured yet
+    memset((void *)(memory_shared_address + GEMDRVEMUL_CMDSTATS), 0, sizeof(CmdStatsSharedTable) + sizeof(BusStatsReport));
 
     *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_RTC_STATUS)) = 0x0;
     *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_NETWORK_STATUS)) = 0x0;
 
-    ConfigEntry *gemdrive_rtc = find_entry(PARAM_GEMDRIVE_RTC);
-    bool gemdrive_rtc_enabled = true;
-    if (gemdrive_rtc != NULL)
-    {
-        gemdrive_rtc_enabled = gemdrive_rtc->value[0] == 't' || gemdrive_rtc->value[0] == 'T';
-    }
+    bool gemdrive_rtc_enabled = configSnapshot.gemdrive_rtc;
     // #if defined(_DEBUG) && (_DEBUG != 0)
     //     DPRINTF("RTC DISABLED FOR DEBUGGING\n");
     //     gemdrive_rtc_enabled = false;
@@ -795,37 +1059,16 @@ void init_gemdrvemul(bool safe_config_reboot)
     *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_NETWORK_ENABLED)) = gemdrive_rtc_enabled;
     DPRINTF("Network enabled? %s\n", gemdrive_rtc_enabled ? "Yes" : "No");
 
-    ConfigEntry *gemdrive_timeout = find_entry(PARAM_GEMDRIVE_TIMEOUT_SEC);
-    uint32_t gemdrive_timeout_sec = 0;
-    if (gemdrive_timeout != NULL)
-    {
-        gemdrive_timeout_sec = atoi(gemdrive_timeout->value);
-    }
+    uint32_t gemdrive_timeout_sec = configSnapshot.gemdrive_timeout_sec;
     WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_TIMEOUT_SEC, gemdrive_timeout_sec);
     DPRINTF("Timeout in seconds: %d\n", gemdrive_timeout_sec);
 
-    ConfigEntry *drive_letter_conf = find_entry(PARAM_GEMDRIVE_DRIVE);
-    char drive_letter = 'C';
-    if (drive_letter_conf != NULL)
-    {
-        drive_letter = drive_letter_conf->value[0];
-    }
+    drive_letter = configSnapshot.gemdrive_drive;
     uint32_t drive_letter_num = (uint8_t)toupper(drive_letter);
     uint32_t drive_number = drive_letter_num - 65; // Convert the drive letter to a number. Add 1 because 0 is the current drive
 
-    ConfigEntry *buffer_type_conf = find_entry(PARAM_GEMDRIVE_BUFF_TYPE);
-    uint16_t buffer_type = 0; // 0: Diskbuffer, 1: Stack
-    if (buffer_type_conf != NULL)
-    {
-        buffer_type = atoi(buffer_type_conf->value);
-    }
-
-    ConfigEntry *virtual_fake_floppy_conf = find_entry(PARAM_GEMDRIVE_FAKEFLOPPY);
-    uint16_t virtual_fake_floppy = 0; // 0: No, 1: Yes
-    if (virtual_fake_floppy_conf != NULL)
-    {
-        virtual_fake_floppy = virtual_fake_floppy_conf->value[0] == 't' || virtual_fake_floppy_conf->value[0] == 'T';
-    }
+    uint16_t buffer_type = configSnapshot.gemdrive_buff_type;          // 0: Diskbuffer, 1: Stack
+    uint16_t virtual_fake_floppy = configSnapshot.gemdrive_fakefloppy; // 0: No, 1: Yes
 
     set_shared_var(SHARED_VARIABLE_FIRST_FILE_DESCRIPTOR, FIRST_FILE_DESCRIPTOR, memory_shared_address);
     set_shared_var(SHARED_VARIABLE_DRIVE_LETTER, drive_letter_num, memory_shared_address);
@@ -840,1685 +1083,1529 @@ void init_gemdrvemul(bool safe_config_reboot)
     }
 
     // Only try to get the datetime from the network if the wifi is configured
-    if (gemdrive_rtc_enabled && strlen(find_entry(PARAM_WIFI_SSID)->value) > 0)
+    // The network is acquired in the background while the commands are served
+    if (gemdrive_rtc_enabled && configSnapshot.wifi_configured)
     {
-        // Initialize SD card
-        if (!sd_init_driver())
+        wifi_timeout_ms = gemdrive_timeout_sec * 1000;
+        network_acquisition_state = NETWORK_ACQUISITION_WIFI_START;
+    }
+    else
+    {
+        // Just be sure to deinit the network stack
+        network_terminate();
+        DPRINTF("No wifi configured. Skipping network initialization.\n");
+    }
+}
+
+void gemdrvemul_poll(void)
+{
+    FRESULT fr;                                          /* FatFs function common result code */
+    uint32_t memory_shared_address = ROM3_START_ADDRESS; // Start of the shared memory buffer
+    uint32_t memory_firmware_code = ROM4_START_ADDRESS;  // Start of the firmware code
+
+    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
+    tight_loop_contents();
+
+    // Commands first. The network acquisition and the USB host only run when the Atari ST is not waiting
+    if (active_command_id == 0xFFFF)
+    {
+        network_acquisition_poll(memory_shared_address);
+        if (usb_shared)
         {
-            DPRINTF("ERROR: Could not initialize SD card\r\n");
+            usb_mass_poll();
         }
         else
         {
-            FRESULT err = read_and_trim_file(WIFI_PASS_FILE_NAME, &wifi_password_file_content, MAX_WIFI_PASSWORD_LENGTH);
-            if (err == FR_OK)
-            {
-                DPRINTF("Wifi password file found. Content: %s\n", wifi_password_file_content);
-            }
-            else
-            {
-                DPRINTF("Wifi password file not found.\n");
-            }
+            // The capture file does not go through the block arbiter
+            capture_poll(APP_GEMDRVEMUL);
         }
+        cmdstats_publish((uint8_t *)(memory_shared_address + GEMDRVEMUL_CMDSTATS));
+        busstats_poll((uint8_t *)(memory_shared_address + GEMDRVEMUL_BUSSTATS));
+        trace_drain();
+    }
 
-        cyw43_arch_deinit();
-
-        network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-        absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(reconnect_t, 0);
-        absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(second_t, 0);
-        uint32_t time_to_connect_again = 1000; // 1 second
-        bool network_ready = false;
-        bool wifi_init = true;
-        uint32_t wifi_timeout_sec = gemdrive_timeout_sec;
-
-        // Wait until timeout
-        while ((!network_ready) && (wifi_timeout_sec > 0) && (strlen(find_entry(PARAM_WIFI_SSID)->value) > 0))
+    // Take the command once. A command arriving later is served in the next loop, after locking the card
+    uint16_t command_id = active_command_id;
+    uint32_t command_start_us = command_arrival_us;
+    bool command_write = usb_shared && (command_id != 0xFFFF) && command_writes(command_id);
+    if (usb_shared && (command_id != 0xFFFF))
+    {
+        if (!usb_shared_begin(&fs, hd_folder_ready, command_write))
         {
-            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
-#if PICO_CYW43_ARCH_POLL
-            if (wifi_init)
-            {
-                cyw43_arch_poll();
-            }
-#endif
-
-            // Check the cancel command
-            if (active_command_id == GEMDRVEMUL_CANCEL)
-            {
-                DPRINTF("CANCEL command received!\n");
-                wifi_timeout_sec = 0;
-                write_random_token(memory_shared_address);
-                active_command_id = 0xFFFF;
-                break;
-            }
+            // Let the USB host release the card. The command is served in the next loop
+            usb_mass_poll();
+            command_id = 0xFFFF;
+        }
+    }
+    if (command_id != 0xFFFF)
+    {
+        TRACE(TRACE_GEMDRIVE_START, command_id, 0, 0);
+    }
 
-            // Only display when changes status to avoid flooding the console
-            ConnectionStatus previous_status = get_previous_connection_status();
-            ConnectionStatus current_status = get_network_connection_status();
-            if (current_status != previous_status)
-            {
+// fully bypass the print variables when debug disabled
 #if defined(_DEBUG) && (_DEBUG != 0)
-                ConnectionData connection_data = {0};
-                get_connection_data(&connection_data);
-                DPRINTF("Status: %d - Prev: %d - SSID: %s - IPv4: %s - GW:%s - Mask:%s - MAC:%s\n",
-                        current_status,
-                        previous_status,
-                        connection_data.ssid,
-                        connection_data.ipv4_address,
-                        print_ipv4(get_gateway()),
-                        print_ipv4(get_netmask()),
-                        print_mac(get_mac_address()));
+    uint16_t old_command = active_command_id != 0xFFFF ? active_command_id : 0xFFFF;
 #endif
-                if ((current_status == GENERIC_ERROR) || (current_status == CONNECT_FAILED_ERROR) || (current_status == BADAUTH_ERROR))
-                {
-                    if (wifi_init)
-                    {
-                        network_terminate();
-                        reconnect_t = make_timeout_time_ms(0);
-                        time_to_connect_again = time_to_connect_again * 1.2;
-                        wifi_init = false;
-                        DPRINTF("Connection failed. Retrying in %d ms...\n", time_to_connect_again);
-                    }
-                }
-            }
-            network_ready = (current_status == CONNECTED_WIFI_IP);
-            if (time_passed(&second_t, 1000) == 1)
-            {
-                DPRINTF("Timeout in seconds: %d\n", wifi_timeout_sec);
-                wifi_timeout_sec--;
-                second_t = make_timeout_time_ms(0);
-            }
-
-            // If SELECT button is pressed, launch the configurator
-            if (gpio_get(SELECT_GPIO) != 0)
-            {
-                select_button_action(safe_config_reboot, write_config_only_once);
-                // Write config only once to avoid hitting the flash too much
-                write_config_only_once = false;
-            }
-            if ((!wifi_init) && (time_passed(&reconnect_t, time_to_connect_again) == 1))
-            {
-                network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-                reconnect_t = make_timeout_time_ms(0);
-                wifi_init = true;
-            }
-        }
-        if (wifi_timeout_sec <= 0)
+    switch (command_id)
+    {
+    case GEMDRVEMUL_DEBUG:
+    {
+        uint32_t d3 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        DPRINTF("DEBUG: %x\n", d3);
+        payloadPtr += 2;
+        uint32_t d4 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        DPRINTF("DEBUG: %x\n", d4);
+        payloadPtr += 2;
+        uint32_t d5 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        DPRINTF("DEBUG: %x\n", d5);
+        payloadPtr += 2;
+        uint8_t *payloadShowBytesPtr = (uint8_t *)payloadPtr;
+        print_payload(payloadShowBytesPtr);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_CANCEL:
+    {
+        DPRINTF("CANCEL command received\n");
+        if ((network_acquisition_state != NETWORK_ACQUISITION_IDLE) &&
+            (network_acquisition_state != NETWORK_ACQUISITION_DONE) &&
+            (network_acquisition_state != NETWORK_ACQUISITION_FAILED))
         {
-            // Just be sure to deinit the network stack
-            network_terminate();
-            DPRINTF("No wifi configured. Skipping network initialization.\n");
+            DPRINTF("Network acquisition cancelled\n");
+            network_acquisition_stop(NETWORK_ACQUISITION_FAILED);
         }
-        else
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_SAVE_VECTORS:
+    {
+        DPRINTF("Saving vectors\n");
+        uint32_t gemdos_trap_address_old = ((uint32_t)payloadPtr[0] << 16) | payloadPtr[1];
+        payloadPtr += 2;
+        uint32_t gemdos_trap_address_xbra = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        // Save the vectors needed for the floppy emulation
+        DPRINTF("gemdos_trap_addres_xbra: %x\n", gemdos_trap_address_xbra);
+        DPRINTF("gemdos_trap_address_old: %x\n", gemdos_trap_address_old);
+        // DPRINTF("random token: %x\n", random_token);
+        // Self modifying code to create the old and venerable XBRA structure
+        *((volatile uint16_t *)(memory_firmware_code + gemdos_trap_address_xbra - ATARI_ROM4_START_ADDRESS)) = gemdos_trap_address_old & 0xFFFF;
+        *((volatile uint16_t *)(memory_firmware_code + gemdos_trap_address_xbra - ATARI_ROM4_START_ADDRESS + 2)) = gemdos_trap_address_old >> 16;
+
+
+        if (get_rtc_time()->year != 0)
         {
-            // We have network connection!
-            // Start the internal RTC
-            rtc_init();
-
-            ntp_server_host = find_entry(PARAM_RTC_NTP_SERVER_HOST)->value;
-            ntp_server_port = atoi(find_entry(PARAM_RTC_NTP_SERVER_PORT)->value);
-
-            DPRINTF("NTP server host: %s\n", ntp_server_host);
-            DPRINTF("NTP server port: %d\n", ntp_server_port);
+            // Update the RTC with the internal clock of the RTC
+            rtc_get_datetime(get_rtc_time());
+            DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
+                            get_rtc_time()->day, 
+                            get_rtc_time()->month, 
+                            get_rtc_time()->year, 
+                            get_rtc_time()->hour, 
+                            get_rtc_time()->min, 
+                            get_rtc_time()->sec);
+
+            DPRINTF("RTC set by NTP server\n");
+            publish_rtc_time(memory_shared_address);
+        }
 
-            char *utc_offset_entry = find_entry(PARAM_RTC_UTC_OFFSET)->value;
-            if (strlen(utc_offset_entry) > 0)
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_PING:
+    {
+        if (!hd_folder_ready)
+        {
+            // Initialize SD card
+            if (!sd_init_driver())
             {
-                // The offset can be in decimal format
-                set_utc_offset_seconds((long)(atoi(utc_offset_entry) * 60 * 60));
+                DPRINTF("ERROR: Could not initialize SD card\r\n");
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x0;
             }
-            DPRINTF("UTC offset: %ld\n", get_utc_offset_seconds());
-
-            // Start the NTP client
-            ntp_init();
-            get_net_time()->ntp_server_found = false;
-
-            bool dns_query_done = false;
-
-            // Wait until the RTC is set by the NTP server
-            while (get_rtc_time()->year == 0)
+            else
             {
-
-#if PICO_CYW43_ARCH_POLL
-                network_safe_poll();
-#endif
-                // Check the cancel command
-                if (active_command_id == GEMDRVEMUL_CANCEL)
-                {
-                    DPRINTF("CANCEL command received!\n");
-                    wifi_timeout_sec = 0;
-                    write_random_token(memory_shared_address);
-                    active_command_id = 0xFFFF;
-                    break;
-                }
-                if ((get_net_time()->ntp_server_found) && dns_query_done)
-                {
-                    DPRINTF("NTP server found. Connecting to NTP server...\n");
-                    get_net_time()->ntp_server_found = false;
-                    set_internal_rtc();
-                }
-                // Get the IP address from the DNS server if the wifi is connected and no IP address is found yet
-                if (!(dns_query_done))
-                {
-                    // Let's connect to ntp server
-                    DPRINTF("Querying the DNS...\n");
-                    err_t dns_ret = dns_gethostbyname(ntp_server_host, &get_net_time()->ntp_ipaddr, host_found_callback, get_net_time());
-#if PICO_CYW43_ARCH_POLL
-                    network_safe_poll();
-#endif
-                    if (dns_ret == ERR_ARG)
-                    {
-                        DPRINTF("Invalid DNS argument\n");
-                    }
-                    DPRINTF("DNS query done\n");
-                    dns_query_done = true;
-                }
-                if (get_net_time()->ntp_error)
+                // Mount drive
+                FRESULT fr; /* FatFs function common result code */
+                fr = f_mount(&fs, "0:", 1);
+                bool microsd_mounted = (fr == FR_OK);
+                if (!microsd_mounted)
                 {
-                    DPRINTF("Error getting the NTP server IP address\n");
-                    dns_query_done = false;
-                    get_net_time()->ntp_error = false;
-                    get_net_time()->ntp_server_found = false;
+                    DPRINTF("ERROR: Could not mount filesystem (%d)\r\n", fr);
+                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x0;
                 }
-                // If SELECT button is pressed, launch the configurator
-                if (gpio_get(SELECT_GPIO) != 0)
+                else
                 {
-                    select_button_action(safe_config_reboot, write_config_only_once);
-                    // Write config only once to avoid hitting the flash too much
-                    write_config_only_once = false;
+                    blkarb_set_layout(&fs);
+                    hd_folder = find_entry(PARAM_GEMDRIVE_FOLDERS)->value;
+                    DPRINTF("Emulating GEMDRIVE in folder: %s\n", hd_folder);
+                    // Iterate over fdescriptors and close all files
+                    close_all_files(&fdescriptors);
+                    cleanDTAHashTable();
+                    delete_all_files(&fdescriptors);
+                    DPRINTF("DTA table elements: %d\n", countDTA());
+                    DPRINTF("File descriptors: %d\n", count_fdesc(fdescriptors));
+                    dpath_string[0] = '\\'; // Set the root folder as default
+                    dpath_string[1] = '\0';
+                    hd_folder_ready = true;
+                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x1;
                 }
             }
-            if (get_rtc_time()->year != 0)
-            {
-                DPRINTF("RTC set by NTP server\n");
-                // Set the RTC time for the Atari ST to read
-                rtc_get_datetime(get_rtc_time());
-
-                DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
-                                get_rtc_time()->day, 
-                                get_rtc_time()->month, 
-                                get_rtc_time()->year, 
-                                get_rtc_time()->hour, 
-                                get_rtc_time()->min, 
-                                get_rtc_time()->sec);
-
-                uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + GEMDRVEMUL_RTC_STATUS);
-                // Change order for the endianess
-                rtc_time_ptr[1] = 0x1b;
-                rtc_time_ptr[0] = add_bcd(to_bcd((get_rtc_time()->year % 100)), to_bcd((2000 - 1980) + (80 - 30))); // Fix Y2K issue
-                rtc_time_ptr[3] = to_bcd(get_rtc_time()->month);
-                rtc_time_ptr[2] = to_bcd(get_rtc_time()->day);
-                rtc_time_ptr[5] = to_bcd(get_rtc_time()->hour);
-                rtc_time_ptr[4] = to_bcd(get_rtc_time()->min);
-                rtc_time_ptr[7] = to_bcd(get_rtc_time()->sec);
-                rtc_time_ptr[6] = 0x0;
-
-                // If connected to the wifi then set the network status to 1, otherwise set it to 0
-                *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_NETWORK_STATUS)) = 0xFFFFFFFF;
-            }
-            else
+        }
+        DPRINTF("PING received. Answering with: %d\n", *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)));
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_SHOW_VECTOR_CALL:
+    {
+        uint16_t trap_call = (uint16_t)payloadPtr[0];
+        bool isBlacklisted = false;
+        for (int i = 0; i < sizeof(BLACKLISTED_GEMDOS_CALLS); i++)
+        {
+            if (trap_call == BLACKLISTED_GEMDOS_CALLS[i])
             {
-                DPRINTF("Timeout reached. RTC not set.\n");
-                cyw43_arch_deinit(); 
-                DPRINTF("No wifi configured. Skipping network initialization.\n");
+                isBlacklisted = true; // Found the call in the blacklist
+                break;
             }
         }
+        // if (!isBlacklisted)
+        // {
+        // If the call is not blacklisted, print its information
+        DPRINTF("GEMDOS CALL: %s (%x)\n", GEMDOS_CALLS[trap_call], trap_call);
+        // }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
     }
-    else
+    case GEMDRVEMUL_SET_SHARED_VAR:
     {
-        // Just be sure to deinit the network stack
-        cyw43_arch_deinit();
-        DPRINTF("No wifi configured. Skipping network initialization.\n");
+        // Shared variables
+        uint32_t shared_variable_index = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d3 register
+        payloadPtr += 2;                                                                  // Skip two words
+        uint32_t shared_variable_value = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
+        set_shared_var(shared_variable_index, shared_variable_value, memory_shared_address);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
     }
-
-    while (true)
+    case GEMDRVEMUL_DGETDRV_CALL:
+    {
+        // Get the drive letter
+        uint16_t dgetdrive_value = (uint16_t)payloadPtr[0];
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_REENTRY_LOCK:
+    {
+        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_REENTRY_TRAP)) = 0xFFFF;
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_REENTRY_UNLOCK:
+    {
+        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_REENTRY_TRAP)) = 0x0;
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DFREE_CALL:
+    {
+        uint32_t dfree_unit = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        // Check the free space
+        DWORD fre_clust;
+        FATFS *fs;
+        FRESULT fr;
+        // Get free space
+        fr = f_getfree(hd_folder, &fre_clust, &fs);
+        if (fr != FR_OK)
+        {
+            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_DFREE_STATUS)) = GEMDOS_ERROR;
+        }
+        else
+        {
+            // Calculate the total number of free bytes
+            uint64_t freeBytes = fre_clust * fs->csize * NUM_BYTES_PER_SECTOR;
+            DPRINTF("Total clusters: %d, free clusters: %d, bytes per sector: %d, sectors per cluster: %d\n", fs->n_fatent - 2, fre_clust, NUM_BYTES_PER_SECTOR, fs->csize);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT, fre_clust);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 4, fs->n_fatent - 2);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 8, NUM_BYTES_PER_SECTOR);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 12, fs->csize);
+            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_DFREE_STATUS)) = GEMDOS_EOK;
+        }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+    }
+    case GEMDRVEMUL_DGETPATH_CALL:
     {
-        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
-        tight_loop_contents();
+        uint16_t dpath_drive = payloadPtr[0]; // d3 register
 
-// fully bypass the print variables when debug disabled
-#if defined(_DEBUG) && (_DEBUG != 0)
-        uint16_t old_command = active_command_id != 0xFFFF ? active_command_id : 0xFFFF;
-#endif
-        switch (active_command_id)
+        DPRINTF("Dpath drive: %x\n", dpath_drive);
+        DPRINTF("Dpath string: %s\n", dpath_string);
+
+        char tmp_path[MAX_FOLDER_LENGTH] = {0};
+        memccpy(tmp_path, dpath_string, 0, MAX_FOLDER_LENGTH);
+        forward_2_backslash(tmp_path);
+
+        // Remove the backslash at the end
+        DPRINTF("Dpath backslash string: %s\n", tmp_path);
+        if (tmp_path[strlen(tmp_path) - 1] == '\\')
         {
-        case GEMDRVEMUL_DEBUG:
+            tmp_path[strlen(tmp_path) - 1] = '\0';
+        }
+
+        DPRINTF("Dpath backslash string (no last backslash: %s\n", tmp_path);
+
+        COPY_AND_CHANGE_ENDIANESS_BLOCK16(tmp_path, memory_shared_address + GEMDRVEMUL_DEFAULT_PATH, MAX_FOLDER_LENGTH);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DSETPATH_CALL:
+    {
+        payloadPtr += 6; // Skip six words
+        // Obtain the fname string and keep it in memory
+        char dpath_tmp[MAX_FOLDER_LENGTH] = {};
+        COPY_AND_CHANGE_ENDIANESS_BLOCK16(payloadPtr, dpath_tmp, MAX_FOLDER_LENGTH);
+        DPRINTF("Default path string: %s\n", dpath_tmp);
+        // Check if the directory exists
+        char tmp_path[MAX_FOLDER_LENGTH] = {0};
+
+        if (dpath_tmp[0] == drive_letter)
         {
-            uint32_t d3 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            DPRINTF("DEBUG: %x\n", d3);
-            payloadPtr += 2;
-            uint32_t d4 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            DPRINTF("DEBUG: %x\n", d4);
-            payloadPtr += 2;
-            uint32_t d5 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            DPRINTF("DEBUG: %x\n", d5);
-            payloadPtr += 2;
-            uint8_t *payloadShowBytesPtr = (uint8_t *)payloadPtr;
-            print_payload(payloadShowBytesPtr);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            DPRINTF("Drive letter found: %c. Removing it.\n", drive_letter);
+            // Remove the drive letter and the colon from the path
+            memmove(dpath_tmp, dpath_tmp + 2, strlen(dpath_tmp));
         }
-        case GEMDRVEMUL_CANCEL:
+
+        DPRINTF("Dpath string: %s\n", dpath_string);
+        DPRINTF("Dpath tmp: %s\n", dpath_tmp);
+
+        // Check if the path is relative or absolute
+        if ((dpath_tmp[0] != '\\') && (dpath_tmp[0] != '/'))
         {
-            DPRINTF("CANCEL command received\n");
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            // Concatenate the path with the existing dpath_string
+            char tmp_path_concat[MAX_FOLDER_LENGTH] = {0};
+            snprintf(tmp_path_concat, sizeof(tmp_path_concat), "%s/%s", dpath_string, dpath_tmp);
+            DPRINTF("Concatenated path: %s\n", tmp_path_concat);
+            strcpy(dpath_tmp, tmp_path_concat);
+            DPRINTF("Dpath tmp: %s\n", dpath_tmp);
         }
-        case GEMDRVEMUL_SAVE_VECTORS:
+        else
         {
-            DPRINTF("Saving vectors\n");
-            uint32_t gemdos_trap_address_old = ((uint32_t)payloadPtr[0] << 16) | payloadPtr[1];
-            payloadPtr += 2;
-            uint32_t gemdos_trap_address_xbra = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            // Save the vectors needed for the floppy emulation
-            DPRINTF("gemdos_trap_addres_xbra: %x\n", gemdos_trap_address_xbra);
-            DPRINTF("gemdos_trap_address_old: %x\n", gemdos_trap_address_old);
-            // DPRINTF("random token: %x\n", random_token);
-            // Self modifying code to create the old and venerable XBRA structure
-            *((volatile uint16_t *)(memory_firmware_code + gemdos_trap_address_xbra - ATARI_ROM4_START_ADDRESS)) = gemdos_trap_address_old & 0xFFFF;
-            *((volatile uint16_t *)(memory_firmware_code + gemdos_trap_address_xbra - ATARI_ROM4_START_ADDRESS + 2)) = gemdos_trap_address_old >> 16;
+            DPRINTF("Do not concatenate the path\n");
+        }
+        back_2_forwardslash(dpath_tmp);
+        // Concatenate the path with the hd_folder
+        snprintf(tmp_path, sizeof(tmp_path), "%s/%s", hd_folder, dpath_tmp);
 
+        // Remove duplicated forward slashes
+        remove_dup_slashes(tmp_path);
+        remove_dup_slashes(dpath_tmp);
 
-            if (get_rtc_time()->year != 0)
+        if (directory_exists(tmp_path))
+        {
+            DPRINTF("Directory exists: %s\n", tmp_path);
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_SET_DPATH_STATUS)) = GEMDOS_EOK;
+        }
+        else
+        {
+            DPRINTF("Directory does not exist: %s\n", tmp_path);
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_SET_DPATH_STATUS)) = GEMDOS_EPTHNF;
+        }
+        // Copy dpath_tmp to dpath_string
+        strcpy(dpath_string, dpath_tmp);
+        DPRINTF("The new default path is: %s\n", dpath_string);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DCREATE_CALL:
+    {
+        // Obtain the pathname string and keep it in memory
+        // concatenated with the local harddisk folder and the default path (if any)
+        payloadPtr += 6; // Skip six words
+        char tmp_pathname[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_pathname);
+        DPRINTF("Folder to create: %s\n", tmp_pathname);
+
+        // Check if the folder exists. If not, return an error
+        if (directory_exists(tmp_pathname) != FR_OK)
+        {
+            DPRINTF("ERROR: Folder does not exist\n");
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EPTHNF;
+        }
+        else
+        {
+            // Create the folder
+            fr = f_mkdir(tmp_pathname);
+            if (fr != FR_OK)
             {
-                // Update the RTC with the internal clock of the RTC
-                rtc_get_datetime(get_rtc_time());
-                DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
-                                get_rtc_time()->day, 
-                                get_rtc_time()->month, 
-                                get_rtc_time()->year, 
-                                get_rtc_time()->hour, 
-                                get_rtc_time()->min, 
-                                get_rtc_time()->sec);
-
-                DPRINTF("RTC set by NTP server\n");
-                uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + GEMDRVEMUL_RTC_STATUS);
-                // Change order for the endianess
-                rtc_time_ptr[1] = 0x1b;
-                rtc_time_ptr[0] = add_bcd(to_bcd((get_rtc_time()->year % 100)), to_bcd((2000 - 1980) + (80 - 30))); // Fix Y2K issue
-                rtc_time_ptr[3] = to_bcd(get_rtc_time()->month);
-                rtc_time_ptr[2] = to_bcd(get_rtc_time()->day);
-                rtc_time_ptr[5] = to_bcd(get_rtc_time()->hour);
-                rtc_time_ptr[4] = to_bcd(get_rtc_time()->min);
-                rtc_time_ptr[7] = to_bcd(get_rtc_time()->sec);
-                rtc_time_ptr[6] = 0x0;
+                DPRINTF("ERROR: Could not create folder (%d)\r\n", fr);
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EACCDN;
             }
-
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            else
+            {
+                DPRINTF("Folder created\n");
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EOK;
+            }
+        }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DDELETE_CALL:
+    {
+        // Obtain the pathname string and keep it in memory
+        // concatenated with the local harddisk folder and the default path (if any)
+        payloadPtr += 6; // Skip six words
+        char tmp_pathname[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_pathname);
+        DPRINTF("Folder to delete: %s\n", tmp_pathname);
+
+        // Check if the folder exists. If not, return an error
+        if (directory_exists(tmp_pathname) == 0)
+        {
+            DPRINTF("ERROR: Folder does not exist\n");
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EPTHNF;
         }
-        case GEMDRVEMUL_PING:
+        else
         {
-            if (!hd_folder_ready)
+            // Delete the folder
+            fr = f_unlink(tmp_pathname);
+            if (fr != FR_OK)
             {
-                // Initialize SD card
-                if (!sd_init_driver())
+                DPRINTF("ERROR: Could not delete folder (%d)\r\n", fr);
+                if (fr == FR_DENIED)
                 {
-                    DPRINTF("ERROR: Could not initialize SD card\r\n");
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x0;
+                    DPRINTF("ERROR: Folder is not empty\n");
+                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EACCDN;
+                }
+                else if (fr == FR_NO_PATH)
+                {
+                    DPRINTF("ERROR: Folder does not exist\n");
+                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EPTHNF;
                 }
                 else
                 {
-                    // Mount drive
-                    FRESULT fr; /* FatFs function common result code */
-                    fr = f_mount(&fs, "0:", 1);
-                    bool microsd_mounted = (fr == FR_OK);
-                    if (!microsd_mounted)
-                    {
-                        DPRINTF("ERROR: Could not mount filesystem (%d)\r\n", fr);
-                        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x0;
-                    }
-                    else
-                    {
-                        hd_folder = find_entry(PARAM_GEMDRIVE_FOLDERS)->value;
-                        DPRINTF("Emulating GEMDRIVE in folder: %s\n", hd_folder);
-                        // Iterate over fdescriptors and close all files
-                        close_all_files(&fdescriptors);
-                        cleanDTAHashTable();
-                        delete_all_files(&fdescriptors);
-                        DPRINTF("DTA table elements: %d\n", countDTA());
-                        DPRINTF("File descriptors: %d\n", count_fdesc(fdescriptors));
-                        dpath_string[0] = '\\'; // Set the root folder as default
-                        dpath_string[1] = '\0';
-                        hd_folder_ready = true;
-                        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)) = 0x1;
-                    }
+                    DPRINTF("ERROR: Internal error: %d\n", fr);
+                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EINTRN;
                 }
             }
-            DPRINTF("PING received. Answering with: %d\n", *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PING_STATUS)));
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_SHOW_VECTOR_CALL:
-        {
-            uint16_t trap_call = (uint16_t)payloadPtr[0];
-            bool isBlacklisted = false;
-            for (int i = 0; i < sizeof(BLACKLISTED_GEMDOS_CALLS); i++)
+            else
             {
-                if (trap_call == BLACKLISTED_GEMDOS_CALLS[i])
-                {
-                    isBlacklisted = true; // Found the call in the blacklist
-                    break;
-                }
+                DPRINTF("Folder deleted\n");
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EOK;
             }
-            // if (!isBlacklisted)
-            // {
-            // If the call is not blacklisted, print its information
-            DPRINTF("GEMDOS CALL: %s (%x)\n", GEMDOS_CALLS[trap_call], trap_call);
-            // }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_SET_SHARED_VAR:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FSETDTA_CALL:
+    {
+        uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        bool ndta_exists = lookupDTA(ndta);
+        if (ndta_exists)
         {
-            // Shared variables
-            uint32_t shared_variable_index = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d3 register
-            payloadPtr += 2;                                                                  // Skip two words
-            uint32_t shared_variable_value = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
-            set_shared_var(shared_variable_index, shared_variable_value, memory_shared_address);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            // We don't release the DTA if it already exists. Wait for FsFirst to do it
+            DPRINTF("DTA at %x already exists.\n", ndta);
         }
-        case GEMDRVEMUL_DGETDRV_CALL:
+        else
         {
-            // Get the drive letter
-            uint16_t dgetdrive_value = (uint16_t)payloadPtr[0];
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            DTA data = {"filename", 0, 0, 0, 0, 0, 0, 0, 0, "filename"};
+            insertDTA(ndta, data, NULL, NULL, 0);
+            DPRINTF("Added ndta: %x.\n", ndta);
         }
-        case GEMDRVEMUL_REENTRY_LOCK:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DTA_EXIST_CALL:
+    {
+        uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        bool ndta_exists = lookupDTA(ndta);
+        DPRINTF("DTA %x exists: %s\n", ndta, (ndta_exists) ? "TRUE" : "FALSE");
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DTA_EXIST, (ndta_exists ? ndta : 0));
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_DTA_RELEASE_CALL:
+    {
+        uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+        DPRINTF("Releasing DTA: %x\n", ndta);
+        DTANode *dtaNode = lookupDTA(ndta);
+        if (dtaNode != NULL)
         {
-            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_REENTRY_TRAP)) = 0xFFFF;
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            releaseDTA(ndta);
+            DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
         }
-        case GEMDRVEMUL_REENTRY_UNLOCK:
+        nullify_dta(memory_shared_address);
+
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DTA_RELEASE, countDTA());
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FSFIRST_CALL:
+    {
+        uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];  // d3 register
+        payloadPtr += 2;                                                  // Skip two words
+        uint32_t attribs = payloadPtr[0];                                 // d4 register
+        payloadPtr += 2;                                                  // Skip two words
+        uint32_t fspec = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register
+        payloadPtr += 2;                                                  // Skip two words
+        char attribs_str[7] = "";
+        char internal_path[MAX_FOLDER_LENGTH * 2] = {0};
+        char pattern[MAX_FOLDER_LENGTH] = {0};
+        char fspec_string[MAX_FOLDER_LENGTH] = {0};
+        char tmp_string[MAX_FOLDER_LENGTH] = {0};
+        char path_forwardslash[MAX_FOLDER_LENGTH] = {0};
+        // swap_string_endiannes((char *)payloadPtr, tmp_string);
+        COPY_AND_CHANGE_ENDIANESS_BLOCK16(payloadPtr, tmp_string, MAX_FOLDER_LENGTH);
+        DPRINTF("Fspec string: %s\n", tmp_string);
+        back_2_forwardslash(tmp_string);
+        DPRINTF("Fspec string backslash: %s\n", tmp_string);
+
+        if (tmp_string[1] == ':')
         {
-            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_REENTRY_TRAP)) = 0x0;
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            // If the path has the drive letter, jump two positions
+            // and ignore the dpath_string
+            snprintf(tmp_string, MAX_FOLDER_LENGTH, "%s", tmp_string + 2);
+            DPRINTF("New path_filename: %s\n", tmp_string);
         }
-        case GEMDRVEMUL_DFREE_CALL:
+        if (tmp_string[0] == '/')
         {
-            uint32_t dfree_unit = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            // Check the free space
-            DWORD fre_clust;
-            FATFS *fs;
-            FRESULT fr;
-            // Get free space
-            fr = f_getfree(hd_folder, &fre_clust, &fs);
-            if (fr != FR_OK)
-            {
-                *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_DFREE_STATUS)) = GEMDOS_ERROR;
-            }
-            else
-            {
-                // Calculate the total number of free bytes
-                uint64_t freeBytes = fre_clust * fs->csize * NUM_BYTES_PER_SECTOR;
-                DPRINTF("Total clusters: %d, free clusters: %d, bytes per sector: %d, sectors per cluster: %d\n", fs->n_fatent - 2, fre_clust, NUM_BYTES_PER_SECTOR, fs->csize);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT, fre_clust);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 4, fs->n_fatent - 2);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 8, NUM_BYTES_PER_SECTOR);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DFREE_STRUCT + 12, fs->csize);
-                *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_DFREE_STATUS)) = GEMDOS_EOK;
-            }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
+            DPRINTF("Root folder found. Ignoring default path.\n");
+            strcpy(fspec_string, tmp_string);
         }
-        case GEMDRVEMUL_DGETPATH_CALL:
+        else
         {
-            uint16_t dpath_drive = payloadPtr[0]; // d3 register
+            DPRINTF("Need to concatenate the default path: %s\n", dpath_string);
+            snprintf(fspec_string, sizeof(fspec_string), "%s/%s", dpath_string, tmp_string);
+            DPRINTF("Full fspec string: %s\n", fspec_string);
+        }
 
-            DPRINTF("Dpath drive: %x\n", dpath_drive);
-            DPRINTF("Dpath string: %s\n", dpath_string);
+        // Remove duplicated forward slashes
+        remove_dup_slashes(fspec_string);
+        get_attribs_st_str(attribs_str, attribs);
+        seach_path_2_st(fspec_string, internal_path, path_forwardslash, pattern);
 
-            char tmp_path[MAX_FOLDER_LENGTH] = {0};
-            memccpy(tmp_path, dpath_string, 0, MAX_FOLDER_LENGTH);
-            forward_2_backslash(tmp_path);
+        back_2_forwardslash(path_forwardslash);
 
-            // Remove the backslash at the end
-            DPRINTF("Dpath backslash string: %s\n", tmp_path);
-            if (tmp_path[strlen(tmp_path) - 1] == '\\')
-            {
-                tmp_path[strlen(tmp_path) - 1] = '\0';
-            }
+        // Testing if the FSfirst changes the default path or not
+        // DPRINTF("Old dpath string: %s, new dpath string: %s\n", dpath_string, path_forwardslash);
+        // strcpy(dpath_string, path_forwardslash);
 
-            DPRINTF("Dpath backslash string (no last backslash: %s\n", tmp_path);
+        // Remove all the trailing spaces in the pattern
+        remove_trailing_spaces(pattern);
 
-            COPY_AND_CHANGE_ENDIANESS_BLOCK16(tmp_path, memory_shared_address + GEMDRVEMUL_DEFAULT_PATH, MAX_FOLDER_LENGTH);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_DSETPATH_CALL:
-        {
-            payloadPtr += 6; // Skip six words
-            // Obtain the fname string and keep it in memory
-            char dpath_tmp[MAX_FOLDER_LENGTH] = {};
-            COPY_AND_CHANGE_ENDIANESS_BLOCK16(payloadPtr, dpath_tmp, MAX_FOLDER_LENGTH);
-            DPRINTF("Default path string: %s\n", dpath_tmp);
-            // Check if the directory exists
-            char tmp_path[MAX_FOLDER_LENGTH] = {0};
+        DPRINTF("Fsfirst ndta: %x, attribs: %s, fspec: %x, fspec string: %s\n", ndta, attribs_str, fspec, fspec_string);
+        DPRINTF("Fsfirst Full internal path: %s, filename pattern: %s[%d]\n", internal_path, pattern, strlen(pattern));
 
-            if (dpath_tmp[0] == drive_letter)
-            {
-                DPRINTF("Drive letter found: %c. Removing it.\n", drive_letter);
-                // Remove the drive letter and the colon from the path
-                memmove(dpath_tmp, dpath_tmp + 2, strlen(dpath_tmp));
-            }
+        bool ndta_exists = lookupDTA(ndta) ? true : false;
 
-            DPRINTF("Dpath string: %s\n", dpath_string);
-            DPRINTF("Dpath tmp: %s\n", dpath_tmp);
+        if (!(attribs & FS_ST_LABEL))
+        {
+            attribs |= FS_ST_ARCH;
+        }
 
-            // Check if the path is relative or absolute
-            if ((dpath_tmp[0] != '\\') && (dpath_tmp[0] != '/'))
+        FRESULT fr;   /* Return value */
+        DIR *dj;      /* Directory object */
+        FILINFO *fno; /* File information */
+        dj = (DIR *)malloc(sizeof(DIR));
+        fno = (FILINFO *)malloc(sizeof(FILINFO));
+
+        char raw_filename[2] = "._";
+        fr = FR_OK;
+        bool first_time = true;
+        while (fr == FR_OK && ((raw_filename[0] == '.') || (raw_filename[0] == '.' && raw_filename[1] == '_')))
+        {
+            if (first_time)
             {
-                // Concatenate the path with the existing dpath_string
-                char tmp_path_concat[MAX_FOLDER_LENGTH] = {0};
-                snprintf(tmp_path_concat, sizeof(tmp_path_concat), "%s/%s", dpath_string, dpath_tmp);
-                DPRINTF("Concatenated path: %s\n", tmp_path_concat);
-                strcpy(dpath_tmp, tmp_path_concat);
-                DPRINTF("Dpath tmp: %s\n", dpath_tmp);
+                first_time = false;
+                fr = f_findfirst(dj, fno, internal_path, pattern);
             }
             else
             {
-                DPRINTF("Do not concatenate the path\n");
+                fr = f_findnext(dj, fno);
             }
-            back_2_forwardslash(dpath_tmp);
-            // Concatenate the path with the hd_folder
-            snprintf(tmp_path, sizeof(tmp_path), "%s/%s", hd_folder, dpath_tmp);
-
-            // Remove duplicated forward slashes
-            remove_dup_slashes(tmp_path);
-            remove_dup_slashes(dpath_tmp);
-
-            if (directory_exists(tmp_path))
+            if (fno->fname[0])
             {
-                DPRINTF("Directory exists: %s\n", tmp_path);
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_SET_DPATH_STATUS)) = GEMDOS_EOK;
+                if (attribs & attribs_fat2st(fno->fattrib))
+                {
+                    if (fr == FR_OK)
+                    {
+                        raw_filename[0] = fno->fname[0];
+                        raw_filename[1] = fno->fname[1];
+                    }
+                }
             }
             else
             {
-                DPRINTF("Directory does not exist: %s\n", tmp_path);
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_SET_DPATH_STATUS)) = GEMDOS_EPTHNF;
+                raw_filename[0] = 'x'; // Force exit, no more elements
+                raw_filename[1] = 'x'; // Force exit, no more elements
             }
-            // Copy dpath_tmp to dpath_string
-            strcpy(dpath_string, dpath_tmp);
-            DPRINTF("The new default path is: %s\n", dpath_string);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_DCREATE_CALL:
+
+        if (fr == FR_OK && fno->fname[0])
         {
-            // Obtain the pathname string and keep it in memory
-            // concatenated with the local harddisk folder and the default path (if any)
-            payloadPtr += 6; // Skip six words
-            char tmp_pathname[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_pathname);
-            DPRINTF("Folder to create: %s\n", tmp_pathname);
+            uint8_t attribs_conv_st = attribs_fat2st(fno->fattrib);
+            char attribs_str[7] = "";
+            get_attribs_st_str(attribs_str, attribs_conv_st);
+            char shorten_filename[14];
+            char upper_filename[14];
+            char filtered_filename[14];
+            filter_fname(fno->fname, filtered_filename);
+            upper_fname(filtered_filename, upper_filename);
+            shorten_fname(upper_filename, shorten_filename);
 
-            // Check if the folder exists. If not, return an error
-            if (directory_exists(tmp_pathname) != FR_OK)
-            {
-                DPRINTF("ERROR: Folder does not exist\n");
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EPTHNF;
-            }
-            else
+            strcpy(fno->fname, shorten_filename);
+
+            // Filter out elements that do not match the attributes
+            if (attribs_conv_st & attribs)
             {
-                // Create the folder
-                fr = f_mkdir(tmp_pathname);
-                if (fr != FR_OK)
-                {
-                    DPRINTF("ERROR: Could not create folder (%d)\r\n", fr);
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EACCDN;
-                }
-                else
+                DPRINTF("Found: %s, attr: %s\n", fno->fname, attribs_str);
+                if (ndta_exists)
                 {
-                    DPRINTF("Folder created\n");
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DCREATE_STATUS)) = GEMDOS_EOK;
+                    releaseDTA(ndta);
+                    DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
+                    nullify_dta(memory_shared_address);
                 }
-            }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_DDELETE_CALL:
-        {
-            // Obtain the pathname string and keep it in memory
-            // concatenated with the local harddisk folder and the default path (if any)
-            payloadPtr += 6; // Skip six words
-            char tmp_pathname[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_pathname);
-            DPRINTF("Folder to delete: %s\n", tmp_pathname);
-
-            // Check if the folder exists. If not, return an error
-            if (directory_exists(tmp_pathname) == 0)
-            {
-                DPRINTF("ERROR: Folder does not exist\n");
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EPTHNF;
+                DTA data = {"filename.typ", 0, 0, 0, 0, 0, 0, 0, 0, "filename.typ"};
+                insertDTA(ndta, data, dj, fno, attribs);
+                // Populate the DTA with the first file found
+                populate_dta(memory_shared_address, ndta, GEMDOS_EFILNF);
+                // Null dj and fno to avoid freeing them
+                dj = NULL;
+                fno = NULL;
             }
             else
             {
-                // Delete the folder
-                fr = f_unlink(tmp_pathname);
-                if (fr != FR_OK)
-                {
-                    DPRINTF("ERROR: Could not delete folder (%d)\r\n", fr);
-                    if (fr == FR_DENIED)
-                    {
-                        DPRINTF("ERROR: Folder is not empty\n");
-                        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EACCDN;
-                    }
-                    else if (fr == FR_NO_PATH)
-                    {
-                        DPRINTF("ERROR: Folder does not exist\n");
-                        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EPTHNF;
-                    }
-                    else
-                    {
-                        DPRINTF("ERROR: Internal error: %d\n", fr);
-                        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EINTRN;
-                    }
-                }
-                else
+                DPRINTF("Skipped: %s, attr: %s\n", fno->fname, attribs_str);
+                int16_t error_code = GEMDOS_EFILNF;
+                DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
+                if (ndta_exists)
                 {
-                    DPRINTF("Folder deleted\n");
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DDELETE_STATUS)) = GEMDOS_EOK;
+                    releaseDTA(ndta);
+                    DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
+                    nullify_dta(memory_shared_address);
                 }
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_FSETDTA_CALL:
+        else
         {
-            uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            bool ndta_exists = lookupDTA(ndta);
+            DPRINTF("Nothing returned from Fsfirst\n");
+            int16_t error_code = GEMDOS_EFILNF;
+            DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
             if (ndta_exists)
-            {
-                // We don't release the DTA if it already exists. Wait for FsFirst to do it
-                DPRINTF("DTA at %x already exists.\n", ndta);
-            }
-            else
-            {
-                DTA data = {"filename", 0, 0, 0, 0, 0, 0, 0, 0, "filename"};
-                insertDTA(ndta, data, NULL, NULL, 0);
-                DPRINTF("Added ndta: %x.\n", ndta);
-            }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_DTA_EXIST_CALL:
-        {
-            uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            bool ndta_exists = lookupDTA(ndta);
-            DPRINTF("DTA %x exists: %s\n", ndta, (ndta_exists) ? "TRUE" : "FALSE");
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DTA_EXIST, (ndta_exists ? ndta : 0));
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_DTA_RELEASE_CALL:
-        {
-            uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-            DPRINTF("Releasing DTA: %x\n", ndta);
-            DTANode *dtaNode = lookupDTA(ndta);
-            if (dtaNode != NULL)
             {
                 releaseDTA(ndta);
                 DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
             }
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
             nullify_dta(memory_shared_address);
-
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_DTA_RELEASE, countDTA());
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_FSFIRST_CALL:
+        // Guarantee that the dynamic memory is released
+        if (dj != NULL)
         {
-            uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];  // d3 register
-            payloadPtr += 2;                                                  // Skip two words
-            uint32_t attribs = payloadPtr[0];                                 // d4 register
-            payloadPtr += 2;                                                  // Skip two words
-            uint32_t fspec = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register
-            payloadPtr += 2;                                                  // Skip two words
-            char attribs_str[7] = "";
-            char internal_path[MAX_FOLDER_LENGTH * 2] = {0};
-            char pattern[MAX_FOLDER_LENGTH] = {0};
-            char fspec_string[MAX_FOLDER_LENGTH] = {0};
-            char tmp_string[MAX_FOLDER_LENGTH] = {0};
-            char path_forwardslash[MAX_FOLDER_LENGTH] = {0};
-            // swap_string_endiannes((char *)payloadPtr, tmp_string);
-            COPY_AND_CHANGE_ENDIANESS_BLOCK16(payloadPtr, tmp_string, MAX_FOLDER_LENGTH);
-            DPRINTF("Fspec string: %s\n", tmp_string);
-            back_2_forwardslash(tmp_string);
-            DPRINTF("Fspec string backslash: %s\n", tmp_string);
-
-            if (tmp_string[1] == ':')
-            {
-                // If the path has the drive letter, jump two positions
-                // and ignore the dpath_string
-                snprintf(tmp_string, MAX_FOLDER_LENGTH, "%s", tmp_string + 2);
-                DPRINTF("New path_filename: %s\n", tmp_string);
-            }
-            if (tmp_string[0] == '/')
-            {
-                DPRINTF("Root folder found. Ignoring default path.\n");
-                strcpy(fspec_string, tmp_string);
-            }
-            else
-            {
-                DPRINTF("Need to concatenate the default path: %s\n", dpath_string);
-                snprintf(fspec_string, sizeof(fspec_string), "%s/%s", dpath_string, tmp_string);
-                DPRINTF("Full fspec string: %s\n", fspec_string);
-            }
-
-            // Remove duplicated forward slashes
-            remove_dup_slashes(fspec_string);
-            get_attribs_st_str(attribs_str, attribs);
-            seach_path_2_st(fspec_string, internal_path, path_forwardslash, pattern);
-
-            back_2_forwardslash(path_forwardslash);
-
-            // Testing if the FSfirst changes the default path or not
-            // DPRINTF("Old dpath string: %s, new dpath string: %s\n", dpath_string, path_forwardslash);
-            // strcpy(dpath_string, path_forwardslash);
-
-            // Remove all the trailing spaces in the pattern
-            remove_trailing_spaces(pattern);
-
-            DPRINTF("Fsfirst ndta: %x, attribs: %s, fspec: %x, fspec string: %s\n", ndta, attribs_str, fspec, fspec_string);
-            DPRINTF("Fsfirst Full internal path: %s, filename pattern: %s[%d]\n", internal_path, pattern, strlen(pattern));
-
-            bool ndta_exists = lookupDTA(ndta) ? true : false;
-
-            if (!(attribs & FS_ST_LABEL))
-            {
-                attribs |= FS_ST_ARCH;
-            }
+            free(dj);
+        }
+        if (fno != NULL)
+        {
+            free(fno);
+        }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FSNEXT_CALL:
+    {
+        uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d3 register
+        DPRINTF("Fsnext ndta: %x\n", ndta);
 
-            FRESULT fr;   /* Return value */
-            DIR *dj;      /* Directory object */
-            FILINFO *fno; /* File information */
-            dj = (DIR *)malloc(sizeof(DIR));
-            fno = (FILINFO *)malloc(sizeof(FILINFO));
+        FRESULT fr; /* Return value */
+        DTANode *dtaNode = lookupDTA(ndta);
 
+        bool ndta_exists = dtaNode ? true : false;
+        if (dtaNode != NULL && dtaNode->dj != NULL && dtaNode->fno != NULL && ndta_exists)
+        {
+            uint32_t attribs = dtaNode->attribs;
+            // We need to filter out the elements that does not make sense in the FsFat environment
+            // And in the Atari ST environment
             char raw_filename[2] = "._";
             fr = FR_OK;
-            bool first_time = true;
             while (fr == FR_OK && ((raw_filename[0] == '.') || (raw_filename[0] == '.' && raw_filename[1] == '_')))
             {
-                if (first_time)
-                {
-                    first_time = false;
-                    fr = f_findfirst(dj, fno, internal_path, pattern);
-                }
-                else
-                {
-                    fr = f_findnext(dj, fno);
-                }
-                if (fno->fname[0])
+                fr = f_findnext(dtaNode->dj, dtaNode->fno);
+                DPRINTF("Fsnext fr: %d and filename: %s\n", fr, dtaNode->fno->fname);
+                if (dtaNode->fno->fname[0])
                 {
-                    if (attribs & attribs_fat2st(fno->fattrib))
+                    if (attribs & attribs_fat2st(dtaNode->fno->fattrib))
                     {
                         if (fr == FR_OK)
                         {
-                            raw_filename[0] = fno->fname[0];
-                            raw_filename[1] = fno->fname[1];
+                            raw_filename[0] = dtaNode->fno->fname[0];
+                            raw_filename[1] = dtaNode->fno->fname[1];
                         }
                     }
                 }
                 else
                 {
-                    raw_filename[0] = 'x'; // Force exit, no more elements
-                    raw_filename[1] = 'x'; // Force exit, no more elements
+                    raw_filename[0] = 'X'; // Force exit, no more elements
+                    raw_filename[1] = 'X'; // Force exit, no more elements
                 }
             }
-
-            if (fr == FR_OK && fno->fname[0])
+            if (fr == FR_OK && dtaNode->fno->fname[0])
             {
-                uint8_t attribs_conv_st = attribs_fat2st(fno->fattrib);
-                char attribs_str[7] = "";
-                get_attribs_st_str(attribs_str, attribs_conv_st);
                 char shorten_filename[14];
                 char upper_filename[14];
                 char filtered_filename[14];
-                filter_fname(fno->fname, filtered_filename);
+                filter_fname(dtaNode->fno->fname, filtered_filename);
                 upper_fname(filtered_filename, upper_filename);
                 shorten_fname(upper_filename, shorten_filename);
+                strcpy(dtaNode->fno->fname, shorten_filename);
 
-                strcpy(fno->fname, shorten_filename);
-
-                // Filter out elements that do not match the attributes
-                if (attribs_conv_st & attribs)
+                uint8_t attribs = dtaNode->fno->fattrib;
+                uint8_t attribs_conv_st = attribs_fat2st(attribs);
+                if (!(attribs & (FS_ST_LABEL)))
                 {
-                    DPRINTF("Found: %s, attr: %s\n", fno->fname, attribs_str);
-                    if (ndta_exists)
-                    {
-                        releaseDTA(ndta);
-                        DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
-                        nullify_dta(memory_shared_address);
-                    }
-                    DTA data = {"filename.typ", 0, 0, 0, 0, 0, 0, 0, 0, "filename.typ"};
-                    insertDTA(ndta, data, dj, fno, attribs);
-                    // Populate the DTA with the first file found
-                    populate_dta(memory_shared_address, ndta, GEMDOS_EFILNF);
-                    // Null dj and fno to avoid freeing them
-                    dj = NULL;
-                    fno = NULL;
-                }
-                else
-                {
-                    DPRINTF("Skipped: %s, attr: %s\n", fno->fname, attribs_str);
-                    int16_t error_code = GEMDOS_EFILNF;
-                    DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
-                    if (ndta_exists)
-                    {
-                        releaseDTA(ndta);
-                        DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
-                        nullify_dta(memory_shared_address);
-                    }
+                    attribs |= FS_ST_ARCH;
                 }
+                char attribs_str[7] = "";
+                get_attribs_st_str(attribs_str, attribs_conv_st);
+                DPRINTF("Found: %s, attr: %s\n", dtaNode->fno->fname, attribs_str);
+                // Populate the DTA with the next file found
+                populate_dta(memory_shared_address, ndta, GEMDOS_ENMFIL);
             }
             else
             {
-                DPRINTF("Nothing returned from Fsfirst\n");
-                int16_t error_code = GEMDOS_EFILNF;
+                DPRINTF("Nothing found\n");
+                int16_t error_code = GEMDOS_ENMFIL;
                 DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
                 if (ndta_exists)
                 {
                     releaseDTA(ndta);
                     DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
                 }
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
                 nullify_dta(memory_shared_address);
             }
-            // Guarantee that the dynamic memory is released
-            if (dj != NULL)
-            {
-                free(dj);
-            }
-            if (fno != NULL)
+        }
+        else
+        {
+            DPRINTF("FsFirst not initalized\n");
+            int16_t error_code = GEMDOS_EINTRN;
+            DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
+            if (ndta_exists)
             {
-                free(fno);
+                releaseDTA(ndta);
+                DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
+            nullify_dta(memory_shared_address);
+        }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FOPEN_CALL:
+    {
+        uint16_t fopen_mode = payloadPtr[0]; // d3 register
+        payloadPtr += 6;                     // Skip six words
+        // Obtain the fname string and keep it in memory
+        // concatenated path and filename
+        char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_filepath);
+        DPRINTF("Opening file: %s with mode: %x\n", tmp_filepath, fopen_mode);
+        // Convert the fopen_mode to FatFs mode
+        DPRINTF("Fopen mode: %x\n", fopen_mode);
+        BYTE fatfs_open_mode = 0;
+        switch (fopen_mode)
+        {
+        case 0: // Read only
+            fatfs_open_mode = FA_READ;
+            break;
+        case 1: // Write only
+            fatfs_open_mode = FA_WRITE;
+            break;
+        case 2: // Read/Write
+            fatfs_open_mode = FA_READ | FA_WRITE;
+            break;
+        default:
+            DPRINTF("ERROR: Invalid mode: %x\n", fopen_mode);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EACCDN);
             break;
         }
-        case GEMDRVEMUL_FSNEXT_CALL:
+        DPRINTF("FatFs open mode: %x\n", fatfs_open_mode);
+        if (fopen_mode <= 2)
         {
-            uint32_t ndta = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d3 register
-            DPRINTF("Fsnext ndta: %x\n", ndta);
-
-            FRESULT fr; /* Return value */
-            DTANode *dtaNode = lookupDTA(ndta);
-
-            bool ndta_exists = dtaNode ? true : false;
-            if (dtaNode != NULL && dtaNode->dj != NULL && dtaNode->fno != NULL && ndta_exists)
+            // Open the file with FatFs
+            FIL file_object;
+            fr = f_open(&file_object, tmp_filepath, fatfs_open_mode);
+            if (fr != FR_OK)
             {
-                uint32_t attribs = dtaNode->attribs;
-                // We need to filter out the elements that does not make sense in the FsFat environment
-                // And in the Atari ST environment
-                char raw_filename[2] = "._";
-                fr = FR_OK;
-                while (fr == FR_OK && ((raw_filename[0] == '.') || (raw_filename[0] == '.' && raw_filename[1] == '_')))
-                {
-                    fr = f_findnext(dtaNode->dj, dtaNode->fno);
-                    DPRINTF("Fsnext fr: %d and filename: %s\n", fr, dtaNode->fno->fname);
-                    if (dtaNode->fno->fname[0])
-                    {
-                        if (attribs & attribs_fat2st(dtaNode->fno->fattrib))
-                        {
-                            if (fr == FR_OK)
-                            {
-                                raw_filename[0] = dtaNode->fno->fname[0];
-                                raw_filename[1] = dtaNode->fno->fname[1];
-                            }
-                        }
-                    }
-                    else
-                    {
-                        raw_filename[0] = 'X'; // Force exit, no more elements
-                        raw_filename[1] = 'X'; // Force exit, no more elements
-                    }
-                }
-                if (fr == FR_OK && dtaNode->fno->fname[0])
-                {
-                    char shorten_filename[14];
-                    char upper_filename[14];
-                    char filtered_filename[14];
-                    filter_fname(dtaNode->fno->fname, filtered_filename);
-                    upper_fname(filtered_filename, upper_filename);
-                    shorten_fname(upper_filename, shorten_filename);
-                    strcpy(dtaNode->fno->fname, shorten_filename);
-
-                    uint8_t attribs = dtaNode->fno->fattrib;
-                    uint8_t attribs_conv_st = attribs_fat2st(attribs);
-                    if (!(attribs & (FS_ST_LABEL)))
-                    {
-                        attribs |= FS_ST_ARCH;
-                    }
-                    char attribs_str[7] = "";
-                    get_attribs_st_str(attribs_str, attribs_conv_st);
-                    DPRINTF("Found: %s, attr: %s\n", dtaNode->fno->fname, attribs_str);
-                    // Populate the DTA with the next file found
-                    populate_dta(memory_shared_address, ndta, GEMDOS_ENMFIL);
-                }
-                else
-                {
-                    DPRINTF("Nothing found\n");
-                    int16_t error_code = GEMDOS_ENMFIL;
-                    DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
-                    if (ndta_exists)
-                    {
-                        releaseDTA(ndta);
-                        DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
-                    }
-                    nullify_dta(memory_shared_address);
-                }
+                DPRINTF("ERROR: Could not open file (%d)\r\n", fr);
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EFILNF);
             }
             else
             {
-                DPRINTF("FsFirst not initalized\n");
-                int16_t error_code = GEMDOS_EINTRN;
-                DPRINTF("DTA at %x showing error code: %x\n", ndta, error_code);
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_DTA_F_FOUND)) = error_code;
-                if (ndta_exists)
-                {
-                    releaseDTA(ndta);
-                    DPRINTF("Existing DTA at %x released. DTA table elements: %d\n", ndta, countDTA());
-                }
-                nullify_dta(memory_shared_address);
-            }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_FOPEN_CALL:
-        {
-            uint16_t fopen_mode = payloadPtr[0]; // d3 register
-            payloadPtr += 6;                     // Skip six words
-            // Obtain the fname string and keep it in memory
-            // concatenated path and filename
-            char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_filepath);
-            DPRINTF("Opening file: %s with mode: %x\n", tmp_filepath, fopen_mode);
-            // Convert the fopen_mode to FatFs mode
-            DPRINTF("Fopen mode: %x\n", fopen_mode);
-            BYTE fatfs_open_mode = 0;
-            switch (fopen_mode)
-            {
-            case 0: // Read only
-                fatfs_open_mode = FA_READ;
-                break;
-            case 1: // Write only
-                fatfs_open_mode = FA_WRITE;
-                break;
-            case 2: // Read/Write
-                fatfs_open_mode = FA_READ | FA_WRITE;
-                break;
-            default:
-                DPRINTF("ERROR: Invalid mode: %x\n", fopen_mode);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EACCDN);
-                break;
-            }
-            DPRINTF("FatFs open mode: %x\n", fatfs_open_mode);
-            if (fopen_mode <= 2)
-            {
-                // Open the file with FatFs
-                FIL file_object;
-                fr = f_open(&file_object, tmp_filepath, fatfs_open_mode);
-                if (fr != FR_OK)
+                // Add the file to the list of open files
+                int fd_counter = get_first_available_fd(fdescriptors);
+                DPRINTF("Opening file with new file descriptor: %d\n", fd_counter);
+                FileDescriptors *newFDescriptor = malloc(sizeof(FileDescriptors));
+                if (newFDescriptor == NULL)
                 {
-                    DPRINTF("ERROR: Could not open file (%d)\r\n", fr);
-                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EFILNF);
+                    DPRINTF("Memory allocation failed for new FileDescriptors\n");
+                    DPRINTF("ERROR: Could not add file to the list of open files\n");
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EINTRN);
                 }
                 else
                 {
-                    // Add the file to the list of open files
-                    int fd_counter = get_first_available_fd(fdescriptors);
-                    DPRINTF("Opening file with new file descriptor: %d\n", fd_counter);
-                    FileDescriptors *newFDescriptor = malloc(sizeof(FileDescriptors));
-                    if (newFDescriptor == NULL)
-                    {
-                        DPRINTF("Memory allocation failed for new FileDescriptors\n");
-                        DPRINTF("ERROR: Could not add file to the list of open files\n");
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, GEMDOS_EINTRN);
-                    }
-                    else
-                    {
-                        add_file(&fdescriptors, newFDescriptor, tmp_filepath, file_object, fd_counter);
-                        DPRINTF("File opened with file descriptor: %d\n", fd_counter);
-                        // Return the file descriptor
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, fd_counter);
-                    }
+                    add_file(&fdescriptors, newFDescriptor, tmp_filepath, file_object, fd_counter);
+                    DPRINTF("File opened with file descriptor: %d\n", fd_counter);
+                    // Return the file descriptor
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FOPEN_HANDLE, fd_counter);
                 }
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_FCLOSE_CALL:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FCLOSE_CALL:
+    {
+        uint16_t fclose_fd = payloadPtr[0]; // d3 register
+        DPRINTF("Closing file with fd: %x\n", fclose_fd);
+        // Obtain the file descriptor
+        FileDescriptors *file = get_file_by_fdesc(fdescriptors, fclose_fd);
+        if (file == NULL)
+        {
+            DPRINTF("ERROR: File descriptor not found\n");
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EIHNDL;
+        }
+        else
         {
-            uint16_t fclose_fd = payloadPtr[0]; // d3 register
-            DPRINTF("Closing file with fd: %x\n", fclose_fd);
-            // Obtain the file descriptor
-            FileDescriptors *file = get_file_by_fdesc(fdescriptors, fclose_fd);
-            if (file == NULL)
+            // Close the file with FatFs
+            fr = f_close(&file->fobject);
+            if (fr == FR_INVALID_OBJECT)
             {
-                DPRINTF("ERROR: File descriptor not found\n");
+                DPRINTF("ERROR: File descriptor is not valid\n");
                 *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EIHNDL;
             }
+            else if (fr != FR_OK)
+            {
+                DPRINTF("ERROR: Could not close file (%d)\r\n", fr);
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EINTRN;
+            }
             else
             {
-                // Close the file with FatFs
-                fr = f_close(&file->fobject);
-                if (fr == FR_INVALID_OBJECT)
-                {
-                    DPRINTF("ERROR: File descriptor is not valid\n");
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EIHNDL;
-                }
-                else if (fr != FR_OK)
-                {
-                    DPRINTF("ERROR: Could not close file (%d)\r\n", fr);
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EINTRN;
-                }
-                else
-                {
-                    // Remove the file from the list of open files
-                    delete_file_by_fdesc(&fdescriptors, fclose_fd);
-                    DPRINTF("File closed\n");
-                    // Return the file descriptor
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EOK;
-                }
+                // Remove the file from the list of open files
+                delete_file_by_fdesc(&fdescriptors, fclose_fd);
+                DPRINTF("File closed\n");
+                // Return the file descriptor
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCLOSE_STATUS)) = GEMDOS_EOK;
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
 
-        case GEMDRVEMUL_FCREATE_CALL:
+    case GEMDRVEMUL_FCREATE_CALL:
+    {
+        fcreate_mode = payloadPtr[0]; // d3 register
+        payloadPtr += 6;              // Skip six words
+        // Obtain the fname string and keep it in memory
+        // concatenated path and filename
+        char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_filepath);
+        DPRINTF("Creating file: %s\n with mode: %x", tmp_filepath, fcreate_mode);
+
+        // CREATE ALWAYS MODE
+        BYTE fatfs_create_mode = FA_READ | FA_WRITE | FA_CREATE_ALWAYS;
+        DPRINTF("FatFs create mode: %x\n", fatfs_create_mode);
+
+        // Open the file with FatFs
+        FIL file_object;
+        fr = f_open(&file_object, tmp_filepath, fatfs_create_mode);
+        if (fr != FR_OK)
         {
-            fcreate_mode = payloadPtr[0]; // d3 register
-            payloadPtr += 6;              // Skip six words
-            // Obtain the fname string and keep it in memory
-            // concatenated path and filename
-            char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_filepath);
-            DPRINTF("Creating file: %s\n with mode: %x", tmp_filepath, fcreate_mode);
-
-            // CREATE ALWAYS MODE
-            BYTE fatfs_create_mode = FA_READ | FA_WRITE | FA_CREATE_ALWAYS;
-            DPRINTF("FatFs create mode: %x\n", fatfs_create_mode);
-
-            // Open the file with FatFs
-            FIL file_object;
-            fr = f_open(&file_object, tmp_filepath, fatfs_create_mode);
-            if (fr != FR_OK)
+            DPRINTF("ERROR: Could not create file (%d)\r\n", fr);
+            // *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
+            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = GEMDOS_EPTHNF;
+        }
+        else
+        {
+            // Add the file to the list of open files
+            int fd_counter = get_first_available_fd(fdescriptors);
+            DPRINTF("File created with file descriptor: %d\n", fd_counter);
+            FileDescriptors *newFDescriptor = malloc(sizeof(FileDescriptors));
+            if (newFDescriptor == NULL)
             {
-                DPRINTF("ERROR: Could not create file (%d)\r\n", fr);
-                // *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
-                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = GEMDOS_EPTHNF;
+                DPRINTF("Memory allocation failed for new FileDescriptors\n");
+                DPRINTF("ERROR: Could not add file to the list of open files\n");
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FCREATE_HANDLE, GEMDOS_EINTRN);
             }
             else
             {
-                // Add the file to the list of open files
-                int fd_counter = get_first_available_fd(fdescriptors);
-                DPRINTF("File created with file descriptor: %d\n", fd_counter);
-                FileDescriptors *newFDescriptor = malloc(sizeof(FileDescriptors));
-                if (newFDescriptor == NULL)
-                {
-                    DPRINTF("Memory allocation failed for new FileDescriptors\n");
-                    DPRINTF("ERROR: Could not add file to the list of open files\n");
-                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FCREATE_HANDLE, GEMDOS_EINTRN);
-                }
-                else
-                {
-                    add_file(&fdescriptors, newFDescriptor, tmp_filepath, file_object, fd_counter);
+                add_file(&fdescriptors, newFDescriptor, tmp_filepath, file_object, fd_counter);
 
-                    // MISSING ATTRIBUTE MODIFICATION
+                // MISSING ATTRIBUTE MODIFICATION
 
-                    // Return the file descriptor
-                    *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = fd_counter;
-                }
+                // Return the file descriptor
+                *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_FCREATE_HANDLE)) = fd_counter;
             }
+        }
 
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FDELETE_CALL:
+    {
+        payloadPtr += 6; // Skip six words
+        // Obtain the fname string and keep it in memory
+        // concatenated path and filename
+        char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_filepath);
+        uint32_t status = GEMDOS_EOK;
+        // Check first if the file is open. If so, close it first.
+        FileDescriptors *file = get_file_by_fpath(fdescriptors, tmp_filepath);
+        if (file != NULL)
+        {
+            DPRINTF("File is open. Closing it first\n");
+            fr = f_close(&file->fobject);
+            if (fr != FR_OK)
+            {
+                DPRINTF("ERROR: Could not close file (%d)\r\n", fr);
+                status = GEMDOS_EINTRN;
+            }
+            // In both cases, remove the file from the list of open files
+            delete_file_by_fdesc(&fdescriptors, file->fd);
         }
-        case GEMDRVEMUL_FDELETE_CALL:
-        {
-            payloadPtr += 6; // Skip six words
-            // Obtain the fname string and keep it in memory
-            // concatenated path and filename
-            char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_filepath);
-            uint32_t status = GEMDOS_EOK;
-            // Check first if the file is open. If so, close it first.
-            FileDescriptors *file = get_file_by_fpath(fdescriptors, tmp_filepath);
-            if (file != NULL)
+        // If the file was open and it was not possible to close it, return an error
+        if (status == GEMDOS_EOK)
+        {
+            DPRINTF("Deleting file: %s\n", tmp_filepath);
+            // Delete the file
+            fr = f_unlink(tmp_filepath);
+            if (fr != FR_OK)
             {
-                DPRINTF("File is open. Closing it first\n");
-                fr = f_close(&file->fobject);
-                if (fr != FR_OK)
+                DPRINTF("ERROR: Could not delete file (%d)\r\n", fr);
+                if (fr == FR_DENIED)
                 {
-                    DPRINTF("ERROR: Could not close file (%d)\r\n", fr);
-                    status = GEMDOS_EINTRN;
+                    DPRINTF("ERROR: Not enough permissions to delete file\n");
+                    status = GEMDOS_EACCDN;
                 }
-                // In both cases, remove the file from the list of open files
-                delete_file_by_fdesc(&fdescriptors, file->fd);
-            }
-            // If the file was open and it was not possible to close it, return an error
-            if (status == GEMDOS_EOK)
-            {
-                DPRINTF("Deleting file: %s\n", tmp_filepath);
-                // Delete the file
-                fr = f_unlink(tmp_filepath);
-                if (fr != FR_OK)
+                else if (fr == FR_NO_PATH)
                 {
-                    DPRINTF("ERROR: Could not delete file (%d)\r\n", fr);
-                    if (fr == FR_DENIED)
-                    {
-                        DPRINTF("ERROR: Not enough permissions to delete file\n");
-                        status = GEMDOS_EACCDN;
-                    }
-                    else if (fr == FR_NO_PATH)
-                    {
-                        DPRINTF("ERROR: Folder does not exist\n");
-                        status = GEMDOS_EPTHNF;
-                    }
-                    else if (fr == FR_NO_FILE)
-                    {
-                        DPRINTF("ERROR: File does not exist\n");
-                        // status = GEMDOS_EFILNF;
-                        status = GEMDOS_EOK;
-                    }
-                    else
-                    {
-                        DPRINTF("ERROR: Internal error\n");
-                        status = GEMDOS_EINTRN;
-                    }
+                    DPRINTF("ERROR: Folder does not exist\n");
+                    status = GEMDOS_EPTHNF;
                 }
-                else
+                else if (fr == FR_NO_FILE)
                 {
-                    DPRINTF("File deleted\n");
+                    DPRINTF("ERROR: File does not exist\n");
+                    // status = GEMDOS_EFILNF;
                     status = GEMDOS_EOK;
                 }
+                else
+                {
+                    DPRINTF("ERROR: Internal error\n");
+                    status = GEMDOS_EINTRN;
+                }
             }
-            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FDELETE_STATUS)) = SWAP_LONGWORD(status);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_FSEEK_CALL:
-        {
-            uint16_t fseek_fd = payloadPtr[0];                                       // d3 register
-            payloadPtr += 2;                                                         // Skip two words
-            uint32_t fseek_offset = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
-            payloadPtr += 2;                                                         // Skip two words
-            uint16_t fseek_mode = payloadPtr[0];                                     // d5 register
-            DPRINTF("Fseek in the file with fd: %x, offset: %x, mode: %x\n", fseek_fd, fseek_offset, fseek_mode);
-            // Obtain the file descriptor
-            FileDescriptors *file = get_file_by_fdesc(fdescriptors, fseek_fd);
-            if (file == NULL)
+            else
             {
-                DPRINTF("ERROR: File descriptor not found\n");
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, GEMDOS_EIHNDL);
+                DPRINTF("File deleted\n");
+                status = GEMDOS_EOK;
             }
-            else
+        }
+        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FDELETE_STATUS)) = SWAP_LONGWORD(status);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FSEEK_CALL:
+    {
+        uint16_t fseek_fd = payloadPtr[0];                                       // d3 register
+        payloadPtr += 2;                                                         // Skip two words
+        uint32_t fseek_offset = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
+        payloadPtr += 2;                                                         // Skip two words
+        uint16_t fseek_mode = payloadPtr[0];                                     // d5 register
+        DPRINTF("Fseek in the file with fd: %x, offset: %x, mode: %x\n", fseek_fd, fseek_offset, fseek_mode);
+        // Obtain the file descriptor
+        FileDescriptors *file = get_file_by_fdesc(fdescriptors, fseek_fd);
+        if (file == NULL)
+        {
+            DPRINTF("ERROR: File descriptor not found\n");
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, GEMDOS_EIHNDL);
+        }
+        else
+        {
+            switch (fseek_mode)
             {
-                switch (fseek_mode)
-                {
-                case 0: // SEEK_SET 0 offset specifies the positive number of bytes from the beginning of the file
-                    file->offset = fseek_offset;
-                    break;
-                case 1: // SEEK_CUR 1 offset specifies offset specifies the negative or positive number of bytes from the current file position
-                    file->offset += fseek_offset;
-                    if (file->offset < 0)
-                    {
-                        file->offset = 0;
-                    }
-                    break;
-                case 2: // SEEK_END 2 offset specifies the negative number of bytes from the end of the file
-                    // Get file size
-                    file->offset = f_size(&(file->fobject)) + fseek_offset;
-                    if (file->offset < 0)
-                    {
-                        file->offset = 0;
-                    }
-                    break;
-                }
-                // We don't really need to do the lseek here, because it will be performed in the read operation
-                if (fr != FR_OK)
+            case 0: // SEEK_SET 0 offset specifies the positive number of bytes from the beginning of the file
+                file->offset = fseek_offset;
+                break;
+            case 1: // SEEK_CUR 1 offset specifies offset specifies the negative or positive number of bytes from the current file position
+                file->offset += fseek_offset;
+                if (file->offset < 0)
                 {
-                    DPRINTF("ERROR: Could not seek file (%d)\r\n", fr);
-                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, GEMDOS_EINTRN);
+                    file->offset = 0;
                 }
-                else
+                break;
+            case 2: // SEEK_END 2 offset specifies the negative number of bytes from the end of the file
+                // Get file size
+                file->offset = f_size(&(file->fobject)) + fseek_offset;
+                if (file->offset < 0)
                 {
-                    DPRINTF("File seeked\n");
-                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, file->offset);
+                    file->offset = 0;
                 }
+                break;
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
-        }
-        case GEMDRVEMUL_FATTRIB_CALL:
-        {
-            uint16_t fattrib_flag = payloadPtr[0]; // d3 register
-            payloadPtr += 2;                       // Skip two words
-            // Obtain the new attributes, if FATTRIB_SET is set
-            uint16_t fattrib_new = payloadPtr[0]; // d4 register
-            payloadPtr += 4;                      // Skip four words
-            // Obtain the fname string and keep it in memory
-            // concatenated path and filename
-            char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
-            get_local_full_pathname(tmp_filepath);
-            DPRINTF("Fattrib flag: %x, new attributes: %x\n", fattrib_flag, fattrib_new);
-            DPRINTF("Getting attributes of file: %s\n", tmp_filepath);
-
-            // Get the attributes of the file
-            FILINFO fno;
-            fr = f_stat(tmp_filepath, &fno);
+            // We don't really need to do the lseek here, because it will be performed in the read operation
             if (fr != FR_OK)
             {
-                DPRINTF("ERROR: Could not get file attributes (%d)\r\n", fr);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, GEMDOS_EFILNF);
+                DPRINTF("ERROR: Could not seek file (%d)\r\n", fr);
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, GEMDOS_EINTRN);
             }
             else
             {
-                uint32_t fattrib_st = attribs_fat2st(fno.fattrib);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, fattrib_st);
-                char fattrib_st_str[7] = "";
-                get_attribs_st_str(fattrib_st_str, fattrib_st);
-                if (fattrib_flag == FATTRIB_INQUIRE)
-                {
-                    DPRINTF("File attributes: %s\n", fattrib_st_str);
-                }
-                else
-                {
-                    // WE will assume here FATTRIB_SET
-                    // Set the attributes of the file
-                    char fattrib_st_str[7] = "";
-                    get_attribs_st_str(fattrib_st_str, fattrib_new);
-                    DPRINTF("New file attributes: %s\n", fattrib_st_str);
-                    BYTE fattrib_fatfs_new = (BYTE)attribs_st2fat(fattrib_new);
-                    fr = f_chmod(tmp_filepath, fattrib_fatfs_new, AM_RDO | AM_HID | AM_SYS);
-                    if (fr != FR_OK)
-                    {
-                        DPRINTF("ERROR: Could not set file attributes (%d)\r\n", fr);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, GEMDOS_EACCDN);
-                    }
-                }
+                DPRINTF("File seeked\n");
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FSEEK_STATUS, file->offset);
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_FRENAME_CALL:
-        {
-            payloadPtr += 6; // Skip six words
-            // Obtain the src name from the payload
-            char *origin = (char *)payloadPtr;
-            char frename_fname_src[MAX_FOLDER_LENGTH] = {0};
-            char frename_fname_dst[MAX_FOLDER_LENGTH] = {0};
-            COPY_AND_CHANGE_ENDIANESS_BLOCK16(origin, frename_fname_src, MAX_FOLDER_LENGTH);
-            COPY_AND_CHANGE_ENDIANESS_BLOCK16(origin + MAX_FOLDER_LENGTH, frename_fname_dst, MAX_FOLDER_LENGTH);
-            // DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
-            // get_local_full_pathname(frename_fname_src);
-            // get_local_full_pathname(frename_fname_dst);
-            // DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
-
-            char drive_src[3] = {0};
-            char folders_src[MAX_FOLDER_LENGTH] = {0};
-            char filePattern_src[MAX_FOLDER_LENGTH] = {0};
-            char drive_dst[3] = {0};
-            char folders_dst[MAX_FOLDER_LENGTH] = {0};
-            char filePattern_dst[MAX_FOLDER_LENGTH] = {0};
-            split_fullpath(frename_fname_src, drive_src, folders_src, filePattern_src);
-            DPRINTF("Drive: %s, Folders: %s, FilePattern: %s\n", drive_src, folders_src, filePattern_src);
-            split_fullpath(frename_fname_dst, drive_dst, folders_dst, filePattern_dst);
-            DPRINTF("Drive: %s, Folders: %s, FilePattern: %s\n", drive_dst, folders_dst, filePattern_dst);
-
-            if (strcasecmp(drive_src, drive_dst) != 0)
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FATTRIB_CALL:
+    {
+        uint16_t fattrib_flag = payloadPtr[0]; // d3 register
+        payloadPtr += 2;                       // Skip two words
+        // Obtain the new attributes, if FATTRIB_SET is set
+        uint16_t fattrib_new = payloadPtr[0]; // d4 register
+        payloadPtr += 4;                      // Skip four words
+        // Obtain the fname string and keep it in memory
+        // concatenated path and filename
+        char tmp_filepath[MAX_FOLDER_LENGTH] = {0};
+        get_local_full_pathname(tmp_filepath);
+        DPRINTF("Fattrib flag: %x, new attributes: %x\n", fattrib_flag, fattrib_new);
+        DPRINTF("Getting attributes of file: %s\n", tmp_filepath);
+
+        // Get the attributes of the file
+        FILINFO fno;
+        fr = f_stat(tmp_filepath, &fno);
+        if (fr != FR_OK)
+        {
+            DPRINTF("ERROR: Could not get file attributes (%d)\r\n", fr);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, GEMDOS_EFILNF);
+        }
+        else
+        {
+            uint32_t fattrib_st = attribs_fat2st(fno.fattrib);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, fattrib_st);
+            char fattrib_st_str[7] = "";
+            get_attribs_st_str(fattrib_st_str, fattrib_st);
+            if (fattrib_flag == FATTRIB_INQUIRE)
             {
-                DPRINTF("ERROR: Different drives\n");
-                *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
+                DPRINTF("File attributes: %s\n", fattrib_st_str);
             }
             else
             {
-                DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
-                get_local_full_pathname(frename_fname_src);
-                payloadPtr += MAX_FOLDER_LENGTH / 2; // MAX_FOLDER_LENGTH * 2 bytes per uint16_t
-                get_local_full_pathname(frename_fname_dst);
-                DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
-                // Rename the file
-                fr = f_rename(frename_fname_src, frename_fname_dst);
+                // WE will assume here FATTRIB_SET
+                // Set the attributes of the file
+                char fattrib_st_str[7] = "";
+                get_attribs_st_str(fattrib_st_str, fattrib_new);
+                DPRINTF("New file attributes: %s\n", fattrib_st_str);
+                BYTE fattrib_fatfs_new = (BYTE)attribs_st2fat(fattrib_new);
+                fr = f_chmod(tmp_filepath, fattrib_fatfs_new, AM_RDO | AM_HID | AM_SYS);
                 if (fr != FR_OK)
                 {
-                    DPRINTF("ERROR: Could not rename file (%d)\r\n", fr);
-                    if (fr == FR_DENIED)
-                    {
-                        DPRINTF("ERROR: Not enough premissions to rename file\n");
-                        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EACCDN);
-                    }
-                    else if (fr == FR_NO_PATH)
-                    {
-                        DPRINTF("ERROR: Folder does not exist\n");
-                        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
-                    }
-                    else if (fr == FR_NO_FILE)
-                    {
-                        DPRINTF("ERROR: File does not exist\n");
-                        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EFILNF);
-                    }
-                    else
-                    {
-                        DPRINTF("ERROR: Internal error\n");
-                        *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EINTRN);
-                    }
+                    DPRINTF("ERROR: Could not set file attributes (%d)\r\n", fr);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FATTRIB_STATUS, GEMDOS_EACCDN);
+                }
+            }
+        }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FRENAME_CALL:
+    {
+        payloadPtr += 6; // Skip six words
+        // Obtain the src name from the payload
+        char *origin = (char *)payloadPtr;
+        char frename_fname_src[MAX_FOLDER_LENGTH] = {0};
+        char frename_fname_dst[MAX_FOLDER_LENGTH] = {0};
+        COPY_AND_CHANGE_ENDIANESS_BLOCK16(origin, frename_fname_src, MAX_FOLDER_LENGTH);
+        COPY_AND_CHANGE_ENDIANESS_BLOCK16(origin + MAX_FOLDER_LENGTH, frename_fname_dst, MAX_FOLDER_LENGTH);
+        // DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
+        // get_local_full_pathname(frename_fname_src);
+        // get_local_full_pathname(frename_fname_dst);
+        // DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
+
+        char drive_src[3] = {0};
+        char folders_src[MAX_FOLDER_LENGTH] = {0};
+        char filePattern_src[MAX_FOLDER_LENGTH] = {0};
+        char drive_dst[3] = {0};
+        char folders_dst[MAX_FOLDER_LENGTH] = {0};
+        char filePattern_dst[MAX_FOLDER_LENGTH] = {0};
+        split_fullpath(frename_fname_src, drive_src, folders_src, filePattern_src);
+        DPRINTF("Drive: %s, Folders: %s, FilePattern: %s\n", drive_src, folders_src, filePattern_src);
+        split_fullpath(frename_fname_dst, drive_dst, folders_dst, filePattern_dst);
+        DPRINTF("Drive: %s, Folders: %s, FilePattern: %s\n", drive_dst, folders_dst, filePattern_dst);
+
+        if (strcasecmp(drive_src, drive_dst) != 0)
+        {
+            DPRINTF("ERROR: Different drives\n");
+            *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
+        }
+        else
+        {
+            DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
+            get_local_full_pathname(frename_fname_src);
+            payloadPtr += MAX_FOLDER_LENGTH / 2; // MAX_FOLDER_LENGTH * 2 bytes per uint16_t
+            get_local_full_pathname(frename_fname_dst);
+            DPRINTF("Renaming file: %s to %s\n", frename_fname_src, frename_fname_dst);
+            // Rename the file
+            fr = f_rename(frename_fname_src, frename_fname_dst);
+            if (fr != FR_OK)
+            {
+                DPRINTF("ERROR: Could not rename file (%d)\r\n", fr);
+                if (fr == FR_DENIED)
+                {
+                    DPRINTF("ERROR: Not enough premissions to rename file\n");
+                    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EACCDN);
+                }
+                else if (fr == FR_NO_PATH)
+                {
+                    DPRINTF("ERROR: Folder does not exist\n");
+                    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EPTHNF);
+                }
+                else if (fr == FR_NO_FILE)
+                {
+                    DPRINTF("ERROR: File does not exist\n");
+                    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EFILNF);
                 }
                 else
                 {
-                    DPRINTF("File renamed\n");
-                    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = GEMDOS_EOK;
+                    DPRINTF("ERROR: Internal error\n");
+                    *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = SWAP_LONGWORD(GEMDOS_EINTRN);
                 }
             }
+            else
+            {
+                DPRINTF("File renamed\n");
+                *((volatile uint32_t *)(memory_shared_address + GEMDRVEMUL_FRENAME_STATUS)) = GEMDOS_EOK;
+            }
+        }
 
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_FDATETIME_CALL:
+    {
+        uint16_t fdatetime_flag = payloadPtr[0]; // d3.w register
+        payloadPtr += 2;                         // Skip two words
+        // Obtain the file descriptor to change the date and time
+        uint16_t fdatetime_fd = payloadPtr[0]; // d4 register
+        payloadPtr += 2;                       // Skip two words
+        // Obtain the date and time to set
+        uint16_t date_dos = payloadPtr[0]; // d5 low register
+        uint16_t time_dos = payloadPtr[1]; // d5 high register
+        DPRINTF("Fdatetime flag: %x, fd: %x, time: %x, date: %x\n", fdatetime_flag, fdatetime_fd, time_dos, date_dos);
+
+        FileDescriptors *fd = get_file_by_fdesc(fdescriptors, fdatetime_fd);
+        if (fd == NULL)
+        {
+            DPRINTF("ERROR: File descriptor not found\n");
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EIHNDL);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
         }
-        case GEMDRVEMUL_FDATETIME_CALL:
+        else
         {
-            uint16_t fdatetime_flag = payloadPtr[0]; // d3.w register
-            payloadPtr += 2;                         // Skip two words
-            // Obtain the file descriptor to change the date and time
-            uint16_t fdatetime_fd = payloadPtr[0]; // d4 register
-            payloadPtr += 2;                       // Skip two words
-            // Obtain the date and time to set
-            uint16_t date_dos = payloadPtr[0]; // d5 low register
-            uint16_t time_dos = payloadPtr[1]; // d5 high register
-            DPRINTF("Fdatetime flag: %x, fd: %x, time: %x, date: %x\n", fdatetime_flag, fdatetime_fd, time_dos, date_dos);
-
-            FileDescriptors *fd = get_file_by_fdesc(fdescriptors, fdatetime_fd);
-            if (fd == NULL)
-            {
-                DPRINTF("ERROR: File descriptor not found\n");
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EIHNDL);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
-            }
-            else
+            if (fdatetime_flag == FDATETIME_INQUIRE)
             {
-                if (fdatetime_flag == FDATETIME_INQUIRE)
+                DPRINTF("Inquire file date and time: %s fd: %d\n", fd->fpath, fdatetime_fd);
+                FILINFO fno;
+                FRESULT fr;
+                fr = f_stat(fd->fpath, &fno);
+                if (fr == FR_OK)
                 {
-                    DPRINTF("Inquire file date and time: %s fd: %d\n", fd->fpath, fdatetime_fd);
-                    FILINFO fno;
-                    FRESULT fr;
-                    fr = f_stat(fd->fpath, &fno);
-                    if (fr == FR_OK)
-                    {
-                        // File information is now in fno
+                    // File information is now in fno
 #if defined(_DEBUG) && (_DEBUG != 0)
-                        // Save some memory and cycles if not in debug mode
-                        // Convert the date and time
-                        unsigned int year = (fno.fdate >> 9);
-                        unsigned int month = (fno.fdate >> 5) & 0x0F;
-                        unsigned int day = fno.fdate & 0x1F;
+                    // Save some memory and cycles if not in debug mode
+                    // Convert the date and time
+                    unsigned int year = (fno.fdate >> 9);
+                    unsigned int month = (fno.fdate >> 5) & 0x0F;
+                    unsigned int day = fno.fdate & 0x1F;
 
-                        unsigned int hour = fno.ftime >> 11;
-                        unsigned int minute = (fno.ftime >> 5) & 0x3F;
-                        unsigned int second = (fno.ftime & 0x1F);
+                    unsigned int hour = fno.ftime >> 11;
+                    unsigned int minute = (fno.ftime >> 5) & 0x3F;
+                    unsigned int second = (fno.ftime & 0x1F);
 
-                        DPRINTF("Get file date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
+                    DPRINTF("Get file date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
 #endif
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EOK);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, fno.fdate);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, fno.ftime);
-                    }
-                    else
-                    {
-                        DPRINTF("ERROR: Could not get file date and time from file %s (%d)\r\n", fd->fpath, fr);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EFILNF);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
-                    }
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EOK);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, fno.fdate);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, fno.ftime);
                 }
                 else
                 {
-                    DPRINTF("Modify file date and time: %s fd: %d\n", fd->fpath, fdatetime_fd);
+                    DPRINTF("ERROR: Could not get file date and time from file %s (%d)\r\n", fd->fpath, fr);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EFILNF);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
+                }
+            }
+            else
+            {
+                DPRINTF("Modify file date and time: %s fd: %d\n", fd->fpath, fdatetime_fd);
 #if defined(_DEBUG) && (_DEBUG != 0)
-                    // Save some memory and cycles if not in debug mode
-                    // Convert the date and time
-                    unsigned int year = (date_dos >> 9);
-                    unsigned int month = (date_dos >> 5) & 0x0F;
-                    unsigned int day = date_dos & 0x1F;
-
-                    unsigned int hour = time_dos >> 11;
-                    unsigned int minute = (time_dos >> 5) & 0x3F;
-                    unsigned int second = (time_dos & 0x1F);
-
-                    DPRINTF("Show in hex the values: %02x:%02x:%02x %02x/%02x/%02x\n", hour, minute, second, day, month, year);
-                    DPRINTF("File date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
+                // Save some memory and cycles if not in debug mode
+                // Convert the date and time
+                unsigned int year = (date_dos >> 9);
+                unsigned int month = (date_dos >> 5) & 0x0F;
+                unsigned int day = date_dos & 0x1F;
+
+                unsigned int hour = time_dos >> 11;
+                unsigned int minute = (time_dos >> 5) & 0x3F;
+                unsigned int second = (time_dos & 0x1F);
+
+                DPRINTF("Show in hex the values: %02x:%02x:%02x %02x/%02x/%02x\n", hour, minute, second, day, month, year);
+                DPRINTF("File date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
 #endif
-                    FILINFO fno;
-                    fno.fdate = date_dos;
-                    fno.ftime = time_dos;
-                    fr = f_utime(fd->fpath, &fno);
-                    if (fr == FR_OK)
-                    {
-                        // File exists and date and time set
-                        // So now we can return the status
-                        DPRINTF("Set the file date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EOK);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
-                    }
-                    else
-                    {
-                        DPRINTF("ERROR: Could not set file date and time to file %s (%d)\r\n", fd->fpath, fr);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EFILNF);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
-                    }
+                FILINFO fno;
+                fno.fdate = date_dos;
+                fno.ftime = time_dos;
+                fr = f_utime(fd->fpath, &fno);
+                if (fr == FR_OK)
+                {
+                    // File exists and date and time set
+                    // So now we can return the status
+                    DPRINTF("Set the file date and time: %02d:%02d:%02d %02d/%02d/%02d\n", hour, minute, second * 2, day, month, year + 1980);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EOK);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
+                }
+                else
+                {
+                    DPRINTF("ERROR: Could not set file date and time to file %s (%d)\r\n", fd->fpath, fr);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_STATUS, GEMDOS_EFILNF);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_DATE, 0);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_FDATETIME_TIME, 0);
                 }
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
 
-        case GEMDRVEMUL_READ_BUFF_CALL:
-        {
-            uint16_t readbuff_fd = payloadPtr[0];                                                      // d3 register
-            payloadPtr += 2;                                                                           // Skip two words
-            uint32_t readbuff_bytes_to_read = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];         // d4 register constains the number of bytes to read
-            payloadPtr += 2;                                                                           // Skip two words
-            uint32_t readbuff_pending_bytes_to_read = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register constains the number of bytes to read
-            DPRINTF("Read buffering file with fd: x%x, bytes_to_read: x%08x, pending_bytes_to_read: x%08x\n", readbuff_fd, readbuff_bytes_to_read, readbuff_pending_bytes_to_read);
-            // Show open files
+    case GEMDRVEMUL_READ_BUFF_CALL:
+    {
+        uint16_t readbuff_fd = payloadPtr[0];                                                      // d3 register
+        payloadPtr += 2;                                                                           // Skip two words
+        uint32_t readbuff_bytes_to_read = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];         // d4 register constains the number of bytes to read
+        payloadPtr += 2;                                                                           // Skip two words
+        uint32_t readbuff_pending_bytes_to_read = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register constains the number of bytes to read
+        DPRINTF("Read buffering file with fd: x%x, bytes_to_read: x%08x, pending_bytes_to_read: x%08x\n", readbuff_fd, readbuff_bytes_to_read, readbuff_pending_bytes_to_read);
+        // Show open files
 #if defined(_DEBUG) && (_DEBUG != 0)
-            print_file_descriptors(fdescriptors);
+        print_file_descriptors(fdescriptors);
 #endif
-            // Obtain the file descriptor
-            FileDescriptors *file = get_file_by_fdesc(fdescriptors, readbuff_fd);
-            if (file == NULL)
+        // Obtain the file descriptor
+        FileDescriptors *file = get_file_by_fdesc(fdescriptors, readbuff_fd);
+        if (file == NULL)
+        {
+            DPRINTF("ERROR: File descriptor not found\n");
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, GEMDOS_EIHNDL);
+        }
+        else
+        {
+            uint32_t readbuff_offset = file->offset;
+            UINT bytes_read = 0;
+            // Read the file with FatFs
+            fr = f_lseek(&file->fobject, readbuff_offset);
+            if (fr != FR_OK)
             {
-                DPRINTF("ERROR: File descriptor not found\n");
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, GEMDOS_EIHNDL);
+                DPRINTF("ERROR: Could not change read offset of the file (%d)\r\n", fr);
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, GEMDOS_EINTRN);
             }
             else
             {
-                uint32_t readbuff_offset = file->offset;
-                UINT bytes_read = 0;
-                // Read the file with FatFs
-                fr = f_lseek(&file->fobject, readbuff_offset);
+                // Only read DEFAULT_FOPEN_READ_BUFFER_SIZE bytes at a time
+                uint16_t buff_size = readbuff_pending_bytes_to_read > DEFAULT_FOPEN_READ_BUFFER_SIZE ? DEFAULT_FOPEN_READ_BUFFER_SIZE : readbuff_pending_bytes_to_read;
+                DPRINTF("Reading x%x bytes from the file at offset x%x\n", buff_size, readbuff_offset);
+                if (buff_size < DEFAULT_FOPEN_READ_BUFFER_SIZE) {
+                    memset((void *)(memory_shared_address + GEMDRVEMUL_READ_BUFF), 0, DEFAULT_FOPEN_READ_BUFFER_SIZE);
+                }
+                fr = f_read(&file->fobject, (void *)(memory_shared_address + GEMDRVEMUL_READ_BUFF), buff_size, &bytes_read);
                 if (fr != FR_OK)
                 {
-                    DPRINTF("ERROR: Could not change read offset of the file (%d)\r\n", fr);
+                    DPRINTF("ERROR: Could not read file (%d)\r\n", fr);
                     WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, GEMDOS_EINTRN);
                 }
                 else
                 {
-                    // Only read DEFAULT_FOPEN_READ_BUFFER_SIZE bytes at a time
-                    uint16_t buff_size = readbuff_pending_bytes_to_read > DEFAULT_FOPEN_READ_BUFFER_SIZE ? DEFAULT_FOPEN_READ_BUFFER_SIZE : readbuff_pending_bytes_to_read;
-                    DPRINTF("Reading x%x bytes from the file at offset x%x\n", buff_size, readbuff_offset);
-                    if (buff_size < DEFAULT_FOPEN_READ_BUFFER_SIZE) {
-                        memset((void *)(memory_shared_address + GEMDRVEMUL_READ_BUFF), 0, DEFAULT_FOPEN_READ_BUFFER_SIZE);
-                    }
-                    fr = f_read(&file->fobject, (void *)(memory_shared_address + GEMDRVEMUL_READ_BUFF), buff_size, &bytes_read);
-                    if (fr != FR_OK)
-                    {
-                        DPRINTF("ERROR: Could not read file (%d)\r\n", fr);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, GEMDOS_EINTRN);
-                    }
-                    else
-                    {
-                        // Update the offset of the file
-                        file->offset += bytes_read;
-                        uint32_t current_offset = file->offset;
-                        DPRINTF("New offset: x%x after reading x%x bytes\n", current_offset, bytes_read);
-                        // Change the endianness of the bytes read
-                        CHANGE_ENDIANESS_BLOCK16(memory_shared_address + GEMDRVEMUL_READ_BUFF, buff_size + (buff_size % 2));
-                        // Return the number of bytes read
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, (uint32_t)bytes_read);
-                    }
+                    // Update the offset of the file
+                    file->offset += bytes_read;
+                    uint32_t current_offset = file->offset;
+                    DPRINTF("New offset: x%x after reading x%x bytes\n", current_offset, bytes_read);
+                    // Change the endianness of the bytes read
+                    CHANGE_ENDIANESS_BLOCK16(memory_shared_address + GEMDRVEMUL_READ_BUFF, buff_size + (buff_size % 2));
+                    // Return the number of bytes read
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_READ_BYTES, (uint32_t)bytes_read);
                 }
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_WRITE_BUFF_CALL:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_WRITE_BUFF_CALL:
+    {
+        uint16_t writebuff_fd = payloadPtr[0];                                                       // d3 register
+        payloadPtr += 2;                                                                             // Skip two words
+        uint32_t writebuff_bytes_to_write = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];         // d4 register constains the number of bytes to write
+        payloadPtr += 2;                                                                             // Skip two words
+        uint32_t writebuff_pending_bytes_to_write = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register constains the number of bytes to write
+        payloadPtr += 2;
+        DPRINTF("Write buffering file with fd: x%x, bytes_to_write: x%08x, pending_bytes_to_write: x%08x\n", writebuff_fd, writebuff_bytes_to_write, writebuff_pending_bytes_to_write);
+        // Obtain the file descriptor
+        FileDescriptors *file = get_file_by_fdesc(fdescriptors, writebuff_fd);
+        if (file == NULL)
         {
-            uint16_t writebuff_fd = payloadPtr[0];                                                       // d3 register
-            payloadPtr += 2;                                                                             // Skip two words
-            uint32_t writebuff_bytes_to_write = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];         // d4 register constains the number of bytes to write
-            payloadPtr += 2;                                                                             // Skip two words
-            uint32_t writebuff_pending_bytes_to_write = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d5 register constains the number of bytes to write
-            payloadPtr += 2;
-            DPRINTF("Write buffering file with fd: x%x, bytes_to_write: x%08x, pending_bytes_to_write: x%08x\n", writebuff_fd, writebuff_bytes_to_write, writebuff_pending_bytes_to_write);
-            // Obtain the file descriptor
-            FileDescriptors *file = get_file_by_fdesc(fdescriptors, writebuff_fd);
-            if (file == NULL)
+            DPRINTF("ERROR: File descriptor not found\n");
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, GEMDOS_EIHNDL);
+        }
+        else
+        {
+            uint32_t writebuff_offset = file->offset;
+            UINT bytes_write = 0;
+            // Reposition the file pointer with FatFs
+            fr = f_lseek(&file->fobject, writebuff_offset);
+            if (fr != FR_OK)
             {
-                DPRINTF("ERROR: File descriptor not found\n");
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, GEMDOS_EIHNDL);
+                DPRINTF("ERROR: Could not change write offset of the file (%d)\r\n", fr);
+                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, GEMDOS_EINTRN);
             }
             else
             {
-                uint32_t writebuff_offset = file->offset;
-                UINT bytes_write = 0;
-                // Reposition the file pointer with FatFs
-                fr = f_lseek(&file->fobject, writebuff_offset);
+                // Only write DEFAULT_FWRITE_BUFFER_SIZE bytes at a time
+                uint16_t buff_size = writebuff_pending_bytes_to_write > DEFAULT_FWRITE_BUFFER_SIZE ? DEFAULT_FWRITE_BUFFER_SIZE : writebuff_pending_bytes_to_write;
+                // Transform buffer's words from little endian to big endian inline
+                uint16_t *target = payloadPtr;
+                // Calculate the checksum of the buffer
+                // Use a 16 bit checksum to minimize the number of loops
+                uint16_t chk = 0;
+                UINT words_to_write = (DEFAULT_FWRITE_BUFFER_SIZE) / 2;
+                UINT pending_bytes = (DEFAULT_FWRITE_BUFFER_SIZE) % 2;
+                uint16_t *target16 = (uint16_t *)target;
+                for (int i = 0; i < words_to_write; i++)
+                {
+                    // Swap the order of the bytes in target16
+                    chk += target16[i];
+                }
+                DPRINTF("Checksum: x%x\n", chk);
+                if (pending_bytes > 0)
+                {
+                    uint16_t pending_long_word = target16[words_to_write];
+                    chk += pending_long_word & (0x00FF << (pending_bytes * 8));
+                }
+                // Change the endianness of the bytes read
+                CHANGE_ENDIANESS_BLOCK16(target, buff_size + (buff_size % 2));
+                // Write the bytes
+                DPRINTF("Write x%x bytes from the file at offset x%x\n", buff_size, writebuff_offset);
+                fr = f_write(&file->fobject, (void *)target, buff_size, &bytes_write);
                 if (fr != FR_OK)
                 {
-                    DPRINTF("ERROR: Could not change write offset of the file (%d)\r\n", fr);
+                    DPRINTF("ERROR: Could not write file (%d)\r\n", fr);
                     WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, GEMDOS_EINTRN);
                 }
                 else
                 {
-                    // Only write DEFAULT_FWRITE_BUFFER_SIZE bytes at a time
-                    uint16_t buff_size = writebuff_pending_bytes_to_write > DEFAULT_FWRITE_BUFFER_SIZE ? DEFAULT_FWRITE_BUFFER_SIZE : writebuff_pending_bytes_to_write;
-                    // Transform buffer's words from little endian to big endian inline
-                    uint16_t *target = payloadPtr;
-                    // Calculate the checksum of the buffer
-                    // Use a 16 bit checksum to minimize the number of loops
-                    uint16_t chk = 0;
-                    UINT words_to_write = (DEFAULT_FWRITE_BUFFER_SIZE) / 2;
-                    UINT pending_bytes = (DEFAULT_FWRITE_BUFFER_SIZE) % 2;
-                    uint16_t *target16 = (uint16_t *)target;
-                    for (int i = 0; i < words_to_write; i++)
-                    {
-                        // Swap the order of the bytes in target16
-                        chk += target16[i];
-                    }
-                    DPRINTF("Checksum: x%x\n", chk);
-                    if (pending_bytes > 0)
-                    {
-                        uint16_t pending_long_word = target16[words_to_write];
-                        chk += pending_long_word & (0x00FF << (pending_bytes * 8));
-                    }
-                    // Change the endianness of the bytes read
-                    CHANGE_ENDIANESS_BLOCK16(target, buff_size + (buff_size % 2));
-                    // Write the bytes
-                    DPRINTF("Write x%x bytes from the file at offset x%x\n", buff_size, writebuff_offset);
-                    fr = f_write(&file->fobject, (void *)target, buff_size, &bytes_write);
-                    if (fr != FR_OK)
-                    {
-                        DPRINTF("ERROR: Could not write file (%d)\r\n", fr);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, GEMDOS_EINTRN);
-                    }
-                    else
-                    {
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CHK, (uint32_t)chk);
-                        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, bytes_write);
-                    }
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CHK, (uint32_t)chk);
+                    WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_BYTES, bytes_write);
                 }
             }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
         }
-        case GEMDRVEMUL_WRITE_BUFF_CHECK:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_WRITE_BUFF_CHECK:
+    {
+        uint16_t writebuff_fd = payloadPtr[0];                                              // d3 register
+        payloadPtr += 2;                                                                    // Skip two words
+        uint32_t writebuff_forward_bytes = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register constains the number of bytes to forward the offset
+        DPRINTF("Write buffering confirm fd: x%x, forward: x%08x\n", writebuff_fd, writebuff_forward_bytes);
+        // Obtain the file descriptor
+        FileDescriptors *file = get_file_by_fdesc(fdescriptors, writebuff_fd);
+        if (file == NULL)
         {
-            uint16_t writebuff_fd = payloadPtr[0];                                              // d3 register
-            payloadPtr += 2;                                                                    // Skip two words
-            uint32_t writebuff_forward_bytes = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register constains the number of bytes to forward the offset
-            DPRINTF("Write buffering confirm fd: x%x, forward: x%08x\n", writebuff_fd, writebuff_forward_bytes);
-            // Obtain the file descriptor
-            FileDescriptors *file = get_file_by_fdesc(fdescriptors, writebuff_fd);
-            if (file == NULL)
-            {
-                DPRINTF("ERROR: File descriptor not found\n");
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CONFIRM_STATUS, GEMDOS_EIHNDL);
-            }
-            else
-            {
-                // Update the offset of the file
-                file->offset += writebuff_forward_bytes;
-                uint32_t current_offset = file->offset;
-                DPRINTF("New offset: x%x after writing x%x bytes\n", current_offset, writebuff_forward_bytes);
-                WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CONFIRM_STATUS, GEMDOS_EOK);
-            }
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            DPRINTF("ERROR: File descriptor not found\n");
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CONFIRM_STATUS, GEMDOS_EIHNDL);
         }
-        case GEMDRVEMUL_PEXEC_CALL:
-        {
-            uint16_t pexec_mode = payloadPtr[0];                                         // d3 register
-            payloadPtr += 2;                                                             // Skip 2 words
-            uint32_t pexec_stack_addr = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
-            payloadPtr += 2;                                                             // Skip 2 words
-            uint32_t pexec_fname = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];      // d5 register
-            payloadPtr += 2;                                                             // Skip 2 words
-            uint32_t pexec_cmdline = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];    // d6 register
-            payloadPtr += 2;                                                             // Skip 2 words
-            uint32_t pexec_envstr = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];     // d7 register
-            DPRINTF("Pexec mode: %x\n", pexec_mode);
-            DPRINTF("Pexec stack addr: %x\n", pexec_stack_addr);
-            DPRINTF("Pexec fname: %x\n", pexec_fname);
-            DPRINTF("Pexec cmdline: %x\n", pexec_cmdline);
-            DPRINTF("Pexec envstr: %x\n", pexec_envstr);
-            *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PEXEC_MODE)) = pexec_mode;
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_STACK_ADDR, pexec_stack_addr);
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_FNAME, pexec_fname);
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_CMDLINE, pexec_cmdline);
-            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_ENVSTR, pexec_envstr);
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+        else
+        {
+            // Update the offset of the file
+            file->offset += writebuff_forward_bytes;
+            uint32_t current_offset = file->offset;
+            DPRINTF("New offset: x%x after writing x%x bytes\n", current_offset, writebuff_forward_bytes);
+            WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_WRITE_CONFIRM_STATUS, GEMDOS_EOK);
         }
-        case GEMDRVEMUL_SAVE_BASEPAGE:
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_PEXEC_CALL:
+    {
+        uint16_t pexec_mode = payloadPtr[0];                                         // d3 register
+        payloadPtr += 2;                                                             // Skip 2 words
+        uint32_t pexec_stack_addr = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0]; // d4 register
+        payloadPtr += 2;                                                             // Skip 2 words
+        uint32_t pexec_fname = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];      // d5 register
+        payloadPtr += 2;                                                             // Skip 2 words
+        uint32_t pexec_cmdline = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];    // d6 register
+        payloadPtr += 2;                                                             // Skip 2 words
+        uint32_t pexec_envstr = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];     // d7 register
+        DPRINTF("Pexec mode: %x\n", pexec_mode);
+        DPRINTF("Pexec stack addr: %x\n", pexec_stack_addr);
+        DPRINTF("Pexec fname: %x\n", pexec_fname);
+        DPRINTF("Pexec cmdline: %x\n", pexec_cmdline);
+        DPRINTF("Pexec envstr: %x\n", pexec_envstr);
+        *((volatile uint16_t *)(memory_shared_address + GEMDRVEMUL_PEXEC_MODE)) = pexec_mode;
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_STACK_ADDR, pexec_stack_addr);
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_FNAME, pexec_fname);
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_CMDLINE, pexec_cmdline);
+        WRITE_AND_SWAP_LONGWORD(memory_shared_address, GEMDRVEMUL_PEXEC_ENVSTR, pexec_envstr);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_SAVE_BASEPAGE:
+    {
+        payloadPtr += 6; // Skip eight words
+        // Copy the from the shared memory the basepagea está to pexec_pd
+        DPRINTF("Saving basepage\n");
+        PD *origin = (PD *)(payloadPtr);
+        // Reserve and copy the memory from origin to pexec_pd
+        if (pexec_pd == NULL)
         {
-            payloadPtr += 6; // Skip eight words
-            // Copy the from the shared memory the basepagea está to pexec_pd
-            DPRINTF("Saving basepage\n");
-            PD *origin = (PD *)(payloadPtr);
-            // Reserve and copy the memory from origin to pexec_pd
-            if (pexec_pd == NULL)
-            {
-                pexec_pd = (PD *)(memory_shared_address + GEMDRVEMUL_EXEC_PD);
-            }
-            memcpy(pexec_pd, origin, sizeof(PD));
-            DPRINTF("pexec_pd->p_lowtpa: %x\n", SWAP_LONGWORD(pexec_pd->p_lowtpa));
-            DPRINTF("pexec_pd->p_hitpa: %x\n", SWAP_LONGWORD(pexec_pd->p_hitpa));
-            DPRINTF("pexec_pd->p_tbase: %x\n", SWAP_LONGWORD(pexec_pd->p_tbase));
-            DPRINTF("pexec_pd->p_tlen: %x\n", SWAP_LONGWORD(pexec_pd->p_tlen));
-            DPRINTF("pexec_pd->p_dbase: %x\n", SWAP_LONGWORD(pexec_pd->p_dbase));
-            DPRINTF("pexec_pd->p_dlen: %x\n", SWAP_LONGWORD(pexec_pd->p_dlen));
-            DPRINTF("pexec_pd->p_bbase: %x\n", SWAP_LONGWORD(pexec_pd->p_bbase));
-            DPRINTF("pexec_pd->p_blen: %x\n", SWAP_LONGWORD(pexec_pd->p_blen));
-            DPRINTF("pexec_pd->p_xdta: %x\n", SWAP_LONGWORD(pexec_pd->p_xdta));
-            DPRINTF("pexec_pd->p_parent: %x\n", SWAP_LONGWORD(pexec_pd->p_parent));
-            DPRINTF("pexec_pd->p_hflags: %x\n", SWAP_LONGWORD(pexec_pd->p_hflags));
-            DPRINTF("pexec_pd->p_env: %x\n", SWAP_LONGWORD(pexec_pd->p_env));
-            DPRINTF("pexec_pd->p_1fill\n");
-            DPRINTF("pexec_pd->p_curdrv: %x\n", SWAP_LONGWORD(pexec_pd->p_curdrv));
-            DPRINTF("pexec_pd->p_uftsize: %x\n", SWAP_LONGWORD(pexec_pd->p_uftsize));
-            DPRINTF("pexec_pd->p_uft: %x\n", SWAP_LONGWORD(pexec_pd->p_uft));
-            DPRINTF("pexec_pd->p_cmdlin: %x\n", SWAP_LONGWORD(pexec_pd->p_cmdlin));
-            write_random_token(memory_shared_address);
-            active_command_id = 0xFFFF;
-            break;
+            pexec_pd = (PD *)(memory_shared_address + GEMDRVEMUL_EXEC_PD);
         }
-        case GEMDRVEMUL_SAVE_EXEC_HEADER:
+        memcpy(pexec_pd, origin, sizeof(PD));
+        DPRINTF("pexec_pd->p_lowtpa: %x\n", SWAP_LONGWORD(pexec_pd->p_lowtpa));
+        DPRINTF("pexec_pd->p_hitpa: %x\n", SWAP_LONGWORD(pexec_pd->p_hitpa));
+        DPRINTF("pexec_pd->p_tbase: %x\n", SWAP_LONGWORD(pexec_pd->p_tbase));
+        DPRINTF("pexec_pd->p_tlen: %x\n", SWAP_LONGWORD(pexec_pd->p_tlen));
+        DPRINTF("pexec_pd->p_dbase: %x\n", SWAP_LONGWORD(pexec_pd->p_dbase));
+        DPRINTF("pexec_pd->p_dlen: %x\n", SWAP_LONGWORD(pexec_pd->p_dlen));
+        DPRINTF("pexec_pd->p_bbase: %x\n", SWAP_LONGWORD(pexec_pd->p_bbase));
+        DPRINTF("pexec_pd->p_blen: %x\n", SWAP_LONGWORD(pexec_pd->p_blen));
+        DPRINTF("pexec_pd->p_xdta: %x\n", SWAP_LONGWORD(pexec_pd->p_xdta));
+        DPRINTF("pexec_pd->p_parent: %x\n", SWAP_LONGWORD(pexec_pd->p_parent));
+        DPRINTF("pexec_pd->p_hflags: %x\n", SWAP_LONGWORD(pexec_pd->p_hflags));
+        DPRINTF("pexec_pd->p_env: %x\n", SWAP_LONGWORD(pexec_pd->p_env));
+        DPRINTF("pexec_pd->p_1fill\n");
+        DPRINTF("pexec_pd->p_curdrv: %x\n", SWAP_LONGWORD(pexec_pd->p_curdrv));
+        DPRINTF("pexec_pd->p_uftsize: %x\n", SWAP_LONGWORD(pexec_pd->p_uftsize));
+        DPRINTF("pexec_pd->p_uft: %x\n", SWAP_LONGWORD(pexec_pd->p_uft));
+        DPRINTF("pexec_pd->p_cmdlin: %x\n", SWAP_LONGWORD(pexec_pd->p_cmdlin));
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    case GEMDRVEMUL_SAVE_EXEC_HEADER:
+    {
+        payloadPtr += 6; // Skip eight words
+        // Copy the from the shared memory the basepage to pexec_exec_header
+        DPRINTF("Saving exec header\n");
+        ExecHeader *origin = (ExecHeader *)(payloadPtr);
+        // Reserve and copy the memory from origin to pexec_exec_header
+        if (pexec_exec_header == NULL)
         {
-            payloadPtr += 6; // Skip eight words
-            // Copy the from the shared memory the basepage to pexec_exec_header
-            DPRINTF("Saving exec header\n");
-            ExecHeader *origin = (ExecHeader *)(payloadPtr);
-            // Reserve and copy the memory from origin to pexec_exec_header
-            if (pexec_exec_header == NULL)
-            {
-                pexec_exec_header = (ExecHeader *)(memory_shared_address + GEMDRVEMUL_EXEC_HEADER);
-            }
-            memcpy(pexec_exec_header, origin, sizeof(ExecHeader));
-            DPRINTF("pexec_exec->magic: %x\n", pexec_exec_header->magic);
-            DPRINTF("pexec_exec->text: %x\n", (uint32_t)(pexec_exec_header->text_h << 16 | pexec_exec_header->text_l));
-            DPRINTF("pexec_exec->data: %x\n", (uint32_t)(pexec_exec_header->data_h << 16 | pexec_exec_header->data_l));
-            DPRINTF("pexec_exec->bss: %x\n", (uint32_t)(pexec_exec_header->bss_h << 16 | pexec_exec_header->bss_l));
-            DPRINTF("pexec_exec->syms: %x\n", (uint32_t)(pexec_exec_header->syms_h << 16 | pexec_exec_header->syms_l));
-            DPRINTF("pexec_exec->reserved1: %x\n", (uint32_t)(pexec_exec_header->reserved1_h << 16 | pexec_exec_header->reserved1_l));
-            DPRINTF("pexec_exec->prgflags: %x\n", (uint32_t)(pexec_exec_header->prgflags_h << 16 | pexec_exec_header->prgflags_l));
-            DPRINTF("pexec_exec->absflag: %x\n", pexec_exec_header->absflag);
+            pexec_exec_header = (ExecHeader *)(memory_shared_address + GEMDRVEMUL_EXEC_HEADER);
+        }
+        memcpy(pexec_exec_header, origin, sizeof(ExecHeader));
+        DPRINTF("pexec_exec->magic: %x\n", pexec_exec_header->magic);
+        DPRINTF("pexec_exec->text: %x\n", (uint32_t)(pexec_exec_header->text_h << 16 | pexec_exec_header->text_l));
+        DPRINTF("pexec_exec->data: %x\n", (uint32_t)(pexec_exec_header->data_h << 16 | pexec_exec_header->data_l));
+        DPRINTF("pexec_exec->bss: %x\n", (uint32_t)(pexec_exec_header->bss_h << 16 | pexec_exec_header->bss_l));
+        DPRINTF("pexec_exec->syms: %x\n", (uint32_t)(pexec_exec_header->syms_h << 16 | pexec_exec_header->syms_l));
+        DPRINTF("pexec_exec->reserved1: %x\n", (uint32_t)(pexec_exec_header->reserved1_h << 16 | pexec_exec_header->reserved1_l));
+        DPRINTF("pexec_exec->prgflags: %x\n", (uint32_t)(pexec_exec_header->prgflags_h << 16 | pexec_exec_header->prgflags_l));
+        DPRINTF("pexec_exec->absflag: %x\n", pexec_exec_header->absflag);
+        write_random_token(memory_shared_address);
+        active_command_id = 0xFFFF;
+        break;
+    }
+    default:
+    {
+        if (command_id != 0xFFFF)
+        {
+            DPRINTF("ERROR: Unknown command: %x\n", command_id);
+            uint32_t d3 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+            DPRINTF("DEBUG: %x\n", d3);
+            payloadPtr += 2;
+            uint32_t d4 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+            DPRINTF("DEBUG: %x\n", d4);
+            payloadPtr += 2;
+            uint32_t d5 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
+            DPRINTF("DEBUG: %x\n", d5);
+            payloadPtr += 2;
+            uint8_t *payloadShowBytesPtr = (uint8_t *)payloadPtr;
+            print_payload(payloadShowBytesPtr);
             write_random_token(memory_shared_address);
             active_command_id = 0xFFFF;
             break;
         }
-        default:
-        {
-            if (active_command_id != 0xFFFF)
-            {
-                DPRINTF("ERROR: Unknown command: %x\n", active_command_id);
-                uint32_t d3 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-                DPRINTF("DEBUG: %x\n", d3);
-                payloadPtr += 2;
-                uint32_t d4 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-                DPRINTF("DEBUG: %x\n", d4);
-                payloadPtr += 2;
-                uint32_t d5 = ((uint32_t)payloadPtr[1] << 16) | payloadPtr[0];
-                DPRINTF("DEBUG: %x\n", d5);
-                payloadPtr += 2;
-                uint8_t *payloadShowBytesPtr = (uint8_t *)payloadPtr;
-                print_payload(payloadShowBytesPtr);
-                write_random_token(memory_shared_address);
-                active_command_id = 0xFFFF;
-                break;
-            }
-        }
-        }
+    }
+    }
+    if (command_id != 0xFFFF)
+    {
+        // The random token is written, the ST is not waiting anymore
+        cmdstats_record(command_id, command_start_us);
+    }
+    if (usb_shared && (command_id != 0xFFFF))
+    {
+        usb_shared_end(command_write);
+    }
+    if (command_id != 0xFFFF)
+    {
+        TRACE(TRACE_GEMDRIVE_END, command_id, 0, 0);
+    }
 // Fully bypass the print variables
 #if defined(_DEBUG) && (_DEBUG != 0)
-        // if (old_command != 0xFFFF)
-        // {
-        //     print_variables(memory_shared_address);
-        // }
+    // if (old_command != 0xFFFF)
+    // {
+    //     print_variables(memory_shared_address);
+    // }
 #endif
-        // If SELECT button is pressed, launch the configurator
-        if (gpio_get(SELECT_GPIO) != 0)
-        {
-            select_button_action(safe_config_reboot, write_config_only_once);
-            // Write config only once to avoid hitting the flash too much
-            write_config_only_once = false;
-        }
+    // If SELECT button is pressed, launch the configurator
+    if (gpio_get(SELECT_GPIO) != 0)
+    {
+        select_button_action(select_safe_config_reboot, write_config_only_once);
+        // Write config only once to avoid hitting the flash too much
+        write_config_only_once = false;
+    }
+}
+
+void init_gemdrvemul(bool safe_config_reboot)
+{
+    gemdrvemul_setup(safe_config_reboot);
+    while (true)
+    {
+        gemdrvemul_poll();
     }
 }
@@ -55,6 +55,313 @@ void httpd_server_init(const char *ssi_tags[], size_t num_tags, tSSIHandler ssi_
     DPRINTF("HTTP server initialized.\n");
 }
 
+// Only one upload at a time. The body is staged in cluster sized blocks and each block is
+// acknowledged to the browser only after it is written, so the SD card paces the upload
+typedef struct
+{
+    bool active;
+    void *connection;
+    FIL file;
+    DownloadSink sink;
+    MsaDecoder msa;
+    bool msa_convert;
+    uint8_t *buffer;
+    uint32_t content_len;
+    uint32_t received;
+    uint32_t crc;
+    uint32_t expected_crc;
+    bool failed;
+    uint64_t last_activity_us;
+    char path[HTTPD_UPLOAD_MAX_PATH];
+} HttpdUpload;
+
+static HttpdUpload upload = {0};
+static uint32_t upload_count = 0;
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Copy the URL decoded value of a parameter of the query string. Returns false if it is not found or too long
+static bool get_query_param(const char *uri, const char *key, char *value, size_t size)
+{
+    const char *query = strchr(uri, '?');
+    size_t key_length = strlen(key);
+    while (query != NULL)
+    {
+        query++;
+        if ((strncmp(query, key, key_length) == 0) && (query[key_length] == '='))
+        {
+            const char *src = query + key_length + 1;
+            size_t pos = 0;
+            while ((*src != '\0') && (*src != '&') && (*src != ' '))
+            {
+                if (pos == size - 1)
+                {
+                    return false;
+                }
+                char c = *src++;
+                if (c == '+')
+                {
+                    c = ' ';
+                }
+                else if ((c == '%') && (hex_value(src[0]) >= 0) && (hex_value(src[1]) >= 0))
+                {
+                    c = (char)((hex_value(src[0]) << 4) | hex_value(src[1]));
+                    src += 2;
+                }
+                value[pos++] = c;
+            }
+            value[pos] = '\0';
+            return true;
+        }
+        query = strchr(query, '&');
+    }
+    return false;
+}
+
+static bool upload_write_file(void *arg, const uint8_t *data, uint32_t size)
+{
+    UINT bytes_written;
+    FRESULT fr = f_write((FIL *)arg, data, size, &bytes_written);
+    return (fr == FR_OK) && (bytes_written == size);
+}
+
+static bool upload_persist_file(void *arg, uint8_t *data, uint32_t size)
+{
+    return upload_write_file(arg, data, size);
+}
+
+static bool upload_persist_msa(void *arg, uint8_t *data, uint32_t size)
+{
+    return msa_decoder_feed((MsaDecoder *)arg, data, size);
+}
+
+// Close the file and free the buffer of the upload in progress. The file is deleted if it is not complete
+static void upload_release(bool keep_file)
+{
+    if (upload.msa_convert)
+    {
+        msa_decoder_finish(&upload.msa);
+    }
+    f_close(&upload.file);
+    if (!keep_file)
+    {
+        f_unlink(upload.path);
+    }
+    free(upload.buffer);
+    upload.buffer = NULL;
+    upload.active = false;
+    upload.connection = NULL;
+}
+
+// httpd calls httpd_post_finished() when it closes a connection with a POST in progress, after
+// a FIN or too many idle polls. It does not when the connection is reset or fails: the upload
+// is then released when it has been idle for HTTPD_UPLOAD_TIMEOUT_MS
+void httpd_upload_poll(void)
+{
+    if (upload.active && (time_us_64() - upload.last_activity_us > (uint64_t)HTTPD_UPLOAD_TIMEOUT_MS * 1000))
+    {
+        DPRINTF("Upload of %s abandoned\n", upload.path);
+        upload_release(false);
+        dircache_invalidate(NULL);
+    }
+}
+
+static void upload_response(char *response_uri, u16_t response_uri_len, const char *uri)
+{
+    snprintf(response_uri, response_uri_len, "%s", uri);
+}
+
+err_t httpd_post_begin(void *connection, const char *uri, const char *http_request,
+                       u16_t http_request_len, int content_len, char *response_uri,
+                       u16_t response_uri_len, u8_t *post_auto_wnd)
+{
+    size_t uri_length = strlen(HTTPD_UPLOAD_URI);
+    if ((strncmp(uri, HTTPD_UPLOAD_URI, uri_length) != 0) || ((uri[uri_length] != '?') && (uri[uri_length] != '\0')))
+    {
+        return ERR_VAL;
+    }
+    httpd_upload_poll();
+    if (upload.active)
+    {
+        DPRINTF("Upload rejected. Another upload is in progress\n");
+        upload_response(response_uri, response_uri_len, "/api/upload_busy.json");
+        return ERR_VAL;
+    }
+    upload_response(response_uri, response_uri_len, "/api/upload_failed.json");
+
+    char folder[16];
+    char name[HTTPD_UPLOAD_MAX_NAME];
+    char crc[16];
+    char msa[4];
+    if (!get_query_param(uri, "folder", folder, sizeof(folder)) ||
+        !get_query_param(uri, "name", name, sizeof(name)) ||
+        !get_query_param(uri, "crc", crc, sizeof(crc)) ||
+        (content_len <= 0))
+    {
+        DPRINTF("Upload rejected. Missing parameters or content length\n");
+        return ERR_VAL;
+    }
+    ConfigEntry *entry = NULL;
+    if (strcmp(folder, "floppies") == 0)
+    {
+        entry = find_entry(PARAM_FLOPPIES_FOLDER);
+    }
+    else if (strcmp(folder, "roms") == 0)
+    {
+        entry = find_entry(PARAM_ROMS_FOLDER);
+    }
+    if ((entry == NULL) || (name[0] == '\0') || (strchr(name, '/') != NULL) || (strchr(name, '\\') != NULL) || (strstr(name, "..") != NULL))
+    {
+        DPRINTF("Upload rejected. Bad folder or file name: %s, %s\n", folder, name);
+        return ERR_VAL;
+    }
+    char *crc_end;
+    upload.expected_crc = strtoul(crc, &crc_end, 16);
+    if ((crc[0] == '\0') || (*crc_end != '\0'))
+    {
+        DPRINTF("Upload rejected. Bad CRC32: %s\n", crc);
+        return ERR_VAL;
+    }
+
+    // MSA images are decoded while they are received and saved with the ST extension
+    upload.msa_convert = get_query_param(uri, "msa", msa, sizeof(msa)) && (strcmp(msa, "1") == 0);
+    if (upload.msa_convert)
+    {
+        char *extension = strrchr(name, '.');
+        if ((extension != NULL) && (strcasecmp(extension, ".msa") == 0))
+        {
+            *extension = '\0';
+        }
+        if (strlen(name) + 3 >= sizeof(name))
+        {
+            return ERR_VAL;
+        }
+        strcat(name, ".st");
+    }
+    if (snprintf(upload.path, sizeof(upload.path), "%s/%s", entry->value, name) >= sizeof(upload.path))
+    {
+        DPRINTF("Upload rejected. Path too long\n");
+        return ERR_VAL;
+    }
+
+    upload.buffer = malloc(HTTPD_UPLOAD_BUFFER_SIZE);
+    if (upload.buffer == NULL)
+    {
+        DPRINTF("Upload rejected. Not enough memory\n");
+        return ERR_MEM;
+    }
+    FRESULT fr = f_open(&upload.file, upload.path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (fr != FR_OK)
+    {
+        DPRINTF("Upload rejected. Cannot create %s: %d\n", upload.path, fr);
+        free(upload.buffer);
+        upload.buffer = NULL;
+        return ERR_VAL;
+    }
+    if (upload.msa_convert)
+    {
+        msa_decoder_init(&upload.msa, upload_write_file, &upload.file);
+        download_sink_init(&upload.sink, upload.buffer, HTTPD_UPLOAD_BUFFER_SIZE, upload_persist_msa, &upload.msa);
+    }
+    else
+    {
+        // Allocate the clusters in one go. If there is no contiguous space, FatFs allocates them while writing
+        fr = f_expand(&upload.file, content_len, 1);
+        if (fr != FR_OK)
+        {
+            DPRINTF("Cannot preallocate %d bytes for %s: %d\n", content_len, upload.path, fr);
+        }
+        download_sink_init(&upload.sink, upload.buffer, HTTPD_UPLOAD_BUFFER_SIZE, upload_persist_file, &upload.file);
+    }
+
+    upload.active = true;
+    upload.connection = connection;
+    upload.content_len = (uint32_t)content_len;
+    upload.received = 0;
+    upload.crc = 0;
+    upload.failed = false;
+    upload.last_activity_us = time_us_64();
+    // The window is opened by httpd_post_data_recved() when the data is written
+    *post_auto_wnd = 0;
+    DPRINTF("Upload of %s started: %d bytes\n", upload.path, content_len);
+    return ERR_OK;
+}
+
+err_t httpd_post_receive_data(void *connection, struct pbuf *p)
+{
+    if (!upload.active || (connection != upload.connection))
+    {
+        pbuf_free(p);
+        return ERR_VAL;
+    }
+    for (struct pbuf *q = p; q != NULL; q = q->next)
+    {
+        upload.crc = crc32_update(upload.crc, (const uint8_t *)q->payload, q->len);
+    }
+    upload.received += p->tot_len;
+    upload.last_activity_us = time_us_64();
+    uint32_t ack = download_sink_stage_pbuf(&upload.sink, p);
+    if ((upload.received >= upload.content_len) || upload.sink.failed)
+    {
+        // Write the last block and open the window for the rest, so httpd can finish the request
+        upload.failed = !download_sink_finish(&upload.sink, 0, 0);
+        ack += upload.sink.unacked;
+        upload.sink.unacked = 0;
+    }
+    pbuf_free(p);
+    if (ack > 0)
+    {
+        httpd_post_data_recved(connection, (u16_t)ack);
+    }
+    return upload.failed ? ERR_VAL : ERR_OK;
+}
+
+// Also called by httpd when the connection is closed before the end of the body
+void httpd_post_finished(void *connection, char *response_uri, u16_t response_uri_len)
+{
+    if (!upload.active || (connection != upload.connection))
+    {
+        upload_response(response_uri, response_uri_len, "/api/upload_failed.json");
+        return;
+    }
+    bool ok = !upload.failed && (upload.received == upload.content_len);
+    if (upload.msa_convert && !msa_decoder_finish(&upload.msa))
+    {
+        ok = false;
+    }
+    upload.msa_convert = false;
+    ok = (f_sync(&upload.file) == FR_OK) && ok;
+    bool crc_ok = (upload.crc == upload.expected_crc);
+    if (ok && crc_ok)
+    {
+        DPRINTF("Upload of %s finished: %d bytes, CRC32 %08x\n", upload.path, upload.received, upload.crc);
+        upload_response(response_uri, response_uri_len, "/api/upload_ok.json");
+        upload_count++;
+    }
+    else
+    {
+        DPRINTF("Upload of %s failed. Received %d of %d bytes, CRC32 %08x, expected %08x\n",
+                upload.path, upload.received, upload.content_len, upload.crc, upload.expected_crc);
+        upload_response(response_uri, response_uri_len, ok ? "/api/upload_bad_crc.json" : "/api/upload_failed.json");
+    }
+    upload_release(ok && crc_ok);
+    dircache_invalidate(NULL);
+}
+
+uint32_t httpd_get_upload_count(void)
+{
+    return upload_count;
+}
+
 // The main function should be as follows:
 // int main(void)
 // {
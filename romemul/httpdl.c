@@ -0,0 +1,576 @@
+/**
+ * File: httpdl.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Downloads of files over HTTP with Range requests. The progress is saved next to the
+ * partial file, and a broken download is resumed where the SD card has it
+ */
+
+#include "include/httpdl.h"
+
+int split_url(const char *url, UrlParts *parts)
+{
+    if (!url || !parts)
+        return -1;
+
+    // Initialize parts with NULL
+    parts->protocol = NULL;
+    parts->domain = NULL;
+    parts->uri = NULL;
+
+    char *p, *q;
+
+    // Get protocol
+    p = strstr(url, "://");
+    if (!p)
+        return -1; // Invalid URL format
+
+    parts->protocol = malloc(p - url + 1);
+    if (!parts->protocol)
+        return -1; // Allocation failed
+    strncpy(parts->protocol, url, p - url);
+    parts->protocol[p - url] = '\0';
+
+    // Get domain
+    p += 3; // Skip over "://"
+    q = strchr(p, '/');
+
+    if (q)
+    {
+        parts->domain = malloc(q - p + 1);
+        if (!parts->domain)
+            return -1; // Allocation failed
+        strncpy(parts->domain, p, q - p);
+        parts->domain[q - p] = '\0';
+
+        // Get URI
+        parts->uri = strdup(q);
+        if (!parts->uri)
+            return -1; // Allocation failed
+    }
+    else
+    {
+        parts->domain = strdup(p);
+        if (!parts->domain)
+            return -1; // Allocation failed
+    }
+
+    return 0;
+}
+
+void free_url_parts(UrlParts *parts)
+{
+    if (parts->protocol)
+        free(parts->protocol);
+    if (parts->domain)
+        free(parts->domain);
+    if (parts->uri)
+        free(parts->uri);
+}
+
+static uint32_t hash_url(const char *url)
+{
+    uint32_t hash = 0x811C9DC5;
+    while (*url)
+    {
+        hash ^= (uint8_t)*url++;
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+static bool read_resume_info(const char *resume_path, uint32_t url_hash, DownloadResumeInfo *info)
+{
+    FIL file;
+    UINT br = 0;
+    if (f_open(&file, resume_path, FA_READ) != FR_OK)
+    {
+        return false;
+    }
+    FRESULT fr = f_read(&file, info, sizeof(DownloadResumeInfo), &br);
+    f_close(&file);
+    return (fr == FR_OK) && (br == sizeof(DownloadResumeInfo)) && (info->magic == DOWNLOAD_RESUME_MAGIC) && (info->url_hash == url_hash);
+}
+
+static void save_resume_info(const char *resume_path, const DownloadResumeInfo *info)
+{
+    FIL file;
+    UINT bw = 0;
+    if (f_open(&file, resume_path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
+    {
+        f_write(&file, info, sizeof(DownloadResumeInfo), &bw);
+        f_close(&file);
+    }
+}
+
+// The DNS lookup of http_get_range. lwIP cannot cancel a lookup, so the answer can arrive after
+// a timeout: it must not touch the stack of the function. A late answer has an old id and is ignored
+static struct
+{
+    uint32_t id;
+    volatile bool done;
+    ip_addr_t addr;
+    err_t err;
+} range_dns = {0};
+
+static void range_dns_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    if ((uint32_t)(uintptr_t)arg != range_dns.id)
+    {
+        DPRINTF("Late DNS answer ignored: %s\n", name);
+        return;
+    }
+    if (ipaddr != NULL)
+    {
+        range_dns.addr = *ipaddr;
+    }
+    else
+    {
+        DPRINTF("DNS lookup failed: %s\n", name);
+        range_dns.err = ERR_ARG;
+    }
+    range_dns.done = true;
+}
+
+bool http_range_parse_headers(char *header, uint32_t offset, HttpRangeResponse *response)
+{
+    for (char *c = header; *c != '\0'; c++)
+    {
+        *c = tolower((unsigned char)*c);
+    }
+    char *status_ptr = strchr(header, ' ');
+    response->status = status_ptr != NULL ? atoi(status_ptr + 1) : 0;
+    response->restart = false;
+    response->total_length = 0;
+    response->error = ERR_OK;
+    char *length_ptr = strstr(header, "content-length:");
+    uint32_t content_length = length_ptr != NULL ? strtoul(length_ptr + strlen("content-length:"), NULL, 10) : 0;
+    DPRINTF("HTTP status: %d. Content length: %d\n", response->status, content_length);
+    char *encoding_ptr = strstr(header, "transfer-encoding:");
+    char *chunked_ptr = encoding_ptr != NULL ? strstr(encoding_ptr, "chunked") : NULL;
+    char *encoding_end = encoding_ptr != NULL ? strchr(encoding_ptr, '\r') : NULL;
+    if ((chunked_ptr != NULL) && ((encoding_end == NULL) || (chunked_ptr < encoding_end)))
+    {
+        // Not expected from an HTTP/1.0 request. The chunk sizes would end up in the file
+        DPRINTF("Chunked response not supported\n");
+        response->error = ERR_VAL;
+        return false;
+    }
+    if (response->status == 206)
+    {
+        // Content-Range: bytes start-end/total
+        char *range_ptr = strstr(header, "content-range:");
+        char *total_ptr = range_ptr != NULL ? strchr(range_ptr, '/') : NULL;
+        response->total_length = total_ptr != NULL ? strtoul(total_ptr + 1, NULL, 10) : offset + content_length;
+        return true;
+    }
+    if (response->status == 200)
+    {
+        if (offset > 0)
+        {
+            DPRINTF("Server does not support ranges. Restarting the download\n");
+            response->restart = true;
+        }
+        response->total_length = content_length;
+        return true;
+    }
+    response->error = response->status == 0 ? ERR_VAL : response->status;
+    return false;
+}
+
+err_t http_get_range(const char *domain, const char *uri, uint32_t offset, DownloadSink *sink, void (*restart)(void), uint32_t *total_length)
+{
+    struct altcp_pcb *pcb = NULL;
+    ip_addr_t server_addr;
+    volatile bool complete = false;
+    volatile err_t callback_error = ERR_OK; // If any error found in the callback and cannot be returned, store it here
+    char header[HTTP_RANGE_HEADER_MAX_LENGTH];
+    uint16_t header_length = 0;
+    uint32_t header_tail = 0;
+    bool headers_done = false;
+    uint64_t last_activity = time_us_64();
+
+    err_t recv(void *arg, struct altcp_pcb *conn, struct pbuf *p, err_t err)
+    {
+        if (p == NULL)
+        {
+            // The server closed the connection
+            altcp_recv(conn, NULL);
+            altcp_err(conn, NULL);
+            if (altcp_close(conn) != ERR_OK)
+            {
+                altcp_abort(conn);
+            }
+            pcb = NULL;
+            complete = true;
+            return ERR_OK;
+        }
+        last_activity = time_us_64();
+        if (!headers_done)
+        {
+            uint16_t header_bytes = 0;
+            while ((header_bytes < p->tot_len) && !headers_done)
+            {
+                char c = pbuf_get_at(p, header_bytes++);
+                if (header_length < sizeof(header) - 1)
+                {
+                    header[header_length++] = c;
+                }
+                header_tail = (header_tail << 8) | (uint8_t)c;
+                headers_done = (header_tail == 0x0D0A0D0A); // Empty line: "\r\n\r\n"
+            }
+            if (headers_done)
+            {
+                HttpRangeResponse response;
+                header[header_length] = '\0';
+                if (!http_range_parse_headers(header, offset, &response))
+                {
+                    callback_error = response.error;
+                    altcp_recved(conn, p->tot_len);
+                    pbuf_free(p);
+                    altcp_err(conn, NULL);
+                    altcp_abort(conn);
+                    pcb = NULL;
+                    complete = true;
+                    return ERR_ABRT;
+                }
+                if (response.restart)
+                {
+                    restart();
+                }
+                *total_length = response.total_length;
+            }
+            download_sink_skip(sink, header_bytes);
+        }
+        download_sink_write_pbuf(sink, conn, p);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+
+    void error(void *arg, err_t err)
+    {
+        // The pcb is already freed
+        DPRINTF("Connection error: %d\n", err);
+        pcb = NULL;
+        callback_error = err;
+        complete = true;
+    }
+
+    err_t connected(void *arg, struct altcp_pcb *conn, err_t err)
+    {
+        char request[512];
+        int request_length = snprintf(request, sizeof(request),
+                                      "GET %s HTTP/1.0\r\n"
+                                      "User-Agent: SidecartRP2040\r\n"
+                                      "Accept: */*\r\n"
+                                      "Host: %s\r\n"
+                                      "Range: bytes=%lu-\r\n"
+                                      "Connection: Close\r\n\r\n",
+                                      uri, domain, (unsigned long)offset);
+        err = altcp_write(conn, request, request_length, TCP_WRITE_FLAG_COPY);
+        if (err == ERR_OK)
+        {
+            err = altcp_output(conn);
+        }
+        return err;
+    }
+
+    cyw43_arch_lwip_begin();
+    range_dns.id++;
+    range_dns.done = false;
+    range_dns.err = ERR_OK;
+    err_t err = dns_gethostbyname(domain, &server_addr, range_dns_found, (void *)(uintptr_t)range_dns.id);
+    cyw43_arch_lwip_end();
+    if (err == ERR_INPROGRESS)
+    {
+        while (!range_dns.done)
+        {
+#if PICO_CYW43_ARCH_POLL
+            network_safe_poll();
+#endif
+            if (time_us_64() - last_activity > DOWNLOAD_LISTS_TIMEOUT * 1000000)
+            {
+                DPRINTF("DNS lookup timed out\n");
+                return ERR_TIMEOUT;
+            }
+        }
+        server_addr = range_dns.addr;
+        err = range_dns.err;
+    }
+    if (err != ERR_OK)
+    {
+        return err;
+    }
+
+    cyw43_arch_lwip_begin();
+    pcb = altcp_new(NULL);
+    if (pcb != NULL)
+    {
+        altcp_recv(pcb, recv);
+        altcp_err(pcb, error);
+        err = altcp_connect(pcb, &server_addr, LWIP_IANA_PORT_HTTP, connected);
+    }
+    cyw43_arch_lwip_end();
+    if (pcb == NULL)
+    {
+        return ERR_MEM;
+    }
+    if (err != ERR_OK)
+    {
+        cyw43_arch_lwip_begin();
+        altcp_err(pcb, NULL);
+        altcp_abort(pcb);
+        cyw43_arch_lwip_end();
+        return err;
+    }
+
+    // The timeout only expires if no data arrives for a while
+    last_activity = time_us_64();
+    while (!complete)
+    {
+#if PICO_CYW43_ARCH_POLL
+        network_safe_poll();
+#endif
+        if (time_us_64() - last_activity > DOWNLOAD_FILES_TIMEOUT * 1000000)
+        {
+            DPRINTF("Download timed out\n");
+            cyw43_arch_lwip_begin();
+            if (pcb != NULL)
+            {
+                altcp_err(pcb, NULL);
+                altcp_recv(pcb, NULL);
+                altcp_abort(pcb);
+                pcb = NULL;
+            }
+            cyw43_arch_lwip_end();
+            return ERR_TIMEOUT;
+        }
+    }
+    if ((callback_error == ERR_OK) && !headers_done)
+    {
+        return ERR_CONN;
+    }
+    return callback_error;
+}
+
+// Connection errors that a new request can fix. HTTP errors are not fixed by retrying
+static bool is_download_error_transient(err_t err)
+{
+    return (err == ERR_TIMEOUT) || (err == ERR_CLSD) || (err == ERR_ABRT) || (err == ERR_RST) || (err == ERR_CONN);
+}
+
+int download_floppy(const char *url, const char *folder, const char *dest_filename, bool overwrite_flag, bool decode_msa)
+{
+    uint8_t *buff = malloc(DOWNLOAD_SINK_SD_BUFFER_SIZE);
+    if (buff == NULL)
+    {
+        DPRINTF("Failed to allocate memory for the download buffer\n");
+        return -1;
+    }
+    DownloadSink sink;
+    err_t callback_error = ERR_OK;
+    UrlParts parts;
+
+    FRESULT fr;    // FatFS function common result code
+    FIL dest_file; // File object
+    UINT bw;       // File read/write count
+    FILINFO fno;
+    DownloadResumeInfo resume_info = {0};
+    char resume_path[256 + sizeof(DOWNLOAD_RESUME_EXTENSION)];
+    uint32_t unsaved_bytes = 0;
+    MsaDecoder msa_decoder;
+
+    bool write_track(void *arg, const uint8_t *data, uint32_t size)
+    {
+        fr = f_write(&dest_file, data, size, &bw);
+        if ((fr != FR_OK) || (bw != size))
+        {
+            DPRINTF("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+            return false;
+        }
+        return true;
+    }
+
+    bool persist(void *arg, uint8_t *data, uint32_t size)
+    {
+        if (decode_msa)
+        {
+            // The MSA image is decoded to ST as it arrives. The tracks are written by the decoder
+            return msa_decoder_feed(&msa_decoder, data, size);
+        }
+        // Whole sectors at aligned file offsets go straight to the SD card
+        fr = f_write(&dest_file, data, size, &bw);
+        if ((fr != FR_OK) || (bw != size))
+        {
+            DPRINTF("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
+            return false;
+        }
+        unsaved_bytes += size;
+        if (unsaved_bytes >= DOWNLOAD_RESUME_SAVE_BYTES)
+        {
+            // The progress is only saved after the data is safe in the SD card
+            f_sync(&dest_file);
+            resume_info.persisted = f_tell(&dest_file);
+            save_resume_info(resume_path, &resume_info);
+            unsaved_bytes = 0;
+        }
+        return true;
+    }
+
+    void restart()
+    {
+        f_lseek(&dest_file, 0);
+        f_truncate(&dest_file);
+    }
+
+    // Create full paths for source and destination files
+    char dest_path[256];
+    sprintf(dest_path, "%s/%s", folder, dest_filename);
+    sprintf(resume_path, "%s%s", dest_path, DOWNLOAD_RESUME_EXTENSION);
+
+    // A partial download of the same URL is resumed. The MSA decoder cannot start in the
+    // middle of the image, so decoded downloads always start from the beginning
+    uint32_t url_hash = hash_url(url);
+    bool resuming = !decode_msa && read_resume_info(resume_path, url_hash, &resume_info);
+
+    // Check if the destination file exists
+    fr = f_stat(dest_path, &fno);
+    if (fr == FR_OK && !overwrite_flag && !resuming)
+    {
+        DPRINTF("Destination file exists and overwrite_flag is false, canceling operation\n");
+        free(buff);
+        return FR_FILE_EXISTS; // Destination file exists and overwrite_flag is false, cancel the operation
+    }
+
+    // Create and open the destination file
+    fr = f_open(&dest_file, dest_path, resuming ? (FA_OPEN_ALWAYS | FA_WRITE) : (FA_CREATE_ALWAYS | FA_WRITE));
+    if (fr != FR_OK)
+    {
+        DPRINTF("f_open error: %s (%d)\n", FRESULT_str(fr), fr);
+        f_close(&dest_file); // Close the source file if it was opened successfully
+        free(buff);
+        return FR_CANNOT_OPEN_FILE_FOR_WRITE;
+    }
+
+    uint32_t offset = 0;
+    if (resuming)
+    {
+        // Discard anything written after the last saved progress
+        offset = resume_info.persisted < f_size(&dest_file) ? resume_info.persisted : f_size(&dest_file);
+        f_lseek(&dest_file, offset);
+        f_truncate(&dest_file);
+        DPRINTF("Resuming download at %d bytes of %d\n", offset, resume_info.total_length);
+    }
+    resume_info.magic = DOWNLOAD_RESUME_MAGIC;
+    resume_info.url_hash = url_hash;
+
+    DPRINTF("Downloading Floppy image from %s\n", url);
+    if (split_url(url, &parts) != 0)
+    {
+        DPRINTF("Failed to split URL\n");
+        f_close(&dest_file);
+        free(buff);
+        return -1;
+    }
+
+    DPRINTF("Protocol %s\n", parts.protocol);
+    DPRINTF("Domain %s\n", parts.domain);
+    DPRINTF("URI %s\n", parts.uri);
+
+    for (int attempt = 0; attempt < DOWNLOAD_RESUME_ATTEMPTS; attempt++)
+    {
+        if ((resume_info.total_length > 0) && (offset >= resume_info.total_length))
+        {
+            // Nothing left to download
+            callback_error = ERR_OK;
+            break;
+        }
+        if (decode_msa)
+        {
+            if (attempt > 0)
+            {
+                restart();
+            }
+            msa_decoder_init(&msa_decoder, write_track, NULL);
+        }
+        download_sink_init(&sink, buff, DOWNLOAD_SINK_SD_BUFFER_SIZE, persist, NULL);
+        uint32_t total_length = resume_info.total_length;
+        callback_error = http_get_range(parts.domain, parts.uri, offset, &sink, restart, &total_length);
+        resume_info.total_length = total_length;
+
+        // Whatever arrived in order is valid, even if the connection failed
+        bool sink_ok = download_sink_finish(&sink, 0, 0);
+        if (decode_msa)
+        {
+            bool decoded = msa_decoder_finish(&msa_decoder);
+            if (sink_ok && (callback_error == ERR_OK) && decoded)
+            {
+                DPRINTF("MSA image decoded while downloading. %d bytes.\n", sink.persisted);
+                break;
+            }
+            if (!sink_ok || (msa_decoder.state == MSA_DECODER_ERROR))
+            {
+                // Bad image or SD card error. Retrying does not help
+                callback_error = ERR_BUF;
+                break;
+            }
+            if (callback_error == ERR_OK)
+            {
+                callback_error = ERR_CLSD;
+            }
+            DPRINTF("MSA download interrupted at %d bytes: %d\n", sink.persisted, callback_error);
+            resume_info.total_length = 0;
+            if (!is_download_error_transient(callback_error))
+            {
+                break;
+            }
+            continue;
+        }
+        if (!sink_ok)
+        {
+            callback_error = ERR_BUF;
+            break;
+        }
+        f_sync(&dest_file);
+        offset = f_tell(&dest_file);
+        resume_info.persisted = offset;
+        unsaved_bytes = 0;
+
+        if ((callback_error == ERR_OK) && ((total_length == 0) || (offset >= total_length)))
+        {
+            DPRINTF("Floppy image transfer complete. %d bytes.\n", offset);
+            break;
+        }
+        if (callback_error == ERR_OK)
+        {
+            // The connection was closed before the end of the file
+            callback_error = ERR_CLSD;
+        }
+        DPRINTF("Download interrupted at %d bytes of %d: %d\n", offset, total_length, callback_error);
+        save_resume_info(resume_path, &resume_info);
+        if (!is_download_error_transient(callback_error))
+        {
+            // HTTP errors are not fixed by retrying
+            break;
+        }
+    }
+
+    // Close open file
+    f_close(&dest_file);
+    if (callback_error == ERR_OK)
+    {
+        f_unlink(resume_path);
+    }
+    else if (decode_msa || !is_download_error_transient(callback_error))
+    {
+        // A partially decoded image is useless, and so is a download the server refuses (a 404 or
+        // an unusable response) or the SD card cannot store. Only a broken connection is resumed
+        f_unlink(dest_path);
+        f_unlink(resume_path);
+    }
+
+    free_url_parts(&parts);
+    free(buff);
+    return callback_error;
+}
@@ -0,0 +1,113 @@
+/**
+ * File: blkarb.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the block arbiter between GEMDRIVE and the USB mass storage
+ */
+
+#ifndef BLKARB_H
+#define BLKARB_H
+
+#include "debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ff.h"
+
+// Regions of the FAT volume. Each one has its own reader/writer lock
+typedef enum
+{
+    BLKARB_REGION_RESERVED = 0, // Boot sector, FSINFO and anything before the FATs
+    BLKARB_REGION_FAT,          // File allocation tables
+    BLKARB_REGION_ROOT_DIR,     // Fixed root directory of FAT12/FAT16. Empty in FAT32 and exFAT
+    BLKARB_REGION_DATA,         // Clusters: directories and file contents
+    BLKARB_REGIONS
+} BlkArbRegion;
+
+#define BLKARB_REGION_MASK(region) (1 << (region))
+#define BLKARB_ALL_REGIONS ((1 << BLKARB_REGIONS) - 1)
+#define BLKARB_METADATA_REGIONS (BLKARB_REGION_MASK(BLKARB_REGION_RESERVED) | BLKARB_REGION_MASK(BLKARB_REGION_FAT) | BLKARB_REGION_MASK(BLKARB_REGION_ROOT_DIR))
+
+typedef enum
+{
+    BLKARB_OWNER_GEMDRIVE = 0, // The Atari ST through FatFs
+    BLKARB_OWNER_USB,          // The USB host through raw blocks
+    BLKARB_OWNERS
+} BlkArbOwner;
+
+typedef struct
+{
+    uint16_t readers[BLKARB_OWNERS];
+    uint16_t writers[BLKARB_OWNERS];
+} BlkArbLock;
+
+typedef struct
+{
+    uint32_t fat_start; // First LBA of each region. The reserved region starts at 0
+    uint32_t root_dir_start;
+    uint32_t data_start;
+    BlkArbLock locks[BLKARB_REGIONS];
+    uint8_t changed[BLKARB_OWNERS]; // Regions written by the other owner since the last check
+    uint32_t conflicts;             // Locks refused because the other owner had the region
+} BlockArbiter;
+
+/**
+ * @brief Reads the layout of the regions from a mounted volume.
+ *
+ * Until the layout is known, all the blocks are in the reserved region, so any write
+ * is taken as a change of the metadata.
+ *
+ * @param fs The mounted FatFs volume.
+ */
+void blkarb_set_layout(const FATFS *fs);
+
+/**
+ * @brief Returns the regions covered by a run of blocks.
+ *
+ * @param lba The first block.
+ * @param count The number of blocks.
+ * @return The mask of regions.
+ */
+uint8_t blkarb_regions(uint32_t lba, uint32_t count);
+
+/**
+ * @brief Locks regions for reading or writing. An owner can hold several locks of the same region.
+ *
+ * Readers of different owners share a region. A writer excludes the other owner, but not itself.
+ *
+ * @param owner The owner of the lock.
+ * @param regions The mask of regions.
+ * @param write true to lock for writing.
+ * @return false if the other owner holds a conflicting lock. Nothing is locked then.
+ */
+bool blkarb_lock(BlkArbOwner owner, uint8_t regions, bool write);
+
+/**
+ * @brief Releases the locks taken with blkarb_lock. Releasing a write lock marks the regions as
+ * changed for the other owner.
+ *
+ * @param owner The owner of the lock.
+ * @param regions The mask of regions.
+ * @param write true if the lock was for writing.
+ */
+void blkarb_unlock(BlkArbOwner owner, uint8_t regions, bool write);
+
+/**
+ * @brief Returns the regions written by the other owner since the last call, and forgets them.
+ *
+ * @param owner The owner asking.
+ * @return The mask of changed regions.
+ */
+uint8_t blkarb_take_changes(BlkArbOwner owner);
+
+/**
+ * @brief Returns the arbiter, for the statistics.
+ *
+ * @return The arbiter.
+ */
+const BlockArbiter *blkarb_get(void);
+
+#endif // BLKARB_H
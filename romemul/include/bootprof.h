@@ -0,0 +1,63 @@
+/**
+ * File: bootprof.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the boot time profiler
+ */
+
+#ifndef BOOTPROF_H
+#define BOOTPROF_H
+
+#include "debug.h"
+#include "memfunc.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+// sync values here as well : atarist-sidecart-firmware/configurator/src/include/bootprof.h
+#define BOOTPROF_MAX_MARKS 16
+#define BOOTPROF_MAX_NAME_LENGTH 12 // Including the null terminator. Must be even
+
+// A single boot phase mark. The timestamp is the number of microseconds since reset
+typedef struct
+{
+    uint32_t timestamp_us;
+    char name[BOOTPROF_MAX_NAME_LENGTH];
+} BootProfMark;
+
+// The boot profile table. This is also the layout copied to the shared memory
+typedef struct
+{
+    uint32_t count;
+    BootProfMark marks[BOOTPROF_MAX_MARKS];
+} BootProfTable;
+
+/**
+ * @brief Records a mark for the boot phase that has just finished.
+ *
+ * The mark stores the microseconds since reset. If the table is full the mark is discarded.
+ *
+ * @param name The name of the boot phase. Truncated to BOOTPROF_MAX_NAME_LENGTH - 1 characters.
+ */
+void bootprof_mark(const char *name);
+
+/**
+ * @brief Prints the boot profile table in the debug output with the elapsed time of each phase.
+ */
+void bootprof_print(void);
+
+/**
+ * @brief Copies the boot profile table to the memory area shared with the Atari ST.
+ *
+ * The longwords are swapped and the names converted to Motorola endianess, so the
+ * ST side can read the table directly.
+ *
+ * @param dest Pointer to the shared memory area. Needs sizeof(BootProfTable) bytes.
+ */
+void bootprof_copy_to_shared(uint8_t *dest);
+
+#endif // BOOTPROF_H
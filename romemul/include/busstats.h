@@ -0,0 +1,98 @@
+/**
+ * File: busstats.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the statistics of the accesses to the cartridge bus
+ */
+
+#ifndef BUSSTATS_H
+#define BUSSTATS_H
+
+#include "debug.h"
+#include "constants.h"
+#include "memfunc.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+
+#define BUSSTATS_REPORT_MS 1000 // Interval of the rates
+
+// Counters of the bus. Incremented in the DMA IRQ, read by the reporter in the main loop
+typedef struct
+{
+    uint32_t accesses[2];    // Accesses seen by the DMA IRQ. ROM4 and ROM3
+    uint32_t commands;       // Commands of the protocol parsed in ROM3
+    uint32_t parse_timeouts; // Commands dropped because the next word arrived too late
+    uint32_t parse_oversized; // Frames dropped because the payload size is bigger than MAX_PROTOCOL_PAYLOAD_SIZE
+    uint32_t irq_overruns;   // Accesses that arrived while the IRQ handler was running. Handled late
+    uint32_t rx_stalls;      // Samples of the read state machine with the RX FIFO full: the DMA fell behind
+    uint32_t fifo_errors;    // Samples with an RX underflow or TX overflow of the read state machine
+} BusStats;
+
+// The last report. This is also the layout copied to the shared memory
+// sync values here as well : atarist-sidecart-firmware/configurator/src/include/busstats.h
+typedef struct
+{
+    uint32_t rom4_per_sec;
+    uint32_t rom3_per_sec;
+    uint32_t commands_per_sec;
+    uint32_t rom4_accesses;
+    uint32_t rom3_accesses;
+    uint32_t commands;
+    uint32_t parse_timeouts;
+    uint32_t irq_overruns;
+    uint32_t rx_stalls;
+    uint32_t fifo_errors;
+    uint32_t sys_clock_khz;
+} BusStatsReport;
+
+extern BusStats bus_stats;
+
+/**
+ * @brief Counts an access of the bus. Call it at the start of the DMA IRQ handler.
+ *
+ * @param addr The address read from the lookup DMA channel.
+ */
+static __force_inline void busstats_access(uint32_t addr)
+{
+    bus_stats.accesses[addr >= ROM3_START_ADDRESS ? 1 : 0]++;
+}
+
+/**
+ * @brief Checks if a new access arrived while the DMA IRQ handler was running. The handler must
+ * clear the interrupt request when it starts: a new access sets it again, and the IRQ runs once
+ * more for it. Comparing the addresses would miss an access to the same address.
+ *
+ * @param channel The lookup DMA channel.
+ */
+static __force_inline void busstats_irq_exit(int channel)
+{
+    if (dma_hw->intr & (1u << channel))
+    {
+        bus_stats.irq_overruns++;
+    }
+}
+
+/**
+ * @brief Samples the FIFO debug flags of the read state machine and, every BUSSTATS_REPORT_MS,
+ * updates the report. Low priority: call it from the main loop when the emulator is idle.
+ *
+ * @param dest Pointer to the shared memory area for the report, or NULL. Needs sizeof(BusStatsReport) bytes.
+ */
+void busstats_poll(uint8_t *dest);
+
+/**
+ * @brief Returns the last report.
+ *
+ * @return The report.
+ */
+const BusStatsReport *busstats_get_report(void);
+
+#endif // BUSSTATS_H
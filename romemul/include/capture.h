@@ -0,0 +1,92 @@
+/**
+ * File: capture.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the capture of the ROM3 protocol traffic to the SD card
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "debug.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "ff.h"
+
+#define CAPTURE_ROM3 0 // Set to 1 to record every word received in ROM3 to the SD card
+
+#define CAPTURE_RING_SIZE 2048       // Records in RAM. Must be a power of two. 16 KBytes
+#define CAPTURE_BLOCK_RECORDS 512    // Records written to the SD card at once. 4 KBytes
+#define CAPTURE_IDLE_US 100000       // Write an incomplete block after this time without traffic
+#define CAPTURE_RETRY_MS 1000        // Interval between attempts to create the capture file
+#define CAPTURE_FILE "/rom3cap.bin"  // Replay it with tests/capture_replay.c or decode it with capture_replay.py
+#define CAPTURE_MAGIC 0x33504143     // "CAP3"
+#define CAPTURE_VERSION 1
+
+// The header of the capture file. Little endian, as written by the RP2040
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t app; // APP_* of commands.h of the emulator running
+    uint32_t record_size;
+} CaptureHeader;
+
+// A word read by the Atari ST in ROM3
+typedef struct
+{
+    uint32_t time_us; // Lower 32 bits of the microseconds timer
+    uint16_t data;    // Lower 16 bits of the address: the word sent by the ST
+    uint16_t lost;    // Records lost before this one because the ring was full. Saturated
+} CaptureRecord;
+
+#if CAPTURE_ROM3 != 0
+extern CaptureRecord capture_ring[CAPTURE_RING_SIZE];
+extern volatile uint32_t capture_head;
+extern volatile uint32_t capture_tail;
+extern uint32_t capture_lost;
+
+/**
+ * @brief Appends a word to the ring. Only from the DMA IRQ: it is the only writer of the head.
+ *
+ * @param data The word read in ROM3.
+ */
+static __force_inline void capture_record(uint16_t data)
+{
+    uint32_t head = capture_head;
+    if (head - capture_tail >= CAPTURE_RING_SIZE)
+    {
+        capture_lost++;
+        return;
+    }
+    CaptureRecord *record = &capture_ring[head & (CAPTURE_RING_SIZE - 1)];
+    record->time_us = timer_hw->timerawl;
+    record->data = data;
+    record->lost = capture_lost > 0xFFFF ? 0xFFFF : capture_lost;
+    capture_lost = 0;
+    __dmb();
+    capture_head = head + 1;
+}
+#define CAPTURE(data) capture_record(data)
+#else
+#define CAPTURE(data)
+#endif
+
+/**
+ * @brief Writes the captured words to the SD card. Creates the capture file the first time.
+ * Call it from the main loop when the emulator is idle and the SD card is mounted. Does
+ * nothing if CAPTURE_ROM3 is 0.
+ *
+ * @param app The APP_* code of the emulator, stored in the header of the file.
+ */
+void capture_poll(uint32_t app);
+
+#endif // CAPTURE_H
@@ -0,0 +1,98 @@
+/**
+ * File: cmdstats.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the latency statistics of the commands of the Atari ST
+ */
+
+#ifndef CMDSTATS_H
+#define CMDSTATS_H
+
+#include "debug.h"
+#include "memfunc.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+
+// sync values here as well : atarist-sidecart-firmware/configurator/src/include/cmdstats.h
+#define CMDSTATS_MAX_COMMANDS 48 // Different command IDs. Enough for all the GEMDRIVE commands
+#define CMDSTATS_BUCKETS 16      // Bucket 0: < 8us. Bucket n: 4 << n to (8 << n) - 1 us. Bucket 15 has all >= 131072 us
+#define CMDSTATS_PUBLISH_MS 1000 // Minimum interval between copies to the shared memory
+
+// Statistics of a command ID. Times from the frame received in the IRQ to the answer in the main loop
+typedef struct
+{
+    uint16_t command;
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[CMDSTATS_BUCKETS];
+} CmdStatsEntry;
+
+// Layout of an entry in the shared memory. All longwords, so the ST can read them after the swap
+typedef struct
+{
+    uint32_t command;
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t buckets[CMDSTATS_BUCKETS];
+} CmdStatsSharedEntry;
+
+// Layout of the table in the shared memory
+typedef struct
+{
+    uint32_t size;    // Entries used
+    uint32_t dropped; // Commands not counted because the table was full
+    CmdStatsSharedEntry entries[CMDSTATS_MAX_COMMANDS];
+} CmdStatsSharedTable;
+
+/**
+ * @brief Adds the latency of an answered command. Call it from the main loop, never from an IRQ.
+ *
+ * @param command The command ID.
+ * @param start_us The lower 32 bits of the timer when the frame of the command was received.
+ */
+void cmdstats_record(uint16_t command, uint32_t start_us);
+
+/**
+ * @brief Returns the number of command IDs with statistics.
+ *
+ * @return The number of entries.
+ */
+int cmdstats_size(void);
+
+/**
+ * @brief Returns the statistics of a command ID.
+ *
+ * @param index The index of the entry, from 0 to cmdstats_size() - 1.
+ * @return The entry, or NULL if the index is out of range.
+ */
+const CmdStatsEntry *cmdstats_get_entry(int index);
+
+/**
+ * @brief Returns the lower bound in microseconds of a bucket of the histogram.
+ *
+ * @param bucket The bucket, from 0 to CMDSTATS_BUCKETS - 1.
+ * @return The lower bound.
+ */
+uint32_t cmdstats_bucket_floor_us(int bucket);
+
+/**
+ * @brief Copies the table to the memory area shared with the Atari ST, if there are new
+ * commands and CMDSTATS_PUBLISH_MS have passed since the last copy.
+ *
+ * The longwords are swapped, so the ST side can read the table directly.
+ *
+ * @param dest Pointer to the shared memory area. Needs sizeof(CmdStatsSharedTable) bytes.
+ */
+void cmdstats_publish(uint8_t *dest);
+
+#endif // CMDSTATS_H
@@ -38,6 +38,9 @@
 #define CLEAN_START 24          // Start the configurator when the app starts
 #define BOOT_GEMDRIVE 25        // Boot the GEMDRIVE emulator
 #define REBOOT 26               // Reboot the device
+#define GET_BOOT_PROFILE 27     // Get the timestamps of the boot phases
+#define LIST_ROMS_PAGE 28       // List a page of the ROMs in the SD card. Need to pass the first index
+#define LIST_FLOPPIES_PAGE 29   // List a page of the floppy images in the SD card. Need to pass the first index
 #define FTPSERVER 30            // Start the FTP server
 
 
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #include <hardware/flash.h>
 #include <hardware/sync.h>
@@ -27,9 +28,8 @@
 #include "hardware/resets.h"
 
 // sync values here as well : atarist-sidecart-firmware/configurator/src/include/config.h
-// Warning. There will be an issue when reaching the maximum number of entries for 4Kbytes of flash memory
-// The maximum number of entries is 46
-// Change the memory size of the config structure to 8Kbytes when reaching the maximum number of entries
+// Warning. A full snapshot of the entries must fit in a single sector of the config log
+// The maximum number of entries is CONFIG_LOG_RECORDS_PER_SECTOR (48)
 #define MAX_ENTRIES 47
 #define MAX_KEY_LENGTH 20
 #define MAX_STRING_VALUE_LENGTH 64
@@ -82,6 +82,61 @@
 #define PARAM_WIFI_SCAN_SECONDS "WIFI_SCAN_SECONDS"
 #define PARAM_WIFI_SSID "WIFI_SSID"
 
+// Integer identifiers of the keys. Index of the key in the defaultEntries and configData.entries arrays
+typedef enum
+{
+    CONFIG_KEY_BOOT_FEATURE,
+    CONFIG_KEY_CONFIGURATOR_DARK,
+    CONFIG_KEY_DELAY_ROM_EMULATION,
+    CONFIG_KEY_DOWNLOAD_TIMEOUT_SEC,
+    CONFIG_KEY_FILE_COUNT_ENABLED,
+    CONFIG_KEY_FLOPPIES_FOLDER,
+    CONFIG_KEY_FLOPPY_BOOT_ENABLED,
+    CONFIG_KEY_FLOPPY_BUFFER_TYPE,
+    CONFIG_KEY_FLOPPY_DB_URL,
+    CONFIG_KEY_FLOPPY_IMAGE_A,
+    CONFIG_KEY_FLOPPY_IMAGE_B,
+    CONFIG_KEY_FLOPPY_NET_ENABLED,
+    CONFIG_KEY_FLOPPY_NET_TOUT_SEC,
+    CONFIG_KEY_FLOPPY_XBIOS_ENABLED,
+    CONFIG_KEY_GEMDRIVE_BUFF_TYPE,
+    CONFIG_KEY_GEMDRIVE_DRIVE,
+    CONFIG_KEY_GEMDRIVE_FOLDERS,
+    CONFIG_KEY_GEMDRIVE_RTC,
+    CONFIG_KEY_GEMDRIVE_TIMEOUT_SEC,
+    CONFIG_KEY_GEMDRIVE_FAKEFLOPPY,
+    CONFIG_KEY_HOSTNAME,
+    CONFIG_KEY_LASTEST_RELEASE_URL,
+    CONFIG_KEY_MENU_REFRESH_SEC,
+    CONFIG_KEY_NETWORK_STATUS_SEC,
+    CONFIG_KEY_ROMS_CSV_URL,
+    CONFIG_KEY_ROMS_FOLDER,
+    CONFIG_KEY_ROMS_YAML_URL,
+    CONFIG_KEY_RTC_NTP_SERVER_HOST,
+    CONFIG_KEY_RTC_NTP_SERVER_PORT,
+    CONFIG_KEY_RTC_TYPE,
+    CONFIG_KEY_RTC_UTC_OFFSET,
+    CONFIG_KEY_SAFE_CONFIG_REBOOT,
+    CONFIG_KEY_SD_MASS_STORAGE,
+    CONFIG_KEY_SD_BAUD_RATE_KB,
+    CONFIG_KEY_WIFI_AUTH,
+    CONFIG_KEY_WIFI_CONNECT_TIMEOUT,
+    CONFIG_KEY_WIFI_COUNTRY,
+    CONFIG_KEY_WIFI_DHCP,
+    CONFIG_KEY_WIFI_DNS,
+    CONFIG_KEY_WIFI_GATEWAY,
+    CONFIG_KEY_WIFI_IP,
+    CONFIG_KEY_WIFI_NETMASK,
+    CONFIG_KEY_WIFI_PASSWORD,
+    CONFIG_KEY_WIFI_POWER,
+    CONFIG_KEY_WIFI_RSSI,
+    CONFIG_KEY_WIFI_SCAN_SECONDS,
+    CONFIG_KEY_WIFI_SSID,
+    // New keys go after this line. The ids are stored in the config log and must not change.
+    // MAX_ENTRIES is part of the GET_CONFIG protocol with the Atari ST and limits the count
+    CONFIG_KEY_COUNT
+} ConfigKeyId;
+
 #define TYPE_INT ((uint16_t)0)
 #define TYPE_STRING ((uint16_t)1)
 #define TYPE_BOOL ((uint16_t)2)
@@ -105,7 +160,82 @@ typedef struct
     size_t count;
 } ConfigData;
 
+// The config is persisted as an append-only log of records in CONFIG_LOG_SECTORS flash sectors.
+// Each save appends only the modified keys. When the active sector is full, the entries that differ
+// from the defaults are compacted into the next sector, so the erases rotate over all the sectors.
+#define CONFIG_LOG_SECTORS 4
+#define CONFIG_LOG_KEY_ERASED 0xFFFF
+#define CONFIG_LOG_RECORDS_PER_PAGE (FLASH_PAGE_SIZE / sizeof(ConfigLogRecord))
+#define CONFIG_LOG_RECORDS_PER_SECTOR (CONFIG_LOG_RECORDS_PER_PAGE * (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE))
+
+// A record never crosses a page boundary, so saving a single key costs one page program
+typedef struct
+{
+    uint16_t key_id; // ConfigKeyId. CONFIG_LOG_KEY_ERASED if the slot is free
+    DataType dataType;
+    char value[MAX_STRING_VALUE_LENGTH];
+    uint32_t checksum; // Detects records torn by a power loss
+} ConfigLogRecord;
+
+// The header is stored in the free bytes at the end of the first page of the sector.
+// It is programmed last, so a sector with a valid header always contains a full snapshot
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;       // The sector with the highest sequence is the active one
+    uint32_t sequence_check; // ~sequence
+    uint32_t reserved;
+} ConfigLogHeader;
+
+// Features to launch at boot. Parsed from PARAM_BOOT_FEATURE
+typedef enum
+{
+    BOOT_FEATURE_CONFIGURATOR,
+    BOOT_FEATURE_ROM_EMULATOR,
+    BOOT_FEATURE_FLOPPY_EMULATOR,
+    BOOT_FEATURE_RTC_EMULATOR,
+    BOOT_FEATURE_GEMDRIVE_EMULATOR
+} BootFeature;
+
+// Typed copy of the config entries that are not plain strings.
+// Parsed after load_all_entries() and updated after every put_*, so the values can be
+// read without parsing the strings again. Use find_entry_by_id() for the string values
+typedef struct
+{
+    BootFeature boot_feature;
+    bool delay_rom_emulation;
+    bool safe_config_reboot;
+    bool file_count_enabled;
+    int download_timeout_sec;
+    bool sd_mass_storage;
+    int sd_baud_rate_kb;
+    // Floppy emulator
+    bool floppy_boot_enabled;
+    int floppy_buffer_type;
+    bool floppy_net_enabled;
+    int floppy_net_tout_sec;
+    bool floppy_xbios_enabled;
+    // GEMDRIVE emulator
+    int gemdrive_buff_type;
+    char gemdrive_drive;
+    bool gemdrive_rtc;
+    int gemdrive_timeout_sec;
+    bool gemdrive_fakefloppy;
+    // RTC
+    int rtc_ntp_server_port;
+    // Network
+    bool wifi_configured; // SSID not empty
+    int wifi_auth;
+    int wifi_connect_timeout_sec;
+    bool wifi_dhcp;
+    uint32_t wifi_power;
+    bool wifi_rssi;
+    int wifi_scan_seconds;
+    int network_status_sec;
+} ConfigSnapshot;
+
 extern ConfigData configData;
+extern ConfigSnapshot configSnapshot;
 
 // Load functions. Should be used only at startup
 void load_all_entries();
@@ -123,6 +253,8 @@ void print_config_table();
 void swap_data(uint16_t *dest_ptr_word);
 
 ConfigEntry *find_entry(const char *key);
+// O(1) access to an entry using its integer identifier
+ConfigEntry *find_entry_by_id(ConfigKeyId key_id);
 
 int put_bool(const char key[MAX_KEY_LENGTH], bool value);
 int put_string(const char key[MAX_KEY_LENGTH], const char *value);
@@ -88,6 +88,9 @@ extern const uint32_t CONFIG_FLASH_OFFSET;
 extern const uint32_t CONFIG_FLASH_SIZE;
 extern const uint32_t CONFIG_VERSION;
 extern const uint32_t CONFIG_MAGIC;
+extern const uint32_t CONFIG_LOG_FLASH_SIZE;
+extern const uint32_t CONFIG_LOG_FLASH_OFFSET;
+extern const uint32_t CONFIG_LOG_MAGIC;
 extern const uint32_t NETWORK_MAGIC;
 
 // Atari ST constants.
@@ -0,0 +1,25 @@
+/**
+ * File: crc32.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the CRC32 checksum (the one of zip, PNG and Ethernet)
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Updates a CRC32 with more data. Start with crc = 0. The lookup table is built on the first call.
+ *
+ * @param crc The CRC32 of the previous data, or 0.
+ * @param data The data.
+ * @param length The number of bytes.
+ * @return The CRC32 of all the data so far.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);
+
+#endif // CRC32_H
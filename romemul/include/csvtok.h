@@ -0,0 +1,82 @@
+/**
+ * File: csvtok.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the streaming CSV tokenizer of the ROM and floppy catalogs
+ */
+
+#ifndef CSVTOK_H
+#define CSVTOK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/pbuf.h"
+
+#define CSV_TOKENIZER_MAX_FIELD_LENGTH 256 // Including the null terminator. Longer fields are truncated
+
+typedef enum
+{
+    CSV_FIELD_START,  // Waiting for the first character of a field
+    CSV_UNQUOTED,     // Inside a field without quotes
+    CSV_QUOTED,       // Inside a quoted field
+    CSV_QUOTE_QUOTED, // Found a quote inside a quoted field. Escaped quote or end of field
+    CSV_AFTER_QUOTED  // After the closing quote. Ignore until the separator
+} CsvTokenizerState;
+
+// Called for each field. The value is only valid during the call
+typedef void (*csv_field_callback_t)(void *arg, uint32_t record, uint16_t field, const char *value);
+// Called after the last field of each record
+typedef void (*csv_record_callback_t)(void *arg, uint32_t record);
+
+typedef struct
+{
+    CsvTokenizerState state;
+    char separator;
+    uint32_t record;
+    uint16_t field;
+    uint16_t field_length;
+    char value[CSV_TOKENIZER_MAX_FIELD_LENGTH];
+    csv_field_callback_t field_callback;
+    csv_record_callback_t record_callback;
+    void *arg;
+} CsvTokenizer;
+
+/**
+ * @brief Initializes the tokenizer. The tokenizer needs no memory besides the structure.
+ *
+ * @param tokenizer The tokenizer to initialize.
+ * @param separator The field separator. ',' for the ROMs catalog and ';' for the floppy database.
+ * @param field_callback Function called for each field.
+ * @param record_callback Function called at the end of each record. Can be NULL.
+ * @param arg Argument passed to the callbacks.
+ */
+void csv_tokenizer_init(CsvTokenizer *tokenizer, char separator, csv_field_callback_t field_callback, csv_record_callback_t record_callback, void *arg);
+
+/**
+ * @brief Tokenizes a block of bytes. The block can split a field or a record at any position.
+ *
+ * @param tokenizer The tokenizer.
+ * @param data The bytes to tokenize.
+ * @param length The number of bytes.
+ */
+void csv_tokenizer_feed(CsvTokenizer *tokenizer, const char *data, size_t length);
+
+/**
+ * @brief Tokenizes all the buffers of a pbuf chain as received from the HTTP client.
+ *
+ * @param tokenizer The tokenizer.
+ * @param p The pbuf chain. It is not freed.
+ */
+void csv_tokenizer_feed_pbuf(CsvTokenizer *tokenizer, const struct pbuf *p);
+
+/**
+ * @brief Emits the last record if the input does not end with a new line.
+ *
+ * @param tokenizer The tokenizer.
+ */
+void csv_tokenizer_finish(CsvTokenizer *tokenizer);
+
+#endif // CSVTOK_H
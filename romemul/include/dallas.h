@@ -0,0 +1,82 @@
+/**
+ * File: dallas.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the Dallas DS1216 clock of the RTC emulator. The magic sequence
+ * and the bits of the clock served to the ST, without the hardware
+ */
+
+#ifndef DALLAS_H
+#define DALLAS_H
+
+#include "debug.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/rtc.h"
+
+#define DALLAS_MAGIC_SEQUENCE_HEX 0x5ca33ac55ca33ac5
+#define DALLAS_READ_ADDRESS_BIT 0x9      // The ST reads the bits of the clock here
+#define DALLAS_WRITE_ADDRESS_BIT_ZERO 0x1 // The ST writes a bit 0 of the magic sequence reading here
+#define DALLAS_WRITE_ADDRESS_BIT_ONE 0x3  // The ST writes a bit 1 of the magic sequence reading here
+
+// WARNING: CHANGE THIS OFFSET WITH CAUTION
+// The offset_sync is the time the RP2040 takes to read and process the time and date from the internal RTC
+// and put it in the clock_sequence_dallas_rtc array. This offset is calculated by trial and error.
+// So if you change the code, you have to recalculate this offset.
+#define DALLAS_OFFSET_SYNC 3
+
+// DAllas RTC. Info here: https://pdf1.alldatasheet.es/datasheet-pdf/view/58439/DALLAS/DS1216.html
+typedef struct
+{
+    uint64_t last_magic_found;
+    uint16_t retries;
+    uint64_t magic_sequence_hex;
+    uint8_t clock_sequence[2][64];   // Double buffer. The main loop prepares one while the IRQ serves the other
+    volatile uint8_t ready_sequence; // Buffer with the current second
+    uint8_t serving_sequence;        // Buffer latched by the IRQ when the magic sequence is found
+    int8_t prepared_second;          // Second of the ready buffer. -1 if no buffer is ready yet
+    uint8_t read_address_bit;
+    uint8_t write_address_bit_zero;
+    uint8_t write_address_bit_one;
+    uint8_t magic_sequence[66];
+    uint16_t size_magic_sequence;
+    uint16_t size_clock_sequence;
+    uint32_t rom_address;
+} DallasClock;
+
+/**
+ * @brief Initializes the clock and its magic sequence. No clock sequence is ready.
+ *
+ * @param clock The clock.
+ * @param rom_address First address of the ROM the ST reads.
+ */
+void dallas_init(DallasClock *clock, uint32_t rom_address);
+
+/**
+ * @brief Prepares the clock sequence of a new second in the buffer the IRQ is not serving, and
+ * swaps the buffers. Called from the main loop so the IRQ only has to copy the bits to the ROM.
+ *
+ * @param clock The clock.
+ * @param now Time and date of the internal RTC.
+ * @return true if the buffers were swapped, false if the second was already prepared.
+ */
+bool dallas_prepare(DallasClock *clock, const datetime_t *now);
+
+/**
+ * @brief Follows an access of the ST to the ROM of the clock. Called from the DMA IRQ.
+ *
+ * @param clock The clock.
+ * @param addr_lsb The LSB of the address.
+ * @param now_us time_us_64() of the access. A pause longer than PROTOCOL_READ_RESTART_MICROSECONDS
+ * restarts the magic sequence.
+ * @param clock_bit Byte to write at rom_address + read_address_bit, for the next read of the ST.
+ * @return true if clock_bit must be written.
+ */
+bool dallas_access(DallasClock *clock, uint8_t addr_lsb, uint64_t now_us, uint8_t *clock_bit);
+
+#endif // DALLAS_H
@@ -0,0 +1,88 @@
+/**
+ * File: dircache.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the short-lived directory listing cache
+ */
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include "debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pico/stdlib.h"
+
+#include "ff.h"
+
+#define DIRCACHE_SLOTS 2                 // Directories kept in the cache
+#define DIRCACHE_TTL_MS 5000             // A listing older than this is read again
+#define DIRCACHE_MAX_SIZE (24 * 1024)    // Bigger directories are not cached
+#define DIRCACHE_MAX_PATH 256
+
+typedef struct
+{
+    uint32_t size;
+    uint32_t name_offset; // Offset of the name in the names blob
+    uint16_t fdate;       // FAT date and time, as in FILINFO
+    uint16_t ftime;
+    uint8_t attrib;
+} DirCacheEntry;
+
+// A listing of a directory in the order of the directory table. The entries and the
+// names are in the same allocation. A listing is freed when its last reference is released
+typedef struct
+{
+    char path[DIRCACHE_MAX_PATH];
+    uint64_t loaded_us;
+    uint32_t refs;
+    uint32_t count;
+    DirCacheEntry *entries;
+    char *names;
+} DirCache;
+
+/**
+ * @brief Returns the listing of a directory, reading it from the SD card if it is not cached or is too old.
+ *
+ * The returned listing stays valid until it is released, even if it is evicted from the cache.
+ * A directory too big to be cached is remembered for DIRCACHE_TTL_MS, so the next calls
+ * return NULL without counting its entries again.
+ *
+ * @param path The path of the directory.
+ * @return The listing, or NULL if the directory cannot be read or is too big to be cached.
+ */
+DirCache *dircache_get(const char *path);
+
+/**
+ * @brief Releases a listing returned by dircache_get.
+ *
+ * @param cache The listing.
+ */
+void dircache_release(DirCache *cache);
+
+/**
+ * @brief Drops the cached listing of a directory. Call it after changing the content of the directory.
+ *
+ * @param path The path of the directory, or NULL to drop all the cached listings.
+ */
+void dircache_invalidate(const char *path);
+
+/**
+ * @brief Returns the name of an entry of a listing.
+ *
+ * @param cache The listing.
+ * @param index The index of the entry.
+ * @return The name of the entry.
+ */
+static inline const char *dircache_name(const DirCache *cache, uint32_t index)
+{
+    return cache->names + cache->entries[index].name_offset;
+}
+
+#endif // DIRCACHE_H
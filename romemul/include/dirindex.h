@@ -0,0 +1,119 @@
+/**
+ * File: dirindex.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the sorted index of the ROM and floppy image folders
+ */
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include "debug.h"
+#include "memfunc.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pico/stdlib.h"
+
+#include "sd_card.h"
+#include "f_util.h"
+#include "ff.h"
+
+#include "filesys.h"
+
+#define DIRINDEX_MAGIC 0x53434958 // "SCIX"
+#define DIRINDEX_VERSION 2
+#define DIRINDEX_FNV_OFFSET_BASIS 0x811C9DC5
+#define DIRINDEX_FNV_PRIME 0x01000193
+
+// The index files live in the folder they index. The dot hides them from the listings
+#define DIRINDEX_ROMS_FILENAME ".sidecart_roms.idx"
+#define DIRINDEX_FLOPPIES_FILENAME ".sidecart_floppies.idx"
+
+// Bytes needed after the last name of a page: alignment byte, 0x0000 end of list and 0xFFFF marker
+#define DIRINDEX_PAGE_TRAILER_SIZE 5
+
+// Memory used to sort the names. A folder that does not fit is sorted in several passes
+#define DIRINDEX_SORT_BUFFER_SIZE (12 * 1024)
+#define DIRINDEX_SORT_MAX_NAMES 512
+
+// Header of the index file. It is followed by count uint32_t offsets and then, at names_offset,
+// by the names blob: the file names sorted and separated with a 0x00 byte
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t signature;    // FNV-1a of the name, size and date of the indexed files
+    uint32_t count;        // Number of file names in the index
+    uint32_t names_offset; // Position of the names blob in the file
+    uint32_t names_size;   // Size in bytes of the names blob
+} DirIndexHeader;
+
+// Header of a page in the shared memory. It is followed by the names of the page
+// in the same format as store_file_list()
+// sync values here as well : atarist-sidecart-firmware/configurator/src/include/config.h
+typedef struct
+{
+    uint16_t total; // Total number of files in the folder
+    uint16_t first; // Index of the first file of the page. Starts at 0
+    uint16_t count; // Number of files in the page
+    uint16_t reserved;
+} DirIndexPage;
+
+/**
+ * @brief Checks the index of a folder and rebuilds it if the folder has changed.
+ *
+ * The folder is scanned without allocating memory to calculate its signature. Only if the
+ * signature does not match the one stored in the index, the whole index is built again: the
+ * names are sorted in passes of DIRINDEX_SORT_BUFFER_SIZE bytes and the index file is written.
+ * The last folder checked is remembered, and it is not scanned again until dirindex_invalidate().
+ *
+ * @param dir The folder to index.
+ * @param index_filename The name of the index file inside the folder.
+ * @param allowed_extensions The lowercase extensions of the files to index.
+ * @param num_extensions The number of extensions in allowed_extensions.
+ * @return true if the index is up to date, false if it could not be built.
+ */
+bool dirindex_refresh(const char *dir, const char *index_filename, const char **allowed_extensions, size_t num_extensions);
+
+/**
+ * @brief Forgets the last folder checked, so the next dirindex_refresh() scans it again.
+ *
+ * Call it when a new listing starts. The pages of the same listing can skip the scan.
+ */
+void dirindex_invalidate(void);
+
+/**
+ * @brief Stores a page of the index in the memory shared with the Atari ST.
+ *
+ * The page starts with a DirIndexPage header followed by as many complete names as fit
+ * in memory_size bytes.
+ *
+ * @param dir The indexed folder.
+ * @param index_filename The name of the index file inside the folder.
+ * @param first The index of the first name of the page. Starts at 0.
+ * @param memory_location Pointer to the shared memory area.
+ * @param memory_size Size of the shared memory area in bytes.
+ * @return The number of names stored in the page, or -1 if the index could not be read.
+ */
+int dirindex_store_page(const char *dir, const char *index_filename, uint32_t first, uint8_t *memory_location, size_t memory_size);
+
+/**
+ * @brief Reads a file name from the index.
+ *
+ * @param dir The indexed folder.
+ * @param index_filename The name of the index file inside the folder.
+ * @param index The position of the name in the sorted list. Starts at 0.
+ * @param name Buffer to store the name.
+ * @param name_size Size of the buffer in bytes.
+ * @return true if the name was found, false otherwise.
+ */
+bool dirindex_get_name(const char *dir, const char *index_filename, uint32_t index, char *name, size_t name_size);
+
+#endif // DIRINDEX_H
@@ -0,0 +1,96 @@
+/**
+ * File: dlsink.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the download sink that stages the HTTP body before persisting it
+ */
+
+#ifndef DLSINK_H
+#define DLSINK_H
+
+#include "debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/altcp.h"
+#include "lwip/tcp.h"
+
+// Staging buffer sizes. They must be smaller than TCP_WND: the received bytes are not
+// acknowledged until the staging buffer is persisted
+#define DOWNLOAD_SINK_SD_BUFFER_SIZE 8192      // 16 SD sectors
+#define DOWNLOAD_SINK_FLASH_BUFFER_SIZE 4096   // One FLASH sector
+
+// Persist a full staging buffer. Returns true if the data was written
+typedef bool (*download_sink_persist_t)(void *arg, uint8_t *data, uint32_t size);
+
+typedef struct
+{
+    uint8_t *buffer;
+    uint32_t buffer_size;
+    uint32_t buffer_pos;
+    uint32_t unacked;   // Bytes received but not acknowledged to the sender yet
+    uint32_t skip;      // Bytes to discard at the current position of the stream
+    uint32_t persisted; // Bytes persisted so far
+    bool failed;
+    download_sink_persist_t persist;
+    void *arg;
+} DownloadSink;
+
+/**
+ * @brief Initializes a download sink.
+ *
+ * @param sink The sink to initialize.
+ * @param buffer The staging buffer. Its size should match the natural write size of the destination.
+ * @param buffer_size The size of the staging buffer in bytes.
+ * @param persist Function called each time the staging buffer is full.
+ * @param arg Argument passed to the persist function.
+ */
+void download_sink_init(DownloadSink *sink, uint8_t *buffer, uint32_t buffer_size, download_sink_persist_t persist, void *arg);
+
+/**
+ * @brief Discards the next bytes of the stream. Used to skip headers of the downloaded images.
+ *
+ * @param sink The sink.
+ * @param bytes The number of bytes to discard.
+ */
+void download_sink_skip(DownloadSink *sink, uint32_t bytes);
+
+/**
+ * @brief Copies a pbuf chain to the staging buffer like download_sink_write_pbuf, but does not acknowledge anything.
+ *
+ * For servers that open the TCP window themselves, like the POST handler of httpd.
+ *
+ * @param sink The sink.
+ * @param p The pbuf chain. It is not freed.
+ * @return The number of bytes that can be acknowledged to the sender now.
+ */
+uint32_t download_sink_stage_pbuf(DownloadSink *sink, struct pbuf *p);
+
+/**
+ * @brief Copies a pbuf chain to the staging buffer and persists the buffer when it is full.
+ *
+ * The pbuf segments are copied directly to the staging buffer. The received bytes are only
+ * acknowledged with tcp_recved() after they are persisted, so a slow destination slows down
+ * the sender instead of filling the memory. The pbuf is not freed.
+ *
+ * @param sink The sink.
+ * @param conn The connection that received the pbuf.
+ * @param p The pbuf chain.
+ */
+void download_sink_write_pbuf(DownloadSink *sink, struct altcp_pcb *conn, struct pbuf *p);
+
+/**
+ * @brief Persists the bytes left in the staging buffer.
+ *
+ * @param sink The sink.
+ * @param align If not zero, the last block is padded to a multiple of align bytes.
+ * @param pad The value used to pad the last block.
+ * @return true if all the data was persisted, false otherwise.
+ */
+bool download_sink_finish(DownloadSink *sink, uint32_t align, uint8_t pad);
+
+#endif // DLSINK_H
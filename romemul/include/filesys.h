@@ -15,6 +15,7 @@
 
 #include "config.h"
 #include "memfunc.h"
+#include "msadec.h"
 
 #define GEMDOS_FILE_ATTRIB_VOLUME_LABEL 8
 
@@ -98,6 +99,8 @@ bool is_sdcard_mounted(FATFS *fs_ptr);
 char **show_dir_files(const char *dir, int *num_files);
 void release_memory_files(char **files, int num_files);
 int load_rom_from_fs(char *path, char *filename, uint32_t rom_load_offset);
+int has_allowed_extension(const char *filename, const char **allowed_extensions, size_t num_extensions);
+int compare_strings(const void *a, const void *b);
 char **filter(char **file_list, int file_count, int *num_files, const char **allowed_extensions, size_t num_extensions);
 void store_file_list(char **file_list, int num_files, uint8_t *memory_location);
 FRESULT read_and_trim_file(const char *path, char **content, size_t max_length);
@@ -36,7 +36,13 @@
 #include "config.h"
 #include "memfunc.h"
 #include "filesys.h"
+#include "dircache.h"
+#include "ftpserver.h"
 #include "httpd.h"
+#include "wifimgr.h"
+#include "trace.h"
+#include "cmdstats.h"
+#include "jsonesc.h"
 
 #define FLOPPYEMUL_RANDOM_TOKEN (0x0)                              // Offset from 0x0000
 #define FLOPPYEMUL_RANDOM_TOKEN_SEED (FLOPPYEMUL_RANDOM_TOKEN + 4) // random_token + 4 bytes
@@ -70,6 +76,10 @@
 // Memory address for the buffer swap
 #define FLOPPYEMUL_IMAGE (FLOPPYEMUL_RANDOM_TOKEN + 0x1000) // random_token + 0x1000 bytes
 
+// Latency statistics of the commands. sizeof(CmdStatsSharedTable) bytes at the end of the shared memory
+#define FLOPPYEMUL_CMDSTATS (FLOPPYEMUL_RANDOM_TOKEN + 0xE000) // random_token + 0xE000 bytes
+#define FLOPPYEMUL_BUSSTATS (FLOPPYEMUL_CMDSTATS + sizeof(CmdStatsSharedTable)) // Bus statistics. sizeof(BusStatsReport) bytes
+
 // Media type changed flags
 #define MED_NOCHANGE 0
 #define MED_UNKNOWN 1
@@ -163,6 +173,18 @@ typedef struct
     int size;
 } FloppyCatalog;
 
+// Counters of the sector requests of the ST, published by the web API
+typedef struct
+{
+    uint32_t sectors_read[2]; // Drive A and B
+    uint32_t sectors_written[2];
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t checksum_errors; // Sector writes rejected because the checksum does not match
+} FloppyStats;
+
+#define FLOPPYEMUL_API_PAGE_SIZE 20 // Files of a page of the catalog in the web API
+
 typedef void (*IRQInterceptionCallback)();
 
 extern int read_addr_rom_dma_channel;
@@ -174,4 +196,20 @@ void __not_in_flash_func(floppyemul_dma_irq_handler_lookup_callback)(void);
 // Function Prototypes
 void init_floppyemul(bool safe_config_reboot);
 
+/**
+ * @brief Prepares the shared memory, the network and the SD card of the floppy emulator.
+ * init_floppyemul() calls it before its loop. The host tests call it instead of init_floppyemul().
+ *
+ * @param safe_config_reboot The SELECT button only sets the configurator for the next power cycle.
+ */
+void floppyemul_setup(bool safe_config_reboot);
+
+/**
+ * @brief One pass of the loop of init_floppyemul(): serves the commands received by the DMA IRQ
+ * handler.
+ *
+ * @return false if the emulator stopped after an error of the SD card or the images.
+ */
+bool floppyemul_poll(void);
+
 #endif // FLOPPYEMUL_H
@@ -16,8 +16,46 @@ extern "C"
 
 #include "debug.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// Clients served at the same time. The next one gets a 421. Each session takes about 19 KB of RAM
+#define FTPD_MAX_SESSIONS 2
+
+// Counters of a client session, for the web interface
+typedef struct
+{
+    uint32_t remote_ip;     // IPv4 address of the client, in network order
+    uint64_t connected_us;  // When the client connected
+    uint64_t transfer_us;   // Time spent in listings and file transfers
+    uint32_t transfers;     // Listings and files finished or aborted
+    uint32_t bytes_sent;    // Bytes of the data connections acknowledged by the client
+    uint32_t bytes_received;
+    bool transferring;      // A listing or file transfer is running
+} FtpSessionStats;
+
+/**
+ * @brief Starts the FTP server. The pool of FTPD_MAX_SESSIONS sessions is allocated here.
+ */
 void ftpd_init(void);
 
+/**
+ * @brief Returns the number of slots of the session pool. 0 if the server is not running.
+ */
+int ftpd_get_max_sessions(void);
+
+/**
+ * @brief Copies the counters of a session.
+ *
+ * @param index The slot of the session, from 0 to ftpd_get_max_sessions() - 1.
+ * @param stats The counters of the session.
+ * @return true if there is a client connected in the slot, false otherwise.
+ */
+bool ftpd_get_session_stats(int index, FtpSessionStats *stats);
+
+// Starts the FTP server for the FTPSERVER command of the configurator
+void test();
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -38,6 +38,9 @@
 #include "memfunc.h"
 #include "filesys.h"
 #include "rtcemul.h"
+#include "usb_mass.h"
+#include "trace.h"
+#include "cmdstats.h"
 
 #define DEFAULT_FOPEN_READ_BUFFER_SIZE 16384
 #define DEFAULT_FWRITE_BUFFER_SIZE 2048
@@ -101,6 +104,10 @@
 
 #define GEMDRVEMUL_EXEC_PD (GEMDRVEMUL_SHARED_VARIABLES + 256) // shared variables + 256 bytes
 
+// Latency statistics of the commands. sizeof(CmdStatsSharedTable) bytes at the end of the shared memory
+#define GEMDRVEMUL_CMDSTATS (GEMDRVEMUL_RANDOM_TOKEN + 0xE000) // random token + 0xE000 bytes
+#define GEMDRVEMUL_BUSSTATS (GEMDRVEMUL_CMDSTATS + sizeof(CmdStatsSharedTable)) // Bus statistics. sizeof(BusStatsReport) bytes
+
 // Atari ST FATTRIB flag
 #define FATTRIB_INQUIRE 0x00
 #define FATTRIB_SET 0x01
@@ -147,6 +154,18 @@
 
 #define DTA_HASH_TABLE_SIZE 512
 
+// States of the background network and NTP acquisition
+typedef enum
+{
+    NETWORK_ACQUISITION_IDLE,
+    NETWORK_ACQUISITION_WIFI_START,
+    NETWORK_ACQUISITION_WIFI_CONNECTING,
+    NETWORK_ACQUISITION_NTP_START,
+    NETWORK_ACQUISITION_NTP_WAITING,
+    NETWORK_ACQUISITION_DONE,
+    NETWORK_ACQUISITION_FAILED
+} NetworkAcquisitionState;
+
 #define PDCLSIZE 0x80 /*  size of command line in bytes  */
 #define MAXDEVS 16    /* max number of block devices */
 
@@ -264,4 +283,18 @@ void __not_in_flash_func(gemdrvemul_dma_irq_handler_lookup_callback)(void);
 // Function Prototypes
 void init_gemdrvemul(bool safe_config_reboot);
 
+/**
+ * @brief Prepares the shared memory and the state of GEMDRIVE. init_gemdrvemul() calls it before
+ * its loop. The host tests call it instead of init_gemdrvemul().
+ *
+ * @param safe_config_reboot The SELECT button only sets the configurator for the next power cycle.
+ */
+void gemdrvemul_setup(bool safe_config_reboot);
+
+/**
+ * @brief One pass of the loop of init_gemdrvemul(): serves the command received by the DMA IRQ
+ * handler, if any, and the background work when the Atari ST is not waiting.
+ */
+void gemdrvemul_poll(void);
+
 #endif // GEMDRVEMUL_H
@@ -15,13 +15,48 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "pico/stdlib.h"
 
 #include "lwip/apps/httpd.h"
 
+#include "ff.h"
+
+#include "config.h"
+#include "dlsink.h"
+#include "msadec.h"
+#include "crc32.h"
+#include "dircache.h"
+
+// Uploads: POST /upload.cgi?folder=floppies|roms&name=<file>&crc=<hex>[&msa=1]
+// The body is the file. With msa=1 the MSA image is saved as an ST image
+#define HTTPD_UPLOAD_URI "/upload.cgi"
+#define HTTPD_UPLOAD_MAX_NAME 128
+#define HTTPD_UPLOAD_MAX_PATH 256
+#define HTTPD_UPLOAD_TIMEOUT_MS 10000 // An upload without data for this time is abandoned and deleted
+#define HTTPD_UPLOAD_BUFFER_SIZE DOWNLOAD_SINK_SD_BUFFER_SIZE // A multiple of the cluster size of the usual SD cards
+
 // Function Prototypes
 void httpd_server_init(const char *ssi_tags[], size_t num_tags, tSSIHandler ssi_handler_func, const tCGI *cgi_handlers, size_t num_cgi_handlers);
 
+/**
+ * @brief Returns the number of files uploaded successfully since the start.
+ *
+ * The content of the floppies or ROMs folder changes when this number changes.
+ *
+ * @return The number of files uploaded.
+ */
+uint32_t httpd_get_upload_count(void);
+
+/**
+ * @brief Releases the upload in progress if its connection is gone.
+ *
+ * httpd does not report a connection reset in the middle of a POST. Call this from the main loop,
+ * in the lwIP context, so the buffer and the open file of the upload do not wait for the next one.
+ */
+void httpd_upload_poll(void);
+
 #endif // HTTPD_H
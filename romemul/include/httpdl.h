@@ -0,0 +1,117 @@
+/**
+ * File: httpdl.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the downloads of files over HTTP with Range requests, resumed
+ * after a broken connection
+ */
+
+#ifndef HTTPDL_H
+#define HTTPDL_H
+
+#include "debug.h"
+#include "constants.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/altcp.h"
+#include "lwip/dns.h"
+
+#include "f_util.h"
+#include "ff.h"
+
+#include "dlsink.h"
+#include "msadec.h"
+
+#define DOWNLOAD_LISTS_TIMEOUT 20 // seconds
+#define DOWNLOAD_FILES_TIMEOUT 99 // seconds
+
+#define HTTP_RANGE_HEADER_MAX_LENGTH 512     // Longer response headers are truncated
+#define DOWNLOAD_RESUME_ATTEMPTS 3           // Attempts to resume a broken download
+#define DOWNLOAD_RESUME_MAGIC 0x444C5253     // "DLRS"
+#define DOWNLOAD_RESUME_SAVE_BYTES (64 * 1024) // Save the progress every 64 Kbytes
+#define DOWNLOAD_RESUME_EXTENSION ".dl"
+
+typedef struct
+{
+    char *protocol;
+    char *domain;
+    char *uri;
+} UrlParts;
+
+// Progress of a download, stored next to the partial file to resume it later
+typedef struct
+{
+    uint32_t magic;
+    uint32_t url_hash;     // FNV-1a of the URL. A different URL restarts the download
+    uint32_t total_length; // Size of the full file. 0 if unknown
+    uint32_t persisted;    // Bytes already written and synced to the file
+} DownloadResumeInfo;
+
+// What the headers of the response to a Range request tell
+typedef struct
+{
+    int status;            // HTTP status. 0 if the status line cannot be read
+    bool restart;          // The server sends the whole file: the bytes already stored must be discarded
+    uint32_t total_length; // Size of the full file. 0 if unknown
+    err_t error;           // ERR_OK if the body can be stored
+} HttpRangeResponse;
+
+// Polls the network stack when lwIP runs in poll mode. In network.c
+void network_safe_poll();
+
+int split_url(const char *url, UrlParts *parts);
+void free_url_parts(UrlParts *parts);
+
+/**
+ * @brief Parses the headers of the response to a GET request with a Range header.
+ *
+ * @param header The status line and the headers, up to the empty line. Changed to lower case.
+ * @param offset First byte requested.
+ * @param response What the response tells.
+ * @return true if the body can be stored, false otherwise. The reason is in response->error: ERR_VAL
+ * for a response that cannot be read or a chunked body, or the HTTP status of an error in an err_t.
+ */
+bool http_range_parse_headers(char *header, uint32_t offset, HttpRangeResponse *response);
+
+/**
+ * @brief GET request that starts at the given offset with a Range header. The lwIP HTTP client
+ * cannot send additional headers. The request is HTTP/1.0, so the server cannot answer with a
+ * chunked body.
+ *
+ * @param domain Name or address of the server.
+ * @param uri Path of the file.
+ * @param offset First byte requested.
+ * @param sink The body goes to the sink.
+ * @param restart Called before the first byte is written if the server ignores the range and sends
+ * the whole file.
+ * @param total_length Size of the full file, or 0 if unknown.
+ * @return ERR_OK if the server closed the connection after the body, an lwIP error, or the HTTP
+ * status of an error in an err_t, as the other downloads of network.c.
+ */
+err_t http_get_range(const char *domain, const char *uri, uint32_t offset, DownloadSink *sink, void (*restart)(void), uint32_t *total_length);
+
+/**
+ * @brief Downloads a floppy image to the SD card. A download broken by the connection is resumed
+ * with a Range request, in this call or in the next one for the same URL.
+ *
+ * @param url URL of the image.
+ * @param folder Folder of the SD card.
+ * @param dest_filename Name of the file in the folder.
+ * @param overwrite_flag If true, an existing file is replaced.
+ * @param decode_msa If true, the MSA image is decoded to ST as it arrives. It cannot be resumed.
+ * @return ERR_OK, FR_FILE_EXISTS, FR_CANNOT_OPEN_FILE_FOR_WRITE, -1 for a bad URL or no memory, or
+ * the error of http_get_range. After an error that is not a broken connection the partial file is
+ * removed.
+ */
+int download_floppy(const char *url, const char *folder, const char *dest_filename, bool overwrite_flag, bool decode_msa);
+
+#endif // HTTPDL_H
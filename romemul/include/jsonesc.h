@@ -0,0 +1,32 @@
+/**
+ * File: jsonesc.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the escaping of UTF-8 strings inside JSON strings
+ */
+
+#ifndef JSONESC_H
+#define JSONESC_H
+
+#include <stddef.h>
+
+#define JSONESC_MAX_SEQUENCE 12 // A surrogate pair: \uD83D\uDE00
+
+/**
+ * @brief Escapes a UTF-8 string to put it between the quotes of a JSON string. Quotes, backslashes and
+ * control characters are escaped, and every character beyond ASCII is written as \uXXXX (a surrogate pair
+ * beyond U+FFFF), so the output is plain ASCII. Bytes that are not valid UTF-8 are written as \uFFFD.
+ *
+ * The output stops before a character that does not fit, so a long string can be escaped in pieces:
+ * call again with src advanced by the returned count until it points to the terminating NUL.
+ *
+ * @param dest The buffer for the escaped string. Always NUL terminated if dest_size > 0.
+ * @param dest_size The size of dest, including the NUL. At least JSONESC_MAX_SEQUENCE + 1 to always progress.
+ * @param src The NUL terminated UTF-8 string.
+ * @param written Set to the number of characters written to dest, without the NUL. Can be NULL.
+ * @return The number of bytes of src escaped.
+ */
+size_t json_escape(char *dest, size_t dest_size, const char *src, size_t *written);
+
+#endif // JSONESC_H
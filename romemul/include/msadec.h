@@ -0,0 +1,97 @@
+/**
+ * File: msadec.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the streaming MSA to ST decoder
+ */
+
+#ifndef MSADEC_H
+#define MSADEC_H
+
+#include "debug.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MSA_HEADER_SIZE 10
+#define MSA_ID_MARKER 0x0E0F
+#define MSA_BYTES_PER_SECTOR 512
+#define MSA_MAX_ENDING_TRACK 86
+#define MSA_MAX_SECTORS_PER_TRACK 56
+#define MSA_RLE_MARKER 0xE5
+#define MSA_READ_BUFFER_SIZE 4096 // Bytes of the MSA file read at once
+
+typedef enum
+{
+    MSA_DECODER_HEADER,       // Reading the MSA header
+    MSA_DECODER_TRACK_LENGTH, // Reading the length word of the next track
+    MSA_DECODER_TRACK_DATA,   // Reading the data of the current track
+    MSA_DECODER_DONE,         // All the tracks decoded. The rest of the input is ignored
+    MSA_DECODER_ERROR         // Bad header, out of memory or write error
+} MsaDecoderState;
+
+// Write the decoded tracks of a cylinder to the destination. Returns true if the data was written
+typedef bool (*msa_write_t)(void *arg, const uint8_t *data, uint32_t size);
+
+typedef struct
+{
+    MsaDecoderState state;
+    uint8_t raw_header[MSA_HEADER_SIZE];
+    uint16_t sectors_per_track;
+    uint16_t sides; // 1 or 2
+    uint16_t starting_track;
+    uint16_t ending_track;
+    uint16_t track;
+    uint16_t side;
+    uint16_t input_pos;   // Bytes read of the header, the length word or the track data
+    uint16_t data_length; // Length of the data of the current track in the MSA file
+    uint16_t track_size;  // Bytes of a decoded track
+    uint16_t track_pos;   // Bytes decoded of the current track
+    uint8_t run_pos;      // Bytes read of the current RLE run. 0 if not inside a run
+    uint8_t run_data;
+    uint16_t run_length;
+    uint8_t *cylinder_buffer; // Decoded tracks of all the sides of the current cylinder
+    msa_write_t write;
+    void *arg;
+} MsaDecoder;
+
+/**
+ * @brief Initializes the decoder. The cylinder buffer is allocated when the header is decoded.
+ *
+ * @param decoder The decoder to initialize.
+ * @param write Function called with each decoded cylinder.
+ * @param arg Argument passed to the write function.
+ */
+void msa_decoder_init(MsaDecoder *decoder, msa_write_t write, void *arg);
+
+/**
+ * @brief Decodes a block of the MSA file. The block can split a track at any position.
+ *
+ * @param decoder The decoder.
+ * @param data The bytes of the MSA file.
+ * @param length The number of bytes.
+ * @return false if the decoder is in error state, true otherwise.
+ */
+bool msa_decoder_feed(MsaDecoder *decoder, const uint8_t *data, size_t length);
+
+/**
+ * @brief Returns the size of the decoded ST image. Only valid once the header is decoded.
+ *
+ * @param decoder The decoder.
+ * @return The size in bytes of the ST image.
+ */
+uint32_t msa_decoder_image_size(const MsaDecoder *decoder);
+
+/**
+ * @brief Releases the cylinder buffer.
+ *
+ * @param decoder The decoder.
+ * @return true if all the tracks were decoded and written, false otherwise.
+ */
+bool msa_decoder_finish(MsaDecoder *decoder);
+
+#endif // MSADEC_H
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "pico/stdlib.h"
 #include "pico/time.h"
@@ -33,6 +34,10 @@
 #include "f_util.h"
 
 #include "memfunc.h"
+#include "csvtok.h"
+#include "dlsink.h"
+#include "msadec.h"
+#include "httpdl.h"
 
 #define MAX_NETWORKS 100
 #define MAX_SSID_LENGTH 36 // SSID can have up to 32 characters + null terminator + padding
@@ -51,9 +56,6 @@
 #define NETWORK_CONNECTION_TIMEOUT 5000 // 1000 milliseconds
 #define FIRMWARE_RELEASE_VERSION_URL "https://api.github.com/repos/diegoparrilla/atarist-sidecart-raspberry-pico/releases/latest"
 
-#define DOWNLOAD_LISTS_TIMEOUT 20 // seconds
-#define DOWNLOAD_FILES_TIMEOUT 99 // seconds
-
 typedef enum
 {
     DISCONNECTED,
@@ -139,13 +141,6 @@ typedef struct
     void *next;
 } FloppyImageInfo;
 
-typedef struct
-{
-    char *protocol;
-    char *domain;
-    char *uri;
-} UrlParts;
-
 extern WifiScanData wifiScanData;
 
 ConnectionStatus get_network_connection_status();
@@ -160,6 +155,9 @@ void network_poll();
 void network_safe_poll();
 void network_terminate();
 int network_init(bool force, bool async, char **pass);
+int network_rejoin(const uint8_t *bssid, uint32_t channel, char **pass);
+bool network_get_access_point(uint8_t *bssid, uint32_t *channel);
+bool network_take_link_event();
 
 u_int32_t get_ip_address();
 u_int32_t get_netmask();
@@ -173,14 +171,12 @@ uint16_t get_wifi_scan_poll_secs();
 uint32_t get_network_status_polling_ms();
 void wait_cyw43_with_polling(uint32_t milliseconds);
 
-int split_url(const char *url, UrlParts *parts);
 err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url);
 int compare_versions(const char *newer_version, const char *current_version);
 int get_latest_release(void);
 char *get_latest_release_str(void);
 
 int download_rom(const char *url, uint32_t rom_load_offset);
-int download_floppy(const char *url, const char *folder, const char *dest_filename, bool overwrite_flag);
 err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *url);
 
 int time_passed(absolute_time_t *t, uint32_t ms);
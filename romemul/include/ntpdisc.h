@@ -0,0 +1,84 @@
+/**
+ * File: ntpdisc.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the software clock disciplined by NTP
+ */
+
+#ifndef NTPDISC_H
+#define NTPDISC_H
+
+#include "debug.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NTP discipline. The clock is polled again at adaptive intervals to follow the drift of the crystal
+#define NTP_MIN_POLL_SEC 64          // Poll interval while the offset is large
+#define NTP_MAX_POLL_SEC 1024        // Poll interval once the clock is stable
+#define NTP_RESPONSE_TIMEOUT_MS 2000 // A request without response is sent again after this time
+#define NTP_MAX_DELAY_MS 500         // Samples with a longer round trip are discarded
+#define NTP_STEP_THRESHOLD_MS 1000   // Bigger offsets step the clock instead of slewing it
+#define NTP_MAX_SLEW_PPM 500         // Maximum rate of the slew, as in ntpd
+#define NTP_STABLE_OFFSET_MS 20      // Below this offset the poll interval grows
+#define NTP_UNSTABLE_OFFSET_MS 100   // Above this offset the poll interval shrinks
+
+// Software clock disciplined by NTP. It runs on time_us_64() corrected by the estimated drift and
+// slews the pending offset. The RP2040 RTC is aligned to it on the second boundaries
+typedef struct
+{
+    bool synchronized;       // The clock was set by at least one NTP response
+    uint64_t request_us;     // time_us_64() when the pending request was sent. 0 if none is pending
+    uint64_t base_us;        // time_us_64() of the last correction
+    int64_t base_time_us;    // Local time at base_us, in microseconds since 1970
+    int64_t slew_us;         // Offset still to be applied since base_us
+    int32_t drift_ppb;       // Estimated drift of the crystal, in parts per billion
+    uint32_t poll_interval_sec;
+    uint64_t next_poll_us;   // time_us_64() of the next request
+    int64_t last_offset_us;  // Offset of the last sample
+    uint32_t last_delay_us;  // Round trip delay of the last sample
+    uint32_t samples;        // Samples accepted
+    int64_t current_second;  // Second of the clock in the last poll
+    bool rtc_checked;        // The RTC was already compared with the clock in this second
+    bool rtc_set_pending;    // The RTC is off. Set it on the next second boundary
+} NtpDiscipline;
+
+typedef enum
+{
+    NTP_SAMPLE_DISCARDED, // Round trip too long
+    NTP_SAMPLE_STEPPED,   // First sample or offset too big. The clock was set to the server time
+    NTP_SAMPLE_SLEWED     // The offset is slewed and the drift estimation corrected
+} NtpSampleResult;
+
+/**
+ * @brief Resets the discipline to the unsynchronized state.
+ *
+ * @param discipline The discipline to reset.
+ */
+void ntp_discipline_init(NtpDiscipline *discipline);
+
+/**
+ * @brief Returns the time of the disciplined clock at a given time_us_64().
+ *
+ * @param discipline The discipline.
+ * @param now_us The time_us_64() value.
+ * @return The local time in microseconds since 1970.
+ */
+int64_t ntp_discipline_clock_us(const NtpDiscipline *discipline, uint64_t now_us);
+
+/**
+ * @brief Applies the timestamps of an NTP response to the clock.
+ *
+ * @param discipline The discipline.
+ * @param t1_us time_us_64() when the request was sent.
+ * @param t4_us time_us_64() when the response was received.
+ * @param t2_us Receive timestamp of the server, local time in microseconds since 1970.
+ * @param t3_us Transmit timestamp of the server, local time in microseconds since 1970.
+ * @return What was done with the sample.
+ */
+NtpSampleResult ntp_discipline_sample(NtpDiscipline *discipline, uint64_t t1_us, uint64_t t4_us, int64_t t2_us, int64_t t3_us);
+
+#endif // NTPDISC_H
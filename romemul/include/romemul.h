@@ -30,6 +30,8 @@ typedef void (*IRQInterceptionCallback)();
 
 extern int read_addr_rom_dma_channel;
 extern int lookup_data_rom_dma_channel;
+extern int read_rom_sm;
+extern PIO default_pio;
 
 // Function Prototypes
 int init_romemul(IRQInterceptionCallback requestCallback, IRQInterceptionCallback responseCallback, bool copyFlashToRAM);
@@ -43,8 +43,12 @@
 #include "commands.h"
 #include "romemul.h"
 #include "network.h"
+#include "wifimgr.h"
+#include "ftpserver.h"
 #include "filesys.h"
 #include "usb_mass.h"
+#include "bootprof.h"
+#include "dirindex.h"
 
 // Size of the random seed to use in the sync commands
 #define RANDOM_SEED_SIZE 4 // 4 bytes
@@ -58,4 +62,20 @@ void __not_in_flash_func(dma_irq_handler_lookup_callback)(void);
 // Declare the function to initialize the firmware
 int init_firmware();
 
+/**
+ * @brief Prepares the configurator: the protocol parser, the SD card, the shared memory and the
+ * network. init_firmware() calls it once the ROM emulator runs. The host tests call it instead of
+ * init_firmware().
+ */
+void romloader_setup(void);
+
+/**
+ * @brief One pass of the loop of init_firmware(): serves the commands received by the DMA IRQ
+ * handler and polls the network and the SD card.
+ *
+ * @return false once a ROM, an emulator or the default config is selected. init_firmware() then
+ * loads it and the board reboots.
+ */
+bool romloader_poll(void);
+
 #endif // ROMLOADER_H
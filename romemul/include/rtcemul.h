@@ -16,6 +16,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
@@ -31,6 +32,8 @@
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
 
+#include "ntpdisc.h"
+#include "dallas.h"
 #include "sd_card.h"
 #include "f_util.h"
 #include "ff.h"
@@ -41,6 +44,7 @@
 #include "commands.h"
 #include "config.h"
 #include "network.h"
+#include "wifimgr.h"
 #include "filesys.h"
 
 #define RTCEMUL_RANDOM_TOKEN 0x0                             // Offset from 0x0000 of the shared memory buffer
@@ -70,22 +74,6 @@ typedef struct NTP_TIME_T
     bool ntp_error;
 } NTP_TIME;
 
-// DAllas RTC. Info here: https://pdf1.alldatasheet.es/datasheet-pdf/view/58439/DALLAS/DS1216.html
-typedef struct
-{
-    uint64_t last_magic_found;
-    uint16_t retries;
-    uint64_t magic_sequence_hex;
-    uint8_t clock_sequence[64];
-    uint8_t read_address_bit;
-    uint8_t write_address_bit_zero;
-    uint8_t write_address_bit_one;
-    uint8_t magic_sequence[66];
-    uint16_t size_magic_sequence;
-    uint16_t size_clock_sequence;
-    uint32_t rom_address;
-} DallasClock;
-
 typedef void (*IRQInterceptionCallback)();
 
 extern int read_addr_rom_dma_channel;
@@ -97,6 +85,20 @@ void __not_in_flash_func(rtcemul_dma_irq_handler_lookup_callback)(void);
 // Function Prototypes
 int init_rtcemul(bool safe_config_reboot);
 
+/**
+ * @brief Prepares the clock of the RTC emulator: the type of clock, the SD card and the time from
+ * the NTP server. init_rtcemul() calls it before its loop. The host tests call it instead of init_rtcemul().
+ *
+ * @param safe_config_reboot The SELECT button only sets the configurator for the next power cycle.
+ */
+void rtcemul_setup(bool safe_config_reboot);
+
+/**
+ * @brief One pass of the loop of init_rtcemul(): prepares the next second of the Dallas clock and
+ * serves the commands received by the DMA IRQ handler.
+ */
+void rtcemul_poll(void);
+
 void host_found_callback(const char *name, const ip_addr_t *ipaddr, void *arg);
 void set_internal_rtc();
 void ntp_init();
@@ -104,6 +106,8 @@ datetime_t *get_rtc_time();
 NTP_TIME *get_net_time();
 long get_utc_offset_seconds();
 void set_utc_offset_seconds(long offset);
+bool ntp_discipline_poll();
+const NtpDiscipline *get_ntp_discipline();
 uint8_t to_bcd(uint8_t val);
 uint8_t add_bcd(uint8_t bcd1, uint8_t bcd2);
 
@@ -11,6 +11,8 @@
 
 #include "debug.h"
 #include "constants.h"
+#include "busstats.h"
+#include "capture.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,7 +20,7 @@
 
 #define PROTOCOL_HEADER 0xABCD
 #define PROTOCOL_READ_RESTART_MICROSECONDS 10000
-#define MAX_PROTOCOL_PAYLOAD_SIZE 2048 + 64 // 1024 bytes of payload plus 64 bytes of overhead for safety
+#define MAX_PROTOCOL_PAYLOAD_SIZE (2048 + 64) // 1024 bytes of payload plus 64 bytes of overhead for safety
 
 #define SHOW_COMMANDS 0 // Set to 1 to show commands received
 
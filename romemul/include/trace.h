@@ -0,0 +1,90 @@
+/**
+ * File: trace.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the binary trace ring used in the hot paths instead of DPRINTF
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "debug.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "commands.h"
+
+#define TRACE_RING_SIZE 512  // Records. Must be a power of two
+#define TRACE_DRAIN_BATCH 1  // Records formatted in each call. A line takes ~5ms at 115200 bauds
+#define TRACE_LINE_PREFIX "@T" // Lines of the drain, for the host decoder (trace_decode.py)
+
+// Events of the trace. The order sets the numeric ID of each event
+#define TRACE_EVENTS(X)                                                         \
+    X(TRACE_GEMDRIVE_COMMAND) /* IRQ. arg0: command, arg1: payload size */      \
+    X(TRACE_GEMDRIVE_START)   /* arg0: command */                               \
+    X(TRACE_GEMDRIVE_END)     /* arg0: command */                               \
+    X(TRACE_DTA_LOOKUP)       /* arg0: found, arg1: key, arg2: nodes visited */ \
+    X(TRACE_FLOPPY_COMMAND)   /* IRQ. arg0: command, arg1: sector, arg2: disk */ \
+    X(TRACE_FLOPPY_READ)      /* arg0: disk, arg1: sector, arg2: checksum */    \
+    X(TRACE_FLOPPY_WRITE)     /* arg0: disk, arg1: sector, arg2: checksum */    \
+    X(TRACE_USB_READ)         /* arg0: read ahead hit, arg1: LBA, arg2: count */ \
+    X(TRACE_USB_WRITE)        /* arg1: LBA, arg2: count */                      \
+    X(TRACE_USB_COMMIT)       /* arg0: ok, arg1: LBA, arg2: count */
+
+typedef enum
+{
+#define TRACE_EVENT_ENUM(name) name,
+    TRACE_EVENTS(TRACE_EVENT_ENUM)
+#undef TRACE_EVENT_ENUM
+        TRACE_EVENT_COUNT
+} TraceEvent;
+
+typedef struct
+{
+    uint32_t time_us; // Lower 32 bits of the microseconds timer. Wraps every 71 minutes
+    uint16_t event;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+} TraceRecord;
+
+#if defined(_DEBUG) && (_DEBUG != 0)
+extern TraceRecord trace_ring[TRACE_RING_SIZE];
+extern uint32_t trace_head;
+
+/**
+ * @brief Appends a record to the ring. Safe in interrupt handlers. Only a few cycles: the record
+ * is formatted later by trace_drain. When the ring is full the oldest records are lost.
+ */
+static __force_inline void trace_record(uint16_t event, uint16_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    uint32_t irq = save_and_disable_interrupts();
+    TraceRecord *record = &trace_ring[trace_head++ & (TRACE_RING_SIZE - 1)];
+    record->time_us = timer_hw->timerawl;
+    record->event = event;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    record->arg2 = arg2;
+    restore_interrupts(irq);
+}
+#endif
+
+/**
+ * @brief Formats up to TRACE_DRAIN_BATCH pending records to the debug output. Call it from the
+ * main loop when the emulator is idle.
+ */
+void trace_drain(void);
+
+#if defined(_DEBUG) && (_DEBUG != 0)
+#define TRACE(event, arg0, arg1, arg2) trace_record((event), (uint16_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2))
+#else
+#define TRACE(event, arg0, arg1, arg2)
+#endif
+
+#endif // TRACE_H
@@ -29,13 +29,52 @@
 #include "hardware/resets.h"
 
 #include "include/config.h"
+#include "include/blkarb.h"
+#include "include/trace.h"
 
 #define USBDRIVE_READ_ONLY false
 
 #define TUD_OPT_HIGH_SPEED true
 
+// A run is a block of consecutive sectors moved with one multi-block SD transfer
+#define USB_MASS_RUN_SIZE CFG_TUD_MSC_EP_BUFSIZE
+#define USB_MASS_WRITE_IDLE_MS 20 // Staged writes are committed after this time without new writes
+#define USB_MASS_SCSI_CMD_SYNCHRONIZE_CACHE_10 0x35
+
+typedef struct
+{
+    uint32_t lba;    // First sector of the run
+    uint32_t count;  // Sectors in the buffer. 0 if empty
+    bool pending;    // Closed write run waiting to be committed
+    uint8_t regions; // Regions locked by the staged blocks of a write run
+    uint8_t data[USB_MASS_RUN_SIZE];
+} UsbMassRun;
+
 // Init USB Mass storage device
 void usb_mass_init(void);
 void usb_mass_start(void);
 
+/**
+ * @brief Starts the USB mass storage next to GEMDRIVE. Unlike usb_mass_init, it returns immediately
+ * and the caller must call usb_mass_poll from its main loop.
+ *
+ * @return true if the SD card is ready and the USB device was started.
+ */
+bool usb_mass_init_shared(void);
+
+/**
+ * @brief Returns true if the USB mass storage was started with usb_mass_init_shared.
+ */
+bool usb_mass_is_shared(void);
+
+/**
+ * @brief Serves the USB host. Never blocks for more than one SD card transfer.
+ */
+void usb_mass_poll(void);
+
+/**
+ * @brief Commits the writes of the USB host still in the staging buffers.
+ */
+void usb_mass_flush(void);
+
 #endif // USB_MASS_H
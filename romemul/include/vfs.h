@@ -36,6 +36,8 @@ typedef struct {
 	long st_size;
 	char st_mode;
 	time_t st_mtime;
+	unsigned short st_fdate; /* FAT date and time, as in FILINFO */
+	unsigned short st_ftime;
 } vfs_stat_t;
 typedef struct {
 	char name[13];
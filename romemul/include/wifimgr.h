@@ -0,0 +1,112 @@
+/**
+ * File: wifimgr.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Header file for the non-blocking Wi-Fi connection manager shared by the emulators
+ */
+
+#ifndef WIFIMGR_H
+#define WIFIMGR_H
+
+#include "debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "network.h"
+
+#define WIFI_MANAGER_CHECK_CONNECTING_MS 50   // Link status checks while joining
+#define WIFI_MANAGER_CHECK_CONNECTED_MS 1000  // Link status checks while connected, besides the link events
+#define WIFI_MANAGER_JOIN_TIMEOUT_MS 10000    // A join without result is considered failed after this time
+#define WIFI_MANAGER_RETRY_MS 1000            // First wait after a failed join
+#define WIFI_MANAGER_RETRY_MAX_MS 30000       // Maximum wait after a failed join
+
+typedef enum
+{
+    WIFI_MANAGER_STOPPED,    // Not started or stopped
+    WIFI_MANAGER_CONNECTING, // Joining the network or waiting for the IP address
+    WIFI_MANAGER_CONNECTED,  // Connected with an IP address
+    WIFI_MANAGER_RETRYING,   // The last join failed. Waiting to try again
+    WIFI_MANAGER_TIMEOUT     // No connection before the timeout. The network stack is released
+} WifiManagerState;
+
+// Called when the state changes
+typedef void (*wifi_manager_callback_t)(WifiManagerState state, void *arg);
+
+typedef struct
+{
+    WifiManagerState state;
+    ConnectionStatus status; // Last link status read
+    char **pass;             // Content of the password file, or NULL
+    uint32_t timeout_ms;     // Timeout of the first connection. 0 never gives up
+    uint64_t start_us;       // Start of the connection, for the timeout
+    uint64_t attempt_us;     // Start of the current join
+    uint64_t retry_us;       // Time of the next join when retrying
+    uint32_t retry_delay_ms;
+    uint64_t check_us;       // Time of the last link status check
+    bool ap_cached;          // The access point of the last connection is known
+    uint8_t bssid[6];
+    uint32_t channel;
+    bool fast_join;          // The current join uses the cached access point
+    uint64_t lost_us;        // When the link was lost. 0 if it was not lost
+    uint32_t reconnects;
+    uint32_t last_reconnect_ms; // Time to recover the last lost link
+    wifi_manager_callback_t callback;
+    void *arg;
+} WifiManager;
+
+/**
+ * @brief Starts connecting to the configured network. It returns immediately.
+ *
+ * If the manager is already running, the connection is dropped and started again without the cached
+ * access point. Call it again after changing the credentials.
+ *
+ * @param pass The content of the password file, or a pointer to NULL to use the password of the config.
+ * @param timeout_ms Give up and release the network stack if the first connection takes longer. 0 never gives up.
+ * @param callback Function called when the state changes, or NULL.
+ * @param arg Argument passed to the callback.
+ */
+void wifi_manager_start(char **pass, uint32_t timeout_ms, wifi_manager_callback_t callback, void *arg);
+
+/**
+ * @brief Advances the connection. Never blocks. Call it from the main loop.
+ *
+ * Polls the network stack. The link status is only read after a link event of the network
+ * stack or every few milliseconds, not in every call. A lost link is joined again with the
+ * cached access point and channel, so the scan is skipped.
+ *
+ * @return The state of the connection.
+ */
+WifiManagerState wifi_manager_poll();
+
+/**
+ * @brief Stops the manager and releases the network stack.
+ */
+void wifi_manager_stop();
+
+/**
+ * @brief Returns the state of the connection without reading the link status.
+ *
+ * @return The state of the connection.
+ */
+WifiManagerState wifi_manager_get_state();
+
+/**
+ * @brief Returns the last link status read by the manager.
+ *
+ * @return The link status.
+ */
+ConnectionStatus wifi_manager_get_status();
+
+/**
+ * @brief Returns the manager, for the statistics.
+ *
+ * @return The manager.
+ */
+const WifiManager *wifi_manager_get();
+
+#endif // WIFIMGR_H
@@ -0,0 +1,142 @@
+/**
+ * File: jsonesc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Escaping of UTF-8 strings inside JSON strings, with ASCII output
+ */
+
+#include "include/jsonesc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define JSONESC_REPLACEMENT 0xFFFD
+
+// Decode one UTF-8 character. Overlong forms, surrogates, values beyond U+10FFFF and truncated
+// sequences are invalid: only the first byte is taken and the character is U+FFFD
+static size_t json_decode_utf8(const uint8_t *src, uint32_t *codepoint)
+{
+    uint8_t lead = src[0];
+    size_t length;
+    uint8_t min = 0x80; // Range of the second byte
+    uint8_t max = 0xBF;
+    if (lead < 0x80)
+    {
+        *codepoint = lead;
+        return 1;
+    }
+    if ((lead >= 0xC2) && (lead <= 0xDF))
+    {
+        length = 2;
+        *codepoint = lead & 0x1F;
+    }
+    else if ((lead >= 0xE0) && (lead <= 0xEF))
+    {
+        length = 3;
+        *codepoint = lead & 0x0F;
+        min = (lead == 0xE0) ? 0xA0 : min;
+        max = (lead == 0xED) ? 0x9F : max;
+    }
+    else if ((lead >= 0xF0) && (lead <= 0xF4))
+    {
+        length = 4;
+        *codepoint = lead & 0x07;
+        min = (lead == 0xF0) ? 0x90 : min;
+        max = (lead == 0xF4) ? 0x8F : max;
+    }
+    else
+    {
+        *codepoint = JSONESC_REPLACEMENT;
+        return 1;
+    }
+    for (size_t i = 1; i < length; i++)
+    {
+        uint8_t c = src[i]; // The NUL ends the string, and it is never a continuation byte
+        if ((c < min) || (c > max))
+        {
+            *codepoint = JSONESC_REPLACEMENT;
+            return 1;
+        }
+        *codepoint = (*codepoint << 6) | (c & 0x3F);
+        min = 0x80;
+        max = 0xBF;
+    }
+    return length;
+}
+
+size_t json_escape(char *dest, size_t dest_size, const char *src, size_t *written)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    size_t consumed = 0;
+    size_t pos = 0;
+    while (in[consumed] != '\0')
+    {
+        char sequence[JSONESC_MAX_SEQUENCE + 1];
+        int sequence_length;
+        uint32_t codepoint;
+        size_t length = json_decode_utf8(in + consumed, &codepoint);
+        switch (codepoint)
+        {
+        case '"':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\\"");
+            break;
+        case '\\':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\\\");
+            break;
+        case '\b':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\b");
+            break;
+        case '\f':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\f");
+            break;
+        case '\n':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\n");
+            break;
+        case '\r':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\r");
+            break;
+        case '\t':
+            sequence_length = snprintf(sequence, sizeof(sequence), "\\t");
+            break;
+        default:
+            if ((codepoint >= 0x20) && (codepoint < 0x7F))
+            {
+                sequence[0] = (char)codepoint;
+                sequence_length = 1;
+            }
+            else if (codepoint <= 0xFFFF)
+            {
+                sequence_length = snprintf(sequence, sizeof(sequence), "\\u%04X", (unsigned int)codepoint);
+            }
+            else
+            {
+                codepoint -= 0x10000;
+                sequence_length = snprintf(sequence, sizeof(sequence), "\\u%04X\\u%04X",
+                                           (unsigned int)(0xD800 + (codepoint >> 10)),
+                                           (unsigned int)(0xDC00 + (codepoint & 0x3FF)));
+            }
+            break;
+        }
+        // Never split a character, and keep room for the NUL
+        if (pos + sequence_length >= dest_size)
+        {
+            break;
+        }
+        for (int i = 0; i < sequence_length; i++)
+        {
+            dest[pos++] = sequence[i];
+        }
+        consumed += length;
+    }
+    if (dest_size > 0)
+    {
+        dest[pos] = '\0';
+    }
+    if (written != NULL)
+    {
+        *written = pos;
+    }
+    return consumed;
+}
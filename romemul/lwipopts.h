@@ -104,8 +104,12 @@
 #define LWIP_HTTPD_SSI 1
 #define LWIP_HTTPD_CGI 1
 // don't include the tag comment - less work for the CPU, but may be harder to debug
-#define LWIP_HTTPD_SSI_INCLUDE_TAG 1
+// The JSON documents of the web API are generated by SSI tags, so the tag comment must not be included
+#define LWIP_HTTPD_SSI_INCLUDE_TAG 0
 #define LWIP_HTTPD_SSI_MULTIPART 1
+// File uploads. The body of the POST is acknowledged only after it is written to the SD card
+#define LWIP_HTTPD_SUPPORT_POST 1
+#define LWIP_HTTPD_POST_MANUAL_WND 1
 
 #define HTTPD_FSDATA_FILE "my_fsdata.c"
 
@@ -11,6 +11,20 @@
 #include "include/floppyemul.h"
 #include "include/rtcemul.h"
 #include "include/gemdrvemul.h"
+#include "include/bootprof.h"
+
+// Init the CYW43 WiFi module. It is only needed for the LED, the VBUS detection and the network,
+// so it is called after the ROM emulator is already serving the bus
+static bool init_cyw43()
+{
+    if (cyw43_arch_init())
+    {
+        DPRINTF("Wi-Fi init failed\n");
+        return false;
+    }
+    bootprof_mark("cyw43");
+    return true;
+}
 
 int main()
 {
@@ -25,12 +39,15 @@ int main()
     gpio_set_dir(SELECT_GPIO, GPIO_IN);
     gpio_set_pulls(SELECT_GPIO, false, true); // Pull down (false, true)
     gpio_pull_down(SELECT_GPIO);
+    bootprof_mark("clocks");
 
 #if _DEBUG
     // Initialize chosen serial port
     stdio_init_all();
     setvbuf(stdout, NULL, _IONBF, 1); // specify that the stream should be unbuffered
 #endif
+    bootprof_mark("stdio");
+
     // Only startup information to display
     DPRINTF("\n\nSidecart ROM emulator. %s (%s). %s mode.\n\n", RELEASE_VERSION, RELEASE_DATE, _DEBUG ? "DEBUG" : "RELEASE");
 
@@ -42,36 +59,29 @@ int main()
     DPRINTF("Voltage: %s\n", current_voltage);
 #endif
 
-    // Init the CYW43 WiFi module
-    if (cyw43_arch_init())
-    {
-        DPRINTF("Wi-Fi init failed\n");
-        return -1;
-    }
-
     // Load the config from FLASH
     load_all_entries();
+    bootprof_mark("config");
 
-    ConfigEntry *default_config_entry = find_entry(PARAM_BOOT_FEATURE);
-    DPRINTF("BOOT_FEATURE: %s\n", default_config_entry->value);
+    DPRINTF("BOOT_FEATURE: %s\n", find_entry_by_id(CONFIG_KEY_BOOT_FEATURE)->value);
+    DPRINTF("SAFE_CONFIG_REBOOT: %s\n", find_entry_by_id(CONFIG_KEY_SAFE_CONFIG_REBOOT)->value);
 
-    ConfigEntry *default_config_reboot_mode = find_entry(PARAM_SAFE_CONFIG_REBOOT);
-    DPRINTF("SAFE_CONFIG_REBOOT: %s\n", default_config_reboot_mode->value);
-
-    bool safe_config_reboot = default_config_reboot_mode->value[0] == 't' || default_config_reboot_mode->value[0] == 'T';
+    bool safe_config_reboot = configSnapshot.safe_config_reboot;
 
 // Check the different modes
     DPRINTF("Testing the different modes\n");
-    if (strcmp(default_config_entry->value, "ROM_EMULATOR") == 0)
+    if (configSnapshot.boot_feature == BOOT_FEATURE_ROM_EMULATOR)
     {
         DPRINTF("No SELECT button pressed. ROM_EMULATOR entry found in config. Launching.\n");
 
         // Check if Delay ROM emulation (ripper style boot) is true
-        ConfigEntry *rom_delay_config_entry = find_entry(PARAM_DELAY_ROM_EMULATION);
-        DPRINTF("DELAY_ROM_EMULATION: %s\n", rom_delay_config_entry->value);
-        if ((strcmp(rom_delay_config_entry->value, "true") == 0) || (strcmp(rom_delay_config_entry->value, "TRUE") == 0) || (strcmp(rom_delay_config_entry->value, "T") == 0))
+        DPRINTF("DELAY_ROM_EMULATION: %s\n", find_entry_by_id(CONFIG_KEY_DELAY_ROM_EMULATION)->value);
+        bool cyw43_ready = false;
+        if (configSnapshot.delay_rom_emulation)
         {
             DPRINTF("Delaying ROM emulation.\n"); // Always print this line
+            // The bus is not emulated yet, so there is no hurry to start the LED
+            cyw43_ready = init_cyw43();
             // The "D" character stands for "Delay"
             blink_morse('D');
 
@@ -95,14 +105,25 @@ int main()
         // Canonical way to initialize the ROM emulator:
         // No IRQ handler callbacks, copy the FLASH ROMs to RAM, and start the state machine
         init_romemul(NULL, NULL, true);
+        bootprof_mark("romemul");
 
         DPRINTF("ROM Emulation started.\n"); // Always print this line
 
-        // The "E" character stands for "Emulator"
-        blink_morse('E');
+        // The CYW43 is only needed to blink the LED
+        if (!cyw43_ready)
+        {
+            cyw43_ready = init_cyw43();
+        }
+        bootprof_print();
 
-        // Deinit the CYW43 WiFi module. DO NOT INTERRUPT, BUDDY!
-        cyw43_arch_deinit();
+        if (cyw43_ready)
+        {
+            // The "E" character stands for "Emulator"
+            blink_morse('E');
+
+            // Deinit the CYW43 WiFi module. DO NOT INTERRUPT, BUDDY!
+            cyw43_arch_deinit();
+        }
 
         bool write_config_only_once = true;
         // Loop forever and block until the state machine put data into the FIFO
@@ -119,13 +140,14 @@ int main()
         }
     }
 
-    if (strcmp(default_config_entry->value, "FLOPPY_EMULATOR") == 0)
+    if (configSnapshot.boot_feature == BOOT_FEATURE_FLOPPY_EMULATOR)
     {
         DPRINTF("FLOPPY_EMULATOR entry found in config. Launching.\n");
 
         // Copy the ST floppy firmware emulator to RAM
         // Copy the firmware to RAM
         COPY_FIRMWARE_TO_RAM((uint16_t *)floppyemulROM, floppyemulROM_length);
+        bootprof_mark("firmware");
 
         // Reserve memory for the protocol parser
         init_protocol_parser();
@@ -135,21 +157,28 @@ int main()
         // IRQ handler callback to read the commands in ROM3, and NOT copy the FLASH ROMs to RAM
         // and start the state machine
         init_romemul(NULL, floppyemul_dma_irq_handler_lookup_callback, false);
+        bootprof_mark("romemul");
+
+        if (!init_cyw43())
+        {
+            return -1;
+        }
 
         change_spi_speed();
 
         DPRINTF("Ready to accept commands.\n");
+        bootprof_print();
 
         init_floppyemul(safe_config_reboot);
 
         // You should never reach this line...
     }
 
-    if (strcmp(default_config_entry->value, "RTC_EMULATOR") == 0)
+    if (configSnapshot.boot_feature == BOOT_FEATURE_RTC_EMULATOR)
     {
         DPRINTF("RTC_EMULATOR entry found in config. Launching.\n");
 
-        char *rtc_type_str = find_entry(PARAM_RTC_TYPE)->value;
+        char *rtc_type_str = find_entry_by_id(CONFIG_KEY_RTC_TYPE)->value;
         if (strcmp(rtc_type_str, "SIDECART") == 0)
         {
             // Copy the ST RTC firmware emulator to RAM
@@ -159,6 +188,7 @@ int main()
         {
             ERASE_FIRMWARE_IN_RAM();
         }
+        bootprof_mark("firmware");
 
         // Reserve memory for the protocol parser
         init_protocol_parser();
@@ -168,8 +198,15 @@ int main()
         // IRQ handler callback to read the commands in ROM3, and NOT copy the FLASH ROMs to RAM
         // and start the state machine
         init_romemul(NULL, rtcemul_dma_irq_handler_lookup_callback, false);
+        bootprof_mark("romemul");
+
+        if (!init_cyw43())
+        {
+            return -1;
+        }
 
         DPRINTF("Ready to accept commands.\n");
+        bootprof_print();
 
         // The "T" character stands for "TIME"
         blink_morse('T');
@@ -179,12 +216,13 @@ int main()
         // You should never reach this line...
     }
 
-    if (strcmp(default_config_entry->value, "GEMDRIVE_EMULATOR") == 0)
+    if (configSnapshot.boot_feature == BOOT_FEATURE_GEMDRIVE_EMULATOR)
     {
         DPRINTF("GEMDRIVE_EMULATOR entry found in config. Launching.\n");
 
         // Copy the GEMDRIVE firmware emulator to RAM
         COPY_FIRMWARE_TO_RAM((uint16_t *)gemdrvemulROM, gemdrvemulROM_length);
+        bootprof_mark("firmware");
 
         // Reserve memory for the protocol parser
         init_protocol_parser();
@@ -193,18 +231,23 @@ int main()
         // IRQ handler callback to read the commands in ROM3, and NOT copy the FLASH ROMs to RAM
         // and start the state machine
         init_romemul(NULL, gemdrvemul_dma_irq_handler_lookup_callback, false);
+        bootprof_mark("romemul");
 
-#if _DEBUG
-        //  Check if the USB is connected. If so, check if the SD card is inserted and initialize the USB Mass storage device
+        if (!init_cyw43())
+        {
+            return -1;
+        }
+
+        //  Check if the USB is connected. If so, share the SD card with the USB host while GEMDRIVE serves the Atari ST
         if (cyw43_arch_gpio_get(CYW43_WL_GPIO_VBUS_PIN))
         {
             DPRINTF("USB connected\n");
-            usb_mass_init();
+            usb_mass_init_shared();
         }
-#endif
         change_spi_speed();
 
         DPRINTF("Ready to accept commands.\n");
+        bootprof_print();
 
         // The "H" character stands for "HARDISK"
         blink_morse('H');
@@ -218,6 +261,11 @@ int main()
 
     DPRINTF("If you are here, you must ALWAYS enter into configuration mode.\n");
 
+    if (!init_cyw43())
+    {
+        return -1;
+    }
+
     //  Check if the USB is connected. If so, check if the SD card is inserted and initialize the USB Mass storage device
     if (cyw43_arch_gpio_get(CYW43_WL_GPIO_VBUS_PIN))
     {
@@ -230,6 +278,7 @@ int main()
         DPRINTF("USB connected\n");
         usb_mass_init();
     }
+    bootprof_mark("usb");
 
     DPRINTF("Launch configurator.\n");
 
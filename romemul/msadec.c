@@ -0,0 +1,216 @@
+/**
+ * File: msadec.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Streaming MSA to ST decoder. Only one cylinder is kept in memory.
+ * The format is described in filesys.c
+ */
+
+#include "include/msadec.h"
+
+static uint16_t read_word_be(const uint8_t *data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static bool parse_header(MsaDecoder *decoder)
+{
+    uint16_t id = read_word_be(&decoder->raw_header[0]);
+    decoder->sectors_per_track = read_word_be(&decoder->raw_header[2]);
+    uint16_t sides = read_word_be(&decoder->raw_header[4]);
+    decoder->starting_track = read_word_be(&decoder->raw_header[6]);
+    decoder->ending_track = read_word_be(&decoder->raw_header[8]);
+    DPRINTF("MSA Header: ID: %x\n", id);
+    DPRINTF("MSA Header: SectorsPerTrack: %d\n", decoder->sectors_per_track);
+    DPRINTF("MSA Header: Sides: %d\n", sides);
+    DPRINTF("MSA Header: StartingTrack: %d\n", decoder->starting_track);
+    DPRINTF("MSA Header: EndingTrack: %d\n", decoder->ending_track);
+
+    if (id != MSA_ID_MARKER || decoder->ending_track > MSA_MAX_ENDING_TRACK || decoder->starting_track > decoder->ending_track || decoder->sectors_per_track > MSA_MAX_SECTORS_PER_TRACK || sides > 1)
+    {
+        DPRINTF("MSA image has a bad header!\n");
+        return false;
+    }
+
+    decoder->sides = sides + 1;
+    decoder->track_size = MSA_BYTES_PER_SECTOR * decoder->sectors_per_track;
+    // One buffer for the whole cylinder, reused for all the tracks
+    decoder->cylinder_buffer = malloc((uint32_t)decoder->track_size * decoder->sides);
+    if (decoder->cylinder_buffer == NULL)
+    {
+        DPRINTF("Not enough memory for the MSA cylinder buffer\n");
+        return false;
+    }
+    decoder->track = decoder->starting_track;
+    decoder->side = 0;
+    return true;
+}
+
+static uint8_t *track_output(MsaDecoder *decoder)
+{
+    return decoder->cylinder_buffer + (uint32_t)decoder->side * decoder->track_size + decoder->track_pos;
+}
+
+// Move to the next track. The cylinder is written when all its sides are decoded
+static void end_track(MsaDecoder *decoder)
+{
+    // Incorrect images could not fill the track. The rest is left as zeroes
+    memset(track_output(decoder), 0, decoder->track_size - decoder->track_pos);
+    decoder->input_pos = 0;
+    decoder->track_pos = 0;
+    decoder->run_pos = 0;
+    if (++decoder->side == decoder->sides)
+    {
+        if (!decoder->write(decoder->arg, decoder->cylinder_buffer, (uint32_t)decoder->track_size * decoder->sides))
+        {
+            DPRINTF("MSA error writing track %d\n", decoder->track);
+            decoder->state = MSA_DECODER_ERROR;
+            return;
+        }
+        decoder->side = 0;
+        decoder->track++;
+    }
+    decoder->state = decoder->track > decoder->ending_track ? MSA_DECODER_DONE : MSA_DECODER_TRACK_LENGTH;
+}
+
+// Copy bytes to the current track. The bytes that do not fit are discarded
+static void copy_bytes(MsaDecoder *decoder, const uint8_t *data, uint16_t length)
+{
+    uint16_t room = decoder->track_size - decoder->track_pos;
+    uint16_t count = length < room ? length : room;
+    memcpy(track_output(decoder), data, count);
+    decoder->track_pos += count;
+}
+
+// Decode as many bytes of the current track as possible. Returns the bytes consumed
+static uint16_t decode_track_data(MsaDecoder *decoder, const uint8_t *data, uint16_t length)
+{
+    // Uncompressed tracks are copied as they are
+    if (decoder->data_length == decoder->track_size)
+    {
+        copy_bytes(decoder, data, length);
+        return length;
+    }
+
+    // Compressed run: marker, data byte and run length word
+    uint16_t pos = 0;
+    while (pos < length)
+    {
+        if (decoder->run_pos == 0)
+        {
+            // Copy the literal bytes up to the next marker in one go
+            const uint8_t *marker = memchr(data + pos, MSA_RLE_MARKER, length - pos);
+            uint16_t literals = (marker == NULL) ? (length - pos) : (uint16_t)(marker - (data + pos));
+            copy_bytes(decoder, data + pos, literals);
+            pos += literals;
+            if (marker != NULL)
+            {
+                decoder->run_pos = 1;
+                pos++;
+            }
+            continue;
+        }
+        uint8_t byte = data[pos++];
+        switch (decoder->run_pos)
+        {
+        case 1:
+            decoder->run_data = byte;
+            decoder->run_pos = 2;
+            break;
+        case 2:
+            decoder->run_length = byte << 8;
+            decoder->run_pos = 3;
+            break;
+        case 3:
+            decoder->run_length |= byte;
+            decoder->run_pos = 0;
+            /* Limit length to size of track, incorrect images may overflow */
+            if (decoder->run_length > decoder->track_size - decoder->track_pos)
+            {
+                DPRINTF("MSA_UnCompress: Illegal run length -> corrupted disk image?\n");
+                decoder->run_length = decoder->track_size - decoder->track_pos;
+            }
+            memset(track_output(decoder), decoder->run_data, decoder->run_length);
+            decoder->track_pos += decoder->run_length;
+            break;
+        }
+    }
+    return length;
+}
+
+void msa_decoder_init(MsaDecoder *decoder, msa_write_t write, void *arg)
+{
+    memset(decoder, 0, sizeof(MsaDecoder));
+    decoder->state = MSA_DECODER_HEADER;
+    decoder->write = write;
+    decoder->arg = arg;
+}
+
+bool msa_decoder_feed(MsaDecoder *decoder, const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+    while ((i < length) && (decoder->state != MSA_DECODER_ERROR) && (decoder->state != MSA_DECODER_DONE))
+    {
+        switch (decoder->state)
+        {
+        case MSA_DECODER_HEADER:
+            decoder->raw_header[decoder->input_pos++] = data[i++];
+            if (decoder->input_pos == MSA_HEADER_SIZE)
+            {
+                decoder->input_pos = 0;
+                decoder->state = parse_header(decoder) ? MSA_DECODER_TRACK_LENGTH : MSA_DECODER_ERROR;
+            }
+            break;
+        case MSA_DECODER_TRACK_LENGTH:
+            decoder->data_length = (decoder->data_length << 8) | data[i++];
+            if (++decoder->input_pos == sizeof(uint16_t))
+            {
+                decoder->input_pos = 0;
+                decoder->state = MSA_DECODER_TRACK_DATA;
+                if (decoder->data_length == 0)
+                {
+                    end_track(decoder);
+                }
+            }
+            break;
+        case MSA_DECODER_TRACK_DATA:
+        {
+            // The whole track data is consumed even if it expands beyond the track size
+            uint16_t pending = decoder->data_length - decoder->input_pos;
+            uint16_t chunk = (length - i) < pending ? (uint16_t)(length - i) : pending;
+            decoder->input_pos += decode_track_data(decoder, data + i, chunk);
+            i += chunk;
+            if (decoder->input_pos == decoder->data_length)
+            {
+                end_track(decoder);
+            }
+            break;
+        }
+        case MSA_DECODER_DONE:
+        case MSA_DECODER_ERROR:
+            break;
+        }
+    }
+    return decoder->state != MSA_DECODER_ERROR;
+}
+
+uint32_t msa_decoder_image_size(const MsaDecoder *decoder)
+{
+    return (uint32_t)decoder->track_size * decoder->sides * (decoder->ending_track - decoder->starting_track + 1);
+}
+
+bool msa_decoder_finish(MsaDecoder *decoder)
+{
+    if (decoder->cylinder_buffer != NULL)
+    {
+        free(decoder->cylinder_buffer);
+        decoder->cylinder_buffer = NULL;
+    }
+    if (decoder->state != MSA_DECODER_DONE)
+    {
+        DPRINTF("MSA error: Premature end of file!\n");
+        return false;
+    }
+    return true;
+}
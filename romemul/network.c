@@ -7,6 +7,7 @@ static char wifi_hostname[32];
 static ip_addr_t current_ip;
 static uint8_t cyw43_mac[6];
 static bool cyw43_initialized = false;
+static volatile bool link_event = false; // The link or the IP address changed since the last check
 
 static char latest_release_version[80] = "v0.0.0";
 
@@ -192,6 +193,7 @@ static int16_t get_rssi(void)
 void wifi_link_callback(struct netif *netif)
 {
     DPRINTF("WiFi Link: %s\n", (netif_is_link_up(netif) ? "UP" : "DOWN"));
+    link_event = true;
 }
 
 void network_status_callback(struct netif *netif)
@@ -205,6 +207,14 @@ void network_status_callback(struct netif *netif)
     {
         DPRINTF("WiFi Status: DOWN\n");
     }
+    link_event = true;
+}
+
+bool network_take_link_event()
+{
+    bool event = link_event;
+    link_event = false;
+    return event;
 }
 
 // We MUST call this function and avoid the cy43_arch_deinit() function to avoid a crash
@@ -243,12 +253,7 @@ int network_wifi_init()
     cyw43_arch_enable_sta_mode();
 
     // Setting the power management
-    uint32_t pm_value = 0xa11140; // 0: Disable PM
-    ConfigEntry *pm_entry = find_entry(PARAM_WIFI_POWER);
-    if (pm_entry != NULL)
-    {
-        pm_value = strtoul(pm_entry->value, NULL, 16);
-    }
+    uint32_t pm_value = configSnapshot.wifi_power;
     if (pm_value < 5)
     {
         switch (pm_value)
@@ -274,6 +279,22 @@ int network_wifi_init()
     cyw43_wifi_pm(&cyw43_state, pm_value);
 }
 
+// The password of the password file if there is one, or the one of the config. Free it after use
+static char *get_wifi_password(char **pass)
+{
+    if (*pass != NULL)
+    {
+        return strdup(*pass);
+    }
+    ConfigEntry *password = find_entry(PARAM_WIFI_PASSWORD);
+    if (strlen(password->value) > 0)
+    {
+        return strdup(password->value);
+    }
+    DPRINTF("No password found in config. Trying to connect without password\n");
+    return NULL;
+}
+
 int network_init(bool force, bool async, char **pass)
 {
     if (!cyw43_initialized)
@@ -307,7 +328,7 @@ int network_init(bool force, bool async, char **pass)
     netif_set_status_callback(n, network_status_callback);
 
     // DHCP or static IP
-    if ((find_entry(PARAM_WIFI_DHCP) != NULL) && (find_entry(PARAM_WIFI_DHCP)->value[0] == 't' || find_entry(PARAM_WIFI_DHCP)->value[0] == 'T'))
+    if (configSnapshot.wifi_dhcp)
     {
         DPRINTF("DHCP enabled\n");
     }
@@ -386,34 +407,14 @@ int network_init(bool force, bool async, char **pass)
         DPRINTF("No auth mode found in config. Can't connect\n");
         return -4;
     }
-    char *password_value = NULL;
-    if (*pass == NULL)
-    {
-        ConfigEntry *password = find_entry(PARAM_WIFI_PASSWORD);
-        if (strlen(password->value) > 0)
-        {
-            password_value = strdup(password->value);
-        }
-        else
-        {
-            DPRINTF("No password found in config. Trying to connect without password\n");
-        }
-    }
-    else
-    {
-        password_value = strdup(*pass);
-    }
+    char *password_value = get_wifi_password(pass);
     DPRINTF("The password is: %s\n", password_value);
 
     uint32_t auth_value = get_auth_pico_code(atoi(auth_mode->value));
     int error_code = 0;
     if (!async)
     {
-        uint32_t network_timeout = NETWORK_CONNECTION_TIMEOUT;
-        if (find_entry(PARAM_WIFI_CONNECT_TIMEOUT) != NULL)
-        {
-            network_timeout = atoi(find_entry(PARAM_WIFI_CONNECT_TIMEOUT)->value) * 1000;
-        }
+        uint32_t network_timeout = configSnapshot.wifi_connect_timeout_sec * 1000;
         uint16_t retries = 3;
         do
         {
@@ -436,6 +437,56 @@ int network_init(bool force, bool async, char **pass)
     return 0;
 }
 
+int network_rejoin(const uint8_t *bssid, uint32_t channel, char **pass)
+{
+    if (!cyw43_initialized)
+    {
+        return -1;
+    }
+    ConfigEntry *ssid = find_entry(PARAM_WIFI_SSID);
+    ConfigEntry *auth_mode = find_entry(PARAM_WIFI_AUTH);
+    if ((strlen(ssid->value) == 0) || (strlen(auth_mode->value) == 0))
+    {
+        DPRINTF("No SSID or auth mode found in config. Can't connect\n");
+        return -3;
+    }
+    char *password_value = get_wifi_password(pass);
+    uint32_t auth_value = get_auth_pico_code(atoi(auth_mode->value));
+    DPRINTF("Joining SSID=%s on channel %d. ASYNC\n", ssid->value, channel);
+    // Same as cyw43_arch_wifi_connect_bssid_async(), but with the channel so the scan is skipped
+    cyw43_arch_lwip_begin();
+    int error_code = cyw43_wifi_join(&cyw43_state, strlen(ssid->value), (const uint8_t *)ssid->value,
+                                     password_value == NULL ? 0 : strlen(password_value), (const uint8_t *)password_value,
+                                     auth_value, bssid, channel);
+    cyw43_arch_lwip_end();
+    free(password_value);
+    if (error_code != 0)
+    {
+        DPRINTF("Failed to join WiFi: %d\n", error_code);
+        return -5;
+    }
+    return 0;
+}
+
+bool network_get_access_point(uint8_t *bssid, uint32_t *channel)
+{
+    if (!cyw43_initialized)
+    {
+        return false;
+    }
+    // WLC_GET_BSSID and WLC_GET_CHANNEL. The ioctl number is shifted as in get_rssi()
+    uint8_t bssid_buffer[6] = {0};
+    int32_t channel_info[3] = {0}; // Hardware, target and scan channel
+    if ((cyw43_ioctl(&cyw43_state, 23 << 1, sizeof(bssid_buffer), bssid_buffer, CYW43_ITF_STA) != 0) ||
+        (cyw43_ioctl(&cyw43_state, 29 << 1, sizeof(channel_info), (uint8_t *)channel_info, CYW43_ITF_STA) != 0))
+    {
+        return false;
+    }
+    memcpy(bssid, bssid_buffer, sizeof(bssid_buffer));
+    *channel = (uint32_t)channel_info[0];
+    return *channel != 0;
+}
+
 void network_scan()
 {
     if (!cyw43_initialized)
@@ -627,37 +678,19 @@ void network_safe_poll()
 
 uint32_t get_network_status_polling_ms()
 {
-    uint32_t network_status_polling_ms = NETWORK_POLL_INTERVAL * 1000;
-    ConfigEntry *default_network_status_polling_sec = find_entry(PARAM_NETWORK_STATUS_SEC);
-    if (default_network_status_polling_sec != NULL)
+    uint32_t network_status_polling_ms = configSnapshot.network_status_sec * 1000;
+    // If the value is too small, set the minimum value
+    if (network_status_polling_ms < NETWORK_POLL_INTERVAL_MIN * 1000)
     {
-        network_status_polling_ms = atoi(default_network_status_polling_sec->value) * 1000;
-        // If the value is too small, set the minimum value
-        if (network_status_polling_ms < NETWORK_POLL_INTERVAL_MIN * 1000)
-        {
-            network_status_polling_ms = NETWORK_POLL_INTERVAL_MIN * 1000;
-            DPRINTF("NETWORK_STATUS_SEC value too small. Changing to minimum value: %d\n", network_status_polling_ms);
-        }
-    }
-    else
-    {
-        DPRINTF("%s not found in the config file. Using default value: %d\n", PARAM_NETWORK_STATUS_SEC, network_status_polling_ms);
+        network_status_polling_ms = NETWORK_POLL_INTERVAL_MIN * 1000;
+        DPRINTF("NETWORK_STATUS_SEC value too small. Changing to minimum value: %d\n", network_status_polling_ms);
     }
     return network_status_polling_ms;
 }
 
 uint16_t get_wifi_scan_poll_secs()
 {
-    uint16_t value = WIFI_SCAN_POLL_COUNTER;
-    ConfigEntry *default_config_entry = find_entry(PARAM_WIFI_SCAN_SECONDS);
-    if (default_config_entry != NULL)
-    {
-        value = atoi(default_config_entry->value);
-    }
-    else
-    {
-        DPRINTF("WIFI_SCAN_SECONDS not found in the config file. Disabling polling.\n");
-    }
+    uint16_t value = configSnapshot.wifi_scan_seconds;
     if (value < WIFI_SCAN_POLL_COUNTER_MIN)
     {
         value = WIFI_SCAN_POLL_COUNTER_MIN;
@@ -719,13 +752,8 @@ char *print_mac(uint8_t *mac_address)
 
 void get_connection_data(ConnectionData *connection_data)
 {
-    ConfigEntry *ssid = find_entry(PARAM_WIFI_SSID);
-    ConfigEntry *wifi_auth = find_entry(PARAM_WIFI_AUTH);
-    ConfigEntry *wifi_scan_interval = find_entry(PARAM_WIFI_SCAN_SECONDS);
-    ConfigEntry *network_status_scan_interval = find_entry(PARAM_NETWORK_STATUS_SEC);
-    ConfigEntry *file_downloading_timeout = find_entry(PARAM_DOWNLOAD_TIMEOUT_SEC);
-    ConfigEntry *wifi_country = find_entry(PARAM_WIFI_COUNTRY);
-    ConfigEntry *wifi_rssi_visible = find_entry(PARAM_WIFI_RSSI);
+    ConfigEntry *ssid = find_entry_by_id(CONFIG_KEY_WIFI_SSID);
+    ConfigEntry *wifi_country = find_entry_by_id(CONFIG_KEY_WIFI_COUNTRY);
     connection_data->network_status = (u_int16_t)connection_status;
     snprintf(connection_data->ipv4_address, sizeof(connection_data->ipv4_address), "%s", "Not connected" + '\0');
     snprintf(connection_data->ipv6_address, sizeof(connection_data->ipv6_address), "%s", "Not connected" + '\0');
@@ -733,10 +761,10 @@ void get_connection_data(ConnectionData *connection_data)
     snprintf(connection_data->gw_ipv4_address, sizeof(connection_data->gw_ipv4_address), "%s", "Not connected" + '\0');
     snprintf(connection_data->netmask_ipv4_address, sizeof(connection_data->netmask_ipv4_address), "Not connected" + '\0');
     snprintf(connection_data->dns_ipv4_address, sizeof(connection_data->dns_ipv4_address), "%s", "Not connected" + '\0');
-    connection_data->wifi_auth_mode = (uint16_t)atoi(wifi_auth->value);
+    connection_data->wifi_auth_mode = (uint16_t)configSnapshot.wifi_auth;
     connection_data->wifi_scan_interval = get_wifi_scan_poll_secs();
     connection_data->network_status_poll_interval = (uint16_t)(get_network_status_polling_ms() / 1000);
-    connection_data->file_downloading_timeout = (uint16_t)atoi(file_downloading_timeout->value);
+    connection_data->file_downloading_timeout = (uint16_t)configSnapshot.download_timeout_sec;
     connection_data->rssi = 0;
 
     // If the country is empty, set it to XX. Otherwise, copy the first two characters
@@ -763,7 +791,7 @@ void get_connection_data(ConnectionData *connection_data)
         snprintf(connection_data->netmask_ipv6_address, sizeof(connection_data->netmask_ipv6_address), "%s", "Not implemented" + '\0');
         snprintf(connection_data->dns_ipv4_address, sizeof(connection_data->dns_ipv4_address), "%s", print_ipv4(get_dns()));
         snprintf(connection_data->dns_ipv6_address, sizeof(connection_data->dns_ipv6_address), "%s", "Not implemented" + '\0');
-        if ((wifi_rssi_visible != NULL) && (wifi_rssi_visible->value[0] == 't' || wifi_rssi_visible->value[0] == 'T'))
+        if (configSnapshot.wifi_rssi)
         {
             connection_data->rssi = get_rssi();
         }
@@ -785,7 +813,7 @@ void get_connection_data(ConnectionData *connection_data)
         snprintf(connection_data->netmask_ipv6_address, sizeof(connection_data->netmask_ipv6_address), "%s", "Waiting address" + '\0');
         snprintf(connection_data->dns_ipv4_address, sizeof(connection_data->dns_ipv4_address), "%s", "Waiting address" + '\0');
         snprintf(connection_data->dns_ipv6_address, sizeof(connection_data->dns_ipv6_address), "%s", "Waiting address" + '\0');
-        if ((wifi_rssi_visible != NULL) && (wifi_rssi_visible->value[0] == 't' || wifi_rssi_visible->value[0] == 'T'))
+        if (configSnapshot.wifi_rssi)
         {
             connection_data->rssi = get_rssi();
         }
@@ -855,64 +883,53 @@ static void remove_quotes(char *token)
     }
 }
 
-int split_url(const char *url, UrlParts *parts)
+static void free_rom_info(RomInfo *item)
 {
-    if (!url || !parts)
-        return -1;
-
-    // Initialize parts with NULL
-    parts->protocol = NULL;
-    parts->domain = NULL;
-    parts->uri = NULL;
-
-    char *p, *q;
-
-    // Get protocol
-    p = strstr(url, "://");
-    if (!p)
-        return -1; // Invalid URL format
-
-    parts->protocol = malloc(p - url + 1);
-    if (!parts->protocol)
-        return -1; // Allocation failed
-    strncpy(parts->protocol, url, p - url);
-    parts->protocol[p - url] = '\0';
-
-    // Get domain
-    p += 3; // Skip over "://"
-    q = strchr(p, '/');
-
-    if (q)
-    {
-        parts->domain = malloc(q - p + 1);
-        if (!parts->domain)
-            return -1; // Allocation failed
-        strncpy(parts->domain, p, q - p);
-        parts->domain[q - p] = '\0';
+    free(item->url);
+    free(item->name);
+    free(item->description);
+    free(item->tags);
+    *item = (RomInfo){0};
+}
 
-        // Get URI
-        parts->uri = strdup(q);
-        if (!parts->uri)
-            return -1; // Allocation failed
-    }
-    else
+// Free a partial list after an error, so the caller gets an empty one
+static void free_rom_list(RomInfo **items, int *itemCount)
+{
+    RomInfo *current = *items;
+    while (current != NULL)
     {
-        parts->domain = strdup(p);
-        if (!parts->domain)
-            return -1; // Allocation failed
+        RomInfo *next = current->next;
+        free_rom_info(current);
+        free(current);
+        current = next;
     }
+    *items = NULL;
+    *itemCount = 0;
+}
 
-    return 0;
+static void free_floppy_image_info(FloppyImageInfo *item)
+{
+    free(item->name);
+    free(item->status);
+    free(item->description);
+    free(item->tags);
+    free(item->extra);
+    free(item->url);
+    *item = (FloppyImageInfo){0};
 }
 
-static void free_url_parts(UrlParts *parts)
+static void free_floppy_image_list(FloppyImageInfo **items, int *itemCount)
 {
-    if (parts->protocol)
-        free(parts->protocol);
-    if (parts->domain)
-        free(parts->domain);
-    if (parts->uri)
-        free(parts->uri);
+    FloppyImageInfo *current = *items;
+    while (current != NULL)
+    {
+        FloppyImageInfo *next = current->next;
+        free_floppy_image_info(current);
+        free(current);
+        current = next;
+    }
+    *items = NULL;
+    *itemCount = 0;
 }
 
 bool check_STEEM_extension(UrlParts parts)
@@ -1104,67 +1121,85 @@ int get_latest_release(void)
     return err;
 }
 
-static char *next_token(char **line_ptr)
+err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
 {
-    char *line = *line_ptr;
-    if (!line || *line == '\0')
-        return NULL;
+    CsvTokenizer tokenizer;
+    RomInfo pending = {0};
+    RomInfo *last = NULL;
+    httpc_state_t *connection;
+    volatile bool complete = false;
+    volatile err_t callback_error = ERR_OK; // If any error found in the callback and cannot be returned, store it here
+    UrlParts parts;
+
+    *items = NULL;
+    *itemCount = 0;
 
-    char *token;
-    if (*line == '"')
+    void csv_field(void *arg, uint32_t record, uint16_t field, const char *value)
     {
-        // Token starts with a quote, find the closing quote
-        token = ++line;
-        while (*line && (*line != '"' || *(line + 1) == '"'))
+        // The first line is the header. After an error the rest of the file is ignored
+        if ((record == 0) || (callback_error != ERR_OK))
         {
-            if (*line == '"' && *(line + 1) == '"')
-            {
-                // Handle escaped quote
-                memmove(line, line + 1, strlen(line));
-            }
-            line++;
+            return;
         }
-        if (*line == '"')
+        char **dest = NULL;
+        switch (field)
         {
-            *line = '\0';
-            line++;
-            if (*line == ',')
-                line++;
+        case 0:
+            dest = &pending.url;
+            break;
+        case 1:
+            dest = &pending.name;
+            break;
+            // Ignore the description, we don't use it for now
+        case 3:
+            dest = &pending.tags;
+            break;
+        case 4:
+            pending.size_kb = atoi(value);
+            break;
+        default:
+            break;
+        }
+        if (dest != NULL)
+        {
+            free(*dest);
+            *dest = strdup(value);
+            if (*dest == NULL)
+            {
+                DPRINTF("Memory allocation failed\n");
+                callback_error = ERR_MEM;
+            }
         }
     }
-    else
+
+    void csv_record(void *arg, uint32_t record)
     {
-        // Token does not start with a quote, find the next comma
-        token = line;
-        while (*line && *line != ',')
+        if ((record == 0) || (callback_error != ERR_OK))
         {
-            line++;
+            return;
         }
-        if (*line)
+        RomInfo *next = malloc(sizeof(RomInfo));
+        if (!next)
         {
-            *line = '\0';
-            line++;
+            DPRINTF("Memory allocation failed\n");
+            callback_error = ERR_MEM;
+            return;
         }
+        *next = pending;
+        next->next = NULL;
+        pending = (RomInfo){0};
+        if (last == NULL)
+        {
+            *items = next;
+        }
+        else
+        {
+            last->next = next;
+        }
+        last = next;
+        (*itemCount)++;
     }
 
-    // Trim leading spaces in the next token
-    while (isspace(*line))
-        line++;
-
-    *line_ptr = line;
-    return token;
-}
-
-err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
-{
-    char buff[32768] = {0};
-    uint32_t buff_pos = 0;
-    httpc_state_t *connection;
-    volatile bool complete = false;
-    volatile err_t callback_error = ERR_OK; // If any error found in the callback and cannot be returned, store it here
-    UrlParts parts;
-    u32_t content_len = 0;
-
     err_t headers(httpc_state_t * connection, void *arg,
                   struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
     {
@@ -1175,7 +1210,6 @@ err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
                 u32_t rx_content_len, u32_t srv_res, err_t err)
 
     {
-        content_len = rx_content_len;
         complete = true;
         if (srv_res != 200)
         {
@@ -1191,15 +1225,11 @@ err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
     err_t body(void *arg, struct altcp_pcb *conn,
                struct pbuf *p, err_t err)
     {
-        // DPRINTF("Body received. ");
-        // DPRINTF("Buffer size:%d\n", p->tot_len);
-        // fflush(stdout);
-        pbuf_copy_partial(p, (buff + buff_pos), p->tot_len, 0);
-        buff_pos += p->tot_len;
-        tcp_recved(conn, p->tot_len);
         if (p != NULL)
         {
-            DPRINTF("pbuf ref count before free: %d\n", p->ref);
+            // Parse the records as they arrive. No need to keep the whole file in memory
+            csv_tokenizer_feed_pbuf(&tokenizer, p);
+            tcp_recved(conn, p->tot_len);
             pbuf_free(p);
         }
 
@@ -1217,6 +1247,8 @@ err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
     DPRINTF("Domain %s\n", parts.domain);
     DPRINTF("URI %s\n", parts.uri);
 
+    csv_tokenizer_init(&tokenizer, ',', csv_field, csv_record, NULL);
+
     httpc_connection_t settings;
     settings.result_fn = result;
     settings.headers_done_fn = headers;
@@ -1252,27 +1284,26 @@ err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
         if (time_us_64() - start_time > timeout)
         {
             DPRINTF("Download timed out\n");
-            return ERR_TIMEOUT;
+            callback_error = ERR_TIMEOUT;
+            break;
         }
     }
 
     free_url_parts(&parts);
 
-    if (callback_error != ERR_OK)
+    if (callback_error == ERR_OK)
     {
-        return callback_error;
+        // The last line could not end with a new line
+        csv_tokenizer_finish(&tokenizer);
     }
 
-    // First, count the number of entries
-    int count = 0;
-    const char *p = buff;
-    for (int i = 0; i < content_len; i++)
+    // The record being parsed when the download ended, and the whole list after an error
+    free_rom_info(&pending);
+    if (callback_error != ERR_OK)
     {
-        if (*p == '\n')
-            count++;
-        p++;
+        free_rom_list(items, itemCount);
+        return callback_error;
     }
-    *itemCount = count - 1; // The first line is the header
 
     DPRINTF("Found %d entries\n", *itemCount);
     if (*itemCount == 0)
@@ -1281,102 +1312,20 @@ err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
         return -1;
     }
 
-    RomInfo *current = NULL;
-    // Allocate memory for the first RomInfo structure
-    *items = malloc(sizeof(RomInfo));
-    if (*items == NULL)
-    {
-        DPRINTF("Failed to allocate memory for RomInfo\n");
-        return -1;
-    }
-
-    current = *items; // Point to the first RomInfo structure
-    char *buff_parse = buff;
-    char *line = NULL;
-    // Skip the first line
-    line = strtok(buff_parse, "\n");
-    if (line == NULL)
-    {
-        DPRINTF("No lines found. Empty file.\n");
-        return -1;
-    }
-    // Increment the buff structure position after the line
-    buff_parse += strlen(line) + 1;
-    DPRINTF("Header: %s\n", line);
-    line = strtok(buff_parse, "\n");
-    for (size_t items_count = 0; items_count < *itemCount; items_count++)
-    {
-        if (line == NULL)
-            break; // Ensure line is valid
-        buff_parse += strlen(line) + 1;
-        DPRINTF("Line: %s\n", line);
-        for (size_t token_count = 0; token_count < 5; token_count++)
-        {
-            // Parse the line splitting by comma
-            char *token = next_token(&line);
-            if (!token)
-                break;
-            // DPRINTF("Token(%d): %s\n", token_count, token);
-            switch (token_count)
-            {
-            case 0:
-                current->url = strdup(token);
-                break;
-            case 1:
-                current->name = strdup(token);
-                break;
-                // Ignore the description, we don't use it for now
-                //            case 2:
-                //
-                //                current->description = strdup(token);
-                // break;
-            case 3:
-                current->tags = strdup(token);
-                break;
-            case 4:
-                current->size_kb = atoi(token);
-                break;
-            default:
-                break;
-            }
-            // Increment the buff structure position after the token
-        }
-        // Allocate memory for the next RomInfo structure
-        if (items_count < *itemCount - 1)
-        {
-            RomInfo *next = malloc(sizeof(RomInfo));
-            if (!next)
-            {
-                DPRINTF("Memory allocation failed\n");
-                return -1;
-            }
-            *next = (RomInfo){0};
-            current->next = next;
-            current = next;
-        }
-        else
-        {
-            current->next = NULL;
-        }
-        line = strtok(buff_parse, "\n");
-    }
-    DPRINTF("Parsing complete\n");
-
     DPRINTF("Returning %d items\n", *itemCount);
     return callback_error;
 }
 
 int download_rom(const char *url, uint32_t rom_load_offset)
 {
-    const int FLASH_BUFFER_SIZE = 4096;
-    uint8_t *flash_buff = malloc(FLASH_BUFFER_SIZE);
+    uint8_t *flash_buff = malloc(DOWNLOAD_SINK_FLASH_BUFFER_SIZE);
     if (flash_buff == NULL)
     {
         DPRINTF("Failed to allocate memory for flash buffer\n");
         return -1;
     }
 
-    uint32_t flash_buff_pos = 0;
+    DownloadSink sink;
     bool first_chunk = true;
     bool is_steem = false;
     volatile bool complete = false;
@@ -1384,6 +1333,21 @@ int download_rom(const char *url, uint32_t rom_load_offset)
     UrlParts parts;
     uint32_t dest_address = rom_load_offset; // Initialize pointer to the ROM address
 
+    bool persist(void *arg, uint8_t *data, uint32_t size)
+    {
+        // Change to big endian
+        CHANGE_ENDIANESS_BLOCK16(data, size);
+
+        // Write chunk to flash
+        DPRINTF("Writing %d bytes to address: %p...", size, dest_address);
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(dest_address, data, size);
+        restore_interrupts(ints);
+        dest_address += size;
+        DPRINTF("Done.\n");
+        return true;
+    }
+
     err_t headers(httpc_state_t * connection, void *arg,
                   struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
     {
@@ -1403,95 +1367,30 @@ int download_rom(const char *url, uint32_t rom_load_offset)
         else
         {
             DPRINTF("ROM image transfer complete. %d transfered.\n", rx_content_len);
-            DPRINTF("Pending bytes to write: %d\n", flash_buff_pos);
+            DPRINTF("Pending bytes to write: %d\n", sink.buffer_pos);
         }
     }
 
     err_t body(void *arg, struct altcp_pcb *conn,
                struct pbuf *p, err_t err)
     {
-        // DPRINTF("Body received. ");
-        // DPRINTF("Buffer size:%d. ", p->tot_len);
-        // DPRINTF("Copying to address: %p\n", dest_address);
-        // fflush(stdout);
-
-        // Transform buffer's words from little endian to big endian inline
         if (p == NULL)
         {
             DPRINTF("Received NULL pbuf\n");
             return ERR_VAL;
         }
-        uint8_t *buffer = (uint8_t *)p->payload;
-        uint16_t total_bytes_copy = p->tot_len;
-        int steem_offset = 0;
         if (is_steem && first_chunk)
         {
             // Check if the first 4 bytes are 0x0000
-            if (buffer[0] == 0x00 && buffer[1] == 0x00 && buffer[2] == 0x00 && buffer[3] == 0x00)
+            if ((p->tot_len >= 4) && (pbuf_get_at(p, 0) == 0x00) && (pbuf_get_at(p, 1) == 0x00) && (pbuf_get_at(p, 2) == 0x00) && (pbuf_get_at(p, 3) == 0x00))
             {
                 DPRINTF("Skipping first 4 bytes. Looks like a STEEM cartridge image.\n");
-                steem_offset = 4;
+                download_sink_skip(&sink, 4);
             }
             first_chunk = false;
         }
-        uint16_t flash_buffer_current_size = FLASH_BUFFER_SIZE - flash_buff_pos - steem_offset;
-        if (flash_buffer_current_size <= 0)
-        {
-            DPRINTF("Invalid flash buffer size calculation\n");
-            return ERR_VAL;
-        }
-        if (total_bytes_copy < flash_buffer_current_size)
-        {
-            // DPRINTF("Copying %d bytes to address: %p...", (total_bytes_copy - steem_offset), (flash_buff + flash_buff_pos));
-            // THere is room in the flash_buff to copy the whole buffer
-            pbuf_copy_partial(p, (flash_buff + flash_buff_pos), (total_bytes_copy - steem_offset), steem_offset);
-            // increment the flash buffer position
-            flash_buff_pos += (total_bytes_copy - steem_offset);
-            // DPRINTF("Done.\n");
-        }
-        else
-        {
-            // DPRINTF("Copying %d bytes to address: %p...", flash_buffer_current_size, (flash_buff + flash_buff_pos));
-            // There is no room, so we have to fill it first, invert, write to flash and continue
-            pbuf_copy_partial(p, (flash_buff + flash_buff_pos), flash_buffer_current_size, 0);
-            // DPRINTF("Done.\n");
-
-            // Change to big endian
-            for (int j = 0; j < FLASH_BUFFER_SIZE; j += 2)
-            {
-                uint8_t temp = flash_buff[j];
-                flash_buff[j] = flash_buff[j + 1];
-                flash_buff[j + 1] = temp;
-            }
-
-            // Write chunk to flash
-            DPRINTF("Writing %d bytes to address: %p...", flash_buff_pos + flash_buffer_current_size, dest_address);
-            uint32_t ints = save_and_disable_interrupts();
-            flash_range_program(dest_address, flash_buff, FLASH_BUFFER_SIZE);
-            restore_interrupts(ints);
-            dest_address += FLASH_BUFFER_SIZE;
-            // Reset the flash buffer position
-            flash_buff_pos = 0;
-            DPRINTF("Done.\n");
-
-            // we have total_bytes - flash_buffer_current_size left to copy!
-            uint16_t bytes_left = total_bytes_copy - flash_buffer_current_size;
-            if (bytes_left > 0)
-            {
-                // DPRINTF("Copying pending %d bytes to address: %p...", bytes_left, (flash_buff + flash_buff_pos));
-                pbuf_copy_partial(p, (flash_buff + flash_buff_pos), bytes_left, flash_buffer_current_size);
-                flash_buff_pos += bytes_left;
-                // DPRINTF("Done.\n");
-            }
-        }
-
-        tcp_recved(conn, p->tot_len);
-
-        if (p != NULL)
-        {
-            DPRINTF("pbuf ref count before free: %d\n", p->ref);
-            pbuf_free(p);
-        }
+        download_sink_write_pbuf(&sink, conn, p);
+        pbuf_free(p);
         return ERR_OK;
     }
     DPRINTF("Downloading ROM image from %s\n", url);
@@ -1499,6 +1398,7 @@ int download_rom(const char *url, uint32_t rom_load_offset)
     if (split_url(url, &parts) != 0)
     {
         DPRINTF("Failed to split URL\n");
+        free(flash_buff);
         return -1;
     }
 
@@ -1507,6 +1407,7 @@ int download_rom(const char *url, uint32_t rom_load_offset)
     DPRINTF("URI %s\n", parts.uri);
 
     is_steem = check_STEEM_extension(parts);
+    download_sink_init(&sink, flash_buff, DOWNLOAD_SINK_FLASH_BUFFER_SIZE, persist, NULL);
 
     // Erase the content before loading the new file. It seems that
     // overwriting it's not enough
@@ -1563,6 +1464,12 @@ int download_rom(const char *url, uint32_t rom_load_offset)
         }
     }
 
+    // Write the last block. The FLASH is programmed in pages
+    if ((callback_error == ERR_OK) && !download_sink_finish(&sink, FLASH_PAGE_SIZE, 0xFF))
+    {
+        callback_error = ERR_BUF;
+    }
+
     free_url_parts(&parts);
     free(flash_buff);
     return callback_error;
@@ -1570,14 +1477,87 @@ int download_rom(const char *url, uint32_t rom_load_offset)
 
 err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *url)
 {
-    size_t BUFFER_SIZE = 32768;
-    char *buff = malloc(BUFFER_SIZE);
-    uint32_t buff_pos = 0;
+    CsvTokenizer tokenizer;
+    FloppyImageInfo pending = {0};
+    FloppyImageInfo *last = NULL;
     httpc_state_t *connection;
     volatile bool complete = false;
     volatile err_t callback_error = ERR_OK; // If any error found in the callback and cannot be returned, store it here
     UrlParts parts;
-    u32_t content_len = 0;
+
+    *items = NULL;
+    *itemCount = 0;
+
+    void csv_field(void *arg, uint32_t record, uint16_t field, const char *value)
+    {
+        // After an error the rest of the file is ignored
+        if (callback_error != ERR_OK)
+        {
+            return;
+        }
+        char **dest = NULL;
+        switch (field)
+        {
+        case 0:
+            dest = &pending.name;
+            break;
+        case 1:
+            dest = &pending.status;
+            break;
+        case 2:
+            dest = &pending.description;
+            break;
+        case 3:
+            dest = &pending.tags;
+            break;
+        case 4:
+            dest = &pending.extra;
+            break;
+        case 5:
+            dest = &pending.url;
+            break;
+        default:
+            break;
+        }
+        if (dest != NULL)
+        {
+            free(*dest);
+            *dest = strdup(value);
+            if (*dest == NULL)
+            {
+                DPRINTF("Memory allocation failed\n");
+                callback_error = ERR_MEM;
+            }
+        }
+    }
+
+    void csv_record(void *arg, uint32_t record)
+    {
+        if (callback_error != ERR_OK)
+        {
+            return;
+        }
+        FloppyImageInfo *next = malloc(sizeof(FloppyImageInfo));
+        if (!next)
+        {
+            DPRINTF("Memory allocation failed\n");
+            callback_error = ERR_MEM;
+            return;
+        }
+        *next = pending;
+        next->next = NULL;
+        pending = (FloppyImageInfo){0};
+        if (last == NULL)
+        {
+            *items = next;
+        }
+        else
+        {
+            last->next = next;
+        }
+        last = next;
+        (*itemCount)++;
+    }
 
     err_t headers(httpc_state_t * connection, void *arg,
                   struct pbuf *hdr, u16_t hdr_len, u32_t rx_content_len)
@@ -1589,7 +1569,6 @@ err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *u
                 u32_t rx_content_len, u32_t srv_res, err_t err)
 
     {
-        content_len = rx_content_len;
         complete = true;
         if (srv_res != 200)
         {
@@ -1605,15 +1584,11 @@ err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *u
     err_t body(void *arg, struct altcp_pcb *conn,
                struct pbuf *p, err_t err)
     {
-        // DPRINTF("Body received. ");
-        // DPRINTF("Buffer size:%d\n", p->tot_len);
-        // fflush(stdout);
-        pbuf_copy_partial(p, (buff + buff_pos), p->tot_len, 0);
-        buff_pos += p->tot_len;
-        tcp_recved(conn, p->tot_len);
         if (p != NULL)
         {
-            DPRINTF("pbuf ref count before free: %d\n", p->ref);
+            // Parse the records as they arrive. No need to keep the whole file in memory
+            csv_tokenizer_feed_pbuf(&tokenizer, p);
+            tcp_recved(conn, p->tot_len);
             pbuf_free(p);
         }
 
@@ -1631,6 +1606,8 @@ err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *u
     DPRINTF("Domain %s\n", parts.domain);
     DPRINTF("URI %s\n", parts.uri);
 
+    csv_tokenizer_init(&tokenizer, ';', csv_field, csv_record, NULL);
+
     httpc_connection_t settings;
     settings.result_fn = result;
     settings.headers_done_fn = headers;
@@ -1652,7 +1629,6 @@ err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *u
     {
         DPRINTF("HTTP GET failed: %d\n", err);
         free_url_parts(&parts);
-        free(buff);
         return -1;
     }
 
@@ -1674,256 +1650,26 @@ err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *u
 
     free_url_parts(&parts);
 
-    if (callback_error != ERR_OK)
+    if (callback_error == ERR_OK)
     {
-        if (buff != NULL)
-            free(buff);
-        return callback_error;
+        // The last line could not end with a new line
+        csv_tokenizer_finish(&tokenizer);
     }
 
-    bool inside_quotes = false;
-    char *start = NULL;
-    int items_count = 0;
-
-    // First, count the number of entries
-    int count = 0;
-    const char *p = buff;
-    for (int i = 0; i < content_len; i++)
+    // The record being parsed when the download ended, and the whole list after an error
+    free_floppy_image_info(&pending);
+    if (callback_error != ERR_OK)
     {
-        if (*p == ';')
-            count++;
-        p++;
+        free_floppy_image_list(items, itemCount);
+        return callback_error;
     }
-    *itemCount = (count / 5);
 
     DPRINTF("Found %d entries\n", *itemCount);
 
     if (*itemCount == 0)
     {
         // If no entries found, short circuit and return
-        if (buff != NULL)
-            free(buff);
-        return -1;
-    }
-
-    FloppyImageInfo *current = NULL;
-
-    // Allocate memory for the first FloppyImageInfo structure
-    *items = malloc(sizeof(FloppyImageInfo));
-    if (!*items)
-    {
-        DPRINTF("Memory allocation failed\n");
-        free(buff);
         return -1;
     }
-    char *buff_iter = buff;
-    current = *items; // Set current to the first allocated FloppyImageInfo structure
-
-    while (*buff_iter)
-    {
-        if (*buff_iter == '"')
-        {
-            inside_quotes = !inside_quotes;
-
-            if (inside_quotes)
-            {
-                start = buff_iter + 1; // Start of a new value
-            }
-            else
-            {
-                char *value = strndup(start, buff_iter - start);
-                switch (items_count % 6)
-                {
-                case 0:
-                    current->name = value;
-                    break;
-                case 1:
-                    current->status = value;
-                    break;
-                case 2:
-                    current->description = value;
-                    break;
-                case 3:
-                    current->tags = value;
-                    break;
-                case 4:
-                    current->extra = value;
-                    break;
-                case 5:
-                    current->url = value;
-                    break;
-                }
-
-                items_count++;
-                if (items_count % 6 == 0 && *(buff_iter + 1) != '\0')
-                {
-                    // Allocate memory for the next FloppyImageInfo structure
-                    FloppyImageInfo *next = malloc(sizeof(FloppyImageInfo));
-                    if (!next)
-                    {
-                        DPRINTF("Memory allocation failed\n");
-                        return -1;
-                    }
-                    // Initialize the newly allocated structure
-                    *next = (FloppyImageInfo){0};
-
-                    current->next = next; // Link the current structure to the next one
-                    current = next;       // Move the current pointer to the next structure
-                }
-            }
-        }
-        buff_iter++;
-    }
-    if (buff != NULL)
-    {
-        free(buff);
-    }
-    return callback_error;
-}
-
-int download_floppy(const char *url, const char *folder, const char *dest_filename, bool overwrite_flag)
-{
-    const int BUFFER_SIZE = 16384;
-    uint8_t *buff = malloc(BUFFER_SIZE);
-    uint32_t buff_pos = 0;
-    httpc_state_t *connection;
-    bool complete = false;
-    err_t callback_error = ERR_OK; // If any error found in the callback and cannot be returned, store it here
-    UrlParts parts;
-
-    FRESULT fr;    // FatFS function common result code
-    FIL dest_file; // File object
-    UINT bw;       // File read/write count
-    FILINFO fno;
-
-    err_t headers(httpc_state_t * connection, void *arg,
-                  struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
-    {
-        return ERR_OK;
-    }
-
-    void result(void *arg, httpc_result_t httpc_result,
-                u32_t rx_content_len, u32_t srv_res, err_t err)
-
-    {
-        complete = true;
-        if (srv_res != 200)
-        {
-            DPRINTF("Floppy image download something went wrong. HTTP error: %d\n", srv_res);
-            callback_error = srv_res == 0 ? ERR_TIMEOUT : srv_res;
-        }
-        else
-        {
-            DPRINTF("Floppy image transfer complete. %d transfered.\n", rx_content_len);
-            DPRINTF("Pending bytes to write: %d\n", buff_pos);
-        }
-    }
-
-    err_t body(void *arg, struct altcp_pcb *conn,
-               struct pbuf *p, err_t err)
-    {
-
-        pbuf_copy_partial(p, buff, p->tot_len, 0);
-
-        fr = f_write(&dest_file, buff, p->tot_len, &bw); // Write it to the destination file
-        if (fr != FR_OK)
-        {
-            DPRINTF("f_write error: %s (%d)\n", FRESULT_str(fr), fr);
-        }
-        // Write chunk to flash
-        DPRINTF("Writing %d bytes to file: %s...\n", p->tot_len, dest_filename);
-
-        tcp_recved(conn, p->tot_len);
-
-        if (p != NULL)
-        {
-            DPRINTF("pbuf ref count before free: %d\n", p->ref);
-            pbuf_free(p);
-        }
-        return ERR_OK;
-    }
-
-    // Create full paths for source and destination files
-    char dest_path[256];
-    sprintf(dest_path, "%s/%s", folder, dest_filename);
-
-    // Check if the destination file exists
-    fr = f_stat(dest_path, &fno);
-    if (fr == FR_OK && !overwrite_flag)
-    {
-        DPRINTF("Destination file exists and overwrite_flag is false, canceling operation\n");
-        return FR_FILE_EXISTS; // Destination file exists and overwrite_flag is false, cancel the operation
-    }
-
-    // Create and open the destination file
-    fr = f_open(&dest_file, dest_path, FA_CREATE_ALWAYS | FA_WRITE);
-    if (fr != FR_OK)
-    {
-        DPRINTF("f_open error: %s (%d)\n", FRESULT_str(fr), fr);
-        f_close(&dest_file); // Close the source file if it was opened successfully
-        return FR_CANNOT_OPEN_FILE_FOR_WRITE;
-    }
-
-    DPRINTF("Downloading Floppy image from %s\n", url);
-    if (split_url(url, &parts) != 0)
-    {
-        DPRINTF("Failed to split URL\n");
-        return -1;
-    }
-
-    DPRINTF("Protocol %s\n", parts.protocol);
-    DPRINTF("Domain %s\n", parts.domain);
-    DPRINTF("URI %s\n", parts.uri);
-
-    httpc_connection_t settings;
-    memset(&settings, 0, sizeof(settings));
-
-    settings.result_fn = result;
-    settings.headers_done_fn = headers;
-    settings.use_proxy = false;
-
-    complete = false;
-    cyw43_arch_lwip_begin();
-    err_t err = httpc_get_file_dns(
-        parts.domain,
-        LWIP_IANA_PORT_HTTP,
-        parts.uri,
-        &settings,
-        body,
-        NULL,
-        NULL);
-    cyw43_arch_lwip_end();
-
-    if (err != ERR_OK)
-    {
-        DPRINTF("HTTP GET failed: %d\n", err);
-        free_url_parts(&parts);
-        return -1;
-    }
-    else
-    {
-        DPRINTF("HTTP GET sent\n");
-    }
-
-    uint64_t start_time = time_us_64();
-    uint64_t timeout = DOWNLOAD_FILES_TIMEOUT * 1000000; // N seconds timeout in microseconds
-    while (!complete)
-    {
-#if PICO_CYW43_ARCH_POLL
-        network_safe_poll();
-#endif
-        if (time_us_64() - start_time > timeout)
-        {
-            DPRINTF("Download timed out\n");
-            callback_error = ERR_TIMEOUT;
-            break;
-        }
-    }
-
-    // Close open file
-    f_close(&dest_file);
-
-    free_url_parts(&parts);
-    free(buff);
     return callback_error;
 }
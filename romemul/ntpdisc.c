@@ -0,0 +1,91 @@
+/**
+ * File: ntpdisc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Software clock disciplined by NTP. Steps the clock on big offsets, slews the small
+ * ones and estimates the drift of the crystal. No network or RTC access, rtcemul.c does that
+ */
+
+#include "include/ntpdisc.h"
+
+void ntp_discipline_init(NtpDiscipline *discipline)
+{
+    memset(discipline, 0, sizeof(NtpDiscipline));
+    discipline->poll_interval_sec = NTP_MIN_POLL_SEC;
+}
+
+int64_t ntp_discipline_clock_us(const NtpDiscipline *discipline, uint64_t now_us)
+{
+    int64_t elapsed = (int64_t)(now_us - discipline->base_us);
+    int64_t max_slew = elapsed * NTP_MAX_SLEW_PPM / 1000000;
+    int64_t slew = discipline->slew_us;
+    if (slew > max_slew)
+    {
+        slew = max_slew;
+    }
+    else if (slew < -max_slew)
+    {
+        slew = -max_slew;
+    }
+    return discipline->base_time_us + elapsed + elapsed * discipline->drift_ppb / 1000000000 + slew;
+}
+
+NtpSampleResult ntp_discipline_sample(NtpDiscipline *discipline, uint64_t t1_us, uint64_t t4_us, int64_t t2_us, int64_t t3_us)
+{
+    NtpDiscipline *d = discipline;
+    int64_t delay = (int64_t)(t4_us - t1_us) - (t3_us - t2_us);
+    if (delay < 0)
+    {
+        delay = 0;
+    }
+    if (d->synchronized && (delay > NTP_MAX_DELAY_MS * 1000))
+    {
+        DPRINTF("NTP sample discarded. Round trip delay: %lld us\n", delay);
+        return NTP_SAMPLE_DISCARDED;
+    }
+    int64_t offset = ((t2_us - ntp_discipline_clock_us(d, t1_us)) + (t3_us - ntp_discipline_clock_us(d, t4_us))) / 2;
+    d->last_offset_us = offset;
+    d->last_delay_us = (uint32_t)delay;
+    d->samples++;
+
+    if (!d->synchronized || (llabs(offset) >= NTP_STEP_THRESHOLD_MS * 1000))
+    {
+        // First sample or too far away: step the clock
+        d->base_us = t4_us;
+        d->base_time_us = t3_us + delay / 2;
+        d->slew_us = 0;
+        d->poll_interval_sec = NTP_MIN_POLL_SEC;
+        d->synchronized = true;
+        DPRINTF("NTP clock stepped. Offset: %lld us, delay: %lld us\n", offset, delay);
+        return NTP_SAMPLE_STEPPED;
+    }
+
+    // The offset not explained by the slew still pending is the error of the drift estimation
+    int64_t elapsed = (int64_t)(t4_us - d->base_us);
+    int64_t applied = ntp_discipline_clock_us(d, t4_us) - (d->base_time_us + elapsed + elapsed * d->drift_ppb / 1000000000);
+    int64_t remaining = d->slew_us - applied;
+    if (elapsed > 0)
+    {
+        int64_t drift_error_ppb = (offset - remaining) * 1000000000 / elapsed;
+        int64_t drift_ppb = d->drift_ppb + drift_error_ppb / 4;
+        int64_t max_drift_ppb = NTP_MAX_SLEW_PPM * 1000;
+        d->drift_ppb = (int32_t)(drift_ppb > max_drift_ppb ? max_drift_ppb : (drift_ppb < -max_drift_ppb ? -max_drift_ppb : drift_ppb));
+    }
+    d->base_time_us = ntp_discipline_clock_us(d, t4_us);
+    d->base_us = t4_us;
+    d->slew_us = offset;
+
+    // Poll less often while the clock follows the server, more often when it does not
+    if ((llabs(offset) < NTP_STABLE_OFFSET_MS * 1000) && (d->poll_interval_sec < NTP_MAX_POLL_SEC))
+    {
+        d->poll_interval_sec *= 2;
+    }
+    else if ((llabs(offset) > NTP_UNSTABLE_OFFSET_MS * 1000) && (d->poll_interval_sec > NTP_MIN_POLL_SEC))
+    {
+        d->poll_interval_sec /= 2;
+    }
+    DPRINTF("NTP sample. Offset: %lld us, delay: %lld us, drift: %ld ppb, next poll: %lu s\n",
+            offset, delay, (long)d->drift_ppb, (unsigned long)d->poll_interval_sec);
+    return NTP_SAMPLE_SLEWED;
+}
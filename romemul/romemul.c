@@ -14,42 +14,13 @@
 // #include "stetest.h"
 
 // Global variables to access them in the IRQ handlers
-// int read_addr_rom_dma_channel = -1;
-// int lookup_data_rom_dma_channel = -1;
-
-int maxelem = 0;
-
 int read_addr_rom_dma_channel = -1;
 int lookup_data_rom_dma_channel = -1;
 
-PIO default_pio = pio0;
+// The state machine that reads the address bus. Its FIFO flags are sampled by the bus statistics
+int read_rom_sm = -1;
 
-// Interrupt handler for DMA completion
-void __not_in_flash_func(dma_irq_handler_lookup)(void)
-{
-    // DPRINTF("DMA IRQ\n");
-    // Clear the interrupt request for the channel
-    dma_hw->ints1 = 1u << 2;
-    uint32_t addr = (uint32_t)dma_hw->ch[2].al3_read_addr_trig;
-    uint16_t value = *((uint16_t *)addr);
-    DPRINTF("DMA LOOKUP: $%x, VALUE: $%x\n", addr, value);
-
-    // Restart the DMA
-    //    dma_channel_start(2);
-}
-
-void __not_in_flash_func(dma_irq_handler_address)(void)
-{
-    // DPRINTF("DMA IRQ\n");
-    // Clear the interrupt request for the channel
-    dma_hw->ints0 = 1u << 1;
-    // uint32_t addr = (uint32_t)dma_hw->ch[2].al3_read_addr_trig;
-    // uint16_t value = *((uint16_t *)addr);
-    // DPRINTF("DMA ADDR: $%x, VALUE: $%x\n", addr, value);
-
-    // Restart the DMA
-    //    dma_channel_start(1);
-}
+PIO default_pio = pio0;
 
 static int init_monitor_rom4(PIO pio)
 {
@@ -134,6 +105,7 @@ static int init_rom_emulator(PIO pio, IRQInterceptionCallback requestCallback, I
     pio_sm_clear_fifos(pio, smReadROM);
     pio_sm_restart(pio, smReadROM);
     pio_sm_set_enabled(pio, smReadROM, true);
+    read_rom_sm = smReadROM;
 
     // DMA configuration
     // Lookup data DMA: the address of the data to read from the ROM is injected from the
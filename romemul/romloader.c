@@ -27,6 +27,11 @@ static bool microsd_status = false;
 static int filtered_num_local_files = 0;
 static char **filtered_local_list = NULL;
 
+// Paged files list variables. The names are read from the folder index instead of filtered_local_list
+static bool list_paged = false;
+static int list_roms_page = -1;
+static int list_floppies_page = -1;
+
 // ROMs in sd card variables
 static int list_roms = false;
 static int rom_file_selected = -1;
@@ -75,19 +80,45 @@ static bool gemdrive_boot = false;
 // Config call
 static bool get_config_call = false;
 
-// Custom case-insensitive comparison function
-static int compare_strings(const void *a, const void *b)
+// Boot profile call
+static bool get_boot_profile = false;
+
+// Get the name of the file selected in the last list. Paged lists read it from the folder index
+static char *get_selected_filename(const char *dir, const char *index_filename, int file_selected)
 {
-    const char *str1 = *(const char **)a;
-    const char *str2 = *(const char **)b;
+    static char indexed_filename[FF_LFN_BUF + 1];
+    if (!list_paged)
+    {
+        return filtered_local_list[file_selected - 1];
+    }
+    if (!dirindex_get_name(dir, index_filename, file_selected - 1, indexed_filename, sizeof(indexed_filename)))
+    {
+        DPRINTF("File %d not found in the index of %s\n", file_selected, dir);
+        return NULL;
+    }
+    return indexed_filename;
+}
 
-    while (*str1 && *str2 && tolower((unsigned char)*str1) == tolower((unsigned char)*str2))
+// Store a page of the files of the folder in the shared memory. The index is rebuilt if the folder changed
+static void store_file_list_page(uint8_t *memory_area, const char *dir, const char *index_filename, const char **allowed_extensions, size_t num_extensions, uint16_t first)
+{
+    // The names are read from the index from now on
+    release_memory_files(filtered_local_list, filtered_num_local_files);
+    filtered_local_list = NULL;
+    filtered_num_local_files = 0;
+    list_paged = true;
+
+    // A listing starts at the first page. The next pages use the index checked then
+    if (first == 0)
     {
-        str1++;
-        str2++;
+        dirindex_invalidate();
     }
+    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+    dirindex_refresh(dir, index_filename, allowed_extensions, num_extensions);
+    dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
 
-    return tolower((unsigned char)*str1) - tolower((unsigned char)*str2);
+    int count = dirindex_store_page(dir, index_filename, first, memory_area + RANDOM_SEED_SIZE, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
+    DPRINTF("Page of %s from %d: %d files\n", dir, first, count);
 }
 
 // Check if the sd card is initalized and mounted and update the information of the folders
@@ -100,9 +131,7 @@ static void update_sd_status(FATFS *fs, SdCardData *sd_data_ptr)
         return;
     }
 
-    ConfigEntry *is_fcount_enabled_conf = find_entry(PARAM_FILE_COUNT_ENABLED);
-    bool is_fcount_enabled = (is_fcount_enabled_conf->value[0] == 't' || is_fcount_enabled_conf->value[0] == 'T') ? true : false;
-    get_sdcard_data(fs, sd_data_local, sd_data_ptr, is_fcount_enabled);
+    get_sdcard_data(fs, sd_data_local, sd_data_ptr, configSnapshot.file_count_enabled);
 
     // Copy the content of sd_data_local to sd_data_ptr
     memcpy(sd_data_ptr, sd_data_local, sizeof(SdCardData));
@@ -155,6 +184,20 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
             list_roms = true; // now the active loop should stop and list the ROMs
         }
         break;
+    case LIST_ROMS_PAGE:
+        // Get a page of the list of roms in the SD card
+        DPRINTF("Command LIST_ROMS_PAGE (%i) received: %d\n", protocol->command_id, protocol->payload_size);
+        random_token = ((*((uint32_t *)protocol->payload) & 0xFFFF0000) >> 16) | ((*((uint32_t *)protocol->payload) & 0x0000FFFF) << 16);
+        if (!microsd_mounted)
+        {
+            DPRINTF("SD card not mounted. Cannot list ROMs.\n");
+            memset(memory_area, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES);
+        }
+        else
+        {
+            list_roms_page = protocol->payload[4] | (protocol->payload[5] << 8); // now the active loop should list the page
+        }
+        break;
     case GET_CONFIG:
         // Get the list of parameters in the device
         DPRINTF("Command GET_CONFIG (%i) received: %d\n", protocol->command_id, protocol->payload_size);
@@ -314,6 +357,20 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
             list_floppies = true; // now the active loop should stop and list the floppy images
         }
         break;
+    case LIST_FLOPPIES_PAGE:
+        // Get a page of the list of floppy images in the SD card
+        DPRINTF("Command LIST_FLOPPIES_PAGE (%i) received: %d\n", protocol->command_id, protocol->payload_size);
+        random_token = ((*((uint32_t *)protocol->payload) & 0xFFFF0000) >> 16) | ((*((uint32_t *)protocol->payload) & 0x0000FFFF) << 16);
+        if (!microsd_mounted)
+        {
+            DPRINTF("SD card not mounted. Cannot list Floppies.\n");
+            memset(memory_area, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES);
+        }
+        else
+        {
+            list_floppies_page = protocol->payload[4] | (protocol->payload[5] << 8); // now the active loop should list the page
+        }
+        break;
     case QUERY_FLOPPY_DB:
         // Get the list of floppy images for a given letter from the Atari ST Databse
         DPRINTF("Command QUERY_FLOPPY_DB (%i) received: %d\n", protocol->command_id, protocol->payload_size);
@@ -362,6 +419,12 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
         random_token = ((*((uint32_t *)protocol->payload) & 0xFFFF0000) >> 16) | ((*((uint32_t *)protocol->payload) & 0x0000FFFF) << 16);
         latest_release = true;
         break;
+    case GET_BOOT_PROFILE:
+        // Get the timestamps of the boot phases
+        DPRINTF("Command GET_BOOT_PROFILE (%i) received: %d\n", protocol->command_id, protocol->payload_size);
+        random_token = ((*((uint32_t *)protocol->payload) & 0xFFFF0000) >> 16) | ((*((uint32_t *)protocol->payload) & 0x0000FFFF) << 16);
+        get_boot_profile = true;
+        break;
     case CREATE_FLOPPY:
         // Create an empty floppy image based in a template
         DPRINTF("Command CREATE_FLOPPY (%i) received: %d\n", protocol->command_id, protocol->payload_size);
@@ -431,8 +494,12 @@ static void __not_in_flash_func(handle_protocol_command)(const TransmissionProto
 // Interrupt handler callback for DMA completion
 void __not_in_flash_func(dma_irq_handler_lookup_callback)(void)
 {
+    // Clear the interrupt request for the channel. A new access during the handler sets it again
+    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+
     // Read the address to process
     uint32_t addr = (uint32_t)dma_hw->ch[lookup_data_rom_dma_channel].al3_read_addr_trig;
+    busstats_access(addr);
 
     // Avoid priting anything inside an IRQ handled function
     // DPRINTF("DMA LOOKUP: $%x\n", addr);
@@ -440,9 +507,7 @@ void __not_in_flash_func(dma_irq_handler_lookup_callback)(void)
     {
         parse_protocol((uint16_t)(addr & 0xFFFF), handle_protocol_command);
     }
-
-    // Clear the interrupt request for the channel
-    dma_hw->ints1 = 1u << lookup_data_rom_dma_channel;
+    busstats_irq_exit(lookup_data_rom_dma_channel);
 }
 
 int delete_FLASH(void)
@@ -455,16 +520,20 @@ int delete_FLASH(void)
     return 0;
 }
 
-int init_firmware()
+// The state of the loop of the configurator. Prepared by romloader_setup() and used by romloader_poll()
+static FATFS fs;
+static int num_files = 0;
+static char **file_list = NULL;
+static uint8_t *memory_area;
+static const uint16_t version_buff_size = 256;
+static uint16_t wifi_scan_poll_polling_ms;
+static SdCardData sd_data;
+static bool version_checked = false;
+static absolute_time_t storage_poll_counter;
+static absolute_time_t wifi_scan_poll_counter;
+
+void romloader_setup(void)
 {
-    // Hybrid way to initialize the ROM emulator:
-    // IRQ handler callback to read the commands in ROM3, and NOT copy the FLASH ROMs to RAM
-    // and start the state machine
-    init_romemul(NULL, dma_irq_handler_lookup_callback, false);
-
-    // Copy the firmware to RAM
-    COPY_FIRMWARE_TO_RAM((uint16_t *)firmwareROM, firmwareROM_length);
-
     // Reserve memory for the protocol parser
     init_protocol_parser();
 
@@ -478,10 +547,8 @@ int init_firmware()
     // Print the config
     print_config_table();
 
-    FRESULT fr;
-    FATFS fs;
-    int num_files = 0;
-    char **file_list = NULL;
+    num_files = 0;
+    file_list = NULL;
 
     // Initialize SD card
     microsd_initialized = sd_init_driver();
@@ -495,6 +562,7 @@ int init_firmware()
         // Mount drive
         microsd_mounted = is_sdcard_mounted(&fs);
     }
+    bootprof_mark("sdcard");
 
     // Copy the content of the file list to the end of the ROM4 memory minus 4Kbytes
     // Translated to pure ROM4 address of the ST: 0xFB0000 - 0x1000 = 0xFAF000
@@ -508,10 +576,9 @@ int init_firmware()
     // x=PEEK(&HFB0002) 'Size of the payload (always even numbers)
     // x=PEEK(&HFB0001) 'Payload (two bytes per word)
 
-    uint8_t *memory_area = (uint8_t *)(ROM3_START_ADDRESS);
+    memory_area = (uint8_t *)(ROM3_START_ADDRESS);
 
     // Clean the version buffer area
-    uint16_t version_buff_size = 256;
     memset(memory_area - version_buff_size, 0, version_buff_size);
 
     // Here comes the tricky part. We have to put in the higher section of the ROM4 memory the content
@@ -520,10 +587,9 @@ int init_firmware()
     // two 0x00 bytes.
 
     // Configure polling times
-    u_int16_t wifi_scan_poll_polling_ms = get_wifi_scan_poll_secs() * 1000;
-    u_int32_t network_status_polling_ms = get_network_status_polling_ms();
+    wifi_scan_poll_polling_ms = get_wifi_scan_poll_secs() * 1000;
 
-    SdCardData sd_data = {0}; // Lazy initalization
+    memset(&sd_data, 0, sizeof(sd_data)); // Lazy initalization
     if (microsd_mounted)
     {
         FRESULT err = read_and_trim_file(WIFI_PASS_FILE_NAME, &wifi_password_file_content, MAX_WIFI_PASSWORD_LENGTH);
@@ -550,9 +616,18 @@ int init_firmware()
         }
     }
 
-    // Start the network.
-    bool wifi_init = true;
-    network_init(false, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
+    // Start the network. The manager joins the configured network in the background
+    if (configSnapshot.wifi_configured)
+    {
+        wifi_manager_start(&wifi_password_file_content, 0, NULL, NULL);
+    }
+    else
+    {
+        // Only to scan the networks around
+        network_init(false, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
+    }
+    bootprof_mark("network");
+    bootprof_print();
 
     // The "C" character stands for "Configurator"
     blink_morse('C');
@@ -573,670 +648,701 @@ int init_firmware()
 //     }
 
     // Only ask for version once
-    bool version_checked = false;
-
-    absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(storage_poll_counter, 0);
-    absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(network_poll_counter, 0);
-    absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(wifi_scan_poll_counter, wifi_scan_poll_polling_ms);
-    absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(reconnect_t, 0);
-    while ((rom_file_selected < 0) &&
-           (rom_network_selected < 0) &&
-           (!reset_default) && (!rtc_boot) && (!gemdrive_boot) &&
-           (rom_rescue_mode_file_content == NULL))
+    version_checked = false;
+
+    storage_poll_counter = from_us_since_boot(0);
+    wifi_scan_poll_counter = from_us_since_boot(wifi_scan_poll_polling_ms);
+}
+
+bool romloader_poll(void)
+{
+    if ((rom_file_selected >= 0) ||
+        (rom_network_selected >= 0) ||
+        reset_default || rtc_boot || gemdrive_boot ||
+        (rom_rescue_mode_file_content != NULL))
     {
-        tight_loop_contents();
+        // Something to do before the reboot
+        return false;
+    }
+
+    tight_loop_contents();
+    busstats_poll(NULL);
+    capture_poll(APP_CONFIGURATOR);
 
+    WifiManagerState wifi_state = wifi_manager_poll();
 #if PICO_CYW43_ARCH_POLL
+    if (wifi_state == WIFI_MANAGER_STOPPED)
+    {
+        // Not joined, but the scan still needs the network stack
         network_safe_poll();
+    }
 #endif
 
-        // Check if the network is disconnected and scan the networks
-        if (time_passed(&wifi_scan_poll_counter, wifi_scan_poll_polling_ms))
+    // Check if the network is disconnected and scan the networks
+    if (time_passed(&wifi_scan_poll_counter, wifi_scan_poll_polling_ms))
+    {
+        wifi_scan_poll_counter = make_timeout_time_ms(0);
+        if (get_network_connection_status() == DISCONNECTED)
+        {
+            DPRINTF("Wifi scan polling...\n");
+            network_scan();
+        }
+    }
+
+    // If the wifi_auth is not NULL, then connect save the auth info and connect to the network
+    // This is done when the user enters the wifi credentials to start the connection process
+    if (wifi_auth != NULL)
+    {
+        DPRINTF("Connecting to network...\n");
+        put_string(PARAM_WIFI_SSID, wifi_auth->ssid);
+        put_string(PARAM_WIFI_PASSWORD, wifi_auth->password);
+        put_integer(PARAM_WIFI_AUTH, wifi_auth->auth_mode);
+        write_all_entries();
+
+        wifi_manager_start(&wifi_password_file_content, 0, NULL, NULL);
+        free(wifi_auth);
+        wifi_auth = NULL;
+    }
+
+    // Restart the network and reconnect
+    if (restart_network)
+    {
+        restart_network = false;
+        // Force  network disconnection
+        wifi_manager_start(&wifi_password_file_content, 0, NULL, NULL);
+    }
+
+    // Fully disconnect from the network, clean credentials and start scanning for 
+    // other networks around
+    if (disconnect_network)
+    {
+        disconnect_network = false;
+        // Force  network disconnection
+        wifi_manager_stop();
+
+        network_scan();
+
+        // Clean the credentials configuration
+        put_string(PARAM_WIFI_SSID, "");
+        put_string(PARAM_WIFI_PASSWORD, "");
+        put_integer(PARAM_WIFI_AUTH, 0);
+        write_all_entries();
+    }
+
+    // Check the latest version once the network is connected
+    if (!version_checked && (wifi_state == WIFI_MANAGER_CONNECTED))
+    {
+        version_checked = true;
+        memset(memory_area - version_buff_size, 0, version_buff_size);
+        int err = get_latest_release();
+        if (err == ERR_OK)
         {
-            wifi_scan_poll_counter = make_timeout_time_ms(0);
-            if (get_network_connection_status() == DISCONNECTED)
+            char *latest_version = get_latest_release_str();
+            DPRINTF("Current version: %s\n", RELEASE_VERSION);
+            DPRINTF("Latest version: %s\n", latest_version);
+            if (compare_versions(latest_version, RELEASE_VERSION) > 0)
+            {
+                DPRINTF("New version available: %s\n", latest_version);
+                strcpy((char *)(memory_area - version_buff_size), latest_version);
+                // Convert to motorla endian
+                CHANGE_ENDIANESS_BLOCK16(memory_area - version_buff_size, strlen(latest_version));
+            }
+            else
             {
-                DPRINTF("Wifi scan polling...\n");
-                network_scan();
+                DPRINTF("No new version available\n");
             }
         }
+        else {
+            DPRINTF("Error getting the latest version\n");
+        }
+    }
 
-        // If the wifi_auth is not NULL, then connect save the auth info and connect to the network
-        // This is done when the user enters the wifi credentials to start the connection process
-        if (wifi_auth != NULL)
+    // Poll the storage status in the SD card
+    if (time_passed(&storage_poll_counter, STORAGE_POLL_INTERVAL))
+    {
+        storage_poll_counter = make_timeout_time_ms(0);
+        if (sd_data.sd_size == 0)
         {
-            DPRINTF("Connecting to network...\n");
-            put_string(PARAM_WIFI_SSID, wifi_auth->ssid);
-            put_string(PARAM_WIFI_PASSWORD, wifi_auth->password);
-            put_integer(PARAM_WIFI_AUTH, wifi_auth->auth_mode);
-            write_all_entries();
-
-            network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-            free(wifi_auth);
-            wifi_auth = NULL;
+            update_sd_status(&fs, &sd_data);
         }
+    }
 
-        // Restart the network and reconnect
-        if (restart_network)
+    if (get_config_call)
+    {
+        get_config_call = false;
+        memcpy(memory_area + RANDOM_SEED_SIZE, &configData, sizeof(configData));
+
+        // Swap the keys and values section bytes in the words
+        // The endians conversions should be done always in the rp2040 side to relief
+        // the ST side from this task
+        uint16_t *dest_ptr = (uint16_t *)(memory_area + sizeof(__uint32_t) + RANDOM_SEED_SIZE); // Bypass magic number and random size
+        DPRINTF("ConfigData count: %d\n", configData.count);
+        for (int i = 0; i < configData.count; i++)
         {
-            restart_network = false;
-            // Force  network disconnection
-            network_terminate();
-            network_init(false, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
+            swap_data(dest_ptr);
+            dest_ptr += sizeof(ConfigEntry) / 2;
         }
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+    if (persist_config)
+    {
+        persist_config = false;
+        DPRINTF("Saving configuration to FLASH\n");
+        write_all_entries();
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
 
-        // Fully disconnect from the network, clean credentials and start scanning for 
-        // other networks around
-        if (disconnect_network)
-        {
-            disconnect_network = false;
-            // Force  network disconnection
-            network_terminate();
+    if (microsd_status)
+    {
+        microsd_status = false;
+        update_sd_status(&fs, &sd_data);
+        memcpy(memory_area + RANDOM_SEED_SIZE, &sd_data, sizeof(SdCardData));
+        SdCardData *sd_data_mem = (SdCardData *)(memory_area + RANDOM_SEED_SIZE);
+        sd_data_mem->roms_folder_count = (sd_data.roms_folder_count >> 16) | (sd_data.roms_folder_count << 16);
+        sd_data_mem->floppies_folder_count = (sd_data.floppies_folder_count >> 16) | (sd_data.floppies_folder_count << 16);
+        sd_data_mem->harddisks_folder_count = (sd_data.harddisks_folder_count >> 16) | (sd_data.harddisks_folder_count << 16);
+        sd_data_mem->sd_free_space = (sd_data.sd_free_space >> 16) | (sd_data.sd_free_space << 16);
+        sd_data_mem->sd_size = (sd_data.sd_size >> 16) | (sd_data.sd_size << 16);
+
+        CHANGE_ENDIANESS_BLOCK16(memory_area + RANDOM_SEED_SIZE, MAX_FOLDER_LENGTH * 3);
 
-            network_scan();
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
 
-            // Clean the credentials configuration
-            put_string(PARAM_WIFI_SSID, "");
-            put_string(PARAM_WIFI_PASSWORD, "");
-            put_integer(PARAM_WIFI_AUTH, 0);
-            write_all_entries();
-        }
+    if (get_ip_data) {
+        get_ip_data = false;
+        ConnectionData connection_data_tmp = {0};
+        get_connection_data(&connection_data_tmp);
+        memcpy(memory_area + RANDOM_SEED_SIZE, &connection_data_tmp, sizeof(ConnectionData));
+        network_swap_connection_data((__uint16_t *)(memory_area + RANDOM_SEED_SIZE));
+
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    if (latest_release)
+    {
+        latest_release = false;
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    if (get_boot_profile)
+    {
+        get_boot_profile = false;
+        bootprof_copy_to_shared(memory_area + RANDOM_SEED_SIZE);
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // Download the json file
+    if (get_rom_catalog)
+    {
+        get_rom_catalog = false;
+        DPRINTF("Getting ROM catalog...\n");
 
-        // Poll the network status and reconnect if needed
-        if (time_passed(&network_poll_counter, network_status_polling_ms))
+        // Free dynamically allocated memory first just in case
+        if (filtered_num_network_files > 0)
         {
-            network_poll_counter = make_timeout_time_ms(0);
-            if (strlen(find_entry(PARAM_WIFI_SSID)->value) > 0)
+            DPRINTF("Freeing network files...\n");
+            RomInfo *current = network_files;
+
+            // Free dynamically allocated memory for each node in the list
+            while (current != NULL)
             {
-                // Only display when changes status to avoid flooding the console
-                ConnectionStatus previous_status = get_previous_connection_status();
-                ConnectionStatus current_status = get_network_connection_status();
-                if (current_status != previous_status)
+                // Free each dynamically allocated field, if non-NULL
+                if (current->url)
                 {
-#if defined(_DEBUG) && (_DEBUG != 0)
-                    ConnectionData connection_data = {0};
-                    get_connection_data(&connection_data);
-                    DPRINTF("Status: %d - Prev: %d - SSID: %s - IPv4: %s - GW:%s - Mask:%s - MAC:%s\n",
-                            current_status,
-                            previous_status,
-                            connection_data.ssid,
-                            connection_data.ipv4_address,
-                            print_ipv4(get_gateway()),
-                            print_ipv4(get_netmask()),
-                            print_mac(get_mac_address()));
-#endif
-                    ConfigEntry *dhcp_enabled_conf = find_entry(PARAM_WIFI_DHCP);
-                    bool dhcp_enabled = false;
-                    if (dhcp_enabled_conf != NULL)
-                    {
-                        dhcp_enabled = (dhcp_enabled_conf->value[0] == 't' || dhcp_enabled_conf->value[0] == 'T') ? true : false;
-                    }
-                    if (!version_checked && ((current_status == CONNECTED_WIFI_IP) || ((current_status == CONNECTED_WIFI_NO_IP) && !dhcp_enabled)))
-                    {
-                        version_checked = true;
-                        memset(memory_area - version_buff_size, 0, version_buff_size);
-                        int err = get_latest_release();
-                        if (err == ERR_OK)
-                        {
-                            char *latest_version = get_latest_release_str();
-                            DPRINTF("Current version: %s\n", RELEASE_VERSION);
-                            DPRINTF("Latest version: %s\n", latest_version);
-                            if (compare_versions(latest_version, RELEASE_VERSION) > 0)
-                            {
-                                DPRINTF("New version available: %s\n", latest_version);
-                                strcpy((char *)(memory_area - version_buff_size), latest_version);
-                                // Convert to motorla endian
-                                CHANGE_ENDIANESS_BLOCK16(memory_area - version_buff_size, strlen(latest_version));
-                            }
-                            else
-                            {
-                                DPRINTF("No new version available\n");
-                            }
-                        }
-                        else {
-                            DPRINTF("Error getting the latest version\n");
-                        }
-                    }
-                    if ((current_status == GENERIC_ERROR) || (current_status == CONNECT_FAILED_ERROR) || (current_status == BADAUTH_ERROR))
-                    {
-                        if (wifi_init)
-                        {
-                            network_terminate();
-                            wifi_init = false;
-                            reconnect_t = make_timeout_time_ms(0);
-                            DPRINTF("Connection failed. Retrying...\n");
-                        }
-                    }
+                    free(current->url);
+                    current->url = NULL;
                 }
-                if ((!wifi_init) && (time_passed(&reconnect_t, 3000) == 1))
+                if (current->name)
                 {
-                    network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-                    reconnect_t = make_timeout_time_ms(0);
-                    wifi_init = true;
+                    free(current->name);
+                    current->name = NULL;
+                }
+                // Description not used
+                // if (current->description)
+                // {
+                //     free(current->description);
+                //     current->description = NULL;
+                // }
+                if (current->tags)
+                {
+                    free(current->tags);
+                    current->tags = NULL;
                 }
-            }
-        }
 
-        // Poll the storage status in the SD card
-        if (time_passed(&storage_poll_counter, STORAGE_POLL_INTERVAL))
-        {
-            storage_poll_counter = make_timeout_time_ms(0);
-            if (sd_data.sd_size == 0)
-            {
-                update_sd_status(&fs, &sd_data);
+                // Store the next node before freeing the current one
+                RomInfo *next = current->next;
+
+                // Free the current node and move to the next
+                if (current != NULL) {
+                    free(current);
+                }
+                current = next;
             }
+
+            // Optional: Reset the head pointer if you’re done with the list
+            network_files = NULL;
         }
 
-        if (get_config_call)
+        // Clean memory space
+        memset(memory_area + RANDOM_SEED_SIZE, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
+
+        // Get the URL from the configuration
+        // char *url = find_entry(PARAM_ROMS_YAML_URL)->value;
+        char *url = find_entry(PARAM_ROMS_CSV_URL)->value;
+
+        DPRINTF("URL: %s\n", url);
+        // The the JSON file info
+        err_t err = get_rom_catalog_file(&network_files, &filtered_num_network_files, url);
+        if (err == ERR_OK)
         {
-            get_config_call = false;
-            memcpy(memory_area + RANDOM_SEED_SIZE, &configData, sizeof(configData));
-
-            // Swap the keys and values section bytes in the words
-            // The endians conversions should be done always in the rp2040 side to relief
-            // the ST side from this task
-            uint16_t *dest_ptr = (uint16_t *)(memory_area + sizeof(__uint32_t) + RANDOM_SEED_SIZE); // Bypass magic number and random size
-            DPRINTF("ConfigData count: %d\n", configData.count);
-            for (int i = 0; i < configData.count; i++)
+            // Iterate over the RomInfo items and populate the names array
+            char *dest_ptr = (char *)(memory_area + RANDOM_SEED_SIZE);
+            RomInfo *current = network_files;
+            for (int i = 0; i < filtered_num_network_files; i++)
             {
-                swap_data(dest_ptr);
-                dest_ptr += sizeof(ConfigEntry) / 2;
+                DPRINTF("Name: %s, tags: %s, size: %d\n", current->name, current->tags, current->size_kb);
+                // Ensure the name is padded with spaces up to position 60
+                char padded_name[51]; // 50 characters for padding + 1 for null terminator
+                snprintf(padded_name, sizeof(padded_name), "%-50s", current->name);
+
+                char padded_tags[26]; // 25 characters for padding + 1 for null terminator
+                snprintf(padded_tags, sizeof(padded_tags), "%-25s", current->tags);
+
+                char padded_size[6]; // 5 characters for padding + 1 for null terminator
+                snprintf(padded_size, sizeof(padded_size), "%5d", current->size_kb);
+
+                // Display padded content
+                sprintf(dest_ptr, "%s%s%s\0", padded_name, padded_tags, padded_size);
+                dest_ptr += strlen(dest_ptr) + 1;
+
+                current = current->next;
             }
-            *((volatile uint32_t *)(memory_area)) = random_token;
+            // If dest_ptr is odd, add a 0x00 byte to align the next string
+            if ((uintptr_t)dest_ptr & 1)
+            {
+                *dest_ptr++ = 0x00;
+            } // Add an additional 0x00 word to mark the end of the list
+            *dest_ptr++ = 0x00;
+            *dest_ptr++ = 0x00;
+
+            // Swap the words to motorola endian format: BIG ENDIAN
+            CHANGE_ENDIANESS_BLOCK16(memory_area + RANDOM_SEED_SIZE, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
         }
-        if (persist_config)
+        else
         {
-            persist_config = false;
-            DPRINTF("Saving configuration to FLASH\n");
-            write_all_entries();
-            *((volatile uint32_t *)(memory_area)) = random_token;
+            DPRINTF("Error getting the ROM catalog: %d\n", err);
         }
 
-        if (microsd_status)
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // List the ROM images in the SD card
+    if (list_roms)
+    {
+        list_roms = false;
+        list_paged = false;
+        // Show the root directory content (ls command)
+        char *dir = find_entry(PARAM_ROMS_FOLDER)->value;
+        if (strlen(dir) == 0)
         {
-            microsd_status = false;
-            update_sd_status(&fs, &sd_data);
-            memcpy(memory_area + RANDOM_SEED_SIZE, &sd_data, sizeof(SdCardData));
-            SdCardData *sd_data_mem = (SdCardData *)(memory_area + RANDOM_SEED_SIZE);
-            sd_data_mem->roms_folder_count = (sd_data.roms_folder_count >> 16) | (sd_data.roms_folder_count << 16);
-            sd_data_mem->floppies_folder_count = (sd_data.floppies_folder_count >> 16) | (sd_data.floppies_folder_count << 16);
-            sd_data_mem->harddisks_folder_count = (sd_data.harddisks_folder_count >> 16) | (sd_data.harddisks_folder_count << 16);
-            sd_data_mem->sd_free_space = (sd_data.sd_free_space >> 16) | (sd_data.sd_free_space << 16);
-            sd_data_mem->sd_size = (sd_data.sd_size >> 16) | (sd_data.sd_size << 16);
+            dir = "";
+        }
+        DPRINTF("ROM images folder: %s\n", dir);
+        file_list = show_dir_files(dir, &num_files);
 
-            CHANGE_ENDIANESS_BLOCK16(memory_area + RANDOM_SEED_SIZE, MAX_FOLDER_LENGTH * 3);
+        // Remove hidden files from the list
+        const char *allowed_extensions[] = {"img", "bin", "stc", "rom"};
 
-            *((volatile uint32_t *)(memory_area)) = random_token;
-        }
+        filtered_local_list = filter(file_list, num_files, &filtered_num_local_files, allowed_extensions, 4);
+        // Sort remaining valid filenames lexicographically
+        qsort(filtered_local_list, filtered_num_local_files, sizeof(char *), compare_strings);
+        // Store the list in the ROM memory space
+        store_file_list(filtered_local_list, filtered_num_local_files, (memory_area + RANDOM_SEED_SIZE));
 
-        if (get_ip_data) {
-            get_ip_data = false;
-            ConnectionData connection_data_tmp = {0};
-            get_connection_data(&connection_data_tmp);
-            memcpy(memory_area + RANDOM_SEED_SIZE, &connection_data_tmp, sizeof(ConnectionData));
-            network_swap_connection_data((__uint16_t *)(memory_area + RANDOM_SEED_SIZE));
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
 
-            *((volatile uint32_t *)(memory_area)) = random_token;
+    // List the floppy images in the SD card
+    if (list_floppies)
+    {
+        list_floppies = false;
+        list_paged = false;
+        // Show the root directory content (ls command)
+        char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+        if (strlen(dir) == 0)
+        {
+            dir = "";
         }
+        DPRINTF("Floppy images folder: %s\n", dir);
+        // Get the list of floppy image files in the directory
+        file_list = show_dir_files(dir, &num_files);
+
+        // Remove hidden files from the list
+        const char *allowed_extensions[] = {"st", "msa", "rw"};
+        filtered_local_list = filter(file_list, num_files, &filtered_num_local_files, allowed_extensions, 3);
+        // Sort remaining valid filenames lexicographically
+        qsort(filtered_local_list, filtered_num_local_files, sizeof(char *), compare_strings);
+        // Store the list in the ROM memory space
+        store_file_list(filtered_local_list, filtered_num_local_files, (memory_area + RANDOM_SEED_SIZE));
 
-        if (latest_release)
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // List a page of the ROM images in the SD card
+    if (list_roms_page >= 0)
+    {
+        uint16_t first = list_roms_page;
+        list_roms_page = -1;
+        const char *allowed_extensions[] = {"img", "bin", "stc", "rom"};
+        store_file_list_page(memory_area, find_entry(PARAM_ROMS_FOLDER)->value, DIRINDEX_ROMS_FILENAME, allowed_extensions, 4, first);
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // List a page of the floppy images in the SD card
+    if (list_floppies_page >= 0)
+    {
+        uint16_t first = list_floppies_page;
+        list_floppies_page = -1;
+        const char *allowed_extensions[] = {"st", "msa", "rw"};
+        store_file_list_page(memory_area, find_entry(PARAM_FLOPPIES_FOLDER)->value, DIRINDEX_FLOPPIES_FILENAME, allowed_extensions, 3, first);
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // Query the Atari ST Database for the list of floppy images for a given letter
+    if (query_floppy_db)
+    {
+        query_floppy_db = false;
+
+        // Free dynamically allocated memory first
+        while (floppy_images_files != NULL)
         {
-            latest_release = false;
-            *((volatile uint32_t *)(memory_area)) = random_token;
+            FloppyImageInfo *current = floppy_images_files;
+
+            // Free each dynamically allocated string in the structure
+            free(current->name);
+            free(current->status);
+            free(current->description);
+            free(current->tags);
+            free(current->extra);
+            free(current->url);
+
+            // Free the current structure
+            free(current);
+
+            // Move to the next item
+            floppy_images_files = floppy_images_files->next; // Move to the next item before freeing the current one
         }
+        floppy_images_files = NULL;
 
-        // Download the json file
-        if (get_rom_catalog)
-        {
-            get_rom_catalog = false;
-            DPRINTF("Getting ROM catalog...\n");
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
 
-            // Free dynamically allocated memory first just in case
-            if (filtered_num_network_files > 0)
-            {
-                DPRINTF("Freeing network files...\n");
-                RomInfo *current = network_files;
+        // Get the URL from the configuration
+        char *base_url = find_entry(PARAM_FLOPPY_DB_URL)->value;
 
-                // Free dynamically allocated memory for each node in the list
-                while (current != NULL)
-                {
-                    // Free each dynamically allocated field, if non-NULL
-                    if (current->url)
-                    {
-                        free(current->url);
-                        current->url = NULL;
-                    }
-                    if (current->name)
-                    {
-                        free(current->name);
-                        current->name = NULL;
-                    }
-                    // Description not used
-                    // if (current->description)
-                    // {
-                    //     free(current->description);
-                    //     current->description = NULL;
-                    // }
-                    if (current->tags)
-                    {
-                        free(current->tags);
-                        current->tags = NULL;
-                    }
-
-                    // Store the next node before freeing the current one
-                    RomInfo *next = current->next;
-
-                    // Free the current node and move to the next
-                    if (current != NULL) {
-                        free(current);
-                    }
-                    current = next;
-                }
+        // Ensure that the buffer is large enough for the original URL, the `/db/`, the letter, `.csv`, and the null terminator.
+        char url[256]; // Adjust the size as needed based on the maximum length of base_url.
 
-                // Optional: Reset the head pointer if you’re done with the list
-                network_files = NULL;
-            }
+        sprintf(url, "%s/db/%c.csv", base_url, query_floppy_letter);
 
-            // Clean memory space
-            memset(memory_area + RANDOM_SEED_SIZE, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
+        err_t res = get_floppy_db_files(&floppy_images_files, &filtered_num_floppy_images_files, url);
 
-            // Get the URL from the configuration
-            // char *url = find_entry(PARAM_ROMS_YAML_URL)->value;
-            char *url = find_entry(PARAM_ROMS_CSV_URL)->value;
+        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
 
-            DPRINTF("URL: %s\n", url);
-            // The the JSON file info
-            err_t err = get_rom_catalog_file(&network_files, &filtered_num_network_files, url);
-            if (err == ERR_OK)
+        // Demonstrate the results
+        // for (int i = 0; i < filtered_num_floppy_images_files; i++)
+        // {
+        //     DPRINTF("Name: %s, Status: %s, Description: %s, Tags: %s, Extra: %s, URL: %s\n",
+        //             floppy_images_files[i].name, floppy_images_files[i].status, floppy_images_files[i].description,
+        //             floppy_images_files[i].tags, floppy_images_files[i].extra, floppy_images_files[i].url);
+        // }
+
+        memset(memory_area + RANDOM_SEED_SIZE, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE); // Clean the memory area except the random token
+        if (res == ERR_OK)
+        {
+            if (filtered_num_floppy_images_files > 0)
             {
                 // Iterate over the RomInfo items and populate the names array
-                char *dest_ptr = (char *)(memory_area + RANDOM_SEED_SIZE);
-                RomInfo *current = network_files;
-                for (int i = 0; i < filtered_num_network_files; i++)
+                char *dest_ptr = (char *)(memory_area + 4); // Bypass random token
+                // Get the first element, if any
+                FloppyImageInfo *floppy_images_file = floppy_images_files;
+                for (int i = 0; i < filtered_num_floppy_images_files; i++)
                 {
-                    DPRINTF("Name: %s, tags: %s, size: %d\n", current->name, current->tags, current->size_kb);
+                    // Copy the string from network_files[i].name to dest_ptr
                     // Ensure the name is padded with spaces up to position 60
-                    char padded_name[51]; // 50 characters for padding + 1 for null terminator
-                    snprintf(padded_name, sizeof(padded_name), "%-50s", current->name);
+                    char padded_name[61]; // 60 characters for padding + 1 for null terminator
+                    snprintf(padded_name, sizeof(padded_name), "%-52s", floppy_images_file->name);
 
-                    char padded_tags[26]; // 25 characters for padding + 1 for null terminator
-                    snprintf(padded_tags, sizeof(padded_tags), "%-25s", current->tags);
+                    char padded_extra[16]; // 15 characters for padding + 1 for null terminator
+                    snprintf(padded_extra, sizeof(padded_extra), "%-15s", floppy_images_file->extra);
 
-                    char padded_size[6]; // 5 characters for padding + 1 for null terminator
-                    snprintf(padded_size, sizeof(padded_size), "%5d", current->size_kb);
+                    char padded_filename[13]; // 12 characters for padding + 1 for null terminator
+                    // Get the filename from the URL
+                    char fname[256] = {0};
+                    extract_filename(floppy_images_file->url, fname);
+                    snprintf(padded_filename, sizeof(padded_filename), "%-13s", fname);
 
                     // Display padded content
-                    sprintf(dest_ptr, "%s%s%s\0", padded_name, padded_tags, padded_size);
+                    sprintf(dest_ptr, "%s%s %s\0", padded_name, padded_extra, padded_filename);
                     dest_ptr += strlen(dest_ptr) + 1;
-
-                    current = current->next;
+                    floppy_images_file = floppy_images_file->next;
                 }
-                // If dest_ptr is odd, add a 0x00 byte to align the next string
-                if ((uintptr_t)dest_ptr & 1)
-                {
-                    *dest_ptr++ = 0x00;
-                } // Add an additional 0x00 word to mark the end of the list
-                *dest_ptr++ = 0x00;
-                *dest_ptr++ = 0x00;
 
                 // Swap the words to motorola endian format: BIG ENDIAN
                 CHANGE_ENDIANESS_BLOCK16(memory_area + RANDOM_SEED_SIZE, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
             }
             else
             {
-                DPRINTF("Error getting the ROM catalog: %d\n", err);
+                DPRINTF("No floppy images found for letter %c\n", query_floppy_letter);
             }
-
+            // Only set the random token if the operation was successful. Otherwise, force a retry
+            DPRINTF("Random token: %x\n", random_token);
             *((volatile uint32_t *)(memory_area)) = random_token;
         }
-
-        // List the ROM images in the SD card
-        if (list_roms)
+        else
         {
-            list_roms = false;
-            // Show the root directory content (ls command)
-            char *dir = find_entry(PARAM_ROMS_FOLDER)->value;
-            if (strlen(dir) == 0)
-            {
-                dir = "";
-            }
-            DPRINTF("ROM images folder: %s\n", dir);
-            file_list = show_dir_files(dir, &num_files);
-
-            // Remove hidden files from the list
-            const char *allowed_extensions[] = {"img", "bin", "stc", "rom"};
-
-            filtered_local_list = filter(file_list, num_files, &filtered_num_local_files, allowed_extensions, 4);
-            // Sort remaining valid filenames lexicographically
-            qsort(filtered_local_list, filtered_num_local_files, sizeof(char *), compare_strings);
-            // Store the list in the ROM memory space
-            store_file_list(filtered_local_list, filtered_num_local_files, (memory_area + RANDOM_SEED_SIZE));
-
-            *((volatile uint32_t *)(memory_area)) = random_token;
+            DPRINTF("Error getting floppy images from the Atari ST Database: %d\n", res);
         }
+    }
 
-        // List the floppy images in the SD card
-        if (list_floppies)
+    if (floppy_header.template > 0)
+    {
+        // Append to the floppy_header floppy_name the extension .st.rw
+        char *dest_ptr = floppy_header.floppy_name;
+        while (*dest_ptr != 0)
         {
-            list_floppies = false;
-            // Show the root directory content (ls command)
-            char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
-            if (strlen(dir) == 0)
-            {
-                dir = "";
-            }
-            DPRINTF("Floppy images folder: %s\n", dir);
-            // Get the list of floppy image files in the directory
-            file_list = show_dir_files(dir, &num_files);
-
-            // Remove hidden files from the list
-            const char *allowed_extensions[] = {"st", "msa", "rw"};
-            filtered_local_list = filter(file_list, num_files, &filtered_num_local_files, allowed_extensions, 3);
-            // Sort remaining valid filenames lexicographically
-            qsort(filtered_local_list, filtered_num_local_files, sizeof(char *), compare_strings);
-            // Store the list in the ROM memory space
-            store_file_list(filtered_local_list, filtered_num_local_files, (memory_area + RANDOM_SEED_SIZE));
-
-            *((volatile uint32_t *)(memory_area)) = random_token;
+            dest_ptr++;
         }
+        strcpy(dest_ptr, ".st.rw");
+        DPRINTF("Floppy file to create: %s\n", floppy_header.floppy_name);
+        char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+        DPRINTF("Floppy folder: %s\n", dir);
+        FRESULT err = create_blank_ST_image(dir,
+                                            floppy_header.floppy_name,
+                                            floppy_header.num_tracks,
+                                            floppy_header.num_sectors,
+                                            floppy_header.num_sides,
+                                            floppy_header.volume_name,
+                                            floppy_header.overwrite);
+        if (err != FR_OK)
+        {
+            DPRINTF("Create blank ST image error: %d\n", err);
+        }
+        else
+        {
+            DPRINTF("Created blank ST image OK\n");
+        }
+        floppy_header.template = 0;
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
 
-        // Query the Atari ST Database for the list of floppy images for a given letter
-        if (query_floppy_db)
+    if (floppy_image_selected > 0)
+    {
+        char *extract_filename(char *path)
         {
-            query_floppy_db = false;
+            char *last_slash = strrchr(path, '/'); // Find the last occurrence of '/'
 
-            // Free dynamically allocated memory first
-            while (floppy_images_files != NULL)
+            // If '/' was found, return the string after it
+            if (last_slash && *(last_slash + 1))
             {
-                FloppyImageInfo *current = floppy_images_files;
-
-                // Free each dynamically allocated string in the structure
-                free(current->name);
-                free(current->status);
-                free(current->description);
-                free(current->tags);
-                free(current->extra);
-                free(current->url);
-
-                // Free the current structure
-                free(current);
-
-                // Move to the next item
-                floppy_images_files = floppy_images_files->next; // Move to the next item before freeing the current one
+                return last_slash + 1;
             }
-            floppy_images_files = NULL;
-
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-
-            // Get the URL from the configuration
-            char *base_url = find_entry(PARAM_FLOPPY_DB_URL)->value;
-
-            // Ensure that the buffer is large enough for the original URL, the `/db/`, the letter, `.csv`, and the null terminator.
-            char url[256]; // Adjust the size as needed based on the maximum length of base_url.
-
-            sprintf(url, "%s/db/%c.csv", base_url, query_floppy_letter);
-
-            err_t res = get_floppy_db_files(&floppy_images_files, &filtered_num_floppy_images_files, url);
+            return path; // Return the original path if '/' wasn't found
+        }
+        DPRINTF("Floppy image selected to download: %d\n", floppy_image_selected);
+        FloppyImageInfo remote = *floppy_images_files;
+        for (int i = 0; i < floppy_image_selected - 1; i++)
+        {
+            remote = *(FloppyImageInfo *)remote.next;
+        }
+        char *remote_name = remote.name;
+        char *remote_uri = remote.url;
 
-            dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+        char full_url[512];
+        // Get the URL from the configuration
+        char *base_url = find_entry("FLOPPY_DB_URL")->value;
 
-            // Demonstrate the results
-            // for (int i = 0; i < filtered_num_floppy_images_files; i++)
-            // {
-            //     DPRINTF("Name: %s, Status: %s, Description: %s, Tags: %s, Extra: %s, URL: %s\n",
-            //             floppy_images_files[i].name, floppy_images_files[i].status, floppy_images_files[i].description,
-            //             floppy_images_files[i].tags, floppy_images_files[i].extra, floppy_images_files[i].url);
-            // }
+        char *dest_filename = extract_filename(remote.url);
+        char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
 
-            memset(memory_area + RANDOM_SEED_SIZE, 0, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE); // Clean the memory area except the random token
-            if (res == ERR_OK)
-            {
-                if (filtered_num_floppy_images_files > 0)
-                {
-                    // Iterate over the RomInfo items and populate the names array
-                    char *dest_ptr = (char *)(memory_area + 4); // Bypass random token
-                    // Get the first element, if any
-                    FloppyImageInfo *floppy_images_file = floppy_images_files;
-                    for (int i = 0; i < filtered_num_floppy_images_files; i++)
-                    {
-                        // Copy the string from network_files[i].name to dest_ptr
-                        // Ensure the name is padded with spaces up to position 60
-                        char padded_name[61]; // 60 characters for padding + 1 for null terminator
-                        snprintf(padded_name, sizeof(padded_name), "%-52s", floppy_images_file->name);
-
-                        char padded_extra[16]; // 15 characters for padding + 1 for null terminator
-                        snprintf(padded_extra, sizeof(padded_extra), "%-15s", floppy_images_file->extra);
-
-                        char padded_filename[13]; // 12 characters for padding + 1 for null terminator
-                        // Get the filename from the URL
-                        char fname[256] = {0};
-                        extract_filename(floppy_images_file->url, fname);
-                        snprintf(padded_filename, sizeof(padded_filename), "%-13s", fname);
-
-                        // Display padded content
-                        sprintf(dest_ptr, "%s%s %s\0", padded_name, padded_extra, padded_filename);
-                        dest_ptr += strlen(dest_ptr) + 1;
-                        floppy_images_file = floppy_images_file->next;
-                    }
-
-                    // Swap the words to motorola endian format: BIG ENDIAN
-                    CHANGE_ENDIANESS_BLOCK16(memory_area + RANDOM_SEED_SIZE, CONFIGURATOR_SHARED_MEMORY_SIZE_BYTES - RANDOM_SEED_SIZE);
-                }
-                else
-                {
-                    DPRINTF("No floppy images found for letter %c\n", query_floppy_letter);
-                }
-                // Only set the random token if the operation was successful. Otherwise, force a retry
-                DPRINTF("Random token: %x\n", random_token);
-                *((volatile uint32_t *)(memory_area)) = random_token;
-            }
-            else
-            {
-                DPRINTF("Error getting floppy images from the Atari ST Database: %d\n", res);
-            }
+        if (strncmp(remote_uri, "http", 4) == 0)
+        { // Check if remote_uri starts with "http"
+            strcpy(full_url, remote_uri);
         }
+        else
+        {
+            // Use sprintf to format and concatenate strings
+            sprintf(full_url, "%s/%s", base_url, remote_uri);
+        }
+
+        DPRINTF("Full URL: %s\n", full_url);
+        DPRINTF("Remote name: %s\n", remote_name);
+        DPRINTF("Name in folder: %s\n", dest_filename);
+        DPRINTF("Directory: %s\n", dir);
 
-        if (floppy_header.template > 0)
+        if (directory_exists(dir))
         {
-            // Append to the floppy_header floppy_name the extension .st.rw
-            char *dest_ptr = floppy_header.floppy_name;
-            while (*dest_ptr != 0)
+            // Directory exists
+            DPRINTF("Directory exists: %s\n", dir);
+
+            // MSA images are converted to ST while downloading
+            size_t dest_filename_length = strlen(dest_filename);
+            bool is_msa = dest_filename_length > 4 &&
+                          (strcasecmp(&dest_filename[dest_filename_length - 4], ".MSA") == 0);
+            char st_filename[dest_filename_length + 1];
+            strcpy(st_filename, dest_filename);
+            if (is_msa)
             {
-                dest_ptr++;
+                strcpy(&st_filename[dest_filename_length - 4], ".ST");
+                dest_filename = st_filename;
             }
-            strcpy(dest_ptr, ".st.rw");
-            DPRINTF("Floppy file to create: %s\n", floppy_header.floppy_name);
-            char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
-            DPRINTF("Floppy folder: %s\n", dir);
-            FRESULT err = create_blank_ST_image(dir,
-                                                floppy_header.floppy_name,
-                                                floppy_header.num_tracks,
-                                                floppy_header.num_sectors,
-                                                floppy_header.num_sides,
-                                                floppy_header.volume_name,
-                                                floppy_header.overwrite);
-            if (err != FR_OK)
+
+            err_t err = download_floppy(&full_url[0], dir, dest_filename, true, is_msa);
+
+            if (err != ERR_OK)
             {
-                DPRINTF("Create blank ST image error: %d\n", err);
+                floppy_image_selected_status = 3; // Error: Failed downloading file
+                DPRINTF("Download floppy error: %d\n", err);
             }
             else
             {
-                DPRINTF("Created blank ST image OK\n");
+                // When downloading a floppy image, the floppy image B is cleared
+                // to avoid conflicts
+                put_string(PARAM_FLOPPY_IMAGE_A, dest_filename);
+                put_string(PARAM_FLOPPY_IMAGE_B, "");
+                // put_string(PARAM_BOOT_FEATURE, "FLOPPY_EMULATOR");
+                // write_all_entries();
             }
-            floppy_header.template = 0;
-            *((volatile uint32_t *)(memory_area)) = random_token;
         }
-
-        if (floppy_image_selected > 0)
+        else
         {
-            char *extract_filename(char *path)
-            {
-                char *last_slash = strrchr(path, '/'); // Find the last occurrence of '/'
+            floppy_image_selected_status = 2; // Error: Directory does not exist
+            DPRINTF("Directory does not exist: %s\n", dir);
+        }
 
-                // If '/' was found, return the string after it
-                if (last_slash && *(last_slash + 1))
-                {
-                    return last_slash + 1;
-                }
-                return path; // Return the original path if '/' wasn't found
-            }
-            DPRINTF("Floppy image selected to download: %d\n", floppy_image_selected);
-            FloppyImageInfo remote = *floppy_images_files;
-            for (int i = 0; i < floppy_image_selected - 1; i++)
-            {
-                remote = *(FloppyImageInfo *)remote.next;
-            }
-            char *remote_name = remote.name;
-            char *remote_uri = remote.url;
+        floppy_image_selected = -1;
+        *((volatile uint16_t *)(memory_area + 4)) = floppy_image_selected_status;
 
-            char full_url[512];
-            // Get the URL from the configuration
-            char *base_url = find_entry("FLOPPY_DB_URL")->value;
+        DPRINTF("Random token: %x\n", random_token);
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
 
-            char *dest_filename = extract_filename(remote.url);
-            char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+    if (floppy_file_selected > 0)
+    {
+        DPRINTF("Floppy file selected: %d in disk %c (%d)\n", floppy_file_selected, floppy_drive == 0 ? 'A' : 'B', floppy_drive);
 
-            if (strncmp(remote_uri, "http", 4) == 0)
-            { // Check if remote_uri starts with "http"
-                strcpy(full_url, remote_uri);
-            }
-            else
-            {
-                // Use sprintf to format and concatenate strings
-                sprintf(full_url, "%s/%s", base_url, remote_uri);
-            }
+        char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
+        char *filename = NULL;
+        if (floppy_drive >= 0)
+        {
+            filename = get_selected_filename(dir, DIRINDEX_FLOPPIES_FILENAME, floppy_file_selected);
+        }
 
-            DPRINTF("Full URL: %s\n", full_url);
-            DPRINTF("Remote name: %s\n", remote_name);
-            DPRINTF("Name in folder: %s\n", dest_filename);
-            DPRINTF("Directory: %s\n", dir);
+        if (floppy_drive < 0)
+        {
+            DPRINTF("Floppy drive not selected\n");
+        }
+        else if (filename == NULL)
+        {
+            DPRINTF("Floppy file not found\n");
+        }
+        else
+        {
 
-            if (directory_exists(dir))
-            {
-                // Directory exists
-                DPRINTF("Directory exists: %s\n", dir);
+            char *old_floppy = NULL;
+            size_t filename_length = strlen(filename);
+            bool is_msa = filename_length > 4 &&
+                          (strcasecmp(&filename[filename_length - 4], ".MSA") == 0);
 
-                err_t err = download_floppy(&full_url[0], dir, dest_filename, true);
+            DPRINTF("Floppy drive: %c\n", floppy_drive == 0 ? 'A' : 'B');
+            DPRINTF("Floppy folder: %s\n", dir);
+            DPRINTF("Floppy file: %s\n", filename);
+            DPRINTF("Floppy file length: %d\n", filename_length);
+            DPRINTF("Floppy file is MSA: %s\n", is_msa ? "true" : "false");
 
-                if (err != ERR_OK)
+            if (is_msa)
+            {
+                // Create a filename and change the extension to .ST
+                char *stFilename = malloc(filename_length + 1);
+                strcpy(stFilename, filename);
+                strcpy(&stFilename[filename_length - 4], ".ST");
+                DPRINTF("MSA to ST: %s -> %s\n", filename, stFilename);
+                dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
+                FRESULT err = MSA_to_ST(dir, filename, stFilename, true);
+                dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
+                if (err != FR_OK)
                 {
-                    floppy_image_selected_status = 3; // Error: Failed downloading file
-                    DPRINTF("Download floppy error: %d\n", err);
+                    DPRINTF("MSA to ST error: %d\n", err);
                 }
                 else
                 {
-                    // When downloading a floppy image, the floppy image B is cleared
-                    // to avoid conflicts
-                    put_string(PARAM_FLOPPY_IMAGE_A, dest_filename);
-                    put_string(PARAM_FLOPPY_IMAGE_B, "");
-                    // put_string(PARAM_BOOT_FEATURE, "FLOPPY_EMULATOR");
-                    // write_all_entries();
+                    old_floppy = stFilename;
                 }
             }
             else
             {
-                floppy_image_selected_status = 2; // Error: Directory does not exist
-                DPRINTF("Directory does not exist: %s\n", dir);
+                old_floppy = filename;
             }
 
-            floppy_image_selected = -1;
-            *((volatile uint16_t *)(memory_area + 4)) = floppy_image_selected_status;
-
-            DPRINTF("Random token: %x\n", random_token);
-            *((volatile uint32_t *)(memory_area)) = random_token;
-        }
-
-        if (floppy_file_selected > 0)
-        {
-            DPRINTF("Floppy file selected: %d in disk %c (%d)\n", floppy_file_selected, floppy_drive == 0 ? 'A' : 'B', floppy_drive);
-
-            if (floppy_drive < 0)
-            {
-                DPRINTF("Floppy drive not selected\n");
-            }
-            else
+            if (old_floppy != NULL)
             {
-
-                char *old_floppy = NULL;
-                char *filename = NULL;
-                char *dir = find_entry(PARAM_FLOPPIES_FOLDER)->value;
-                filename = filtered_local_list[floppy_file_selected - 1];
-
-                size_t filename_length = strlen(filename);
-                bool is_msa = filename_length > 4 &&
-                              (strcasecmp(&filename[filename_length - 4], ".MSA") == 0);
-
-                DPRINTF("Floppy drive: %c\n", floppy_drive == 0 ? 'A' : 'B');
-                DPRINTF("Floppy folder: %s\n", dir);
-                DPRINTF("Floppy file: %s\n", filename);
-                DPRINTF("Floppy file length: %d\n", filename_length);
-                DPRINTF("Floppy file is MSA: %s\n", is_msa ? "true" : "false");
-
-                if (is_msa)
+                DPRINTF("Load file: %s\n", old_floppy);
+                char *new_floppy = NULL;
+                // Check if old_floppy ends with ".rw"
+                bool use_existing_rw = (strlen(old_floppy) > 3 && strcmp(&old_floppy[strlen(old_floppy) - 3], ".rw") == 0);
+                if (floppy_read_write && !use_existing_rw)
                 {
-                    // Create a filename and change the extension to .ST
-                    char *stFilename = malloc(filename_length + 1);
-                    strcpy(stFilename, filename);
-                    strcpy(&stFilename[filename_length - 4], ".ST");
-                    DPRINTF("MSA to ST: %s -> %s\n", filename, stFilename);
+                    new_floppy = malloc(strlen(old_floppy) + strlen(".rw") + 1); // Allocate space for the old string, the new suffix, and the null terminator
+                    sprintf(new_floppy, "%s.rw", old_floppy);                    // Create the new string with the .rw suffix
                     dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-                    FRESULT err = MSA_to_ST(dir, filename, stFilename, true);
+                    FRESULT result = copy_file(dir, old_floppy, new_floppy, false); // Do not overwrite if exists
                     dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-                    if (err != FR_OK)
-                    {
-                        DPRINTF("MSA to ST error: %d\n", err);
-                    }
-                    else
-                    {
-                        old_floppy = stFilename;
-                    }
                 }
                 else
                 {
-                    old_floppy = filename;
+                    new_floppy = strdup(old_floppy);
                 }
+                DPRINTF("Floppy Read/Write: %s\n", floppy_read_write ? "true" : "false");
 
-                if (old_floppy != NULL)
+                if (floppy_drive == 0)
+                {
+                    put_string(PARAM_FLOPPY_IMAGE_A, new_floppy);
+                }
+                else
                 {
-                    DPRINTF("Load file: %s\n", old_floppy);
-                    char *new_floppy = NULL;
-                    // Check if old_floppy ends with ".rw"
-                    bool use_existing_rw = (strlen(old_floppy) > 3 && strcmp(&old_floppy[strlen(old_floppy) - 3], ".rw") == 0);
-                    if (floppy_read_write && !use_existing_rw)
-                    {
-                        new_floppy = malloc(strlen(old_floppy) + strlen(".rw") + 1); // Allocate space for the old string, the new suffix, and the null terminator
-                        sprintf(new_floppy, "%s.rw", old_floppy);                    // Create the new string with the .rw suffix
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, false);
-                        FRESULT result = copy_file(dir, old_floppy, new_floppy, false); // Do not overwrite if exists
-                        dma_channel_set_irq1_enabled(lookup_data_rom_dma_channel, true);
-                    }
-                    else
-                    {
-                        new_floppy = strdup(old_floppy);
-                    }
-                    DPRINTF("Floppy Read/Write: %s\n", floppy_read_write ? "true" : "false");
-
-                    if (floppy_drive == 0)
-                    {
-                        put_string(PARAM_FLOPPY_IMAGE_A, new_floppy);
-                    }
-                    else
-                    {
-                        put_string(PARAM_FLOPPY_IMAGE_B, new_floppy);
-                    }
-                    put_string(PARAM_BOOT_FEATURE, "FLOPPY_EMULATOR");
-                    write_all_entries();
-
-                    free(new_floppy);
-                    fflush(stdout);
+                    put_string(PARAM_FLOPPY_IMAGE_B, new_floppy);
                 }
+                put_string(PARAM_BOOT_FEATURE, "FLOPPY_EMULATOR");
+                write_all_entries();
+
+                free(new_floppy);
+                fflush(stdout);
             }
-            floppy_file_selected = -1;
-            *((volatile uint32_t *)(memory_area)) = random_token;
         }
+        floppy_file_selected = -1;
+        *((volatile uint32_t *)(memory_area)) = random_token;
+    }
+
+    // Store the seed of the random number generator in the ROM memory space
+    *((volatile uint32_t *)(memory_area - RANDOM_SEED_SIZE)) = rand() % 0xFFFFFFFF;
+    return true;
+}
+
+int init_firmware()
+{
+    // Hybrid way to initialize the ROM emulator:
+    // IRQ handler callback to read the commands in ROM3, and NOT copy the FLASH ROMs to RAM
+    // and start the state machine
+    init_romemul(NULL, dma_irq_handler_lookup_callback, false);
+    bootprof_mark("romemul");
 
-        // Store the seed of the random number generator in the ROM memory space
-        *((volatile uint32_t *)(memory_area - RANDOM_SEED_SIZE)) = rand() % 0xFFFFFFFF;
+    // Copy the firmware to RAM
+    COPY_FIRMWARE_TO_RAM((uint16_t *)firmwareROM, firmwareROM_length);
+    bootprof_mark("firmware");
+
+    romloader_setup();
+    while (romloader_poll())
+    {
     }
 
     if (rom_file_selected > 0)
@@ -1248,7 +1354,8 @@ int init_firmware()
         uint32_t ints = save_and_disable_interrupts();
         flash_range_erase(FLASH_ROM_LOAD_OFFSET, ROM_SIZE_BYTES * 2); // Two banks of 64K
         restore_interrupts(ints);
-        int res = load_rom_from_fs(find_entry(PARAM_ROMS_FOLDER)->value, filtered_local_list[rom_file_selected - 1], FLASH_ROM_LOAD_OFFSET);
+        char *rom_filename = get_selected_filename(find_entry(PARAM_ROMS_FOLDER)->value, DIRINDEX_ROMS_FILENAME, rom_file_selected);
+        int res = rom_filename != NULL ? load_rom_from_fs(find_entry(PARAM_ROMS_FOLDER)->value, rom_filename, FLASH_ROM_LOAD_OFFSET) : FR_NO_FILE;
 
         if (res != FR_OK)
             DPRINTF("f_open error: %s (%d)\n", FRESULT_str(res), res);
@@ -27,6 +27,7 @@ static NTP_TIME net_time;
 static long utc_offset_seconds = 0;
 static char *ntp_server_host = NULL;
 static int ntp_server_port = NTP_DEFAULT_PORT;
+static NtpDiscipline ntp_discipline = {0};
 
 // Dallas RTC variables
 static DallasClock dallasClock = {0};
@@ -116,8 +117,63 @@ void host_found_callback(const char *name, const ip_addr_t *ipaddr, void *arg)
     }
 }
 
+// Local time of a 64 bit NTP timestamp of the message, in microseconds since 1970
+static int64_t ntp_timestamp_us(struct pbuf *p, u16_t offset)
+{
+    uint32_t timestamp[2];
+    pbuf_copy_partial(p, timestamp, sizeof(timestamp), offset);
+    int64_t seconds = (int64_t)lwip_ntohl(timestamp[0]) - NTP_DELTA + utc_offset_seconds;
+    uint32_t fraction = lwip_ntohl(timestamp[1]);
+    return seconds * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+}
+
+// Set the RP2040 RTC and the rtc_time structure to a time in seconds since 1970
+static bool set_rtc_seconds(int64_t seconds)
+{
+    time_t utc_sec = (time_t)seconds;
+    struct tm *utc = gmtime(&utc_sec);
+    if (utc == NULL)
+    {
+        DPRINTF("Error converting NTP time to struct tm\n");
+        return false;
+    }
+
+    // Fill the rtc_time structure
+    rtc_time.year = utc->tm_year + 1900;
+    rtc_time.month = utc->tm_mon + 1;
+    rtc_time.day = utc->tm_mday;
+    rtc_time.hour = utc->tm_hour;
+    rtc_time.min = utc->tm_min;
+    rtc_time.sec = utc->tm_sec;
+    rtc_time.dotw = utc->tm_wday; // Day of the week, Sunday is day 0
+
+    // Set the RTC with the received time
+    if (!rtc_set_datetime(&rtc_time))
+    {
+        DPRINTF("Cannot set internal RTC!\n");
+        return false;
+    }
+    DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
+            rtc_time.day, rtc_time.month, rtc_time.year, rtc_time.hour, rtc_time.min, rtc_time.sec);
+    return true;
+}
+
+// Apply a sample. t1 and t4 are the time_us_64() of the request and the response,
+// t2 and t3 the receive and transmit timestamps of the server
+static void ntp_process_sample(uint64_t t1_us, uint64_t t4_us, int64_t t2_us, int64_t t3_us)
+{
+    if (ntp_discipline_sample(&ntp_discipline, t1_us, t4_us, t2_us, t3_us) == NTP_SAMPLE_STEPPED)
+    {
+        set_rtc_seconds(ntp_discipline.base_time_us / 1000000);
+        // The RTC was set in the middle of a second. Align it on the next boundary
+        ntp_discipline.rtc_set_pending = true;
+    }
+}
+
 static void ntp_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
+    uint64_t received_us = time_us_64();
+
     // Logging the entry into the callback
     DPRINTF("ntp_recv_callback\n");
 
@@ -152,40 +208,23 @@ static void ntp_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, co
         return;
     }
 
-    // Extract the Transmit Timestamp (field starting at byte 40)
-    uint32_t transmit_timestamp_secs;
-    pbuf_copy_partial(p, &transmit_timestamp_secs, sizeof(transmit_timestamp_secs), 40);
-    transmit_timestamp_secs = lwip_ntohl(transmit_timestamp_secs) - NTP_DELTA + utc_offset_seconds;
-
-    // Convert NTP time to a `struct tm`
-    time_t utc_sec = transmit_timestamp_secs;
-    struct tm *utc = gmtime(&utc_sec);
-    if (utc == NULL)
+    // The server copies the transmit timestamp of the request to the originate timestamp.
+    // It must be the one of the pending request, otherwise the response is late or duplicated
+    uint64_t originate;
+    pbuf_copy_partial(p, &originate, sizeof(originate), 24);
+    if ((ntp_discipline.request_us == 0) || (originate != ntp_discipline.request_us))
     {
-        DPRINTF("Error converting NTP time to struct tm\n");
+        DPRINTF("NTP response does not match the pending request\n");
         pbuf_free(p);
         return;
     }
 
-    // Fill the rtc_time structure
-    rtc_time.year = utc->tm_year + 1900;
-    rtc_time.month = utc->tm_mon + 1;
-    rtc_time.day = utc->tm_mday;
-    rtc_time.hour = utc->tm_hour;
-    rtc_time.min = utc->tm_min;
-    rtc_time.sec = utc->tm_sec;
-    rtc_time.dotw = utc->tm_wday; // Day of the week, Sunday is day 0
-
-    // Set the RTC with the received time
-    if (!rtc_set_datetime(&rtc_time))
-    {
-        DPRINTF("Cannot set internal RTC!\n");
-    }
-    else
-    {
-        DPRINTF("RP2040 RTC set to: %02d/%02d/%04d %02d:%02d:%02d UTC+0\n",
-                rtc_time.day, rtc_time.month, rtc_time.year, rtc_time.hour, rtc_time.min, rtc_time.sec);
-    }
+    // Extract the Receive (byte 32) and Transmit (byte 40) Timestamps
+    int64_t receive_us = ntp_timestamp_us(p, 32);
+    int64_t transmit_us = ntp_timestamp_us(p, 40);
+    ntp_process_sample(ntp_discipline.request_us, received_us, receive_us, transmit_us);
+    ntp_discipline.request_us = 0;
+    ntp_discipline.next_poll_us = received_us + (uint64_t)ntp_discipline.poll_interval_sec * 1000000;
 
     // Free the packet buffer
     pbuf_free(p);
@@ -204,6 +243,8 @@ void ntp_init()
     // Set up the callback function that will be called when an NTP response is received.
     udp_recv(net_time.ntp_pcb, ntp_recv_callback, &net_time);
 
+    ntp_discipline_init(&ntp_discipline);
+
     // Initialization success, set flag.
     net_time.ntp_server_found = false;
     net_time.ntp_error = false;
@@ -228,6 +269,9 @@ void set_internal_rtc()
     uint8_t *req = (uint8_t *)pb->payload;
     memset(req, 0, NTP_MSG_LEN);
     req[0] = 0x1b; // NTP request header for a client request
+    // The transmit timestamp is only used to match the response. The server copies it to the originate timestamp
+    ntp_discipline.request_us = time_us_64();
+    memcpy(&req[40], &ntp_discipline.request_us, sizeof(ntp_discipline.request_us));
 
     // Send the NTP request.
     err_t err = udp_sendto(net_time.ntp_pcb, pb, &net_time.ntp_ipaddr, ntp_server_port);
@@ -248,6 +292,69 @@ void set_internal_rtc()
     DPRINTF("NTP request sent successfully.\n");
 }
 
+/**
+ * @brief Keeps the internal RTC disciplined by NTP once it was set.
+ *
+ * Sends a new NTP request when the poll interval expires, and aligns the RP2040 RTC with
+ * the disciplined clock on the second boundaries. Never blocks: the responses are processed
+ * by the UDP callback, so the network must be polled by the caller.
+ *
+ * @return true if the RTC was changed, so the copies of the time must be updated.
+ */
+bool ntp_discipline_poll()
+{
+    NtpDiscipline *d = &ntp_discipline;
+    if (!d->synchronized || (net_time.ntp_pcb == NULL))
+    {
+        return false;
+    }
+    uint64_t now_us = time_us_64();
+    if ((d->request_us != 0) && (now_us - d->request_us > (uint64_t)NTP_RESPONSE_TIMEOUT_MS * 1000))
+    {
+        DPRINTF("NTP request timed out\n");
+        d->request_us = 0;
+        d->next_poll_us = now_us + (uint64_t)NTP_MIN_POLL_SEC * 1000000;
+    }
+    if ((d->request_us == 0) && (now_us >= d->next_poll_us))
+    {
+        set_internal_rtc();
+    }
+
+    // Compare the RTC with the clock in the middle of the second, and set it on the boundary
+    bool changed = false;
+    int64_t clock_us = ntp_discipline_clock_us(d, now_us);
+    int64_t second = clock_us / 1000000;
+    if (second != d->current_second)
+    {
+        d->current_second = second;
+        d->rtc_checked = false;
+        if (d->rtc_set_pending)
+        {
+            d->rtc_set_pending = false;
+            changed = set_rtc_seconds(second);
+        }
+    }
+    else if (!d->rtc_checked && (clock_us % 1000000 >= 500000))
+    {
+        d->rtc_checked = true;
+        datetime_t rtc_now;
+        struct tm utc;
+        time_t utc_sec = (time_t)second;
+        if ((gmtime_r(&utc_sec, &utc) != NULL) && rtc_get_datetime(&rtc_now) &&
+            ((rtc_now.sec != utc.tm_sec) || (rtc_now.min != utc.tm_min) || (rtc_now.hour != utc.tm_hour) || (rtc_now.day != utc.tm_mday)))
+        {
+            DPRINTF("RP2040 RTC drifted from the NTP clock\n");
+            d->rtc_set_pending = true;
+        }
+    }
+    return changed;
+}
+
+const NtpDiscipline *get_ntp_discipline()
+{
+    return &ntp_discipline;
+}
+
 static void __not_in_flash_func(handle_protocol_command)(const TransmissionProtocol *protocol)
 {
     ConfigEntry *entry = NULL;
@@ -306,47 +413,14 @@ inline uint8_t add_bcd(uint8_t bcd1, uint8_t bcd2)
     return (high_nibble & 0xF0) | (low_nibble & 0x0F);
 }
 
-// WARNING: CHANGE THIS OFFSET WITH CAUTION
-// The offset_sync is the time the RP2040 takes to read and process the time and date from the internal RTC
-// and put it in the clock_sequence_dallas_rtc array. This offset is calculated by trial and error.
-// So if you change the code, you have to recalculate this offset.
-static uint8_t offset_sync = 3;
-
-// Function to populate the magic_sequence_dallas_rtc
-static void populate_magic_sequence(uint8_t *sequence, uint64_t hex_value)
-{
-    // Loop through each bit of the 64-bit hex value. Leave the first two bits untouched
-    for (int i = 2; i < 66; i++)
-    {
-        // Check if the bit is 0 or 1 by shifting hex_value right i positions
-        // and checking the least significant bit
-        if ((hex_value >> (i - 2)) & 1)
-        {
-            sequence[i] = dallasClock.write_address_bit_one; // If the bit is 1
-        }
-        else
-        {
-            sequence[i] = dallasClock.write_address_bit_zero; // If the bit is 0
-        }
-    }
-}
-
-// Function to populate the clock_sequence_dallas_rtc
-static void populate_clock_sequence(uint8_t *sequence, uint8_t bcd_value)
+// Prepare the clock sequence of the current second in the buffer the IRQ is not serving, and swap
+// the buffers. Called from the main loop so the IRQ only has to copy the bits to the ROM
+static void prepare_dallas_clock_sequence()
 {
-    // Loop through each bit of the 8 bit BDC value
-    for (int i = 0; i < 8; i++)
+    datetime_t now;
+    if (rtc_get_datetime(&now))
     {
-        // Check if the bit is 0 or 1 by shifting bcd_value right i positions
-        // and checking the least significant bit
-        if ((bcd_value >> i) & 1)
-        {
-            sequence[i] = 0xFF; // If the bit is 1
-        }
-        else
-        {
-            sequence[i] = 0x0; // If the bit is 0
-        }
+        dallas_prepare(&dallasClock, &now);
     }
 }
 
@@ -358,6 +432,7 @@ void __not_in_flash_func(rtcemul_dma_irq_handler_lookup_callback)(void)
 
     // Read the address to process
     uint32_t addr = (uint32_t)dma_hw->ch[lookup_data_rom_dma_channel].al3_read_addr_trig;
+    busstats_access(addr);
     switch (rtc_type)
     {
     case RTC_SIDECART:
@@ -369,80 +444,32 @@ void __not_in_flash_func(rtcemul_dma_irq_handler_lookup_callback)(void)
     case RTC_DALLAS:
         if (addr >= dallasClock.rom_address)
         {
-            // Reset counter
-            uint64_t new_header_found = time_us_64();
-            if (new_header_found - dallasClock.last_magic_found > PROTOCOL_READ_RESTART_MICROSECONDS)
+            uint8_t clock_bit;
+            if (dallas_access(&dallasClock, (uint8_t)addr, time_us_64(), &clock_bit))
             {
-                dallasClock.last_magic_found = new_header_found;
-                dallasClock.retries = 0;
-            }
-
-            uint8_t addr_lsb = addr; // Only the LSB is needed
-            // Check the magic sequence of the Dallas RTC
-            if ((dallasClock.magic_sequence[dallasClock.retries] == addr_lsb) && (dallasClock.retries < dallasClock.size_magic_sequence))
-            {
-                dallasClock.retries++;
-                if (dallasClock.retries == dallasClock.size_magic_sequence)
-                {
-                    // We have the magic sequence, now we have to put the time and date of the internal RTC mimicking the Dallas RTC clock
-                    // 32 bit the date and 32 bit the time
-
-                    bool ready = rtc_get_datetime(&rtc_time);
-                    if (ready)
-                    {
-                        uint8_t cent_seconds = 0;
-                        uint8_t seconds = to_bcd(rtc_time.sec);
-                        uint8_t minutes = to_bcd(rtc_time.min);
-                        uint8_t hours = to_bcd(rtc_time.hour);
-                        uint8_t dotw = to_bcd(rtc_time.dotw);
-                        uint8_t day = to_bcd(rtc_time.day);
-                        uint8_t month = to_bcd(rtc_time.month);
-                        uint8_t year = to_bcd(rtc_time.year % 100);
-
-                        // Set the values in the clock_sequence_dallas_rtc
-                        // populate_clock_sequence(&dallasClock.clock_sequence[0], cent_seconds);
-                        populate_clock_sequence(&dallasClock.clock_sequence[8 - offset_sync], seconds);
-                        populate_clock_sequence(&dallasClock.clock_sequence[16 - offset_sync], minutes);
-                        populate_clock_sequence(&dallasClock.clock_sequence[24 - offset_sync], hours);
-                        populate_clock_sequence(&dallasClock.clock_sequence[32 - offset_sync], dotw);
-                        populate_clock_sequence(&dallasClock.clock_sequence[40 - offset_sync], day);
-                        populate_clock_sequence(&dallasClock.clock_sequence[48 - offset_sync], month);
-                        populate_clock_sequence(&dallasClock.clock_sequence[56 - offset_sync], year);
-
-                        dallasClock.retries = 0;
-                    }
-                    else
-                    {
-                        DPRINTF("Cannot get internal RTC!\n");
-                    }
-                }
-            }
-            else
-            {
-                // Now we have to put the time and date of the internal RTC mimicking the Dallas RTC clock
-                if (dallasClock.retries <= (dallasClock.size_magic_sequence + dallasClock.size_clock_sequence))
-                {
-                    uint32_t clock_read_address = dallasClock.rom_address + dallasClock.read_address_bit;
-                    (*((volatile uint8_t *)(clock_read_address))) = dallasClock.clock_sequence[dallasClock.retries - dallasClock.size_magic_sequence];
-                    // 32 bit the date and 32 bit the time
-                    dallasClock.retries++;
-                }
+                (*((volatile uint8_t *)(dallasClock.rom_address + dallasClock.read_address_bit))) = clock_bit;
             }
         }
         break;
     default:
         break;
     }
+    busstats_irq_exit(lookup_data_rom_dma_channel);
 }
 
-int init_rtcemul(bool safe_config_reboot)
+// The state of the loop of the emulator. Prepared by rtcemul_setup() and used by rtcemul_poll()
+static bool write_config_only_once = true;
+static bool select_safe_config_reboot = false;
+static FATFS fs; // Mounted while the emulator runs
+
+void rtcemul_setup(bool safe_config_reboot)
 {
     uint32_t memory_shared_address = ROM3_START_ADDRESS;
     uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + RTCEMUL_DATETIME);
-    bool write_config_only_once = true;
+    write_config_only_once = true;
+    select_safe_config_reboot = safe_config_reboot;
 
     FRESULT fr;
-    FATFS fs;
 
     srand(time(0));
     char *rtc_type_str = find_entry(PARAM_RTC_TYPE)->value;
@@ -452,19 +479,8 @@ int init_rtcemul(bool safe_config_reboot)
         DPRINTF("RTC type: DALLAS\n");
 
         rtc_type = RTC_DALLAS;
-        // Initialize the Dallas RTC clock structure
-        dallasClock.last_magic_found = 0;
-        dallasClock.retries = 0;
-        dallasClock.magic_sequence_hex = 0x5ca33ac55ca33ac5;
-        dallasClock.read_address_bit = 0x9;
-        dallasClock.write_address_bit_zero = 0x1;
-        dallasClock.write_address_bit_one = 0x3;
-        dallasClock.size_magic_sequence = sizeof(dallasClock.magic_sequence);
-        dallasClock.size_clock_sequence = sizeof(dallasClock.clock_sequence);
-        dallasClock.rom_address = ROM3_START_ADDRESS;
-
-        // Populate the magic_sequence_dallas_rtc array
-        populate_magic_sequence(dallasClock.magic_sequence, dallasClock.magic_sequence_hex);
+        // Initialize the Dallas RTC clock structure and its magic sequence
+        dallas_init(&dallasClock, ROM3_START_ADDRESS);
     }
     else if (strcmp(rtc_type_str, "SIDECART") == 0)
     {
@@ -512,58 +528,26 @@ int init_rtcemul(bool safe_config_reboot)
 
     uint32_t rtc_timeout_sec = 45;
     // Only try to get the datetime from the network if the wifi is configured
-    if (strlen(find_entry(PARAM_WIFI_SSID)->value) > 0)
+    if (configSnapshot.wifi_configured)
     {
         cyw43_arch_deinit();
 
-        network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-        absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(reconnect_t, 0);
         absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(second_t, 0);
-        uint32_t time_to_connect_again = 1000; // 1 second
         bool network_ready = false;
-        bool wifi_init = true;
         uint32_t wifi_timeout_sec = rtc_timeout_sec;
+        wifi_manager_start(&wifi_password_file_content, wifi_timeout_sec * 1000, NULL, NULL);
 
-        // Wait until timeout
-        while ((!network_ready) && (wifi_timeout_sec > 0) && (strlen(find_entry(PARAM_WIFI_SSID)->value) > 0))
+        // Wait until connected or timeout
+        while ((!network_ready) && (wifi_timeout_sec > 0))
         {
             *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
-#if PICO_CYW43_ARCH_POLL
-            if (wifi_init)
-            {
-                cyw43_arch_poll();
-            }
-#endif
-            // Only display when changes status to avoid flooding the console
-            ConnectionStatus previous_status = get_previous_connection_status();
-            ConnectionStatus current_status = get_network_connection_status();
-            if (current_status != previous_status)
+            WifiManagerState wifi_state = wifi_manager_poll();
+            if (wifi_state == WIFI_MANAGER_TIMEOUT)
             {
-#if defined(_DEBUG) && (_DEBUG != 0)
-                ConnectionData connection_data = {0};
-                get_connection_data(&connection_data);
-                DPRINTF("Status: %d - Prev: %d - SSID: %s - IPv4: %s - GW:%s - Mask:%s - MAC:%s\n",
-                        current_status,
-                        previous_status,
-                        connection_data.ssid,
-                        connection_data.ipv4_address,
-                        print_ipv4(get_gateway()),
-                        print_ipv4(get_netmask()),
-                        print_mac(get_mac_address()));
-#endif
-                if ((current_status == GENERIC_ERROR) || (current_status == CONNECT_FAILED_ERROR) || (current_status == BADAUTH_ERROR))
-                {
-                    if (wifi_init)
-                    {
-                        cyw43_arch_deinit();
-                        reconnect_t = make_timeout_time_ms(0);
-                        time_to_connect_again = time_to_connect_again * 1.2;
-                        wifi_init = false;
-                        DPRINTF("Connection failed. Retrying in %d ms...\n", time_to_connect_again);
-                    }
-                }
+                wifi_timeout_sec = 0;
+                break;
             }
-            network_ready = (current_status == CONNECTED_WIFI_IP);
+            network_ready = (wifi_state == WIFI_MANAGER_CONNECTED);
             if (time_passed(&second_t, 1000) == 1)
             {
                 DPRINTF("Timeout in seconds: %d\n", wifi_timeout_sec);
@@ -578,20 +562,13 @@ int init_rtcemul(bool safe_config_reboot)
                 // Write config only once to avoid hitting the flash too much
                 write_config_only_once = false;
             }
-
-            if ((!wifi_init) && (time_passed(&reconnect_t, time_to_connect_again) == 1))
-            {
-                network_init(true, NETWORK_CONNECTION_ASYNC, &wifi_password_file_content);
-                reconnect_t = make_timeout_time_ms(0);
-                wifi_init = true;
-            }
             *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)) = 0x0;
             *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
         }
-        if (wifi_timeout_sec <= 0)
+        if (!network_ready)
         {
             // Just be sure to deinit the network stack
-            cyw43_arch_deinit();
+            wifi_manager_stop();
             DPRINTF("No wifi configured. Skipping network initialization.\n");
         }
         else
@@ -601,7 +578,7 @@ int init_rtcemul(bool safe_config_reboot)
             rtc_init();
 
             ntp_server_host = find_entry(PARAM_RTC_NTP_SERVER_HOST)->value;
-            ntp_server_port = atoi(find_entry(PARAM_RTC_NTP_SERVER_PORT)->value);
+            ntp_server_port = configSnapshot.rtc_ntp_server_port;
 
             DPRINTF("NTP server host: %s\n", ntp_server_host);
             DPRINTF("NTP server port: %d\n", ntp_server_port);
@@ -623,10 +600,11 @@ int init_rtcemul(bool safe_config_reboot)
             // Wait until the RTC is set by the NTP server
             while ((rtc_timeout_sec > 0) && (get_rtc_time()->year == 0))
             {
-
-#if PICO_CYW43_ARCH_POLL
-                network_safe_poll();
-#endif
+                wifi_manager_poll();
+                if (rtc_type == RTC_DALLAS)
+                {
+                    prepare_dallas_clock_sequence();
+                }
                 if ((get_net_time()->ntp_server_found) && dns_query_done)
                 {
                     DPRINTF("NTP server found. Connecting to NTP server...\n");
@@ -691,7 +669,7 @@ int init_rtcemul(bool safe_config_reboot)
             else
             {
                 DPRINTF("Timeout reached. RTC not set.\n");
-                cyw43_arch_deinit();
+                wifi_manager_stop();
                 DPRINTF("No wifi configured. Skipping network initialization.\n");
             }
         }
@@ -703,65 +681,85 @@ int init_rtcemul(bool safe_config_reboot)
         DPRINTF("No wifi configured. Skipping network initialization.\n");
     }
 
-    bool rtc_error = false;
     DPRINTF("Waiting for commands...\n");
-    while (!rtc_error)
+}
+
+void rtcemul_poll(void)
+{
+    uint32_t memory_shared_address = ROM3_START_ADDRESS;
+    *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
+    tight_loop_contents();
+    if (rtc_type == RTC_DALLAS)
     {
-        *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN_SEED)) = rand() % 0xFFFFFFFF;
-        tight_loop_contents();
-        if (save_vectors)
-        {
-            save_vectors = false;
-            // Save the vectors needed for the RTC emulation
-            DPRINTF("Saving vectors\n");
-            *((volatile uint16_t *)(memory_shared_address + RTCEMUL_OLD_XBIOS_TRAP)) = XBIOS_trap_payload & 0xFFFF;
-            *((volatile uint16_t *)(memory_shared_address + RTCEMUL_OLD_XBIOS_TRAP + 2)) = XBIOS_trap_payload >> 16;
-            // DPRINTF("random token: %x\n", random_token);
-            *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
-        }
+        prepare_dallas_clock_sequence();
+    }
+    busstats_poll(NULL);
+    capture_poll(APP_RTCEMUL);
+    if (rtc_time.year != 0)
+    {
+        // Keep the link up and the RTC disciplined by NTP
+        wifi_manager_poll();
+        ntp_discipline_poll();
+    }
+    if (save_vectors)
+    {
+        save_vectors = false;
+        // Save the vectors needed for the RTC emulation
+        DPRINTF("Saving vectors\n");
+        *((volatile uint16_t *)(memory_shared_address + RTCEMUL_OLD_XBIOS_TRAP)) = XBIOS_trap_payload & 0xFFFF;
+        *((volatile uint16_t *)(memory_shared_address + RTCEMUL_OLD_XBIOS_TRAP + 2)) = XBIOS_trap_payload >> 16;
+        // DPRINTF("random token: %x\n", random_token);
+        *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
+    }
 
-        if (test_ntp_received)
+    if (test_ntp_received)
+    {
+        test_ntp_received = false;
+        if (rtc_time.year != 0)
         {
-            test_ntp_received = false;
-            if (rtc_time.year != 0)
-            {
-                *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)) = 0xFFFF;
-            }
-            else
-            {
-                *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)) = 0x0;
-            }
-            DPRINTF("NTP test received. Answering with: %d\n", *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)));
-            *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
+            *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)) = 0xFFFF;
         }
-
-        if (read_time_received)
+        else
         {
-            read_time_received = false;
-
-            rtc_get_datetime(&rtc_time);
-            uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + RTCEMUL_DATETIME);
-            // Change order for the endianess
-            rtc_time_ptr[1] = 0x1b;
-            rtc_time_ptr[0] = add_bcd(to_bcd((rtc_time.year % 100)), to_bcd((2000 - 1980) + (80 - 30)));
-            rtc_time_ptr[3] = to_bcd(rtc_time.month);
-            rtc_time_ptr[2] = to_bcd(rtc_time.day);
-            rtc_time_ptr[5] = to_bcd(rtc_time.hour);
-            rtc_time_ptr[4] = to_bcd(rtc_time.min);
-            rtc_time_ptr[7] = to_bcd(rtc_time.sec);
-            rtc_time_ptr[6] = 0x0;
-
-            *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
+            *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)) = 0x0;
         }
+        DPRINTF("NTP test received. Answering with: %d\n", *((volatile uint16_t *)(memory_shared_address + RTCEMUL_NTP_SUCCESS)));
+        *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
+    }
 
-        // If SELECT button is pressed, launch the configurator
-        if (gpio_get(SELECT_GPIO) != 0)
-        {
-            select_button_action(safe_config_reboot, write_config_only_once);
-            // Write config only once to avoid hitting the flash too much
-            write_config_only_once = false;
-        }
+    if (read_time_received)
+    {
+        read_time_received = false;
+
+        rtc_get_datetime(&rtc_time);
+        uint8_t *rtc_time_ptr = (uint8_t *)(memory_shared_address + RTCEMUL_DATETIME);
+        // Change order for the endianess
+        rtc_time_ptr[1] = 0x1b;
+        rtc_time_ptr[0] = add_bcd(to_bcd((rtc_time.year % 100)), to_bcd((2000 - 1980) + (80 - 30)));
+        rtc_time_ptr[3] = to_bcd(rtc_time.month);
+        rtc_time_ptr[2] = to_bcd(rtc_time.day);
+        rtc_time_ptr[5] = to_bcd(rtc_time.hour);
+        rtc_time_ptr[4] = to_bcd(rtc_time.min);
+        rtc_time_ptr[7] = to_bcd(rtc_time.sec);
+        rtc_time_ptr[6] = 0x0;
+
+        *((volatile uint32_t *)(memory_shared_address + RTCEMUL_RANDOM_TOKEN)) = random_token;
+    }
+
+    // If SELECT button is pressed, launch the configurator
+    if (gpio_get(SELECT_GPIO) != 0)
+    {
+        select_button_action(select_safe_config_reboot, write_config_only_once);
+        // Write config only once to avoid hitting the flash too much
+        write_config_only_once = false;
     }
+}
 
-    blink_error();
+int init_rtcemul(bool safe_config_reboot)
+{
+    rtcemul_setup(safe_config_reboot);
+    while (true)
+    {
+        rtcemul_poll();
+    }
 }
@@ -0,0 +1,182 @@
+/**
+ * File: capture_replay.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Replays a ROM3 capture copied from the SD card. Without a card, only through the
+ * parse_protocol of the firmware, and prints the commands it delivers. With a copy of the SD card
+ * (an image file or a folder), through the command handlers of the emulator that made the capture,
+ * and prints the time the emulator took for each command.
+ *   capture_replay [-w payload words to print] [-c sdcard] [-p KEY=VALUE]... rom3cap.bin
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "hostdisk.h"
+#include "hostemul.h"
+#include "replay.h"
+
+#define MAX_COMMAND_IDS 64 // Different command IDs in the summary of the times
+
+static int payload_words = 8;
+static uint64_t start_us = 0;
+static uint64_t previous_us = 0;
+
+// The time of the emulator for each command ID
+typedef struct
+{
+    uint16_t command_id;
+    uint32_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} CommandTimes;
+
+static CommandTimes times[MAX_COMMAND_IDS];
+static int times_count = 0;
+
+static void print_command(const TransmissionProtocol *protocol)
+{
+    printf("%12.3f ms  +%8llu us  0x%04X  size %5u ",
+           (host_time_us - start_us) / 1000.0,
+           (unsigned long long)(host_time_us - previous_us),
+           protocol->command_id,
+           protocol->payload_size);
+    for (int i = 0; (i < payload_words) && (i * 2 < protocol->payload_size); i++)
+    {
+        printf(" %04X", ((const uint16_t *)protocol->payload)[i]);
+    }
+    printf("\n");
+    previous_us = host_time_us;
+}
+
+static void print_served(const ReplayCommand *command)
+{
+    printf("%12.3f ms  0x%04X  size %5u  %10.1f us in the emulator\n",
+           (command->time_us - start_us) / 1000.0,
+           command->command_id,
+           command->payload_size,
+           command->handler_ns / 1000.0);
+    int i = 0;
+    while ((i < times_count) && (times[i].command_id != command->command_id))
+    {
+        i++;
+    }
+    if (i == times_count)
+    {
+        if (times_count == MAX_COMMAND_IDS)
+        {
+            return;
+        }
+        times[times_count++].command_id = command->command_id;
+    }
+    times[i].count++;
+    times[i].total_ns += command->handler_ns;
+    times[i].max_ns = command->handler_ns > times[i].max_ns ? command->handler_ns : times[i].max_ns;
+}
+
+// KEY=VALUE of the config of the flash, as the capture does not have it
+static bool set_config(char *setting)
+{
+    char *value = strchr(setting, '=');
+    if ((value == NULL) || (value - setting >= MAX_KEY_LENGTH))
+    {
+        return false;
+    }
+    char key[MAX_KEY_LENGTH] = {0};
+    memcpy(key, setting, value - setting);
+    if (find_entry(key) == NULL)
+    {
+        return false;
+    }
+    put_string(key, value + 1);
+    return true;
+}
+
+static int usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-w payload words to print] [-c sdcard] [-p KEY=VALUE]... rom3cap.bin\n", name);
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *card = NULL;
+    host_flash_reset();
+    clear_config();
+    load_all_entries();
+    int option;
+    while ((option = getopt(argc, argv, "w:c:p:")) != -1)
+    {
+        switch (option)
+        {
+        case 'w':
+            payload_words = atoi(optarg);
+            break;
+        case 'c':
+            card = optarg;
+            break;
+        case 'p':
+            if (!set_config(optarg))
+            {
+                fprintf(stderr, "Unknown config setting %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        return usage(argv[0]);
+    }
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL)
+    {
+        perror(argv[optind]);
+        return 2;
+    }
+    if ((card != NULL) && !host_disk_open(card))
+    {
+        fprintf(stderr, "%s is not a card of the %s backend\n", card, host_disk_backend());
+        fclose(file);
+        return 2;
+    }
+
+    // The start time is only known after the first word. Read it before the replay
+    CaptureRecord first;
+    if ((fseek(file, sizeof(CaptureHeader), SEEK_SET) == 0) && (fread(&first, sizeof(first), 1, file) == 1))
+    {
+        start_us = first.time_us;
+        previous_us = start_us;
+    }
+    rewind(file);
+
+    ReplayInfo info;
+    host_rom_clear();
+    bool ok = card != NULL ? replay_emulator(file, print_served, &info) : replay_capture(file, print_command, &info);
+    fclose(file);
+    if (card != NULL)
+    {
+        host_disk_eject();
+    }
+    if (!ok)
+    {
+        return 1;
+    }
+    printf("\nApp: %u\n", info.app);
+    printf("%u words, %u commands in %.3f s\n", info.records, bus_stats.commands, (host_time_us - info.start_us) / 1000000.0);
+    printf("Parse timeouts: %u. Oversized frames: %u. Words lost: %u\n", bus_stats.parse_timeouts, bus_stats.parse_oversized, info.lost);
+    if (info.stopped)
+    {
+        printf("The emulator stopped before the end of the capture\n");
+    }
+    for (int i = 0; i < times_count; i++)
+    {
+        printf("0x%04X: %6u commands, %10.1f us average, %10.1f us max\n", times[i].command_id, times[i].count,
+               times[i].total_ns / 1000.0 / times[i].count, times[i].max_ns / 1000.0);
+    }
+    return 0;
+}
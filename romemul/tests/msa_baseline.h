@@ -0,0 +1,17 @@
+/**
+ * File: msa_baseline.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The MSA_to_ST of filesys.c before the streaming decoder, the reference of test_msaconv.c
+ */
+
+#ifndef MSA_BASELINE_H
+#define MSA_BASELINE_H
+
+#include "include/filesys.h"
+
+// Same arguments and results as MSA_to_ST. A truncated image is not detected
+FRESULT MSA_to_ST_baseline(const char *folder, char *msaFilename, char *stFilename, bool overwrite);
+
+#endif // MSA_BASELINE_H
@@ -0,0 +1,214 @@
+/**
+ * File: replay.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Replay of a ROM3 capture (capture.h) through the parse_protocol of tprotocol.c, alone
+ * or with the command handlers of the emulator that made the capture
+ */
+
+#include "replay.h"
+
+#include <time.h>
+
+#include "floppyemul.h"
+#include "gemdrvemul.h"
+#include "hostemul.h"
+#include "romloader.h"
+#include "rtcemul.h"
+
+// The state of the parser in tprotocol.c
+extern TPParseStep nextTPstep;
+extern uint64_t last_header_found;
+extern TransmissionProtocol transmission;
+
+// An emulator as main.c starts it, without its endless loop
+typedef struct
+{
+    uint32_t app;
+    void (*setup)(void);
+    void (*irq_handler)(void);
+    bool (*poll)(void); // false when the loop of the firmware ends
+} ReplayEmulator;
+
+static void setup_configurator(void)
+{
+    // The configurator reserves the memory of the parser itself
+    romloader_setup();
+}
+
+static void setup_floppyemul(void)
+{
+    init_protocol_parser();
+    floppyemul_setup(false);
+}
+
+static void setup_rtcemul(void)
+{
+    init_protocol_parser();
+    rtcemul_setup(false);
+}
+
+static bool poll_rtcemul(void)
+{
+    rtcemul_poll();
+    return true;
+}
+
+static void setup_gemdrvemul(void)
+{
+    init_protocol_parser();
+    gemdrvemul_setup(false);
+}
+
+static bool poll_gemdrvemul(void)
+{
+    gemdrvemul_poll();
+    return true;
+}
+
+static const ReplayEmulator emulators[] = {
+    {APP_CONFIGURATOR, setup_configurator, dma_irq_handler_lookup_callback, romloader_poll},
+    {APP_FLOPPYEMUL, setup_floppyemul, floppyemul_dma_irq_handler_lookup_callback, floppyemul_poll},
+    {APP_RTCEMUL, setup_rtcemul, rtcemul_dma_irq_handler_lookup_callback, poll_rtcemul},
+    {APP_GEMDRVEMUL, setup_gemdrvemul, gemdrvemul_dma_irq_handler_lookup_callback, poll_gemdrvemul},
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static bool read_header(FILE *file, ReplayInfo *info)
+{
+    CaptureHeader header;
+    memset(info, 0, sizeof(ReplayInfo));
+    if ((fread(&header, sizeof(header), 1, file) != 1) || (header.magic != CAPTURE_MAGIC))
+    {
+        fprintf(stderr, "Not a ROM3 capture\n");
+        return false;
+    }
+    if ((header.version != CAPTURE_VERSION) || (header.record_size != sizeof(CaptureRecord)))
+    {
+        fprintf(stderr, "Unknown capture version %u with records of %u bytes\n", header.version, header.record_size);
+        return false;
+    }
+    info->app = header.app;
+
+    memset(&bus_stats, 0, sizeof(bus_stats));
+    nextTPstep = HEADER_DETECTION;
+    last_header_found = 0;
+    return true;
+}
+
+// Reads the next word and sets the host timer to its time. The records have the lower 32 bits of
+// the timer
+static bool read_record(FILE *file, ReplayInfo *info, uint64_t *time_us, CaptureRecord *record)
+{
+    if (fread(record, sizeof(CaptureRecord), 1, file) != 1)
+    {
+        return false;
+    }
+    if (info->records == 0)
+    {
+        *time_us = record->time_us;
+        info->start_us = *time_us;
+    }
+    else
+    {
+        *time_us += (uint32_t)(record->time_us - (uint32_t)*time_us);
+    }
+    host_set_time_us(*time_us);
+    info->records++;
+    info->lost += record->lost;
+    return true;
+}
+
+bool replay_capture(FILE *file, ProtocolCallback callback, ReplayInfo *info)
+{
+    if (!read_header(file, info))
+    {
+        return false;
+    }
+    init_protocol_parser();
+
+    uint64_t time_us = 0;
+    CaptureRecord record;
+    while (read_record(file, info, &time_us, &record))
+    {
+        parse_protocol(record.data, callback);
+    }
+    terminate_protocol_parser();
+    return true;
+}
+
+// One pass of the loop of the emulator. Its time goes to the last command served
+static bool run_loop(const ReplayEmulator *emulator, ReplayCommand *command)
+{
+    uint64_t start_ns = now_ns();
+    bool running = emulator->poll();
+    command->handler_ns += now_ns() - start_ns;
+    return running;
+}
+
+bool replay_emulator(FILE *file, ReplayCommandCallback callback, ReplayInfo *info)
+{
+    if (!read_header(file, info))
+    {
+        return false;
+    }
+    const ReplayEmulator *emulator = NULL;
+    for (size_t i = 0; i < sizeof(emulators) / sizeof(emulators[0]); i++)
+    {
+        if (emulators[i].app == info->app)
+        {
+            emulator = &emulators[i];
+            break;
+        }
+    }
+    if (emulator == NULL)
+    {
+        fprintf(stderr, "No emulator for the app %u of the capture\n", info->app);
+        return false;
+    }
+    emulator->setup();
+
+    // The passes of the loop before the first command are not timed
+    ReplayCommand command = {0};
+    bool served = false;
+    uint64_t time_us = 0;
+    CaptureRecord record;
+    while (!info->stopped && read_record(file, info, &time_us, &record))
+    {
+        // The parser clears the command once it is served
+        uint32_t commands = bus_stats.commands;
+        uint16_t command_id = transmission.command_id;
+        uint16_t payload_size = transmission.payload_size;
+        host_rom3_access(record.data, emulator->irq_handler);
+        if (bus_stats.commands != commands)
+        {
+            if (served && (callback != NULL))
+            {
+                callback(&command);
+            }
+            command.command_id = command_id;
+            command.payload_size = payload_size;
+            command.time_us = time_us;
+            command.handler_ns = 0;
+            served = true;
+        }
+        info->stopped = !run_loop(emulator, &command);
+    }
+    for (int i = 0; (i < REPLAY_FINAL_POLLS) && !info->stopped; i++)
+    {
+        info->stopped = !run_loop(emulator, &command);
+    }
+    if (served && (callback != NULL))
+    {
+        callback(&command);
+    }
+    terminate_protocol_parser();
+    return true;
+}
@@ -0,0 +1,67 @@
+/**
+ * File: replay.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Replay of a ROM3 capture (capture.h) through the parse_protocol of tprotocol.c, alone
+ * or with the command handlers of the emulator that made the capture
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "include/tprotocol.h"
+
+// Passes of the loop of the emulator after the last word, for the answer of the last command
+#define REPLAY_FINAL_POLLS 4
+
+typedef struct
+{
+    uint32_t app;      // APP_* of the emulator that made the capture
+    uint32_t records;  // Words replayed
+    uint32_t lost;     // Words lost by the capture because its ring was full
+    uint64_t start_us; // Time of the first word
+    bool stopped;      // The loop of the emulator ended before the last word
+} ReplayInfo;
+
+// A command served by the emulator during a replay
+typedef struct
+{
+    uint16_t command_id;
+    uint16_t payload_size;
+    uint64_t time_us;    // Time in the capture of the last word of the command
+    uint64_t handler_ns; // Time of the host in the loop of the emulator until the next command
+} ReplayCommand;
+
+typedef void (*ReplayCommandCallback)(const ReplayCommand *command);
+
+/**
+ * @brief Feeds every word of a capture to parse_protocol, with the host timer set to the time of the
+ * word, so the restart after PROTOCOL_READ_RESTART_MICROSECONDS behaves as in the RP2040. The counters
+ * of bus_stats are reset first. Only the parser runs: the callback gets the commands, but no command
+ * handler of the emulators is executed.
+ *
+ * @param file The capture file, at its start.
+ * @param callback Called with each command parsed.
+ * @param info Filled with the header and the counters of the capture.
+ * @return false if the file is not a capture.
+ */
+bool replay_capture(FILE *file, ProtocolCallback callback, ReplayInfo *info);
+
+/**
+ * @brief Replays a capture through the emulator that made it: gemdrvemul.c, floppyemul.c, rtcemul.c
+ * or the configurator of romloader.c. The emulator is started as in the firmware, each word is a read
+ * of ROM3 served by its DMA IRQ handler, and one pass of its loop runs after each word. The config and
+ * the SD card (hostdisk.h) must be ready before. The answers are left in the shared memory.
+ *
+ * @param file The capture file, at its start.
+ * @param callback Called with each command served and the time the emulator took. Can be NULL.
+ * @param info Filled with the header and the counters of the capture.
+ * @return false if the file is not a capture or there is no emulator for its app.
+ */
+bool replay_emulator(FILE *file, ReplayCommandCallback callback, ReplayInfo *info);
+
+#endif // REPLAY_H
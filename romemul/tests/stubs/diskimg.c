@@ -0,0 +1,165 @@
+/**
+ * File: diskimg.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The SD card of the emulator tests as a FAT image file, for the real FatFs of the
+ * fatfs-sdk submodule. The sectors are read and written by the disk functions of FatFs
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "hostdisk.h"
+
+#define DISKIMG_SECTOR_SIZE 512
+
+static FILE *image = NULL;
+static char image_path[512];
+static LBA_t image_sectors = 0;
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return ((pdrv == 0) && (image != NULL)) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+    return ((pdrv == 0) && (image != NULL)) ? 0 : STA_NOINIT;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+    if ((pdrv != 0) || (image == NULL))
+    {
+        return RES_NOTRDY;
+    }
+    if (sector + count > image_sectors)
+    {
+        return RES_PARERR;
+    }
+    if ((fseeko(image, (off_t)sector * DISKIMG_SECTOR_SIZE, SEEK_SET) != 0) || (fread(buff, DISKIMG_SECTOR_SIZE, count, image) != count))
+    {
+        return RES_ERROR;
+    }
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+    if ((pdrv != 0) || (image == NULL))
+    {
+        return RES_NOTRDY;
+    }
+    if (sector + count > image_sectors)
+    {
+        return RES_PARERR;
+    }
+    if ((fseeko(image, (off_t)sector * DISKIMG_SECTOR_SIZE, SEEK_SET) != 0) || (fwrite(buff, DISKIMG_SECTOR_SIZE, count, image) != count))
+    {
+        return RES_ERROR;
+    }
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    if ((pdrv != 0) || (image == NULL))
+    {
+        return RES_NOTRDY;
+    }
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        return fflush(image) == 0 ? RES_OK : RES_ERROR;
+    case GET_SECTOR_COUNT:
+        *(LBA_t *)buff = image_sectors;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = DISKIMG_SECTOR_SIZE;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD *)buff = 1;
+        return RES_OK;
+    default:
+        return RES_PARERR;
+    }
+}
+
+// The time of the host. The firmware takes it from the RTC
+DWORD get_fattime(void)
+{
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return ((DWORD)(tm.tm_year - 80) << 25) | ((DWORD)(tm.tm_mon + 1) << 21) | ((DWORD)tm.tm_mday << 16) |
+           ((DWORD)tm.tm_hour << 11) | ((DWORD)tm.tm_min << 5) | ((DWORD)tm.tm_sec >> 1);
+}
+
+bool host_disk_create(const char *path, uint32_t size_mb)
+{
+    static BYTE work[FF_MAX_SS * 8];
+    host_disk_remove();
+    image = fopen(path, "w+b");
+    if (image == NULL)
+    {
+        return false;
+    }
+    snprintf(image_path, sizeof(image_path), "%s", path);
+    image_sectors = (LBA_t)size_mb * 1024 * 1024 / DISKIMG_SECTOR_SIZE;
+    MKFS_PARM options = {.fmt = FM_ANY | FM_SFD};
+    if ((ftruncate(fileno(image), (off_t)image_sectors * DISKIMG_SECTOR_SIZE) != 0) || (f_mkfs("0:", &options, work, sizeof(work)) != FR_OK))
+    {
+        host_disk_remove();
+        return false;
+    }
+    return true;
+}
+
+bool host_disk_open(const char *path)
+{
+    host_disk_eject();
+    image = fopen(path, "r+b");
+    if (image == NULL)
+    {
+        return false;
+    }
+    snprintf(image_path, sizeof(image_path), "%s", path);
+    struct stat st;
+    if ((fstat(fileno(image), &st) != 0) || (st.st_size < DISKIMG_SECTOR_SIZE))
+    {
+        host_disk_eject();
+        return false;
+    }
+    image_sectors = (LBA_t)(st.st_size / DISKIMG_SECTOR_SIZE);
+    return true;
+}
+
+void host_disk_eject(void)
+{
+    if (image != NULL)
+    {
+        fclose(image);
+        image = NULL;
+        image_sectors = 0;
+    }
+}
+
+void host_disk_remove(void)
+{
+    if (image != NULL)
+    {
+        host_disk_eject();
+        remove(image_path);
+    }
+}
+
+const char *host_disk_backend(void)
+{
+    return "image";
+}
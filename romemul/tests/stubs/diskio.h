@@ -0,0 +1,37 @@
+/**
+ * File: diskio.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the FatFs disk interface. The tests implement the functions
+ */
+
+#ifndef HOST_DISKIO_H
+#define HOST_DISKIO_H
+
+#include "ff.h"
+
+typedef BYTE DSTATUS;
+
+typedef enum
+{
+    RES_OK = 0,
+    RES_ERROR,
+    RES_WRPRT,
+    RES_NOTRDY,
+    RES_PARERR
+} DRESULT;
+
+#define STA_NOINIT 0x01
+
+#define CTRL_SYNC 0
+#define GET_SECTOR_COUNT 1
+#define GET_SECTOR_SIZE 2
+#define GET_BLOCK_SIZE 3
+
+DSTATUS disk_initialize(BYTE pdrv);
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff);
+
+#endif // HOST_DISKIO_H
@@ -0,0 +1,16 @@
+/**
+ * File: f_util.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the FatFs utilities of the SD card driver
+ */
+
+#ifndef HOST_F_UTIL_H
+#define HOST_F_UTIL_H
+
+#include "ff.h"
+
+const char *FRESULT_str(FRESULT i);
+
+#endif // HOST_F_UTIL_H
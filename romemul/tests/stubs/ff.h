@@ -0,0 +1,156 @@
+/**
+ * File: ff.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of FatFs, with the fields of the real structures used by the firmware.
+ * The emulator tests link stubs/hostfs.c, or the real FatFs when the fatfs-sdk submodule is checked
+ * out. The other tests that need files implement the functions
+ */
+
+#ifndef HOST_FF_H
+#define HOST_FF_H
+
+#include <stdint.h>
+
+#include "ffconf.h"
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+typedef char TCHAR;
+#if FF_LBA64
+typedef QWORD LBA_t;
+#else
+typedef DWORD LBA_t;
+#endif
+#if FF_FS_EXFAT
+typedef QWORD FSIZE_t;
+#else
+typedef DWORD FSIZE_t;
+#endif
+
+#define FS_FAT12 1
+#define FS_FAT16 2
+#define FS_FAT32 3
+#define FS_EXFAT 4
+
+typedef struct
+{
+    BYTE fs_type;
+    WORD csize;    // Sectors per cluster
+    DWORD n_fatent; // Clusters + 2
+    LBA_t fatbase;
+    LBA_t dirbase;
+    LBA_t database;
+    LBA_t winsect; // Sector in the window. Invalidated to force a read
+} FATFS;
+
+typedef struct
+{
+    FATFS *fs;
+    FSIZE_t objsize;
+} FFOBJID;
+
+typedef enum
+{
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED,
+    FR_EXIST,
+    FR_INVALID_OBJECT,
+    FR_WRITE_PROTECTED,
+    FR_INVALID_DRIVE,
+    FR_NOT_ENABLED,
+    FR_NO_FILESYSTEM,
+    FR_MKFS_ABORTED,
+    FR_TIMEOUT,
+    FR_LOCKED,
+    FR_NOT_ENOUGH_CORE,
+    FR_TOO_MANY_OPEN_FILES,
+    FR_INVALID_PARAMETER
+} FRESULT;
+
+#define FA_READ 0x01
+#define FA_WRITE 0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_NEW 0x04
+#define FA_CREATE_ALWAYS 0x08
+#define FA_OPEN_ALWAYS 0x10
+#define FA_OPEN_APPEND 0x30
+
+#define AM_RDO 0x01
+#define AM_HID 0x02
+#define AM_SYS 0x04
+#define AM_DIR 0x10
+#define AM_ARC 0x20
+
+typedef struct
+{
+    FFOBJID obj;
+    BYTE flag;
+    FSIZE_t fptr;
+    LBA_t sect; // Sector in the buffer. 0 forces a read
+    void *host; // Owned by the implementation
+} FIL;
+
+#define HOST_FF_PATH_MAX 512
+
+typedef struct
+{
+    FFOBJID obj;
+    const TCHAR *pat; // Pattern of f_findfirst
+    uint32_t index;
+    TCHAR path[HOST_FF_PATH_MAX]; // Folder and last name read. Owned by the implementation
+    TCHAR last[FF_LFN_BUF + 1];
+} DIR;
+
+typedef struct
+{
+    FSIZE_t fsize;
+    WORD fdate;
+    WORD ftime;
+    BYTE fattrib;
+    TCHAR fname[FF_LFN_BUF + 1];
+} FILINFO;
+
+#define f_eof(fp) ((int)((fp)->fptr == (fp)->obj.objsize))
+#define f_error(fp) (0)
+#define f_tell(fp) ((fp)->fptr)
+#define f_size(fp) ((fp)->obj.objsize)
+#define f_rewind(fp) f_lseek((fp), 0)
+#define f_rewinddir(dp) f_readdir((dp), 0)
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_truncate(FIL *fp);
+FRESULT f_sync(FIL *fp);
+FRESULT f_opendir(DIR *dp, const TCHAR *path);
+FRESULT f_closedir(DIR *dp);
+FRESULT f_readdir(DIR *dp, FILINFO *fno);
+FRESULT f_findfirst(DIR *dp, FILINFO *fno, const TCHAR *path, const TCHAR *pattern);
+FRESULT f_findnext(DIR *dp, FILINFO *fno);
+FRESULT f_mkdir(const TCHAR *path);
+FRESULT f_unlink(const TCHAR *path);
+FRESULT f_rename(const TCHAR *path_old, const TCHAR *path_new);
+FRESULT f_stat(const TCHAR *path, FILINFO *fno);
+FRESULT f_chmod(const TCHAR *path, BYTE attr, BYTE mask);
+FRESULT f_utime(const TCHAR *path, const FILINFO *fno);
+FRESULT f_chdir(const TCHAR *path);
+FRESULT f_getcwd(TCHAR *buff, UINT len);
+FRESULT f_getfree(const TCHAR *path, DWORD *nclst, FATFS **fatfs);
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt);
+FRESULT f_unmount(const TCHAR *path);
+TCHAR *f_gets(TCHAR *buff, int len, FIL *fp);
+
+#endif // HOST_FF_H
@@ -0,0 +1,12 @@
+/**
+ * File: clocks.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Empty host stand-in. The tested modules include it but use nothing from it
+ */
+
+#ifndef HOST_HARDWARE_CLOCKS_H
+#define HOST_HARDWARE_CLOCKS_H
+
+#endif // HOST_HARDWARE_CLOCKS_H
@@ -0,0 +1,59 @@
+/**
+ * File: dma.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the DMA registers. The raw interrupt flags read by busstats.h, and
+ * the lookup channel and interrupt flags used by the DMA IRQ handlers of the emulators
+ */
+
+#ifndef HOST_HARDWARE_DMA_H
+#define HOST_HARDWARE_DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NUM_DMA_CHANNELS 12
+
+typedef struct
+{
+    volatile uint32_t read_addr;
+    volatile uint32_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct
+{
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    volatile uint32_t intr;
+    volatile uint32_t ints0;
+    volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t *dma_hw;
+
+#define DREQ_XIP_STREAM 37
+
+typedef struct
+{
+    uint32_t ctrl;
+} dma_channel_config;
+
+// Declared only: the copy of the firmware to RAM with the DMA does not run on the host
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(unsigned int channel);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_dreq(dma_channel_config *c, unsigned int dreq);
+void dma_channel_configure(unsigned int channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr, unsigned int transfer_count, bool trigger);
+bool dma_channel_is_busy(unsigned int channel);
+
+// The host has no interrupts. The tests call the handlers
+static inline void dma_channel_set_irq1_enabled(unsigned int channel, bool enabled)
+{
+    (void)channel;
+    (void)enabled;
+}
+
+#endif // HOST_HARDWARE_DMA_H
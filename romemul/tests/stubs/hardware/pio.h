@@ -0,0 +1,16 @@
+/**
+ * File: pio.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the PIO blocks. The emulators do not run the PIO programs on the host
+ */
+
+#ifndef HOST_HARDWARE_PIO_H
+#define HOST_HARDWARE_PIO_H
+
+// The host has no PIO. Only the type of the declarations of romemul.h
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t *PIO;
+
+#endif // HOST_HARDWARE_PIO_H
@@ -0,0 +1,32 @@
+/**
+ * File: rtc.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the RP2040 RTC. It counts the seconds of the host timer since the
+ * last rtc_set_datetime()
+ */
+
+#ifndef HOST_HARDWARE_RTC_H
+#define HOST_HARDWARE_RTC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw; // 0 is Sunday
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+void rtc_init(void);
+bool rtc_set_datetime(datetime_t *t);
+bool rtc_get_datetime(datetime_t *t);
+bool rtc_running(void);
+
+#endif // HOST_HARDWARE_RTC_H
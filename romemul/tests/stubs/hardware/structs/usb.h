@@ -0,0 +1,12 @@
+/**
+ * File: usb.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Empty host stand-in. The tested modules include it but use nothing from it
+ */
+
+#ifndef HOST_HARDWARE_STRUCTS_USB_H
+#define HOST_HARDWARE_STRUCTS_USB_H
+
+#endif // HOST_HARDWARE_STRUCTS_USB_H
@@ -0,0 +1,28 @@
+/**
+ * File: xip_ctrl.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the XIP stream registers
+ */
+
+#ifndef HOST_HARDWARE_STRUCTS_XIP_CTRL_H
+#define HOST_HARDWARE_STRUCTS_XIP_CTRL_H
+
+#include <stdint.h>
+
+#define XIP_AUX_BASE 0x50400000
+#define XIP_STAT_FIFO_EMPTY 0x2
+
+typedef struct
+{
+    volatile uint32_t stat;
+    volatile uint32_t stream_addr;
+    volatile uint32_t stream_ctr;
+    volatile uint32_t stream_fifo;
+} xip_ctrl_hw_t;
+
+// Declared only: the copy of the firmware to RAM with the XIP stream does not run on the host
+extern xip_ctrl_hw_t *xip_ctrl_hw;
+
+#endif // HOST_HARDWARE_STRUCTS_XIP_CTRL_H
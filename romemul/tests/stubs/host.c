@@ -0,0 +1,72 @@
+/**
+ * File: host.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Simulated hardware of the host tests: the microseconds timer, the flash, the DMA
+ * registers and the counters of busstats.c
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "host.h"
+#include "busstats.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/timer.h"
+
+uint64_t host_time_us = 0;
+uint8_t host_flash[HOST_FLASH_SIZE];
+uint32_t host_flash_erases = 0;
+uint32_t host_flash_programs = 0;
+
+static timer_hw_t host_timer = {0};
+timer_hw_t *timer_hw = &host_timer;
+
+static dma_hw_t host_dma = {0};
+dma_hw_t *dma_hw = &host_dma;
+
+// parse_protocol and the DMA IRQ handlers count the accesses, the commands and the timeouts here
+BusStats bus_stats;
+
+void host_set_time_us(uint64_t us)
+{
+    host_time_us = us;
+    host_timer.timerawh = (uint32_t)(us >> 32);
+    host_timer.timerawl = (uint32_t)us;
+}
+
+void host_advance_us(uint64_t us)
+{
+    host_set_time_us(host_time_us + us);
+}
+
+void host_flash_reset(void)
+{
+    memset(host_flash, 0xFF, sizeof(host_flash));
+    host_flash_erases = 0;
+    host_flash_programs = 0;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    assert((flash_offs % FLASH_SECTOR_SIZE) == 0);
+    assert((count % FLASH_SECTOR_SIZE) == 0);
+    assert(flash_offs + count <= HOST_FLASH_SIZE);
+    memset(host_flash + flash_offs, 0xFF, count);
+    host_flash_erases += count / FLASH_SECTOR_SIZE;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    assert((flash_offs % FLASH_PAGE_SIZE) == 0);
+    assert((count % FLASH_PAGE_SIZE) == 0);
+    assert(flash_offs + count <= HOST_FLASH_SIZE);
+    // Programming only clears bits
+    for (size_t i = 0; i < count; i++)
+    {
+        host_flash[flash_offs + i] &= data[i];
+    }
+    host_flash_programs += count / FLASH_PAGE_SIZE;
+}
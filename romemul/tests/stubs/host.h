@@ -0,0 +1,44 @@
+/**
+ * File: host.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Simulated hardware of the host tests: the microseconds timer, the flash, the DMA
+ * registers and the counters of busstats.c
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+#define HOST_FLASH_SIZE (2 * 1024 * 1024)
+
+// The microseconds since boot. Advanced only by the tests, so the results are deterministic
+extern uint64_t host_time_us;
+// The flash as mapped in XIP_BASE. Erased to 0xFF
+extern uint8_t host_flash[HOST_FLASH_SIZE];
+// Operations done on the flash since the last reset of the counters
+extern uint32_t host_flash_erases;
+extern uint32_t host_flash_programs;
+
+/**
+ * @brief Sets the microseconds timer, also the lower 32 bits read from timer_hw->timerawl.
+ *
+ * @param us The new time.
+ */
+void host_set_time_us(uint64_t us);
+
+/**
+ * @brief Advances the microseconds timer.
+ *
+ * @param us Microseconds to advance.
+ */
+void host_advance_us(uint64_t us);
+
+/**
+ * @brief Erases the whole flash to 0xFF and resets the counters.
+ */
+void host_flash_reset(void);
+
+#endif // HOST_H
@@ -0,0 +1,51 @@
+/**
+ * File: hostdisk.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The SD card of the emulator tests. With the real FatFs of the fatfs-sdk submodule it
+ * is a FAT image file read and written by diskimg.c. Without it, hostfs.c implements the FatFs API
+ * on a folder of the host
+ */
+
+#ifndef HOSTDISK_H
+#define HOSTDISK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Creates an empty card and inserts it. The emulators mount it as the drive "0:".
+ *
+ * @param path The image file or the folder. Anything there is removed first.
+ * @param size_mb Size of the image file. The folder takes the free space of the host.
+ * @return true if the card is ready.
+ */
+bool host_disk_create(const char *path, uint32_t size_mb);
+
+/**
+ * @brief Inserts a card made before, as the image of an SD card of the field. Nothing is removed.
+ *
+ * @param path The image file or the folder.
+ * @return true if the card is ready.
+ */
+bool host_disk_open(const char *path);
+
+/**
+ * @brief Ejects the card. The image file or the folder is kept.
+ */
+void host_disk_eject(void);
+
+/**
+ * @brief Ejects the card and removes the image file or the folder.
+ */
+void host_disk_remove(void);
+
+/**
+ * @brief Name of the backend of the card, for the reports of the benchmarks.
+ *
+ * @return "image" or "folder".
+ */
+const char *host_disk_backend(void);
+
+#endif // HOSTDISK_H
@@ -0,0 +1,20 @@
+/**
+ * File: hostdl.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The downloads of the floppy images of the configurator in the emulator tests. There is
+ * no network (stubs/hostnet.c). Apart from hostnet.c, so test_httpdl can link the real httpdl.c
+ */
+
+#include "include/network.h"
+
+int download_floppy(const char *url, const char *folder, const char *dest_filename, bool overwrite_flag, bool decode_msa)
+{
+    (void)url;
+    (void)folder;
+    (void)dest_filename;
+    (void)overwrite_flag;
+    (void)decode_msa;
+    return ERR_CONN;
+}
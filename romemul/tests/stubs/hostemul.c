@@ -0,0 +1,159 @@
+/**
+ * File: hostemul.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Simulated hardware of the emulator tests: the ROM4 and ROM3 memory, the DMA channel
+ * that gives the address read by the ST to the IRQ handlers, the RTC and the SD card driver
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "constants.h"
+#include "hostemul.h"
+#include "busstats.h"
+#include "f_util.h"
+#include "sd_card.h"
+#include "tusb.h"
+#include "hardware/dma.h"
+#include "hardware/rtc.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// The channels of romemul.c
+int read_addr_rom_dma_channel = 0;
+int lookup_data_rom_dma_channel = 1;
+
+static BusStatsReport bus_stats_report = {0};
+
+static datetime_t rtc_datetime;
+static uint64_t rtc_set_us = 0;
+static bool rtc_set = false;
+
+static spi_t sd_spi = {.baud_rate = 12500 * 1000};
+static sd_spi_if_t sd_spi_if = {.spi = &sd_spi};
+static sd_card_t sd_card = {.spi_if_p = &sd_spi_if};
+
+// The emulators use the addresses of the RP2040 as pointers. Map them in the host before main
+__attribute__((constructor)) static void host_rom_map(void)
+{
+    size_t size = ROM_BANKS * ROM_SIZE_BYTES;
+    void *rom = mmap((void *)(uintptr_t)ROM4_START_ADDRESS, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (rom != (void *)(uintptr_t)ROM4_START_ADDRESS)
+    {
+        fprintf(stderr, "Can't map ROM4 and ROM3 at 0x%08X\n", ROM4_START_ADDRESS);
+        exit(2);
+    }
+}
+
+void host_rom_clear(void)
+{
+    memset((void *)(uintptr_t)ROM4_START_ADDRESS, 0, ROM_BANKS * ROM_SIZE_BYTES);
+}
+
+void host_rom3_access(uint16_t offset, void (*irq_handler)(void))
+{
+    dma_hw->ch[lookup_data_rom_dma_channel].al3_read_addr_trig = ROM3_START_ADDRESS + offset;
+    irq_handler();
+}
+
+void busstats_poll(uint8_t *dest)
+{
+    if (dest != NULL)
+    {
+        memcpy(dest, &bus_stats_report, sizeof(bus_stats_report));
+    }
+}
+
+const BusStatsReport *busstats_get_report(void)
+{
+    return &bus_stats_report;
+}
+
+void rtc_init(void)
+{
+}
+
+bool rtc_set_datetime(datetime_t *t)
+{
+    rtc_datetime = *t;
+    rtc_set_us = host_time_us;
+    rtc_set = true;
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t)
+{
+    if (!rtc_set)
+    {
+        return false;
+    }
+    struct tm tm = {
+        .tm_year = rtc_datetime.year - 1900,
+        .tm_mon = rtc_datetime.month - 1,
+        .tm_mday = rtc_datetime.day,
+        .tm_hour = rtc_datetime.hour,
+        .tm_min = rtc_datetime.min,
+        .tm_sec = rtc_datetime.sec,
+    };
+    time_t seconds = timegm(&tm) + (time_t)((host_time_us - rtc_set_us) / 1000000);
+    gmtime_r(&seconds, &tm);
+    t->year = tm.tm_year + 1900;
+    t->month = tm.tm_mon + 1;
+    t->day = tm.tm_mday;
+    t->dotw = tm.tm_wday;
+    t->hour = tm.tm_hour;
+    t->min = tm.tm_min;
+    t->sec = tm.tm_sec;
+    return true;
+}
+
+bool rtc_running(void)
+{
+    return rtc_set;
+}
+
+bool sd_init_driver(void)
+{
+    return true;
+}
+
+size_t sd_get_num(void)
+{
+    return 1;
+}
+
+sd_card_t *sd_get_by_num(size_t num)
+{
+    return num == 0 ? &sd_card : NULL;
+}
+
+const char *FRESULT_str(FRESULT i)
+{
+    static const char *const names[] = {
+        "Succeeded", "A hard error occurred in the low level disk I/O layer", "Assertion failed",
+        "The physical drive cannot work", "Could not find the file", "Could not find the path",
+        "The path name format is invalid", "Access denied due to prohibited access or directory full",
+        "Access denied due to prohibited access", "The file/directory object is invalid",
+        "The physical drive is write protected", "The logical drive number is invalid",
+        "The volume has no work area", "There is no valid FAT volume", "The f_mkfs() aborted due to any problem",
+        "Could not get a grant to access the volume within defined period", "The operation is rejected according to the file sharing policy",
+        "LFN working buffer could not be allocated", "Number of open files > FF_FS_LOCK", "Given parameter is invalid"};
+    return (i < sizeof(names) / sizeof(names[0])) ? names[i] : "Unknown error";
+}
+
+// No USB host is connected
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
+{
+    (void)lun;
+    (void)sense_key;
+    (void)add_sense_code;
+    (void)add_sense_qualifier;
+    return true;
+}
@@ -0,0 +1,28 @@
+/**
+ * File: hostemul.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Simulated hardware of the emulator tests: the ROM4 and ROM3 memory, the DMA channel
+ * that gives the address read by the ST to the IRQ handlers, the RTC and the SD card driver
+ */
+
+#ifndef HOSTEMUL_H
+#define HOSTEMUL_H
+
+#include <stdint.h>
+
+/**
+ * @brief Clears ROM4 and ROM3. They are mapped in the host at the addresses of the RP2040 before main.
+ */
+void host_rom_clear(void);
+
+/**
+ * @brief A read of the ST in ROM3, as the DMA IRQ handler of an emulator sees it.
+ *
+ * @param offset Offset in ROM3 read by the ST. The protocol sends a word in each offset.
+ * @param irq_handler The lookup callback of the emulator.
+ */
+void host_rom3_access(uint16_t offset, void (*irq_handler)(void));
+
+#endif // HOSTEMUL_H
@@ -0,0 +1,1007 @@
+/**
+ * File: hostfs.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The FatFs API on a folder of the host, for the emulator tests when the fatfs-sdk
+ * submodule is not checked out. It follows FatFs where the emulators can see it: the names are case
+ * insensitive, the trailing dots and spaces are ignored, f_findfirst() takes the same wildcards and
+ * the attributes and the error codes are the same. The folders are listed in name order instead of
+ * the order of the directory table, and an open file is not locked
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <ctype.h>
+// DIR is also the folder object of FatFs. The one of the host is renamed
+#define DIR HOST_DIR_STREAM
+#include <dirent.h>
+#undef DIR
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "diskio.h"
+#include "ff.h"
+#include "hostdisk.h"
+
+#define HOSTFS_SECTOR_SIZE 512
+#define HOSTFS_CLUSTER_SECTORS 64 // Clusters of 32 Kbytes, as a FAT32 SD card
+#define HOSTFS_MAX_CLUSTERS 0x0FFFFFF5
+#define HOSTFS_CACHED_FOLDERS 4
+
+// A folder in name order. Listed again after any change of the card
+typedef struct
+{
+    char path[HOST_FF_PATH_MAX]; // From the root of the card
+    uint32_t generation;
+    FILINFO *entries;
+    uint32_t count;
+    uint32_t last_use;
+} FolderListing;
+
+// The FAT attributes the host files do not have. AM_RDO is the write permission of the owner
+typedef struct HostAttrib
+{
+    char path[HOST_FF_PATH_MAX]; // From the root of the card
+    BYTE attrib;
+    struct HostAttrib *next;
+} HostAttrib;
+
+typedef struct
+{
+    int fd;
+} HostFile;
+
+static char root[HOST_FF_PATH_MAX] = ""; // Folder of the card. Empty if there is no card
+static FATFS *mounted = NULL;
+static char cwd[HOST_FF_PATH_MAX] = ""; // From the root of the card
+static uint32_t generation = 1;         // Changes with every change of the card
+static FolderListing listings[HOSTFS_CACHED_FOLDERS];
+static uint32_t listing_uses = 0;
+static HostAttrib *attribs = NULL;
+
+static int compare_names(const char *a, const char *b)
+{
+    int result = strcasecmp(a, b);
+    return result != 0 ? result : strcmp(a, b);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return compare_names(((const FILINFO *)a)->fname, ((const FILINFO *)b)->fname);
+}
+
+static void host_path_of(const char *path, char *host_path)
+{
+    snprintf(host_path, HOST_FF_PATH_MAX, "%s%s%s", root, path[0] ? "/" : "", path);
+}
+
+static HostAttrib *find_attrib(const char *path)
+{
+    for (HostAttrib *attrib = attribs; attrib != NULL; attrib = attrib->next)
+    {
+        if (strcmp(attrib->path, path) == 0)
+        {
+            return attrib;
+        }
+    }
+    return NULL;
+}
+
+static void set_attrib(const char *path, BYTE value)
+{
+    HostAttrib *attrib = find_attrib(path);
+    if (attrib == NULL)
+    {
+        attrib = calloc(1, sizeof(HostAttrib));
+        snprintf(attrib->path, sizeof(attrib->path), "%s", path);
+        attrib->next = attribs;
+        attribs = attrib;
+    }
+    attrib->attrib = value;
+}
+
+// Removes the attributes of a path and of everything inside it
+static void remove_attribs(const char *path)
+{
+    size_t length = strlen(path);
+    for (HostAttrib **attrib = &attribs; *attrib != NULL;)
+    {
+        if ((strncmp((*attrib)->path, path, length) == 0) && (((*attrib)->path[length] == '\0') || ((*attrib)->path[length] == '/')))
+        {
+            HostAttrib *removed = *attrib;
+            *attrib = removed->next;
+            free(removed);
+        }
+        else
+        {
+            attrib = &(*attrib)->next;
+        }
+    }
+}
+
+static void rename_attribs(const char *old_path, const char *new_path)
+{
+    size_t length = strlen(old_path);
+    for (HostAttrib *attrib = attribs; attrib != NULL; attrib = attrib->next)
+    {
+        if ((strncmp(attrib->path, old_path, length) == 0) && ((attrib->path[length] == '\0') || (attrib->path[length] == '/')))
+        {
+            char renamed[HOST_FF_PATH_MAX];
+            snprintf(renamed, sizeof(renamed), "%s%s", new_path, attrib->path + length);
+            strcpy(attrib->path, renamed);
+        }
+    }
+}
+
+static void fat_datetime(time_t time, WORD *fdate, WORD *ftime)
+{
+    struct tm tm;
+    localtime_r(&time, &tm);
+    if (tm.tm_year < 80)
+    {
+        *fdate = (1 << 5) | 1; // The FAT dates start in 1980
+        *ftime = 0;
+        return;
+    }
+    *fdate = (WORD)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    *ftime = (WORD)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+static void fill_info(const char *path, const char *name, const struct stat *st, FILINFO *fno)
+{
+    const HostAttrib *attrib = find_attrib(path);
+    memset(fno, 0, sizeof(FILINFO));
+    snprintf(fno->fname, sizeof(fno->fname), "%s", name);
+    if (S_ISDIR(st->st_mode))
+    {
+        fno->fattrib = AM_DIR | (attrib != NULL ? attrib->attrib : 0);
+    }
+    else
+    {
+        fno->fattrib = attrib != NULL ? attrib->attrib : AM_ARC;
+        fno->fsize = st->st_size;
+    }
+    fno->fattrib |= (st->st_mode & S_IWUSR) ? 0 : AM_RDO;
+    fat_datetime(st->st_mtime, &fno->fdate, &fno->ftime);
+}
+
+static const FolderListing *list_folder(const char *path)
+{
+    FolderListing *listing = &listings[0];
+    for (int i = 0; i < HOSTFS_CACHED_FOLDERS; i++)
+    {
+        if ((listings[i].generation == generation) && (strcmp(listings[i].path, path) == 0))
+        {
+            listings[i].last_use = ++listing_uses;
+            return &listings[i];
+        }
+        listing = listings[i].last_use < listing->last_use ? &listings[i] : listing;
+    }
+
+    char host_path[HOST_FF_PATH_MAX];
+    host_path_of(path, host_path);
+    HOST_DIR_STREAM *dir = opendir(host_path);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    free(listing->entries);
+    memset(listing, 0, sizeof(FolderListing));
+    uint32_t capacity = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        if ((strcmp(dirent->d_name, ".") == 0) || (strcmp(dirent->d_name, "..") == 0) || (fstatat(dirfd(dir), dirent->d_name, &st, 0) != 0))
+        {
+            continue;
+        }
+        if (listing->count == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            listing->entries = realloc(listing->entries, capacity * sizeof(FILINFO));
+        }
+        char entry_path[HOST_FF_PATH_MAX];
+        snprintf(entry_path, sizeof(entry_path), "%s%s%s", path, path[0] ? "/" : "", dirent->d_name);
+        fill_info(entry_path, dirent->d_name, &st, &listing->entries[listing->count++]);
+    }
+    closedir(dir);
+    if (listing->count > 0)
+    {
+        qsort(listing->entries, listing->count, sizeof(FILINFO), compare_entries);
+    }
+    snprintf(listing->path, sizeof(listing->path), "%s", path);
+    listing->generation = generation;
+    listing->last_use = ++listing_uses;
+    return listing;
+}
+
+static const FILINFO *find_name(const char *folder, const char *name)
+{
+    const FolderListing *listing = list_folder(folder);
+    for (uint32_t i = 0; (listing != NULL) && (i < listing->count); i++)
+    {
+        if (strcasecmp(listing->entries[i].fname, name) == 0)
+        {
+            return &listing->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// The path from the root of a FatFs path, with the case of the names of the card. Only the last name
+// can be missing. info gets the last name if it exists, and its fname is empty otherwise
+static FRESULT resolve(const TCHAR *fatfs_path, char *path, FILINFO *info)
+{
+    if (mounted == NULL)
+    {
+        return FR_NOT_ENABLED;
+    }
+    if (isdigit((unsigned char)fatfs_path[0]) && (fatfs_path[1] == ':'))
+    {
+        if (fatfs_path[0] != '0')
+        {
+            return FR_INVALID_DRIVE;
+        }
+        fatfs_path += 2;
+    }
+    bool absolute = (fatfs_path[0] == '/') || (fatfs_path[0] == '\\');
+    snprintf(path, HOST_FF_PATH_MAX, "%s", absolute ? "" : cwd);
+    memset(info, 0, sizeof(FILINFO));
+    info->fattrib = AM_DIR; // The root
+    bool exists = true;
+    const char *next = fatfs_path;
+    while (*next != '\0')
+    {
+        size_t length = strcspn(next, "/\\");
+        if (length == 0)
+        {
+            next++;
+            continue;
+        }
+        char name[FF_LFN_BUF + 1];
+        if (length > FF_LFN_BUF)
+        {
+            return FR_INVALID_NAME;
+        }
+        memcpy(name, next, length);
+        name[length] = '\0';
+        next += length;
+        if (!exists || !(info->fattrib & AM_DIR))
+        {
+            return FR_NO_PATH;
+        }
+        if (strcmp(name, ".") == 0)
+        {
+            continue;
+        }
+        if (strcmp(name, "..") == 0)
+        {
+            char *slash = strrchr(path, '/');
+            *(slash != NULL ? slash : path) = '\0';
+            continue;
+        }
+        // FatFs ignores the trailing dots and spaces
+        while ((length > 0) && ((name[length - 1] == '.') || (name[length - 1] == ' ')))
+        {
+            name[--length] = '\0';
+        }
+        if ((length == 0) || (strpbrk(name, "\"*:<>?|\x7F") != NULL))
+        {
+            return FR_INVALID_NAME;
+        }
+        const FILINFO *found = find_name(path, name);
+        exists = found != NULL;
+        if (exists)
+        {
+            *info = *found;
+        }
+        else
+        {
+            memset(info, 0, sizeof(FILINFO));
+        }
+        size_t path_length = strlen(path);
+        if (path_length + 1 + length >= HOST_FF_PATH_MAX)
+        {
+            return FR_INVALID_NAME;
+        }
+        snprintf(path + path_length, HOST_FF_PATH_MAX - path_length, "%s%s", path_length > 0 ? "/" : "", exists ? found->fname : name);
+    }
+    return FR_OK;
+}
+
+static bool is_root(const char *path)
+{
+    return path[0] == '\0';
+}
+
+static FRESULT validate_file(const FIL *fp)
+{
+    return ((mounted == NULL) || (fp->obj.fs != mounted) || (fp->host == NULL)) ? FR_INVALID_OBJECT : FR_OK;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    char host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    memset(fp, 0, sizeof(FIL));
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    bool exists = info.fname[0] != '\0';
+    if (is_root(card_path) || (exists && (info.fattrib & AM_DIR)))
+    {
+        return is_root(card_path) ? FR_INVALID_NAME : FR_NO_FILE;
+    }
+    if (exists && (mode & FA_CREATE_NEW))
+    {
+        return FR_EXIST;
+    }
+    if (!exists && !(mode & (FA_CREATE_NEW | FA_CREATE_ALWAYS | FA_OPEN_ALWAYS)))
+    {
+        return FR_NO_FILE;
+    }
+    if (exists && (mode & (FA_WRITE | FA_CREATE_ALWAYS)) && (info.fattrib & AM_RDO))
+    {
+        return FR_DENIED;
+    }
+
+    bool create = !exists || (mode & FA_CREATE_ALWAYS);
+    int flags = ((mode & FA_WRITE) || create) ? O_RDWR : O_RDONLY;
+    flags |= create ? (O_CREAT | O_TRUNC) : 0;
+    host_path_of(card_path, host_path);
+    int fd = open(host_path, flags, 0666);
+    if (fd < 0)
+    {
+        return FR_DENIED;
+    }
+    if (create)
+    {
+        remove_attribs(card_path);
+        generation++;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    HostFile *file = malloc(sizeof(HostFile));
+    file->fd = fd;
+    fp->obj.fs = mounted;
+    fp->obj.objsize = st.st_size;
+    fp->flag = mode;
+    fp->fptr = ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND) ? fp->obj.objsize : 0;
+    fp->host = file;
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    FRESULT fr = validate_file(fp);
+    if (fr == FR_OK)
+    {
+        HostFile *file = fp->host;
+        close(file->fd);
+        free(file);
+        fp->host = NULL;
+        fp->obj.fs = NULL;
+    }
+    return fr;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    *br = 0;
+    FRESULT fr = validate_file(fp);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (!(fp->flag & FA_READ))
+    {
+        return FR_DENIED;
+    }
+    FSIZE_t remaining = fp->fptr < fp->obj.objsize ? fp->obj.objsize - fp->fptr : 0;
+    btr = btr < remaining ? btr : (UINT)remaining;
+    ssize_t bytes = pread(((HostFile *)fp->host)->fd, buff, btr, (off_t)fp->fptr);
+    if (bytes < 0)
+    {
+        return FR_DISK_ERR;
+    }
+    fp->fptr += bytes;
+    *br = (UINT)bytes;
+    return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    *bw = 0;
+    FRESULT fr = validate_file(fp);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (!(fp->flag & FA_WRITE))
+    {
+        return FR_DENIED;
+    }
+    // A short write is a full disk, as in FatFs
+    ssize_t bytes = pwrite(((HostFile *)fp->host)->fd, buff, btw, (off_t)fp->fptr);
+    if (bytes < 0)
+    {
+        return FR_DISK_ERR;
+    }
+    fp->fptr += bytes;
+    fp->obj.objsize = fp->fptr > fp->obj.objsize ? fp->fptr : fp->obj.objsize;
+    *bw = (UINT)bytes;
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    FRESULT fr = validate_file(fp);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (ofs > fp->obj.objsize)
+    {
+        // Only a file open for writing grows
+        if (!(fp->flag & FA_WRITE))
+        {
+            ofs = fp->obj.objsize;
+        }
+        else
+        {
+            if (ftruncate(((HostFile *)fp->host)->fd, (off_t)ofs) != 0)
+            {
+                return FR_DISK_ERR;
+            }
+            fp->obj.objsize = ofs;
+            generation++;
+        }
+    }
+    fp->fptr = ofs;
+    return FR_OK;
+}
+
+FRESULT f_truncate(FIL *fp)
+{
+    FRESULT fr = validate_file(fp);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (!(fp->flag & FA_WRITE))
+    {
+        return FR_DENIED;
+    }
+    if (fp->fptr < fp->obj.objsize)
+    {
+        if (ftruncate(((HostFile *)fp->host)->fd, (off_t)fp->fptr) != 0)
+        {
+            return FR_DISK_ERR;
+        }
+        fp->obj.objsize = fp->fptr;
+        generation++;
+    }
+    return FR_OK;
+}
+
+FRESULT f_sync(FIL *fp)
+{
+    return validate_file(fp);
+}
+
+TCHAR *f_gets(TCHAR *buff, int len, FIL *fp)
+{
+    int count = 0;
+    UINT br;
+    while ((count < len - 1) && (f_read(fp, &buff[count], 1, &br) == FR_OK) && (br == 1))
+    {
+        if (buff[count++] == '\n')
+        {
+            break;
+        }
+    }
+    buff[count] = '\0';
+    return count > 0 ? buff : NULL;
+}
+
+FRESULT f_opendir(DIR *dp, const TCHAR *path)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    dp->obj.fs = NULL;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (!is_root(card_path) && ((info.fname[0] == '\0') || !(info.fattrib & AM_DIR)))
+    {
+        return FR_NO_PATH;
+    }
+    dp->obj.fs = mounted;
+    dp->index = 0;
+    snprintf(dp->path, sizeof(dp->path), "%s", card_path);
+    dp->last[0] = '\0';
+    return FR_OK;
+}
+
+FRESULT f_closedir(DIR *dp)
+{
+    if ((mounted == NULL) || (dp->obj.fs != mounted))
+    {
+        return FR_INVALID_OBJECT;
+    }
+    dp->obj.fs = NULL;
+    return FR_OK;
+}
+
+FRESULT f_readdir(DIR *dp, FILINFO *fno)
+{
+    if ((mounted == NULL) || (dp->obj.fs != mounted))
+    {
+        return FR_INVALID_OBJECT;
+    }
+    if (fno == NULL)
+    {
+        dp->index = 0;
+        dp->last[0] = '\0';
+        return FR_OK;
+    }
+    const FolderListing *listing = list_folder(dp->path);
+    if (listing == NULL)
+    {
+        return FR_DISK_ERR;
+    }
+    uint32_t index = dp->index;
+    if ((dp->last[0] != '\0') && !((index > 0) && (index <= listing->count) && (strcmp(listing->entries[index - 1].fname, dp->last) == 0)))
+    {
+        // The folder changed. Go on after the last name read
+        for (index = 0; (index < listing->count) && (compare_names(listing->entries[index].fname, dp->last) <= 0); index++)
+        {
+        }
+    }
+    if (index >= listing->count)
+    {
+        dp->index = index;
+        fno->fname[0] = '\0';
+        return FR_OK;
+    }
+    *fno = listing->entries[index];
+    snprintf(dp->last, sizeof(dp->last), "%s", fno->fname);
+    dp->index = index + 1;
+    return FR_OK;
+}
+
+// The wildcards of FatFs. ? is any character and * any string. The case is ignored
+static bool pattern_match(const char *pattern, const char *name)
+{
+    while (*pattern != '\0')
+    {
+        if (*pattern == '*')
+        {
+            pattern++;
+            for (const char *rest = name;; rest++)
+            {
+                if (pattern_match(pattern, rest))
+                {
+                    return true;
+                }
+                if (*rest == '\0')
+                {
+                    return false;
+                }
+            }
+        }
+        if ((*name == '\0') || ((*pattern != '?') && (toupper((unsigned char)*pattern) != toupper((unsigned char)*name))))
+        {
+            return false;
+        }
+        pattern++;
+        name++;
+    }
+    return *name == '\0';
+}
+
+FRESULT f_findnext(DIR *dp, FILINFO *fno)
+{
+    FRESULT fr;
+    do
+    {
+        fr = f_readdir(dp, fno);
+    } while ((fr == FR_OK) && (fno->fname[0] != '\0') && (dp->pat != NULL) && !pattern_match(dp->pat, fno->fname));
+    return fr;
+}
+
+FRESULT f_findfirst(DIR *dp, FILINFO *fno, const TCHAR *path, const TCHAR *pattern)
+{
+    dp->pat = pattern;
+    FRESULT fr = f_opendir(dp, path);
+    return fr == FR_OK ? f_findnext(dp, fno) : fr;
+}
+
+FRESULT f_stat(const TCHAR *path, FILINFO *fno)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(card_path))
+    {
+        return FR_INVALID_NAME;
+    }
+    if (info.fname[0] == '\0')
+    {
+        return FR_NO_FILE;
+    }
+    if (fno != NULL)
+    {
+        *fno = info;
+    }
+    return FR_OK;
+}
+
+FRESULT f_mkdir(const TCHAR *path)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    char host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(card_path) || (info.fname[0] != '\0'))
+    {
+        return is_root(card_path) ? FR_INVALID_NAME : FR_EXIST;
+    }
+    host_path_of(card_path, host_path);
+    if (mkdir(host_path, 0777) != 0)
+    {
+        return FR_DENIED;
+    }
+    remove_attribs(card_path);
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_unlink(const TCHAR *path)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    char host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(card_path))
+    {
+        return FR_INVALID_NAME;
+    }
+    if (info.fname[0] == '\0')
+    {
+        return FR_NO_FILE;
+    }
+    if (info.fattrib & AM_RDO)
+    {
+        return FR_DENIED;
+    }
+    host_path_of(card_path, host_path);
+    // A folder that is not empty can't be removed
+    if (((info.fattrib & AM_DIR) ? rmdir(host_path) : unlink(host_path)) != 0)
+    {
+        return FR_DENIED;
+    }
+    remove_attribs(card_path);
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_rename(const TCHAR *path_old, const TCHAR *path_new)
+{
+    char old_path[HOST_FF_PATH_MAX];
+    char new_path[HOST_FF_PATH_MAX];
+    char old_host_path[HOST_FF_PATH_MAX];
+    char new_host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path_old, old_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(old_path))
+    {
+        return FR_INVALID_NAME;
+    }
+    if (info.fname[0] == '\0')
+    {
+        return FR_NO_FILE;
+    }
+    fr = resolve(path_new, new_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(new_path) || (info.fname[0] != '\0'))
+    {
+        return is_root(new_path) ? FR_INVALID_NAME : FR_EXIST;
+    }
+    host_path_of(old_path, old_host_path);
+    host_path_of(new_path, new_host_path);
+    if (rename(old_host_path, new_host_path) != 0)
+    {
+        return FR_DENIED;
+    }
+    rename_attribs(old_path, new_path);
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_chmod(const TCHAR *path, BYTE attr, BYTE mask)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    char host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(card_path))
+    {
+        return FR_INVALID_NAME;
+    }
+    if (info.fname[0] == '\0')
+    {
+        return FR_NO_FILE;
+    }
+    mask &= AM_RDO | AM_HID | AM_SYS | AM_ARC;
+    BYTE attrib = (info.fattrib & ~mask) | (attr & mask);
+    struct stat st;
+    host_path_of(card_path, host_path);
+    stat(host_path, &st);
+    chmod(host_path, (attrib & AM_RDO) ? (st.st_mode & ~0222) : (st.st_mode | S_IWUSR));
+    set_attrib(card_path, attrib & (AM_HID | AM_SYS | AM_ARC));
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_utime(const TCHAR *path, const FILINFO *fno)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    char host_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (is_root(card_path))
+    {
+        return FR_INVALID_NAME;
+    }
+    if (info.fname[0] == '\0')
+    {
+        return FR_NO_FILE;
+    }
+    struct tm tm = {
+        .tm_year = (fno->fdate >> 9) + 80,
+        .tm_mon = ((fno->fdate >> 5) & 0x0F) - 1,
+        .tm_mday = fno->fdate & 0x1F,
+        .tm_hour = fno->ftime >> 11,
+        .tm_min = (fno->ftime >> 5) & 0x3F,
+        .tm_sec = (fno->ftime & 0x1F) * 2,
+        .tm_isdst = -1,
+    };
+    struct timeval times[2] = {{.tv_sec = mktime(&tm)}, {.tv_sec = mktime(&tm)}};
+    host_path_of(card_path, host_path);
+    if (utimes(host_path, times) != 0)
+    {
+        return FR_DENIED;
+    }
+    generation++;
+    return FR_OK;
+}
+
+FRESULT f_chdir(const TCHAR *path)
+{
+    char card_path[HOST_FF_PATH_MAX];
+    FILINFO info;
+    FRESULT fr = resolve(path, card_path, &info);
+    if (fr != FR_OK)
+    {
+        return fr;
+    }
+    if (!is_root(card_path) && ((info.fname[0] == '\0') || !(info.fattrib & AM_DIR)))
+    {
+        return FR_NO_PATH;
+    }
+    strcpy(cwd, card_path);
+    return FR_OK;
+}
+
+FRESULT f_getcwd(TCHAR *buff, UINT len)
+{
+    if (mounted == NULL)
+    {
+        return FR_NOT_ENABLED;
+    }
+    if (strlen(cwd) + 2 > len)
+    {
+        return FR_NOT_ENOUGH_CORE;
+    }
+    snprintf(buff, len, "/%s", cwd);
+    return FR_OK;
+}
+
+static DWORD host_clusters(bool free_only)
+{
+    struct statvfs st;
+    if (statvfs(root, &st) != 0)
+    {
+        return 0;
+    }
+    uint64_t bytes = (uint64_t)(free_only ? st.f_bavail : st.f_blocks) * st.f_frsize;
+    uint64_t clusters = bytes / (HOSTFS_CLUSTER_SECTORS * HOSTFS_SECTOR_SIZE);
+    return clusters < HOSTFS_MAX_CLUSTERS ? (DWORD)clusters : HOSTFS_MAX_CLUSTERS;
+}
+
+FRESULT f_getfree(const TCHAR *path, DWORD *nclst, FATFS **fatfs)
+{
+    (void)path;
+    if (mounted == NULL)
+    {
+        return FR_NOT_ENABLED;
+    }
+    *nclst = host_clusters(true);
+    *fatfs = mounted;
+    return FR_OK;
+}
+
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt)
+{
+    (void)path;
+    if (fs == NULL)
+    {
+        mounted = NULL;
+        return FR_OK;
+    }
+    if ((opt == 1) && (root[0] == '\0'))
+    {
+        return FR_NOT_READY;
+    }
+    // A FAT32 layout for the block arbiter: two FATs after the reserved sectors
+    memset(fs, 0, sizeof(FATFS));
+    fs->fs_type = FS_FAT32;
+    fs->csize = HOSTFS_CLUSTER_SECTORS;
+    fs->n_fatent = host_clusters(false) + 2;
+    fs->fatbase = 32;
+    fs->dirbase = 2;
+    fs->database = fs->fatbase + 2 * ((fs->n_fatent * 4 + HOSTFS_SECTOR_SIZE - 1) / HOSTFS_SECTOR_SIZE);
+    mounted = fs;
+    cwd[0] = '\0';
+    return FR_OK;
+}
+
+FRESULT f_unmount(const TCHAR *path)
+{
+    return f_mount(NULL, path, 0);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    chmod(path, 0777);
+    return remove(path);
+}
+
+static void remove_folder(const char *path)
+{
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+bool host_disk_create(const char *path, uint32_t size_mb)
+{
+    (void)size_mb;
+    host_disk_remove();
+    remove_folder(path);
+    if (mkdir(path, 0777) != 0)
+    {
+        return false;
+    }
+    snprintf(root, sizeof(root), "%s", path);
+    return true;
+}
+
+bool host_disk_open(const char *path)
+{
+    host_disk_eject();
+    struct stat st;
+    if ((stat(path, &st) != 0) || !S_ISDIR(st.st_mode))
+    {
+        return false;
+    }
+    snprintf(root, sizeof(root), "%s", path);
+    return true;
+}
+
+void host_disk_remove(void)
+{
+    if (root[0] != '\0')
+    {
+        remove_folder(root);
+    }
+    host_disk_eject();
+}
+
+void host_disk_eject(void)
+{
+    while (attribs != NULL)
+    {
+        HostAttrib *next = attribs->next;
+        free(attribs);
+        attribs = next;
+    }
+    root[0] = '\0';
+    mounted = NULL;
+    generation++;
+}
+
+// A folder has no sectors. The USB mass storage of the card does not work with this backend
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    (void)pdrv;
+    return STA_NOINIT;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+    (void)pdrv;
+    (void)buff;
+    (void)sector;
+    (void)count;
+    return RES_NOTRDY;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+    (void)pdrv;
+    (void)buff;
+    (void)sector;
+    (void)count;
+    return RES_NOTRDY;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    (void)pdrv;
+    (void)cmd;
+    (void)buff;
+    return RES_NOTRDY;
+}
+
+const char *host_disk_backend(void)
+{
+    return "folder";
+}
@@ -0,0 +1,26 @@
+/**
+ * File: hostftp.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The FTP server of the emulator tests. It is not started, as there is no network
+ * (stubs/hostnet.c). Apart from hostnet.c, so test_ftpserver can link the real ftpserver.c
+ */
+
+#include "ftpserver.h"
+
+void test()
+{
+}
+
+int ftpd_get_max_sessions(void)
+{
+    return 0;
+}
+
+bool ftpd_get_session_stats(int index, FtpSessionStats *stats)
+{
+    (void)index;
+    (void)stats;
+    return false;
+}
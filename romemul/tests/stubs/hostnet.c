@@ -0,0 +1,264 @@
+/**
+ * File: hostnet.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The network of the emulator tests. There is none: the WiFi manager times out at once,
+ * only the IP addresses are resolved and the servers are not started. The emulators go on offline, as
+ * with a WiFi network out of reach
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/network.h"
+#include "memfunc.h"
+#include "wifimgr.h"
+#include "httpd.h"
+#include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+static WifiManagerState wifi_state = WIFI_MANAGER_STOPPED;
+
+WifiScanData wifiScanData;
+
+void wifi_manager_start(char **pass, uint32_t timeout_ms, wifi_manager_callback_t callback, void *arg)
+{
+    (void)pass;
+    (void)timeout_ms;
+    wifi_state = WIFI_MANAGER_TIMEOUT;
+    if (callback != NULL)
+    {
+        callback(wifi_state, arg);
+    }
+}
+
+WifiManagerState wifi_manager_poll()
+{
+    return wifi_state;
+}
+
+void wifi_manager_stop()
+{
+    wifi_state = WIFI_MANAGER_STOPPED;
+}
+
+ConnectionStatus get_network_connection_status()
+{
+    return DISCONNECTED;
+}
+
+void network_poll()
+{
+}
+
+void network_terminate()
+{
+}
+
+void get_connection_data(ConnectionData *connection_data)
+{
+    memset(connection_data, 0, sizeof(ConnectionData));
+}
+
+// The configurator scans, but no network is found
+int network_init(bool force, bool async, char **pass)
+{
+    (void)force;
+    (void)async;
+    (void)pass;
+    return 0;
+}
+
+void network_scan()
+{
+    wifiScanData.count = 0;
+}
+
+uint16_t get_wifi_scan_poll_secs()
+{
+    return WIFI_SCAN_POLL_COUNTER;
+}
+
+// Same as network.c
+void network_swap_auth_data(uint16_t *dest_ptr_word)
+{
+    WifiNetworkAuthInfo *authInfo = (WifiNetworkAuthInfo *)dest_ptr_word;
+    CHANGE_ENDIANESS_BLOCK16(authInfo->ssid, MAX_SSID_LENGTH);
+    CHANGE_ENDIANESS_BLOCK16(authInfo->password, MAX_PASSWORD_LENGTH);
+}
+
+// Same as network.c
+void network_swap_data(uint16_t *dest_ptr_word, uint16_t total_items)
+{
+    WifiNetworkInfo *netInfo = (WifiNetworkInfo *)((char *)(dest_ptr_word) + sizeof(uint32_t));
+    for (uint16_t i = 0; i < total_items; i++)
+    {
+        CHANGE_ENDIANESS_BLOCK16(netInfo[i].ssid, MAX_SSID_LENGTH);
+        CHANGE_ENDIANESS_BLOCK16(netInfo[i].bssid, MAX_BSSID_LENGTH);
+    }
+}
+
+// Same as network.c
+void network_swap_connection_data(uint16_t *dest_ptr_word)
+{
+    CHANGE_ENDIANESS_BLOCK16(dest_ptr_word, sizeof(ConnectionData) - sizeof(uint16_t) * 6);
+}
+
+// The catalogs, the releases and the ROMs of the configurator cannot be downloaded
+err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url)
+{
+    (void)url;
+    *items = NULL;
+    *itemCount = 0;
+    return ERR_CONN;
+}
+
+err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *url)
+{
+    (void)url;
+    *items = NULL;
+    *itemCount = 0;
+    return ERR_CONN;
+}
+
+int get_latest_release(void)
+{
+    return ERR_CONN;
+}
+
+char *get_latest_release_str(void)
+{
+    return "";
+}
+
+int compare_versions(const char *newer_version, const char *current_version)
+{
+    return strcmp(newer_version, current_version);
+}
+
+int download_rom(const char *url, uint32_t rom_load_offset)
+{
+    (void)url;
+    (void)rom_load_offset;
+    return ERR_CONN;
+}
+
+// Same as network.c
+int time_passed(absolute_time_t *t, uint32_t ms)
+{
+    if (t == NULL)
+    {
+        return -1;
+    }
+    absolute_time_t t_now = get_absolute_time();
+    if ((to_us_since_boot(*t) == 0) || (absolute_time_diff_us(*t, t_now) >= (int64_t)ms * 1000))
+    {
+        *t = t_now;
+        return 1;
+    }
+    return 0;
+}
+
+// As lwIP, an address is resolved at once. There is no DNS server for the names
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+    (void)found;
+    (void)callback_arg;
+    unsigned int a, b, c, d;
+    char end;
+    if ((sscanf(hostname, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) == 4) && (a < 256) && (b < 256) && (c < 256) && (d < 256))
+    {
+        addr->addr = a | (b << 8) | (c << 16) | (d << 24);
+        return ERR_OK;
+    }
+    return ERR_ARG;
+}
+
+struct udp_pcb *udp_new_ip_type(u8_t type)
+{
+    (void)type;
+    return NULL;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg)
+{
+    (void)pcb;
+    (void)recv;
+    (void)recv_arg;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, u16_t dst_port)
+{
+    (void)pcb;
+    (void)p;
+    (void)dst_ip;
+    (void)dst_port;
+    return ERR_VAL;
+}
+
+void udp_remove(struct udp_pcb *pcb)
+{
+    (void)pcb;
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+    (void)layer;
+    (void)type;
+    struct pbuf *p = calloc(1, sizeof(struct pbuf) + length);
+    p->payload = p + 1;
+    p->tot_len = length;
+    p->len = length;
+    return p;
+}
+
+// The whole chain, as lwIP frees it when nothing else references it
+u8_t pbuf_free(struct pbuf *p)
+{
+    u8_t count = 0;
+    while (p != NULL)
+    {
+        struct pbuf *next = p->next;
+        free(p);
+        p = next;
+        count++;
+    }
+    return count;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset)
+{
+    if (offset >= p->len)
+    {
+        return 0;
+    }
+    len = len < p->len - offset ? len : p->len - offset;
+    memcpy(dataptr, (const uint8_t *)p->payload + offset, len);
+    return len;
+}
+
+u8_t pbuf_get_at(const struct pbuf *p, u16_t offset)
+{
+    return offset < p->len ? ((const uint8_t *)p->payload)[offset] : 0;
+}
+
+void httpd_server_init(const char *ssi_tags[], size_t num_tags, tSSIHandler ssi_handler_func, const tCGI *cgi_handlers, size_t num_cgi_handlers)
+{
+    (void)ssi_tags;
+    (void)num_tags;
+    (void)ssi_handler_func;
+    (void)cgi_handlers;
+    (void)num_cgi_handlers;
+}
+
+uint32_t httpd_get_upload_count(void)
+{
+    return 0;
+}
+
+void httpd_upload_poll(void)
+{
+}
@@ -0,0 +1,12 @@
+/**
+ * File: hw_config.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the SD card hardware configuration. Nothing is needed from it
+ */
+
+#ifndef HOST_HW_CONFIG_H
+#define HOST_HW_CONFIG_H
+
+#endif // HOST_HW_CONFIG_H
@@ -0,0 +1,139 @@
+/**
+ * File: network.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of network.h. The defaults of the config entries and the calls of the
+ * emulators. The host has no network: stubs/hostnet.c never connects
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+// Same values as include/network.h
+#define WIFI_SCAN_POLL_COUNTER 15
+#define WIFI_SCAN_POLL_COUNTER_STR STRINGIFY(WIFI_SCAN_POLL_COUNTER)
+#define NETWORK_POLL_INTERVAL 5
+#define NETWORK_POLL_INTERVAL_STR STRINGIFY(NETWORK_POLL_INTERVAL)
+#define MAX_SSID_LENGTH 36
+#define MAX_BSSID_LENGTH 20
+#define IPV4_ADDRESS_LENGTH 16
+#define IPV6_ADDRESS_LENGTH 40
+#define MAX_NETWORKS 100
+#define MAX_PASSWORD_LENGTH 68
+#define NETWORK_CONNECTION_ASYNC 1
+#define NETWORK_CONNECTION_SYNC 0
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "httpdl.h"
+
+typedef enum
+{
+    DISCONNECTED,
+    CONNECTING,
+    CONNECTED_WIFI,
+    CONNECTED_WIFI_NO_IP,
+    CONNECTED_WIFI_IP,
+    TIMEOUT_ERROR,
+    GENERIC_ERROR,
+    NO_DATA_ERROR,
+    NOT_PERMITTED_ERROR,
+    INVALID_ARG_ERROR,
+    IO_ERROR,
+    BADAUTH_ERROR,
+    CONNECT_FAILED_ERROR,
+    INSUFFICIENT_RESOURCES_ERROR,
+    NOT_SUPPORTED
+} ConnectionStatus;
+
+typedef struct
+{
+    char ssid[MAX_SSID_LENGTH];
+    char bssid[MAX_BSSID_LENGTH];
+    uint16_t auth_mode;
+    int16_t rssi;
+} WifiNetworkInfo;
+
+typedef struct
+{
+    char ssid[MAX_SSID_LENGTH];
+    char password[MAX_PASSWORD_LENGTH];
+    uint16_t auth_mode;
+} WifiNetworkAuthInfo;
+
+typedef struct
+{
+    uint32_t magic;
+    WifiNetworkInfo networks[MAX_NETWORKS];
+    uint16_t count;
+} WifiScanData;
+
+typedef struct connection_data
+{
+    char ssid[MAX_SSID_LENGTH];
+    char ipv4_address[IPV4_ADDRESS_LENGTH];
+    char ipv6_address[IPV6_ADDRESS_LENGTH];
+    char mac_address[MAX_BSSID_LENGTH];
+    char gw_ipv4_address[IPV4_ADDRESS_LENGTH];
+    char gw_ipv6_address[IPV6_ADDRESS_LENGTH];
+    char netmask_ipv4_address[IPV4_ADDRESS_LENGTH];
+    char netmask_ipv6_address[IPV6_ADDRESS_LENGTH];
+    char dns_ipv4_address[IPV4_ADDRESS_LENGTH];
+    char dns_ipv6_address[IPV6_ADDRESS_LENGTH];
+    char wifi_country[4];
+    uint16_t wifi_auth_mode;
+    uint16_t wifi_scan_interval;
+    uint16_t network_status_poll_interval;
+    uint16_t network_status;
+    uint16_t file_downloading_timeout;
+    int16_t rssi;
+} ConnectionData;
+
+typedef struct
+{
+    char *url;
+    char *name;
+    char *description;
+    char *tags;
+    int size_kb;
+    void *next;
+} RomInfo;
+
+typedef struct
+{
+    char *name;
+    char *status;
+    char *description;
+    char *tags;
+    char *extra;
+    char *url;
+    void *next;
+} FloppyImageInfo;
+
+#include "pico/stdlib.h"
+
+extern WifiScanData wifiScanData;
+
+ConnectionStatus get_network_connection_status();
+void network_swap_auth_data(uint16_t *dest_ptr_word);
+void network_swap_data(uint16_t *dest_ptr_word, uint16_t total_items);
+void network_swap_connection_data(uint16_t *dest_ptr_word);
+void network_scan();
+int network_init(bool force, bool async, char **pass);
+uint16_t get_wifi_scan_poll_secs();
+void network_poll();
+void network_terminate();
+void get_connection_data(ConnectionData *connection_data);
+int time_passed(absolute_time_t *t, uint32_t ms);
+
+err_t get_rom_catalog_file(RomInfo **items, int *itemCount, const char *url);
+int compare_versions(const char *newer_version, const char *current_version);
+int get_latest_release(void);
+char *get_latest_release_str(void);
+int download_rom(const char *url, uint32_t rom_load_offset);
+err_t get_floppy_db_files(FloppyImageInfo **items, int *itemCount, const char *url);
+
+#endif // NETWORK_H
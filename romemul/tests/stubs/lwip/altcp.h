@@ -0,0 +1,42 @@
+/**
+ * File: altcp.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the lwIP application layered TCP. The connection is opaque. The
+ * tests that open connections implement the functions
+ */
+
+#ifndef HOST_LWIP_ALTCP_H
+#define HOST_LWIP_ALTCP_H
+
+#include "lwip/ip_addr.h"
+
+#define LWIP_IANA_PORT_HTTP 80
+#define TCP_WRITE_FLAG_COPY 0x01
+
+// The firmware builds lwIP without LWIP_ALTCP, so an altcp connection is a raw TCP pcb. The tests of
+// the code that uses the raw TCP API define HOST_LWIP_RAW_TCP to get the same
+#ifdef HOST_LWIP_RAW_TCP
+#define altcp_pcb tcp_pcb
+#endif
+
+struct altcp_pcb;
+struct pbuf;
+typedef struct altcp_allocator_s altcp_allocator_t;
+
+typedef err_t (*altcp_recv_fn)(void *arg, struct altcp_pcb *conn, struct pbuf *p, err_t err);
+typedef void (*altcp_err_fn)(void *arg, err_t err);
+typedef err_t (*altcp_connected_fn)(void *arg, struct altcp_pcb *conn, err_t err);
+
+struct altcp_pcb *altcp_new(altcp_allocator_t *allocator);
+void altcp_recv(struct altcp_pcb *conn, altcp_recv_fn recv);
+void altcp_err(struct altcp_pcb *conn, altcp_err_fn err);
+err_t altcp_connect(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port, altcp_connected_fn connected);
+err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags);
+err_t altcp_output(struct altcp_pcb *conn);
+void altcp_recved(struct altcp_pcb *conn, u16_t len);
+err_t altcp_close(struct altcp_pcb *conn);
+void altcp_abort(struct altcp_pcb *conn);
+
+#endif // HOST_LWIP_ALTCP_H
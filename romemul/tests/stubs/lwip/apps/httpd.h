@@ -0,0 +1,35 @@
+/**
+ * File: httpd.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the lwIP HTTP server. The options are the ones of lwipopts.h. The
+ * handlers are only registered: the host has no network
+ */
+
+#ifndef HOST_LWIP_APPS_HTTPD_H
+#define HOST_LWIP_APPS_HTTPD_H
+
+#include "lwip/err.h"
+
+#define LWIP_HTTPD_SSI 1
+#define LWIP_HTTPD_CGI 1
+#define LWIP_HTTPD_SSI_INCLUDE_TAG 0
+#define LWIP_HTTPD_SSI_MULTIPART 1
+#define LWIP_HTTPD_SUPPORT_POST 1
+
+typedef const char *(*tCGIHandler)(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+
+typedef struct
+{
+    const char *pcCGIName;
+    tCGIHandler pfnCGIHandler;
+} tCGI;
+
+typedef u16_t (*tSSIHandler)(int iIndex, char *pcInsert, int iInsertLen, u16_t current_tag_part, u16_t *next_tag_part);
+
+void httpd_init(void);
+void http_set_cgi_handlers(const tCGI *pCGIs, int iNumHandlers);
+void http_set_ssi_handler(tSSIHandler pfnSSIHandler, const char **ppcTags, int iNumTags);
+
+#endif // HOST_LWIP_APPS_HTTPD_H
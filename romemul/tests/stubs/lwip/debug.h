@@ -0,0 +1,15 @@
+/**
+ * File: debug.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the lwIP debug messages. They are off, as in the firmware
+ */
+
+#ifndef HOST_LWIP_DEBUG_H
+#define HOST_LWIP_DEBUG_H
+
+#define LWIP_DEBUGF(debug, message)
+#define LWIP_PLATFORM_DIAG(message)
+
+#endif // HOST_LWIP_DEBUG_H
@@ -0,0 +1,43 @@
+/**
+ * File: ip_addr.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the lwIP IPv4 addresses. As in the firmware, there is no IPv6 and
+ * an ip_addr_t is an IPv4 address
+ */
+
+#ifndef HOST_LWIP_IP_ADDR_H
+#define HOST_LWIP_IP_ADDR_H
+
+#include "lwip/err.h"
+
+struct ip4_addr
+{
+    u32_t addr; // In network order
+};
+
+typedef struct ip4_addr ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+// The tests that bind to any address define it
+extern const ip_addr_t ip_addr_any;
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_ANY 46
+#define IP_ADDR_ANY (&ip_addr_any)
+#define IP_SET_TYPE_VAL(ipaddr, iptype)
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+#define ipaddr_ntoa(ipaddr) "0.0.0.0"
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+    ((ipaddr)->addr = (u32_t)(a) | ((u32_t)(b) << 8) | ((u32_t)(c) << 16) | ((u32_t)(d) << 24))
+#define ip4_addr_copy(dest, src) ((dest).addr = (src).addr)
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
+#define ip4_addr1(ipaddr) ((u8_t)((ipaddr)->addr))
+#define ip4_addr2(ipaddr) ((u8_t)((ipaddr)->addr >> 8))
+#define ip4_addr3(ipaddr) ((u8_t)((ipaddr)->addr >> 16))
+#define ip4_addr4(ipaddr) ((u8_t)((ipaddr)->addr >> 24))
+
+#endif // HOST_LWIP_IP_ADDR_H
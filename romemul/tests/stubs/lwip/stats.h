@@ -0,0 +1,12 @@
+/**
+ * File: stats.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the lwIP statistics. The host tests do not count anything
+ */
+
+#ifndef HOST_LWIP_STATS_H
+#define HOST_LWIP_STATS_H
+
+#endif // HOST_LWIP_STATS_H
@@ -0,0 +1,35 @@
+/**
+ * File: cyw43_arch.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the CYW43 driver. The LED of the config module. The host has no
+ * network to release
+ */
+
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+#include "pico/stdlib.h"
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+static inline void cyw43_arch_gpio_put(uint wl_gpio, bool value)
+{
+    (void)wl_gpio;
+    (void)value;
+}
+
+static inline void cyw43_arch_deinit(void)
+{
+}
+
+static inline void cyw43_arch_lwip_begin(void)
+{
+}
+
+static inline void cyw43_arch_lwip_end(void)
+{
+}
+
+#endif // HOST_PICO_CYW43_ARCH_H
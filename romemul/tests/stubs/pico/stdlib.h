@@ -0,0 +1,90 @@
+/**
+ * File: stdlib.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the Pico SDK for the host tests. Only what the tested modules use
+ */
+
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "host.h"
+
+typedef unsigned int uint;
+
+#define __force_inline inline __attribute__((always_inline))
+#define __not_in_flash_func(func_name) func_name
+#define __dmb() __sync_synchronize()
+#define tight_loop_contents()
+
+#define PPB_BASE 0xE0000000
+#define M0PLUS_VTOR_OFFSET 0x0000ED08
+
+typedef uint64_t absolute_time_t;
+
+#define ABSOLUTE_TIME_INITIALIZED_VAR(name, value) name = value
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+    return t;
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us)
+{
+    return us;
+}
+
+static inline uint64_t time_us_64(void)
+{
+    return host_time_us;
+}
+
+static inline uint32_t time_us_32(void)
+{
+    return (uint32_t)host_time_us;
+}
+
+static inline absolute_time_t get_absolute_time(void)
+{
+    return host_time_us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return host_time_us + (uint64_t)ms * 1000;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+static inline bool is_nil_time(absolute_time_t t)
+{
+    return t == 0;
+}
+
+static inline void stdio_flush(void)
+{
+    fflush(stdout);
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+    host_advance_us((uint64_t)ms * 1000);
+}
+
+static inline int gpio_get(uint gpio)
+{
+    (void)gpio;
+    return 0;
+}
+
+#endif // HOST_PICO_STDLIB_H
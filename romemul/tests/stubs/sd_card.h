@@ -0,0 +1,36 @@
+/**
+ * File: sd_card.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of the SD card driver. One card, always present. The SPI speed is
+ * only recorded
+ */
+
+#ifndef HOST_SD_CARD_H
+#define HOST_SD_CARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t baud_rate;
+} spi_t;
+
+typedef struct
+{
+    spi_t *spi;
+} sd_spi_if_t;
+
+typedef struct
+{
+    sd_spi_if_t *spi_if_p;
+} sd_card_t;
+
+bool sd_init_driver(void);
+size_t sd_get_num(void);
+sd_card_t *sd_get_by_num(size_t num);
+
+#endif // HOST_SD_CARD_H
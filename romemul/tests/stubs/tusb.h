@@ -0,0 +1,80 @@
+/**
+ * File: tusb.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Host stand-in of TinyUSB. The tests call the MSC callbacks as the stack would.
+ * tud_msc_set_sense is implemented by the tests, or by stubs/hostemul.c for the emulators
+ */
+
+#ifndef HOST_TUSB_H
+#define HOST_TUSB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OPT_MCU_HOST 0
+#define CFG_TUSB_MCU OPT_MCU_HOST
+#include "tusb_config.h"
+
+enum
+{
+    SCSI_CMD_TEST_UNIT_READY = 0x00,
+    SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL = 0x1E,
+    SCSI_CMD_READ_10 = 0x28,
+    SCSI_CMD_WRITE_10 = 0x2A,
+};
+
+enum
+{
+    SCSI_SENSE_NONE = 0x00,
+    SCSI_SENSE_NOT_READY = 0x02,
+    SCSI_SENSE_MEDIUM_ERROR = 0x03,
+    SCSI_SENSE_ILLEGAL_REQUEST = 0x05,
+    SCSI_SENSE_UNIT_ATTENTION = 0x06,
+};
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier);
+
+// Callbacks of the MSC class, implemented by the application
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize);
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize);
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size);
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize);
+bool tud_msc_test_unit_ready_cb(uint8_t lun);
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject);
+
+static inline bool tud_init(uint8_t rhport)
+{
+    (void)rhport;
+    return true;
+}
+
+static inline void tud_task(void)
+{
+}
+
+static inline uint32_t tud_cdc_available(void)
+{
+    return 0;
+}
+
+static inline uint32_t tud_cdc_read(void *buffer, uint32_t bufsize)
+{
+    (void)buffer;
+    (void)bufsize;
+    return 0;
+}
+
+static inline uint32_t tud_cdc_write(void const *buffer, uint32_t bufsize)
+{
+    (void)buffer;
+    return bufsize;
+}
+
+static inline uint32_t tud_cdc_write_flush(void)
+{
+    return 0;
+}
+
+#endif // HOST_TUSB_H
@@ -0,0 +1,58 @@
+/**
+ * File: test.h
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Minimal checks for the host tests. A failed check is printed and the test
+ * returns non zero at the end
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++;                                                              \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_EQ_INT(actual, expected)                                                \
+    do                                                                                \
+    {                                                                                 \
+        long long check_actual = (long long)(actual);                                 \
+        long long check_expected = (long long)(expected);                             \
+        if (check_actual != check_expected)                                           \
+        {                                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s is %lld, expected %lld\n",       \
+                    __FILE__, __LINE__, #actual, check_actual, check_expected);       \
+            test_failures++;                                                          \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_EQ_STR(actual, expected)                                                \
+    do                                                                                \
+    {                                                                                 \
+        const char *check_actual = (actual);                                          \
+        const char *check_expected = (expected);                                      \
+        if (strcmp(check_actual, check_expected) != 0)                                \
+        {                                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s is \"%s\", expected \"%s\"\n",   \
+                    __FILE__, __LINE__, #actual, check_actual, check_expected);       \
+            test_failures++;                                                          \
+        }                                                                             \
+    } while (0)
+
+// The exit code of the test
+#define TEST_RESULT() \
+    ((test_failures == 0) ? (printf("OK\n"), 0) : (printf("%d checks failed\n", test_failures), 1))
+
+#endif // TEST_H
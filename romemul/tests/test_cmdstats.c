@@ -0,0 +1,182 @@
+/**
+ * File: test_cmdstats.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The latency statistics of the commands. The times go to the bucket of their power of
+ * two, also across the wrap of the 32 bits timer, a full table drops the new command IDs, and the
+ * table is copied to the shared memory with the longwords swapped, at most once per second
+ */
+
+#include "test.h"
+
+#include "include/cmdstats.h"
+
+#define FIRST_COMMAND 0x0100
+
+static uint32_t unswap(uint32_t value)
+{
+    return SWAP_LONGWORD(value);
+}
+
+// A command answered elapsed_us after its frame was received
+static void record(uint16_t command, uint32_t elapsed_us)
+{
+    cmdstats_record(command, timer_hw->timerawl - elapsed_us);
+}
+
+static const CmdStatsEntry *entry_of(uint16_t command)
+{
+    for (int i = 0; i < cmdstats_size(); i++)
+    {
+        if (cmdstats_get_entry(i)->command == command)
+        {
+            return cmdstats_get_entry(i);
+        }
+    }
+    return NULL;
+}
+
+static void check_buckets(void)
+{
+    CHECK_EQ_INT(cmdstats_bucket_floor_us(0), 0);
+    CHECK_EQ_INT(cmdstats_bucket_floor_us(1), 8);
+    CHECK_EQ_INT(cmdstats_bucket_floor_us(CMDSTATS_BUCKETS - 1), 131072);
+
+    // The floor of each bucket and the time just before it
+    host_set_time_us(5000000);
+    for (int bucket = 1; bucket < CMDSTATS_BUCKETS; bucket++)
+    {
+        record(FIRST_COMMAND + bucket, cmdstats_bucket_floor_us(bucket));
+        record(FIRST_COMMAND + bucket, cmdstats_bucket_floor_us(bucket) - 1);
+        const CmdStatsEntry *entry = entry_of(FIRST_COMMAND + bucket);
+        CHECK(entry != NULL);
+        if (entry == NULL)
+        {
+            continue;
+        }
+        for (int i = 0; i < CMDSTATS_BUCKETS; i++)
+        {
+            CHECK_EQ_INT(entry->buckets[i], (i == bucket) || (i == bucket - 1) ? 1 : 0);
+        }
+    }
+
+    // Zero, and longer than the last floor, go to the ends
+    record(FIRST_COMMAND, 0);
+    record(FIRST_COMMAND, 7);
+    record(FIRST_COMMAND, 10000000);
+    const CmdStatsEntry *entry = entry_of(FIRST_COMMAND);
+    CHECK(entry != NULL);
+    if (entry != NULL)
+    {
+        CHECK_EQ_INT(entry->buckets[0], 2);
+        CHECK_EQ_INT(entry->buckets[CMDSTATS_BUCKETS - 1], 1);
+        CHECK_EQ_INT(entry->count, 3);
+        CHECK_EQ_INT(entry->min_us, 0);
+        CHECK_EQ_INT(entry->max_us, 10000000);
+        CHECK_EQ_INT(entry->total_us, 10000007);
+    }
+}
+
+// The frame arrives before the lower 32 bits of the timer wrap, the answer after
+static void check_timer_wrap(void)
+{
+    host_set_time_us(0x100000000ULL - 20);
+    uint32_t start_us = timer_hw->timerawl;
+    host_advance_us(50);
+    cmdstats_record(FIRST_COMMAND + 0x40, start_us);
+    const CmdStatsEntry *entry = entry_of(FIRST_COMMAND + 0x40);
+    CHECK(entry != NULL);
+    if (entry != NULL)
+    {
+        CHECK_EQ_INT(entry->min_us, 50);
+        CHECK_EQ_INT(entry->max_us, 50);
+        CHECK_EQ_INT(entry->buckets[3], 1);
+    }
+}
+
+// The same command repeated and two alternating: each time counts in its own entry
+static void check_repeated(void)
+{
+    for (int i = 0; i < 100; i++)
+    {
+        record(FIRST_COMMAND + 1 + (i % 2), 20);
+        record(FIRST_COMMAND + 3, 100);
+    }
+    CHECK_EQ_INT(entry_of(FIRST_COMMAND + 1)->count, 2 + 50);
+    CHECK_EQ_INT(entry_of(FIRST_COMMAND + 2)->count, 2 + 50);
+    CHECK_EQ_INT(entry_of(FIRST_COMMAND + 3)->count, 2 + 100);
+}
+
+static void check_full_table(void)
+{
+    int size = cmdstats_size();
+    for (int i = size; i < CMDSTATS_MAX_COMMANDS; i++)
+    {
+        record(0x2000 + i, 10);
+    }
+    CHECK_EQ_INT(cmdstats_size(), CMDSTATS_MAX_COMMANDS);
+    // A new command ID is dropped, the known ones are still counted
+    record(0x3000, 10);
+    record(0x3001, 10);
+    record(FIRST_COMMAND + 3, 100);
+    CHECK_EQ_INT(cmdstats_size(), CMDSTATS_MAX_COMMANDS);
+    CHECK(entry_of(0x3000) == NULL);
+    CHECK_EQ_INT(entry_of(FIRST_COMMAND + 3)->count, 2 + 100 + 1);
+    CHECK(cmdstats_get_entry(-1) == NULL);
+    CHECK(cmdstats_get_entry(CMDSTATS_MAX_COMMANDS) == NULL);
+}
+
+static void check_publish(void)
+{
+    static CmdStatsSharedTable shared;
+    host_advance_us(CMDSTATS_PUBLISH_MS * 1000);
+    cmdstats_publish((uint8_t *)&shared);
+    CHECK_EQ_INT(unswap(shared.size), CMDSTATS_MAX_COMMANDS);
+    CHECK_EQ_INT(unswap(shared.dropped), 2);
+    for (int i = 0; i < CMDSTATS_MAX_COMMANDS; i++)
+    {
+        const CmdStatsEntry *entry = cmdstats_get_entry(i);
+        const CmdStatsSharedEntry *shared_entry = &shared.entries[i];
+        CHECK_EQ_INT(unswap(shared_entry->command), entry->command);
+        CHECK_EQ_INT(unswap(shared_entry->count), entry->count);
+        CHECK_EQ_INT(unswap(shared_entry->min_us), entry->min_us);
+        CHECK_EQ_INT(unswap(shared_entry->avg_us), entry->total_us / entry->count);
+        CHECK_EQ_INT(unswap(shared_entry->max_us), entry->max_us);
+        for (int j = 0; j < CMDSTATS_BUCKETS; j++)
+        {
+            CHECK_EQ_INT(unswap(shared_entry->buckets[j]), entry->buckets[j]);
+        }
+    }
+    const CmdStatsSharedEntry *repeated = &shared.entries[entry_of(FIRST_COMMAND + 3) - cmdstats_get_entry(0)];
+    CHECK_EQ_INT(repeated->count, SWAP_LONGWORD(103));
+
+    // Nothing new: not copied again
+    memset(&shared, 0, sizeof(shared));
+    host_advance_us(CMDSTATS_PUBLISH_MS * 1000);
+    cmdstats_publish((uint8_t *)&shared);
+    CHECK_EQ_INT(shared.size, 0);
+
+    // A new command: copied once, and not again before CMDSTATS_PUBLISH_MS
+    record(FIRST_COMMAND + 3, 100);
+    cmdstats_publish((uint8_t *)&shared);
+    CHECK_EQ_INT(unswap(shared.size), CMDSTATS_MAX_COMMANDS);
+    memset(&shared, 0, sizeof(shared));
+    record(FIRST_COMMAND + 3, 100);
+    host_advance_us(CMDSTATS_PUBLISH_MS * 1000 - 1);
+    cmdstats_publish((uint8_t *)&shared);
+    CHECK_EQ_INT(shared.size, 0);
+    host_advance_us(1);
+    cmdstats_publish((uint8_t *)&shared);
+    CHECK_EQ_INT(unswap(repeated->count), 2 + 100 + 1 + 2);
+}
+
+int main(void)
+{
+    check_buckets();
+    check_timer_wrap();
+    check_repeated();
+    check_full_table();
+    check_publish();
+    return TEST_RESULT();
+}
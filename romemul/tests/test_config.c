@@ -0,0 +1,319 @@
+/**
+ * File: test_config.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The typed config snapshot must always match the ConfigEntry table: after a load,
+ * after each put and after a round trip through the config log in flash
+ */
+
+#include "test.h"
+
+#include "include/config.h"
+
+typedef enum
+{
+    FIELD_BOOL,       // First character 't' or 'T'
+    FIELD_EXACT_BOOL, // Only "true", "TRUE" or "T"
+    FIELD_INT,
+    FIELD_HEX,
+    FIELD_CHAR,      // First character
+    FIELD_NOT_EMPTY, // true if the string is not empty
+    FIELD_BOOT_FEATURE
+} FieldKind;
+
+typedef struct
+{
+    ConfigKeyId key_id;
+    FieldKind kind;
+    size_t offset;
+} SnapshotField;
+
+#define FIELD(key_id, kind, field) {key_id, kind, offsetof(ConfigSnapshot, field)}
+
+// Every field of ConfigSnapshot and the entry it comes from
+static const SnapshotField fields[] = {
+    FIELD(CONFIG_KEY_BOOT_FEATURE, FIELD_BOOT_FEATURE, boot_feature),
+    FIELD(CONFIG_KEY_DELAY_ROM_EMULATION, FIELD_EXACT_BOOL, delay_rom_emulation),
+    FIELD(CONFIG_KEY_SAFE_CONFIG_REBOOT, FIELD_BOOL, safe_config_reboot),
+    FIELD(CONFIG_KEY_FILE_COUNT_ENABLED, FIELD_BOOL, file_count_enabled),
+    FIELD(CONFIG_KEY_DOWNLOAD_TIMEOUT_SEC, FIELD_INT, download_timeout_sec),
+    FIELD(CONFIG_KEY_SD_MASS_STORAGE, FIELD_BOOL, sd_mass_storage),
+    FIELD(CONFIG_KEY_SD_BAUD_RATE_KB, FIELD_INT, sd_baud_rate_kb),
+    FIELD(CONFIG_KEY_FLOPPY_BOOT_ENABLED, FIELD_BOOL, floppy_boot_enabled),
+    FIELD(CONFIG_KEY_FLOPPY_BUFFER_TYPE, FIELD_INT, floppy_buffer_type),
+    FIELD(CONFIG_KEY_FLOPPY_NET_ENABLED, FIELD_BOOL, floppy_net_enabled),
+    FIELD(CONFIG_KEY_FLOPPY_NET_TOUT_SEC, FIELD_INT, floppy_net_tout_sec),
+    FIELD(CONFIG_KEY_FLOPPY_XBIOS_ENABLED, FIELD_BOOL, floppy_xbios_enabled),
+    FIELD(CONFIG_KEY_GEMDRIVE_BUFF_TYPE, FIELD_INT, gemdrive_buff_type),
+    FIELD(CONFIG_KEY_GEMDRIVE_DRIVE, FIELD_CHAR, gemdrive_drive),
+    FIELD(CONFIG_KEY_GEMDRIVE_RTC, FIELD_BOOL, gemdrive_rtc),
+    FIELD(CONFIG_KEY_GEMDRIVE_TIMEOUT_SEC, FIELD_INT, gemdrive_timeout_sec),
+    FIELD(CONFIG_KEY_GEMDRIVE_FAKEFLOPPY, FIELD_BOOL, gemdrive_fakefloppy),
+    FIELD(CONFIG_KEY_RTC_NTP_SERVER_PORT, FIELD_INT, rtc_ntp_server_port),
+    FIELD(CONFIG_KEY_WIFI_SSID, FIELD_NOT_EMPTY, wifi_configured),
+    FIELD(CONFIG_KEY_WIFI_AUTH, FIELD_INT, wifi_auth),
+    FIELD(CONFIG_KEY_WIFI_CONNECT_TIMEOUT, FIELD_INT, wifi_connect_timeout_sec),
+    FIELD(CONFIG_KEY_WIFI_DHCP, FIELD_BOOL, wifi_dhcp),
+    FIELD(CONFIG_KEY_WIFI_POWER, FIELD_HEX, wifi_power),
+    FIELD(CONFIG_KEY_WIFI_RSSI, FIELD_BOOL, wifi_rssi),
+    FIELD(CONFIG_KEY_WIFI_SCAN_SECONDS, FIELD_INT, wifi_scan_seconds),
+    FIELD(CONFIG_KEY_NETWORK_STATUS_SEC, FIELD_INT, network_status_sec),
+};
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+// Values tried for each kind of field
+static const char *bool_values[] = {"true", "false", "TRUE", "FALSE", "T", "F", "True", "trueish", "t", "", "1"};
+static const char *int_values[] = {"0", "1", "45", "-3", "65535", "12abc", "", "x"};
+static const char *hex_values[] = {"0", "a0a0", "FFFFFFFF", "1f", "zz", ""};
+static const char *char_values[] = {"C", "D", "Z", ""};
+static const char *boot_values[] = {"CONFIGURATOR", "ROM_EMULATOR", "FLOPPY_EMULATOR", "RTC_EMULATOR",
+                                    "GEMDRIVE_EMULATOR", "gemdrive_emulator", "ROM_EMULATOR ", ""};
+
+// The value the snapshot must have for a string, written independently of config.c
+static long long expected_value(FieldKind kind, const char *value)
+{
+    switch (kind)
+    {
+    case FIELD_BOOL:
+        return (value[0] == 't') || (value[0] == 'T');
+    case FIELD_EXACT_BOOL:
+        return (strcmp(value, "true") == 0) || (strcmp(value, "TRUE") == 0) || (strcmp(value, "T") == 0);
+    case FIELD_INT:
+        return atoi(value);
+    case FIELD_HEX:
+        return (uint32_t)strtoul(value, NULL, 16);
+    case FIELD_CHAR:
+        return value[0];
+    case FIELD_NOT_EMPTY:
+        return value[0] != '\0';
+    case FIELD_BOOT_FEATURE:
+        if (strcmp(value, "ROM_EMULATOR") == 0)
+            return BOOT_FEATURE_ROM_EMULATOR;
+        if (strcmp(value, "FLOPPY_EMULATOR") == 0)
+            return BOOT_FEATURE_FLOPPY_EMULATOR;
+        if (strcmp(value, "RTC_EMULATOR") == 0)
+            return BOOT_FEATURE_RTC_EMULATOR;
+        if (strcmp(value, "GEMDRIVE_EMULATOR") == 0)
+            return BOOT_FEATURE_GEMDRIVE_EMULATOR;
+        return BOOT_FEATURE_CONFIGURATOR;
+    }
+    return 0;
+}
+
+static long long snapshot_value(const SnapshotField *field)
+{
+    const uint8_t *base = (const uint8_t *)&configSnapshot + field->offset;
+    switch (field->kind)
+    {
+    case FIELD_BOOL:
+    case FIELD_EXACT_BOOL:
+    case FIELD_NOT_EMPTY:
+        return *(const bool *)base;
+    case FIELD_INT:
+        return *(const int *)base;
+    case FIELD_HEX:
+        return *(const uint32_t *)base;
+    case FIELD_CHAR:
+        return *(const char *)base;
+    case FIELD_BOOT_FEATURE:
+        return *(const BootFeature *)base;
+    }
+    return 0;
+}
+
+// Every field of the snapshot against the current entries
+static void check_snapshot(const char *when)
+{
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        const ConfigEntry *entry = find_entry_by_id(fields[i].key_id);
+        long long expected = expected_value(fields[i].kind, entry->value);
+        long long actual = snapshot_value(&fields[i]);
+        if (actual != expected)
+        {
+            fprintf(stderr, "%s: %s=\"%s\" gives %lld in the snapshot, expected %lld\n",
+                    when, entry->key, entry->value, actual, expected);
+            test_failures++;
+        }
+    }
+}
+
+static void values_of_kind(FieldKind kind, const char ***values, size_t *count)
+{
+    switch (kind)
+    {
+    case FIELD_BOOL:
+    case FIELD_EXACT_BOOL:
+        *values = bool_values;
+        *count = sizeof(bool_values) / sizeof(bool_values[0]);
+        break;
+    case FIELD_INT:
+        *values = int_values;
+        *count = sizeof(int_values) / sizeof(int_values[0]);
+        break;
+    case FIELD_HEX:
+        *values = hex_values;
+        *count = sizeof(hex_values) / sizeof(hex_values[0]);
+        break;
+    case FIELD_CHAR:
+    case FIELD_NOT_EMPTY:
+        *values = char_values;
+        *count = sizeof(char_values) / sizeof(char_values[0]);
+        break;
+    case FIELD_BOOT_FEATURE:
+        *values = boot_values;
+        *count = sizeof(boot_values) / sizeof(boot_values[0]);
+        break;
+    }
+}
+
+// Load the config from the flash again, as after a reboot
+static void reload(void)
+{
+    clear_config();
+    memset(&configSnapshot, 0xA5, sizeof(configSnapshot));
+    load_all_entries();
+}
+
+// The put functions take the key as an array of MAX_KEY_LENGTH characters
+static const char *config_key(const char *key)
+{
+    static char buffer[MAX_KEY_LENGTH + 1];
+    memset(buffer, 0, sizeof(buffer));
+    strncpy(buffer, key, MAX_KEY_LENGTH);
+    return buffer;
+}
+
+static int non_default_entries(const ConfigData *defaults)
+{
+    int count = 0;
+    for (int i = 0; i < MAX_ENTRIES; i++)
+    {
+        count += (strcmp(configData.entries[i].value, defaults->entries[i].value) != 0) ? 1 : 0;
+    }
+    return count;
+}
+
+// Many saves of one entry: an append is one page program and no erase. When the sector is full, the
+// compaction erases the next sector once and the reload gives the same entries
+static void check_log_wear(void)
+{
+    host_flash_reset();
+    clear_config();
+    load_all_entries();
+    ConfigData defaults = configData;
+
+    int used_slots = -1; // No log in the flash yet
+    int compactions = 0;
+    int appends = 0;
+    for (int save = 0; save < 5 * (int)CONFIG_LOG_RECORDS_PER_SECTOR; save++)
+    {
+        char value[MAX_STRING_VALUE_LENGTH];
+        snprintf(value, sizeof(value), "sidecart%d", save);
+        put_string(config_key(PARAM_HOSTNAME), value);
+        if (save % 50 == 7)
+        {
+            // Another entry different from the default, so the snapshots grow
+            snprintf(value, sizeof(value), "/roms%d", save);
+            put_string(config_key(PARAM_ROMS_FOLDER), value);
+        }
+        bool full = (used_slots < 0) || (used_slots + 1 + (save % 50 == 7 ? 1 : 0) > (int)CONFIG_LOG_RECORDS_PER_SECTOR);
+        uint32_t erases = host_flash_erases;
+        uint32_t programs = host_flash_programs;
+        CHECK_EQ_INT(write_all_entries(), 0);
+        if (full)
+        {
+            CHECK_EQ_INT(host_flash_erases - erases, 1);
+            compactions++;
+            used_slots = non_default_entries(&defaults);
+            ConfigData saved = configData;
+            reload();
+            check_snapshot("after compaction");
+            for (int i = 0; i < MAX_ENTRIES; i++)
+            {
+                CHECK_EQ_STR(configData.entries[i].value, saved.entries[i].value);
+            }
+        }
+        else
+        {
+            CHECK_EQ_INT(host_flash_erases - erases, 0);
+            CHECK_EQ_INT(host_flash_programs - programs, (save % 50 == 7) ? 1 + (used_slots % CONFIG_LOG_RECORDS_PER_PAGE == CONFIG_LOG_RECORDS_PER_PAGE - 1) : 1);
+            used_slots += 1 + (save % 50 == 7 ? 1 : 0);
+            appends++;
+        }
+    }
+    // The records of the sector are written before the next compaction
+    CHECK(compactions >= 5);
+    CHECK(appends > 4 * (int)CONFIG_LOG_RECORDS_PER_SECTOR);
+    CHECK_EQ_INT(host_flash_erases, compactions);
+    reload();
+    CHECK_EQ_STR(find_entry(PARAM_HOSTNAME)->value, "sidecart239");
+}
+
+int main(void)
+{
+    host_flash_reset();
+
+    // The defaults of an empty flash
+    load_all_entries();
+    check_snapshot("defaults");
+    CHECK_EQ_INT(configSnapshot.boot_feature, BOOT_FEATURE_CONFIGURATOR);
+    CHECK_EQ_INT(configSnapshot.delay_rom_emulation, false);
+    CHECK_EQ_INT(configSnapshot.floppy_boot_enabled, true);
+    CHECK_EQ_INT(configSnapshot.gemdrive_drive, 'C');
+    CHECK_EQ_INT(configSnapshot.network_status_sec, 5);
+    CHECK_EQ_INT(configSnapshot.wifi_scan_seconds, 15);
+    CHECK_EQ_INT(configSnapshot.wifi_configured, false);
+    for (int i = 0; i < MAX_ENTRIES; i++)
+    {
+        CHECK(find_entry(configData.entries[i].key) == find_entry_by_id(i));
+    }
+
+    // Each value of each field. The snapshot follows every put, and the saved config
+    // gives the same snapshot after a reload
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        const char **values;
+        size_t count;
+        values_of_kind(fields[i].kind, &values, &count);
+        char key[MAX_KEY_LENGTH + 1] = {0};
+        strncpy(key, find_entry_by_id(fields[i].key_id)->key, MAX_KEY_LENGTH);
+        for (size_t v = 0; v < count; v++)
+        {
+            put_string(key, values[v]);
+            check_snapshot("after put");
+            CHECK_EQ_INT(snapshot_value(&fields[i]), expected_value(fields[i].kind, values[v]));
+            CHECK_EQ_INT(write_all_entries(), 0);
+            reload();
+            check_snapshot("after reload");
+            CHECK_EQ_STR(find_entry_by_id(fields[i].key_id)->value, values[v]);
+        }
+    }
+
+    // put_bool and put_integer write values that parse back to themselves
+    put_bool(config_key(PARAM_DELAY_ROM_EMULATION), true);
+    put_integer(config_key(PARAM_DOWNLOAD_TIMEOUT_SEC), 123);
+    put_bool(config_key(PARAM_WIFI_DHCP), false);
+    CHECK_EQ_INT(configSnapshot.delay_rom_emulation, true);
+    CHECK_EQ_INT(configSnapshot.download_timeout_sec, 123);
+    CHECK_EQ_INT(configSnapshot.wifi_dhcp, false);
+    CHECK_EQ_INT(write_all_entries(), 0);
+    reload();
+    CHECK_EQ_INT(configSnapshot.delay_rom_emulation, true);
+    CHECK_EQ_INT(configSnapshot.download_timeout_sec, 123);
+    CHECK_EQ_INT(configSnapshot.wifi_dhcp, false);
+    check_snapshot("put_bool and put_integer");
+
+    // Back to the defaults
+    CHECK_EQ_INT(reset_config_default(), 0);
+    check_snapshot("reset");
+    reload();
+    check_snapshot("reset and reload");
+    CHECK_EQ_INT(configSnapshot.boot_feature, BOOT_FEATURE_CONFIGURATOR);
+    CHECK_EQ_INT(configSnapshot.download_timeout_sec, 60);
+
+    check_log_wear();
+
+    return TEST_RESULT();
+}
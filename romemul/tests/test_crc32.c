@@ -0,0 +1,37 @@
+/**
+ * File: test_crc32.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: CRC32 against the check value of the standard and in pieces
+ */
+
+#include "test.h"
+
+#include "include/crc32.h"
+
+int main(void)
+{
+    const uint8_t check[] = "123456789";
+    CHECK_EQ_INT(crc32_update(0, check, 9), 0xCBF43926);
+    CHECK_EQ_INT(crc32_update(0, check, 0), 0);
+
+    // The same CRC fed in pieces of any size
+    uint8_t data[1000];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+    uint32_t whole = crc32_update(0, data, sizeof(data));
+    for (size_t piece = 1; piece < 300; piece += 37)
+    {
+        uint32_t crc = 0;
+        for (size_t offset = 0; offset < sizeof(data); offset += piece)
+        {
+            size_t length = (sizeof(data) - offset < piece) ? sizeof(data) - offset : piece;
+            crc = crc32_update(crc, data + offset, length);
+        }
+        CHECK_EQ_INT(crc, whole);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,467 @@
+/**
+ * File: test_csvtok.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The streaming CSV tokenizer must give the same fields however the network
+ * splits the file. Boundary cases, random splits and the real ROMs catalog
+ */
+
+#include "test.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/csvtok.h"
+
+#define LOG_SIZE (256 * 1024)
+
+// Every callback is written to a log. Two parses are equal if their logs are equal
+typedef struct
+{
+    char *text;
+    size_t length;
+} CallbackLog;
+
+static void log_field(void *arg, uint32_t record, uint16_t field, const char *value)
+{
+    CallbackLog *log = arg;
+    int written = snprintf(log->text + log->length, LOG_SIZE - log->length, "%u.%u=%s|", record, field, value);
+    CHECK(written > 0 && log->length + written < LOG_SIZE);
+    log->length += written;
+}
+
+static void log_record(void *arg, uint32_t record)
+{
+    CallbackLog *log = arg;
+    int written = snprintf(log->text + log->length, LOG_SIZE - log->length, "#%u\n", record);
+    CHECK(written > 0 && log->length + written < LOG_SIZE);
+    log->length += written;
+}
+
+// Parse the input in chunks of the given sizes. A size of 0 means all the rest
+static void parse(CallbackLog *log, char separator, const char *input, size_t length, const size_t *chunks, size_t chunk_count)
+{
+    static CsvTokenizer tokenizer;
+    log->length = 0;
+    log->text[0] = '\0';
+    csv_tokenizer_init(&tokenizer, separator, log_field, log_record, log);
+    size_t offset = 0;
+    for (size_t i = 0; offset < length; i++)
+    {
+        size_t size = (i < chunk_count) && (chunks[i] > 0) ? chunks[i] : length - offset;
+        if (size > length - offset)
+        {
+            size = length - offset;
+        }
+        csv_tokenizer_feed(&tokenizer, input + offset, size);
+        offset += size;
+    }
+    csv_tokenizer_finish(&tokenizer);
+}
+
+static void check_parse(char separator, const char *input, const char *expected)
+{
+    CallbackLog log = {malloc(LOG_SIZE), 0};
+    parse(&log, separator, input, strlen(input), NULL, 0);
+    CHECK_EQ_STR(log.text, expected);
+
+    // One byte at a time
+    size_t ones[1024];
+    for (size_t i = 0; i < sizeof(ones) / sizeof(ones[0]); i++)
+    {
+        ones[i] = 1;
+    }
+    parse(&log, separator, input, strlen(input), ones, sizeof(ones) / sizeof(ones[0]));
+    CHECK_EQ_STR(log.text, expected);
+    free(log.text);
+}
+
+static void check_boundaries(void)
+{
+    check_parse(',', "a,b,c\n", "0.0=a|0.1=b|0.2=c|#0\n");
+    // Missing final new line
+    check_parse(',', "a,b\n1,2", "0.0=a|0.1=b|#0\n1.0=1|1.1=2|#1\n");
+    // CRLF and empty lines
+    check_parse(',', "a,b\r\n\r\n\n1,2\r\n", "0.0=a|0.1=b|#0\n1.0=1|1.1=2|#1\n");
+    // Quoted fields with the separator, new lines and escaped quotes inside
+    check_parse(',', "\"x,y\",\"say \"\"hi\"\"\",\"two\nlines\"\n",
+                "0.0=x,y|0.1=say \"hi\"|0.2=two\nlines|#0\n");
+    // Empty fields, quoted and unquoted
+    check_parse(',', ",\"\",\n", "0.0=|0.1=|0.2=|#0\n");
+    // Characters after the closing quote are ignored
+    check_parse(',', "\"ab\"cd,e\n", "0.0=ab|0.1=e|#0\n");
+    // The quote only starts a quoted field at the beginning
+    check_parse(',', "a\"b,c\n", "0.0=a\"b|0.1=c|#0\n");
+    // Leading blanks are skipped
+    check_parse(',', "  a,\t\"b\"\n", "0.0=a|0.1=b|#0\n");
+    // The separator of the floppy database
+    check_parse(';', "a;b,c;\"d;e\"\n", "0.0=a|0.1=b,c|0.2=d;e|#0\n");
+    // Nothing at all
+    check_parse(',', "", "");
+    check_parse(',', "\n\r\n", "");
+    // A quoted field not closed at the end of the input
+    check_parse(',', "a,\"open", "0.0=a|0.1=open|#0\n");
+
+    // A field longer than the buffer is truncated to 255 characters
+    char input[1024];
+    char expected[1024];
+    memset(input, 'z', 600);
+    strcpy(input + 600, ",next\n");
+    char truncated[CSV_TOKENIZER_MAX_FIELD_LENGTH];
+    memset(truncated, 'z', CSV_TOKENIZER_MAX_FIELD_LENGTH - 1);
+    truncated[CSV_TOKENIZER_MAX_FIELD_LENGTH - 1] = '\0';
+    snprintf(expected, sizeof(expected), "0.0=%s|0.1=next|#0\n", truncated);
+    check_parse(',', input, expected);
+}
+
+// Random files of the troublesome characters, parsed whole and in random chunks
+static void check_random_splits(void)
+{
+    static const char alphabet[] = "ab,;\"\"\r\n \t";
+    CallbackLog whole = {malloc(LOG_SIZE), 0};
+    CallbackLog split = {malloc(LOG_SIZE), 0};
+    char input[2048];
+    size_t chunks[2048];
+
+    srand(20261018);
+    for (int round = 0; round < 2000; round++)
+    {
+        size_t length = rand() % sizeof(input);
+        for (size_t i = 0; i < length; i++)
+        {
+            input[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        size_t chunk_count = 0;
+        for (size_t total = 0; total < length; chunk_count++)
+        {
+            chunks[chunk_count] = 1 + rand() % 64;
+            total += chunks[chunk_count];
+        }
+        char separator = (round & 1) ? ';' : ',';
+        parse(&whole, separator, input, length, NULL, 0);
+        parse(&split, separator, input, length, chunks, chunk_count);
+        if (strcmp(whole.text, split.text) != 0)
+        {
+            fprintf(stderr, "Round %d: the split parse differs\n", round);
+            test_failures++;
+        }
+    }
+    free(whole.text);
+    free(split.text);
+}
+
+// The fields of roms.json, written as CSV as roms/create_roms_csv does
+#define MAX_ROMS 256
+#define ROM_FIELDS 5
+static char *rom_fields[MAX_ROMS][ROM_FIELDS];
+static int rom_count;
+
+static char *json_string(const char *line)
+{
+    const char *start = strchr(strchr(line, ':') + 1, '"') + 1;
+    const char *end = strrchr(line, '"');
+    return strndup(start, end - start);
+}
+
+static bool load_roms_json(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+    char line[1024];
+    bool in_tags = false;
+    char tags[1024] = {0};
+    while (fgets(line, sizeof(line), file) != NULL && rom_count < MAX_ROMS)
+    {
+        char **rom = rom_fields[rom_count];
+        const char *base_url = "http://roms.sidecartridge.com/";
+        if (in_tags)
+        {
+            if (strchr(line, ']') != NULL)
+            {
+                rom[3] = strdup(tags);
+                in_tags = false;
+                continue;
+            }
+            const char *start = strchr(line, '"');
+            if (start == NULL)
+            {
+                continue;
+            }
+            start++;
+            if (tags[0] != '\0')
+            {
+                strcat(tags, "; ");
+            }
+            strncat(tags, start, strrchr(line, '"') - start);
+        }
+        else if (strstr(line, "\"url\":") != NULL)
+        {
+            char *url = json_string(line);
+            if (strncmp(url, base_url, strlen(base_url)) == 0)
+            {
+                memmove(url, url + strlen(base_url), strlen(url) - strlen(base_url) + 1);
+            }
+            rom[0] = url;
+        }
+        else if (strstr(line, "\"name\":") != NULL)
+        {
+            rom[1] = json_string(line);
+        }
+        else if (strstr(line, "\"description\":") != NULL)
+        {
+            rom[2] = json_string(line);
+        }
+        else if (strstr(line, "\"tags\":") != NULL)
+        {
+            tags[0] = '\0';
+            // An empty list fits in one line
+            in_tags = (strchr(line, ']') == NULL);
+            if (!in_tags)
+            {
+                rom[3] = strdup(tags);
+            }
+        }
+        else if (strstr(line, "\"size_kb\":") != NULL)
+        {
+            rom[4] = malloc(16);
+            snprintf(rom[4], 16, "%d", atoi(strchr(line, ':') + 1));
+            rom_count++;
+        }
+    }
+    fclose(file);
+    return rom_count > 0;
+}
+
+// Quote all the fields and end the lines with CRLF, as the python csv module
+static size_t write_csv_field(char *dest, const char *value, bool last)
+{
+    size_t length = 0;
+    dest[length++] = '"';
+    for (const char *c = value; *c != '\0'; c++)
+    {
+        if (*c == '"')
+        {
+            dest[length++] = '"';
+        }
+        dest[length++] = *c;
+    }
+    dest[length++] = '"';
+    if (last)
+    {
+        dest[length++] = '\r';
+        dest[length++] = '\n';
+    }
+    else
+    {
+        dest[length++] = ',';
+    }
+    return length;
+}
+
+typedef struct
+{
+    int matched;
+    int mismatched;
+} RomCheck;
+
+static void check_rom_field(void *arg, uint32_t record, uint16_t field, const char *value)
+{
+    RomCheck *check = arg;
+    // The first record is the header
+    if ((record == 0) || (record > (uint32_t)rom_count) || (field >= ROM_FIELDS))
+    {
+        return;
+    }
+    if (strcmp(value, rom_fields[record - 1][field]) == 0)
+    {
+        check->matched++;
+    }
+    else
+    {
+        fprintf(stderr, "ROM %u field %u is \"%s\", expected \"%s\"\n", record, field, value, rom_fields[record - 1][field]);
+        check->mismatched++;
+    }
+}
+
+// roms.json as the CSV file of the catalog server
+static char *roms_csv(size_t *csv_length)
+{
+    char *csv = malloc(LOG_SIZE);
+    size_t length = 0;
+    static const char *header[ROM_FIELDS] = {"URL", "Name", "Description", "Tags", "Size (KB)"};
+    for (int field = 0; field < ROM_FIELDS; field++)
+    {
+        length += write_csv_field(csv + length, header[field], field == ROM_FIELDS - 1);
+    }
+    for (int rom = 0; rom < rom_count; rom++)
+    {
+        for (int field = 0; field < ROM_FIELDS; field++)
+        {
+            length += write_csv_field(csv + length, rom_fields[rom][field], field == ROM_FIELDS - 1);
+        }
+    }
+    *csv_length = length;
+    return csv;
+}
+
+static void check_roms_catalog(void)
+{
+    CHECK(load_roms_json("../../roms/roms.json"));
+    size_t length;
+    char *csv = roms_csv(&length);
+
+    // The size of the TCP segments changes from one download to another
+    static const size_t segment_sizes[] = {1, 7, 536, 1460, 0};
+    for (size_t s = 0; s < sizeof(segment_sizes) / sizeof(segment_sizes[0]); s++)
+    {
+        RomCheck check = {0};
+        CsvTokenizer tokenizer;
+        csv_tokenizer_init(&tokenizer, ',', check_rom_field, NULL, &check);
+        size_t segment = segment_sizes[s] > 0 ? segment_sizes[s] : length;
+        for (size_t offset = 0; offset < length; offset += segment)
+        {
+            csv_tokenizer_feed(&tokenizer, csv + offset, (length - offset < segment) ? length - offset : segment);
+        }
+        csv_tokenizer_finish(&tokenizer);
+        CHECK_EQ_INT(check.mismatched, 0);
+        CHECK_EQ_INT(check.matched, rom_count * ROM_FIELDS);
+        CHECK_EQ_INT(tokenizer.record, rom_count + 1);
+    }
+    free(csv);
+}
+
+// The parser that the tokenizer replaced: the whole body in one buffer, split in lines with strtok
+// and in fields with next_token, which moves the rest of the line for each escaped quote
+static char *next_token(char **line_ptr)
+{
+    char *line = *line_ptr;
+    if (!line || *line == '\0')
+        return NULL;
+
+    char *token;
+    if (*line == '"')
+    {
+        token = ++line;
+        while (*line && (*line != '"' || *(line + 1) == '"'))
+        {
+            if (*line == '"' && *(line + 1) == '"')
+            {
+                memmove(line, line + 1, strlen(line));
+            }
+            line++;
+        }
+        if (*line == '"')
+        {
+            *line = '\0';
+            line++;
+            if (*line == ',')
+                line++;
+        }
+    }
+    else
+    {
+        token = line;
+        while (*line && *line != ',')
+        {
+            line++;
+        }
+        if (*line)
+        {
+            *line = '\0';
+            line++;
+        }
+    }
+    while (isspace((unsigned char)*line))
+        line++;
+
+    *line_ptr = line;
+    return token;
+}
+
+static int count_fields(char *buffer)
+{
+    int fields = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(buffer, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save))
+    {
+        for (int field = 0; (field < ROM_FIELDS) && (next_token(&line) != NULL); field++)
+        {
+            fields++;
+        }
+    }
+    return fields;
+}
+
+static void count_field(void *arg, uint32_t record, uint16_t field, const char *value)
+{
+    (void)record;
+    (void)field;
+    (void)value;
+    (*(int *)arg)++;
+}
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// The catalog in TCP segments of 1460 bytes, against the parser of the whole body
+static void check_throughput(void)
+{
+    const int rounds = 200;
+    size_t length;
+    char *csv = roms_csv(&length);
+    char *body = malloc(length + 1);
+
+    struct timespec start;
+    int fields = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < rounds; round++)
+    {
+        CsvTokenizer tokenizer;
+        csv_tokenizer_init(&tokenizer, ',', count_field, NULL, &fields);
+        for (size_t offset = 0; offset < length; offset += 1460)
+        {
+            csv_tokenizer_feed(&tokenizer, csv + offset, (length - offset < 1460) ? length - offset : 1460);
+        }
+        csv_tokenizer_finish(&tokenizer);
+    }
+    double stream_s = elapsed_s(&start);
+
+    int baseline_fields = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < rounds; round++)
+    {
+        memcpy(body, csv, length);
+        body[length] = '\0';
+        baseline_fields += count_fields(body);
+    }
+    double baseline_s = elapsed_s(&start);
+
+    double megabytes = (double)length * rounds / (1024 * 1024);
+    printf("Catalog of %zu bytes: tokenizer %.1f MB/s with %zu bytes of state, whole body %.1f MB/s with a %zu bytes buffer\n",
+           length, megabytes / stream_s, sizeof(CsvTokenizer), megabytes / baseline_s, length + 1);
+    CHECK_EQ_INT(fields, rounds * (rom_count + 1) * ROM_FIELDS);
+    CHECK_EQ_INT(baseline_fields, fields);
+    // The RP2040 is about 50 times slower than the host. The catalog must still parse much faster than
+    // it downloads
+    CHECK(megabytes / stream_s > 10.0);
+    free(body);
+    free(csv);
+}
+
+int main(void)
+{
+    check_boundaries();
+    check_random_splits();
+    check_roms_catalog();
+    check_throughput();
+    return TEST_RESULT();
+}
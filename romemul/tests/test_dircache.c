@@ -0,0 +1,203 @@
+/**
+ * File: test_dircache.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The directory listing cache on an SD card. A listing is served from the cache until
+ * it is old or invalidated, stays valid while referenced after it is replaced, and a directory too
+ * big to be cached is not read again until it is old or invalidated
+ */
+
+#include "test.h"
+
+#include "include/dircache.h"
+#include "hostdisk.h"
+
+#define SMALL_FOLDER "/SMALL"
+#define OTHER_FOLDER "/OTHER"
+#define THIRD_FOLDER "/THIRD"
+#define BIG_FOLDER "/BIG"
+#define BIG_FILES 1000 // About 29 bytes each in a listing, more than DIRCACHE_MAX_SIZE
+
+static FATFS fs;
+
+static void create_file(const char *folder, const char *name, uint32_t size)
+{
+    static uint8_t buffer[1024];
+    char path[64];
+    FIL file;
+    UINT written;
+    snprintf(path, sizeof(path), "%s/%s", folder, name);
+    CHECK_EQ_INT(f_open(&file, path, FA_WRITE | FA_CREATE_NEW), FR_OK);
+    CHECK_EQ_INT(f_write(&file, buffer, size, &written), FR_OK);
+    CHECK_EQ_INT(f_close(&file), FR_OK);
+}
+
+static const DirCacheEntry *find_entry(const DirCache *cache, const char *name)
+{
+    for (uint32_t i = 0; i < cache->count; i++)
+    {
+        if (strcmp(dircache_name(cache, i), name) == 0)
+        {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void create_card(void)
+{
+    CHECK(host_disk_create(HOST_DISK_PATH, 64));
+    CHECK_EQ_INT(f_mount(&fs, "0:", 1), FR_OK);
+    CHECK_EQ_INT(f_mkdir(SMALL_FOLDER), FR_OK);
+    CHECK_EQ_INT(f_mkdir(SMALL_FOLDER "/SUB"), FR_OK);
+    create_file(SMALL_FOLDER, "A.TXT", 10);
+    create_file(SMALL_FOLDER, "B.TXT", 1000);
+    CHECK_EQ_INT(f_mkdir(OTHER_FOLDER), FR_OK);
+    CHECK_EQ_INT(f_mkdir(THIRD_FOLDER), FR_OK);
+    CHECK_EQ_INT(f_mkdir(BIG_FOLDER), FR_OK);
+    for (int i = 0; i < BIG_FILES; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "F%04d.DAT", i);
+        create_file(BIG_FOLDER, name, 0);
+    }
+}
+
+static void check_listing(void)
+{
+    DirCache *cache = dircache_get(SMALL_FOLDER);
+    CHECK(cache != NULL);
+    if (cache == NULL)
+    {
+        return;
+    }
+    CHECK_EQ_INT(cache->count, 3);
+    const DirCacheEntry *entry = find_entry(cache, "B.TXT");
+    CHECK(entry != NULL);
+    CHECK(entry != NULL && entry->size == 1000 && !(entry->attrib & AM_DIR));
+    entry = find_entry(cache, "SUB");
+    CHECK(entry != NULL && (entry->attrib & AM_DIR));
+
+    // Served from the cache, also with the path in other case
+    DirCache *again = dircache_get("/small");
+    CHECK(again == cache);
+    CHECK_EQ_INT(cache->refs, 3);
+    dircache_release(again);
+    dircache_release(cache);
+    CHECK_EQ_INT(cache->refs, 1);
+}
+
+// A new file is not seen until the listing is invalidated or old. The replaced listing stays
+// valid for the callers that still hold it
+static void check_invalidate(void)
+{
+    DirCache *old = dircache_get(SMALL_FOLDER);
+    create_file(SMALL_FOLDER, "C.TXT", 20);
+    DirCache *cache = dircache_get(SMALL_FOLDER);
+    CHECK(cache == old);
+    CHECK_EQ_INT(cache->count, 3);
+    dircache_release(cache);
+
+    dircache_invalidate("/Small");
+    cache = dircache_get(SMALL_FOLDER);
+    CHECK(cache != NULL && cache != old);
+    CHECK(cache != NULL && cache->count == 4 && find_entry(cache, "C.TXT") != NULL);
+    CHECK_EQ_INT(old->refs, 1);
+    CHECK_EQ_INT(old->count, 3);
+    CHECK(find_entry(old, "A.TXT") != NULL);
+    dircache_release(old);
+    dircache_release(cache);
+
+    create_file(SMALL_FOLDER, "D.TXT", 30);
+    host_advance_us((uint64_t)DIRCACHE_TTL_MS * 1000 - 1);
+    cache = dircache_get(SMALL_FOLDER);
+    CHECK(cache != NULL && cache->count == 4);
+    dircache_release(cache);
+    host_advance_us(1);
+    cache = dircache_get(SMALL_FOLDER);
+    CHECK(cache != NULL && cache->count == 5);
+    dircache_release(cache);
+}
+
+// With all the slots taken, the oldest listing is replaced
+static void check_eviction(void)
+{
+    dircache_invalidate(NULL);
+    DirCache *small = dircache_get(SMALL_FOLDER);
+    host_advance_us(1000);
+    DirCache *other = dircache_get(OTHER_FOLDER);
+    host_advance_us(1000);
+    DirCache *third = dircache_get(THIRD_FOLDER);
+    CHECK(small != NULL && other != NULL && third != NULL);
+    if ((small == NULL) || (other == NULL) || (third == NULL))
+    {
+        return;
+    }
+    CHECK_EQ_INT(small->refs, 1);
+    CHECK_EQ_INT(other->refs, 2);
+    CHECK_EQ_INT(third->refs, 2);
+    CHECK_EQ_INT(small->count, 5);
+    DirCache *cache = dircache_get(OTHER_FOLDER);
+    CHECK(cache == other);
+    dircache_release(cache);
+    dircache_release(small);
+    dircache_release(other);
+    dircache_release(third);
+}
+
+// A directory too big is remembered: it is not read again, even if it became small, until it
+// is old or invalidated
+static void check_too_big(void)
+{
+    CHECK(dircache_get(BIG_FOLDER) == NULL);
+    for (int i = 1; i < BIG_FILES; i++)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), BIG_FOLDER "/F%04d.DAT", i);
+        CHECK_EQ_INT(f_unlink(path), FR_OK);
+    }
+    CHECK(dircache_get(BIG_FOLDER) == NULL);
+    dircache_invalidate(BIG_FOLDER);
+    DirCache *cache = dircache_get(BIG_FOLDER);
+    CHECK(cache != NULL && cache->count == 1);
+    dircache_release(cache);
+
+    // Big again: remembered until DIRCACHE_TTL_MS
+    for (int i = 1; i < BIG_FILES; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "F%04d.DAT", i);
+        create_file(BIG_FOLDER, name, 0);
+    }
+    dircache_invalidate(BIG_FOLDER);
+    CHECK(dircache_get(BIG_FOLDER) == NULL);
+    CHECK_EQ_INT(f_unlink(BIG_FOLDER "/F0001.DAT"), FR_OK);
+    for (int i = 2; i < BIG_FILES; i++)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), BIG_FOLDER "/F%04d.DAT", i);
+        CHECK_EQ_INT(f_unlink(path), FR_OK);
+    }
+    host_advance_us((uint64_t)DIRCACHE_TTL_MS * 1000 - 1);
+    CHECK(dircache_get(BIG_FOLDER) == NULL);
+    host_advance_us(1);
+    cache = dircache_get(BIG_FOLDER);
+    CHECK(cache != NULL && cache->count == 1);
+    dircache_release(cache);
+
+    // A directory that cannot be read
+    CHECK(dircache_get("/NONE") == NULL);
+}
+
+int main(void)
+{
+    create_card();
+    check_listing();
+    check_invalidate();
+    check_eviction();
+    check_too_big();
+    dircache_invalidate(NULL);
+    host_disk_remove();
+    return TEST_RESULT();
+}
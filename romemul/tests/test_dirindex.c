@@ -0,0 +1,364 @@
+/**
+ * File: test_dirindex.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The folder index on an in-memory FatFs. Folders much bigger than the sort buffer
+ * must be indexed in the same order as a sort in memory, and the pages of a listing must not
+ * scan the folder again
+ */
+
+#include "test.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "include/dirindex.h"
+
+#define FOLDER "/roms"
+#define INDEX_NAME ".sidecart_roms.idx"
+#define FOLDER_MAX_ENTRIES 6000
+#define MAX_FILES 4
+#define PAGE_SIZE 4096
+
+typedef struct
+{
+    char name[FF_LFN_BUF + 1];
+    FSIZE_t size;
+    BYTE attrib;
+} FolderEntry;
+
+typedef struct
+{
+    char path[512];
+    bool exists;
+    uint8_t *data;
+    size_t size;
+} HostFile;
+
+// The only folder, in the order of the directory table
+static FolderEntry folder[FOLDER_MAX_ENTRIES];
+static uint32_t folder_count;
+static HostFile files[MAX_FILES];
+static uint32_t folder_scans;
+static uint32_t index_writes;
+
+static const char *extensions[] = {"img", "bin", "stc"};
+
+int has_allowed_extension(const char *filename, const char **allowed_extensions, size_t num_extensions)
+{
+    const char *dot = strrchr(filename, '.');
+    for (size_t i = 0; (dot != NULL) && (i < num_extensions); i++)
+    {
+        if (strcasecmp(dot + 1, allowed_extensions[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *FRESULT_str(FRESULT i)
+{
+    (void)i;
+    return "error";
+}
+
+static HostFile *find_file(const char *path)
+{
+    for (int i = 0; i < MAX_FILES; i++)
+    {
+        if (files[i].exists && (strcmp(files[i].path, path) == 0))
+        {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+    HostFile *file = find_file(path);
+    if (mode & FA_CREATE_ALWAYS)
+    {
+        for (int i = 0; (file == NULL) && (i < MAX_FILES); i++)
+        {
+            file = files[i].exists ? NULL : &files[i];
+        }
+        snprintf(file->path, sizeof(file->path), "%s", path);
+        file->exists = true;
+        file->size = 0;
+        index_writes++;
+    }
+    if (file == NULL)
+    {
+        return FR_NO_FILE;
+    }
+    fp->host = file;
+    fp->fptr = 0;
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    fp->host = NULL;
+    return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    HostFile *file = fp->host;
+    *br = fp->fptr >= file->size ? 0 : (file->size - fp->fptr < btr ? file->size - fp->fptr : btr);
+    memcpy(buff, file->data + fp->fptr, *br);
+    fp->fptr += *br;
+    return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    HostFile *file = fp->host;
+    if (fp->fptr + btw > file->size)
+    {
+        file->data = realloc(file->data, fp->fptr + btw);
+        if (fp->fptr > file->size)
+        {
+            memset(file->data + file->size, 0, fp->fptr - file->size);
+        }
+        file->size = fp->fptr + btw;
+    }
+    memcpy(file->data + fp->fptr, buff, btw);
+    fp->fptr += btw;
+    *bw = btw;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    fp->fptr = ofs;
+    return FR_OK;
+}
+
+FRESULT f_unlink(const char *path)
+{
+    HostFile *file = find_file(path);
+    if (file == NULL)
+    {
+        return FR_NO_FILE;
+    }
+    file->exists = false;
+    return FR_OK;
+}
+
+static FRESULT read_entry(DIR *dp, FILINFO *fno)
+{
+    if (dp->index >= folder_count)
+    {
+        fno->fname[0] = '\0';
+        return FR_OK;
+    }
+    const FolderEntry *entry = &folder[dp->index++];
+    strcpy(fno->fname, entry->name);
+    fno->fsize = entry->size;
+    fno->fattrib = entry->attrib;
+    fno->fdate = 0x5A21;
+    fno->ftime = 0x6000;
+    return FR_OK;
+}
+
+FRESULT f_findfirst(DIR *dp, FILINFO *fno, const char *path, const char *pattern)
+{
+    (void)pattern;
+    if (strcmp(path, FOLDER) != 0)
+    {
+        return FR_NO_PATH;
+    }
+    folder_scans++;
+    dp->index = 0;
+    return read_entry(dp, fno);
+}
+
+FRESULT f_findnext(DIR *dp, FILINFO *fno)
+{
+    return read_entry(dp, fno);
+}
+
+FRESULT f_closedir(DIR *dp)
+{
+    (void)dp;
+    return FR_OK;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcasecmp(*(const char **)a, *(const char **)b);
+}
+
+// A folder of random names in mixed case. Some entries must not be indexed
+static void make_folder(uint32_t files_count, uint32_t min_length, uint32_t max_length)
+{
+    static const char *all_extensions[] = {".img", ".BIN", ".Stc", ".txt"};
+    memset(folder, 0, sizeof(folder));
+    folder_count = 0;
+    strcpy(folder[folder_count++].name, INDEX_NAME);
+    strcpy(folder[folder_count].name, "subfolder.img");
+    folder[folder_count++].attrib = AM_DIR;
+    strcpy(folder[folder_count++].name, ".hidden.img");
+    for (uint32_t i = 0; i < files_count; i++)
+    {
+        FolderEntry *entry = &folder[folder_count++];
+        uint32_t length = min_length + rand() % (max_length - min_length + 1);
+        // The number keeps the names different without regard to case
+        int pos = snprintf(entry->name, sizeof(entry->name), "%c%05u", 'a' + rand() % 26, i);
+        while (pos < (int)length - 4)
+        {
+            char c = "abcdefghijklmnopqrstuvwxyz0123456789 _-"[rand() % 39];
+            entry->name[pos++] = rand() % 2 ? toupper(c) : c;
+        }
+        strcpy(entry->name + pos, all_extensions[rand() % 4]);
+        entry->size = rand();
+    }
+}
+
+// The names that must be in the index, sorted in memory
+static uint32_t expected_names(const char **names)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < folder_count; i++)
+    {
+        if ((folder[i].name[0] != '.') && !(folder[i].attrib & AM_DIR) &&
+            has_allowed_extension(folder[i].name, extensions, 3))
+        {
+            names[count++] = folder[i].name;
+        }
+    }
+    qsort(names, count, sizeof(char *), compare_names);
+    return count;
+}
+
+// Walk the listing page by page, as the ST does, and compare it with the sorted names
+static void check_listing(const char **names, uint32_t count)
+{
+    static uint8_t memory[PAGE_SIZE];
+    uint32_t first = 0;
+    dirindex_invalidate();
+    do
+    {
+        CHECK(dirindex_refresh(FOLDER, INDEX_NAME, extensions, 3));
+        memset(memory, 0xAA, sizeof(memory));
+        int stored = dirindex_store_page(FOLDER, INDEX_NAME, first, memory, sizeof(memory));
+        DirIndexPage *page = (DirIndexPage *)memory;
+        CHECK_EQ_INT(page->total, count);
+        CHECK_EQ_INT(page->first, first);
+        CHECK_EQ_INT(page->count, stored);
+        if ((stored <= 0) && (first < count))
+        {
+            fprintf(stderr, "Empty page at %u of %u\n", first, count);
+            test_failures++;
+            return;
+        }
+
+        // The names are in Motorola order
+        uint8_t *names_start = memory + sizeof(DirIndexPage);
+        CHANGE_ENDIANESS_BLOCK16(names_start, sizeof(memory) - sizeof(DirIndexPage));
+        const char *name = (const char *)names_start;
+        for (int i = 0; i < stored; i++)
+        {
+            if (strcmp(name, names[first + i]) != 0)
+            {
+                fprintf(stderr, "Name %u is %s, expected %s\n", first + i, name, names[first + i]);
+                test_failures++;
+                return;
+            }
+            name += strlen(name) + 1;
+        }
+        // End of list marker after the last name
+        name += ((uintptr_t)name & 1);
+        CHECK(memcmp(name, "\x00\x00\xFF\xFF", 4) == 0);
+        first += stored;
+    } while (first < count);
+}
+
+static void check_folder(uint32_t files_count, uint32_t min_length, uint32_t max_length)
+{
+    static const char *names[FOLDER_MAX_ENTRIES];
+    make_folder(files_count, min_length, max_length);
+    uint32_t count = expected_names(names);
+
+    folder_scans = 0;
+    index_writes = 0;
+    check_listing(names, count);
+    printf("%u files of %u to %u bytes: %u folder scans\n", count, min_length, max_length, folder_scans);
+    CHECK_EQ_INT(index_writes, 1);
+
+    // Any name can be read
+    for (uint32_t i = 0; i < count; i += 1 + rand() % 50)
+    {
+        char name[FF_LFN_BUF + 1];
+        CHECK(dirindex_get_name(FOLDER, INDEX_NAME, i, name, sizeof(name)));
+        CHECK_EQ_STR(name, names[i]);
+    }
+    char name[FF_LFN_BUF + 1];
+    CHECK(!dirindex_get_name(FOLDER, INDEX_NAME, count, name, sizeof(name)));
+}
+
+// The folder is scanned when a listing starts, not for each page. It is only rebuilt if it changed
+static void check_scans(void)
+{
+    static const char *names[FOLDER_MAX_ENTRIES];
+    make_folder(2000, 20, 60);
+    uint32_t count = expected_names(names);
+    check_listing(names, count);
+
+    folder_scans = 0;
+    index_writes = 0;
+    CHECK(dirindex_refresh(FOLDER, INDEX_NAME, extensions, 3));
+    CHECK_EQ_INT(folder_scans, 0);
+    check_listing(names, count);
+    CHECK_EQ_INT(folder_scans, 1);
+    CHECK_EQ_INT(index_writes, 0);
+
+    // A new file is not in the pages of the listing in progress, only in the next listing
+    FolderEntry *entry = &folder[folder_count++];
+    strcpy(entry->name, "0 new.img");
+    entry->attrib = 0;
+    CHECK(dirindex_refresh(FOLDER, INDEX_NAME, extensions, 3));
+    CHECK_EQ_INT(index_writes, 0);
+    count = expected_names(names);
+    check_listing(names, count);
+    CHECK_EQ_INT(index_writes, 1);
+
+    // A file that changes size changes the signature
+    folder[folder_count / 2].size++;
+    index_writes = 0;
+    check_listing(names, count);
+    CHECK_EQ_INT(index_writes, 1);
+}
+
+// An index of a previous version is built again
+static void check_old_version(void)
+{
+    static const char *names[FOLDER_MAX_ENTRIES];
+    make_folder(100, 10, 30);
+    uint32_t count = expected_names(names);
+    check_listing(names, count);
+    HostFile *file = find_file(FOLDER "/" INDEX_NAME);
+    ((DirIndexHeader *)file->data)->version = 1;
+    index_writes = 0;
+    check_listing(names, count);
+    CHECK_EQ_INT(index_writes, 1);
+}
+
+int main(void)
+{
+    srand(20261018);
+    check_folder(0, 10, 10);
+    check_folder(1, 10, 10);
+    check_folder(150, 8, 40);
+    // Beyond DIRINDEX_SORT_MAX_NAMES names
+    check_folder(3000, 8, 24);
+    // Beyond DIRINDEX_SORT_BUFFER_SIZE bytes, with names up to the longest FatFs name
+    check_folder(1500, 100, FF_LFN_BUF);
+    check_scans();
+    check_old_version();
+    return TEST_RESULT();
+}
@@ -0,0 +1,165 @@
+/**
+ * File: test_dlsink.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The download sink with random pbuf chains. The persisted bytes must be the body in
+ * order, only the staged bytes can be unacknowledged, and a broken download must leave exactly
+ * the prefix that arrived, as the resume of the floppy downloads expects
+ */
+
+#include "test.h"
+
+#include <stdlib.h>
+
+#include "include/dlsink.h"
+
+#define BODY_SIZE 300000
+#define HEADER_SIZE 37
+#define SEGMENT_MAX 1460 // TCP_MSS
+
+static uint8_t body[BODY_SIZE];
+static uint8_t persisted[BODY_SIZE + DOWNLOAD_SINK_SD_BUFFER_SIZE];
+static uint32_t persisted_size;
+static uint32_t acked;
+static uint32_t persist_calls;
+static uint32_t fail_at_call; // 0 to never fail
+
+void tcp_recved(struct altcp_pcb *pcb, uint16_t len)
+{
+    (void)pcb;
+    acked += len;
+}
+
+static bool persist(void *arg, uint8_t *data, uint32_t size)
+{
+    (void)arg;
+    if (++persist_calls == fail_at_call)
+    {
+        return false;
+    }
+    memcpy(persisted + persisted_size, data, size);
+    persisted_size += size;
+    return true;
+}
+
+// Send the stream in chains of one or two random segments, as lwIP delivers them.
+// Returns the largest number of bytes received and not acknowledged
+static uint32_t receive(DownloadSink *sink, const uint8_t *stream, uint32_t length)
+{
+    uint32_t received = 0;
+    uint32_t max_unacked = 0;
+    uint32_t acked_before = acked;
+    while (received < length)
+    {
+        uint16_t first = 1 + rand() % SEGMENT_MAX;
+        uint16_t second = rand() % 2 ? rand() % SEGMENT_MAX : 0;
+        if (received + first + second > length)
+        {
+            first = (length - received) > SEGMENT_MAX ? SEGMENT_MAX : length - received;
+            second = 0;
+        }
+        struct pbuf tail = {NULL, (void *)(stream + received + first), second, second};
+        struct pbuf head = {second > 0 ? &tail : NULL, (void *)(stream + received), (uint16_t)(first + second), first};
+        download_sink_write_pbuf(sink, NULL, &head);
+        received += first + second;
+        uint32_t unacked = received - (acked - acked_before);
+        max_unacked = unacked > max_unacked ? unacked : max_unacked;
+        if (!sink->failed && (received >= HEADER_SIZE) && (unacked != sink->buffer_pos))
+        {
+            fprintf(stderr, "%u bytes unacknowledged with %u staged\n", unacked, sink->buffer_pos);
+            test_failures++;
+        }
+    }
+    return max_unacked;
+}
+
+static void reset(void)
+{
+    persisted_size = 0;
+    acked = 0;
+    persist_calls = 0;
+    fail_at_call = 0;
+}
+
+static void check_whole_body(uint32_t buffer_size, uint32_t align)
+{
+    static uint8_t buffer[DOWNLOAD_SINK_SD_BUFFER_SIZE];
+    DownloadSink sink;
+    reset();
+    download_sink_init(&sink, buffer, buffer_size, persist, NULL);
+    download_sink_skip(&sink, HEADER_SIZE);
+    uint32_t max_unacked = receive(&sink, body, BODY_SIZE);
+    CHECK(download_sink_finish(&sink, align, 0xFF));
+
+    uint32_t size = BODY_SIZE - HEADER_SIZE;
+    CHECK_EQ_INT(sink.persisted, size);
+    CHECK(memcmp(persisted, body + HEADER_SIZE, size) == 0);
+    uint32_t padded = (align > 0) && (size % align != 0) ? size + align - size % align : size;
+    CHECK_EQ_INT(persisted_size, padded);
+    for (uint32_t i = size; i < padded; i++)
+    {
+        CHECK_EQ_INT(persisted[i], 0xFF);
+    }
+    // Whole buffers, except the last one
+    CHECK_EQ_INT(persist_calls, (size + buffer_size - 1) / buffer_size);
+    // The sender can never fill the TCP window with bytes that are not persisted
+    CHECK(max_unacked < buffer_size + 2 * SEGMENT_MAX);
+}
+
+// The connection breaks at a random point. Everything received is persisted in order
+static void check_broken_download(void)
+{
+    static uint8_t buffer[DOWNLOAD_SINK_SD_BUFFER_SIZE];
+    for (int round = 0; round < 50; round++)
+    {
+        DownloadSink sink;
+        reset();
+        download_sink_init(&sink, buffer, sizeof(buffer), persist, NULL);
+        uint32_t cut = rand() % BODY_SIZE;
+        receive(&sink, body, cut);
+        CHECK(download_sink_finish(&sink, 0, 0));
+        CHECK_EQ_INT(sink.persisted, cut);
+        CHECK_EQ_INT(persisted_size, cut);
+        CHECK(memcmp(persisted, body, cut) == 0);
+
+        // The resumed request sends the rest of the body
+        uint32_t resumed = persisted_size;
+        download_sink_init(&sink, buffer, sizeof(buffer), persist, NULL);
+        receive(&sink, body + resumed, BODY_SIZE - resumed);
+        CHECK(download_sink_finish(&sink, 0, 0));
+        CHECK_EQ_INT(persisted_size, BODY_SIZE);
+        CHECK(memcmp(persisted, body, BODY_SIZE) == 0);
+    }
+}
+
+// A failed write stops persisting, but the data keeps being acknowledged so the transfer ends
+static void check_persist_error(void)
+{
+    static uint8_t buffer[DOWNLOAD_SINK_SD_BUFFER_SIZE];
+    DownloadSink sink;
+    reset();
+    fail_at_call = 3;
+    download_sink_init(&sink, buffer, sizeof(buffer), persist, NULL);
+    receive(&sink, body, BODY_SIZE);
+    CHECK(sink.failed);
+    CHECK(!download_sink_finish(&sink, 0, 0));
+    CHECK_EQ_INT(sink.persisted, 2 * sizeof(buffer));
+    CHECK_EQ_INT(persist_calls, 3);
+    CHECK_EQ_INT(acked, BODY_SIZE);
+}
+
+int main(void)
+{
+    srand(20261018);
+    for (uint32_t i = 0; i < BODY_SIZE; i++)
+    {
+        body[i] = rand() & 0xFF;
+    }
+    check_whole_body(DOWNLOAD_SINK_SD_BUFFER_SIZE, 0);
+    check_whole_body(DOWNLOAD_SINK_FLASH_BUFFER_SIZE, 256);
+    check_whole_body(512, 512);
+    check_broken_download();
+    check_persist_error();
+    return TEST_RESULT();
+}
@@ -0,0 +1,260 @@
+/**
+ * File: test_gemdrive.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The GEMDRIVE emulator on the host. The commands are sent as the ST sends them, with
+ * reads of ROM3, and served by gemdrvemul_poll() from a FatFs SD card. The answers are read from the
+ * shared memory. Also the speed of Fsfirst/Fsnext in a big folder and of READ_BUFF
+ */
+
+#include "test.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "gemdrvemul.h"
+#include "hostdisk.h"
+#include "hostemul.h"
+
+#define SHARED(offset) ((volatile uint8_t *)(uintptr_t)(ROM3_START_ADDRESS + (offset)))
+#define FOLDER_FILES 1000
+#define BIG_FILE_SIZE (4 * 1024 * 1024 + 123)
+#define NDTA 0x00012340
+
+static uint32_t next_token = 0x12340000;
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static uint32_t read_swapped_longword(uint32_t offset)
+{
+    uint32_t value = *(volatile uint32_t *)SHARED(offset);
+    return (value << 16) | (value >> 16);
+}
+
+static int16_t read_word(uint32_t offset)
+{
+    return *(volatile int16_t *)SHARED(offset);
+}
+
+// Sends a command as the ST: the header, the command, the size and the payload. The payload starts
+// with the random token and goes on with the arguments of 32 bits, lower word first, and a string with
+// two characters in each word. Then the main loop of the emulator runs until it writes the token
+static void send_command(uint16_t command_id, const uint32_t *args, int args_count, const char *string)
+{
+    uint16_t payload[MAX_PROTOCOL_PAYLOAD_SIZE / 2];
+    uint32_t token = ++next_token;
+    int words = 0;
+    payload[words++] = token >> 16;
+    payload[words++] = token & 0xFFFF;
+    for (int i = 0; i < args_count; i++)
+    {
+        payload[words++] = args[i] & 0xFFFF;
+        payload[words++] = args[i] >> 16;
+    }
+    if (string != NULL)
+    {
+        size_t length = strlen(string) + 1;
+        for (size_t i = 0; i < length; i += 2)
+        {
+            payload[words++] = ((uint16_t)(uint8_t)string[i] << 8) | (i + 1 < length ? (uint8_t)string[i + 1] : 0);
+        }
+    }
+
+    host_rom3_access(PROTOCOL_HEADER, gemdrvemul_dma_irq_handler_lookup_callback);
+    host_rom3_access(command_id, gemdrvemul_dma_irq_handler_lookup_callback);
+    host_rom3_access(words * 2, gemdrvemul_dma_irq_handler_lookup_callback);
+    for (int i = 0; i < words; i++)
+    {
+        host_rom3_access(payload[i], gemdrvemul_dma_irq_handler_lookup_callback);
+    }
+    for (int loop = 0; (loop < 4) && (*(volatile uint32_t *)SHARED(GEMDRVEMUL_RANDOM_TOKEN) != token); loop++)
+    {
+        gemdrvemul_poll();
+    }
+    CHECK_EQ_INT(*(volatile uint32_t *)SHARED(GEMDRVEMUL_RANDOM_TOKEN), token);
+}
+
+// The name in the DTA of the shared memory. The ST reads the bytes of each word swapped
+static void dta_name(char *name)
+{
+    volatile uint8_t *dta_name = SHARED(GEMDRVEMUL_DTA_TRANSFER + 30);
+    for (int i = 0; i < 14; i++)
+    {
+        name[i] = dta_name[i ^ 1];
+    }
+    name[13] = '\0';
+}
+
+static uint32_t dta_length(void)
+{
+    volatile uint16_t *length = (volatile uint16_t *)SHARED(GEMDRVEMUL_DTA_TRANSFER + 26);
+    return ((uint32_t)length[0] << 16) | length[1];
+}
+
+static uint8_t big_file_byte(uint32_t offset)
+{
+    return (uint8_t)((offset * 7) ^ (offset >> 11));
+}
+
+// The card as the ST sees it in the default folder of GEMDRIVE, /hd
+static void create_card(void)
+{
+    static uint8_t buffer[32768];
+    FATFS fs;
+    FIL file;
+    UINT written;
+    char path[64];
+    CHECK(host_disk_create(HOST_DISK_PATH, 64));
+    CHECK_EQ_INT(f_mount(&fs, "0:", 1), FR_OK);
+    CHECK_EQ_INT(f_mkdir("/hd"), FR_OK);
+    CHECK_EQ_INT(f_mkdir("/hd/GAMES"), FR_OK);
+    for (int i = 0; i < FOLDER_FILES; i++)
+    {
+        snprintf(path, sizeof(path), "/hd/GAMES/FILE%04d.PRG", i);
+        CHECK_EQ_INT(f_open(&file, path, FA_WRITE | FA_CREATE_NEW), FR_OK);
+        CHECK_EQ_INT(f_write(&file, buffer, i, &written), FR_OK);
+        CHECK_EQ_INT(f_close(&file), FR_OK);
+    }
+    CHECK_EQ_INT(f_open(&file, "/hd/BIG.DAT", FA_WRITE | FA_CREATE_NEW), FR_OK);
+    for (uint32_t offset = 0; offset < BIG_FILE_SIZE; offset += written)
+    {
+        UINT size = BIG_FILE_SIZE - offset < sizeof(buffer) ? BIG_FILE_SIZE - offset : sizeof(buffer);
+        for (UINT i = 0; i < size; i++)
+        {
+            buffer[i] = big_file_byte(offset + i);
+        }
+        CHECK_EQ_INT(f_write(&file, buffer, size, &written), FR_OK);
+        CHECK_EQ_INT(written, size);
+    }
+    CHECK_EQ_INT(f_close(&file), FR_OK);
+    f_unmount("0:");
+}
+
+static void check_ping(void)
+{
+    host_flash_reset();
+    clear_config();
+    load_all_entries();
+    host_rom_clear();
+    // As main.c before the emulator starts
+    init_protocol_parser();
+    gemdrvemul_setup(false);
+
+    // No card
+    send_command(GEMDRVEMUL_PING, NULL, 0, NULL);
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_PING_STATUS), 0);
+
+    create_card();
+    send_command(GEMDRVEMUL_PING, NULL, 0, NULL);
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_PING_STATUS), 1);
+}
+
+static void check_fsfirst(void)
+{
+    char name[14];
+    char expected[32];
+
+    // All the files of the folder, in order
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t args[] = {NDTA, 0, 0};
+    send_command(GEMDRVEMUL_FSFIRST_CALL, args, 3, "C:\\GAMES\\*.*");
+    int found = 0;
+    while (read_word(GEMDRVEMUL_DTA_F_FOUND) == 0)
+    {
+        dta_name(name);
+        snprintf(expected, sizeof(expected), "FILE%04d.PRG", found);
+        CHECK_EQ_STR(name, expected);
+        CHECK_EQ_INT(dta_length(), found);
+        found++;
+        uint32_t next_args[] = {NDTA};
+        send_command(GEMDRVEMUL_FSNEXT_CALL, next_args, 1, NULL);
+    }
+    double listing_s = elapsed_s(&start);
+    CHECK_EQ_INT(found, FOLDER_FILES);
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_DTA_F_FOUND), GEMDOS_ENMFIL);
+    printf("Fsfirst/Fsnext of %d files on the %s card: %.1f us per file\n", found, host_disk_backend(), listing_s * 1e6 / found);
+    // The RP2040 is about 50 times slower than the host. A folder of the ST must still list in seconds
+    CHECK(listing_s < 1.0);
+
+    // The wildcards of the ST
+    send_command(GEMDRVEMUL_FSFIRST_CALL, args, 3, "\\GAMES\\FILE09??.PRG");
+    for (found = 0; read_word(GEMDRVEMUL_DTA_F_FOUND) == 0; found++)
+    {
+        uint32_t next_args[] = {NDTA};
+        send_command(GEMDRVEMUL_FSNEXT_CALL, next_args, 1, NULL);
+    }
+    CHECK_EQ_INT(found, 100);
+
+    // A folder that is not there
+    send_command(GEMDRVEMUL_FSFIRST_CALL, args, 3, "C:\\NOTHERE\\*.*");
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_DTA_F_FOUND), GEMDOS_EFILNF);
+}
+
+static void check_read_buff(void)
+{
+    uint32_t open_args[] = {0, 0, 0};
+    send_command(GEMDRVEMUL_FOPEN_CALL, open_args, 3, "C:\\BIG.DAT");
+    uint32_t fd = read_swapped_longword(GEMDRVEMUL_FOPEN_HANDLE);
+    CHECK_EQ_INT(fd, FIRST_FILE_DESCRIPTOR);
+
+    // The ST asks for the whole file, and takes it in parts of DEFAULT_FOPEN_READ_BUFFER_SIZE
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t offset = 0;
+    int mismatches = 0;
+    int reads = 0;
+    while (offset < BIG_FILE_SIZE)
+    {
+        uint32_t args[] = {fd, BIG_FILE_SIZE, BIG_FILE_SIZE - offset};
+        send_command(GEMDRVEMUL_READ_BUFF_CALL, args, 3, NULL);
+        uint32_t bytes = read_swapped_longword(GEMDRVEMUL_READ_BYTES);
+        reads++;
+        if ((bytes == 0) || (bytes > DEFAULT_FOPEN_READ_BUFFER_SIZE))
+        {
+            break;
+        }
+        volatile uint8_t *data = SHARED(GEMDRVEMUL_READ_BUFF);
+        for (uint32_t i = 0; i < bytes; i++)
+        {
+            mismatches += data[i ^ 1] != big_file_byte(offset + i);
+        }
+        offset += bytes;
+    }
+    double read_s = elapsed_s(&start);
+    CHECK_EQ_INT(offset, BIG_FILE_SIZE);
+    CHECK_EQ_INT(mismatches, 0);
+    CHECK_EQ_INT(reads, (BIG_FILE_SIZE + DEFAULT_FOPEN_READ_BUFFER_SIZE - 1) / DEFAULT_FOPEN_READ_BUFFER_SIZE);
+    printf("READ_BUFF of %d bytes on the %s card: %.1f MB/s\n", BIG_FILE_SIZE, host_disk_backend(), BIG_FILE_SIZE / (1024.0 * 1024.0) / read_s);
+    CHECK(BIG_FILE_SIZE / (1024.0 * 1024.0) / read_s > 20.0);
+
+    // At the end of the file
+    uint32_t args[] = {fd, 100, 100};
+    send_command(GEMDRVEMUL_READ_BUFF_CALL, args, 3, NULL);
+    CHECK_EQ_INT(read_swapped_longword(GEMDRVEMUL_READ_BYTES), 0);
+
+    uint32_t close_args[] = {fd};
+    send_command(GEMDRVEMUL_FCLOSE_CALL, close_args, 1, NULL);
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_FCLOSE_STATUS), 0);
+
+    // A closed file
+    send_command(GEMDRVEMUL_READ_BUFF_CALL, args, 3, NULL);
+    CHECK_EQ_INT((int32_t)read_swapped_longword(GEMDRVEMUL_READ_BYTES), GEMDOS_EIHNDL);
+    send_command(GEMDRVEMUL_FCLOSE_CALL, close_args, 1, NULL);
+    CHECK_EQ_INT(read_word(GEMDRVEMUL_FCLOSE_STATUS), GEMDOS_EIHNDL);
+}
+
+int main(void)
+{
+    check_ping();
+    check_fsfirst();
+    check_read_buff();
+    host_disk_remove();
+    return TEST_RESULT();
+}
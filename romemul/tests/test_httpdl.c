@@ -0,0 +1,600 @@
+/**
+ * File: test_httpdl.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The range downloads of httpdl.c against a stand-in HTTP server, with connections
+ * reset, closed or stalled in the middle of the body. The downloaded files must be the served file
+ * byte by byte, resumed where the SD card has them, or restarted when the server ignores the range.
+ * The progress file is kept for a broken connection and removed after a refusal of the server
+ */
+
+#include "test.h"
+
+#include <stdlib.h>
+
+#include "hostdisk.h"
+#include "include/httpdl.h"
+
+#define FOLDER "/floppies"
+#define SERVER_ADDRESS 0x0A01A8C0 // 192.168.1.10
+#define URL "http://192.168.1.10/images/DISK.ST"
+#define FILE_SIZE 300001
+#define SEGMENT_MAX 1460   // TCP_MSS
+#define TCP_WINDOW 16384   // TCP_WND of lwipopts.h
+#define POLL_US 10000      // Time of the network stack between two polls
+#define MAX_DROPS 4
+#define MAX_REQUESTS 8
+
+typedef enum
+{
+    SERVE_RANGES,    // 206 with a Content-Range
+    SERVE_WHOLE,     // 200 with the whole file: the Range header is ignored
+    SERVE_NOT_FOUND, // 404
+    SERVE_CHUNKED    // 200 with a chunked body
+} ServerMode;
+
+typedef enum
+{
+    DROP_RESET, // The connection is reset: the error callback, and the pcb is gone
+    DROP_CLOSE, // The server closes the connection before the end of the body
+    DROP_STALL  // The server stops sending
+} DropKind;
+
+// The only connection of the server
+struct altcp_pcb
+{
+    altcp_recv_fn recv;
+    altcp_err_fn err;
+    altcp_connected_fn connected;
+    bool open;
+    bool connecting;
+    bool stalled;
+    char request[512];
+    uint16_t request_length;
+    char header[256];
+    uint32_t header_size;
+    const uint8_t *body;
+    uint32_t start;  // Offset in the file of the first byte of the body
+    uint32_t length; // Header and body
+    uint32_t sent;
+    uint32_t unacked;
+};
+
+static struct
+{
+    const uint8_t *file;
+    uint32_t size;
+    ServerMode mode;
+    uint32_t drops[MAX_DROPS]; // Offsets in the file, in order
+    DropKind drop_kinds[MAX_DROPS];
+    int drop_count;
+    int next_drop;
+    uint32_t ranges[MAX_REQUESTS]; // The first byte of each request
+    int requests;
+    int leaks; // Connections opened when the previous one was still open
+} server;
+
+static struct altcp_pcb connection;
+static FATFS fs;
+static uint8_t file[FILE_SIZE];
+static uint8_t stored[FILE_SIZE + DOWNLOAD_SINK_SD_BUFFER_SIZE];
+
+static const char not_found[] = "<html>Not found</html>";
+
+static void serve(ServerMode mode, const uint8_t *data, uint32_t size)
+{
+    memset(&server, 0, sizeof(server));
+    server.mode = mode;
+    server.file = data;
+    server.size = size;
+}
+
+static void drop_at(uint32_t offset, DropKind kind)
+{
+    server.drops[server.drop_count] = offset;
+    server.drop_kinds[server.drop_count++] = kind;
+}
+
+struct altcp_pcb *altcp_new(altcp_allocator_t *allocator)
+{
+    (void)allocator;
+    server.leaks += connection.open;
+    memset(&connection, 0, sizeof(connection));
+    connection.open = true;
+    return &connection;
+}
+
+void altcp_recv(struct altcp_pcb *conn, altcp_recv_fn recv)
+{
+    conn->recv = recv;
+}
+
+void altcp_err(struct altcp_pcb *conn, altcp_err_fn err)
+{
+    conn->err = err;
+}
+
+err_t altcp_connect(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port, altcp_connected_fn connected)
+{
+    CHECK_EQ_INT(ipaddr->addr, SERVER_ADDRESS);
+    CHECK_EQ_INT(port, 80);
+    conn->connected = connected;
+    conn->connecting = true;
+    return ERR_OK;
+}
+
+err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t apiflags)
+{
+    // The request is on the stack of the caller: it must be copied
+    CHECK_EQ_INT(apiflags & TCP_WRITE_FLAG_COPY, TCP_WRITE_FLAG_COPY);
+    if (conn->request_length + len >= sizeof(conn->request))
+    {
+        return ERR_MEM;
+    }
+    memcpy(conn->request + conn->request_length, dataptr, len);
+    conn->request_length += len;
+    conn->request[conn->request_length] = '\0';
+    return ERR_OK;
+}
+
+err_t altcp_output(struct altcp_pcb *conn)
+{
+    (void)conn;
+    return ERR_OK;
+}
+
+void altcp_recved(struct altcp_pcb *conn, u16_t len)
+{
+    conn->unacked -= len;
+}
+
+void tcp_recved(struct altcp_pcb *pcb, uint16_t len)
+{
+    altcp_recved(pcb, len);
+}
+
+err_t altcp_close(struct altcp_pcb *conn)
+{
+    conn->open = false;
+    return ERR_OK;
+}
+
+void altcp_abort(struct altcp_pcb *conn)
+{
+    conn->open = false;
+}
+
+// The answer of the server to the request received
+static void answer(struct altcp_pcb *conn)
+{
+    char *range = strstr(conn->request, "\r\nRange: bytes=");
+    CHECK(strncmp(conn->request, "GET /images/DISK.", strlen("GET /images/DISK.")) == 0);
+    CHECK(strstr(conn->request, " HTTP/1.0\r\nUser-Agent: ") != NULL);
+    CHECK(strstr(conn->request, "\r\n\r\n") == conn->request + conn->request_length - 4);
+    uint32_t offset = range != NULL ? strtoul(range + strlen("\r\nRange: bytes="), NULL, 10) : 0;
+    if (server.requests < MAX_REQUESTS)
+    {
+        server.ranges[server.requests++] = offset;
+    }
+    conn->body = server.file;
+    switch (server.mode)
+    {
+    case SERVE_RANGES:
+        conn->start = offset;
+        conn->header_size = snprintf(conn->header, sizeof(conn->header),
+                                     "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                                     "Content-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\n\r\n",
+                                     server.size - offset, offset, server.size - 1, server.size);
+        break;
+    case SERVE_WHOLE:
+        conn->header_size = snprintf(conn->header, sizeof(conn->header),
+                                     "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %u\r\n\r\n", server.size);
+        break;
+    case SERVE_NOT_FOUND:
+        conn->body = (const uint8_t *)not_found;
+        conn->header_size = snprintf(conn->header, sizeof(conn->header),
+                                     "HTTP/1.0 404 Not Found\r\nContent-Length: %zu\r\n\r\n", strlen(not_found));
+        break;
+    case SERVE_CHUNKED:
+        conn->header_size = snprintf(conn->header, sizeof(conn->header),
+                                     "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        break;
+    }
+    uint32_t body_size = server.mode == SERVE_NOT_FOUND ? strlen(not_found) : server.size - conn->start;
+    conn->length = conn->header_size + body_size;
+}
+
+// One step of the network stack: the connection, or the next segment of the response. A segment
+// of random size can end in the middle of the header, and stops at the next drop
+void network_safe_poll()
+{
+    struct altcp_pcb *conn = &connection;
+    host_advance_us(POLL_US);
+    if (!conn->open || conn->stalled)
+    {
+        return;
+    }
+    if (conn->connecting)
+    {
+        conn->connecting = false;
+        if (conn->connected(NULL, conn, ERR_OK) == ERR_OK)
+        {
+            answer(conn);
+        }
+        return;
+    }
+    if (conn->sent == conn->length)
+    {
+        conn->recv(NULL, conn, NULL, ERR_OK);
+        return;
+    }
+    uint32_t size = 1 + rand() % SEGMENT_MAX;
+    size = size < conn->length - conn->sent ? size : conn->length - conn->sent;
+    size = size < TCP_WINDOW - conn->unacked ? size : TCP_WINDOW - conn->unacked;
+    if (size == 0)
+    {
+        // The window is closed until the receiver acknowledges the data
+        return;
+    }
+    bool drop = false;
+    if (server.next_drop < server.drop_count)
+    {
+        uint32_t drop_pos = conn->header_size + server.drops[server.next_drop] - conn->start;
+        if ((drop_pos >= conn->sent) && (drop_pos <= conn->sent + size))
+        {
+            size = drop_pos - conn->sent;
+            drop = true;
+        }
+    }
+    if (size > 0)
+    {
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, size, PBUF_RAM);
+        for (uint32_t i = 0; i < size; i++)
+        {
+            uint32_t pos = conn->sent + i;
+            ((uint8_t *)p->payload)[i] = pos < conn->header_size ? conn->header[pos] : conn->body[conn->start + pos - conn->header_size];
+        }
+        conn->sent += size;
+        conn->unacked += size;
+        if ((conn->recv(NULL, conn, p, ERR_OK) != ERR_OK) || !conn->open)
+        {
+            return;
+        }
+    }
+    if (drop)
+    {
+        switch (server.drop_kinds[server.next_drop++])
+        {
+        case DROP_RESET:
+            conn->open = false;
+            conn->err(NULL, ERR_RST);
+            break;
+        case DROP_CLOSE:
+            conn->recv(NULL, conn, NULL, ERR_OK);
+            break;
+        case DROP_STALL:
+            conn->stalled = true;
+            break;
+        }
+    }
+}
+
+static uint32_t stored_size;
+
+static bool store(void *arg, uint8_t *data, uint32_t size)
+{
+    (void)arg;
+    memcpy(stored + stored_size, data, size);
+    stored_size += size;
+    return true;
+}
+
+static int restarts;
+
+static void restart(void)
+{
+    // Before the first byte of the body
+    CHECK_EQ_INT(stored_size, 0);
+    restarts++;
+}
+
+// http_get_range to the stored buffer. Returns the error, and the bytes stored in stored_size
+static err_t get_range(uint32_t offset, uint32_t *total_length)
+{
+    static uint8_t buffer[DOWNLOAD_SINK_SD_BUFFER_SIZE];
+    DownloadSink sink;
+    stored_size = 0;
+    restarts = 0;
+    *total_length = 0;
+    download_sink_init(&sink, buffer, sizeof(buffer), store, NULL);
+    err_t err = http_get_range("192.168.1.10", "/images/DISK.ST", offset, &sink, restart, total_length);
+    CHECK(download_sink_finish(&sink, 0, 0));
+    // No connection is left open
+    CHECK(!connection.open);
+    return err;
+}
+
+static bool stored_is(const uint8_t *data, uint32_t size)
+{
+    return (stored_size == size) && (memcmp(stored, data, size) == 0);
+}
+
+// Reads a whole file. Returns the size, or -1 if the file is not there
+static int32_t read_file(const char *path, uint8_t *data, uint32_t max_size)
+{
+    FIL f;
+    UINT read;
+    if (f_open(&f, path, FA_READ) != FR_OK)
+    {
+        return -1;
+    }
+    CHECK_EQ_INT(f_read(&f, data, max_size, &read), FR_OK);
+    CHECK_EQ_INT(f_close(&f), FR_OK);
+    return (int32_t)read;
+}
+
+static bool downloaded_is(const char *path, const uint8_t *data, uint32_t size)
+{
+    int32_t read = read_file(path, stored, sizeof(stored));
+    return (read == (int32_t)size) && (memcmp(stored, data, size) == 0);
+}
+
+static bool read_progress(DownloadResumeInfo *info)
+{
+    return read_file(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, (uint8_t *)info, sizeof(*info)) == sizeof(*info);
+}
+
+static void check_ranges(const uint32_t *expected, int count)
+{
+    CHECK_EQ_INT(server.requests, count);
+    for (int i = 0; (i < count) && (i < server.requests); i++)
+    {
+        CHECK_EQ_INT(server.ranges[i], expected[i]);
+    }
+}
+
+static void check_parse_headers(void)
+{
+    HttpRangeResponse response;
+    char partial[] = "HTTP/1.1 206 Partial Content\r\nContent-Length: 1000\r\nCONTENT-RANGE: bytes 500-1499/1500\r\n\r\n";
+    CHECK(http_range_parse_headers(partial, 500, &response));
+    CHECK_EQ_INT(response.status, 206);
+    CHECK(!response.restart);
+    CHECK_EQ_INT(response.total_length, 1500);
+    CHECK_EQ_INT(response.error, ERR_OK);
+
+    // Without the Content-Range, the total is the offset and the length of the body
+    char no_range[] = "HTTP/1.1 206 Partial Content\r\nContent-Length: 1000\r\n\r\n";
+    CHECK(http_range_parse_headers(no_range, 500, &response));
+    CHECK_EQ_INT(response.total_length, 1500);
+
+    // The whole file when a range was asked: restart
+    char whole[] = "HTTP/1.0 200 OK\r\ncontent-length: 1500\r\n\r\n";
+    CHECK(http_range_parse_headers(whole, 500, &response));
+    CHECK(response.restart);
+    CHECK_EQ_INT(response.total_length, 1500);
+    char first[] = "HTTP/1.0 200 OK\r\nContent-Length: 1500\r\n\r\n";
+    CHECK(http_range_parse_headers(first, 0, &response));
+    CHECK(!response.restart);
+
+    // A chunked body is refused. The word in another header is not the encoding
+    char chunked[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n";
+    CHECK(!http_range_parse_headers(chunked, 0, &response));
+    CHECK_EQ_INT(response.error, ERR_VAL);
+    char identity[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: identity\r\nX-Note: chunked\r\nContent-Length: 10\r\n\r\n";
+    CHECK(http_range_parse_headers(identity, 0, &response));
+    CHECK_EQ_INT(response.total_length, 10);
+
+    char missing[] = "HTTP/1.0 404 Not Found\r\n\r\n";
+    CHECK(!http_range_parse_headers(missing, 0, &response));
+    CHECK_EQ_INT(response.status, 404);
+    CHECK_EQ_INT(response.error, (err_t)404);
+    char garbage[] = "garbage\r\n\r\n";
+    CHECK(!http_range_parse_headers(garbage, 0, &response));
+    CHECK_EQ_INT(response.error, ERR_VAL);
+}
+
+static void check_get_range(void)
+{
+    uint32_t total_length;
+
+    serve(SERVE_WHOLE, file, FILE_SIZE);
+    CHECK_EQ_INT(get_range(0, &total_length), ERR_OK);
+    CHECK(stored_is(file, FILE_SIZE));
+    CHECK_EQ_INT(total_length, FILE_SIZE);
+    CHECK_EQ_INT(restarts, 0);
+
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    CHECK_EQ_INT(get_range(123457, &total_length), ERR_OK);
+    CHECK(stored_is(file + 123457, FILE_SIZE - 123457));
+    CHECK_EQ_INT(total_length, FILE_SIZE);
+    CHECK_EQ_INT(server.ranges[0], 123457);
+
+    // The range is ignored: the whole file after a restart
+    serve(SERVE_WHOLE, file, FILE_SIZE);
+    CHECK_EQ_INT(get_range(5000, &total_length), ERR_OK);
+    CHECK(stored_is(file, FILE_SIZE));
+    CHECK_EQ_INT(restarts, 1);
+
+    // Refused: nothing of the body is stored
+    serve(SERVE_NOT_FOUND, file, FILE_SIZE);
+    CHECK_EQ_INT(get_range(0, &total_length), (err_t)404);
+    CHECK_EQ_INT(stored_size, 0);
+    serve(SERVE_CHUNKED, file, FILE_SIZE);
+    CHECK_EQ_INT(get_range(0, &total_length), ERR_VAL);
+    CHECK_EQ_INT(stored_size, 0);
+
+    // Broken connections: exactly the bytes before the drop
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    drop_at(50000, DROP_RESET);
+    CHECK_EQ_INT(get_range(0, &total_length), ERR_RST);
+    CHECK(stored_is(file, 50000));
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    drop_at(60000, DROP_CLOSE);
+    CHECK_EQ_INT(get_range(10000, &total_length), ERR_OK);
+    CHECK(stored_is(file + 10000, 50000));
+    CHECK_EQ_INT(total_length, FILE_SIZE);
+
+    // A stalled server times out when no data arrives for DOWNLOAD_FILES_TIMEOUT seconds
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    drop_at(70000, DROP_STALL);
+    uint64_t start = time_us_64();
+    CHECK_EQ_INT(get_range(0, &total_length), ERR_TIMEOUT);
+    CHECK(stored_is(file, 70000));
+    CHECK(time_us_64() - start > DOWNLOAD_FILES_TIMEOUT * 1000000ULL);
+
+    CHECK_EQ_INT(server.leaks, 0);
+}
+
+static void check_download_resumed(void)
+{
+    // A reset and an early close: resumed in the same call, where each connection stopped
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    drop_at(100000, DROP_RESET);
+    drop_at(200000, DROP_CLOSE);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), ERR_OK);
+    CHECK(downloaded_is(FOLDER "/DISK.ST", file, FILE_SIZE));
+    static const uint32_t resumed[] = {0, 100000, 200000};
+    check_ranges(resumed, 3);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+
+    // The server ignores the range: the file starts again
+    serve(SERVE_WHOLE, file, FILE_SIZE);
+    drop_at(150000, DROP_RESET);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), ERR_OK);
+    CHECK(downloaded_is(FOLDER "/DISK.ST", file, FILE_SIZE));
+    static const uint32_t restarted[] = {0, 150000};
+    check_ranges(restarted, 2);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+    CHECK_EQ_INT(server.leaks, 0);
+}
+
+// All the attempts of a call are broken. The progress is kept, and resumed by the next call
+static void check_download_interrupted(void)
+{
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    drop_at(70000, DROP_RESET);
+    drop_at(140000, DROP_CLOSE);
+    drop_at(210000, DROP_STALL);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), ERR_TIMEOUT);
+    DownloadResumeInfo info;
+    CHECK(read_progress(&info));
+    CHECK_EQ_INT(info.magic, DOWNLOAD_RESUME_MAGIC);
+    CHECK_EQ_INT(info.total_length, FILE_SIZE);
+    CHECK_EQ_INT(info.persisted, 210000);
+    CHECK(downloaded_is(FOLDER "/DISK.ST", file, 210000));
+
+    // Another URL does not resume the file, and does not replace it without the overwrite
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    CHECK_EQ_INT(download_floppy("http://192.168.1.10/images/OTHER.ST", FOLDER, "DISK.ST", false, false), FR_FILE_EXISTS);
+    CHECK_EQ_INT(server.requests, 0);
+
+    // The same URL resumes at the saved progress, even without the overwrite
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", false, false), ERR_OK);
+    CHECK(downloaded_is(FOLDER "/DISK.ST", file, FILE_SIZE));
+    static const uint32_t resumed[] = {210000};
+    check_ranges(resumed, 1);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+    CHECK_EQ_INT(server.leaks, 0);
+}
+
+// A refusal of the server leaves nothing: neither the partial file nor the progress
+static void check_download_refused(void)
+{
+    serve(SERVE_NOT_FOUND, file, FILE_SIZE);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), (err_t)404);
+    CHECK_EQ_INT(server.requests, 1);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST", NULL), FR_NO_FILE);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+
+    serve(SERVE_CHUNKED, file, FILE_SIZE);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), ERR_VAL);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST", NULL), FR_NO_FILE);
+
+    // The file is gone from the server while a download is broken
+    serve(SERVE_RANGES, file, FILE_SIZE);
+    for (int i = 0; i < DOWNLOAD_RESUME_ATTEMPTS; i++)
+    {
+        drop_at(80000 * (i + 1), DROP_RESET);
+    }
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", true, false), ERR_RST);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_OK);
+    serve(SERVE_NOT_FOUND, file, FILE_SIZE);
+    CHECK_EQ_INT(download_floppy(URL, FOLDER, "DISK.ST", false, false), (err_t)404);
+    static const uint32_t resumed[] = {240000};
+    check_ranges(resumed, 1);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST", NULL), FR_NO_FILE);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+    CHECK_EQ_INT(server.leaks, 0);
+}
+
+// An MSA image decoded as it arrives. A broken download starts again from the first byte
+static void check_download_msa(void)
+{
+    static uint8_t msa[MSA_HEADER_SIZE + 20 * (2 + 9 * MSA_BYTES_PER_SECTOR)];
+    static uint8_t image[20 * 9 * MSA_BYTES_PER_SECTOR];
+    uint32_t track_size = 9 * MSA_BYTES_PER_SECTOR;
+    static const uint8_t header[] = {0x0E, 0x0F, 0x00, 0x09, 0x00, 0x01, 0x00, 0x00, 0x00, 0x09};
+    memcpy(msa, header, sizeof(header));
+    uint32_t size = sizeof(header);
+    for (uint32_t track = 0; track < 20; track++)
+    {
+        uint8_t *data = image + track * track_size;
+        if (track % 4 == 0)
+        {
+            // An empty track: a single run
+            memset(data, 0xE5, track_size);
+            const uint8_t run[] = {0x00, 0x04, 0xE5, 0xE5, track_size >> 8, track_size & 0xFF};
+            memcpy(msa + size, run, sizeof(run));
+            size += sizeof(run);
+            continue;
+        }
+        memcpy(data, file + track * track_size, track_size);
+        for (uint32_t i = 0; i < track_size; i++)
+        {
+            // No 0xE5 in a stored track
+            data[i] = data[i] == 0xE5 ? 0xE4 : data[i];
+        }
+        msa[size++] = track_size >> 8;
+        msa[size++] = track_size & 0xFF;
+        memcpy(msa + size, data, track_size);
+        size += track_size;
+    }
+
+    serve(SERVE_RANGES, msa, size);
+    drop_at(40000, DROP_RESET);
+    CHECK_EQ_INT(download_floppy("http://192.168.1.10/images/DISK.MSA", FOLDER, "DISK.ST", true, true), ERR_OK);
+    CHECK(downloaded_is(FOLDER "/DISK.ST", image, sizeof(image)));
+    static const uint32_t restarted[] = {0, 0};
+    check_ranges(restarted, 2);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST" DOWNLOAD_RESUME_EXTENSION, NULL), FR_NO_FILE);
+
+    // A truncated image is not a floppy image
+    serve(SERVE_RANGES, msa, size - 100);
+    CHECK(download_floppy("http://192.168.1.10/images/DISK.MSA", FOLDER, "DISK.ST", true, true) != ERR_OK);
+    CHECK_EQ_INT(f_stat(FOLDER "/DISK.ST", NULL), FR_NO_FILE);
+}
+
+int main(void)
+{
+    srand(20261018);
+    for (uint32_t i = 0; i < FILE_SIZE; i++)
+    {
+        file[i] = rand() & 0xFF;
+    }
+    CHECK(host_disk_create(HOST_DISK_PATH, 64));
+    CHECK_EQ_INT(f_mount(&fs, "0:", 1), FR_OK);
+    CHECK_EQ_INT(f_mkdir(FOLDER), FR_OK);
+
+    check_parse_headers();
+    check_get_range();
+    check_download_resumed();
+    check_download_interrupted();
+    check_download_refused();
+    check_download_msa();
+
+    f_unmount("0:");
+    host_disk_remove();
+    return TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+/**
+ * File: test_jsonesc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The JSON escaping of file names. The output must be plain ASCII and valid inside a
+ * JSON string, and a name escaped in pieces must be the same as escaped at once
+ */
+
+#include "test.h"
+
+#include "include/jsonesc.h"
+
+static const char *escape(const char *src)
+{
+    static char dest[512];
+    size_t written;
+    size_t consumed = json_escape(dest, sizeof(dest), src, &written);
+    CHECK_EQ_INT(consumed, strlen(src));
+    CHECK_EQ_INT(written, strlen(dest));
+    return dest;
+}
+
+static void check_ascii(void)
+{
+    CHECK_EQ_STR(escape(""), "");
+    CHECK_EQ_STR(escape("GAME.ST"), "GAME.ST");
+    CHECK_EQ_STR(escape("a \"quoted\" \\name/"), "a \\\"quoted\\\" \\\\name/");
+    CHECK_EQ_STR(escape("\b\f\n\r\t"), "\\b\\f\\n\\r\\t");
+    CHECK_EQ_STR(escape("\x01\x1F\x7F"), "\\u0001\\u001F\\u007F");
+}
+
+static void check_utf8(void)
+{
+    CHECK_EQ_STR(escape("Caf\xC3\xA9.st"), "Caf\\u00E9.st");
+    CHECK_EQ_STR(escape("\xE2\x82\xAC"), "\\u20AC");
+    CHECK_EQ_STR(escape("\xEF\xBF\xBF"), "\\uFFFF");
+    CHECK_EQ_STR(escape("\xF0\x9F\x98\x80"), "\\uD83D\\uDE00");
+    CHECK_EQ_STR(escape("\xF4\x8F\xBF\xBF"), "\\uDBFF\\uDFFF");
+}
+
+// Each invalid byte is one replacement character, and the next valid character is kept
+static void check_invalid(void)
+{
+    CHECK_EQ_STR(escape("\x80"), "\\uFFFD");
+    CHECK_EQ_STR(escape("\xFF" "a"), "\\uFFFDa");
+    // Overlong forms
+    CHECK_EQ_STR(escape("\xC0\xAF"), "\\uFFFD\\uFFFD");
+    CHECK_EQ_STR(escape("\xE0\x80\xAF"), "\\uFFFD\\uFFFD\\uFFFD");
+    CHECK_EQ_STR(escape("\xF0\x8F\xBF\xBF"), "\\uFFFD\\uFFFD\\uFFFD\\uFFFD");
+    // Surrogate and beyond U+10FFFF
+    CHECK_EQ_STR(escape("\xED\xA0\x80"), "\\uFFFD\\uFFFD\\uFFFD");
+    CHECK_EQ_STR(escape("\xF4\x90\x80\x80"), "\\uFFFD\\uFFFD\\uFFFD\\uFFFD");
+    // Truncated by the end of the string or by another character
+    CHECK_EQ_STR(escape("a\xE2\x82"), "a\\uFFFD\\uFFFD");
+    CHECK_EQ_STR(escape("\xC3" "b"), "\\uFFFDb");
+}
+
+// A character that does not fit is left for the next call
+static void check_truncation(void)
+{
+    char dest[16];
+    size_t written;
+    memset(dest, 'x', sizeof(dest));
+    CHECK_EQ_INT(json_escape(dest, 8, "abcdef\xC3\xA9", &written), 6);
+    CHECK_EQ_STR(dest, "abcdef");
+    CHECK_EQ_INT(written, 6);
+    CHECK_EQ_INT(json_escape(dest, 13, "\xF0\x9F\x98\x80", &written), 4);
+    CHECK_EQ_INT(json_escape(dest, 12, "\xF0\x9F\x98\x80", &written), 0);
+    CHECK_EQ_STR(dest, "");
+    CHECK_EQ_INT(json_escape(dest, 2, "\"", &written), 0);
+    CHECK_EQ_INT(json_escape(dest, 3, "\"", &written), 1);
+    CHECK_EQ_STR(dest, "\\\"");
+    dest[0] = 'x';
+    CHECK_EQ_INT(json_escape(dest, 0, "abc", NULL), 0);
+    CHECK_EQ_INT(dest[0], 'x');
+}
+
+// The pieces of any size joined together are the whole escaped string
+static void check_pieces(void)
+{
+    char name[256];
+    int length = 0;
+    const char *parts[] = {"Disk \"1\" \\", "\xC3\xA9", "\xF0\x9F\x98\x80", "\t", "\xE2\x82\xAC", "\xFF", "z"};
+    while (length < 200)
+    {
+        const char *part = parts[length % 7];
+        strcpy(name + length, part);
+        length += strlen(part);
+    }
+    char whole[2048];
+    size_t whole_length;
+    CHECK_EQ_INT(json_escape(whole, sizeof(whole), name, &whole_length), length);
+
+    for (size_t piece = JSONESC_MAX_SEQUENCE + 1; piece < 200; piece += 7)
+    {
+        char joined[2048] = "";
+        char dest[200];
+        size_t offset = 0;
+        size_t joined_length = 0;
+        while (name[offset] != '\0')
+        {
+            size_t written;
+            size_t consumed = json_escape(dest, piece, name + offset, &written);
+            CHECK(consumed > 0);
+            if (consumed == 0)
+            {
+                break;
+            }
+            CHECK(written < piece);
+            offset += consumed;
+            memcpy(joined + joined_length, dest, written + 1);
+            joined_length += written;
+        }
+        CHECK_EQ_INT(joined_length, whole_length);
+        CHECK_EQ_STR(joined, whole);
+    }
+}
+
+int main(void)
+{
+    check_ascii();
+    check_utf8();
+    check_invalid();
+    check_truncation();
+    check_pieces();
+    return TEST_RESULT();
+}
@@ -0,0 +1,253 @@
+/**
+ * File: test_msaconv.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: MSA_to_ST of filesys.c on a FatFs SD card. A corpus of MSA images converted by the
+ * streaming decoder and by the track by track conversion it replaced (msa_baseline.c) must give the
+ * same ST images byte by byte. A truncated image is an error and leaves no ST image. Also the speed
+ * of both conversions
+ */
+
+#include "test.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "hostdisk.h"
+#include "msa_baseline.h"
+
+#define FOLDER "/floppies"
+#define MAX_IMAGE_SIZE (2 * (MSA_MAX_ENDING_TRACK + 1) * 11 * MSA_BYTES_PER_SECTOR)
+#define BENCHMARK_ROUNDS 20
+
+static FATFS fs;
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void put_word(uint8_t **dest, uint16_t value)
+{
+    *(*dest)++ = value >> 8;
+    *(*dest)++ = value & 0xFF;
+}
+
+// Compress an ST image as the MSA tools do: runs longer than 4 bytes and all the 0xE5 bytes
+// are encoded, and a track that does not get smaller is stored as it is
+static size_t encode_msa(uint8_t *msa, const uint8_t *image, uint16_t sectors_per_track, uint16_t sides,
+                         uint16_t starting_track, uint16_t ending_track)
+{
+    uint8_t *dest = msa;
+    put_word(&dest, MSA_ID_MARKER);
+    put_word(&dest, sectors_per_track);
+    put_word(&dest, sides - 1);
+    put_word(&dest, starting_track);
+    put_word(&dest, ending_track);
+    uint32_t track_size = sectors_per_track * MSA_BYTES_PER_SECTOR;
+    uint32_t tracks = (ending_track - starting_track + 1) * sides;
+    uint8_t *packed = malloc(track_size * 2);
+    for (uint32_t t = 0; t < tracks; t++)
+    {
+        const uint8_t *track = image + t * track_size;
+        uint32_t length = 0;
+        for (uint32_t i = 0; i < track_size;)
+        {
+            uint32_t run = 1;
+            while ((i + run < track_size) && (track[i + run] == track[i]))
+            {
+                run++;
+            }
+            if ((run > 4) || (track[i] == MSA_RLE_MARKER))
+            {
+                packed[length++] = MSA_RLE_MARKER;
+                packed[length++] = track[i];
+                packed[length++] = run >> 8;
+                packed[length++] = run & 0xFF;
+                i += run;
+            }
+            else
+            {
+                packed[length++] = track[i++];
+            }
+        }
+        if (length >= track_size)
+        {
+            put_word(&dest, track_size);
+            memcpy(dest, track, track_size);
+            dest += track_size;
+        }
+        else
+        {
+            put_word(&dest, length);
+            memcpy(dest, packed, length);
+            dest += length;
+        }
+    }
+    free(packed);
+    return dest - msa;
+}
+
+// A floppy image with the usual mix of empty sectors, fill patterns and random data. The empty
+// percentage goes from a blank disk to a full one
+static void random_image(uint8_t *image, uint32_t size, int empty_percent)
+{
+    static const uint8_t fills[] = {0x00, MSA_RLE_MARKER, 0x07, 0xFF};
+    for (uint32_t i = 0; i < size;)
+    {
+        uint32_t length = (rand() % 10 < 3) ? 1 + rand() % 900 : 1 + rand() % 50;
+        bool fill = rand() % 100 < empty_percent;
+        uint8_t value = fills[rand() % sizeof(fills)];
+        for (uint32_t j = 0; (j < length) && (i < size); j++)
+        {
+            image[i++] = fill ? value : rand() & 0xFF;
+        }
+    }
+}
+
+static void write_file(const char *path, const uint8_t *data, uint32_t size)
+{
+    FIL file;
+    UINT written;
+    CHECK_EQ_INT(f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+    CHECK_EQ_INT(f_write(&file, data, size, &written), FR_OK);
+    CHECK_EQ_INT(written, size);
+    CHECK_EQ_INT(f_close(&file), FR_OK);
+}
+
+// Reads a whole file. Returns the size, or -1 if the file is not there
+static int32_t read_file(const char *path, uint8_t *data, uint32_t max_size)
+{
+    FIL file;
+    UINT read;
+    if (f_open(&file, path, FA_READ) != FR_OK)
+    {
+        return -1;
+    }
+    CHECK_EQ_INT(f_read(&file, data, max_size, &read), FR_OK);
+    CHECK_EQ_INT(f_close(&file), FR_OK);
+    return (int32_t)read;
+}
+
+static void create_card(void)
+{
+    CHECK(host_disk_create(HOST_DISK_PATH, 64));
+    CHECK_EQ_INT(f_mount(&fs, "0:", 1), FR_OK);
+    CHECK_EQ_INT(f_mkdir(FOLDER), FR_OK);
+}
+
+static void check_corpus(uint8_t *image, uint8_t *msa, uint8_t *baseline, uint8_t *converted)
+{
+    static const uint16_t geometries[][4] = {
+        // Sectors per track, sides, starting track, ending track
+        {9, 2, 0, 79},
+        {9, 1, 0, 79},
+        {10, 2, 0, 81},
+        {11, 2, 0, 82},
+        {9, 2, 0, 85},
+        {11, 1, 5, 10},
+    };
+    static const int empty_percents[] = {0, 50, 90, 100};
+
+    srand(20261018);
+    for (size_t g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++)
+    {
+        const uint16_t *geometry = geometries[g];
+        uint32_t size = geometry[0] * MSA_BYTES_PER_SECTOR * geometry[1] * (geometry[3] - geometry[2] + 1);
+        for (size_t e = 0; e < sizeof(empty_percents) / sizeof(empty_percents[0]); e++)
+        {
+            random_image(image, size, empty_percents[e]);
+            write_file(FOLDER "/DISK.MSA", msa, encode_msa(msa, image, geometry[0], geometry[1], geometry[2], geometry[3]));
+
+            CHECK_EQ_INT(MSA_to_ST_baseline(FOLDER, "DISK.MSA", "OLD.ST", true), FR_OK);
+            CHECK_EQ_INT(MSA_to_ST(FOLDER, "DISK.MSA", "NEW.ST", true), FR_OK);
+            CHECK_EQ_INT(read_file(FOLDER "/OLD.ST", baseline, MAX_IMAGE_SIZE), size);
+            CHECK(memcmp(baseline, image, size) == 0);
+            int32_t new_size = read_file(FOLDER "/NEW.ST", converted, MAX_IMAGE_SIZE);
+            CHECK_EQ_INT(new_size, size);
+            if ((new_size != (int32_t)size) || (memcmp(converted, baseline, size) != 0))
+            {
+                fprintf(stderr, "Geometry %zu with %d%% empty: the ST image differs from the baseline\n", g, empty_percents[e]);
+                test_failures++;
+            }
+        }
+    }
+
+    // The destination is kept if it exists and the overwrite is not set
+    CHECK_EQ_INT(MSA_to_ST(FOLDER, "DISK.MSA", "NEW.ST", false), FR_FILE_EXISTS);
+    CHECK_EQ_INT(MSA_to_ST(FOLDER, "NOTHERE.MSA", "NEW.ST", true), FR_NO_FILE);
+}
+
+static void check_truncated(uint8_t *image, uint8_t *msa)
+{
+    uint32_t size = 9 * MSA_BYTES_PER_SECTOR * 2 * 80;
+    random_image(image, size, 50);
+    size_t msa_size = encode_msa(msa, image, 9, 2, 0, 79);
+
+    // Cut in the header, in a length word, in the data of a track and before the last byte
+    static const size_t cuts[] = {MSA_HEADER_SIZE - 1, MSA_HEADER_SIZE + 1, 5000, 0};
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++)
+    {
+        size_t cut = cuts[c] != 0 ? cuts[c] : msa_size - 1;
+        f_unlink(FOLDER "/CUT.ST");
+        write_file(FOLDER "/CUT.MSA", msa, cut);
+        CHECK_EQ_INT(MSA_to_ST(FOLDER, "CUT.MSA", "CUT.ST", true), FR_DISK_ERR);
+        // No partial image for the floppy emulator
+        CHECK_EQ_INT(f_stat(FOLDER "/CUT.ST", NULL), FR_NO_FILE);
+    }
+}
+
+// Converts the same image with both versions, in turns, and returns the seconds of each
+static void time_conversions(double *baseline_s, double *streaming_s)
+{
+    struct timespec start;
+    *baseline_s = 0;
+    *streaming_s = 0;
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        CHECK_EQ_INT(MSA_to_ST_baseline(FOLDER, "DISK.MSA", "OLD.ST", true), FR_OK);
+        *baseline_s += elapsed_s(&start);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        CHECK_EQ_INT(MSA_to_ST(FOLDER, "DISK.MSA", "NEW.ST", true), FR_OK);
+        *streaming_s += elapsed_s(&start);
+    }
+}
+
+static void check_speed(uint8_t *image, uint8_t *msa)
+{
+    // A double sided disk of 11 sectors, half empty as most of the floppies of the ST
+    uint32_t size = 11 * MSA_BYTES_PER_SECTOR * 2 * 83;
+    random_image(image, size, 50);
+    write_file(FOLDER "/DISK.MSA", msa, encode_msa(msa, image, 11, 2, 0, 82));
+
+    double baseline_s, streaming_s;
+    time_conversions(&baseline_s, &streaming_s);
+    double megabytes = (double)size * BENCHMARK_ROUNDS / (1024.0 * 1024.0);
+    printf("MSA_to_ST of %u bytes on the %s card: baseline %.1f MB/s, streaming %.1f MB/s\n", size, host_disk_backend(),
+           megabytes / baseline_s, megabytes / streaming_s);
+    // Loose, the time of the card is the same for both and the host is not idle
+    CHECK(streaming_s < baseline_s * 1.5);
+}
+
+int main(void)
+{
+    uint8_t *image = malloc(MAX_IMAGE_SIZE);
+    uint8_t *msa = malloc(MAX_IMAGE_SIZE * 2);
+    uint8_t *baseline = malloc(MAX_IMAGE_SIZE);
+    uint8_t *converted = malloc(MAX_IMAGE_SIZE);
+    create_card();
+    check_corpus(image, msa, baseline, converted);
+    check_truncated(image, msa);
+    check_speed(image, msa);
+    f_unmount("0:");
+    host_disk_remove();
+    free(image);
+    free(msa);
+    free(baseline);
+    free(converted);
+    return TEST_RESULT();
+}
@@ -0,0 +1,277 @@
+/**
+ * File: test_msadec.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The streaming MSA decoder must give the same ST image byte by byte however
+ * the download splits the MSA file. A hand made image, and random images compressed here
+ */
+
+#include "test.h"
+
+#include <stdlib.h>
+
+#include "include/msadec.h"
+
+#define MAX_IMAGE_SIZE (2 * (MSA_MAX_ENDING_TRACK + 1) * 11 * MSA_BYTES_PER_SECTOR)
+
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t writes;
+    uint32_t fail_at_write; // 0 to never fail
+} ImageSink;
+
+static bool write_image(void *arg, const uint8_t *data, uint32_t size)
+{
+    ImageSink *sink = arg;
+    if (++sink->writes == sink->fail_at_write)
+    {
+        return false;
+    }
+    if (sink->size + size > MAX_IMAGE_SIZE)
+    {
+        return false;
+    }
+    memcpy(sink->data + sink->size, data, size);
+    sink->size += size;
+    return true;
+}
+
+// Decode in chunks of the given size. 0 means all at once
+static bool decode(const uint8_t *msa, size_t msa_size, size_t chunk, ImageSink *sink, uint32_t *image_size)
+{
+    MsaDecoder decoder;
+    sink->size = 0;
+    sink->writes = 0;
+    msa_decoder_init(&decoder, write_image, sink);
+    bool ok = true;
+    for (size_t offset = 0; ok && (offset < msa_size);)
+    {
+        size_t size = (chunk == 0) || (chunk > msa_size - offset) ? msa_size - offset : chunk;
+        ok = msa_decoder_feed(&decoder, msa + offset, size);
+        offset += size;
+    }
+    if (image_size != NULL)
+    {
+        *image_size = msa_decoder_image_size(&decoder);
+    }
+    return msa_decoder_finish(&decoder) && ok;
+}
+
+static void put_word(uint8_t **dest, uint16_t value)
+{
+    *(*dest)++ = value >> 8;
+    *(*dest)++ = value & 0xFF;
+}
+
+// Compress an ST image as the MSA tools do: runs longer than 4 bytes and all the 0xE5 bytes
+// are encoded, and a track that does not get smaller is stored as it is
+static size_t encode_msa(uint8_t *msa, const uint8_t *image, uint16_t sectors_per_track, uint16_t sides,
+                         uint16_t starting_track, uint16_t ending_track)
+{
+    uint8_t *dest = msa;
+    put_word(&dest, MSA_ID_MARKER);
+    put_word(&dest, sectors_per_track);
+    put_word(&dest, sides - 1);
+    put_word(&dest, starting_track);
+    put_word(&dest, ending_track);
+
+    uint32_t track_size = sectors_per_track * MSA_BYTES_PER_SECTOR;
+    uint32_t tracks = (ending_track - starting_track + 1) * sides;
+    uint8_t *packed = malloc(track_size * 2);
+    for (uint32_t t = 0; t < tracks; t++)
+    {
+        const uint8_t *track = image + t * track_size;
+        uint32_t length = 0;
+        for (uint32_t i = 0; i < track_size;)
+        {
+            uint32_t run = 1;
+            while ((i + run < track_size) && (track[i + run] == track[i]))
+            {
+                run++;
+            }
+            if ((run > 4) || (track[i] == MSA_RLE_MARKER))
+            {
+                packed[length++] = MSA_RLE_MARKER;
+                packed[length++] = track[i];
+                packed[length++] = run >> 8;
+                packed[length++] = run & 0xFF;
+                i += run;
+            }
+            else
+            {
+                packed[length++] = track[i++];
+            }
+        }
+        if (length >= track_size)
+        {
+            put_word(&dest, track_size);
+            memcpy(dest, track, track_size);
+            dest += track_size;
+        }
+        else
+        {
+            put_word(&dest, length);
+            memcpy(dest, packed, length);
+            dest += length;
+        }
+    }
+    free(packed);
+    return dest - msa;
+}
+
+// A floppy image with the usual mix of empty sectors, fill patterns and random data
+static void random_image(uint8_t *image, uint32_t size)
+{
+    static const uint8_t fills[] = {0x00, MSA_RLE_MARKER, 0x07, 0xFF};
+    for (uint32_t i = 0; i < size;)
+    {
+        uint32_t length = (rand() % 10 < 3) ? 1 + rand() % 900 : 1 + rand() % 50;
+        bool fill = rand() % 2;
+        uint8_t value = fills[rand() % sizeof(fills)];
+        for (uint32_t j = 0; (j < length) && (i < size); j++)
+        {
+            image[i++] = fill ? value : rand() & 0xFF;
+        }
+    }
+}
+
+// Two tracks of one sector of one side. Track 0 compressed, track 1 stored as it is
+static void check_known_image(ImageSink *sink)
+{
+    uint8_t msa[MSA_HEADER_SIZE + 2 + 12 + 2 + MSA_BYTES_PER_SECTOR];
+    uint8_t expected[2 * MSA_BYTES_PER_SECTOR];
+    uint8_t *dest = msa;
+    put_word(&dest, MSA_ID_MARKER);
+    put_word(&dest, 1); // Sectors per track
+    put_word(&dest, 0); // One side
+    put_word(&dest, 0); // Starting track
+    put_word(&dest, 1); // Ending track
+    // 'A' 'B', a run of 500 bytes of 0x00, a run of one 0xE5, 'C' 'D'
+    static const uint8_t track0[] = {'A', 'B', 0xE5, 0x00, 0x01, 0xF4, 0xE5, 0xE5, 0x00, 0x01, 'C', 'D'};
+    put_word(&dest, sizeof(track0));
+    memcpy(dest, track0, sizeof(track0));
+    dest += sizeof(track0);
+    put_word(&dest, MSA_BYTES_PER_SECTOR);
+    for (int i = 0; i < MSA_BYTES_PER_SECTOR; i++)
+    {
+        *dest++ = (uint8_t)i;
+        expected[MSA_BYTES_PER_SECTOR + i] = (uint8_t)i;
+    }
+    memset(expected, 0, MSA_BYTES_PER_SECTOR);
+    expected[0] = 'A';
+    expected[1] = 'B';
+    expected[502] = 0xE5;
+    expected[503] = 'C';
+    expected[504] = 'D';
+    // The rest of track 0 is not in the file and stays as zeroes
+    CHECK_EQ_INT(dest - msa, sizeof(msa));
+
+    static const size_t chunks[] = {0, 1, 2, 3, 5, 13, 511};
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+    {
+        uint32_t image_size = 0;
+        CHECK(decode(msa, sizeof(msa), chunks[c], sink, &image_size));
+        CHECK_EQ_INT(image_size, sizeof(expected));
+        CHECK_EQ_INT(sink->size, sizeof(expected));
+        CHECK(memcmp(sink->data, expected, sizeof(expected)) == 0);
+        CHECK_EQ_INT(sink->writes, 2);
+    }
+}
+
+static void check_random_images(ImageSink *sink)
+{
+    static const uint16_t geometries[][4] = {
+        // Sectors per track, sides, starting track, ending track
+        {9, 2, 0, 79},
+        {9, 1, 0, 79},
+        {10, 2, 0, 81},
+        {11, 2, 0, 82},
+        {11, 1, 5, 10},
+    };
+    static const size_t chunks[] = {0, 1, 3, 536, 1460, MSA_READ_BUFFER_SIZE};
+    uint8_t *image = malloc(MAX_IMAGE_SIZE);
+    uint8_t *msa = malloc(MAX_IMAGE_SIZE * 2);
+
+    srand(20261018);
+    for (size_t g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++)
+    {
+        const uint16_t *geometry = geometries[g];
+        uint32_t size = geometry[0] * MSA_BYTES_PER_SECTOR * geometry[1] * (geometry[3] - geometry[2] + 1);
+        random_image(image, size);
+        size_t msa_size = encode_msa(msa, image, geometry[0], geometry[1], geometry[2], geometry[3]);
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+        {
+            uint32_t image_size = 0;
+            CHECK(decode(msa, msa_size, chunks[c], sink, &image_size));
+            CHECK_EQ_INT(image_size, size);
+            CHECK_EQ_INT(sink->size, size);
+            if (memcmp(sink->data, image, size) != 0)
+            {
+                fprintf(stderr, "Geometry %zu in chunks of %zu: the image differs\n", g, chunks[c]);
+                test_failures++;
+            }
+            // One write per cylinder
+            CHECK_EQ_INT(sink->writes, geometry[3] - geometry[2] + 1);
+        }
+
+        // Bytes after the last track are ignored
+        memset(msa + msa_size, 0xAA, 100);
+        CHECK(decode(msa, msa_size + 100, 7, sink, NULL));
+        CHECK_EQ_INT(sink->size, size);
+
+        // A truncated file is an error, at any position
+        for (size_t cut = 0; cut < msa_size; cut += 1 + rand() % 4096)
+        {
+            CHECK(!decode(msa, cut, 512, sink, NULL));
+        }
+    }
+    free(image);
+    free(msa);
+}
+
+static void check_errors(ImageSink *sink)
+{
+    uint8_t msa[MSA_HEADER_SIZE + 4];
+    uint8_t *dest = msa;
+    put_word(&dest, MSA_ID_MARKER);
+    put_word(&dest, 9);
+    put_word(&dest, 1);
+    put_word(&dest, 0);
+    put_word(&dest, 0);
+    put_word(&dest, 0); // Both tracks empty
+    put_word(&dest, 0);
+    CHECK(decode(msa, sizeof(msa), 1, sink, NULL));
+    CHECK_EQ_INT(sink->size, 2 * 9 * MSA_BYTES_PER_SECTOR);
+
+    // Bad headers
+    msa[0] = 0x0F;
+    CHECK(!decode(msa, sizeof(msa), 0, sink, NULL));
+    msa[0] = 0x0E;
+    msa[5] = 2; // Three sides
+    CHECK(!decode(msa, sizeof(msa), 0, sink, NULL));
+    msa[5] = 1;
+    msa[7] = 1; // Starting track after the ending track
+    CHECK(!decode(msa, sizeof(msa), 0, sink, NULL));
+    msa[7] = 0;
+    msa[9] = MSA_MAX_ENDING_TRACK + 1;
+    CHECK(!decode(msa, sizeof(msa), 0, sink, NULL));
+    msa[9] = 0;
+
+    // A failed write stops the decoder
+    sink->fail_at_write = 1;
+    CHECK(!decode(msa, sizeof(msa), 0, sink, NULL));
+    sink->fail_at_write = 0;
+}
+
+int main(void)
+{
+    ImageSink sink = {malloc(MAX_IMAGE_SIZE), 0, 0, 0};
+    check_known_image(&sink);
+    check_random_images(&sink);
+    check_errors(&sink);
+    free(sink.data);
+    return TEST_RESULT();
+}
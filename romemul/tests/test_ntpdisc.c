@@ -0,0 +1,206 @@
+/**
+ * File: test_ntpdisc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The NTP discipline against a simulated server, with a crystal off by tens of ppm,
+ * random network delays and lost responses. Days of simulated time in a fraction of a second
+ */
+
+#include "test.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "include/ntpdisc.h"
+
+#define SIM_STEP_US 100000ULL         // The simulated main loop runs every 100 ms
+#define SIM_START_TIME 1790000000.0   // Unix time of the server when the simulation starts
+#define SIM_BOOT_US 5000000ULL        // time_us_64() when the first request is sent
+#define HOUR_US (3600ULL * 1000000ULL)
+
+typedef struct
+{
+    double crystal_ppm;     // time_us_64() runs this much faster than the real time
+    double server_step_sec; // The server time jumps this much at jump_at_us. 0 for no jump
+    uint64_t jump_at_us;
+    uint32_t loss_percent;
+    uint64_t now_us; // time_us_64()
+    // Pending request
+    bool pending;
+    uint64_t t1_us;
+    uint64_t response_us;
+    int64_t t2_us;
+    int64_t t3_us;
+    // Results
+    uint32_t steps;
+    uint32_t discarded;
+    double max_error_sec; // After the warm up
+    double error_sum_sq;
+    uint32_t error_count;
+    bool went_backwards;
+} Simulation;
+
+// The real time at a time_us_64()
+static double server_time(const Simulation *sim, uint64_t us)
+{
+    double t = SIM_START_TIME + us / (1e6 * (1 + sim->crystal_ppm * 1e-6));
+    if ((sim->jump_at_us != 0) && (us >= sim->jump_at_us))
+    {
+        t += sim->server_step_sec;
+    }
+    return t;
+}
+
+// Send a request. The server answers after a random delay on each way, or never
+static void send_request(Simulation *sim)
+{
+    double to_server = 0.005 + (rand() % 40) / 1000.0;
+    double to_client = 0.005 + (rand() % 40) / 1000.0;
+    sim->t1_us = sim->now_us;
+    uint64_t at_server_us = sim->now_us + (uint64_t)(to_server * 1e6);
+    sim->t2_us = (int64_t)(server_time(sim, at_server_us) * 1e6);
+    sim->t3_us = sim->t2_us + 250; // Time in the server
+    sim->response_us = at_server_us + 250 + (uint64_t)(to_client * 1e6);
+    sim->pending = (uint32_t)(rand() % 100) >= sim->loss_percent;
+}
+
+// Run the discipline as rtcemul.c does: a new request when the poll interval expires or the
+// response times out, and each response applied as it arrives
+static void run(Simulation *sim, NtpDiscipline *d, uint64_t until_us, uint64_t warm_up_us)
+{
+    int64_t last_clock_us = ntp_discipline_clock_us(d, sim->now_us);
+    while (sim->now_us < until_us)
+    {
+        sim->now_us += SIM_STEP_US;
+        if (sim->pending && (sim->now_us >= sim->response_us))
+        {
+            // The UDP callback takes the time when the response arrives, not the time of the loop
+            sim->pending = false;
+            NtpSampleResult result = ntp_discipline_sample(d, sim->t1_us, sim->response_us, sim->t2_us, sim->t3_us);
+            sim->steps += (result == NTP_SAMPLE_STEPPED);
+            sim->discarded += (result == NTP_SAMPLE_DISCARDED);
+            d->request_us = 0;
+            d->next_poll_us = sim->response_us + (uint64_t)d->poll_interval_sec * 1000000;
+            last_clock_us = ntp_discipline_clock_us(d, sim->now_us);
+        }
+        if ((d->request_us != 0) && (sim->now_us - d->request_us > (uint64_t)NTP_RESPONSE_TIMEOUT_MS * 1000))
+        {
+            d->request_us = 0;
+            d->next_poll_us = sim->now_us + (uint64_t)NTP_MIN_POLL_SEC * 1000000;
+        }
+        if ((d->request_us == 0) && (sim->now_us >= d->next_poll_us))
+        {
+            d->request_us = sim->now_us;
+            send_request(sim);
+        }
+
+        // The slew never makes the clock go backwards
+        int64_t clock_us = ntp_discipline_clock_us(d, sim->now_us);
+        if (clock_us < last_clock_us)
+        {
+            sim->went_backwards = true;
+        }
+        last_clock_us = clock_us;
+        if (sim->now_us >= warm_up_us)
+        {
+            double error = fabs(clock_us / 1e6 - server_time(sim, sim->now_us));
+            sim->max_error_sec = error > sim->max_error_sec ? error : sim->max_error_sec;
+            sim->error_sum_sq += error * error;
+            sim->error_count++;
+        }
+    }
+}
+
+static void start(Simulation *sim, NtpDiscipline *d, double crystal_ppm)
+{
+    memset(sim, 0, sizeof(Simulation));
+    sim->crystal_ppm = crystal_ppm;
+    sim->loss_percent = 5;
+    sim->now_us = SIM_BOOT_US;
+    ntp_discipline_init(d);
+    d->next_poll_us = SIM_BOOT_US;
+}
+
+// A crystal off by some ppm. The drift is learned and the clock stays within a few ms
+static void check_drift(double crystal_ppm)
+{
+    Simulation sim;
+    NtpDiscipline d;
+    start(&sim, &d, crystal_ppm);
+    run(&sim, &d, 72 * HOUR_US, 12 * HOUR_US);
+
+    double expected_ppb = -crystal_ppm * 1000 / (1 + crystal_ppm * 1e-6);
+    double rms_error_sec = sqrt(sim.error_sum_sq / sim.error_count);
+    printf("Crystal %+.0f ppm: drift %ld ppb, expected %.0f ppb. Error max %.1f ms, rms %.1f ms. %u samples\n",
+           crystal_ppm, (long)d.drift_ppb, expected_ppb, sim.max_error_sec * 1000, rms_error_sec * 1000, d.samples);
+    CHECK(d.synchronized);
+    CHECK(fabs(d.drift_ppb - expected_ppb) < 5000);
+    // Each sample is applied as it comes, so a sample can be off by half the difference
+    // between the two ways, up to 20 ms here
+    CHECK(sim.max_error_sec < 0.040);
+    CHECK(rms_error_sec < 0.015);
+    CHECK_EQ_INT(d.poll_interval_sec, NTP_MAX_POLL_SEC);
+    CHECK_EQ_INT(sim.steps, 1); // Only the first sample
+    CHECK(!sim.went_backwards);
+}
+
+// The first response steps the clock to the server time
+static void check_first_sample(void)
+{
+    NtpDiscipline d;
+    ntp_discipline_init(&d);
+    CHECK(!d.synchronized);
+    CHECK_EQ_INT(d.poll_interval_sec, NTP_MIN_POLL_SEC);
+    int64_t server_us = 1790000000LL * 1000000;
+    // 20 ms out, 40 ms back, 1 ms in the server
+    CHECK_EQ_INT(ntp_discipline_sample(&d, 1000000, 1061000, server_us, server_us + 1000), NTP_SAMPLE_STEPPED);
+    CHECK(d.synchronized);
+    CHECK_EQ_INT(d.last_delay_us, 60000);
+    // The delay is taken as symmetric: 30 ms after the transmit timestamp
+    CHECK_EQ_INT(ntp_discipline_clock_us(&d, 1061000), server_us + 1000 + 30000);
+    CHECK_EQ_INT(ntp_discipline_clock_us(&d, 2061000), server_us + 1000 + 30000 + 1000000);
+
+    // A response with a long round trip is not used once the clock is set
+    NtpDiscipline before = d;
+    CHECK_EQ_INT(ntp_discipline_sample(&d, 5000000, 5000000 + (NTP_MAX_DELAY_MS + 1) * 1000, server_us, server_us),
+                 NTP_SAMPLE_DISCARDED);
+    CHECK(memcmp(&before, &d, sizeof(d)) == 0);
+
+    // A small offset is slewed at most at NTP_MAX_SLEW_PPM
+    int64_t now_us = 10000000;
+    int64_t at_server_us = ntp_discipline_clock_us(&d, now_us) + 100000; // 100 ms ahead
+    CHECK_EQ_INT(ntp_discipline_sample(&d, now_us, now_us, at_server_us, at_server_us), NTP_SAMPLE_SLEWED);
+    CHECK_EQ_INT(d.slew_us, 100000);
+    CHECK_EQ_INT(ntp_discipline_clock_us(&d, now_us + 1000000) - ntp_discipline_clock_us(&d, now_us),
+                 1000000 + NTP_MAX_SLEW_PPM + d.drift_ppb / 1000);
+}
+
+// The server time jumps. The clock is stepped again and polls fast until it is stable
+static void check_server_jump(void)
+{
+    Simulation sim;
+    NtpDiscipline d;
+    start(&sim, &d, 40);
+    run(&sim, &d, 24 * HOUR_US, 0);
+    CHECK_EQ_INT(d.poll_interval_sec, NTP_MAX_POLL_SEC);
+    sim.server_step_sec = 5.0;
+    sim.jump_at_us = sim.now_us;
+    run(&sim, &d, sim.now_us + 2 * HOUR_US, 0);
+    CHECK_EQ_INT(sim.steps, 2);
+    CHECK(fabs(ntp_discipline_clock_us(&d, sim.now_us) / 1e6 - server_time(&sim, sim.now_us)) < 0.025);
+
+    // The learned drift survives the step. It is not back to 0
+    CHECK(llabs((long long)d.drift_ppb + 40000) < 10000);
+}
+
+int main(void)
+{
+    srand(20261018);
+    check_first_sample();
+    check_drift(80);
+    check_drift(-150);
+    check_drift(3);
+    check_server_jump();
+    return TEST_RESULT();
+}
@@ -0,0 +1,498 @@
+/**
+ * File: test_replay.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Synthetic ROM3 captures replayed through the parse_protocol of the firmware. The
+ * commands must arrive complete, the restart after a pause must drop the incomplete ones, and the
+ * wrap of the 32 bits timer of the capture must not look like a pause. Then captures of each emulator
+ * replayed through its command handlers on a FatFs SD card, with the answers read from the shared
+ * memory, and the speed of the replay of a whole floppy disk
+ */
+
+#include "test.h"
+
+#include <time.h>
+
+#include "floppyemul.h"
+#include "gemdrvemul.h"
+#include "hostdisk.h"
+#include "hostemul.h"
+#include "replay.h"
+#include "romloader.h"
+#include "rtcemul.h"
+
+#define SHARED(offset) ((volatile uint8_t *)(uintptr_t)(ROM3_START_ADDRESS + (offset)))
+#define FLOPPY_SECTORS 1440 // A double sided disk of 80 tracks and 9 sectors
+#define COMMAND_GAP_US 100  // The ST waits for the answer before the next command
+
+#define MAX_COMMANDS 16
+
+typedef struct
+{
+    uint16_t command_id;
+    uint16_t payload_size;
+    uint16_t payload[8];
+} Command;
+
+static Command commands[MAX_COMMANDS];
+static int commands_count;
+
+static void store_command(const TransmissionProtocol *protocol)
+{
+    Command *command = &commands[commands_count++];
+    command->command_id = protocol->command_id;
+    command->payload_size = protocol->payload_size;
+    // Only the start of the big payloads
+    memcpy(command->payload, protocol->payload, protocol->payload_size < sizeof(command->payload) ? protocol->payload_size : sizeof(command->payload));
+}
+
+static ReplayCommand served[FLOPPY_SECTORS + 1];
+static int served_count;
+
+static FILE *new_app_capture(uint32_t magic, uint32_t app)
+{
+    FILE *file = tmpfile();
+    CaptureHeader header = {.magic = magic, .version = CAPTURE_VERSION, .app = app, .record_size = sizeof(CaptureRecord)};
+    fwrite(&header, sizeof(header), 1, file);
+    return file;
+}
+
+static FILE *new_capture(uint32_t magic)
+{
+    return new_app_capture(magic, APP_FLOPPYEMUL);
+}
+
+static void add_word(FILE *file, uint32_t time_us, uint16_t data)
+{
+    CaptureRecord record = {.time_us = time_us, .data = data, .lost = 0};
+    fwrite(&record, sizeof(record), 1, file);
+}
+
+// A command sent by the ST, one word every 2 microseconds
+static uint32_t add_command(FILE *file, uint32_t time_us, uint16_t command_id, uint16_t payload_size, const uint16_t *payload)
+{
+    add_word(file, time_us, PROTOCOL_HEADER);
+    add_word(file, time_us += 2, command_id);
+    add_word(file, time_us += 2, payload_size);
+    for (int i = 0; i < (payload_size + 1) / 2; i++)
+    {
+        add_word(file, time_us += 2, payload[i]);
+    }
+    return time_us + 2;
+}
+
+static bool replay(FILE *file, ReplayInfo *info)
+{
+    commands_count = 0;
+    memset(commands, 0, sizeof(commands));
+    rewind(file);
+    bool ok = replay_capture(file, store_command, info);
+    fclose(file);
+    return ok;
+}
+
+static void check_commands(void)
+{
+    const uint16_t payload[] = {0x1234, 0xABCD, 0x0001, 0xFFFF};
+    FILE *file = new_capture(CAPTURE_MAGIC);
+    uint32_t time_us = 5000;
+    // Reads of ROM3 that are not commands
+    add_word(file, time_us, 0x0000);
+    add_word(file, time_us += 3, 0xFFFF);
+    time_us = add_command(file, time_us + 50, 0x0201, 8, payload);
+    time_us = add_command(file, time_us + 50, 0x0202, 0, NULL);
+    time_us = add_command(file, time_us + 50, 0x0203, 3, payload);
+
+    ReplayInfo info;
+    CHECK(replay(file, &info));
+    CHECK_EQ_INT(info.app, 2);
+    CHECK_EQ_INT(info.records, 2 + 7 + 3 + 5);
+    CHECK_EQ_INT(info.start_us, 5000);
+    CHECK_EQ_INT(bus_stats.commands, 3);
+    CHECK_EQ_INT(bus_stats.parse_timeouts, 0);
+    CHECK_EQ_INT(commands_count, 3);
+    CHECK_EQ_INT(commands[0].command_id, 0x0201);
+    CHECK_EQ_INT(commands[0].payload_size, 8);
+    CHECK(memcmp(commands[0].payload, payload, 8) == 0);
+    CHECK_EQ_INT(commands[1].command_id, 0x0202);
+    CHECK_EQ_INT(commands[1].payload_size, 0);
+    CHECK_EQ_INT(commands[2].command_id, 0x0203);
+    CHECK_EQ_INT(commands[2].payload_size, 3);
+    CHECK(memcmp(commands[2].payload, payload, 3) == 0);
+}
+
+// A command that stops in the middle is dropped by the next word after the pause
+static void check_timeout(void)
+{
+    const uint16_t payload[] = {0x1111, 0x2222, 0x3333};
+    FILE *file = new_capture(CAPTURE_MAGIC);
+    uint32_t time_us = 100;
+    add_word(file, time_us, PROTOCOL_HEADER);
+    add_word(file, time_us += 2, 0x0301);
+    add_word(file, time_us += 2, 6);
+    add_word(file, time_us += 2, 0x1111);
+    // The header of the next command would be taken as the payload without the restart
+    time_us = add_command(file, time_us + PROTOCOL_READ_RESTART_MICROSECONDS + 1, 0x0302, 6, payload);
+    // A pause shorter than the restart between the words of a command is not a timeout
+    add_word(file, time_us, PROTOCOL_HEADER);
+    add_word(file, time_us += PROTOCOL_READ_RESTART_MICROSECONDS / 2, 0x0303);
+    add_word(file, time_us += 2, 0);
+
+    ReplayInfo info;
+    CHECK(replay(file, &info));
+    CHECK_EQ_INT(bus_stats.parse_timeouts, 1);
+    CHECK_EQ_INT(bus_stats.commands, 2);
+    CHECK_EQ_INT(commands_count, 2);
+    CHECK_EQ_INT(commands[0].command_id, 0x0302);
+    CHECK(memcmp(commands[0].payload, payload, 6) == 0);
+    CHECK_EQ_INT(commands[1].command_id, 0x0303);
+}
+
+// The timer of the capture wraps in the middle of a command
+static void check_timer_wrap(void)
+{
+    const uint16_t payload[] = {0xCAFE, 0xBEEF};
+    FILE *file = new_capture(CAPTURE_MAGIC);
+    uint32_t time_us = add_command(file, 0xFFFFFFF8, 0x0401, 4, payload);
+    add_command(file, time_us + 10, 0x0402, 0, NULL);
+
+    ReplayInfo info;
+    CHECK(replay(file, &info));
+    CHECK_EQ_INT(bus_stats.parse_timeouts, 0);
+    CHECK_EQ_INT(commands_count, 2);
+    CHECK_EQ_INT(commands[0].command_id, 0x0401);
+    CHECK(memcmp(commands[0].payload, payload, 4) == 0);
+    CHECK_EQ_INT(commands[1].command_id, 0x0402);
+    CHECK_EQ_INT(host_time_us, 0x100000000ULL + 16);
+}
+
+static void check_bad_captures(void)
+{
+    ReplayInfo info;
+    CHECK(!replay(new_capture(0x12345678), &info));
+
+    // The ROM emulator has no commands and no emulator to replay them
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_ROMEMUL);
+    rewind(file);
+    CHECK(!replay_emulator(file, NULL, &info));
+    CHECK_EQ_INT(info.app, APP_ROMEMUL);
+    fclose(file);
+}
+
+// The parser drops a frame with a payload bigger than its buffer. The words that follow are not
+// taken as its payload, and the next command arrives complete
+static void check_oversized(void)
+{
+    const uint16_t payload[] = {0x0A0B, 0x0C0D};
+    FILE *file = new_capture(CAPTURE_MAGIC);
+    uint32_t time_us = 10;
+    add_word(file, time_us, PROTOCOL_HEADER);
+    add_word(file, time_us += 2, 0x0501);
+    add_word(file, time_us += 2, MAX_PROTOCOL_PAYLOAD_SIZE + 2);
+    add_word(file, time_us += 2, 0x0000);
+    time_us = add_command(file, time_us + 2, 0x0502, 4, payload);
+    // The biggest payload accepted
+    uint16_t big[MAX_PROTOCOL_PAYLOAD_SIZE / 2];
+    for (int i = 0; i < MAX_PROTOCOL_PAYLOAD_SIZE / 2; i++)
+    {
+        big[i] = i;
+    }
+    add_command(file, time_us, 0x0503, MAX_PROTOCOL_PAYLOAD_SIZE, big);
+
+    ReplayInfo info;
+    CHECK(replay(file, &info));
+    CHECK_EQ_INT(info.records, 4 + 5 + 3 + MAX_PROTOCOL_PAYLOAD_SIZE / 2);
+    CHECK_EQ_INT(bus_stats.parse_oversized, 1);
+    CHECK_EQ_INT(bus_stats.parse_timeouts, 0);
+    CHECK_EQ_INT(bus_stats.commands, 2);
+    CHECK_EQ_INT(commands_count, 2);
+    CHECK_EQ_INT(commands[0].command_id, 0x0502);
+    CHECK_EQ_INT(commands[0].payload_size, 4);
+    CHECK(memcmp(commands[0].payload, payload, 4) == 0);
+    CHECK_EQ_INT(commands[1].command_id, 0x0503);
+    CHECK_EQ_INT(commands[1].payload_size, MAX_PROTOCOL_PAYLOAD_SIZE);
+    CHECK(memcmp(commands[1].payload, big, sizeof(commands[1].payload)) == 0);
+}
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// A command of the emulators: the random token first, then the arguments of 32 bits, lower word
+// first, and a string with two characters in each word
+static uint32_t add_token_command(FILE *file, uint32_t time_us, uint16_t command_id, uint32_t token, const uint32_t *args,
+                                  int args_count, const char *string)
+{
+    uint16_t payload[MAX_PROTOCOL_PAYLOAD_SIZE / 2];
+    int words = 0;
+    payload[words++] = token >> 16;
+    payload[words++] = token & 0xFFFF;
+    for (int i = 0; i < args_count; i++)
+    {
+        payload[words++] = args[i] & 0xFFFF;
+        payload[words++] = args[i] >> 16;
+    }
+    if (string != NULL)
+    {
+        size_t length = strlen(string) + 1;
+        for (size_t i = 0; i < length; i += 2)
+        {
+            payload[words++] = ((uint16_t)(uint8_t)string[i] << 8) | (i + 1 < length ? (uint8_t)string[i + 1] : 0);
+        }
+    }
+    return add_command(file, time_us, command_id, words * 2, payload) + COMMAND_GAP_US;
+}
+
+static void store_served(const ReplayCommand *command)
+{
+    served[served_count++] = *command;
+}
+
+// The default config and the shared memory as the firmware boots
+static void boot(void)
+{
+    host_flash_reset();
+    clear_config();
+    load_all_entries();
+    host_rom_clear();
+}
+
+static bool replay_through_emulator(FILE *file, ReplayInfo *info)
+{
+    served_count = 0;
+    rewind(file);
+    bool ok = replay_emulator(file, store_served, info);
+    fclose(file);
+    return ok;
+}
+
+static uint32_t read_token(void)
+{
+    return *(volatile uint32_t *)SHARED(0);
+}
+
+// The name of the first entry of a list of names separated by zeros, with the bytes of the words swapped
+static void shared_string(uint32_t offset, char *string, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        string[i] = *SHARED(offset + (i ^ 1));
+    }
+    string[size - 1] = '\0';
+}
+
+// The byte of a sector of the floppy image. Each sector has its own data
+static uint8_t floppy_byte(uint32_t sector, uint32_t offset)
+{
+    return (uint8_t)((sector * 13) ^ (offset * 7) ^ (offset >> 8));
+}
+
+static void write_file(const char *path, const uint8_t *data, uint32_t size)
+{
+    FIL file;
+    UINT written;
+    CHECK_EQ_INT(f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+    CHECK_EQ_INT(f_write(&file, data, size, &written), FR_OK);
+    CHECK_EQ_INT(written, size);
+    CHECK_EQ_INT(f_close(&file), FR_OK);
+}
+
+// The folders of the SD card of the field: the hard disk of GEMDRIVE, a floppy image and the ROMs
+static void create_card(void)
+{
+    static uint8_t image[FLOPPY_SECTORS * 512];
+    FATFS fs;
+    CHECK(host_disk_create(HOST_DISK_PATH, 64));
+    CHECK_EQ_INT(f_mount(&fs, "0:", 1), FR_OK);
+    CHECK_EQ_INT(f_mkdir("/hd"), FR_OK);
+    write_file("/hd/README.TXT", (const uint8_t *)"Hello", 5);
+    CHECK_EQ_INT(f_mkdir("/roms"), FR_OK);
+    write_file("/roms/BETA.ROM", image, 1024);
+    write_file("/roms/ALPHA.IMG", image, 2048);
+    write_file("/roms/NOTES.TXT", image, 10);
+
+    for (uint32_t sector = 0; sector < FLOPPY_SECTORS; sector++)
+    {
+        for (uint32_t i = 0; i < 512; i++)
+        {
+            image[sector * 512 + i] = floppy_byte(sector, i);
+        }
+    }
+    // The boot sector of a 720 KB disk
+    static const uint8_t bpb[] = {0x00, 0x02, 0x02, 0x01, 0x00, 0x02, 0x70, 0x00, 0xA0, 0x05, 0xF9, 0x05, 0x00, 0x09, 0x00, 0x02, 0x00};
+    memcpy(image + 11, bpb, sizeof(bpb));
+    CHECK_EQ_INT(f_mkdir("/floppies"), FR_OK);
+    write_file("/floppies/DISK.ST", image, sizeof(image));
+    f_unmount("0:");
+}
+
+// The checksum of a sector after the boot sector as the ST computes it: the sum of its big endian words
+static uint16_t floppy_checksum(uint32_t sector)
+{
+    uint16_t checksum = 0;
+    for (uint32_t i = 0; i < 512; i += 2)
+    {
+        checksum += ((uint16_t)floppy_byte(sector, i) << 8) | floppy_byte(sector, i + 1);
+    }
+    return checksum;
+}
+
+static void check_gemdrive(void)
+{
+    uint32_t args[] = {0x00012340, 0, 0};
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_GEMDRVEMUL);
+    // The driver of the ST pings first. GEMDRIVE mounts the card then
+    uint32_t time_us = add_token_command(file, 1000, GEMDRVEMUL_PING, 0xABCD0001, NULL, 0, NULL);
+    time_us = add_token_command(file, time_us, GEMDRVEMUL_FSFIRST_CALL, 0xABCD0002, args, 3, "C:\\*.TXT");
+
+    boot();
+    ReplayInfo info;
+    CHECK(replay_through_emulator(file, &info));
+    CHECK(!info.stopped);
+    CHECK_EQ_INT(served_count, 2);
+    CHECK_EQ_INT(served[0].command_id, GEMDRVEMUL_PING);
+    CHECK_EQ_INT(served[1].command_id, GEMDRVEMUL_FSFIRST_CALL);
+    CHECK_EQ_INT(served[1].payload_size, 2 * (2 + 3 * 2 + 5));
+    CHECK_EQ_INT(served[1].time_us, time_us - COMMAND_GAP_US - 2);
+    CHECK(served[1].handler_ns > 0);
+    CHECK_EQ_INT(read_token(), 0xABCD0002);
+    CHECK_EQ_INT(*(volatile int16_t *)SHARED(GEMDRVEMUL_PING_STATUS), 1);
+    CHECK_EQ_INT(*(volatile int16_t *)SHARED(GEMDRVEMUL_DTA_F_FOUND), 0);
+    char name[14];
+    shared_string(GEMDRVEMUL_DTA_TRANSFER + 30, name, sizeof(name));
+    CHECK_EQ_STR(name, "README.TXT");
+}
+
+static uint32_t add_read_sector(FILE *file, uint32_t time_us, uint32_t sector)
+{
+    // d3.l the size of the sector, d3.h the logical sector, d4.l the drive
+    uint32_t args[] = {512 | (sector << 16), 0};
+    return add_token_command(file, time_us, FLOPPYEMUL_READ_SECTORS, 0x5EC70000 + sector, args, 2, NULL);
+}
+
+static void check_floppy(void)
+{
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_FLOPPYEMUL);
+    add_read_sector(file, 1000, 7);
+
+    boot();
+    put_string(PARAM_FLOPPY_IMAGE_A, "DISK.ST");
+    ReplayInfo info;
+    CHECK(replay_through_emulator(file, &info));
+    CHECK(!info.stopped);
+    CHECK_EQ_INT(served_count, 1);
+    CHECK_EQ_INT(served[0].command_id, FLOPPYEMUL_READ_SECTORS);
+    CHECK_EQ_INT(read_token(), 0x5EC70007);
+    int mismatches = 0;
+    for (uint32_t i = 0; i < 512; i++)
+    {
+        mismatches += *SHARED(FLOPPYEMUL_IMAGE + (i ^ 1)) != floppy_byte(7, i);
+    }
+    CHECK_EQ_INT(mismatches, 0);
+    CHECK_EQ_INT(*(volatile uint16_t *)SHARED(FLOPPYEMUL_READ_CHECKSUM), floppy_checksum(7));
+}
+
+static void check_rtc(void)
+{
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_RTCEMUL);
+    add_token_command(file, 1000, RTCEMUL_READ_TIME, 0x7177E000, NULL, 0, NULL);
+
+    // The internal RTC at the time of the capture. Wednesday 31 December 2025 23:59:58
+    boot();
+    host_set_time_us(1000);
+    datetime_t now = {.year = 2025, .month = 12, .day = 31, .dotw = 3, .hour = 23, .min = 59, .sec = 58};
+    rtc_set_datetime(&now);
+    ReplayInfo info;
+    CHECK(replay_through_emulator(file, &info));
+    CHECK_EQ_INT(served_count, 1);
+    CHECK_EQ_INT(read_token(), 0x7177E000);
+    // The bytes of each word swapped for the ST
+    volatile uint8_t *datetime = SHARED(RTCEMUL_DATETIME);
+    CHECK_EQ_INT(datetime[1], 0x1B);
+    CHECK_EQ_INT(datetime[3], 0x12);
+    CHECK_EQ_INT(datetime[2], 0x31);
+    CHECK_EQ_INT(datetime[5], 0x23);
+    CHECK_EQ_INT(datetime[4], 0x59);
+    CHECK_EQ_INT(datetime[7], 0x58);
+}
+
+static void check_configurator(void)
+{
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_CONFIGURATOR);
+    uint32_t time_us = add_token_command(file, 1000, LIST_ROMS, 0xC0F10001, NULL, 0, NULL);
+    // The second ROM of the list. The configurator loads it and the board reboots
+    uint32_t second = 2;
+    time_us = add_token_command(file, time_us, LOAD_ROM, 0xC0F10002, &second, 1, NULL);
+    // Never served: the loop ended
+    add_token_command(file, time_us, LIST_ROMS, 0xC0F10003, NULL, 0, NULL);
+
+    boot();
+    ReplayInfo info;
+    CHECK(replay_through_emulator(file, &info));
+    CHECK(info.stopped);
+    CHECK_EQ_INT(served_count, 2);
+    CHECK_EQ_INT(served[0].command_id, LIST_ROMS);
+    CHECK_EQ_INT(served[1].command_id, LOAD_ROM);
+    // The words of the last command are not replayed
+    CHECK_EQ_INT(info.records, 5 + 7);
+    // The ROMs of the folder, in order, as listed by the first command
+    char name[16];
+    shared_string(RANDOM_SEED_SIZE, name, strlen("ALPHA.IMG") + 1);
+    CHECK_EQ_STR(name, "ALPHA.IMG");
+    shared_string(RANDOM_SEED_SIZE + strlen("ALPHA.IMG") + 1, name, strlen("BETA.ROM") + 1);
+    CHECK_EQ_STR(name, "BETA.ROM");
+}
+
+// All the sectors of the floppy disk as the ST reads them when it copies the disk
+static void check_floppy_speed(void)
+{
+    FILE *file = new_app_capture(CAPTURE_MAGIC, APP_FLOPPYEMUL);
+    uint32_t time_us = 1000;
+    for (uint32_t sector = 0; sector < FLOPPY_SECTORS; sector++)
+    {
+        time_us = add_read_sector(file, time_us, sector);
+    }
+
+    boot();
+    put_string(PARAM_FLOPPY_IMAGE_A, "DISK.ST");
+    ReplayInfo info;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CHECK(replay_through_emulator(file, &info));
+    double replay_s = elapsed_s(&start);
+    CHECK_EQ_INT(served_count, FLOPPY_SECTORS);
+    uint64_t handler_ns = 0;
+    uint64_t max_ns = 0;
+    for (int i = 0; i < served_count; i++)
+    {
+        handler_ns += served[i].handler_ns;
+        max_ns = served[i].handler_ns > max_ns ? served[i].handler_ns : max_ns;
+    }
+    CHECK_EQ_INT(*(volatile uint16_t *)SHARED(FLOPPYEMUL_READ_CHECKSUM), floppy_checksum(FLOPPY_SECTORS - 1));
+    printf("Replay of %d READ_SECTORS on the %s card: %.1f us per command in the emulator (max %.1f us), %.2f s in total\n",
+           served_count, host_disk_backend(), handler_ns / 1000.0 / served_count, max_ns / 1000.0, replay_s);
+    // The RP2040 is about 50 times slower than the host. A sector must still take less than a millisecond
+    CHECK(handler_ns / served_count < 20000);
+}
+
+int main(void)
+{
+    check_commands();
+    check_timeout();
+    check_timer_wrap();
+    check_bad_captures();
+    check_oversized();
+
+    create_card();
+    check_gemdrive();
+    check_floppy();
+    check_rtc();
+    check_configurator();
+    check_floppy_speed();
+    host_disk_remove();
+    return TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+/**
+ * File: test_rtc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The Dallas DS1216 clock of the RTC emulator with the accesses of the TOS driver: the
+ * magic sequence as reads of the write addresses, and then the reads of the bits of the clock. The
+ * 64 bits served must be the BCD time and date of the internal RTC, even if the second changes
+ * in the middle of a read
+ */
+
+#include "test.h"
+
+#include "include/dallas.h"
+#include "include/tprotocol.h"
+
+#define CLOCK_BITS 64
+#define MAGIC_ACCESSES 66        // Two accesses to reset and the 64 bits of the magic sequence
+#define ACCESS_US 2              // Time between two accesses of the ST
+#define SECOND_TICK_AT_READ 100  // The main loop swaps the buffers after this read
+
+// The magic sequence of the DS1216, from the datasheet. The bits go LSB first
+static const uint8_t magic[] = {0xC5, 0x3A, 0xA3, 0x5C, 0xC5, 0x3A, 0xA3, 0x5C};
+
+typedef struct
+{
+    DallasClock clock;
+    uint64_t now_us;
+    uint8_t rom_bit; // Byte at rom_address + read_address_bit
+} Clock;
+
+static void st_access(Clock *clock, uint8_t addr_lsb)
+{
+    uint8_t clock_bit = 0xAA;
+    clock->now_us += ACCESS_US;
+    if (dallas_access(&clock->clock, addr_lsb, clock->now_us, &clock_bit))
+    {
+        clock->rom_bit = clock_bit;
+    }
+}
+
+// The magic sequence as the TOS driver writes it, after two accesses to reset the clock
+static void write_magic_sequence(Clock *clock)
+{
+    st_access(clock, 0);
+    st_access(clock, 0);
+    for (int i = 0; i < CLOCK_BITS; i++)
+    {
+        st_access(clock, ((magic[i / 8] >> (i % 8)) & 1) ? DALLAS_WRITE_ADDRESS_BIT_ONE : DALLAS_WRITE_ADDRESS_BIT_ZERO);
+    }
+}
+
+// Reads all the bytes served after the magic sequence, until the clock stops serving them. A
+// tick of the second of the internal RTC can happen after a given read
+static int read_clock(Clock *clock, uint8_t *served, int max_reads, int tick_at_read, const datetime_t *tick)
+{
+    int reads = 0;
+    for (; reads < max_reads; reads++)
+    {
+        clock->rom_bit = 0xAA;
+        st_access(clock, DALLAS_READ_ADDRESS_BIT);
+        if (clock->rom_bit == 0xAA)
+        {
+            break;
+        }
+        served[reads] = clock->rom_bit;
+        if ((reads == tick_at_read) && (tick != NULL))
+        {
+            CHECK(dallas_prepare(&clock->clock, tick));
+        }
+    }
+    return reads;
+}
+
+// The 8 bytes of the clock in the 64 bits served after the first MAGIC_ACCESSES reads. Each bit is
+// served DALLAS_OFFSET_SYNC reads ahead, the time the ST takes to see the byte written in the ROM
+static void decode_clock(const uint8_t *served, uint8_t *bytes)
+{
+    const uint8_t *bits = served + MAGIC_ACCESSES - DALLAS_OFFSET_SYNC;
+    for (int i = 0; i < 8; i++)
+    {
+        bytes[i] = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            // The hundredths of second are always zero, and served before the bits of the clock
+            uint8_t value = (i * 8 + bit < DALLAS_OFFSET_SYNC) ? 0 : bits[i * 8 + bit];
+            CHECK((value == 0x00) || (value == 0xFF));
+            bytes[i] |= (value & 1) << bit;
+        }
+    }
+}
+
+static void check_bytes(const uint8_t *bytes, const uint8_t *expected)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK_EQ_INT(bytes[i], expected[i]);
+    }
+}
+
+static void check_read(void)
+{
+    Clock clock = {.now_us = 1000000};
+    uint8_t served[256];
+    uint8_t bytes[8];
+    dallas_init(&clock.clock, 0xFB0000);
+
+    // No second prepared yet: the magic sequence is not accepted and only zeroes are served
+    write_magic_sequence(&clock);
+    int reads = read_clock(&clock, served, sizeof(served), -1, NULL);
+    CHECK(reads > 0);
+    for (int i = 0; i < reads; i++)
+    {
+        CHECK_EQ_INT(served[i], 0);
+    }
+
+    // Tuesday 31 December 2024 23:59:58
+    datetime_t now = {.year = 2024, .month = 12, .day = 31, .dotw = 2, .hour = 23, .min = 59, .sec = 58};
+    CHECK(dallas_prepare(&clock.clock, &now));
+    // The same second is not prepared again
+    CHECK(!dallas_prepare(&clock.clock, &now));
+
+    clock.now_us += PROTOCOL_READ_RESTART_MICROSECONDS + 1;
+    write_magic_sequence(&clock);
+    reads = read_clock(&clock, served, sizeof(served), -1, NULL);
+    CHECK_EQ_INT(reads, MAGIC_ACCESSES + CLOCK_BITS + 1);
+    decode_clock(served, bytes);
+    static const uint8_t expected[] = {0x00, 0x58, 0x59, 0x23, 0x02, 0x31, 0x12, 0x24};
+    check_bytes(bytes, expected);
+    // Nothing after the last bit
+    for (int i = MAGIC_ACCESSES + CLOCK_BITS - DALLAS_OFFSET_SYNC; i < reads; i++)
+    {
+        CHECK_EQ_INT(served[i], 0);
+    }
+
+    // The second changes in the middle of a read: the read goes on with the second it latched
+    clock.now_us += PROTOCOL_READ_RESTART_MICROSECONDS + 1;
+    write_magic_sequence(&clock);
+    datetime_t next = {.year = 2025, .month = 1, .day = 1, .dotw = 3, .hour = 0, .min = 0, .sec = 0};
+    reads = read_clock(&clock, served, sizeof(served), SECOND_TICK_AT_READ, &next);
+    CHECK_EQ_INT(reads, MAGIC_ACCESSES + CLOCK_BITS + 1);
+    decode_clock(served, bytes);
+    check_bytes(bytes, expected);
+
+    // The next read of the ST gets the new second
+    clock.now_us += PROTOCOL_READ_RESTART_MICROSECONDS + 1;
+    write_magic_sequence(&clock);
+    reads = read_clock(&clock, served, sizeof(served), -1, NULL);
+    CHECK_EQ_INT(reads, MAGIC_ACCESSES + CLOCK_BITS + 1);
+    decode_clock(served, bytes);
+    static const uint8_t expected_next[] = {0x00, 0x00, 0x00, 0x00, 0x03, 0x01, 0x01, 0x25};
+    check_bytes(bytes, expected_next);
+}
+
+static void check_bad_sequences(void)
+{
+    Clock clock = {.now_us = 1000000};
+    uint8_t served[256];
+    dallas_init(&clock.clock, 0xFB0000);
+    datetime_t now = {.year = 2024, .month = 6, .day = 15, .dotw = 6, .hour = 12, .min = 34, .sec = 56};
+    CHECK(dallas_prepare(&clock.clock, &now));
+
+    // A wrong last bit of the magic sequence: the clock is not latched and no bit of the clock is served
+    st_access(&clock, 0);
+    st_access(&clock, 0);
+    for (int i = 0; i < CLOCK_BITS; i++)
+    {
+        bool one = ((magic[i / 8] >> (i % 8)) & 1) ^ (i == CLOCK_BITS - 1);
+        st_access(&clock, one ? DALLAS_WRITE_ADDRESS_BIT_ONE : DALLAS_WRITE_ADDRESS_BIT_ZERO);
+    }
+    int reads = read_clock(&clock, served, sizeof(served), -1, NULL);
+    for (int i = 0; i < reads; i++)
+    {
+        CHECK_EQ_INT(served[i], 0);
+    }
+
+    // A pause in the middle of the magic sequence starts it again
+    clock.now_us += PROTOCOL_READ_RESTART_MICROSECONDS + 1;
+    st_access(&clock, 0);
+    st_access(&clock, 0);
+    st_access(&clock, DALLAS_WRITE_ADDRESS_BIT_ONE);
+    clock.now_us += PROTOCOL_READ_RESTART_MICROSECONDS + 1;
+    write_magic_sequence(&clock);
+    reads = read_clock(&clock, served, sizeof(served), -1, NULL);
+    CHECK_EQ_INT(reads, MAGIC_ACCESSES + CLOCK_BITS + 1);
+    uint8_t bytes[8];
+    decode_clock(served, bytes);
+    static const uint8_t expected[] = {0x00, 0x56, 0x34, 0x12, 0x06, 0x15, 0x06, 0x24};
+    check_bytes(bytes, expected);
+}
+
+int main(void)
+{
+    check_read();
+    check_bad_sequences();
+    return TEST_RESULT();
+}
@@ -0,0 +1,122 @@
+/**
+ * File: test_trace.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The binary trace ring of the debug builds. The drain formats the records in order,
+ * reports the records lost when the ring is full, and keeps working across the wrap of the indexes
+ */
+
+// The ring only exists in the debug builds: trace.c and the command names are built here with it
+#undef _DEBUG
+#define _DEBUG 1
+
+#include "test.h"
+
+#include <unistd.h>
+
+#include "../trace.c"
+#include "../commands.c"
+
+/**
+ * One call to trace_drain, with the debug output captured in text. Empty when nothing was pending
+ */
+static void drain(char *text, size_t size)
+{
+    FILE *capture = tmpfile();
+    int saved = dup(fileno(stderr));
+    fflush(stderr);
+    dup2(fileno(capture), fileno(stderr));
+    trace_drain();
+    fflush(stderr);
+    dup2(saved, fileno(stderr));
+    close(saved);
+
+    rewind(capture);
+    size_t length = fread(text, 1, size - 1, capture);
+    text[length] = '\0';
+    fclose(capture);
+}
+
+static void check_empty(void)
+{
+    char text[256];
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "");
+}
+
+static void check_format(void)
+{
+    char text[256];
+    host_set_time_us(0x123456789ULL);
+    TRACE(TRACE_GEMDRIVE_COMMAND, DOWNLOAD_ROM, 16, 0);
+    host_advance_us(10);
+    TRACE(TRACE_DTA_LOOKUP, 1, 0xCAFEBABE, 3);
+    TRACE(TRACE_EVENT_COUNT, 0, 0, 0);
+
+    // One record per call, each with the timer of its TRACE
+    drain(text, sizeof(text));
+    char expected[256];
+    snprintf(expected, sizeof(expected), "@T 23456789 TRACE_GEMDRIVE_COMMAND %04x 00000010 00000000 DOWNLOAD_ROM\n",
+             DOWNLOAD_ROM);
+    CHECK_EQ_STR(text, expected);
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "@T 23456793 TRACE_DTA_LOOKUP 0001 cafebabe 00000003 \n");
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "@T 23456793 TRACE_UNKNOWN 0000 00000000 00000000 \n");
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "");
+}
+
+// The ring keeps the last TRACE_RING_SIZE records. The first drain reports the others as lost
+static void check_overflow(void)
+{
+    char text[256];
+    char expected[256];
+    for (int i = 0; i < TRACE_RING_SIZE + 10; i++)
+    {
+        TRACE(TRACE_USB_READ, 0, i, 1);
+    }
+    drain(text, sizeof(text));
+    snprintf(expected, sizeof(expected), "@T-LOST 10\n@T %08x TRACE_USB_READ 0000 %08x 00000001 \n", timer_hw->timerawl, 10);
+    CHECK_EQ_STR(text, expected);
+    for (int i = 11; i < TRACE_RING_SIZE + 10; i++)
+    {
+        drain(text, sizeof(text));
+        snprintf(expected, sizeof(expected), "@T %08x TRACE_USB_READ 0000 %08x 00000001 \n", timer_hw->timerawl, i);
+        CHECK_EQ_STR(text, expected);
+    }
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "");
+}
+
+// trace_head and trace_tail count the records since the boot and wrap at 32 bits
+static void check_index_wrap(void)
+{
+    char text[256];
+    char expected[256];
+    trace_head = 0xFFFFFFFC;
+    trace_tail = trace_head;
+    for (int i = 0; i < 8; i++)
+    {
+        TRACE(TRACE_USB_WRITE, 0, i, 1);
+    }
+    CHECK_EQ_INT(trace_head, 4);
+    for (int i = 0; i < 8; i++)
+    {
+        drain(text, sizeof(text));
+        snprintf(expected, sizeof(expected), "@T %08x TRACE_USB_WRITE 0000 %08x 00000001 \n", timer_hw->timerawl, i);
+        CHECK_EQ_STR(text, expected);
+    }
+    drain(text, sizeof(text));
+    CHECK_EQ_STR(text, "");
+}
+
+int main(void)
+{
+    check_empty();
+    check_format();
+    check_overflow();
+    check_index_wrap();
+    return TEST_RESULT();
+}
@@ -0,0 +1,272 @@
+/**
+ * File: test_usb_mass.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: The USB mass storage callbacks on a RAM block device. Random reads and writes
+ * must see the data of the host, and a timing model of the SD card and the USB bus gives the
+ * throughput of the sequential transfers against one synchronous sector per callback
+ */
+
+#include "test.h"
+
+#include "include/usb_mass.h"
+
+#define DISK_SECTORS 16384 // 8 MB
+#define SECTOR_SIZE 512
+
+// Timing model. SPI at the default SD_BAUD_RATE_KB of 12500: 328 us per sector. Each command
+// has a fixed cost, and a write waits for the card to program the blocks
+#define SD_COMMAND_US 250
+#define SD_SECTOR_US 328
+#define SD_WRITE_BUSY_US 1000
+#define USB_BYTE_NS 1000 // Full speed bulk transfers, about 1 MB/s
+
+static uint8_t disk[DISK_SECTORS * SECTOR_SIZE];
+static uint8_t reference[DISK_SECTORS * SECTOR_SIZE];
+static uint32_t disk_reads;
+static uint32_t disk_writes;
+static uint64_t disk_busy_us; // Time spent in the SD card by the last calls
+static bool fail_writes;
+static uint8_t last_sense_key;
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    (void)pdrv;
+    return 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+    (void)pdrv;
+    disk_reads++;
+    disk_busy_us += SD_COMMAND_US + (uint64_t)count * SD_SECTOR_US;
+    memcpy(buff, disk + (size_t)sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+    (void)pdrv;
+    disk_writes++;
+    disk_busy_us += SD_COMMAND_US + SD_WRITE_BUSY_US + (uint64_t)count * SD_SECTOR_US;
+    if (fail_writes)
+    {
+        return RES_ERROR;
+    }
+    memcpy(disk + (size_t)sector * SECTOR_SIZE, buff, (size_t)count * SECTOR_SIZE);
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    (void)pdrv;
+    if (cmd == GET_SECTOR_COUNT)
+    {
+        *(DWORD *)buff = DISK_SECTORS;
+    }
+    return RES_OK;
+}
+
+bool tud_msc_set_sense(uint8_t lun, uint8_t sense_key, uint8_t add_sense_code, uint8_t add_sense_qualifier)
+{
+    (void)lun;
+    (void)add_sense_code;
+    (void)add_sense_qualifier;
+    last_sense_key = sense_key;
+    return true;
+}
+
+// One READ10 or WRITE10 callback and the USB transfer of its data. The main loop runs while
+// the USB interrupt moves the packets, so its SD card time overlaps the transfer
+static uint64_t transfer(bool write, uint32_t lba, uint8_t *buffer, uint32_t size)
+{
+    disk_busy_us = 0;
+    int32_t result = write ? tud_msc_write10_cb(0, lba, 0, buffer, size) : tud_msc_read10_cb(0, lba, 0, buffer, size);
+    CHECK_EQ_INT(result, size);
+    uint64_t callback_us = disk_busy_us;
+    uint64_t usb_us = (uint64_t)size * USB_BYTE_NS / 1000;
+
+    disk_busy_us = 0;
+    usb_mass_poll();
+    uint64_t background_us = disk_busy_us;
+    host_advance_us(callback_us + (usb_us > background_us ? usb_us : background_us));
+    return callback_us + (usb_us > background_us ? usb_us : background_us);
+}
+
+// The time of the same transfer with one synchronous single block command per sector
+static uint64_t transfer_one_sector_per_callback(bool write, uint32_t size)
+{
+    uint64_t sd_us = SD_COMMAND_US + SD_SECTOR_US + (write ? SD_WRITE_BUSY_US : 0);
+    return (uint64_t)(size / SECTOR_SIZE) * (sd_us + SECTOR_SIZE * USB_BYTE_NS / 1000);
+}
+
+// Random reads and writes of the host. Every read must return the last data written
+static void check_random_access(void)
+{
+    static uint8_t buffer[USB_MASS_RUN_SIZE];
+    srand(20261018);
+    for (size_t i = 0; i < sizeof(disk); i++)
+    {
+        disk[i] = reference[i] = rand() & 0xFF;
+    }
+    for (int command = 0; command < 5000; command++)
+    {
+        uint32_t lba = (rand() % 3 == 0) ? (command * 37) % DISK_SECTORS : rand() % DISK_SECTORS;
+        uint32_t count = 1 + rand() % 64;
+        count = (lba + count > DISK_SECTORS) ? DISK_SECTORS - lba : count;
+        bool write = rand() % 2;
+        // TinyUSB splits a command in callbacks of up to CFG_TUD_MSC_EP_BUFSIZE bytes
+        for (uint32_t done = 0; done < count;)
+        {
+            uint32_t sectors = count - done;
+            sectors = sectors > USB_MASS_RUN_SIZE / SECTOR_SIZE ? USB_MASS_RUN_SIZE / SECTOR_SIZE : sectors;
+            uint32_t size = sectors * SECTOR_SIZE;
+            uint8_t *data = reference + (size_t)(lba + done) * SECTOR_SIZE;
+            if (write)
+            {
+                for (uint32_t k = 0; k < size; k++)
+                {
+                    buffer[k] = rand() & 0xFF;
+                }
+                memcpy(data, buffer, size);
+                CHECK_EQ_INT(tud_msc_write10_cb(0, lba + done, 0, buffer, size), size);
+            }
+            else
+            {
+                CHECK_EQ_INT(tud_msc_read10_cb(0, lba + done, 0, buffer, size), size);
+                if (memcmp(buffer, data, size) != 0)
+                {
+                    fprintf(stderr, "Command %d: read of LBA %u does not return the data written\n", command, lba + done);
+                    test_failures++;
+                }
+            }
+            done += sectors;
+            for (int polls = rand() % 3; polls > 0; polls--)
+            {
+                usb_mass_poll();
+            }
+            host_advance_us(rand() % 30000);
+        }
+    }
+    usb_mass_flush();
+    CHECK(memcmp(disk, reference, sizeof(disk)) == 0);
+}
+
+static void check_sequential_throughput(void)
+{
+    static uint8_t buffer[USB_MASS_RUN_SIZE];
+    const uint32_t total = DISK_SECTORS * SECTOR_SIZE;
+
+    // Sequential reads of 4 KB, as a file copy from the card
+    disk_reads = 0;
+    uint64_t read_us = 0;
+    for (uint32_t offset = 0; offset < total; offset += sizeof(buffer))
+    {
+        read_us += transfer(false, offset / SECTOR_SIZE, buffer, sizeof(buffer));
+    }
+    uint64_t read_baseline_us = transfer_one_sector_per_callback(false, total);
+    printf("Sequential read: %.0f KB/s, one sector per callback: %.0f KB/s. %u SD commands for %u runs\n",
+           total / 1024.0 / (read_us / 1e6), total / 1024.0 / (read_baseline_us / 1e6), disk_reads,
+           total / (uint32_t)sizeof(buffer));
+    // Only the first run is read in the callback. The rest come from the read ahead, and
+    // nothing is read after the end of the card
+    CHECK_EQ_INT(disk_reads, total / sizeof(buffer));
+    CHECK(read_us * 2 < read_baseline_us);
+
+    // Sequential writes. The host sends 4 KB callbacks, and some hosts 1 KB ones
+    static const uint32_t write_sizes[] = {USB_MASS_RUN_SIZE, 1024};
+    for (size_t w = 0; w < sizeof(write_sizes) / sizeof(write_sizes[0]); w++)
+    {
+        uint32_t size = write_sizes[w];
+        disk_writes = 0;
+        uint64_t write_us = 0;
+        for (uint32_t offset = 0; offset < total; offset += size)
+        {
+            write_us += transfer(true, offset / SECTOR_SIZE, buffer, size);
+        }
+        disk_busy_us = 0;
+        usb_mass_flush();
+        write_us += disk_busy_us;
+        uint64_t write_baseline_us = transfer_one_sector_per_callback(true, total);
+        printf("Sequential write in %u byte callbacks: %.0f KB/s, one sector per callback: %.0f KB/s. %u SD commands\n",
+               size, total / 1024.0 / (write_us / 1e6), total / 1024.0 / (write_baseline_us / 1e6), disk_writes);
+        // The consecutive callbacks are merged in runs of USB_MASS_RUN_SIZE
+        CHECK_EQ_INT(disk_writes, total / USB_MASS_RUN_SIZE);
+        CHECK(write_us * 2 < write_baseline_us);
+    }
+}
+
+// A staged write that fails in the background is reported in the next command
+static void check_write_error(void)
+{
+    static uint8_t buffer[SECTOR_SIZE];
+    CHECK_EQ_INT(tud_msc_write10_cb(0, 100, 0, buffer, sizeof(buffer)), sizeof(buffer));
+    fail_writes = true;
+    host_advance_us((USB_MASS_WRITE_IDLE_MS + 1) * 1000);
+    usb_mass_poll();
+    fail_writes = false;
+    last_sense_key = SCSI_SENSE_NONE;
+    CHECK_EQ_INT(tud_msc_write10_cb(0, 200, 0, buffer, sizeof(buffer)), -1);
+    CHECK_EQ_INT(last_sense_key, SCSI_SENSE_MEDIUM_ERROR);
+    // Reported once
+    CHECK_EQ_INT(tud_msc_write10_cb(0, 200, 0, buffer, sizeof(buffer)), sizeof(buffer));
+
+    // SYNCHRONIZE CACHE commits the staged writes before the answer
+    uint8_t const synchronize_cache[16] = {USB_MASS_SCSI_CMD_SYNCHRONIZE_CACHE_10};
+    disk_writes = 0;
+    CHECK_EQ_INT(tud_msc_scsi_cb(0, synchronize_cache, buffer, sizeof(buffer)), 0);
+    CHECK_EQ_INT(disk_writes, 1);
+}
+
+// Shared with GEMDRIVE. A write of GEMDRIVE between two sequential reads of the host must not be
+// hidden by the read ahead of the first read
+static void check_shared_write(void)
+{
+    static uint8_t buffer[USB_MASS_RUN_SIZE];
+    const uint32_t lba = 4096;
+    const uint32_t count = USB_MASS_RUN_SIZE / SECTOR_SIZE;
+    configSnapshot.sd_mass_storage = true;
+    CHECK(usb_mass_init_shared());
+    CHECK(tud_msc_test_unit_ready_cb(0));
+
+    memset(disk + (size_t)(lba + count) * SECTOR_SIZE, 0x11, USB_MASS_RUN_SIZE);
+    CHECK_EQ_INT(tud_msc_read10_cb(0, lba, 0, buffer, sizeof(buffer)), sizeof(buffer));
+    disk_reads = 0;
+    usb_mass_poll();
+    CHECK_EQ_INT(disk_reads, 1); // The next run is in the read ahead
+
+    // GEMDRIVE writes the next run in the main loop
+    uint8_t regions = blkarb_regions(lba + count, count);
+    CHECK(blkarb_lock(BLKARB_OWNER_GEMDRIVE, regions, true));
+    memset(disk + (size_t)(lba + count) * SECTOR_SIZE, 0x22, USB_MASS_RUN_SIZE);
+    blkarb_unlock(BLKARB_OWNER_GEMDRIVE, regions, true);
+
+    // The next poll runs the callback of the next read before usb_mass_task
+    disk_reads = 0;
+    CHECK_EQ_INT(tud_msc_read10_cb(0, lba + count, 0, buffer, sizeof(buffer)), sizeof(buffer));
+    CHECK_EQ_INT(disk_reads, 1);
+    CHECK_EQ_INT(buffer[0], 0x22);
+    CHECK_EQ_INT(buffer[sizeof(buffer) - 1], 0x22);
+    usb_mass_poll();
+
+    // The host is told that the card changed, once
+    CHECK(!tud_msc_test_unit_ready_cb(0));
+    CHECK_EQ_INT(last_sense_key, SCSI_SENSE_UNIT_ATTENTION);
+    CHECK(tud_msc_test_unit_ready_cb(0));
+}
+
+int main(void)
+{
+    uint32_t block_count = 0;
+    uint16_t block_size = 0;
+    tud_msc_capacity_cb(0, &block_count, &block_size);
+    CHECK_EQ_INT(block_count, DISK_SECTORS);
+    CHECK_EQ_INT(block_size, SECTOR_SIZE);
+
+    check_random_access();
+    check_sequential_throughput();
+    check_write_error();
+    check_shared_write();
+    return TEST_RESULT();
+}
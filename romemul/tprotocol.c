@@ -34,7 +34,13 @@ inline static void __not_in_flash_func(read_command)(uint16_t data)
 
 inline static void __not_in_flash_func(read_payload_size)(uint16_t data)
 {
-    if (data > 0)
+    if (data > MAX_PROTOCOL_PAYLOAD_SIZE)
+    {
+        // The payload buffer can't hold it, so it is not a command. Drop the frame
+        bus_stats.parse_oversized++;
+        nextTPstep = HEADER_DETECTION;
+    }
+    else if (data > 0)
     {
         transmission.payload_size = data; // Store incoming data as payload size
         nextTPstep = PAYLOAD_READ_START;
@@ -92,6 +98,7 @@ inline void __not_in_flash_func(process_command)(ProtocolCallback callback)
     // Here should pass the transmission message to a function that will handle the different commands
     // I think a good aproach would be to have a callback to custom functions that will handle the different commands
 
+    bus_stats.commands++;
     if (callback)
     {
         callback(&transmission);
@@ -107,9 +114,15 @@ inline void __not_in_flash_func(process_command)(ProtocolCallback callback)
 
 inline void __not_in_flash_func(parse_protocol)(uint16_t data, ProtocolCallback callback)
 {
+    CAPTURE(data);
     new_header_found = (((uint64_t)timer_hw->timerawh) << 32u | timer_hw->timerawl);
     if (new_header_found - last_header_found > PROTOCOL_READ_RESTART_MICROSECONDS)
     {
+        if (nextTPstep != HEADER_DETECTION)
+        {
+            // The rest of the command never arrived
+            bus_stats.parse_timeouts++;
+        }
         nextTPstep = HEADER_DETECTION;
     }
     switch (nextTPstep)
@@ -0,0 +1,71 @@
+/**
+ * File: trace.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Binary trace ring. The hot paths append fixed size records and the main loop
+ * formats them later, so tracing barely changes the timing
+ */
+
+#include "include/trace.h"
+
+#if defined(_DEBUG) && (_DEBUG != 0)
+// Only in the debug builds: the ring takes 8KB of RAM
+TraceRecord trace_ring[TRACE_RING_SIZE];
+uint32_t trace_head = 0;
+static uint32_t trace_tail = 0;
+
+static const char *event_names[] = {
+#define TRACE_EVENT_NAME(name) #name,
+    TRACE_EVENTS(TRACE_EVENT_NAME)
+#undef TRACE_EVENT_NAME
+};
+
+static const char *command_name(uint16_t command)
+{
+    for (int i = 0; i < numCommands; i++)
+    {
+        if (commandStr[i].value == command)
+        {
+            return commandStr[i].name;
+        }
+    }
+    return "";
+}
+
+void trace_drain(void)
+{
+    for (int i = 0; i < TRACE_DRAIN_BATCH; i++)
+    {
+        uint32_t lost = 0;
+        uint32_t irq = save_and_disable_interrupts();
+        if (trace_tail == trace_head)
+        {
+            restore_interrupts(irq);
+            return;
+        }
+        if (trace_head - trace_tail > TRACE_RING_SIZE)
+        {
+            lost = trace_head - trace_tail - TRACE_RING_SIZE;
+            trace_tail = trace_head - TRACE_RING_SIZE;
+        }
+        TraceRecord record = trace_ring[trace_tail++ & (TRACE_RING_SIZE - 1)];
+        restore_interrupts(irq);
+
+        if (lost > 0)
+        {
+            DPRINTFRAW(TRACE_LINE_PREFIX "-LOST %lu\n", (unsigned long)lost);
+        }
+        const char *name = record.event < TRACE_EVENT_COUNT ? event_names[record.event] : "TRACE_UNKNOWN";
+        bool is_command = (record.event == TRACE_GEMDRIVE_COMMAND) || (record.event == TRACE_GEMDRIVE_START) ||
+                          (record.event == TRACE_GEMDRIVE_END) || (record.event == TRACE_FLOPPY_COMMAND);
+        DPRINTFRAW(TRACE_LINE_PREFIX " %08lx %s %04x %08lx %08lx %s\n", (unsigned long)record.time_us, name, record.arg0,
+                   (unsigned long)record.arg1, (unsigned long)record.arg2,
+                   is_command ? command_name(record.arg0) : "");
+    }
+}
+#else
+void trace_drain(void)
+{
+}
+#endif
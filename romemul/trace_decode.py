@@ -0,0 +1,130 @@
+import argparse
+import re
+import sys
+
+# Lines written by trace_drain() in trace.c:
+# @T <time_us hex> <event> <arg0 hex> <arg1 hex> <arg2 hex> [command name]
+TRACE_LINE = re.compile(
+    r"@T ([0-9a-fA-F]{8}) (\w+) ([0-9a-fA-F]+) ([0-9a-fA-F]+) ([0-9a-fA-F]+)(?: (\w+))?"
+)
+LOST_LINE = re.compile(r"@T-LOST (\d+)")
+
+# Events that end the command started by a *_COMMAND event
+COMMAND_START = {"TRACE_GEMDRIVE_COMMAND": "GEMDRIVE", "TRACE_FLOPPY_COMMAND": "FLOPPY"}
+COMMAND_END = {
+    "TRACE_GEMDRIVE_END": "GEMDRIVE",
+    "TRACE_FLOPPY_READ": "FLOPPY",
+    "TRACE_FLOPPY_WRITE": "FLOPPY",
+}
+# Events with a command in arg0
+NAMED_EVENTS = {
+    "TRACE_GEMDRIVE_COMMAND",
+    "TRACE_GEMDRIVE_START",
+    "TRACE_GEMDRIVE_END",
+    "TRACE_FLOPPY_COMMAND",
+}
+
+
+def read_records(input_file):
+    # Unwrap the 32 bit microseconds timer, it wraps every 71 minutes
+    records = []
+    lost = 0
+    last = None
+    offset = 0
+    with open(input_file, "r", errors="replace") as f:
+        for line in f:
+            match = LOST_LINE.search(line)
+            if match:
+                lost += int(match.group(1))
+                continue
+            match = TRACE_LINE.search(line)
+            if not match:
+                continue
+            time_us = int(match.group(1), 16)
+            if last is not None and time_us < last:
+                offset += 1 << 32
+            last = time_us
+            records.append(
+                {
+                    "time_us": time_us + offset,
+                    "event": match.group(2),
+                    "arg0": int(match.group(3), 16),
+                    "arg1": int(match.group(4), 16),
+                    "arg2": int(match.group(5), 16),
+                    "name": match.group(6) or f"0x{int(match.group(3), 16):04X}",
+                }
+            )
+    return records, lost
+
+
+def print_timeline(records):
+    if not records:
+        return
+    start = records[0]["time_us"]
+    previous = start
+    for record in records:
+        print(
+            f"{(record['time_us'] - start) / 1000:12.3f} ms  +{record['time_us'] - previous:8d} us  "
+            f"{record['event']:<24} {record['arg0']:04x} {record['arg1']:08x} {record['arg2']:08x}  "
+            f"{record['name'] if record['event'] in NAMED_EVENTS else ''}"
+        )
+        previous = record["time_us"]
+
+
+def command_latencies(records):
+    # From the arrival in the IRQ to the end of the command in the main loop
+    pending = {}
+    latencies = {}
+    for record in records:
+        if record["event"] in COMMAND_START:
+            pending[COMMAND_START[record["event"]]] = record
+        elif record["event"] in COMMAND_END:
+            start = pending.pop(COMMAND_END[record["event"]], None)
+            if start is not None:
+                latencies.setdefault(start["name"], []).append(
+                    record["time_us"] - start["time_us"]
+                )
+    return latencies
+
+
+def print_histograms(latencies):
+    # Power of two buckets, in microseconds
+    for name in sorted(latencies):
+        values = sorted(latencies[name])
+        count = len(values)
+        print(
+            f"\n{name}: {count} commands, min {values[0]} us, "
+            f"p50 {values[count // 2]} us, p99 {values[min(count - 1, count * 99 // 100)]} us, max {values[-1]} us"
+        )
+        buckets = {}
+        for value in values:
+            buckets[max(value, 1).bit_length()] = buckets.get(max(value, 1).bit_length(), 0) + 1
+        for bits in sorted(buckets):
+            low = 1 << (bits - 1)
+            print(f"  {low:>8} - {(low << 1) - 1:<8} us {buckets[bits]:6d} {'#' * min(60, buckets[bits])}")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode the trace lines of a debug build from a serial log"
+    )
+    parser.add_argument("input_file", help="Serial log with the @T lines")
+    parser.add_argument(
+        "--no-timeline", action="store_true", help="Only print the latency histograms"
+    )
+    args = parser.parse_args()
+
+    records, lost = read_records(args.input_file)
+    if not records:
+        print("No trace records found", file=sys.stderr)
+        return 1
+    if not args.no_timeline:
+        print_timeline(records)
+    print_histograms(command_latencies(records))
+    if lost > 0:
+        print(f"\nWARNING: {lost} records lost. The latencies around them can be wrong")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -11,12 +11,137 @@
 static DWORD sz_drv;
 static DWORD sz_sect = 0;
 
+// While TinyUSB sends a run to the host, the main loop reads the next one here
+static UsbMassRun read_ahead = {0};
+static bool read_ahead_wanted = false;
+
+// Writes are acknowledged into a run and committed later. While one run is written to
+// the SD card from the main loop, the other receives the data from the host
+static UsbMassRun write_runs[2] = {0};
+static int write_active = 0;
+static uint64_t last_write_us = 0;
+static bool write_error = false; // A staged write failed. Reported in the next command
+
+// Shared with GEMDRIVE: the blocks are locked through the arbiter
+static bool shared = false;
+static bool media_changed = false; // GEMDRIVE wrote to the card. Reported to the host as a unit attention
+
 void cdc_task(void);
 
-void usb_mass_init()
+static bool commit_run(UsbMassRun *run)
+{
+    bool ok = true;
+    if (run->count > 0)
+    {
+        DRESULT res = disk_write(0, run->data, run->lba, run->count);
+        if (res != RES_OK)
+        {
+            DPRINTF("disk_write LBA %lu, count %lu failed: %d\n", run->lba, run->count, res);
+            write_error = true;
+            ok = false;
+        }
+        TRACE(TRACE_USB_COMMIT, ok, run->lba, run->count);
+    }
+    if (shared)
+    {
+        blkarb_unlock(BLKARB_OWNER_USB, run->regions, true);
+    }
+    run->regions = 0;
+    run->count = 0;
+    run->pending = false;
+    return ok;
+}
+
+// The other side of the card holds the blocks. The host retries after a NOT READY
+static bool lock_blocks(uint8_t lun, uint8_t regions, bool write)
+{
+    if (shared && !blkarb_lock(BLKARB_OWNER_USB, regions, write))
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x01); // Becoming ready
+        return false;
+    }
+    return true;
+}
+
+static void unlock_blocks(uint8_t regions, bool write)
+{
+    if (shared)
+    {
+        blkarb_unlock(BLKARB_OWNER_USB, regions, write);
+    }
+}
+
+// Commit all the staged writes. The closed run is older than the open one
+static void flush_writes()
+{
+    commit_run(&write_runs[write_active ^ 1]);
+    commit_run(&write_runs[write_active]);
+}
+
+// A failed staged write is reported as a medium error in the next command, as a disk with a write cache does
+static bool check_write_error(uint8_t lun)
+{
+    if (write_error)
+    {
+        write_error = false;
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // Write error
+        return false;
+    }
+    return true;
+}
+
+// GEMDRIVE wrote to the card. The read ahead could be old
+static void check_gemdrive_changes()
+{
+    if (shared && (blkarb_take_changes(BLKARB_OWNER_USB) != 0))
+    {
+        read_ahead.count = 0;
+        read_ahead_wanted = false;
+        media_changed = true;
+    }
+}
+
+// Background work between the USB transfers. The USB interrupt moves the packets of the
+// current run meanwhile
+static void usb_mass_task()
+{
+    check_gemdrive_changes();
+    UsbMassRun *closed = &write_runs[write_active ^ 1];
+    UsbMassRun *open = &write_runs[write_active];
+    if (closed->pending)
+    {
+        commit_run(closed);
+        return;
+    }
+    if ((open->count > 0) && (time_us_64() - last_write_us >= (uint64_t)USB_MASS_WRITE_IDLE_MS * 1000))
+    {
+        commit_run(open);
+        return;
+    }
+    if (read_ahead_wanted)
+    {
+        read_ahead_wanted = false;
+        uint32_t count = USB_MASS_RUN_SIZE / sz_sect;
+        if (read_ahead.lba + count > sz_drv)
+        {
+            count = sz_drv - read_ahead.lba;
+        }
+        uint8_t regions = blkarb_regions(read_ahead.lba, count);
+        if ((count > 0) && (!shared || blkarb_lock(BLKARB_OWNER_USB, regions, false)))
+        {
+            if (disk_read(0, read_ahead.data, read_ahead.lba, count) == RES_OK)
+            {
+                read_ahead.count = count;
+            }
+            unlock_blocks(regions, false);
+        }
+    }
+}
+
+// Initialize the SD card in block mode if the USB mass storage is enabled
+static bool init_block_device()
 {
-    ConfigEntry *sd_card_mass_storage_enabled = find_entry(PARAM_SD_MASS_STORAGE);
-    if ((sd_card_mass_storage_enabled != NULL) && (sd_card_mass_storage_enabled->value[0] == 't' || sd_card_mass_storage_enabled->value[0] == 'T'))
+    if (configSnapshot.sd_mass_storage)
     {
         DPRINTF("USB Mass storage flag set to enabled\n");
         DPRINTF("TUD_OPT_HIGH_SPEED: %s\n", TUD_OPT_HIGH_SPEED ? "true" : "false");
@@ -33,14 +158,53 @@ void usb_mass_init()
         else
         {
             DPRINTF("SD card initialized\n");
-            // Start the USB Mass storage device
-            usb_mass_start();
+            return true;
         }
     }
     else
     {
         DPRINTF("USB Mass storage flag set to disabled\n");
     }
+    return false;
+}
+
+void usb_mass_init()
+{
+    if (init_block_device())
+    {
+        // Start the USB Mass storage device
+        usb_mass_start();
+    }
+}
+
+bool usb_mass_init_shared()
+{
+    if (!init_block_device())
+    {
+        return false;
+    }
+    DPRINTF("Init USB shared with GEMDRIVE\n");
+    shared = true;
+    tud_init(BOARD_TUD_RHPORT);
+    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
+    return true;
+}
+
+bool usb_mass_is_shared()
+{
+    return shared;
+}
+
+void usb_mass_poll()
+{
+    tud_task(); // tinyusb device task
+    cdc_task();
+    usb_mass_task();
+}
+
+void usb_mass_flush()
+{
+    flush_writes();
 }
 
 void usb_mass_start(void)
@@ -58,8 +222,8 @@ void usb_mass_start(void)
     // while (cyw43_arch_gpio_get(CYW43_WL_GPIO_VBUS_PIN))
     while (1)
     {
-        tud_task(); // tinyusb device task
-        cdc_task();
+        usb_mass_poll();
+        trace_drain();
     }
     reboot();
     while (1)
@@ -185,6 +349,15 @@ bool tud_msc_test_unit_ready_cb(uint8_t lun)
         return false;
     }
 
+    if (media_changed)
+    {
+        // Additional Sense 28-00 is NOT READY TO READY CHANGE, MEDIUM MAY HAVE CHANGED.
+        // The host reads the card again instead of trusting its cache
+        media_changed = false;
+        tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+        return false;
+    }
+
     return true;
 }
 
@@ -240,6 +413,7 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
         {
             // unload disk storage
             DPRINTF("UNLOAD DISK STORAGE\n");
+            flush_writes();
             ejected = true;
         }
     }
@@ -249,23 +423,49 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
 
 // Callback invoked when received READ10 command.
 // Copy disk's data to buffer (up to bufsize) and return number of copied bytes.
+// A command is served in runs of up to CFG_TUD_MSC_EP_BUFSIZE bytes
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize)
 {
-    (void)lun;
-
     if (offset != 0)
         return -1;
-    if (bufsize != sz_sect)
+    if ((sz_sect == 0) || (bufsize == 0) || (bufsize % sz_sect != 0))
         return -1;
-    if (lba >= sz_drv)
+    uint32_t count = bufsize / sz_sect;
+    if (lba + count > sz_drv)
         return -1;
 
-    DPRINTF("Read10 LBA %lu, bufsize %lu, offset %lu\n", lba, bufsize, offset);
+    // Read what the host wrote, not the old content. GEMDRIVE can write between the read ahead
+    // and this callback, because tud_task runs before usb_mass_task
+    flush_writes();
+    if (!check_write_error(lun))
+        return -1;
+    check_gemdrive_changes();
 
-    DRESULT res = disk_read(0, buffer, lba, 1);
+    bool hit = (read_ahead.count > 0) && (lba >= read_ahead.lba) && (lba + count <= read_ahead.lba + read_ahead.count);
+    TRACE(TRACE_USB_READ, hit, lba, count);
+    if (hit)
+    {
+        memcpy(buffer, read_ahead.data + (lba - read_ahead.lba) * sz_sect, bufsize);
+    }
+    else
+    {
+        uint8_t regions = blkarb_regions(lba, count);
+        if (!lock_blocks(lun, regions, false))
+            return -1;
+        DRESULT res = disk_read(0, buffer, lba, count);
+        unlock_blocks(regions, false);
+        if (res != RES_OK)
+        {
+            DPRINTF("disk_read LBA %lu, count %lu failed: %d\n", lba, count, res);
+            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00); // Unrecovered read error
+            return -1;
+        }
+    }
 
-    if (res != RES_OK)
-        return res;
+    // Most reads are sequential. Read the next run while this one is sent
+    read_ahead.lba = lba + count;
+    read_ahead.count = 0;
+    read_ahead_wanted = true;
 
     return (int32_t)bufsize;
 }
@@ -276,24 +476,52 @@ bool tud_msc_is_writable_cb(uint8_t lun)
     return !USBDRIVE_READ_ONLY;
 }
 
+// The data is acknowledged once copied to the open run. Consecutive writes are merged
+// into one multi-block write
 int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
 {
-    (void)lun;
-
     if (offset != 0)
         return -1;
-    if (bufsize != sz_sect)
+    if ((sz_sect == 0) || (bufsize == 0) || (bufsize % sz_sect != 0))
         return -1;
-    if (lba >= sz_drv)
+    uint32_t count = bufsize / sz_sect;
+    if (lba + count > sz_drv)
         return -1;
 
-    DPRINTF("Write10 LBA %lu, Offset %lu, Size %lu\n", lba, offset, bufsize);
+    if (!check_write_error(lun))
+        return -1;
+    TRACE(TRACE_USB_WRITE, 0, lba, count);
 
-    DRESULT res = disk_write(0, buffer, lba, 1);
-    if (res != RES_OK)
-        return res;
+    // The read ahead could have the old content of the sectors
+    read_ahead.count = 0;
+    read_ahead_wanted = false;
 
-    int32_t status = 0;
+    UsbMassRun *run = &write_runs[write_active];
+    if ((run->count > 0) && ((lba != run->lba + run->count) || ((run->count + count) * sz_sect > USB_MASS_RUN_SIZE)))
+    {
+        // Close the run and continue in the other one. The main loop commits it
+        UsbMassRun *next = &write_runs[write_active ^ 1];
+        if (next->pending)
+        {
+            // The SD card is behind the host. Commit here, the run must be free
+            commit_run(next);
+        }
+        run->pending = true;
+        write_active ^= 1;
+        run = next;
+    }
+    // The staged blocks stay locked until they are committed
+    uint8_t regions = blkarb_regions(lba, count) & ~run->regions;
+    if (!lock_blocks(lun, regions, true))
+        return -1;
+    run->regions |= regions;
+    if (run->count == 0)
+    {
+        run->lba = lba;
+    }
+    memcpy(run->data + run->count * sz_sect, buffer, bufsize);
+    run->count += count;
+    last_write_us = time_us_64();
 
     return (int32_t)bufsize;
 }
@@ -319,6 +547,11 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, u
         // Host is about to read/write etc ... better not to disconnect disk
         resplen = 0;
         break;
+    case USB_MASS_SCSI_CMD_SYNCHRONIZE_CACHE_10:
+        // Commit the staged writes before answering
+        flush_writes();
+        resplen = check_write_error(lun) ? 0 : -1;
+        break;
     default:
         // Set Sense = Invalid Command Operation
         tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
@@ -53,7 +53,8 @@ vfs_dirent_t* vfs_readdir(vfs_dir_t* dir) {
 	FRESULT r = f_readdir(dir, &fi);
 	if (r != FR_OK) return NULL;
 	if (fi.fname[0] == 0) return NULL;
-	memcpy(dir_ent.name, fi.fname, sizeof(fi.fname));
+	/* fname is the long name, cut to the 8.3 size of the dirent */
+	strncpy(dir_ent.name, fi.fname, sizeof(dir_ent.name) - 1);
 	return &dir_ent;
 }
 
@@ -68,6 +69,8 @@ int vfs_stat(vfs_t* vfs, const char* filename, vfs_stat_t* st) {
 	}
 	st->st_size = f.fsize;
 	st->st_mode = f.fattrib;
+	st->st_fdate = f.fdate;
+	st->st_ftime = f.ftime;
 	struct tm tm = {
 		.tm_sec = 2*(f.ftime & 0x1f),
 		.tm_min = (f.ftime >> 5) & 0x3f,
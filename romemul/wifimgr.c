@@ -0,0 +1,202 @@
+/**
+ * File: wifimgr.c
+ * Author: Diego Parrilla Santamaría
+ * Date: October 2026
+ * Copyright: 2023 - GOODDATA LABS SL
+ * Description: Non-blocking Wi-Fi connection manager. Joins, keeps and recovers the connection
+ * for the emulators without busy-wait loops
+ */
+
+#include "include/wifimgr.h"
+
+static WifiManager manager = {.state = WIFI_MANAGER_STOPPED, .status = DISCONNECTED};
+
+static void set_state(WifiManagerState state)
+{
+    if (manager.state != state)
+    {
+        manager.state = state;
+        if (manager.callback != NULL)
+        {
+            manager.callback(state, manager.arg);
+        }
+    }
+}
+
+// With a static IP the link is usable without the IP address of the DHCP server
+static bool is_connected(ConnectionStatus status)
+{
+    return (status == CONNECTED_WIFI_IP) || ((status == CONNECTED_WIFI_NO_IP) && !configSnapshot.wifi_dhcp);
+}
+
+// Join the network. With the cached access point the chip skips the scan
+static void join()
+{
+    int err;
+    manager.attempt_us = time_us_64();
+    manager.fast_join = manager.ap_cached;
+    if (manager.fast_join)
+    {
+        err = network_rejoin(manager.bssid, manager.channel, manager.pass);
+    }
+    else
+    {
+        err = network_init(true, NETWORK_CONNECTION_ASYNC, manager.pass);
+    }
+    if (err < 0)
+    {
+        DPRINTF("Cannot start the WiFi join: %d\n", err);
+        manager.retry_us = time_us_64() + (uint64_t)manager.retry_delay_ms * 1000;
+        set_state(WIFI_MANAGER_RETRYING);
+        return;
+    }
+    set_state(WIFI_MANAGER_CONNECTING);
+}
+
+// The join failed. Try once more without the cached access point, then wait longer each time
+static void join_failed()
+{
+    if (manager.fast_join)
+    {
+        DPRINTF("Join with the cached access point failed. Scanning again\n");
+        manager.ap_cached = false;
+        join();
+        return;
+    }
+    network_terminate();
+    manager.retry_us = time_us_64() + (uint64_t)manager.retry_delay_ms * 1000;
+    DPRINTF("Connection failed. Retrying in %d ms...\n", manager.retry_delay_ms);
+    manager.retry_delay_ms = manager.retry_delay_ms * 1.2;
+    if (manager.retry_delay_ms > WIFI_MANAGER_RETRY_MAX_MS)
+    {
+        manager.retry_delay_ms = WIFI_MANAGER_RETRY_MAX_MS;
+    }
+    set_state(WIFI_MANAGER_RETRYING);
+}
+
+static void connected()
+{
+    manager.retry_delay_ms = WIFI_MANAGER_RETRY_MS;
+    manager.timeout_ms = 0; // Once connected, a lost link is recovered whatever it takes
+    manager.ap_cached = network_get_access_point(manager.bssid, &manager.channel);
+    if (manager.lost_us != 0)
+    {
+        manager.last_reconnect_ms = (uint32_t)((time_us_64() - manager.lost_us) / 1000);
+        manager.reconnects++;
+        manager.lost_us = 0;
+        DPRINTF("WiFi reconnected in %d ms\n", manager.last_reconnect_ms);
+    }
+#if defined(_DEBUG) && (_DEBUG != 0)
+    ConnectionData connection_data = {0};
+    get_connection_data(&connection_data);
+    DPRINTF("Connected - SSID: %s - IPv4: %s - GW:%s - Mask:%s - MAC:%s - Channel: %d\n",
+            connection_data.ssid,
+            connection_data.ipv4_address,
+            print_ipv4(get_gateway()),
+            print_ipv4(get_netmask()),
+            print_mac(get_mac_address()),
+            manager.ap_cached ? manager.channel : 0);
+#endif
+    set_state(WIFI_MANAGER_CONNECTED);
+}
+
+void wifi_manager_start(char **pass, uint32_t timeout_ms, wifi_manager_callback_t callback, void *arg)
+{
+    if ((manager.state != WIFI_MANAGER_STOPPED) && (manager.state != WIFI_MANAGER_TIMEOUT))
+    {
+        network_terminate();
+    }
+    manager.ap_cached = false;
+    manager.pass = pass;
+    manager.timeout_ms = timeout_ms;
+    manager.callback = callback;
+    manager.arg = arg;
+    manager.start_us = time_us_64();
+    manager.retry_delay_ms = WIFI_MANAGER_RETRY_MS;
+    manager.lost_us = 0;
+    manager.status = DISCONNECTED;
+    join();
+}
+
+WifiManagerState wifi_manager_poll()
+{
+    if ((manager.state == WIFI_MANAGER_STOPPED) || (manager.state == WIFI_MANAGER_TIMEOUT))
+    {
+        return manager.state;
+    }
+#if PICO_CYW43_ARCH_POLL
+    network_safe_poll();
+#endif
+    uint64_t now_us = time_us_64();
+    if ((manager.timeout_ms > 0) && (manager.state != WIFI_MANAGER_CONNECTED) &&
+        (now_us - manager.start_us >= (uint64_t)manager.timeout_ms * 1000))
+    {
+        DPRINTF("Timeout reached. Skipping network initialization.\n");
+        network_terminate();
+        set_state(WIFI_MANAGER_TIMEOUT);
+        return manager.state;
+    }
+    if (manager.state == WIFI_MANAGER_RETRYING)
+    {
+        if (now_us >= manager.retry_us)
+        {
+            join();
+        }
+        return manager.state;
+    }
+
+    // Read the link status only after a link event, or from time to time
+    uint32_t check_ms = (manager.state == WIFI_MANAGER_CONNECTED) ? WIFI_MANAGER_CHECK_CONNECTED_MS : WIFI_MANAGER_CHECK_CONNECTING_MS;
+    if (!network_take_link_event() && (now_us - manager.check_us < (uint64_t)check_ms * 1000))
+    {
+        return manager.state;
+    }
+    manager.check_us = now_us;
+    manager.status = get_network_connection_status();
+
+    if (manager.state == WIFI_MANAGER_CONNECTED)
+    {
+        if (!is_connected(manager.status))
+        {
+            // The access point is gone for a moment. Join it again without scanning
+            DPRINTF("WiFi link lost. Joining again...\n");
+            manager.lost_us = now_us;
+            join();
+        }
+        return manager.state;
+    }
+
+    // Connecting
+    if (is_connected(manager.status))
+    {
+        connected();
+    }
+    else if ((manager.status == GENERIC_ERROR) || (manager.status == CONNECT_FAILED_ERROR) || (manager.status == BADAUTH_ERROR) ||
+             (now_us - manager.attempt_us >= (uint64_t)WIFI_MANAGER_JOIN_TIMEOUT_MS * 1000))
+    {
+        join_failed();
+    }
+    return manager.state;
+}
+
+void wifi_manager_stop()
+{
+    network_terminate();
+    manager.status = DISCONNECTED;
+    set_state(WIFI_MANAGER_STOPPED);
+}
+
+WifiManagerState wifi_manager_get_state()
+{
+    return manager.state;
+}
+
+ConnectionStatus wifi_manager_get_status()
+{
+    return manager.status;
+}
+
+const WifiManager *wifi_manager_get()
+{
+    return &manager;
+}